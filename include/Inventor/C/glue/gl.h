@@ -561,6 +561,11 @@ COIN_DLL_API void cc_glglue_glGetQueryObjectuiv(const cc_glglue * glue,
                                                 GLuint id, GLenum pname, 
                                                 GLuint * params);
 
+/* ARB_instanced_arrays */
+COIN_DLL_API SbBool cc_glglue_has_instanced_arrays(const cc_glglue * glue);
+COIN_DLL_API void cc_glglue_glVertexAttribDivisor(const cc_glglue * glue,
+                                                  GLuint index, GLuint divisor);
+
 /* framebuffer_object */
 COIN_DLL_API void cc_glglue_glIsRenderbuffer(const cc_glglue * glue, GLuint renderbuffer);
 COIN_DLL_API void cc_glglue_glBindRenderbuffer(const cc_glglue * glue, GLenum target, GLuint renderbuffer);
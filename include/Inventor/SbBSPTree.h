@@ -63,6 +63,8 @@ public:
   void setUserData(const int idx, void * const data);
 
   int addPoint(const SbVec3f & pt, void * const userdata = NULL);
+  void addPoints(const SbVec3f * const points, const int numpoints,
+                 int * const indices = NULL);
   int removePoint(const SbVec3f & pt);
   void removePoint(const int idx);
   int findPoint(const SbVec3f & pos) const;
@@ -70,6 +72,7 @@ public:
   void clear(const int initsize = 4);
   void findPoints(const SbSphere & sphere, SbIntList & array) const;
   int findClosest(const SbSphere & sphere, SbIntList & array) const;
+  void findNearest(const SbVec3f & pos, const int k, SbIntList & array) const;
 
   const SbBox3f & getBBox() const;
   const SbVec3f * getPointsArrayPtr() const;
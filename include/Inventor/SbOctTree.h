@@ -79,11 +79,30 @@ public:
                  SbList <void*> & destarray,
                  const SbBool removeduplicates= TRUE) const;
 
+  void findItems(const SbBox3f * const boxes,
+                 const int numboxes,
+                 SbList <void*> & destarray,
+                 SbList <int> & offsets) const;
+  void findItems(const SbSphere * const spheres,
+                 const int numspheres,
+                 SbList <void*> & destarray,
+                 SbList <int> & offsets) const;
+  void findItems(const SbPlane * const planes,
+                 const int numplanes,
+                 const int numqueries,
+                 SbList <void*> & destarray,
+                 SbList <int> & offsets) const;
+
+  void optimize(void (*itemboxfunc)(void * const item, SbBox3f & box) = NULL);
+  SbBool isOptimized(void) const;
+
   const SbBox3f & getBoundingBox(void) const;
   void clear(void);
   void debugTree(FILE * fp);
 
 private:
+  void dropOptimization(void);
+
   SbOctTreeNode * topnode;
   SbOctTreeFuncs itemfuncs;
   int maxitemspernode;
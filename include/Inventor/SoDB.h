@@ -64,6 +64,8 @@ public:
   static SbBool read(SoInput * input, SoNode *& rootnode);
   static SoSeparator * readAll(SoInput * input);
   static SoVRMLGroup * readAllVRML(SoInput * input);
+  static void setNumReadThreads(const int numthreads);
+  static int getNumReadThreads(void);
   static SbBool isValidHeader(const char * teststring);
   static SbBool registerHeader(const SbString & headerstring,
                                SbBool isbinary,
@@ -103,6 +105,10 @@ public:
   static SbBool isNotifying(void);
   static void endNotify(void);
 
+  static void beginNotificationBatch(void);
+  static void commitNotificationBatch(void);
+  static SbBool isNotificationBatchActive(void);
+
   typedef SbBool ProgressCallbackType(const SbName & itemid, float fraction,
                                       SbBool interruptible, void * userdata);
   static void addProgressCallback(ProgressCallbackType * func, void * userdata);
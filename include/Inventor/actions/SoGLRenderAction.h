@@ -84,6 +84,12 @@ public:
     CUSTOM_CALLBACK
   };
 
+  enum OcclusionCullingType {
+    OCCLUSION_CULLING_NONE,
+    OCCLUSION_CULLING_SOFTWARE,
+    OCCLUSION_CULLING_HARDWARE
+  };
+
   typedef AbortCode SoGLRenderAbortCB(void * userdata);
 
   void setViewportRegion(const SbViewportRegion & newregion);
@@ -135,6 +141,11 @@ public:
   SbBool isRenderingTranspPaths(void) const;
   SbBool isRenderingTranspBackfaces(void) const;
 
+  void setOcclusionCullingType(const OcclusionCullingType type);
+  OcclusionCullingType getOcclusionCullingType(void) const;
+  void getOcclusionCullingStatistics(int & numtested, int & numculled,
+                                     int & numoccluders, int & numqueries) const;
+
 protected:
   friend class SoGLRenderActionP; // calls beginTraversal
   virtual void beginTraversal(SoNode * node);
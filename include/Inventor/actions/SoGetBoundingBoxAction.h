@@ -84,6 +84,9 @@ public:
   SbBool isCenterSet(void) const;
   void resetCenter(void);
 
+  void setNumThreads(int numthreads);
+  int getNumThreads(void) const;
+
 protected:
   virtual void beginTraversal(SoNode * node);
 
@@ -99,6 +102,7 @@ private:
 
 private:
   SbLazyPimplPtr<SoGetBoundingBoxActionP> pimpl;
+  friend class SoGetBoundingBoxActionP;
 
   SoGetBoundingBoxAction(const SoGetBoundingBoxAction & rhs);
   SoGetBoundingBoxAction & operator = (const SoGetBoundingBoxAction & rhs);
@@ -37,6 +37,8 @@
 
 class SoSimplifier;
 class SoSeparator;
+class SoPath;
+class SoPickedPoint;
 class SoReorganizeActionP;
 
 class COIN_DLL_API SoReorganizeAction : public SoSimplifyAction {
@@ -61,6 +63,11 @@ public:
   SbBool areVPNodesGenerated(void); 
   void matchIndexArrays(SbBool onoff);
   SbBool areIndexArraysMatched(void) const;
+  void mergeShapes(SbBool onoff);
+  SbBool areShapesMerged(void) const;
+  void setMergeTriangleLimit(int numtriangles);
+  int getMergeTriangleLimit(void) const;
+  const SoPath * getOriginalPath(const SoPickedPoint * pp, int * faceindex = NULL) const;
   SoSimplifier * getSimplifier(void) const;
 
   virtual void apply(SoNode * root);
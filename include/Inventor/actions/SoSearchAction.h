@@ -40,6 +40,7 @@
 #include <Inventor/lists/SoPathList.h>
 
 class SoSearchActionP;
+class SoSearchIndex;
 
 class COIN_DLL_API SoSearchAction : public SoAction {
   typedef SoAction inherited;
@@ -71,6 +72,9 @@ public:
   SoPathList & getPaths(void);
   void reset(void);
 
+  void setIndex(SoSearchIndex * index);
+  SoSearchIndex * getIndex(void) const;
+
   void setFound(void);
   SbBool isFound(void) const;
   void addPath(SoPath * const path);
@@ -93,6 +97,9 @@ private:
   SoPathList paths;
 
 private:
+  friend class SoSearchIndexP;
+  void setPathCallback(void (*callback)(void * closure, SoPath * path), void * closure);
+
   SbLazyPimplPtr<SoSearchActionP> pimpl;
 
   // NOT IMPLEMENTED:
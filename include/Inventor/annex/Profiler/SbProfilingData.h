@@ -64,6 +64,11 @@ public:
   SbTime getActionStopTime(void) const;
   SbTime getActionDuration(void) const;
 
+  // timings for phases of the action that are not node traversals
+  void addPhaseTiming(const char * phase, SbTime timing);
+  SbTime getPhaseTiming(const char * phase) const;
+  void getPhaseKeyList(SbList<const char *> & keys_out) const;
+
   // profiling setters
   enum FootprintType {
     MEMORY_SIZE,
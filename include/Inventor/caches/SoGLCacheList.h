@@ -35,11 +35,18 @@
 
 #include <Inventor/SbBasic.h>
 #include <Inventor/lists/SbList.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SoType.h>
 
 class SoGLRenderAction;
 class SoGLRenderCache;
+class SoGLCacheList;
 class SoGLCacheListP;
 
+typedef SbBool SoGLCacheListPolicyCB(void * closure, const SoGLCacheList * list,
+                                     SoGLRenderAction * action,
+                                     SbBool autocache, SbBool createcache);
+
 
 class COIN_DLL_API SoGLCacheList {
 public:
@@ -53,6 +60,24 @@ public:
 
   void invalidateAll(void);
 
+  int getNumCaches(void) const;
+  int getNumValidFrames(void) const;
+
+  int getNumHits(void) const;
+  int getNumMisses(void) const;
+  int getNumBuilt(void) const;
+  int getNumFailedBuilds(void) const;
+  SbTime getBuildTime(void) const;
+  int getNumInvalidations(void) const;
+  int getNumInvalidations(const SoType elementtype) const;
+  void getInvalidationCauses(SbList<SoType> & elementtypes,
+                             SbList<int> & counts) const;
+  size_t getMemoryUsage(void) const;
+  void resetStatistics(void);
+
+  static void setCachePolicyCallback(SoGLCacheListPolicyCB * func,
+                                     void * closure);
+
 private:
   SoGLCacheListP * pimpl;
 };
@@ -63,6 +63,11 @@ public:
     ABORT
   };
 
+  enum CallbackOrdering {
+    ORDERED,
+    UNORDERED
+  };
+
   typedef SoCallbackAction::Response SoIntersectionVisitationCB(void * closure, const SoPath * where);
   typedef SbBool SoIntersectionFilterCB(void * closure, const SoPath * p1, const SoPath * p2);
   typedef Resp SoIntersectionCB(void * closure, const SoIntersectingPrimitive * p1, const SoIntersectingPrimitive * p2);
@@ -85,6 +90,12 @@ public:
   void setShapeInternalsEnabled(SbBool enable);
   SbBool isShapeInternalsEnabled(void) const;
 
+  void setNumThreads(int numthreads);
+  int getNumThreads(void) const;
+
+  void setCallbackOrdering(CallbackOrdering ordering);
+  CallbackOrdering getCallbackOrdering(void) const;
+
   void addVisitationCallback(SoType type, SoIntersectionVisitationCB * cb, void * closure);
   void removeVisitationCallback(SoType type, SoIntersectionVisitationCB * cb, void * closure);
 
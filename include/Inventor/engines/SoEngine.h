@@ -60,6 +60,10 @@ public:
   SbBool isNotifying(void) const;
   virtual void notify(SoNotList * nl);
 
+  static void enableEvaluationScheduling(const SbBool onoff);
+  static SbBool isEvaluationSchedulingEnabled(void);
+  static void evaluateDirtyEngines(const int numthreads = 0);
+
   SoEngine * copy(void) const;
   virtual SoFieldContainer * copyThroughConnection(void) const;
   SbBool shouldCopy(void) const;
@@ -87,13 +91,15 @@ private:
 
   enum InternalEngineFlags {
     FLAG_ISNOTIFYING = (1 << 0),
-    FLAG_ISDIRTY = (1 << 1)
+    FLAG_ISDIRTY = (1 << 1),
+    FLAG_ISSCHEDULED = (1 << 2)
   };
 
   unsigned int flags;
 
   // needed for handling connections from SoEngineOutput
   friend class SoEngineOutput;
+  friend class SoEngineP;
   void setDirty(void);
 };
 
@@ -54,6 +54,8 @@ public:
   SbBool fieldsAreEqual(const SoFieldContainer * container) const;
   void copyFieldValues(const SoFieldContainer * container,
                        SbBool copyconnections = FALSE);
+  static void setCopySharesValues(const SbBool onoff);
+  static SbBool getCopySharesValues(void);
 
   SbBool set(const char * const fielddata);
   void get(SbString & fielddata);
@@ -61,10 +61,18 @@ public:
   virtual void enableDeleteValues(void);
   virtual SbBool isDeleteValuesEnabled(void) const;
 
+  typedef void ReleaseBufferCB(void * data, void * closure);
+  SbBool shareValues(const SoMField & field);
+  SbBool setValuesBuffer(const int num, void * data,
+                         ReleaseBufferCB * release, void * closure);
+
 protected:
   SoMField(void);
   virtual void makeRoom(int newnum);
 
+  void detachValues(void);
+  SbBool resizeSharedValues(const int newnum);
+
 #ifndef DOXYGEN_SKIP_THIS // Internal methods.
   virtual int fieldSizeof(void) const = 0;
   virtual void * valuesPtr(void) = 0;
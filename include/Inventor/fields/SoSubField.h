@@ -263,7 +263,7 @@ public: \
   _valref_ operator=(_valref_ val) { this->setValue(val); return val; } \
   SbBool operator==(const _class_ & field) const; \
   SbBool operator!=(const _class_ & field) const { return !operator==(field); } \
-  _valtype_ * startEditing(void) { this->evaluate(); return this->values; } \
+  _valtype_ * startEditing(void) { this->evaluate(); this->detachValues(); return this->values; } \
   void finishEditing(void) { this->valueChanged(); }
 
 #define SO_MFIELD_DERIVED_VALUE_HEADER(_class_, _valtype_, _valref_) \
@@ -372,6 +372,7 @@ _class_::find(_valref_ value, SbBool addifnotfound) \
 void \
 _class_::setValues(const int start, const int numarg, const _valtype_ * newvals) \
 { \
+  this->detachValues(); \
   if (start+numarg > this->maxNum) this->allocValues(start+numarg); \
   else if (start+numarg > this->num) this->num = start+numarg; \
  \
@@ -385,6 +386,7 @@ _class_::setValues(const int start, const int numarg, const _valtype_ * newvals)
 void \
 _class_::set1Value(const int idx, _valref_ value) \
 { \
+  this->detachValues(); \
   if (idx+1 > this->maxNum) this->allocValues(idx+1); \
   else if (idx+1 > this->num) this->num = idx+1; \
   this->values[idx] = value; \
@@ -426,6 +428,7 @@ _class_::deleteAllValues(void) \
 void \
 _class_::copyValue(int to, int from) \
 { \
+  this->detachValues(); \
   this->values[to] = this->values[from]; \
 }
 
@@ -444,6 +447,7 @@ _class_::allocValues(int newnum) \
   int oldmaxnum; \
   _valtype_ * newblock; \
   assert(newnum >= 0); \
+  if (this->userDataIsUsed && this->resizeSharedValues(newnum)) return; \
  \
   this->setChangedIndices(); \
   if (newnum == 0) { \
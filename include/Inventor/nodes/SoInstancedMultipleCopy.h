@@ -0,0 +1,73 @@
+#ifndef COIN_SOINSTANCEDMULTIPLECOPY_H
+#define COIN_SOINSTANCEDMULTIPLECOPY_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include <Inventor/nodes/SoSubNode.h>
+#include <Inventor/nodes/SoMultipleCopy.h>
+#include <Inventor/fields/SoMFColor.h>
+
+class SoInstancedMultipleCopyP;
+
+class COIN_DLL_API SoInstancedMultipleCopy : public SoMultipleCopy {
+  typedef SoMultipleCopy inherited;
+
+  SO_NODE_HEADER(SoInstancedMultipleCopy);
+
+public:
+  static void initClass(void);
+  SoInstancedMultipleCopy(void);
+
+  SoMFColor color;
+
+  virtual void doAction(SoAction * action);
+  virtual void callback(SoCallbackAction * action);
+  virtual void GLRender(SoGLRenderAction * action);
+  virtual void pick(SoPickAction * action);
+  virtual void getPrimitiveCount(SoGetPrimitiveCountAction * action);
+
+  virtual void notify(SoNotList * nl);
+
+protected:
+  virtual ~SoInstancedMultipleCopy();
+
+private:
+  SoInstancedMultipleCopyP * pimpl;
+  friend class SoInstancedMultipleCopyP;
+
+  // NOT IMPLEMENTED
+  SoInstancedMultipleCopy(const SoInstancedMultipleCopy & rhs);
+  SoInstancedMultipleCopy & operator = (const SoInstancedMultipleCopy & rhs);
+};
+
+#endif // !COIN_SOINSTANCEDMULTIPLECOPY_H
@@ -170,5 +170,7 @@
 #include <Inventor/nodes/SoCacheHint.h>
 #include <Inventor/nodes/SoDepthBuffer.h>
 #include <Inventor/nodes/SoAlphaTest.h>
+#include <Inventor/nodes/SoInstancedMultipleCopy.h>
+#include <Inventor/nodes/SoLODIndexedFaceSet.h>
 
 #endif // !COIN_SONODES_H
@@ -39,6 +39,7 @@
 #include <Inventor/tools/SbPimplPtr.h>
 
 class SoState;
+class SoGLCacheList;
 class SoSeparatorP;
 
 class COIN_DLL_API SoSeparator : public SoGroup {
@@ -78,6 +79,7 @@ public:
 
   static void setNumRenderCaches(const int howmany);
   static int getNumRenderCaches(void);
+  SoGLCacheList * getGLCacheList(void) const;
   virtual SbBool affectsState(void) const;
 
 protected:
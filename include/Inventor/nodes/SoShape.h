@@ -152,6 +152,7 @@ protected:
 private:
   class SoShapeP * pimpl;
   void validatePVCache(SoGLRenderAction * action);
+  SbBool rayPickBVH(SoRayPickAction * action);
   void getBBox(SoAction * action, SbBox3f & box, SbVec3f & center);
   void rayPickBoundingBox(SoRayPickAction * action);
   friend class soshape_primdata;           // internal class
@@ -100,6 +100,7 @@
 #include <Inventor/elements/SoViewingMatrixElement.h>
 #include <Inventor/elements/SoWindowElement.h>
 #include <Inventor/elements/SoGLDepthBufferElement.h>
+#include <Inventor/engines/SoEngine.h>
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/lists/SoCallbackList.h>
 #include <Inventor/lists/SoEnabledElementsList.h>
@@ -126,6 +127,10 @@
 #include "glue/glp.h"
 #include "glue/simage_wrapper.h"
 #include "rendering/SoGL.h"
+#include "caches/SoSortBoxCache.h"
+#include "rendering/SoOcclusionCuller.h"
+#include "misc/SbDepthSorter.h"
+#include "threads/taskschedulerp.h"
 
 #include <Inventor/annex/Profiler/nodes/SoProfilerStats.h>
 #include "profiler/SoProfilerP.h"
@@ -536,11 +541,49 @@
   second pass.
 */
 
+/*!
+  \enum SoGLRenderAction::OcclusionCullingType
+
+  Enumerates the ways separators hidden behind other geometry can be
+  skipped during rendering.
+
+  \sa setOcclusionCullingType()
+  \since Coin 4.1
+*/
+
+/*!
+  \var SoGLRenderAction::OcclusionCullingType SoGLRenderAction::OCCLUSION_CULLING_NONE
+
+  No occlusion culling. Only view frustum culling is done.
+*/
+
+/*!
+  \var SoGLRenderAction::OcclusionCullingType SoGLRenderAction::OCCLUSION_CULLING_SOFTWARE
+
+  Opaque shapes that cover a large part of the screen are rasterized
+  into a low resolution depth buffer in main memory when rendered, and
+  separators whose bounding boxes are behind them are skipped. This
+  doesn't read anything back from OpenGL. Only geometry rendered
+  earlier in the same frame occludes, so the mode works best when
+  large occluders, like walls and floors, come early in the scene
+  graph. Gaps narrower than a pixel of the internal buffer (256 pixels
+  wide) are not seen.
+*/
+
+/*!
+  \var SoGLRenderAction::OcclusionCullingType SoGLRenderAction::OCCLUSION_CULLING_HARDWARE
+
+  The bounding boxes of separators are tested with OpenGL occlusion
+  queries. The results are used in the next frame, so a separator
+  that comes into view is drawn one frame late. Needs the
+  GL_ARB_occlusion_query extension or OpenGL 1.5.
+*/
+
 // *************************************************************************
 
 class SoGLRenderActionP {
 public:
-  SoGLRenderActionP(void) : action(NULL) { }
+  SoGLRenderActionP(void) : action(NULL), sortsetuptime(SbTime::zero()) { }
 
   SoGLRenderAction * action;
   SbViewportRegion viewport;
@@ -561,6 +604,24 @@ public:
   SoPathList transpobjpaths;
   SoPathList sorttranspobjpaths;
   SbList<float> sorttranspobjdistances;
+
+  // What's needed to compute the sort distance of a path in
+  // sorttranspobjpaths, collected by addSortTransPath().
+  struct SortPathData {
+    SbBox3f box; // object space
+    SbVec3f center; // object space
+    SbMatrix modelmatrix;
+    SbPlane plane; // near plane of the view volume
+    SbBool custom; // distance from the CUSTOM_CALLBACK
+    float dist;
+  };
+  SbList<SortPathData> sortpathdata;
+  SbDepthSorter pathsorter;
+
+  // Object space bounding boxes of sorted transparent paths, kept
+  // across frames.
+  SoSortBoxCache sortboxes;
+  SbTime sortsetuptime;
   SoGLRenderAction::TransparentDelayedObjectRenderType transpdelayedrendertype;
   SbBool renderingtranspbackfaces;
 
@@ -594,6 +655,9 @@ public:
   SoGLSortedObjectOrderCB * sortedobjectcb;
   void * sortedobjectclosure;
 
+  SoOcclusionCuller occlusionculler;
+  static SoOcclusionCuller * getOcclusionCuller(SoGLRenderAction * action);
+
   void setupSortedLayersBlendTextures(const SoState * state);
   void doSortedLayersBlendRendering(const SoState * state, SoNode * node);
   void initSortedLayersBlendRendering(const SoState * state);
@@ -633,6 +697,7 @@ public:
 SO_ACTION_SOURCE(SoGLRenderAction);
 
 static int COIN_GLBBOX = 0;
+static int COIN_OCCLUSION_CULLING = 0;
 
 // *************************************************************************
 
@@ -663,6 +728,13 @@ SoGLRenderAction::initClass(void)
   else {
     COIN_GLBBOX = 0;
   }
+
+  env = coin_getenv("COIN_OCCLUSION_CULLING");
+  COIN_OCCLUSION_CULLING = env ? atoi(env) : 0;
+  if (COIN_OCCLUSION_CULLING < 0 ||
+      COIN_OCCLUSION_CULLING > SoGLRenderAction::OCCLUSION_CULLING_HARDWARE) {
+    COIN_OCCLUSION_CULLING = 0;
+  }
 }
 
 // *************************************************************************
@@ -739,6 +811,8 @@ SoGLRenderAction::SoGLRenderAction(const SbViewportRegion & viewportregion)
   PRIVATE(this)->sortedobjectstrategy = BBOX_CENTER;
   PRIVATE(this)->sortedobjectcb = NULL;
   PRIVATE(this)->sortedobjectclosure = NULL;
+
+  PRIVATE(this)->occlusionculler.setType(static_cast<OcclusionCullingType>(COIN_OCCLUSION_CULLING));
 }
 
 /*!
@@ -1066,6 +1140,12 @@ SoGLRenderAction::beginTraversal(SoNode * node)
     return;
   }
 
+  // Evaluate the engines changed since the last traversal up front,
+  // so the traversal only reads up-to-date values.
+  if (SoEngine::isEvaluationSchedulingEnabled()) {
+    SoEngine::evaluateDirtyEngines();
+  }
+
   // If the environment variable COIN_GLBBOX is set to 1, apply a bbox
   // action before rendering.  This will make sure bounding box caches
   // are updated (needed for view frustum culling). The default
@@ -1480,35 +1560,53 @@ SoGLRenderAction::invalidateState(void)
   PRIVATE(this)->needglinit = TRUE;
 }
 
-// Sort paths with transparent objects before rendering.
+// Computes the sort distances of the paths with transparent objects,
+// and sorts them back to front, starting from the order of the
+// previous frame. The order is found in pathsorter.
 void
 SoGLRenderActionP::doPathSort(void)
 {
-  // need to cast to SbPList to avoid ref/unref problems, since
-  // operator[] is overloaded with non-virtual inheritance.
-  SbPList * plist = &this->sorttranspobjpaths;
-  float * darray = const_cast<float *>(this->sorttranspobjdistances.getArrayPtr());
+  const int n = this->sortpathdata.getLength();
+  assert(n == this->sorttranspobjpaths.getLength());
+  this->sorttranspobjdistances.truncate(0);
+  for (int i = 0; i < n; i++) this->sorttranspobjdistances.append(0.0f);
 
-  int i, j, distance, n = this->sorttranspobjdistances.getLength();
-  void * ptmp;
-  float dtmp;
-
-  // shell sort algorithm (O(nlog(n))
-  for (distance = 1; distance <= n/9; distance = 3*distance + 1) ;
-  for (; distance > 0; distance /= 3) {
-    for (i = distance; i < n; i++) {
-      dtmp = darray[i];
-      ptmp = plist->get(i);
-      j = i;
-      while (j >= distance && darray[j-distance] < dtmp) {
-        darray[j] = darray[j-distance];
-        plist->set(j, plist->get(j-distance));
-        j -= distance;
+  const SortPathData * data = this->sortpathdata.getArrayPtr();
+  float * darray = const_cast<float *>(this->sorttranspobjdistances.getArrayPtr());
+  const SoGLRenderAction::SortedObjectOrderStrategy strategy = this->sortedobjectstrategy;
+  SbTaskScheduler::parallelFor(0, n, 1024, [&](int begin, int end) {
+      for (int i = begin; i < end; i++) {
+        const SortPathData & d = data[i];
+        if (d.custom) {
+          darray[i] = d.dist;
+          continue;
+        }
+        SbVec3f center;
+        d.modelmatrix.multVecMatrix(d.center, center);
+        float dist = -d.plane.getDistance(center);
+        if ((strategy == SoGLRenderAction::BBOX_CLOSEST_CORNER) ||
+            (strategy == SoGLRenderAction::BBOX_FARTHEST_CORNER)) {
+          const SbVec3f & bmin = d.box.getMin();
+          const SbVec3f & bmax = d.box.getMax();
+          for (int j = 0; j < 8; j++) {
+            SbVec3f tmp(j&1 ? bmin[0] : bmax[0],
+                        j&2 ? bmin[1] : bmax[1],
+                        j&4 ? bmin[2] : bmax[2]);
+            d.modelmatrix.multVecMatrix(tmp, tmp);
+            const float tmpdist = -d.plane.getDistance(tmp);
+            if (j == 0) dist = tmpdist;
+            else if (strategy == SoGLRenderAction::BBOX_CLOSEST_CORNER) {
+              if (tmpdist < dist) dist = tmpdist;
+            }
+            else if (tmpdist > dist) dist = tmpdist;
+          }
+        }
+        darray[i] = dist;
       }
-      darray[j] = dtmp;
-      plist->set(j, ptmp);
-    }
-  }
+    });
+
+  // farthest first
+  this->pathsorter.sort(darray, n, TRUE);
 }
 
 /*!
@@ -1568,6 +1666,14 @@ SoGLRenderAction::removePreRenderCallback(SoGLPreRenderCB * func, void * userdat
   The callback will supply the SoGLRenderAction instance, and the path
   to the current object can be found using SoAction::getCurPath().
 
+  For the built in strategies, the bounding box of each transparent
+  path is cached between frames, and is recomputed only when the path
+  or the state it depends on changes. The sort keys are computed in
+  parallel, and the order from the previous frame is used as a
+  starting point for the sort. When profiling, the time spent is
+  reported as the "sortedObjectSetup" and "sortedObjectOrdering"
+  phases of SbProfilingData.
+
   \since Coin 2.5
 
 */
@@ -1586,82 +1692,37 @@ SoGLRenderAction::setSortedObjectOrderStrategy(const SortedObjectOrderStrategy s
 
 // Private function to save transparent paths that need to be sorted.
 // The transparent paths that don't need to be sorted are rendered
-// after the sorted ones.
+// after the sorted ones. The sort distances are computed later, in
+// doPathSort().
 void
 SoGLRenderActionP::addSortTransPath(SoPath * path)
 {
+  const SbBool profiling = SoProfiler::isEnabled() &&
+    this->action->getState()->isElementEnabled(SoProfilerElement::getClassStackIndex());
+  SbTime start;
+  if (profiling) start = SbTime::getTimeOfDay();
+
   this->sorttranspobjpaths.append(path);
+  SortPathData data;
 
   // check and handle callback first
   if ((this->sortedobjectstrategy == SoGLRenderAction::CUSTOM_CALLBACK) &&
       (this->sortedobjectcb != NULL)) {
-    this->sorttranspobjdistances.append(this->sortedobjectcb(this->sortedobjectclosure,
-                                                             this->action));
-    return;
-  }
-
-  SoState * state = action->getState();
-  SoNode * tail = reclassify_cast<SoFullPath *>(path)->getTail();
-  float dist;
-  SbBox3f bbox;
-  // test if we can find the bbox using SoShape::getBoundingBoxCache()
-  // or SoShape::computeBBox. This is the common case, and quite a lot
-  // faster than using an SoGetBoundingBoxAction.
-  if (tail->isOfType(SoShape::getClassTypeId())) { // common case
-    SoShape * tailshape = coin_assert_cast<SoShape *>(tail);
-    const SoBoundingBoxCache * bboxcache = tailshape->getBoundingBoxCache();
-    SbVec3f center;
-
-    if (bboxcache && bboxcache->isValid(state)) {
-      bbox = bboxcache->getProjectedBox();
-      if (bboxcache->isCenterSet()) center = bboxcache->getCenter();
-      else center = bbox.getCenter();
-    }
-    else {
-      tailshape->computeBBox(action, bbox, center);
-    }
-    SoModelMatrixElement::get(state).multVecMatrix(center, center);
-    dist = -SoViewVolumeElement::get(state).getPlane(0.0f).getDistance(center);
+    data.custom = TRUE;
+    data.dist = this->sortedobjectcb(this->sortedobjectclosure, this->action);
   }
   else {
-    this->bboxaction->setViewportRegion(SoViewportRegionElement::get(state));
-    this->bboxaction->apply(path);
-    SbVec3f center = this->bboxaction->getBoundingBox().getCenter();
-    bbox = this->bboxaction->getBoundingBox();
-    bbox.transform(SoModelMatrixElement::get(state).inverse());
-    dist = -SoViewVolumeElement::get(state).getPlane(0.0f).getDistance(center);
+    SoState * state = action->getState();
+    data.custom = FALSE;
+    data.dist = 0.0f;
+    data.modelmatrix = SoModelMatrixElement::get(state);
+    data.plane = SoViewVolumeElement::get(state).getPlane(0.0f);
+    (void)this->sortboxes.getBox(this->action, reclassify_cast<SoFullPath *>(path),
+                                 this->bboxaction.get(), data.box, data.center);
   }
-  if ((this->sortedobjectstrategy == SoGLRenderAction::BBOX_CLOSEST_CORNER) ||
-      (this->sortedobjectstrategy == SoGLRenderAction::BBOX_FARTHEST_CORNER)) {
-    const SbMatrix & m = SoModelMatrixElement::get(state);
-    const SbPlane & plane = SoViewVolumeElement::get(state).getPlane(0.0f);
-    SbVec3f bmin, bmax;
-    bmin = bbox.getMin();
-    bmax = bbox.getMax();
-
-    for (int i = 0; i < 8; i++) {
-      SbVec3f tmp(i&1 ? bmin[0] : bmax[0],
-                  i&2 ? bmin[1] : bmax[1],
-                  i&4 ? bmin[2] : bmax[2]);
-      m.multVecMatrix(tmp, tmp);
-      float tmpdist = -plane.getDistance(tmp);
-      if (i == 0) dist = tmpdist;
-      else {
-        switch (this->sortedobjectstrategy) {
-        case SoGLRenderAction::BBOX_CLOSEST_CORNER:
-          if (tmpdist < dist) dist = tmpdist;
-          break;
-        case SoGLRenderAction::BBOX_FARTHEST_CORNER:
-          if (tmpdist > dist) dist = tmpdist;
-          break;
-        default:
-          assert(0 && "unknown sorting strategy");
-          break;
-        }
-      }
-    }
-  }
-  this->sorttranspobjdistances.append(dist);
+  this->sortpathdata.append(data);
+
+  if (profiling) this->sortsetuptime += SbTime::getTimeOfDay() - start;
 }
 
 // Private function which "unwinds" the real value of the "rendering"
@@ -1721,6 +1782,7 @@ SoGLRenderActionP::render(SoNode * node)
                                FALSE, !this->isDirectRendering(state));
   SoGLRenderPassElement::set(state, 0);
 
+  this->occlusionculler.beginFrame();
   this->precblist.invokeCallbacks(static_cast<void *>(this->action));
 
   if (this->action->getNumPasses() > 1 && this->internal_multipass) {
@@ -1822,11 +1884,16 @@ SoGLRenderActionP::renderSingle(SoNode * node)
   assert(this->delayedpathrender == FALSE);
   assert(this->transparencyrender == FALSE);
 
+  this->occlusionculler.beginPass();
+
   // Truncate just in case
   this->sorttranspobjpaths.truncate(0);
   this->transpobjpaths.truncate(0);
   this->sorttranspobjdistances.truncate(0);
+  this->sortpathdata.truncate(0);
   this->delayedpaths.truncate(0);
+  this->sortsetuptime = SbTime::zero();
+  this->sortboxes.beginFrame();
 
   // Do order independent transparency rendering
   if (this->transparencytype == SoGLRenderAction::SORTED_LAYERS_BLEND) {
@@ -1887,7 +1954,17 @@ SoGLRenderActionP::renderSingle(SoNode * node)
 
     // All paths in the sorttranspobjpaths should be sorted
     // back-to-front and rendered
+    const SbBool profiling = SoProfiler::isEnabled() &&
+      state->isElementEnabled(SoProfilerElement::getClassStackIndex());
+    SbTime sortstart;
+    if (profiling) sortstart = SbTime::getTimeOfDay();
     this->doPathSort();
+    if (profiling) {
+      SbProfilingData & data = SoProfilerElement::get(state)->getProfilingData();
+      data.addPhaseTiming("sortedObjectSetup", this->sortsetuptime);
+      data.addPhaseTiming("sortedObjectOrdering", SbTime::getTimeOfDay() - sortstart);
+    }
+    const int * order = this->pathsorter.getOrder();
     int i;
     for (i = 0; i < this->sorttranspobjpaths.getLength(); i++) {
       for (int pass = 0; pass < numtransppasses; pass++) {
@@ -1903,7 +1980,7 @@ SoGLRenderActionP::renderSingle(SoNode * node)
             break;
           }
         }
-        this->action->apply(this->sorttranspobjpaths[i]);
+        this->action->apply(this->sorttranspobjpaths[order[i]]);
       }
     }
 
@@ -1942,6 +2019,7 @@ SoGLRenderActionP::renderSingle(SoNode * node)
   this->sorttranspobjpaths.truncate(0);
   this->transpobjpaths.truncate(0);
   this->sorttranspobjdistances.truncate(0);
+  this->sortpathdata.truncate(0);
   this->delayedpaths.truncate(0);
 
 }
@@ -2040,6 +2118,81 @@ SoGLRenderAction::getTransparentDelayedObjectRenderType(void) const
   return PRIVATE(this)->transpdelayedrendertype;
 }
 
+/*!
+  Sets how separators hidden behind other geometry are culled. The
+  default is OCCLUSION_CULLING_NONE, unless the \c
+  COIN_OCCLUSION_CULLING environment variable is set.
+
+  Only SoSeparator nodes with a valid bounding box cache are tested,
+  so an SoGetBoundingBoxAction must have been applied to the scene
+  graph (most viewers do this every frame to set the clipping planes).
+  The \c renderCulling field of the separator must not be \c OFF.
+
+  While occlusion culling is active, separators with \c renderCaching
+  set to \c AUTO are not render cached, since a cache would store the
+  culling decisions of the whole subgraph. Separators with \c
+  renderCaching set to \c ON are still cached. Occlusion culling is
+  not done in SORTED_LAYERS_BLEND mode, nor for delayed paths, like
+  the children of SoAnnotation nodes.
+
+  \sa getOcclusionCullingStatistics()
+  \since Coin 4.1
+*/
+void
+SoGLRenderAction::setOcclusionCullingType(const OcclusionCullingType type)
+{
+  PRIVATE(this)->occlusionculler.setType(type);
+}
+
+/*!
+  Returns how separators hidden behind other geometry are culled.
+
+  \since Coin 4.1
+*/
+SoGLRenderAction::OcclusionCullingType
+SoGLRenderAction::getOcclusionCullingType(void) const
+{
+  return PRIVATE(this)->occlusionculler.getType();
+}
+
+/*!
+  Returns occlusion culling statistics for the last time the action
+  was applied. \a numtested is the number of separators tested, and \a
+  numculled how many of them were skipped. \a numoccluders is the
+  number of shapes rasterized as occluders in OCCLUSION_CULLING_SOFTWARE
+  mode, and \a numqueries the number of occlusion queries issued in
+  OCCLUSION_CULLING_HARDWARE mode.
+
+  \since Coin 4.1
+*/
+void
+SoGLRenderAction::getOcclusionCullingStatistics(int & numtested, int & numculled,
+                                                int & numoccluders, int & numqueries) const
+{
+  PRIVATE(this)->occlusionculler.getStatistics(numtested, numculled,
+                                               numoccluders, numqueries);
+}
+
+// Returns the occlusion culler if separators should be tested right
+// now.
+SoOcclusionCuller *
+SoGLRenderActionP::getOcclusionCuller(SoGLRenderAction * action)
+{
+  SoGLRenderActionP * thisp = &PRIVATE(action).get();
+  if (thisp->occlusionculler.getType() == SoGLRenderAction::OCCLUSION_CULLING_NONE ||
+      thisp->delayedpathrender ||
+      thisp->transparencytype == SoGLRenderAction::SORTED_LAYERS_BLEND) {
+    return NULL;
+  }
+  return &thisp->occlusionculler;
+}
+
+SoOcclusionCuller *
+sogl_occlusion_culler(SoGLRenderAction * action)
+{
+  return SoGLRenderActionP::getOcclusionCuller(action);
+}
+
 void
 SoGLRenderActionP::doSortedLayersBlendRendering(const SoState * state, SoNode * node)
 {
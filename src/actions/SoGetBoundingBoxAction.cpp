@@ -61,6 +61,14 @@
   parts of scene graphs, should be very quick on successive runs for
   "static" parts of the scene.
 
+  The first traversal of a large scene, or of the parts of it that
+  have changed, can be spread over several threads with
+  setNumThreads(). The subgraphs below an SoSeparator are then
+  traversed in parallel, filling in the bounding box caches of their
+  SoSeparator and shape nodes, before the separator itself uses the
+  cached boxes. The coordinates of large vertex based shapes are also
+  scanned in parallel.
+
   Note that the algorithm used is not guaranteed to always give an
   exact bounding box: it combines bounding boxes in pairs and extends
   one of them to contain the other. Since the boxes need not be
@@ -85,15 +93,39 @@
 #include <Inventor/elements/SoLocalBBoxMatrixElement.h>
 #include <Inventor/elements/SoViewingMatrixElement.h>
 #include <Inventor/elements/SoViewportRegionElement.h>
+#include <Inventor/SoPath.h>
 #include <Inventor/lists/SoEnabledElementsList.h>
+#include <Inventor/lists/SoPathList.h>
+#include <Inventor/misc/SoChildList.h>
 #include <Inventor/misc/SoState.h>
+#include <Inventor/fields/SoFieldData.h>
+#include <Inventor/fields/SoMField.h>
+#include <Inventor/nodes/SoAsciiText.h>
+#include <Inventor/nodes/SoCallback.h>
 #include <Inventor/nodes/SoNode.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoShape.h>
+#include <Inventor/nodes/SoText2.h>
+#include <Inventor/nodes/SoText3.h>
+#include <Inventor/nodes/SoVertexShape.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#ifdef HAVE_VRML97
+#include <Inventor/VRMLnodes/SoVRMLText.h>
+#endif // HAVE_VRML97
+
+#include <vector>
 
 #if COIN_DEBUG
 #include <Inventor/errors/SoDebugError.h>
 #endif // COIN_DEBUG
 
+#include "actions/SoGetBoundingBoxActionP.h"
 #include "actions/SoSubActionP.h"
+#include "threads/taskschedulerp.h"
 #include "SbBasicP.h"
 
 // FIXME: kristian investigated the assumed bug-cases listed below,
@@ -218,12 +250,10 @@
   \COININTERNAL
 */
 
-class SoGetBoundingBoxActionP {
-public:
-};
-
 SO_ACTION_SOURCE(SoGetBoundingBoxAction);
 
+#define PRIVATE(obj) ((obj)->pimpl)
+
 
 /*!
   \copydetails SoAction::initClass(void)
@@ -590,6 +620,56 @@ SoGetBoundingBoxAction::resetCenter(void)
   this->center.setValue(0.0f, 0.0f, 0.0f);
 }
 
+/*!
+  Sets the number of threads used for the traversal.
+
+  The default value is 1, which does the whole traversal on the
+  thread calling apply(). With a larger value, the work is spread
+  over the calling thread and \a numthreads - 1 threads started for
+  the duration of apply(). The value 0 uses Coin's shared worker
+  threads, see the COIN_NUM_TASK_THREADS environment variable.
+
+  When an SoSeparator without a valid bounding box cache is
+  traversed, the subgraphs of its child separators and shapes are
+  then traversed in parallel, to fill in their bounding box caches,
+  before the separator traverses its children as usual. The boxes
+  are kept in the caches, so later traversals only redo the parts of
+  the scene that have changed. This is done for separators which are
+  reached through SoGroup and SoSeparator nodes only, when the
+  separator caches its bounding box (see
+  SoSeparator::boundingBoxCaching), and when the subgraphs are large
+  enough to be worth it. Separators inside a subgraph traversed by
+  another thread are not split any further.
+
+  As each subgraph is traversed by one thread, subgraphs containing
+  group or shape nodes with more than one parent, field connections,
+  SoCallback nodes or text nodes are left for the calling thread.
+
+  The coordinates of vertex based shapes with many coordinates are
+  scanned in parallel in any case.
+
+  \sa getNumThreads()
+  \since Coin 4.1
+*/
+void
+SoGetBoundingBoxAction::setNumThreads(int numthreads)
+{
+  assert(numthreads >= 0);
+  PRIVATE(this)->numthreads = SbMax(numthreads, 0);
+}
+
+/*!
+  Returns the number of threads used for the traversal.
+
+  \sa setNumThreads()
+  \since Coin 4.1
+*/
+int
+SoGetBoundingBoxAction::getNumThreads(void) const
+{
+  return PRIVATE(this)->numthreads;
+}
+
 // Documented in superclass. Overridden to reset center point and
 // bounding box before traversal starts.
 void
@@ -599,5 +679,384 @@ SoGetBoundingBoxAction::beginTraversal(SoNode * node)
   this->bbox.makeEmpty();
 
   SoViewportRegionElement::set(this->getState(), this->vpregion);
+
+  // the actions traversing subgraphs in parallel are given the
+  // scheduler of this action before they are applied
+  SbTaskScheduler * ownscheduler = NULL;
+  const SbBool isparallel =
+    PRIVATE(this)->numthreads != 1 && PRIVATE(this)->scheduler == NULL;
+  if (isparallel) {
+    if (PRIVATE(this)->numthreads == 0) {
+      PRIVATE(this)->scheduler = SbTaskScheduler::getGlobal();
+    }
+    else {
+      ownscheduler = new SbTaskScheduler(PRIVATE(this)->numthreads - 1);
+      PRIVATE(this)->scheduler = ownscheduler;
+    }
+  }
+
   inherited::beginTraversal(node);
+
+  if (isparallel) {
+    PRIVATE(this)->scheduler = NULL;
+    delete ownscheduler;
+  }
+}
+
+// *************************************************************************
+
+namespace {
+
+  // the subgraphs of a separator are only traversed in parallel if
+  // they add up to at least this many nodes and field values
+  const size_t SOGETBBOX_MIN_PARALLEL_WEIGHT = 65536;
+
+  size_t
+  sogetbbox_field_weight(SoNode * node)
+  {
+    size_t weight = 1;
+    const SoFieldData * fielddata = node->getFieldData();
+    const int numfields = fielddata ? fielddata->getNumFields() : 0;
+    for (int i = 0; i < numfields; i++) {
+      SoField * field = fielddata->getField(node, i);
+      if (field->isOfType(SoMField::getClassTypeId())) {
+        weight += static_cast<SoMField *>(field)->getNum();
+      }
+    }
+    return weight;
+  }
+
+  SbBool
+  sogetbbox_has_connections(SoNode * node)
+  {
+    const SoFieldData * fielddata = node->getFieldData();
+    const int numfields = fielddata ? fielddata->getNumFields() : 0;
+    for (int i = 0; i < numfields; i++) {
+      if (fielddata->getField(node, i)->isConnected()) return TRUE;
+    }
+    return FALSE;
+  }
+
+  // Returns TRUE if the subgraph can be traversed on a worker thread
+  // while other threads traverse other subgraphs, and adds an
+  // estimate of the work to weight. Nodes which write to themselves
+  // during traversal (groups and shapes, through their caches) can't
+  // be reached through more than one parent. Field connections are
+  // evaluated during traversal, callbacks can't be expected to be
+  // thread safe, and the text nodes share font data.
+  SbBool
+  sogetbbox_is_thread_safe(SoNode * node, size_t & weight)
+  {
+    SoChildList * children = node->getChildren();
+    if (node->getRefCount() > 1 &&
+        (children || node->isOfType(SoShape::getClassTypeId()))) {
+      return FALSE;
+    }
+    if (node->isOfType(SoCallback::getClassTypeId()) ||
+        node->isOfType(SoText2::getClassTypeId()) ||
+        node->isOfType(SoText3::getClassTypeId()) ||
+        node->isOfType(SoAsciiText::getClassTypeId())) {
+      return FALSE;
+    }
+#ifdef HAVE_VRML97
+    if (node->isOfType(SoVRMLText::getClassTypeId())) return FALSE;
+#endif // HAVE_VRML97
+    if (sogetbbox_has_connections(node)) return FALSE;
+
+    weight += sogetbbox_field_weight(node);
+    if (node->isOfType(SoVertexShape::getClassTypeId())) {
+      SoNode * vp = static_cast<SoVertexShape *>(node)->vertexProperty.getValue();
+      if (vp && !sogetbbox_is_thread_safe(vp, weight)) return FALSE;
+    }
+    const int numchildren = children ? children->getLength() : 0;
+    for (int i = 0; i < numchildren; i++) {
+      if (!sogetbbox_is_thread_safe((*children)[i], weight)) return FALSE;
+    }
+    return TRUE;
+  }
+
+  // Returns TRUE if node is traversed safely by several threads at
+  // the same time when it is off their paths. Separators and shapes
+  // are not traversed off the path.
+  SbBool
+  sogetbbox_is_off_path_safe(SoNode * node)
+  {
+    if (node->isOfType(SoSeparator::getClassTypeId()) ||
+        node->isOfType(SoShape::getClassTypeId())) {
+      return TRUE;
+    }
+    size_t weight = 0;
+    return sogetbbox_is_thread_safe(node, weight);
+  }
+
+} // namespace
+
+SbTaskScheduler *
+SoGetBoundingBoxActionP::getScheduler(SoAction * action)
+{
+  if (!action->isOfType(SoGetBoundingBoxAction::getClassTypeId())) return NULL;
+  return PRIVATE(static_cast<SoGetBoundingBoxAction *>(action))->scheduler;
 }
+
+// Called by SoSeparator::getBoundingBox() before it traverses its
+// children to fill in its bounding box cache. If the action uses
+// several threads, the bounding boxes of the child separators and
+// shapes are computed in parallel first, by applying other bounding
+// box actions to the paths to them, so that the caches in them are
+// filled in. Unsafe parts are left for the calling thread.
+//
+// Only the calling thread splits separators. The actions applied by
+// the other threads traverse their subgraphs in full, as making and
+// destroying the paths for a split would change the auditor lists of
+// the nodes leading up to the subgraph, which are shared with the
+// other threads.
+void
+SoGetBoundingBoxActionP::computeSubgraphs(SoGetBoundingBoxAction * action,
+                                          SoSeparator * separator)
+{
+  SoGetBoundingBoxActionP * thisp = &PRIVATE(action).get();
+  if (thisp->scheduler == NULL || thisp->scheduler->getNumWorkers() == 0) return;
+  if (thisp->insubgraph) return;
+
+  // The other threads traverse the nodes leading up to the
+  // separator in the path, and the nodes before them which affect
+  // the state. They must only read their fields.
+  const SoFullPath * curpath = reclassify_cast<const SoFullPath *>(action->getCurPath());
+  const int pathlength = curpath->getLength();
+  assert(curpath->getTail() == separator);
+  for (int i = 0; i < pathlength; i++) {
+    SoNode * node = curpath->getNode(i);
+    const SoType type = node->getTypeId();
+    if ((type != SoGroup::getClassTypeId() && type != SoSeparator::getClassTypeId()) ||
+        sogetbbox_has_connections(node)) {
+      return;
+    }
+    if (i == pathlength - 1) continue;
+    SoChildList * children = node->getChildren();
+    const int index = curpath->getIndex(i + 1);
+    for (int j = 0; j < index; j++) {
+      if (!sogetbbox_is_off_path_safe((*children)[j])) return;
+    }
+  }
+
+  SoChildList * children = separator->getChildren();
+  const int numchildren = children->getLength();
+  std::vector<int> subgraphs;
+  size_t totalweight = 0;
+  for (int i = 0; i < numchildren; i++) {
+    SoNode * child = (*children)[i];
+    size_t weight = 0;
+    const SbBool issafe = sogetbbox_is_thread_safe(child, weight);
+    if (child->isOfType(SoSeparator::getClassTypeId()) ||
+        child->isOfType(SoShape::getClassTypeId())) {
+      if (issafe) {
+        subgraphs.push_back(i);
+        totalweight += weight;
+      }
+    }
+    else if (!issafe) return;
+  }
+  if (subgraphs.size() < 2 || totalweight < SOGETBBOX_MIN_PARALLEL_WEIGHT) return;
+
+  // The subgraphs are traversed in a few chunks per thread, each
+  // with an action of its own, applied to the paths to all the
+  // subgraphs in the chunk in one go. The paths ref the nodes in
+  // them, so they are made after the reference counts have been
+  // checked.
+  const int num = static_cast<int>(subgraphs.size());
+  const int numchunks = SbMin(num, 4 * (thisp->scheduler->getNumWorkers() + 1));
+  std::vector<SoPathList> paths(numchunks);
+  std::vector<SoGetBoundingBoxAction *> actions(numchunks);
+  for (int c = 0; c < numchunks; c++) {
+    const int first = static_cast<int>(static_cast<size_t>(c) * num / numchunks);
+    const int last = static_cast<int>((static_cast<size_t>(c) + 1) * num / numchunks);
+    for (int i = first; i < last; i++) {
+      SoPath * path = new SoPath(curpath->getHead());
+      for (int j = 1; j < pathlength; j++) path->append(curpath->getIndex(j));
+      path->append(subgraphs[i]);
+      paths[c].append(path);
+    }
+    actions[c] = new SoGetBoundingBoxAction(action->getViewportRegion());
+    PRIVATE(actions[c])->numthreads = thisp->numthreads;
+    PRIVATE(actions[c])->scheduler = thisp->scheduler;
+    PRIVATE(actions[c])->insubgraph = TRUE;
+    (void) actions[c]->getState();
+  }
+  SbTaskScheduler::parallelFor(0, numchunks, 1, [&](int begin, int end) {
+      for (int c = begin; c < end; c++) actions[c]->apply(paths[c], TRUE);
+    }, thisp->scheduler);
+
+  for (int c = 0; c < numchunks; c++) delete actions[c];
+}
+
+#undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoPointSet.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+// a number of separators, each with its own coordinates and a shape,
+// big enough for the subgraphs to be handled in parallel
+static SoSeparator *
+make_point_clouds(SoNode * shared)
+{
+  SoSeparator * root = new SoSeparator;
+  unsigned int seed = 1;
+  for (int i = 0; i < 8; i++) {
+    SoSeparator * sep = new SoSeparator;
+    SoTranslation * t = new SoTranslation;
+    t->translation.setValue(i * 2.0f, 0.0f, -i * 1.0f);
+    sep->addChild(t);
+    if (shared) sep->addChild(shared);
+    SoCoordinate3 * coords = new SoCoordinate3;
+    coords->point.setNum(20000);
+    SbVec3f * pts = coords->point.startEditing();
+    for (int j = 0; j < 20000; j++) {
+      seed = seed * 1103515245u + 12345u;
+      const float x = static_cast<float>((seed >> 8) & 0xffff) / 65535.0f;
+      seed = seed * 1103515245u + 12345u;
+      const float y = static_cast<float>((seed >> 8) & 0xffff) / 65535.0f;
+      pts[j].setValue(x * (i + 1), y, x * y * 3.0f);
+    }
+    coords->point.finishEditing();
+    sep->addChild(coords);
+    if (i % 2) {
+      sep->addChild(new SoPointSet);
+    }
+    else {
+      SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+      ifs->coordIndex.setNum(4 * 5000);
+      int32_t * idx = ifs->coordIndex.startEditing();
+      for (int j = 0; j < 5000; j++) {
+        idx[j * 4 + 0] = j * 3;
+        idx[j * 4 + 1] = j * 3 + 1;
+        idx[j * 4 + 2] = j * 3 + 2;
+        idx[j * 4 + 3] = -1;
+      }
+      ifs->coordIndex.finishEditing();
+      sep->addChild(ifs);
+    }
+    root->addChild(sep);
+  }
+  return root;
+}
+
+static SbBool
+same_box(SoGetBoundingBoxAction & a, SoGetBoundingBoxAction & b)
+{
+  return
+    a.getBoundingBox().getMin() == b.getBoundingBox().getMin() &&
+    a.getBoundingBox().getMax() == b.getBoundingBox().getMax() &&
+    a.getCenter() == b.getCenter();
+}
+
+BOOST_AUTO_TEST_CASE(parallelSubgraphs)
+{
+  SoSeparator * serialroot = make_point_clouds(NULL);
+  serialroot->ref();
+  SoSeparator * parallelroot = make_point_clouds(NULL);
+  parallelroot->ref();
+
+  SbViewportRegion vp(100, 100);
+  SoGetBoundingBoxAction serial(vp);
+  serial.apply(serialroot);
+  BOOST_CHECK_MESSAGE(serial.getNumThreads() == 1, "should be serial by default");
+
+  SoGetBoundingBoxAction parallel(vp);
+  parallel.setNumThreads(3);
+  parallel.apply(parallelroot);
+  BOOST_CHECK_MESSAGE(same_box(serial, parallel),
+                      "parallel traversal should give the same box and center");
+
+  // the second traversal uses the cached boxes
+  parallel.apply(parallelroot);
+  BOOST_CHECK_MESSAGE(same_box(serial, parallel),
+                      "cached boxes should give the same box and center");
+
+  // a changed subgraph is recomputed
+  SoCoordinate3 * coords = static_cast<SoCoordinate3 *>
+    (static_cast<SoSeparator *>(serialroot->getChild(3))->getChild(1));
+  coords->point.set1Value(7, SbVec3f(100.0f, -50.0f, 3.0f));
+  coords = static_cast<SoCoordinate3 *>
+    (static_cast<SoSeparator *>(parallelroot->getChild(3))->getChild(1));
+  coords->point.set1Value(7, SbVec3f(100.0f, -50.0f, 3.0f));
+  serial.apply(serialroot);
+  parallel.apply(parallelroot);
+  BOOST_CHECK_MESSAGE(same_box(serial, parallel),
+                      "changed subgraph should be recomputed");
+  BOOST_CHECK_MESSAGE(parallel.getBoundingBox().getMax()[0] > 100.0f,
+                      "box should include the changed point");
+
+  serialroot->unref();
+  parallelroot->unref();
+}
+
+BOOST_AUTO_TEST_CASE(parallelNestedSubgraphs)
+{
+  // each subgraph is big enough to be split again, which is left to
+  // the threads traversing them
+  SoSeparator * serialroot = new SoSeparator;
+  serialroot->ref();
+  SoSeparator * parallelroot = new SoSeparator;
+  parallelroot->ref();
+  for (int i = 0; i < 3; i++) {
+    SoTranslation * t = new SoTranslation;
+    t->translation.setValue(0.0f, i * 5.0f, 0.0f);
+    serialroot->addChild(t);
+    serialroot->addChild(make_point_clouds(NULL));
+    t = new SoTranslation;
+    t->translation.setValue(0.0f, i * 5.0f, 0.0f);
+    parallelroot->addChild(t);
+    parallelroot->addChild(make_point_clouds(NULL));
+  }
+
+  SbViewportRegion vp(100, 100);
+  SoGetBoundingBoxAction serial(vp);
+  serial.apply(serialroot);
+  SoGetBoundingBoxAction parallel(vp);
+  parallel.setNumThreads(4);
+  for (int i = 0; i < 3; i++) {
+    // invalidate the caches of the nested subgraphs
+    SoSeparator * sep = static_cast<SoSeparator *>
+      (static_cast<SoSeparator *>(parallelroot->getChild(2 * i + 1))->getChild(i));
+    static_cast<SoTranslation *>(sep->getChild(0))->translation.touch();
+    parallel.apply(parallelroot);
+    BOOST_CHECK_MESSAGE(same_box(serial, parallel),
+                        "nested subgraphs should give the same box and center");
+  }
+
+  serialroot->unref();
+  parallelroot->unref();
+}
+
+BOOST_AUTO_TEST_CASE(parallelSharedNodes)
+{
+  // the material is shared by all the subgraphs
+  SoMaterial * material = new SoMaterial;
+  material->ref();
+  SoSeparator * serialroot = make_point_clouds(material);
+  serialroot->ref();
+  SoSeparator * parallelroot = make_point_clouds(material);
+  parallelroot->ref();
+
+  SbViewportRegion vp(100, 100);
+  SoGetBoundingBoxAction serial(vp);
+  serial.apply(serialroot);
+  SoGetBoundingBoxAction parallel(vp);
+  parallel.setNumThreads(0);
+  parallel.apply(parallelroot);
+  BOOST_CHECK_MESSAGE(same_box(serial, parallel),
+                      "shared nodes should give the same box and center");
+
+  serialroot->unref();
+  parallelroot->unref();
+  material->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -244,6 +244,51 @@
 
   \endcode
 
+  The action can also flatten the scene graph, by merging shapes.
+  This is enabled with mergeShapes(). When the action is then
+  applied to a root node, a new, flattened scene graph is built and
+  made available through getSimplifiedSceneGraph(). The scene graph
+  that the action was applied to is not changed. Merging is done like
+  this:
+
+  - Triangle shapes are converted to triangles in world coordinates,
+    so that static transformations are collapsed into the coordinates.
+
+  - The shapes are grouped by the state they are rendered with:
+    material (except the diffuse color and transparency, which are
+    stored per vertex), texture, shader program, light model and
+    shape hints.
+
+  - The triangles of the shapes in each group are merged into large
+    SoIndexedFaceSet nodes with shared vertices. getOriginalPath()
+    maps a picked point on a merged shape back to the path to the
+    original shape, so picking still works.
+
+  - The groups are ordered to minimize the number of OpenGL state
+    changes: opaque groups first, then sorted on shader program,
+    texture and material.
+
+  Shapes that can't be merged are kept in a copy of the original
+  scene graph, which makes up the first part of the new scene
+  graph. This is the case for shapes with more than
+  getMergeTriangleLimit() triangles, shapes with lines or points,
+  shapes below switch and level-of-detail nodes, node kits, SoCallback
+  nodes or transformations that are manipulators or connected to
+  engines or other fields, and shapes rendered with another camera,
+  other lights or other clipping planes than the ones in effect at
+  the end of the root node. A shape node which is instanced several
+  times in the scene graph is only merged if all its instances can be
+  merged. Separators left without anything to render are removed from
+  the copy.
+
+  \code
+  SoReorganizeAction reorg;
+  reorg.mergeShapes(TRUE);
+  reorg.apply(root);
+  SoSeparator * flattened = reorg.getSimplifiedSceneGraph();
+  flattened->ref(); // the action keeps it only until it's applied again
+  \endcode
+
   \since Coin 2.5
 
 */
@@ -256,6 +301,7 @@
 
 #include <cstring>
 #include <cassert>
+#include <cstdlib>
 
 #include <Inventor/SbName.h>
 #include <Inventor/actions/SoCallbackAction.h>
@@ -279,6 +325,53 @@
 #include <Inventor/elements/SoNormalElement.h>
 #include <Inventor/caches/SoPrimitiveVertexCache.h>
 #include <Inventor/SbColor4f.h>
+#include <Inventor/SbPlane.h>
+#include <Inventor/SoFullPath.h>
+#include <Inventor/SoPickedPoint.h>
+#include <Inventor/details/SoFaceDetail.h>
+#include <Inventor/elements/SoClipPlaneElement.h>
+#include <Inventor/elements/SoDrawStyleElement.h>
+#include <Inventor/elements/SoLightElement.h>
+#include <Inventor/elements/SoMultiTextureImageElement.h>
+#include <Inventor/elements/SoMultiTextureMatrixElement.h>
+#include <Inventor/elements/SoProjectionMatrixElement.h>
+#include <Inventor/elements/SoShapeHintsElement.h>
+#include <Inventor/elements/SoViewingMatrixElement.h>
+#include <Inventor/fields/SoFieldData.h>
+#include <Inventor/manips/SoTransformManip.h>
+#include <Inventor/nodes/SoAnnotation.h>
+#include <Inventor/nodes/SoAntiSquish.h>
+#include <Inventor/nodes/SoBaseColor.h>
+#include <Inventor/nodes/SoCallback.h>
+#include <Inventor/nodes/SoCamera.h>
+#include <Inventor/nodes/SoClipPlane.h>
+#include <Inventor/nodes/SoComplexity.h>
+#include <Inventor/nodes/SoCoordinate4.h>
+#include <Inventor/nodes/SoDrawStyle.h>
+#include <Inventor/nodes/SoImage.h>
+#include <Inventor/nodes/SoInfo.h>
+#include <Inventor/nodes/SoInstancedMultipleCopy.h>
+#include <Inventor/nodes/SoLOD.h>
+#include <Inventor/nodes/SoLabel.h>
+#include <Inventor/nodes/SoLevelOfDetail.h>
+#include <Inventor/nodes/SoLight.h>
+#include <Inventor/nodes/SoLightModel.h>
+#include <Inventor/nodes/SoLocateHighlight.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoMaterialBinding.h>
+#include <Inventor/nodes/SoNormalBinding.h>
+#include <Inventor/nodes/SoPackedColor.h>
+#include <Inventor/nodes/SoSelection.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoShapeHints.h>
+#include <Inventor/nodes/SoSurroundScale.h>
+#include <Inventor/nodes/SoSwitch.h>
+#include <Inventor/nodes/SoText2.h>
+#include <Inventor/nodes/SoTexture2.h>
+#include <Inventor/nodes/SoTexture2Transform.h>
+#include <Inventor/nodes/SoTextureCoordinateBinding.h>
+#include <Inventor/nodes/SoTransformation.h>
+#include <Inventor/nodes/SoShaderProgram.h>
 
 #ifdef HAVE_VRML97
 #include <Inventor/VRMLnodes/SoVRMLCoordinate.h>
@@ -294,6 +387,28 @@
 #include "coindefs.h" // COIN_STUB()
 #include "SbBasicP.h"
 #include "actions/SoSubActionP.h"
+#include "misc/SbHash.h"
+
+// shapes with more triangles than this are not merged by default
+static const int SOREORGANIZE_DEFAULT_MERGE_LIMIT = 4096;
+// the maximum number of vertices in a merged shape
+static const int SOREORGANIZE_MAX_MERGED_VERTICES = 65535;
+
+// Maps the faces of a merged SoIndexedFaceSet back to the shapes
+// they were merged from.
+class soreorganize_mergedshape {
+public:
+  ~soreorganize_mergedshape() {
+    for (int i = 0; i < this->partpath.getLength(); i++) {
+      this->partpath[i]->unref();
+    }
+  }
+  // index of the first face of each part
+  SbList <int> partstart;
+  SbList <SoPath *> partpath;
+  // face index in the original shape, for each face
+  SbList <int32_t> faceindex;
+};
 
 class SoReorganizeActionP {
  public:
@@ -304,6 +419,9 @@ class SoReorganizeActionP {
       gentristrips(FALSE),
       genvp(FALSE),
       matchidx(TRUE),
+      mergeshapes(FALSE),
+      mergelimit(SOREORGANIZE_DEFAULT_MERGE_LIMIT),
+      mergedroot(NULL),
       cbaction(SbViewportRegion(640, 480)),
       pvcache(NULL)
   {
@@ -334,12 +452,21 @@ class SoReorganizeActionP {
 #endif // HAVE_VRML97
 
   }
+  ~SoReorganizeActionP() {
+    this->clearMerged();
+  }
   SoReorganizeAction * master;
   SbBool gennormals;
   SbBool gentexcoords;
   SbBool gentristrips;
   SbBool genvp;
   SbBool matchidx;
+  SbBool mergeshapes;
+  int mergelimit;
+
+  SoSeparator * mergedroot;
+  SbList <soreorganize_mergedshape *> mergedshapes;
+  SbHash <const SoNode *, soreorganize_mergedshape *> mergedshapemap;
   SbList <SbBool> needtexcoords;
   int lastneeded;
   int numtriangles;
@@ -376,6 +503,9 @@ class SoReorganizeActionP {
   void replaceVrmlIls(SoFullPath * path);
 
   SoVertexProperty * createVertexProperty(const SbBool forlines);
+
+  void mergeSceneGraph(SoNode * root);
+  void clearMerged(void);
 };
 
 
@@ -411,10 +541,19 @@ SoReorganizeAction::~SoReorganizeAction(void)
 {
 }
 
+/*!
+  Returns the flattened scene graph built by the last apply() when
+  shapes are merged, or \c NULL if shapes are not merged.
+
+  The action keeps a reference to the scene graph until it is applied
+  again or destructed, so ref() it to keep it after that.
+
+  \sa mergeShapes()
+*/
 SoSeparator *
 SoReorganizeAction::getSimplifiedSceneGraph(void) const
 {
-  return NULL;
+  return PRIVATE(this)->mergedroot;
 }
 
 void
@@ -477,6 +616,94 @@ SoReorganizeAction::areIndexArraysMatched(void) const
   return PRIVATE(this)->matchidx;
 }
 
+/*!
+  Sets whether shapes should be merged into a new, flattened scene
+  graph when the action is applied to a node. The default is \c
+  FALSE.
+
+  \sa getSimplifiedSceneGraph()
+  \since Coin 4.1
+*/
+void
+SoReorganizeAction::mergeShapes(SbBool onoff)
+{
+  PRIVATE(this)->mergeshapes = onoff;
+}
+
+/*!
+  Returns whether shapes are merged.
+
+  \sa mergeShapes()
+  \since Coin 4.1
+*/
+SbBool
+SoReorganizeAction::areShapesMerged(void) const
+{
+  return PRIVATE(this)->mergeshapes;
+}
+
+/*!
+  Sets the maximum number of triangles in a shape for the shape to be
+  merged with others. Larger shapes are left as they are, since they
+  don't benefit much from being merged. The default is 4096.
+
+  \sa mergeShapes()
+  \since Coin 4.1
+*/
+void
+SoReorganizeAction::setMergeTriangleLimit(int numtriangles)
+{
+  PRIVATE(this)->mergelimit = numtriangles;
+}
+
+/*!
+  Returns the maximum number of triangles in a shape for it to be
+  merged.
+
+  \sa setMergeTriangleLimit()
+  \since Coin 4.1
+*/
+int
+SoReorganizeAction::getMergeTriangleLimit(void) const
+{
+  return PRIVATE(this)->mergelimit;
+}
+
+/*!
+  Returns the path to the original shape for a point picked on a
+  merged shape in the scene graph returned by
+  getSimplifiedSceneGraph(). If \a faceindex is not \c NULL, it is
+  set to the index of the picked face in the original shape, or -1 if
+  the original shape didn't provide face details.
+
+  \c NULL is returned if the point wasn't picked on a merged shape.
+
+  \sa mergeShapes()
+  \since Coin 4.1
+*/
+const SoPath *
+SoReorganizeAction::getOriginalPath(const SoPickedPoint * pp, int * faceindex) const
+{
+  const SoFullPath * path = reclassify_cast<const SoFullPath *>(pp->getPath());
+  soreorganize_mergedshape * merged;
+  if (!PRIVATE(this)->mergedshapemap.get(path->getTail(), merged)) return NULL;
+
+  const SoDetail * detail = pp->getDetail();
+  if (!detail || !detail->isOfType(SoFaceDetail::getClassTypeId())) return NULL;
+  const int face = coin_assert_cast<const SoFaceDetail *>(detail)->getFaceIndex();
+  if (face < 0 || face >= merged->faceindex.getLength()) return NULL;
+
+  // binary search for the last part starting at or before face
+  int lo = 0, hi = merged->partstart.getLength() - 1;
+  while (lo < hi) {
+    const int mid = (lo + hi + 1) / 2;
+    if (merged->partstart[mid] <= face) lo = mid;
+    else hi = mid - 1;
+  }
+  if (faceindex) *faceindex = merged->faceindex[face];
+  return merged->partpath[lo];
+}
+
 SoSimplifier *
 SoReorganizeAction::getSimplifier(void) const
 {
@@ -486,6 +713,11 @@ SoReorganizeAction::getSimplifier(void) const
 void
 SoReorganizeAction::apply(SoNode * root)
 {
+  if (PRIVATE(this)->mergeshapes) {
+    PRIVATE(this)->mergeSceneGraph(root);
+    return;
+  }
+
   int i;
   PRIVATE(this)->sa.setType(SoVertexShape::getClassTypeId());
   PRIVATE(this)->sa.setSearchingAll(TRUE);
@@ -1037,4 +1269,1184 @@ SoReorganizeActionP::replaceVrmlIls(SoFullPath * path)
 #endif // HAVE_VRML97
 }
 
+// *************************************************************************
+// Shape merging. The scene graph is traversed twice with an
+// SoCallbackAction. The first pass finds the shapes that can be
+// merged and groups them by state, and the second pass collects the
+// triangles of the merged shapes into the groups.
+
+class soreorganize_vertex {
+public:
+  SbVec3f point;
+  SbVec3f normal;
+  SbVec2f texcoord;
+  uint32_t rgba;
+
+  // needed for SbHash
+  operator unsigned long(void) const;
+  int operator==(const soreorganize_vertex & v) const;
+};
+
+soreorganize_vertex::operator unsigned long(void) const
+{
+  // hash the point only, vertices at the same point are resolved by
+  // operator==()
+  unsigned long key = 0;
+  for (int i = 0; i < 3; i++) {
+    uint32_t bits;
+    memcpy(&bits, &this->point[i], sizeof(bits));
+    key = key * 2654435761UL + bits;
+  }
+  return key;
+}
+
+int
+soreorganize_vertex::operator==(const soreorganize_vertex & v) const
+{
+  return
+    (this->point == v.point) &&
+    (this->normal == v.normal) &&
+    (this->texcoord == v.texcoord) &&
+    (this->rgba == v.rgba);
+}
+
+// The state a group of merged shapes is rendered with. The diffuse
+// color and transparency are stored per vertex.
+class soreorganize_mergekey {
+public:
+  soreorganize_mergekey(void)
+    : program(NULL), image(NULL), imagesize(0, 0), imagenc(0),
+      wraps(0), wrapt(0), model(0), blendcolor(0.0f, 0.0f, 0.0f),
+      ambient(0.0f, 0.0f, 0.0f), specular(0.0f, 0.0f, 0.0f),
+      emissive(0.0f, 0.0f, 0.0f), shininess(0.0f), transparent(FALSE),
+      lighting(TRUE), vertexordering(0), shapetype(0) { }
+
+  SoNode * program;
+  const unsigned char * image;
+  SbVec2s imagesize;
+  int imagenc;
+  int wraps, wrapt, model;
+  SbColor blendcolor;
+  SbColor ambient, specular, emissive;
+  float shininess;
+  SbBool transparent;
+  SbBool lighting;
+  int vertexordering;
+  int shapetype;
+
+  uint32_t hash(void) const;
+  int compare(const soreorganize_mergekey & key) const;
+  SbBool sameTexture(const soreorganize_mergekey & key) const;
+};
+
+static int
+soreorganize_compare(int a, int b)
+{
+  return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int
+soreorganize_compare(size_t a, size_t b)
+{
+  return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int
+soreorganize_compare(const SbColor & a, const SbColor & b)
+{
+  for (int i = 0; i < 3; i++) {
+    if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+uint32_t
+soreorganize_mergekey::hash(void) const
+{
+  const float values[] = {
+    this->ambient[0], this->ambient[1], this->ambient[2],
+    this->specular[0], this->specular[1], this->specular[2],
+    this->emissive[0], this->emissive[1], this->emissive[2],
+    this->shininess
+  };
+  uint32_t h = static_cast<uint32_t>(reinterpret_cast<size_t>(this->program));
+  h = h * 31 + static_cast<uint32_t>(reinterpret_cast<size_t>(this->image));
+  for (unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    uint32_t bits;
+    memcpy(&bits, &values[i], sizeof(bits));
+    h = h * 31 + bits;
+  }
+  return h;
+}
+
+// Orders keys so that the most expensive state changes are done
+// least often: transparent groups last, then on shader program,
+// texture, light model, shape hints and material.
+int
+soreorganize_mergekey::compare(const soreorganize_mergekey & key) const
+{
+  int c;
+  if ((c = soreorganize_compare(this->transparent, key.transparent))) return c;
+  if ((c = soreorganize_compare(reinterpret_cast<size_t>(this->program),
+                                reinterpret_cast<size_t>(key.program)))) return c;
+  if ((c = soreorganize_compare(reinterpret_cast<size_t>(this->image),
+                                reinterpret_cast<size_t>(key.image)))) return c;
+  if ((c = soreorganize_compare(this->wraps, key.wraps))) return c;
+  if ((c = soreorganize_compare(this->wrapt, key.wrapt))) return c;
+  if ((c = soreorganize_compare(this->model, key.model))) return c;
+  if ((c = soreorganize_compare(this->blendcolor, key.blendcolor))) return c;
+  if ((c = soreorganize_compare(this->lighting, key.lighting))) return c;
+  if ((c = soreorganize_compare(this->vertexordering, key.vertexordering))) return c;
+  if ((c = soreorganize_compare(this->shapetype, key.shapetype))) return c;
+  if ((c = soreorganize_compare(this->ambient, key.ambient))) return c;
+  if ((c = soreorganize_compare(this->specular, key.specular))) return c;
+  if ((c = soreorganize_compare(this->emissive, key.emissive))) return c;
+  if (this->shininess != key.shininess) return this->shininess < key.shininess ? -1 : 1;
+  return 0;
+}
+
+SbBool
+soreorganize_mergekey::sameTexture(const soreorganize_mergekey & key) const
+{
+  return
+    (this->image == key.image) &&
+    (this->wraps == key.wraps) &&
+    (this->wrapt == key.wrapt) &&
+    (this->model == key.model) &&
+    (this->blendcolor == key.blendcolor);
+}
+
+class soreorganize_mergegroup {
+public:
+  soreorganize_mergegroup(const soreorganize_mergekey & keyarg)
+    : key(keyarg), next(NULL), numtriangles(0), sep(NULL),
+      vhash(1024), current(NULL), currentocc(-1) { }
+
+  soreorganize_mergekey key;
+  // next group in the same hash bucket
+  soreorganize_mergegroup * next;
+  int numtriangles;
+
+  SoSeparator * sep;
+  // the merged shape being built
+  SbList <soreorganize_vertex> vertices;
+  SbList <int32_t> coordindex;
+  SbHash <soreorganize_vertex, int32_t> vhash;
+  soreorganize_mergedshape * current;
+  int currentocc;
+};
+
+// The camera, lights and clipping planes a shape is rendered with.
+class soreorganize_env {
+public:
+  void capture(SoState * state);
+  SbBool operator==(const soreorganize_env & env) const;
+
+  SbMatrix viewing;
+  SbMatrix projection;
+  SbList <SoNode *> lights;
+  SbList <SbPlane> planes;
+};
+
+void
+soreorganize_env::capture(SoState * state)
+{
+  this->viewing = SoViewingMatrixElement::get(state);
+  this->projection = SoProjectionMatrixElement::get(state);
+  const SoNodeList & lights = SoLightElement::getLights(state);
+  this->lights.truncate(0);
+  for (int i = 0; i < lights.getLength(); i++) {
+    this->lights.append(lights[i]);
+  }
+  const SoClipPlaneElement * clip = SoClipPlaneElement::getInstance(state);
+  this->planes.truncate(0);
+  for (int i = 0; i < clip->getNum(); i++) {
+    this->planes.append(clip->get(i, TRUE));
+  }
+}
+
+SbBool
+soreorganize_env::operator==(const soreorganize_env & env) const
+{
+  if (this->viewing != env.viewing || this->projection != env.projection) return FALSE;
+  if (this->lights.getLength() != env.lights.getLength() ||
+      this->planes.getLength() != env.planes.getLength()) return FALSE;
+  for (int i = 0; i < this->lights.getLength(); i++) {
+    if (this->lights[i] != env.lights[i]) return FALSE;
+  }
+  for (int i = 0; i < this->planes.getLength(); i++) {
+    if (this->planes[i] != env.planes[i]) return FALSE;
+  }
+  return TRUE;
+}
+
+class soreorganize_occurrence {
+public:
+  const SoNode * shape;
+  soreorganize_mergegroup * group;
+  int env;
+  int numtriangles;
+  SbBool mergeable;
+  // path to the shape in the original scene graph, set in the second
+  // pass for merged shapes
+  SoPath * path;
+};
+
+// state which is popped by separators
+class soreorganize_scope {
+public:
+  SoNode * program;
+  SbBool mergeable;
+};
+
+class soreorganize_removal {
+public:
+  SoGroup * parent;
+  int index;
+};
+
+class soreorganize_merge {
+public:
+  soreorganize_merge(SoReorganizeActionP * master);
+  ~soreorganize_merge();
+
+  SoSeparator * apply(SoNode * root);
+
+private:
+  SoReorganizeActionP * master;
+  SoCallbackAction cbaction;
+  int pass;
+  SoNode * root;
+  SbBool wrapped;
+  SoGroup * wrapper;
+  SoInfo * marker;
+
+  SbList <soreorganize_scope> scopes;
+  SbList <soreorganize_env *> envs;
+  soreorganize_env endenv;
+  SbList <soreorganize_occurrence> occurrences;
+  int curocc;
+  SbList <soreorganize_mergegroup *> groups;
+  SbHash <uint32_t, soreorganize_mergegroup *> groupmap;
+
+  // transformations for the current shape in the second pass
+  SbMatrix modelmatrix;
+  SbMatrix normalmatrix;
+  SbMatrix texturematrix;
+  SbBool flip;
+
+  static SoCallbackAction::Response pre_node_cb(void * userdata, SoCallbackAction * action, const SoNode * node);
+  static SoCallbackAction::Response post_node_cb(void * userdata, SoCallbackAction * action, const SoNode * node);
+  static SoCallbackAction::Response pre_shape_cb(void * userdata, SoCallbackAction * action, const SoNode * node);
+  static SoCallbackAction::Response post_shape_cb(void * userdata, SoCallbackAction * action, const SoNode * node);
+  static void triangle_cb(void * userdata, SoCallbackAction * action,
+                          const SoPrimitiveVertex * v1,
+                          const SoPrimitiveVertex * v2,
+                          const SoPrimitiveVertex * v3);
+  static void line_segment_cb(void * userdata, SoCallbackAction * action,
+                              const SoPrimitiveVertex * v1,
+                              const SoPrimitiveVertex * v2);
+  static void point_cb(void * userdata, SoCallbackAction * action,
+                       const SoPrimitiveVertex * v);
+
+  static SbBool isDynamic(const SoNode * node);
+  static SbBool isInert(const SoNode * node);
+  static int compareGroups(const void * a, const void * b);
+  static int compareRemovals(const void * a, const void * b);
+
+  SbBool checkPath(const SoFullPath * path) const;
+  SbBool initOccurrence(SoState * state, soreorganize_occurrence & occ);
+  void resolve(void);
+  void setupShape(SoCallbackAction * action, soreorganize_occurrence & occ);
+  void addTriangle(SoState * state, soreorganize_occurrence & occ,
+                   const SoPrimitiveVertex ** v);
+  void finishShape(soreorganize_mergegroup * group);
+  SoSeparator * buildMerged(void);
+  void removeMerged(SoGroup * result);
+  SbBool prune(SoGroup * group, SbHash <const SoNode *, SbBool> & visited);
+};
+
+soreorganize_merge::soreorganize_merge(SoReorganizeActionP * masterarg)
+  : master(masterarg),
+    cbaction(SbViewportRegion(640, 480)),
+    pass(0),
+    root(NULL),
+    wrapped(FALSE),
+    wrapper(NULL),
+    marker(NULL),
+    curocc(-1)
+{
+  this->cbaction.addPreCallback(SoNode::getClassTypeId(), pre_node_cb, this);
+  this->cbaction.addPostCallback(SoSeparator::getClassTypeId(), post_node_cb, this);
+  this->cbaction.addPreCallback(SoShape::getClassTypeId(), pre_shape_cb, this);
+  this->cbaction.addPostCallback(SoShape::getClassTypeId(), post_shape_cb, this);
+  this->cbaction.addTriangleCallback(SoShape::getClassTypeId(), triangle_cb, this);
+  this->cbaction.addLineSegmentCallback(SoShape::getClassTypeId(), line_segment_cb, this);
+  this->cbaction.addPointCallback(SoShape::getClassTypeId(), point_cb, this);
+}
+
+soreorganize_merge::~soreorganize_merge()
+{
+  int i;
+  for (i = 0; i < this->occurrences.getLength(); i++) {
+    if (this->occurrences[i].path) this->occurrences[i].path->unref();
+  }
+  for (i = 0; i < this->envs.getLength(); i++) {
+    delete this->envs[i];
+  }
+  for (i = 0; i < this->groups.getLength(); i++) {
+    delete this->groups[i];
+  }
+}
+
+SoSeparator *
+soreorganize_merge::apply(SoNode * rootarg)
+{
+  this->root = rootarg;
+
+  // Shapes are merged into groups appended to the root node, so we
+  // need the state at the end of the root's children. Traverse them
+  // through a wrapper group with a marker node at the end.
+  this->wrapper = new SoGroup;
+  this->wrapper->ref();
+  this->wrapped =
+    !this->root->isOfType(SoSeparator::getClassTypeId()) &&
+    this->root->getTypeId() != SoGroup::getClassTypeId();
+  if (this->wrapped) {
+    this->wrapper->addChild(this->root);
+  }
+  else {
+    SoGroup * g = coin_assert_cast<SoGroup *>(this->root);
+    for (int i = 0; i < g->getNumChildren(); i++) {
+      this->wrapper->addChild(g->getChild(i));
+    }
+  }
+  this->marker = new SoInfo;
+  this->wrapper->addChild(this->marker);
+
+  soreorganize_scope scope;
+  scope.program = NULL;
+  scope.mergeable = TRUE;
+  this->scopes.append(scope);
+
+  this->pass = 1;
+  this->cbaction.apply(this->wrapper);
+  this->resolve();
+
+  SoSeparator * merged = this->buildMerged();
+  merged->ref();
+
+  this->pass = 2;
+  this->curocc = -1;
+  this->cbaction.apply(this->wrapper);
+  for (int i = 0; i < this->groups.getLength(); i++) {
+    this->finishShape(this->groups[i]);
+  }
+
+  SoGroup * result;
+  if (this->wrapped) {
+    result = new SoSeparator;
+    result->addChild(this->root->copy(TRUE));
+  }
+  else {
+    result = coin_assert_cast<SoGroup *>(this->root->copy(TRUE));
+  }
+  result->ref();
+  this->removeMerged(result);
+  SbHash <const SoNode *, SbBool> visited;
+  (void) this->prune(result, visited);
+  if (merged->getNumChildren()) result->addChild(merged);
+  merged->unref();
+
+  this->wrapper->unref();
+  this->wrapper = NULL;
+
+  if (!result->isOfType(SoSeparator::getClassTypeId())) {
+    SoSeparator * sep = new SoSeparator;
+    for (int i = 0; i < result->getNumChildren(); i++) {
+      sep->addChild(result->getChild(i));
+    }
+    result->unref();
+    result = sep;
+    result->ref();
+  }
+  result->unrefNoDelete();
+  return coin_assert_cast<SoSeparator *>(result);
+}
+
+// Returns TRUE if node changes between traversals, or depends on the
+// view, so that shapes affected by it can't be merged. Cameras,
+// lights and clipping planes are not baked into the merged shapes,
+// so they may change.
+SbBool
+soreorganize_merge::isDynamic(const SoNode * node)
+{
+  if (node->isOfType(SoCamera::getClassTypeId()) ||
+      node->isOfType(SoLight::getClassTypeId()) ||
+      node->isOfType(SoClipPlane::getClassTypeId())) {
+    return FALSE;
+  }
+  if (node->isOfType(SoTransformManip::getClassTypeId()) ||
+      node->isOfType(SoAntiSquish::getClassTypeId()) ||
+      node->isOfType(SoSurroundScale::getClassTypeId())) {
+    return TRUE;
+  }
+  const SoFieldData * fields = node->getFieldData();
+  if (fields) {
+    for (int i = 0; i < fields->getNumFields(); i++) {
+      if (fields->getField(node, i)->isConnected()) return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// Returns TRUE for nodes that only set up state for shapes, and can
+// be removed when there are no shapes left for them to affect.
+SbBool
+soreorganize_merge::isInert(const SoNode * node)
+{
+  static const SoType types[] = {
+    SoTransformation::getClassTypeId(),
+    SoMaterial::getClassTypeId(),
+    SoBaseColor::getClassTypeId(),
+    SoPackedColor::getClassTypeId(),
+    SoMaterialBinding::getClassTypeId(),
+    SoNormalBinding::getClassTypeId(),
+    SoTextureCoordinateBinding::getClassTypeId(),
+    SoShapeHints::getClassTypeId(),
+    SoComplexity::getClassTypeId(),
+    SoDrawStyle::getClassTypeId(),
+    SoLightModel::getClassTypeId(),
+    SoLight::getClassTypeId(),
+    SoCoordinate3::getClassTypeId(),
+    SoCoordinate4::getClassTypeId(),
+    SoNormal::getClassTypeId(),
+    SoTextureCoordinate2::getClassTypeId(),
+    SoTexture2::getClassTypeId(),
+    SoTexture2Transform::getClassTypeId(),
+    SoVertexProperty::getClassTypeId(),
+    SoShaderProgram::getClassTypeId(),
+    SoInfo::getClassTypeId(),
+    SoLabel::getClassTypeId()
+  };
+  if (node->isOfType(SoTransformManip::getClassTypeId())) return FALSE;
+  for (unsigned int i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    if (node->isOfType(types[i])) return TRUE;
+  }
+  return FALSE;
+}
+
+SoCallbackAction::Response
+soreorganize_merge::pre_node_cb(void * userdata, SoCallbackAction * action, const SoNode * node)
+{
+  soreorganize_merge * thisp = static_cast<soreorganize_merge *>(userdata);
+  if (thisp->pass != 1) return SoCallbackAction::CONTINUE;
+
+  if (node->isOfType(SoSeparator::getClassTypeId())) {
+    const soreorganize_scope top = thisp->scopes[thisp->scopes.getLength() - 1];
+    thisp->scopes.append(top);
+  }
+  else if (node->isOfType(SoShaderProgram::getClassTypeId())) {
+    thisp->scopes[thisp->scopes.getLength() - 1].program = const_cast<SoNode *>(node);
+  }
+  else if (node == thisp->marker) {
+    thisp->endenv.capture(action->getState());
+  }
+  else if (node->isOfType(SoCallback::getClassTypeId()) ||
+           (!node->isOfType(SoGroup::getClassTypeId()) &&
+            !node->isOfType(SoShape::getClassTypeId()) &&
+            isDynamic(node))) {
+    thisp->scopes[thisp->scopes.getLength() - 1].mergeable = FALSE;
+  }
+  return SoCallbackAction::CONTINUE;
+}
+
+SoCallbackAction::Response
+soreorganize_merge::post_node_cb(void * userdata, SoCallbackAction * COIN_UNUSED_ARG(action), const SoNode * COIN_UNUSED_ARG(node))
+{
+  soreorganize_merge * thisp = static_cast<soreorganize_merge *>(userdata);
+  if (thisp->pass == 1) {
+    thisp->scopes.truncate(thisp->scopes.getLength() - 1);
+  }
+  return SoCallbackAction::CONTINUE;
+}
+
+// Shapes can only be merged if all the nodes above them are groups
+// which traverse all their children in the same way every time.
+SbBool
+soreorganize_merge::checkPath(const SoFullPath * path) const
+{
+  // skip the wrapper group at the head and the shape at the tail
+  for (int i = 1; i < path->getLength() - 1; i++) {
+    const SoNode * node = path->getNode(i);
+    if (!node->isOfType(SoGroup::getClassTypeId()) ||
+        node->isOfType(SoSwitch::getClassTypeId()) ||
+        node->isOfType(SoLOD::getClassTypeId()) ||
+        node->isOfType(SoLevelOfDetail::getClassTypeId()) ||
+        node->isOfType(SoAnnotation::getClassTypeId()) ||
+        node->isOfType(SoLocateHighlight::getClassTypeId()) ||
+        node->isOfType(SoSelection::getClassTypeId()) ||
+        node->isOfType(SoInstancedMultipleCopy::getClassTypeId())) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+SoCallbackAction::Response
+soreorganize_merge::pre_shape_cb(void * userdata, SoCallbackAction * action, const SoNode * node)
+{
+  soreorganize_merge * thisp = static_cast<soreorganize_merge *>(userdata);
+  if (thisp->pass == 1) {
+    soreorganize_occurrence occ;
+    occ.shape = node;
+    occ.group = NULL;
+    occ.env = -1;
+    occ.numtriangles = 0;
+    occ.path = NULL;
+    occ.mergeable =
+      thisp->scopes[thisp->scopes.getLength() - 1].mergeable &&
+      !node->isOfType(SoText2::getClassTypeId()) &&
+      !node->isOfType(SoImage::getClassTypeId()) &&
+      !isDynamic(node) &&
+      thisp->checkPath(reclassify_cast<const SoFullPath *>(action->getCurPath()));
+    thisp->occurrences.append(occ);
+    thisp->curocc = thisp->occurrences.getLength() - 1;
+  }
+  else {
+    thisp->curocc++;
+    soreorganize_occurrence & occ = thisp->occurrences[thisp->curocc];
+    assert(occ.shape == node);
+    if (occ.mergeable) thisp->setupShape(action, occ);
+  }
+  return SoCallbackAction::CONTINUE;
+}
+
+SoCallbackAction::Response
+soreorganize_merge::post_shape_cb(void * userdata, SoCallbackAction * COIN_UNUSED_ARG(action), const SoNode * COIN_UNUSED_ARG(node))
+{
+  soreorganize_merge * thisp = static_cast<soreorganize_merge *>(userdata);
+  if (thisp->pass == 1) {
+    soreorganize_occurrence & occ = thisp->occurrences[thisp->curocc];
+    if (occ.numtriangles == 0 || occ.numtriangles > thisp->master->mergelimit) {
+      occ.mergeable = FALSE;
+    }
+  }
+  return SoCallbackAction::CONTINUE;
+}
+
+void
+soreorganize_merge::triangle_cb(void * userdata, SoCallbackAction * action,
+                                const SoPrimitiveVertex * v1,
+                                const SoPrimitiveVertex * v2,
+                                const SoPrimitiveVertex * v3)
+{
+  soreorganize_merge * thisp = static_cast<soreorganize_merge *>(userdata);
+  soreorganize_occurrence & occ = thisp->occurrences[thisp->curocc];
+  if (!occ.mergeable) return;
+
+  if (thisp->pass == 1) {
+    if (occ.group == NULL && !thisp->initOccurrence(action->getState(), occ)) {
+      occ.mergeable = FALSE;
+      return;
+    }
+    occ.numtriangles++;
+  }
+  else {
+    const SoPrimitiveVertex * v[3] = { v1, v2, v3 };
+    thisp->addTriangle(action->getState(), occ, v);
+  }
+}
+
+void
+soreorganize_merge::line_segment_cb(void * userdata, SoCallbackAction * COIN_UNUSED_ARG(action),
+                                    const SoPrimitiveVertex * COIN_UNUSED_ARG(v1),
+                                    const SoPrimitiveVertex * COIN_UNUSED_ARG(v2))
+{
+  soreorganize_merge * thisp = static_cast<soreorganize_merge *>(userdata);
+  if (thisp->pass == 1) thisp->occurrences[thisp->curocc].mergeable = FALSE;
+}
+
+void
+soreorganize_merge::point_cb(void * userdata, SoCallbackAction * COIN_UNUSED_ARG(action),
+                             const SoPrimitiveVertex * COIN_UNUSED_ARG(v))
+{
+  soreorganize_merge * thisp = static_cast<soreorganize_merge *>(userdata);
+  if (thisp->pass == 1) thisp->occurrences[thisp->curocc].mergeable = FALSE;
+}
+
+// Checks the state of a shape on its first triangle, and finds the
+// group and environment for it.
+SbBool
+soreorganize_merge::initOccurrence(SoState * state, soreorganize_occurrence & occ)
+{
+  const unsigned int shapeflags = SoShapeStyleElement::get(state)->getFlags();
+  if (shapeflags &
+      (SoShapeStyleElement::BUMPMAP|
+       SoShapeStyleElement::BBOXCMPLX|
+       SoShapeStyleElement::INVISIBLE|
+       SoShapeStyleElement::BIGIMAGE)) {
+    return FALSE;
+  }
+  if (SoDrawStyleElement::get(state) != SoDrawStyleElement::FILLED) return FALSE;
+
+  soreorganize_mergekey key;
+  key.program = this->scopes[this->scopes.getLength() - 1].program;
+
+  // only a 2D texture on unit 0 is supported, as in initShape()
+  int lastenabled;
+  const SbBool * enabledunits =
+    SoMultiTextureEnabledElement::getEnabledUnits(state, lastenabled);
+  if (enabledunits) {
+    for (int i = 1; i <= lastenabled; i++) {
+      if (enabledunits[i]) return FALSE;
+    }
+  }
+  if (SoMultiTextureEnabledElement::get(state, 0)) {
+    if (SoMultiTextureEnabledElement::getMode(state, 0) !=
+        SoMultiTextureEnabledElement::TEXTURE2D) return FALSE;
+    // texture coordinates generated by OpenGL can't be transformed
+    // to world coordinates
+    if (SoMultiTextureCoordinateElement::getType(state, 0) ==
+        SoMultiTextureCoordinateElement::TEXGEN) return FALSE;
+
+    SoMultiTextureImageElement::Wrap wraps, wrapt;
+    SoMultiTextureImageElement::Model model;
+    key.image = SoMultiTextureImageElement::get(state, 0, key.imagesize, key.imagenc,
+                                                wraps, wrapt, model, key.blendcolor);
+    if (key.image == NULL) return FALSE;
+    if ((wraps != SoMultiTextureImageElement::REPEAT &&
+         wraps != SoMultiTextureImageElement::CLAMP) ||
+        (wrapt != SoMultiTextureImageElement::REPEAT &&
+         wrapt != SoMultiTextureImageElement::CLAMP)) {
+      return FALSE;
+    }
+    key.wraps = wraps;
+    key.wrapt = wrapt;
+    key.model = model;
+  }
+
+  key.ambient = SoLazyElement::getAmbient(state);
+  key.specular = SoLazyElement::getSpecular(state);
+  key.emissive = SoLazyElement::getEmissive(state);
+  key.shininess = SoLazyElement::getShininess(state);
+  key.transparent = SoLazyElement::getInstance(state)->isTransparent();
+  key.lighting = SoLightModelElement::get(state) != SoLightModelElement::BASE_COLOR;
+  key.vertexordering = SoShapeHintsElement::getVertexOrdering(state);
+  key.shapetype = SoShapeHintsElement::getShapeType(state);
+
+  const uint32_t hash = key.hash();
+  soreorganize_mergegroup * first = NULL;
+  (void) this->groupmap.get(hash, first);
+  soreorganize_mergegroup * group = first;
+  while (group && group->key.compare(key) != 0) group = group->next;
+  if (group == NULL) {
+    group = new soreorganize_mergegroup(key);
+    group->next = first;
+    this->groupmap.put(hash, group);
+    this->groups.append(group);
+  }
+  occ.group = group;
+
+  soreorganize_env env;
+  env.capture(state);
+  int i = this->envs.getLength() - 1;
+  while (i >= 0 && !(*this->envs[i] == env)) i--;
+  if (i < 0) {
+    i = this->envs.getLength();
+    this->envs.append(new soreorganize_env(env));
+  }
+  occ.env = i;
+  return TRUE;
+}
+
+// Decides which shapes to merge after the first pass.
+void
+soreorganize_merge::resolve(void)
+{
+  int i;
+  SbList <SbBool> envok;
+  for (i = 0; i < this->envs.getLength(); i++) {
+    envok.append(*this->envs[i] == this->endenv);
+  }
+
+  // a shape node can only be removed from the scene graph if all its
+  // instances are merged
+  SbHash <const SoNode *, SbBool> keep;
+  for (i = 0; i < this->occurrences.getLength(); i++) {
+    soreorganize_occurrence & occ = this->occurrences[i];
+    if (occ.mergeable && !envok[occ.env]) occ.mergeable = FALSE;
+    if (!occ.mergeable) keep.put(occ.shape, TRUE);
+  }
+  for (i = 0; i < this->occurrences.getLength(); i++) {
+    soreorganize_occurrence & occ = this->occurrences[i];
+    SbBool dummy;
+    if (occ.mergeable && keep.get(occ.shape, dummy)) occ.mergeable = FALSE;
+    if (occ.mergeable) occ.group->numtriangles += occ.numtriangles;
+  }
+}
+
+void
+soreorganize_merge::setupShape(SoCallbackAction * action, soreorganize_occurrence & occ)
+{
+  const SoFullPath * curpath = reclassify_cast<const SoFullPath *>(action->getCurPath());
+  SoPath * path = new SoPath(this->root);
+  path->ref();
+  for (int i = this->wrapped ? 2 : 1; i < curpath->getLength(); i++) {
+    path->append(curpath->getIndex(i));
+  }
+  occ.path = path;
+
+  this->modelmatrix = action->getModelMatrix();
+  this->normalmatrix = this->modelmatrix.inverse().transpose();
+  this->texturematrix = SoMultiTextureMatrixElement::get(action->getState(), 0);
+  // mirroring transformations turn the triangles inside out
+  this->flip = this->modelmatrix.det3() < 0.0f;
+}
+
+void
+soreorganize_merge::addTriangle(SoState * state, soreorganize_occurrence & occ,
+                                const SoPrimitiveVertex ** v)
+{
+  soreorganize_mergegroup * group = occ.group;
+  if (group->vertices.getLength() + 3 > SOREORGANIZE_MAX_MERGED_VERTICES) {
+    this->finishShape(group);
+  }
+  if (group->current == NULL) {
+    group->current = new soreorganize_mergedshape;
+    group->currentocc = -1;
+  }
+  soreorganize_mergedshape * merged = group->current;
+  if (group->currentocc != this->curocc) {
+    group->currentocc = this->curocc;
+    merged->partstart.append(merged->faceindex.getLength());
+    merged->partpath.append(occ.path);
+    occ.path->ref();
+  }
+
+  const SoLazyElement * lazy = SoLazyElement::getInstance(state);
+  const uint32_t * packed = lazy->isPacked() ? lazy->getPackedPointer() : NULL;
+
+  int32_t idx[3];
+  for (int i = 0; i < 3; i++) {
+    soreorganize_vertex vertex;
+    this->modelmatrix.multVecMatrix(v[i]->getPoint(), vertex.point);
+    if (group->key.lighting) {
+      this->normalmatrix.multDirMatrix(v[i]->getNormal(), vertex.normal);
+      vertex.normal.normalize();
+    }
+    else {
+      vertex.normal.setValue(0.0f, 0.0f, 0.0f);
+    }
+    if (group->key.image) {
+      SbVec4f tc;
+      this->texturematrix.multVecMatrix(v[i]->getTextureCoords(), tc);
+      if (tc[3] != 0.0f) {
+        tc[0] /= tc[3];
+        tc[1] /= tc[3];
+      }
+      vertex.texcoord.setValue(tc[0], tc[1]);
+    }
+    else {
+      vertex.texcoord.setValue(0.0f, 0.0f);
+    }
+    const int midx = v[i]->getMaterialIndex();
+    if (packed) {
+      vertex.rgba = packed[SbClamp(midx, 0, lazy->getNumDiffuse() - 1)];
+    }
+    else {
+      vertex.rgba = lazy->getDiffusePointer()[SbClamp(midx, 0, lazy->getNumDiffuse() - 1)].
+        getPackedValue(lazy->getTransparencyPointer()[SbClamp(midx, 0, lazy->getNumTransparencies() - 1)]);
+    }
+
+    if (!group->vhash.get(vertex, idx[i])) {
+      idx[i] = group->vertices.getLength();
+      group->vertices.append(vertex);
+      group->vhash.put(vertex, idx[i]);
+    }
+  }
+  if (this->flip) {
+    int32_t tmp = idx[1];
+    idx[1] = idx[2];
+    idx[2] = tmp;
+  }
+  group->coordindex.append(idx[0]);
+  group->coordindex.append(idx[1]);
+  group->coordindex.append(idx[2]);
+  group->coordindex.append(-1);
+
+  const SoDetail * detail = v[0]->getDetail();
+  merged->faceindex.append((detail && detail->isOfType(SoFaceDetail::getClassTypeId())) ?
+                           coin_assert_cast<const SoFaceDetail *>(detail)->getFaceIndex() : -1);
+}
+
+// Creates a merged shape from the triangles collected in group.
+void
+soreorganize_merge::finishShape(soreorganize_mergegroup * group)
+{
+  if (group->current == NULL) return;
+
+  const int numv = group->vertices.getLength();
+  const soreorganize_vertex * src = group->vertices.getArrayPtr();
+  SoVertexProperty * vp = new SoVertexProperty;
+
+  vp->vertex.setNum(numv);
+  SbVec3f * dst = vp->vertex.startEditing();
+  for (int i = 0; i < numv; i++) dst[i] = src[i].point;
+  vp->vertex.finishEditing();
+
+  vp->normalBinding = SoVertexProperty::OVERALL;
+  if (group->key.lighting) {
+    vp->normalBinding = SoVertexProperty::PER_VERTEX_INDEXED;
+    vp->normal.setNum(numv);
+    dst = vp->normal.startEditing();
+    for (int i = 0; i < numv; i++) dst[i] = src[i].normal;
+    vp->normal.finishEditing();
+  }
+
+  if (group->key.image) {
+    vp->texCoord.setNum(numv);
+    SbVec2f * tdst = vp->texCoord.startEditing();
+    for (int i = 0; i < numv; i++) tdst[i] = src[i].texcoord;
+    vp->texCoord.finishEditing();
+  }
+
+  SbBool colorpervertex = FALSE;
+  for (int i = 1; i < numv && !colorpervertex; i++) {
+    colorpervertex = src[i].rgba != src[0].rgba;
+  }
+  vp->materialBinding = SoVertexProperty::OVERALL;
+  vp->orderedRGBA = src[0].rgba;
+  if (colorpervertex) {
+    vp->materialBinding = SoVertexProperty::PER_VERTEX_INDEXED;
+    vp->orderedRGBA.setNum(numv);
+    uint32_t * cdst = vp->orderedRGBA.startEditing();
+    for (int i = 0; i < numv; i++) cdst[i] = src[i].rgba;
+    vp->orderedRGBA.finishEditing();
+  }
+
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  ifs->vertexProperty = vp;
+  ifs->coordIndex.setValues(0, group->coordindex.getLength(),
+                            group->coordindex.getArrayPtr());
+  group->sep->addChild(ifs);
+
+  this->master->mergedshapes.append(group->current);
+  this->master->mergedshapemap.put(ifs, group->current);
+  group->current = NULL;
+  group->vertices.truncate(0);
+  group->coordindex.truncate(0);
+  group->vhash.clear();
+}
+
+int
+soreorganize_merge::compareGroups(const void * a, const void * b)
+{
+  const soreorganize_mergegroup * ga = *static_cast<soreorganize_mergegroup * const *>(a);
+  const soreorganize_mergegroup * gb = *static_cast<soreorganize_mergegroup * const *>(b);
+  return ga->key.compare(gb->key);
+}
+
+// Sets up a separator with the state for each group, in the order
+// they should be rendered. The merged shapes are added to them in the
+// second pass.
+SoSeparator *
+soreorganize_merge::buildMerged(void)
+{
+  SoSeparator * merged = new SoSeparator;
+  SbList <soreorganize_mergegroup *> sorted;
+  for (int i = 0; i < this->groups.getLength(); i++) {
+    if (this->groups[i]->numtriangles) sorted.append(this->groups[i]);
+  }
+  qsort(const_cast<soreorganize_mergegroup **>(sorted.getArrayPtr()), sorted.getLength(),
+        sizeof(soreorganize_mergegroup *), compareGroups);
+
+  SbList <soreorganize_mergegroup *> texturegroups;
+  SbList <SoTexture2 *> textures;
+  for (int i = 0; i < sorted.getLength(); i++) {
+    soreorganize_mergegroup * group = sorted[i];
+    const soreorganize_mergekey & key = group->key;
+    group->sep = new SoSeparator;
+
+    SoShapeHints * hints = new SoShapeHints;
+    hints->vertexOrdering = key.vertexordering;
+    hints->shapeType = key.shapetype;
+    hints->faceType = SoShapeHints::CONVEX;
+    group->sep->addChild(hints);
+
+    if (!key.lighting) {
+      SoLightModel * lightmodel = new SoLightModel;
+      lightmodel->model = SoLightModel::BASE_COLOR;
+      group->sep->addChild(lightmodel);
+    }
+
+    SoMaterial * material = new SoMaterial;
+    material->ambientColor = key.ambient;
+    material->specularColor = key.specular;
+    material->emissiveColor = key.emissive;
+    material->shininess = key.shininess;
+    group->sep->addChild(material);
+
+    if (key.image) {
+      SoTexture2 * texture = NULL;
+      for (int j = 0; j < texturegroups.getLength() && !texture; j++) {
+        if (texturegroups[j]->key.sameTexture(key)) texture = textures[j];
+      }
+      if (texture == NULL) {
+        texture = new SoTexture2;
+        texture->image.setValue(key.imagesize, key.imagenc, key.image);
+        texture->wrapS = key.wraps;
+        texture->wrapT = key.wrapt;
+        texture->model = key.model;
+        texture->blendColor = key.blendcolor;
+        texturegroups.append(group);
+        textures.append(texture);
+      }
+      group->sep->addChild(texture);
+    }
+    if (key.program) group->sep->addChild(key.program);
+    merged->addChild(group->sep);
+  }
+  return merged;
+}
+
+int
+soreorganize_merge::compareRemovals(const void * a, const void * b)
+{
+  const soreorganize_removal * ra = static_cast<const soreorganize_removal *>(a);
+  const soreorganize_removal * rb = static_cast<const soreorganize_removal *>(b);
+  const int c = soreorganize_compare(reinterpret_cast<size_t>(ra->parent),
+                                     reinterpret_cast<size_t>(rb->parent));
+  if (c) return c;
+  // highest index first, so the indices stay valid while removing
+  return rb->index - ra->index;
+}
+
+// Removes the merged shapes from the copy of the scene graph.
+void
+soreorganize_merge::removeMerged(SoGroup * result)
+{
+  SbList <soreorganize_removal> removals;
+  SbList <int> indices;
+  for (int i = 0; i < this->occurrences.getLength(); i++) {
+    const soreorganize_occurrence & occ = this->occurrences[i];
+    if (!occ.mergeable) continue;
+    const SoFullPath * path = reclassify_cast<const SoFullPath *>(occ.path);
+
+    indices.truncate(0);
+    if (this->wrapped) indices.append(0);
+    for (int j = 1; j < path->getLength(); j++) indices.append(path->getIndex(j));
+
+    soreorganize_removal removal;
+    removal.parent = result;
+    for (int j = 0; j < indices.getLength() - 1; j++) {
+      removal.parent = coin_assert_cast<SoGroup *>(removal.parent->getChild(indices[j]));
+    }
+    removal.index = indices[indices.getLength() - 1];
+    removals.append(removal);
+  }
+  qsort(const_cast<soreorganize_removal *>(removals.getArrayPtr()), removals.getLength(),
+        sizeof(soreorganize_removal), compareRemovals);
+  for (int i = 0; i < removals.getLength(); i++) {
+    if (i > 0 &&
+        removals[i].parent == removals[i-1].parent &&
+        removals[i].index == removals[i-1].index) continue;
+    removals[i].parent->removeChild(removals[i].index);
+  }
+}
+
+// Removes separators that have nothing left to render below group,
+// and returns TRUE if group doesn't render anything.
+SbBool
+soreorganize_merge::prune(SoGroup * group, SbHash <const SoNode *, SbBool> & visited)
+{
+  SbBool inert = TRUE;
+  for (int i = group->getNumChildren() - 1; i >= 0; i--) {
+    SoNode * child = group->getChild(i);
+    SbBool childinert;
+    if (!visited.get(child, childinert)) {
+      // only look below groups that traverse all their children
+      // once, so that removing children doesn't change which of them
+      // are traversed
+      const SoType type = child->getTypeId();
+      if (type == SoSeparator::getClassTypeId() || type == SoGroup::getClassTypeId()) {
+        childinert = this->prune(coin_assert_cast<SoGroup *>(child), visited);
+      }
+      else {
+        childinert = isInert(child);
+      }
+      visited.put(child, childinert);
+    }
+    if (!childinert) {
+      inert = FALSE;
+    }
+    else if (child->getTypeId() == SoSeparator::getClassTypeId() ||
+             (child->getTypeId() == SoGroup::getClassTypeId() &&
+              coin_assert_cast<SoGroup *>(child)->getNumChildren() == 0)) {
+      group->removeChild(i);
+    }
+  }
+  return inert;
+}
+
+// *************************************************************************
+
+void
+SoReorganizeActionP::mergeSceneGraph(SoNode * root)
+{
+  this->clearMerged();
+  soreorganize_merge merge(this);
+  this->mergedroot = merge.apply(root);
+  this->mergedroot->ref();
+}
+
+void
+SoReorganizeActionP::clearMerged(void)
+{
+  if (this->mergedroot) {
+    this->mergedroot->unref();
+    this->mergedroot = NULL;
+  }
+  for (int i = 0; i < this->mergedshapes.getLength(); i++) {
+    delete this->mergedshapes[i];
+  }
+  this->mergedshapes.truncate(0);
+  this->mergedshapemap.clear();
+}
+
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/SoFullPath.h>
+#include <Inventor/SoPickedPoint.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/actions/SoRayPickAction.h>
+#include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+static SoSeparator *
+make_part(float x, const SbColor & color, float shininess, SoCube ** cube)
+{
+  SoSeparator * sep = new SoSeparator;
+  SoTranslation * t = new SoTranslation;
+  t->translation.setValue(x, 0.0f, 0.0f);
+  sep->addChild(t);
+  SoMaterial * m = new SoMaterial;
+  m->diffuseColor = color;
+  m->shininess = shininess;
+  sep->addChild(m);
+  *cube = new SoCube;
+  sep->addChild(*cube);
+  return sep;
+}
+
+static int
+count_nodes(SoNode * root, SoType type)
+{
+  SoSearchAction sa;
+  sa.setType(type);
+  sa.setInterest(SoSearchAction::ALL);
+  sa.apply(root);
+  return sa.getPaths().getLength();
+}
+
+// three static cubes, where two share state except for the diffuse
+// color, and a cube with a translation connected to another field
+static SoSeparator *
+make_parts(SoCube ** cubes, SoTranslation * source)
+{
+  SoSeparator * root = new SoSeparator;
+  root->addChild(make_part(0.0f, SbColor(1.0f, 0.0f, 0.0f), 0.2f, &cubes[0]));
+  root->addChild(make_part(3.0f, SbColor(0.0f, 1.0f, 0.0f), 0.2f, &cubes[1]));
+  root->addChild(make_part(6.0f, SbColor(1.0f, 0.0f, 0.0f), 0.9f, &cubes[2]));
+  SoSeparator * dynamic = make_part(9.0f, SbColor(0.0f, 0.0f, 1.0f), 0.2f, &cubes[3]);
+  static_cast<SoTranslation *>(dynamic->getChild(0))->translation.connectFrom(&source->translation);
+  root->addChild(dynamic);
+  return root;
+}
+
+BOOST_AUTO_TEST_CASE(mergeShapes)
+{
+  SoCube * cubes[4];
+  SoTranslation * source = new SoTranslation;
+  source->ref();
+  source->translation.setValue(9.0f, 0.0f, 0.0f);
+  SoSeparator * root = make_parts(cubes, source);
+  root->ref();
+
+  SoReorganizeAction reorg;
+  BOOST_CHECK_MESSAGE(reorg.getSimplifiedSceneGraph() == NULL,
+                      "no scene graph before the action is applied");
+  reorg.mergeShapes(TRUE);
+  reorg.apply(root);
+  SoSeparator * result = reorg.getSimplifiedSceneGraph();
+  BOOST_REQUIRE(result != NULL);
+
+  BOOST_CHECK_MESSAGE(count_nodes(root, SoCube::getClassTypeId()) == 4,
+                      "original scene graph should not be changed");
+  BOOST_CHECK_MESSAGE(count_nodes(result, SoCube::getClassTypeId()) == 1,
+                      "only the cube with a connected translation should be left");
+  BOOST_CHECK_MESSAGE(count_nodes(result, SoIndexedFaceSet::getClassTypeId()) == 2,
+                      "cubes should be merged into one shape per material");
+
+  SbViewportRegion vp(100, 100);
+  SoGetBoundingBoxAction bba(vp);
+  bba.apply(root);
+  const SbBox3f before = bba.getBoundingBox();
+  bba.apply(result);
+  const SbBox3f after = bba.getBoundingBox();
+  BOOST_CHECK_MESSAGE((before.getMin() - after.getMin()).length() < 1e-4f &&
+                      (before.getMax() - after.getMax()).length() < 1e-4f,
+                      "bounding box should not change");
+
+  root->unref();
+  source->unref();
+}
+
+BOOST_AUTO_TEST_CASE(mergedPicking)
+{
+  SoCube * cubes[4];
+  SoTranslation * source = new SoTranslation;
+  source->ref();
+  source->translation.setValue(9.0f, 0.0f, 0.0f);
+  SoSeparator * root = make_parts(cubes, source);
+  root->ref();
+
+  SoReorganizeAction reorg;
+  reorg.mergeShapes(TRUE);
+  reorg.apply(root);
+  SoSeparator * result = reorg.getSimplifiedSceneGraph();
+  BOOST_REQUIRE(result != NULL);
+
+  for (int i = 0; i < 4; i++) {
+    SoRayPickAction rpa(SbViewportRegion(100, 100));
+    rpa.setRay(SbVec3f(i * 3.0f, 0.2f, 10.0f), SbVec3f(0.0f, 0.0f, -1.0f));
+    rpa.apply(result);
+    const SoPickedPoint * pp = rpa.getPickedPoint();
+    BOOST_REQUIRE(pp != NULL);
+    BOOST_CHECK_MESSAGE(fabs(pp->getPoint()[2] - 1.0f) < 1e-4f,
+                        "should hit the front of the cube");
+    int faceindex = -2;
+    const SoPath * path = reorg.getOriginalPath(pp, &faceindex);
+    if (i < 3) {
+      BOOST_REQUIRE(path != NULL);
+      BOOST_CHECK_MESSAGE(static_cast<const SoFullPath *>(path)->getTail() == cubes[i],
+                          "should map to the original cube");
+      BOOST_CHECK_MESSAGE(path->getHead() == root, "path should start at the root");
+      BOOST_CHECK_MESSAGE(faceindex >= -1, "face index should be set");
+    }
+    else {
+      BOOST_CHECK_MESSAGE(path == NULL, "cube which is not merged has no original path");
+    }
+  }
+
+  root->unref();
+  source->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -69,10 +69,16 @@
 
   See the documentation of SoTexture2 for a full usage example of
   SoSearchAction.
+
+  Applications which search the same scene graph many times can set
+  up an SoSearchIndex for it, and pass it to setIndex(). Searches
+  applied to the root of the index are then answered without a
+  traversal of the scene graph.
 */
 
 #include <Inventor/actions/SoSearchAction.h>
 
+#include <Inventor/misc/SoSearchIndex.h>
 #include <Inventor/nodes/SoNode.h>
 
 #include "actions/SoSubActionP.h"
@@ -135,8 +141,15 @@
 
 class SoSearchActionP {
 public:
+  SoSearchActionP(void) : index(NULL), pathcb(NULL), pathcbdata(NULL) { }
+
+  SoSearchIndex * index;
+  void (*pathcb)(void * closure, SoPath * path);
+  void * pathcbdata;
 };
 
+#define PRIVATE(obj) ((obj)->pimpl)
+
 SO_ACTION_SOURCE(SoSearchAction);
 
 SbBool SoSearchAction::duringSearchAll = FALSE;
@@ -393,6 +406,35 @@ SoSearchAction::reset(void)
   this->paths.truncate(0);
 }
 
+/*!
+  Sets an \a index to answer the searches from. The index is used
+  when the action is applied to the root node of the index, with the
+  same SoSearchAction::isSearchingAll() setting as the index. Other
+  searches traverse the scene graph as usual. Pass \c NULL to stop
+  using an index.
+
+  The index is not owned by the action, and it is kept by reset().
+
+  \sa SoSearchIndex
+  \since Coin 4.1
+*/
+void
+SoSearchAction::setIndex(SoSearchIndex * index)
+{
+  PRIVATE(this)->index = index;
+}
+
+/*!
+  Returns the index set with setIndex(), or \c NULL if none is set.
+
+  \since Coin 4.1
+*/
+SoSearchIndex *
+SoSearchAction::getIndex(void) const
+{
+  return PRIVATE(this)->index;
+}
+
 /*!
   \COININTERNAL
 
@@ -431,6 +473,13 @@ SoSearchAction::addPath(SoPath * const pathptr)
 {
   assert(! this->isFound()); // shouldn't try to add path if found
 
+  if (PRIVATE(this)->pathcb) {
+    pathptr->ref();
+    PRIVATE(this)->pathcb(PRIVATE(this)->pathcbdata, pathptr);
+    pathptr->unref();
+    return;
+  }
+
   switch (this->interest) {
   case FIRST:
     assert(! this->path); // should be NULL
@@ -456,6 +505,18 @@ SoSearchAction::addPath(SoPath * const pathptr)
   }
 }
 
+// Lets SoSearchIndex see the found paths one by one, instead of
+// keeping them in the path list. The paths are destructed right after
+// the callback, so that they can be removed from the path auditors of
+// the child lists without searching long lists.
+void
+SoSearchAction::setPathCallback(void (*callback)(void * closure, SoPath * path),
+                                void * closure)
+{
+  PRIVATE(this)->pathcb = callback;
+  PRIVATE(this)->pathcbdata = closure;
+}
+
 // *************************************************************************
 
 // Documented in superclass. Overridden from superclass to initialize
@@ -471,7 +532,121 @@ SoSearchAction::beginTraversal(SoNode * nodeptr)
   // now obsoleted 'duringSearchAll' flag.
   SoSearchAction::duringSearchAll = this->isSearchingAll();
 
-  this->traverse(nodeptr); // begin traversal at root node
+  if (!PRIVATE(this)->index || !PRIVATE(this)->index->search(this)) {
+    this->traverse(nodeptr); // begin traversal at root node
+  }
 
   SoSearchAction::duringSearchAll = FALSE;
 }
+
+#undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/misc/SoSearchIndex.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoOrthographicCamera.h>
+#include <Inventor/nodes/SoPerspectiveCamera.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoSwitch.h>
+
+static SbBool
+same_result(SoSearchAction & a, SoSearchAction & b)
+{
+  if (a.getInterest() == SoSearchAction::ALL) {
+    if (a.getPaths().getLength() != b.getPaths().getLength()) return FALSE;
+    for (int i = 0; i < a.getPaths().getLength(); i++) {
+      if (!(*a.getPaths()[i] == *b.getPaths()[i])) return FALSE;
+    }
+    return TRUE;
+  }
+  if (!a.getPath() || !b.getPath()) return a.getPath() == b.getPath();
+  return *a.getPath() == *b.getPath();
+}
+
+// searches root with and without the index, and compares the results
+static SbBool
+same_searches(SoNode * root, SoSearchIndex * index, SoNode * node)
+{
+  SoSearchAction traversal, indexed;
+  indexed.setIndex(index);
+  SoSearchAction * actions[] = { &traversal, &indexed };
+  for (int interest = SoSearchAction::FIRST; interest <= SoSearchAction::ALL; interest++) {
+    for (int what = 0; what < 4; what++) {
+      for (int i = 0; i < 2; i++) {
+        actions[i]->reset();
+        actions[i]->setInterest(static_cast<SoSearchAction::Interest>(interest));
+        actions[i]->setSearchingAll(index->isSearchingAll());
+        if (what == 0) actions[i]->setType(SoCamera::getClassTypeId());
+        if (what == 1) actions[i]->setType(SoCube::getClassTypeId(), FALSE);
+        if (what == 2) actions[i]->setName("part");
+        if (what == 3) actions[i]->setNode(node);
+        actions[i]->apply(root);
+      }
+      if (!same_result(traversal, indexed)) return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+BOOST_AUTO_TEST_CASE(indexedSearch)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoCube * shared = new SoCube;
+  SoSwitch * sw = new SoSwitch;
+  sw->whichChild = 1;
+  for (int i = 0; i < 3; i++) {
+    SoSeparator * sep = new SoSeparator;
+    if (i == 1) sep->setName("part");
+    sep->addChild(new SoMaterial);
+    sep->addChild(shared);
+    sep->addChild(i == 2 ? (SoNode *) new SoOrthographicCamera : new SoPerspectiveCamera);
+    sw->addChild(sep);
+  }
+  root->addChild(new SoPerspectiveCamera);
+  root->addChild(sw);
+  root->addChild(shared);
+
+  for (int searchall = 0; searchall < 2; searchall++) {
+    SoSearchIndex index(root, searchall);
+    BOOST_CHECK_MESSAGE(same_searches(root, &index, shared),
+                        "indexed search should give the same paths as traversal");
+
+    // field change in a node without children
+    static_cast<SoMaterial *>(static_cast<SoSeparator *>(sw->getChild(0))->getChild(0))->
+      diffuseColor.setValue(1.0f, 0.0f, 0.0f);
+    BOOST_CHECK_MESSAGE(same_searches(root, &index, shared),
+                        "field changes should not change the result");
+
+    // changes to the traversed children
+    sw->whichChild = 2;
+    BOOST_CHECK_MESSAGE(same_searches(root, &index, shared),
+                        "index should follow SoSwitch::whichChild");
+
+    // changes in an inactive child of the switch
+    SoSeparator * inactive = static_cast<SoSeparator *>(sw->getChild(0));
+    SoCube * cube = new SoCube;
+    inactive->insertChild(cube, 0);
+    BOOST_CHECK_MESSAGE(same_searches(root, &index, cube),
+                        "index should see new children of inactive switch children");
+    inactive->removeChild(cube);
+    BOOST_CHECK_MESSAGE(same_searches(root, &index, cube),
+                        "index should see removed children");
+
+    root->insertChild(new SoPerspectiveCamera, 1);
+    root->removeChild(0);
+    BOOST_CHECK_MESSAGE(same_searches(root, &index, shared),
+                        "index should see changes to the root");
+
+    sw->whichChild = 1;
+    root->removeChild(0);
+    root->insertChild(new SoPerspectiveCamera, 0);
+  }
+
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -1102,17 +1102,27 @@ SoToVRMLActionP::vrmlils_cb(void * closure, SoCallbackAction * COIN_UNUSED_ARG(a
 
     const SbVec3f * c = coord->point.getValues(0);
 
+    // weld all the vertices in one go
+    SbList <SbVec3f> pts(n);
+    int i;
+    for (i = 0; i < n; i++) {
+      if (src[i] >= 0) pts.append(c[src[i]]);
+    }
+    int * welded = new int[pts.getLength()];
+    bsp.addPoints(pts.getArrayPtr(), pts.getLength(), welded);
+
     ils->coordIndex.setNum(n);
     int32_t * dst = ils->coordIndex.startEditing();
 
-    for (int i = 0; i < n; i++) {
-      int idx = src[i];
-      if (idx >= 0) {
-        dst[i] = bsp.addPoint(c[idx]);
+    int numwelded = 0;
+    for (i = 0; i < n; i++) {
+      if (src[i] >= 0) {
+        dst[i] = welded[numwelded++];
       }
       else dst[i] = -1;
     }
     ils->coordIndex.finishEditing();
+    delete[] welded;
     newcoord->point.setValues(0, bsp.numPoints(),
                               bsp.getPointsArrayPtr());
 
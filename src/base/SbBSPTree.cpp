@@ -36,6 +36,9 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cfloat>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include "coindefs.h"
 
@@ -53,6 +56,15 @@
   This class can be used to organize searches for 3D points or normals
   in a set in O(log(n)) time.
 
+  Large point sets, like the vertices of a mesh to be welded, should
+  be added with addPoints(), which builds a balanced tree in O(n
+  log(n)) time.
+
+  The const query functions, like findPoint(), findClosest(),
+  findNearest() and findPoints(), only read the tree, and can be used
+  from several threads at the same time, as long as the tree isn't
+  modified meanwhile.
+
   Note: SbBSPTree is an extension to the original Open Inventor API.
 */
 
@@ -64,9 +76,12 @@ public:
   ~coin_bspnode();
 
   int addPoint(const SbVec3f &pt, const int maxpts);
+  void build(int * const idx, const int num, const int maxpts);
   int findPoint(const SbVec3f &pt) const;
-  void findPoints(const SbSphere &sphere, SbList <int> &array);
-  void findPoints(const SbSphere &sphere, SbIntList & array);
+  void findPoints(const SbSphere &sphere, SbList <int> &array) const;
+  void findPoints(const SbSphere &sphere, SbIntList & array) const;
+  void findNearest(const SbVec3f & pos, const int k,
+                   std::vector<std::pair<float, int> > & heap) const;
   int removePoint(const SbVec3f &pt);
   void updateIndex(const SbVec3f & pt, int previdx, int newidx);
 
@@ -158,7 +173,7 @@ coin_bspnode::findPoint(const SbVec3f &pt) const
 }
 
 void
-coin_bspnode::findPoints(const SbSphere &sphere, SbList <int> &array)
+coin_bspnode::findPoints(const SbSphere &sphere, SbList <int> &array) const
 {
   if (this->left) {
     SbVec3f min, max;
@@ -179,7 +194,7 @@ coin_bspnode::findPoints(const SbSphere &sphere, SbList <int> &array)
 }
 
 void
-coin_bspnode::findPoints(const SbSphere &sphere, SbIntList & array)
+coin_bspnode::findPoints(const SbSphere &sphere, SbIntList & array) const
 {
   if (this->left) {
     SbVec3f min, max;
@@ -199,6 +214,41 @@ coin_bspnode::findPoints(const SbSphere &sphere, SbIntList & array)
   }
 }
 
+// Keeps the k closest points found so far in a max heap of (squared
+// distance, index) pairs, so the point furthest away is on top. Ties
+// are resolved by picking the lowest index.
+void
+coin_bspnode::findNearest(const SbVec3f & pos, const int k,
+                          std::vector<std::pair<float, int> > & heap) const
+{
+  if (this->left) {
+    const double d = double(pos[this->dimension]) - this->position;
+    const coin_bspnode * nearnode = (d < 0.0) ? this->left : this->right;
+    const coin_bspnode * farnode = (d < 0.0) ? this->right : this->left;
+    nearnode->findNearest(pos, k, heap);
+    if (int(heap.size()) < k || d*d <= double(heap.front().first)) {
+      farnode->findNearest(pos, k, heap);
+    }
+  }
+  else {
+    const SbVec3f * points = this->pointsArray->getArrayPtr();
+    int i, n = this->indices.getLength();
+    for (i = 0; i < n; i++) {
+      const int idx = this->indices[i];
+      const std::pair<float, int> candidate((points[idx] - pos).sqrLength(), idx);
+      if (int(heap.size()) < k) {
+        heap.push_back(candidate);
+        std::push_heap(heap.begin(), heap.end());
+      }
+      else if (candidate < heap.front()) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = candidate;
+        std::push_heap(heap.begin(), heap.end());
+      }
+    }
+  }
+}
+
 /*
   Used to update index after a point is removed.
 */
@@ -343,6 +393,66 @@ coin_bspnode::split()
   this->indices.truncate(0, TRUE);
 }
 
+//
+// Builds a balanced subtree for the num points in idx, which must
+// all be unique, by splitting at the median of the largest
+// dimension. Used for bulk construction of the tree.
+//
+void
+coin_bspnode::build(int * const idx, const int num, const int maxpts)
+{
+  assert(this->left == NULL && this->indices.getLength() == 0);
+  if (num <= maxpts) {
+    for (int i = 0; i < num; i++) this->indices.append(idx[i]);
+    return;
+  }
+
+  const SbVec3f * points = this->pointsArray->getArrayPtr();
+  SbBox3f box;
+  int i;
+  for (i = 0; i < num; i++) {
+    box.extendBy(points[idx[i]]);
+  }
+  SbVec3f diag = box.getMax() - box.getMin();
+  int dim;
+  if (diag[0] > diag[1]) {
+    if (diag[0] > diag[2]) dim = DIM_YZ;
+    else dim = DIM_XY;
+  }
+  else {
+    if (diag[1] > diag[2]) dim = DIM_XZ;
+    else dim = DIM_XY;
+  }
+
+  const int mid = num / 2;
+  std::nth_element(idx, idx + mid, idx + num,
+                   [points, dim](int a, int b) { return points[a][dim] < points[b][dim]; });
+  float pos = points[idx[mid]][dim];
+  // everything before mid is <= pos, so only that part needs to be
+  // partitioned to find the points left of pos
+  int * split = std::partition(idx, idx + mid,
+                               [points, dim, pos](int a) { return points[a][dim] < pos; });
+  if (split == idx) {
+    // the median is also the minimum value, split just above it instead
+    float next = FLT_MAX;
+    for (i = mid; i < num; i++) {
+      const float v = points[idx[i]][dim];
+      if (v > pos && v < next) next = v;
+    }
+    assert(next != FLT_MAX && "points are not unique");
+    pos = next;
+    split = std::partition(idx, idx + num,
+                           [points, dim, pos](int a) { return points[a][dim] < pos; });
+  }
+
+  this->dimension = dim;
+  this->position = pos;
+  this->left = new coin_bspnode(this->pointsArray);
+  this->right = new coin_bspnode(this->pointsArray);
+  this->left->build(idx, int(split - idx), maxpts);
+  this->right->build(split, int(idx + num - split), maxpts);
+}
+
 //
 // an implementation of the shellsort algorithm
 //
@@ -468,6 +578,78 @@ SbBSPTree::addPoint(const SbVec3f &pt, void * const data)
   return ret;
 }
 
+/*!
+  Adds \a numpoints points from \a points to the BSP tree. This gives
+  the same result as calling addPoint() for each of them in order,
+  with NULL user data, but it is much faster for many points.
+  Identical points are only stored once, and if \a indices is not
+  NULL, the index of each point in the tree is returned in it.
+
+  The tree is rebuilt balanced in O(n log(n)) time, so this is the
+  preferred way to weld the vertices of large meshes.
+
+  \since Coin 4.1
+*/
+void
+SbBSPTree::addPoints(const SbVec3f * const points, const int numpoints,
+                     int * const indices)
+{
+  // Find identical points by sorting. Points with NaN coordinates
+  // are never equal to anything, just like in addPoint().
+  std::vector<int> order;
+  order.reserve(numpoints);
+  int i;
+  for (i = 0; i < numpoints; i++) {
+    const SbVec3f & p = points[i];
+    if (p[0] == p[0] && p[1] == p[1] && p[2] == p[2]) order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), [points](int a, int b) {
+      const SbVec3f & p = points[a];
+      const SbVec3f & q = points[b];
+      if (p[0] != q[0]) return p[0] < q[0];
+      if (p[1] != q[1]) return p[1] < q[1];
+      if (p[2] != q[2]) return p[2] < q[2];
+      return a < b;
+    });
+
+  // the first occurrence of a point represents all its duplicates
+  std::vector<int> first(numpoints);
+  for (i = 0; i < numpoints; i++) first[i] = i;
+  const int numsorted = int(order.size());
+  for (i = 1; i < numsorted; i++) {
+    if (points[order[i]] == points[order[i-1]]) {
+      first[order[i]] = first[order[i-1]];
+    }
+  }
+
+  std::vector<int> pointidx(numpoints);
+  for (i = 0; i < numpoints; i++) {
+    if (first[i] == i) {
+      this->boundingBox.extendBy(points[i]);
+      int idx = this->topnode->findPoint(points[i]);
+      if (idx < 0) {
+        idx = this->pointsArray.getLength();
+        this->pointsArray.append(points[i]);
+        this->userdataArray.append(NULL);
+      }
+      pointidx[i] = idx;
+    }
+    else {
+      pointidx[i] = pointidx[first[i]];
+    }
+    if (indices) indices[i] = pointidx[i];
+  }
+
+  // rebuild the whole tree balanced
+  std::vector<int> all(this->pointsArray.getLength());
+  for (i = 0; i < int(all.size()); i++) all[i] = i;
+  delete this->topnode;
+  this->topnode = new coin_bspnode(&this->pointsArray);
+  if (!all.empty()) {
+    this->topnode->build(&all[0], int(all.size()), this->maxnodepoints);
+  }
+}
+
 /*!
   Removes the point with coordinates \a pt, and returns the index
   to the removed point. -1 is returned if no point with those
@@ -544,45 +726,30 @@ SbBSPTree::getBBox() const
 int
 SbBSPTree::findClosest(const SbVec3f &pos) const
 {
-  int n = this->pointsArray.getLength();
-  if (n < 32) { // points are very scattered when few are inserted
-    SbVec3f tmp;
-    int smallidx = -1;
-    float smalldist = FLT_MAX;
-    for (int i = 0; i < n; i++) {
-      tmp = this->pointsArray[i];
-      float dist = (tmp-pos).sqrLength();
-      if (dist < smalldist) {
-        smalldist = dist;
-        smallidx = i;
-      }
-    }
-    return smallidx;
-  }
-  SbVec3f center =
-    (this->boundingBox.getMin() +
-     this->boundingBox.getMax()) * 0.5f;
-  center -= pos;
-
-  float siz = center.length() * 2 +
-    (this->boundingBox.getMax()-this->boundingBox.getMin()).length();
-
-  float currsize = siz / 65536.0f;  // max 16 iterations (too much?).
+  std::vector<std::pair<float, int> > heap;
+  this->topnode->findNearest(pos, 1, heap);
+  return heap.empty() ? -1 : heap[0].second;
+}
 
-  SbSphere sphere(pos, currsize);
-  SbList <int> tmparray; // use only one array to avoid reallocs
-  int idx = -1;
+/*!
+  Finds the \a k points closest to \a pos, and appends their
+  indices to \a array, ordered by increasing distance. If there are
+  fewer than \a k points in the tree, all of them are returned.
+  Points at the same distance are ordered by index.
 
-  // double size of sphere until a vertex is found
-  while (currsize < siz) {
-    sphere.setRadius(currsize);
-    tmparray.truncate(0);
-    idx = this->findClosest(sphere, tmparray);
-    if (idx >= 0) return idx;
-    currsize *= 2;
+  \since Coin 4.1
+*/
+void
+SbBSPTree::findNearest(const SbVec3f & pos, const int k, SbIntList & array) const
+{
+  if (k <= 0) return;
+  std::vector<std::pair<float, int> > heap;
+  heap.reserve(SbMin(k, this->pointsArray.getLength()));
+  this->topnode->findNearest(pos, k, heap);
+  std::sort_heap(heap.begin(), heap.end());
+  for (size_t i = 0; i < heap.size(); i++) {
+    array.append(heap[i].second);
   }
-  assert(0);
-  return -1; // this should not happen!
 }
 
 /*!
@@ -678,6 +845,10 @@ SbBSPTree::findPoints(const SbSphere &sphere,
 
 #ifdef COIN_TEST_SUITE
 
+#include <algorithm>
+#include <vector>
+#include <Inventor/SbBSPTree.h>
+
 BOOST_AUTO_TEST_CASE(initialized)
 {
   SbBSPTree bsp;
@@ -719,4 +890,66 @@ BOOST_AUTO_TEST_CASE(initialized)
 
 }
 
+BOOST_AUTO_TEST_CASE(bulkAndNearest)
+{
+  // a grid with every point added several times, like the vertices
+  // of a mesh before welding, in a scrambled order
+  const int numpoints = 6000;
+  SbVec3f * points = new SbVec3f[numpoints];
+  for (int i = 0; i < numpoints; i++) {
+    const int j = (i * 7919) % 1000;
+    points[i].setValue(float(j % 10), float((j / 10) % 10), float(j / 100) * 0.5f);
+  }
+
+  SbBSPTree single, bulk(8);
+  int * indices = new int[numpoints];
+  bulk.addPoints(points, numpoints, indices);
+  SbBool sameindices = TRUE;
+  for (int i = 0; i < numpoints; i++) {
+    if (single.addPoint(points[i]) != indices[i]) sameindices = FALSE;
+  }
+  BOOST_CHECK_MESSAGE(sameindices, "addPoints() differs from addPoint()");
+  BOOST_CHECK_MESSAGE(bulk.numPoints() == 1000 && single.numPoints() == 1000,
+                      "wrong number of unique points");
+  SbBool samepoints = TRUE;
+  for (int i = 0; i < 1000; i++) {
+    if (bulk.getPoint(i) != single.getPoint(i)) samepoints = FALSE;
+    if (bulk.findPoint(bulk.getPoint(i)) != i) samepoints = FALSE;
+  }
+  BOOST_CHECK_MESSAGE(samepoints, "wrong points after addPoints()");
+
+  // adding more points to a bulk built tree
+  const SbVec3f extra[3] = {
+    SbVec3f(0.0f, 0.0f, 0.0f), SbVec3f(20.0f, 0.0f, 0.0f), SbVec3f(20.0f, 0.0f, 0.0f)
+  };
+  int extraindices[3];
+  bulk.addPoints(extra, 3, extraindices);
+  BOOST_CHECK_MESSAGE(extraindices[0] == bulk.findPoint(extra[0]) &&
+                      extraindices[1] == 1000 && extraindices[2] == 1000 &&
+                      bulk.numPoints() == 1001, "wrong indices for added points");
+  BOOST_CHECK_MESSAGE(bulk.addPoint(SbVec3f(-1.0f, 0.0f, 0.0f)) == 1001,
+                      "addPoint() failed after addPoints()");
+
+  const SbVec3f pos(3.2f, 4.7f, 2.1f);
+  SbIntList nearest;
+  bulk.findNearest(pos, 5, nearest);
+  BOOST_CHECK_MESSAGE(nearest.getLength() == 5, "wrong number of nearest points");
+  // brute force check of the distances
+  SbList<float> dists;
+  for (int i = 0; i < bulk.numPoints(); i++) {
+    dists.append((bulk.getPoint(i) - pos).sqrLength());
+  }
+  std::vector<float> sorted(dists.getArrayPtr(), dists.getArrayPtr() + dists.getLength());
+  std::sort(sorted.begin(), sorted.end());
+  SbBool samedists = TRUE;
+  for (int i = 0; i < nearest.getLength(); i++) {
+    if (dists[nearest[i]] != sorted[i]) samedists = FALSE;
+  }
+  BOOST_CHECK_MESSAGE(samedists, "findNearest() didn't find the nearest points");
+  BOOST_CHECK_MESSAGE(bulk.findClosest(pos) == nearest[0], "findClosest() differs from findNearest()");
+
+  delete[] points;
+  delete[] indices;
+}
+
 #endif // COIN_TEST_SUITE
@@ -376,3 +376,79 @@ SbName::empty(void) // static
   }
   return *emptyname;
 }
+
+#ifdef COIN_TEST_SUITE
+
+#include <cstring>
+#include <Inventor/threads/SbThread.h>
+#include <Inventor/SbString.h>
+
+namespace {
+
+  const int SBNAME_TEST_NUMTHREADS = 4;
+  const int SBNAME_TEST_NUMNAMES = 20000;
+
+  void *
+  SbName_test_thread(void * closure)
+  {
+    const char ** result = static_cast<const char **>(closure);
+    for (int i = 0; i < SBNAME_TEST_NUMNAMES; i++) {
+      SbString s;
+      s.sprintf("testname_%d", i);
+      result[i] = SbName(s).getString();
+    }
+    return NULL;
+  }
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(uniqueAddress)
+{
+  SbName a("uniqueAddressTest");
+  SbName b(SbString("uniqueAddressTest"));
+  BOOST_CHECK_MESSAGE(a.getString() == b.getString(),
+                      "equal strings should map to the same address");
+  BOOST_CHECK_MESSAGE(a.getString() != SbName("uniqueAddressTest2").getString(),
+                      "different strings should map to different addresses");
+  BOOST_CHECK_MESSAGE(SbName::empty().getString() == SbName("").getString(),
+                      "empty name should be unique");
+
+  // long names used to be limited by the string pool chunk size
+  SbString longstr;
+  for (int i = 0; i < 100000; i++) { longstr += static_cast<char>('a' + (i % 26)); }
+  SbName longname(longstr);
+  BOOST_CHECK_MESSAGE(longname.getLength() == 100000, "long name was truncated");
+  BOOST_CHECK_MESSAGE(longname.getString() == SbName(longstr).getString(),
+                      "long name should map to the same address");
+}
+
+BOOST_AUTO_TEST_CASE(concurrentCreation)
+{
+  const char ** results[SBNAME_TEST_NUMTHREADS];
+  SbThread * threads[SBNAME_TEST_NUMTHREADS];
+  for (int t = 0; t < SBNAME_TEST_NUMTHREADS; t++) {
+    results[t] = new const char *[SBNAME_TEST_NUMNAMES];
+    threads[t] = SbThread::create(SbName_test_thread, results[t]);
+  }
+  for (int t = 0; t < SBNAME_TEST_NUMTHREADS; t++) {
+    threads[t]->join();
+    SbThread::destroy(threads[t]);
+  }
+
+  int mismatches = 0;
+  for (int i = 0; i < SBNAME_TEST_NUMNAMES; i++) {
+    SbString s;
+    s.sprintf("testname_%d", i);
+    const char * expected = SbName(s).getString();
+    if (strcmp(expected, s.getString()) != 0) { mismatches++; }
+    for (int t = 0; t < SBNAME_TEST_NUMTHREADS; t++) {
+      if (results[t][i] != expected) { mismatches++; }
+    }
+  }
+  for (int t = 0; t < SBNAME_TEST_NUMTHREADS; t++) { delete[] results[t]; }
+
+  BOOST_CHECK_MESSAGE(mismatches == 0,
+                      "names created concurrently should map to one address");
+}
+
+#endif // COIN_TEST_SUITE
@@ -44,12 +44,22 @@
 #include <cassert>
 #include <cfloat>
 #include <cstddef>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include <Inventor/SbOctTree.h>
 #include <Inventor/SbSphere.h>
 #include <Inventor/SbPlane.h>
 #include <Inventor/errors/SoDebugError.h>
 
+inline unsigned int SbHashFunc(const void * key);
+#include "misc/SbHash.h"
+inline unsigned int SbHashFunc(const void * key)
+{
+  return SbHashFunc(reinterpret_cast<size_t>(key));
+}
+
 // *************************************************************************
 
 /*!
@@ -146,6 +156,39 @@ box_inside_planes(const SbBox3f & box, const SbPlane * const planes,
   return TRUE;
 }
 
+// Same as SbBox3f::intersect(const SbBox3f &), but inlined for the
+// item tests of the flattened octree.
+static inline SbBool
+boxes_overlap(const SbBox3f & box1, const SbBox3f & box2)
+{
+  const SbVec3f & min1 = box1.getMin();
+  const SbVec3f & max1 = box1.getMax();
+  const SbVec3f & min2 = box2.getMin();
+  const SbVec3f & max2 = box2.getMax();
+  return (max1[0] >= min2[0] && max2[0] >= min1[0] &&
+          max1[1] >= min2[1] && max2[1] >= min1[1] &&
+          max1[2] >= min2[2] && max2[2] >= min1[2]);
+}
+
+// Exact version of box_inside_planes(), used for the flattened
+// octree. For each plane, the box corner furthest along the plane
+// normal is tested.
+static SbBool
+box_inside_planes_exact(const SbBox3f & box, const SbPlane * const planes,
+                        const int numplanes)
+{
+  const SbVec3f & bmin = box.getMin();
+  const SbVec3f & bmax = box.getMax();
+  for (int i = 0; i < numplanes; i++) {
+    const SbVec3f & n = planes[i].getNormal();
+    const SbVec3f corner(n[0] >= 0.0f ? bmax[0] : bmin[0],
+                         n[1] >= 0.0f ? bmax[1] : bmin[1],
+                         n[2] >= 0.0f ? bmax[2] : bmin[2]);
+    if (planes[i].getDistance(corner) < 0.0f) return FALSE;
+  }
+  return TRUE;
+}
+
 // *************************************************************************
 
 class SbOctTreeNode
@@ -161,27 +204,25 @@ public:
                   const SbOctTreeFuncs & itemfuncs);
   void findItems(const SbVec3f &pos,
                  SbList <void*> &destarray,
-                 const SbOctTreeFuncs &itemfuncs,
-                 const SbBool removeduplicates) const;
+                 const SbOctTreeFuncs &itemfuncs) const;
   void findItems(const SbBox3f &box,
                  SbList <void*> &destarray,
-                 const SbOctTreeFuncs &itemfuncs,
-                 const SbBool removeduplicates) const;
+                 const SbOctTreeFuncs &itemfuncs) const;
   void findItems(const SbSphere &sphere,
                  SbList <void*> &destarray,
-                 const SbOctTreeFuncs &itemfuncs,
-                 const SbBool removeduplicates) const;
+                 const SbOctTreeFuncs &itemfuncs) const;
   void findItems(const SbPlane * const planes,
                  const int numPlanes,
                  SbList <void*> &destarray,
-                 const SbOctTreeFuncs &itemfuncs,
-                 const SbBool removeduplicates) const;
+                 const SbOctTreeFuncs &itemfuncs) const;
 
   const SbBox3f & getBBox(void) const { return this->nodesize; }
 
   void debugTree(FILE *fp, const int indent) const;
 
 private:
+  friend class SbOctTreeFlatBuilder;
+
   SbBool isLeaf(void) const { return this->children[0] == NULL; }
   SbBool isGroup(void) const { return ! this->isLeaf(); }
 
@@ -234,12 +275,52 @@ SbOctTreeNode::debugTree(FILE *fp, const int indent) const
   }
 }
 
+static bool
+item_position_less(const std::pair<void *, int> & a,
+                   const std::pair<void *, int> & b)
+{
+  if (a.first != b.first) { return std::less<void *>()(a.first, b.first); }
+  return a.second < b.second;
+}
+
+// Removes the items from index \a first and onwards in \a array which
+// are duplicates of items earlier in the array, back to index \a
+// seedfrom. The order of the remaining items is kept.
 static void
-add_to_array(SbList<void *> & array, void * ptr)
+remove_duplicates(SbList<void *> & array, const int seedfrom, const int first)
 {
-  // FIXME: this is rather awful, resulting in n^2 algorithm time.
-  // Should change to using the array as a sorted set. 20050512 mortene.
-  if (array.find(ptr) == -1) { array.append(ptr); }
+  const int n = array.getLength();
+  if (n - seedfrom < 2 || first >= n) return;
+
+  int dst = first;
+  if (n - seedfrom <= 16) {
+    // for the common case of small results, a linear search is faster
+    for (int i = first; i < n; i++) {
+      void * item = array[i];
+      int j = seedfrom;
+      while (j < dst && array[j] != item) { j++; }
+      if (j == dst) { array[dst++] = item; }
+    }
+  }
+  else {
+    std::vector<std::pair<void *, int> > sorted;
+    sorted.reserve(n - seedfrom);
+    for (int i = seedfrom; i < n; i++) {
+      sorted.push_back(std::pair<void *, int>(array[i], i));
+    }
+    std::sort(sorted.begin(), sorted.end(), item_position_less);
+
+    std::vector<char> duplicate(n - first, 0);
+    for (size_t i = 1; i < sorted.size(); i++) {
+      if (sorted[i].first == sorted[i-1].first && sorted[i].second >= first) {
+        duplicate[sorted[i].second - first] = 1;
+      }
+    }
+    for (int i = first; i < n; i++) {
+      if (!duplicate[i - first]) { array[dst++] = array[i]; }
+    }
+  }
+  array.truncate(dst);
 }
 
 SbOctTreeNode::SbOctTreeNode(const SbBox3f & b)
@@ -308,14 +389,12 @@ SbOctTreeNode::removeItem(void * const item, const SbOctTreeFuncs & itemfuncs)
 void
 SbOctTreeNode::findItems(const SbVec3f & pos,
                          SbList <void*> & destarray,
-                         const SbOctTreeFuncs & itemfuncs,
-                         const SbBool removeduplicates) const
+                         const SbOctTreeFuncs & itemfuncs) const
 {
   if (this->isGroup()) {
     for (int i = 0; i < 8; i++) {
       if (point_inside_box(pos, this->children[i]->nodesize)) {
-        this->children[i]->findItems(pos, destarray,
-                                     itemfuncs, removeduplicates);
+        this->children[i]->findItems(pos, destarray, itemfuncs);
       }
     }
   }
@@ -324,10 +403,7 @@ SbOctTreeNode::findItems(const SbVec3f & pos,
     for (int i = 0; i < n; i++) {
       void *item = this->items[i];
       if (itemfuncs.ptinsidefunc(item, pos)) {
-        if (removeduplicates)
-          add_to_array(destarray, item);
-        else
-          destarray.append(item);
+        destarray.append(item);
       }
     }
   }
@@ -336,14 +412,12 @@ SbOctTreeNode::findItems(const SbVec3f & pos,
 void
 SbOctTreeNode::findItems(const SbBox3f & box,
                          SbList <void*> & destarray,
-                         const SbOctTreeFuncs & itemfuncs,
-                         const SbBool removeduplicates) const
+                         const SbOctTreeFuncs & itemfuncs) const
 {
   if (this->isGroup()) {
     for (int i = 0; i < 8; i++) {
       if (intersect_box_box(box, this->children[i]->nodesize))
-        this->children[i]->findItems(box, destarray,
-                                     itemfuncs, removeduplicates);
+        this->children[i]->findItems(box, destarray, itemfuncs);
     }
   }
   else {
@@ -351,10 +425,7 @@ SbOctTreeNode::findItems(const SbBox3f & box,
     for (int i = 0; i < n; i++) {
       void *item = this->items[i];
       if (itemfuncs.insideboxfunc(item, box)) {
-        if (removeduplicates)
-          add_to_array(destarray, item);
-        else
-          destarray.append(item);
+        destarray.append(item);
       }
     }
   }
@@ -363,14 +434,12 @@ SbOctTreeNode::findItems(const SbBox3f & box,
 void
 SbOctTreeNode::findItems(const SbSphere & sphere,
                          SbList <void*> & destarray,
-                         const SbOctTreeFuncs & itemfuncs,
-                         const SbBool removeduplicates) const
+                         const SbOctTreeFuncs & itemfuncs) const
 {
   if (this->isGroup()) {
     for (int i = 0; i < 8; i++) {
       if (intersect_box_sphere(this->children[i]->nodesize, sphere))
-        this->children[i]->findItems(sphere, destarray,
-                                     itemfuncs, removeduplicates);
+        this->children[i]->findItems(sphere, destarray, itemfuncs);
     }
   }
   else {
@@ -378,10 +447,7 @@ SbOctTreeNode::findItems(const SbSphere & sphere,
     for (int i = 0; i < n; i++) {
       void * item = this->items[i];
       if (itemfuncs.insidespherefunc(item, sphere)) {
-        if (removeduplicates)
-          add_to_array(destarray, item);
-        else
-          destarray.append(item);
+        destarray.append(item);
       }
     }
   }
@@ -391,14 +457,12 @@ void
 SbOctTreeNode::findItems(const SbPlane * const planes,
                          const int numplanes,
                          SbList <void*> & destarray,
-                         const SbOctTreeFuncs & itemfuncs,
-                         const SbBool removeduplicates) const
+                         const SbOctTreeFuncs & itemfuncs) const
 {
   if (this->isGroup()) {
     for (int i = 0; i < 8; i++) {
       if (box_inside_planes(this->children[i]->nodesize, planes, numplanes)) {
-        this->children[i]->findItems(planes, numplanes,
-                                     destarray, itemfuncs, removeduplicates);
+        this->children[i]->findItems(planes, numplanes, destarray, itemfuncs);
       }
     }
   }
@@ -407,10 +471,7 @@ SbOctTreeNode::findItems(const SbPlane * const planes,
     for (int i = 0; i < n; i++) {
       void *item = this->items[i];
       if (itemfuncs.insideplanesfunc(item, planes, numplanes)) {
-        if (removeduplicates)
-          add_to_array(destarray, item);
-        else
-          destarray.append(item);
+        destarray.append(item);
       }
     }
   }
@@ -475,13 +536,322 @@ SbOctTreeNode::splitNode(const SbOctTreeFuncs & itemfuncs)
 
 // *************************************************************************
 
+// The flattened octree made by SbOctTree::optimize(). All nodes are
+// stored in one array, with the eight children of a group node next
+// to each other, and each leaf node refers to a range of the item
+// index array. Every item is stored only once in the item array, so
+// query results are made unique by sorting the item indices. The
+// item pointers, and optionally the item bounding boxes, are also
+// stored in leaf order, so the items of a leaf are tested without
+// jumping around in memory.
+
+class SbOctTreeFlatNode {
+public:
+  SbBox3f box;
+  int firstchild; // -1 for leaf nodes
+  int firstitem;
+  int numitems;
+};
+
+class SbOctTreeFlat {
+public:
+  std::vector<SbOctTreeFlatNode> nodes;
+  std::vector<int> itemrefs;
+  std::vector<void *> items;
+  // in the same order as itemrefs
+  std::vector<void *> refitems;
+  // only set if an item bounding box function was given to optimize()
+  std::vector<SbBox3f> refboxes;
+};
+
+// The top-level node of an SbOctTree, which also holds the flattened
+// tree. Kept here, and not in SbOctTree itself, to not change the
+// size of the public class.
+class SbOctTreeRoot : public SbOctTreeNode {
+public:
+  SbOctTreeRoot(const SbBox3f & b) : SbOctTreeNode(b), flat(NULL) { }
+  ~SbOctTreeRoot() { delete this->flat; }
+
+  SbOctTreeFlat * flat;
+};
+
+#define ROOT(tree) (static_cast<SbOctTreeRoot *>((tree)->topnode))
+
+// Builds the flattened octree from the pointer based nodes.
+
+class SbOctTreeFlatBuilder {
+public:
+  SbOctTreeFlatBuilder(SbOctTreeFlat & f,
+                       void (*boxfunc)(void * const item, SbBox3f & box))
+    : flat(f), itemboxfunc(boxfunc) { }
+
+  void addNode(const SbOctTreeNode * node, const int nodeidx);
+
+private:
+  SbOctTreeFlat & flat;
+  void (*itemboxfunc)(void * const item, SbBox3f & box);
+  SbHash<void *, int> itemindices;
+};
+
+// Copies node and its children into the flat node array, starting
+// at nodeidx, which must already be allocated.
+void
+SbOctTreeFlatBuilder::addNode(const SbOctTreeNode * node, const int nodeidx)
+{
+  SbOctTreeFlatNode & flatnode = this->flat.nodes[nodeidx];
+  flatnode.box = node->nodesize;
+  flatnode.firstchild = -1;
+  flatnode.firstitem = static_cast<int>(this->flat.itemrefs.size());
+  flatnode.numitems = 0;
+
+  if (node->isGroup()) {
+    const int firstchild = static_cast<int>(this->flat.nodes.size());
+    flatnode.firstchild = firstchild;
+    this->flat.nodes.resize(firstchild + 8); // invalidates flatnode
+    for (int i = 0; i < 8; i++) {
+      this->addNode(node->children[i], firstchild + i);
+    }
+    return;
+  }
+
+  const int n = node->items.getLength();
+  for (int i = 0; i < n; i++) {
+    void * item = node->items[i];
+    int idx;
+    if (!this->itemindices.get(item, idx)) {
+      idx = static_cast<int>(this->flat.items.size());
+      this->itemindices.put(item, idx);
+      this->flat.items.push_back(item);
+    }
+    this->flat.itemrefs.push_back(idx);
+    this->flat.refitems.push_back(item);
+    if (this->itemboxfunc) {
+      SbBox3f itembox;
+      this->itemboxfunc(item, itembox);
+      this->flat.refboxes.push_back(itembox);
+    }
+  }
+  flatnode.numitems = n;
+}
+
+// The query classes used with flat_find_items() below. node() tests
+// an octree node box, and item() tests the item at position ref in
+// the item index array, either against its stored bounding box or by
+// using the item callback function.
+
+class SbOctTreePointQuery {
+public:
+  SbOctTreePointQuery(const SbVec3f & p, const SbOctTreeFlat & f,
+                      const SbOctTreeFuncs & funcs)
+    : pos(p), flat(f), itemfuncs(funcs) { }
+  SbBool node(const SbBox3f & box) const { return point_inside_box(this->pos, box); }
+  SbBool item(const int ref) const {
+    if (this->flat.refboxes.empty()) {
+      return this->itemfuncs.ptinsidefunc(this->flat.refitems[ref], this->pos);
+    }
+    return this->flat.refboxes[ref].intersect(this->pos);
+  }
+private:
+  const SbVec3f & pos;
+  const SbOctTreeFlat & flat;
+  const SbOctTreeFuncs & itemfuncs;
+};
+
+class SbOctTreeBoxQuery {
+public:
+  SbOctTreeBoxQuery(const SbBox3f & b, const SbOctTreeFlat & f,
+                    const SbOctTreeFuncs & funcs)
+    : querybox(b), flat(f), itemfuncs(funcs) { }
+  SbBool node(const SbBox3f & box) const { return intersect_box_box(this->querybox, box); }
+  SbBool item(const int ref) const {
+    if (this->flat.refboxes.empty()) {
+      return this->itemfuncs.insideboxfunc(this->flat.refitems[ref], this->querybox);
+    }
+    return boxes_overlap(this->querybox, this->flat.refboxes[ref]);
+  }
+private:
+  const SbBox3f & querybox;
+  const SbOctTreeFlat & flat;
+  const SbOctTreeFuncs & itemfuncs;
+};
+
+class SbOctTreeSphereQuery {
+public:
+  SbOctTreeSphereQuery(const SbSphere & s, const SbOctTreeFlat & f,
+                       const SbOctTreeFuncs & funcs)
+    : sphere(s), flat(f), itemfuncs(funcs) { }
+  SbBool node(const SbBox3f & box) const { return intersect_box_sphere(box, this->sphere); }
+  SbBool item(const int ref) const {
+    if (this->flat.refboxes.empty()) {
+      return this->itemfuncs.insidespherefunc(this->flat.refitems[ref], this->sphere);
+    }
+    return intersect_box_sphere(this->flat.refboxes[ref], this->sphere);
+  }
+private:
+  const SbSphere & sphere;
+  const SbOctTreeFlat & flat;
+  const SbOctTreeFuncs & itemfuncs;
+};
+
+class SbOctTreePlanesQuery {
+public:
+  SbOctTreePlanesQuery(const SbPlane * const p, const int n,
+                       const SbOctTreeFlat & f, const SbOctTreeFuncs & funcs)
+    : planes(p), numplanes(n), flat(f), itemfuncs(funcs) { }
+  SbBool node(const SbBox3f & box) const {
+    return box_inside_planes_exact(box, this->planes, this->numplanes);
+  }
+  SbBool item(const int ref) const {
+    if (this->flat.refboxes.empty()) {
+      return this->itemfuncs.insideplanesfunc(this->flat.refitems[ref],
+                                              this->planes, this->numplanes);
+    }
+    return box_inside_planes_exact(this->flat.refboxes[ref],
+                                   this->planes, this->numplanes);
+  }
+private:
+  const SbPlane * const planes;
+  const int numplanes;
+  const SbOctTreeFlat & flat;
+  const SbOctTreeFuncs & itemfuncs;
+};
+
+// Scratch memory for flattened tree queries, reused between the
+// queries of a batch.
+class SbOctTreeQueryScratch {
+public:
+  std::vector<int> stack;
+  std::vector<int> found;
+};
+
+// Finds the items of the flattened octree matching query, and
+// appends them to destarray without duplicates, in item index order.
+template <class Query>
+static void
+flat_find_items(const SbOctTreeFlat & flat, const Query & query,
+                SbOctTreeQueryScratch & scratch, SbList<void *> & destarray)
+{
+  std::vector<int> & stack = scratch.stack;
+  std::vector<int> & found = scratch.found;
+  stack.clear();
+  found.clear();
+
+  // like for the pointer based nodes, the top-level box isn't tested
+  stack.push_back(0);
+  while (!stack.empty()) {
+    const SbOctTreeFlatNode & node = flat.nodes[stack.back()];
+    stack.pop_back();
+    if (node.firstchild >= 0) {
+      // push in reverse, so the children are visited in order
+      for (int i = 7; i >= 0; i--) {
+        if (query.node(flat.nodes[node.firstchild + i].box)) {
+          stack.push_back(node.firstchild + i);
+        }
+      }
+    }
+    else {
+      const int end = node.firstitem + node.numitems;
+      for (int ref = node.firstitem; ref < end; ref++) {
+        if (query.item(ref)) { found.push_back(flat.itemrefs[ref]); }
+      }
+    }
+  }
+
+  std::sort(found.begin(), found.end());
+  std::vector<int>::iterator end = std::unique(found.begin(), found.end());
+  for (std::vector<int>::iterator it = found.begin(); it != end; ++it) {
+    destarray.append(flat.items[*it]);
+  }
+}
+
+static SbVec3f
+query_center(const SbBox3f & box)
+{
+  return box.getCenter();
+}
+
+static SbVec3f
+query_center(const SbSphere & sphere)
+{
+  return sphere.getCenter();
+}
+
+// Interleaves the lower 10 bits of v with zeros, for a Morton code.
+static inline uint32_t
+morton_spread(uint32_t v)
+{
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+// Runs a batch of queries on the flattened octree. Large batches are
+// run in the Morton order of the query centers, so queries close to
+// each other run one after the other and find the nodes and items
+// they need in the CPU caches. The results are returned in the order
+// of the queries anyway.
+template <class Query, class QueryArg>
+static void
+flat_find_items_batch(const SbOctTreeFlat & flat, const SbOctTreeFuncs & itemfuncs,
+                      const QueryArg * const args, const int numargs,
+                      SbList<void *> & destarray, SbList<int> & offsets)
+{
+  SbOctTreeQueryScratch scratch;
+  if (numargs < 64) {
+    for (int i = 0; i < numargs; i++) {
+      offsets.append(destarray.getLength());
+      flat_find_items(flat, Query(args[i], flat, itemfuncs), scratch, destarray);
+    }
+    offsets.append(destarray.getLength());
+    return;
+  }
+
+  const SbBox3f & bbox = flat.nodes[0].box;
+  const SbVec3f & bmin = bbox.getMin();
+  SbVec3f scale;
+  for (int j = 0; j < 3; j++) {
+    const float size = bbox.getMax()[j] - bmin[j];
+    scale[j] = (size > 0.0f) ? 1023.0f / size : 0.0f;
+  }
+  std::vector<std::pair<uint32_t, int> > order(numargs);
+  for (int i = 0; i < numargs; i++) {
+    const SbVec3f c = query_center(args[i]);
+    uint32_t code = 0;
+    for (int j = 0; j < 3; j++) {
+      const float v = SbClamp((c[j] - bmin[j]) * scale[j], 0.0f, 1023.0f);
+      code |= morton_spread(static_cast<uint32_t>(v)) << (2 - j);
+    }
+    order[i] = std::pair<uint32_t, int>(code, i);
+  }
+  std::sort(order.begin(), order.end());
+
+  SbList<void *> found;
+  std::vector<int> start(numargs + 1);
+  std::vector<int> count(numargs);
+  for (int k = 0; k < numargs; k++) {
+    const int i = order[k].second;
+    start[i] = found.getLength();
+    flat_find_items(flat, Query(args[i], flat, itemfuncs), scratch, found);
+    count[i] = found.getLength() - start[i];
+  }
+  for (int i = 0; i < numargs; i++) {
+    offsets.append(destarray.getLength());
+    for (int j = 0; j < count[i]; j++) { destarray.append(found[start[i] + j]); }
+  }
+  offsets.append(destarray.getLength());
+}
+
+// *************************************************************************
+
 /*!
   Constructor.
 */
 SbOctTree::SbOctTree(const SbBox3f & bbox,
                      const SbOctTreeFuncs & itemfuncs,
                      const int maxitems)
-  : topnode(new SbOctTreeNode(bbox)),
+  : topnode(new SbOctTreeRoot(bbox)),
     itemfuncs(itemfuncs),
     maxitemspernode(maxitems)
 {
@@ -492,7 +862,7 @@ SbOctTree::SbOctTree(const SbBox3f & bbox,
 */
 SbOctTree::~SbOctTree()
 {
-  delete this->topnode;
+  delete ROOT(this);
 }
 
 /*!
@@ -503,12 +873,15 @@ void
 SbOctTree::clear(void)
 {
   SbBox3f bbox = this->topnode->getBBox();
-  delete this->topnode;
-  this->topnode = new SbOctTreeNode(bbox);
+  delete ROOT(this);
+  this->topnode = new SbOctTreeRoot(bbox);
 }
 
 /*!
   Adds an item to this octree.
+
+  If the octree has been optimized, the optimization is dropped, and
+  optimize() must be called again when done adding items.
 */
 void
 SbOctTree::addItem(void * const item)
@@ -543,16 +916,20 @@ SbOctTree::addItem(void * const item)
   assert(this->itemfuncs.insideboxfunc(item, this->topnode->getBBox()) &&
          "bbox of item outside the octtree top-level bbox");
 
+  this->dropOptimization();
   this->topnode->addItem(item, this->itemfuncs, this->maxitemspernode);
 }
 
 /*!
   Removes the item from the octree. The octree will not be
   modified/simplified even when all items are removed.
+
+  If the octree has been optimized, the optimization is dropped.
 */
 void
 SbOctTree::removeItem(void * const item)
 {
+  this->dropOptimization();
   this->topnode->removeItem(item, this->itemfuncs);
 }
 
@@ -561,9 +938,9 @@ SbOctTree::removeItem(void * const item)
   returned in \a destarray.
 
   If \a removeduplicates is TRUE (the default), \a destarray will not
-  contain duplicate items. This is not an optimized process, so if
-  you're looking for speed you should set this to FALSE and do
-  your own post processing of the array of returned items.
+  contain duplicate items. If the octree has been optimized (see
+  optimize()), the items found are never duplicated, and they are
+  appended to \a destarray in the same order for every query.
 
   \DANGEROUS_ALLOC_RETURN
 */
@@ -577,26 +954,30 @@ SbOctTree::findItems(const SbVec3f & pos,
   // C-library's heaps. The other findItems() functions below have the
   // same problem. 20050512 mortene.
 
-  // FIXME: should be straightforward to drop the removeduplicates
-  // argument -- it's a hack. We just need to optimize the
-  // add_to_array() function above to keep a _sorted_ array.
-  //
-  // This also goes for the other findItems() functions below, of
-  // course.
-  //
-  // 20050512 mortene.
-
-  assert(this->itemfuncs.ptinsidefunc);
-  topnode->findItems(pos, destarray, this->itemfuncs, removeduplicates);
+  const int start = destarray.getLength();
+  const SbOctTreeFlat * flat = ROOT(this)->flat;
+  if (flat) {
+    assert(this->itemfuncs.ptinsidefunc || !flat->refboxes.empty());
+    SbOctTreeQueryScratch scratch;
+    flat_find_items(*flat, SbOctTreePointQuery(pos, *flat, this->itemfuncs),
+                    scratch, destarray);
+  }
+  else {
+    assert(this->itemfuncs.ptinsidefunc);
+    this->topnode->findItems(pos, destarray, this->itemfuncs);
+  }
+  if (removeduplicates && (start > 0 || !flat)) {
+    remove_duplicates(destarray, 0, start);
+  }
 }
 
 /*!
   Finds all items inside \a box. Items are returned in \a destarray.
 
   If \a removeduplicates is TRUE (the default), \a destarray will not
-  contain duplicate items. This is not an optimized process, so if
-  you're looking for speed you should set this to FALSE and do
-  your own post processing of the array of returned items.
+  contain duplicate items. If the octree has been optimized (see
+  optimize()), the items found are never duplicated, and they are
+  appended to \a destarray in the same order for every query.
 
   \DANGEROUS_ALLOC_RETURN
 */
@@ -604,17 +985,29 @@ void
 SbOctTree::findItems(const SbBox3f & box, SbList <void*> & destarray,
                      const SbBool removeduplicates) const
 {
-  assert(this->itemfuncs.insideboxfunc);
-  this->topnode->findItems(box, destarray, this->itemfuncs, removeduplicates);
+  const int start = destarray.getLength();
+  const SbOctTreeFlat * flat = ROOT(this)->flat;
+  if (flat) {
+    SbOctTreeQueryScratch scratch;
+    flat_find_items(*flat, SbOctTreeBoxQuery(box, *flat, this->itemfuncs),
+                    scratch, destarray);
+  }
+  else {
+    assert(this->itemfuncs.insideboxfunc);
+    this->topnode->findItems(box, destarray, this->itemfuncs);
+  }
+  if (removeduplicates && (start > 0 || !flat)) {
+    remove_duplicates(destarray, 0, start);
+  }
 }
 
 /*!
   Finds all items inside \a sphere. Items are returned in \a destarray.
 
   If \a removeduplicates is TRUE (the default), \a destarray will not
-  contain duplicate items. This is not an optimized process, so if
-  you're looking for speed you should set this to FALSE and do
-  your own post processing of the array of returned items.
+  contain duplicate items. If the octree has been optimized (see
+  optimize()), the items found are never duplicated, and they are
+  appended to \a destarray in the same order for every query.
 
   \DANGEROUS_ALLOC_RETURN
 */
@@ -623,8 +1016,21 @@ SbOctTree::findItems(const SbSphere & sphere,
                      SbList <void*> & destarray,
                      const SbBool removeduplicates) const
 {
-  assert(this->itemfuncs.insidespherefunc);
-  this->topnode->findItems(sphere, destarray, this->itemfuncs, removeduplicates);
+  const int start = destarray.getLength();
+  const SbOctTreeFlat * flat = ROOT(this)->flat;
+  if (flat) {
+    assert(this->itemfuncs.insidespherefunc || !flat->refboxes.empty());
+    SbOctTreeQueryScratch scratch;
+    flat_find_items(*flat, SbOctTreeSphereQuery(sphere, *flat, this->itemfuncs),
+                    scratch, destarray);
+  }
+  else {
+    assert(this->itemfuncs.insidespherefunc);
+    this->topnode->findItems(sphere, destarray, this->itemfuncs);
+  }
+  if (removeduplicates && (start > 0 || !flat)) {
+    remove_duplicates(destarray, 0, start);
+  }
 }
 
 /*!
@@ -634,9 +1040,9 @@ SbOctTree::findItems(const SbSphere & sphere,
   destarray.
 
   If \a removeduplicates is TRUE (the default), \a destarray will not
-  contain duplicate items. This is not an optimized process, so if
-  you're looking for speed you should set this to FALSE and do
-  your own post processing of the array of returned items.
+  contain duplicate items. If the octree has been optimized (see
+  optimize()), the items found are never duplicated, and they are
+  appended to \a destarray in the same order for every query.
 
   \DANGEROUS_ALLOC_RETURN
 */
@@ -646,9 +1052,182 @@ SbOctTree::findItems(const SbPlane * const planes,
                      SbList <void*> & destarray,
                      const SbBool removeduplicates) const
 {
-  assert(this->itemfuncs.insideplanesfunc);
-  this->topnode->findItems(planes, numplanes, destarray, this->itemfuncs,
-                           removeduplicates);
+  const int start = destarray.getLength();
+  const SbOctTreeFlat * flat = ROOT(this)->flat;
+  if (flat) {
+    assert(this->itemfuncs.insideplanesfunc || !flat->refboxes.empty());
+    SbOctTreeQueryScratch scratch;
+    flat_find_items(*flat, SbOctTreePlanesQuery(planes, numplanes, *flat, this->itemfuncs),
+                    scratch, destarray);
+  }
+  else {
+    assert(this->itemfuncs.insideplanesfunc);
+    this->topnode->findItems(planes, numplanes, destarray, this->itemfuncs);
+  }
+  if (removeduplicates && (start > 0 || !flat)) {
+    remove_duplicates(destarray, 0, start);
+  }
+}
+
+/*!
+  Finds the items inside each of the \a numboxes boxes in \a boxes.
+
+  \a destarray and \a offsets are cleared first. The items found for
+  box number \e i are then returned in \a destarray from index \a
+  offsets[\e i] up to, but not including, index \a offsets[\e i + 1],
+  so \a offsets will hold \a numboxes + 1 entries. The items found
+  for each box are not duplicated.
+
+  This is much faster than calling findItems() once for each box,
+  especially if the octree has been optimized. It can be used with
+  a const SbOctTree from several threads at the same time.
+
+  \DANGEROUS_ALLOC_RETURN
+
+  \since Coin 4.1
+*/
+void
+SbOctTree::findItems(const SbBox3f * const boxes,
+                     const int numboxes,
+                     SbList <void*> & destarray,
+                     SbList <int> & offsets) const
+{
+  destarray.truncate(0);
+  offsets.truncate(0);
+  const SbOctTreeFlat * flat = ROOT(this)->flat;
+  if (flat) {
+    flat_find_items_batch<SbOctTreeBoxQuery>(*flat, this->itemfuncs, boxes, numboxes,
+                                             destarray, offsets);
+    return;
+  }
+  for (int i = 0; i < numboxes; i++) {
+    const int start = destarray.getLength();
+    offsets.append(start);
+    this->topnode->findItems(boxes[i], destarray, this->itemfuncs);
+    remove_duplicates(destarray, start, start);
+  }
+  offsets.append(destarray.getLength());
+}
+
+/*!
+  Finds the items inside each of the \a numspheres spheres in \a
+  spheres. The results are returned in \a destarray and \a offsets,
+  like for the batch version of findItems() for boxes.
+
+  \DANGEROUS_ALLOC_RETURN
+
+  \since Coin 4.1
+*/
+void
+SbOctTree::findItems(const SbSphere * const spheres,
+                     const int numspheres,
+                     SbList <void*> & destarray,
+                     SbList <int> & offsets) const
+{
+  destarray.truncate(0);
+  offsets.truncate(0);
+  const SbOctTreeFlat * flat = ROOT(this)->flat;
+  if (flat) {
+    assert(this->itemfuncs.insidespherefunc || !flat->refboxes.empty());
+    flat_find_items_batch<SbOctTreeSphereQuery>(*flat, this->itemfuncs, spheres, numspheres,
+                                                destarray, offsets);
+    return;
+  }
+  assert(this->itemfuncs.insidespherefunc);
+  for (int i = 0; i < numspheres; i++) {
+    const int start = destarray.getLength();
+    offsets.append(start);
+    this->topnode->findItems(spheres[i], destarray, this->itemfuncs);
+    remove_duplicates(destarray, start, start);
+  }
+  offsets.append(destarray.getLength());
+}
+
+/*!
+  Does \a numqueries plane queries at once. The planes for query
+  number \e i are found in \a planes from index \e i * \a numplanes,
+  and the items which are (partially) inside all of them are
+  returned. The results are returned in \a destarray and \a offsets,
+  like for the batch version of findItems() for boxes.
+
+  \DANGEROUS_ALLOC_RETURN
+
+  \since Coin 4.1
+*/
+void
+SbOctTree::findItems(const SbPlane * const planes,
+                     const int numplanes,
+                     const int numqueries,
+                     SbList <void*> & destarray,
+                     SbList <int> & offsets) const
+{
+  destarray.truncate(0);
+  offsets.truncate(0);
+  const SbOctTreeFlat * flat = ROOT(this)->flat;
+  SbOctTreeQueryScratch scratch;
+  for (int i = 0; i < numqueries; i++) {
+    const int start = destarray.getLength();
+    const SbPlane * const queryplanes = planes + i * numplanes;
+    offsets.append(start);
+    if (flat) {
+      flat_find_items(*flat, SbOctTreePlanesQuery(queryplanes, numplanes,
+                                                  *flat, this->itemfuncs),
+                      scratch, destarray);
+    }
+    else {
+      this->topnode->findItems(queryplanes, numplanes, destarray, this->itemfuncs);
+      remove_duplicates(destarray, start, start);
+    }
+  }
+  offsets.append(destarray.getLength());
+}
+
+/*!
+  Optimizes the octree for queries, for when all items have been
+  added. The nodes are copied into one contiguous array, with each
+  leaf node referring to a range of item indices, which makes
+  queries faster and their results free of duplicates.
+
+  If \a itemboxfunc is set, it is called once for every item to get
+  its bounding box, and the queries then test against the stored
+  item bounding boxes instead of using the SbOctTreeFuncs callbacks.
+  Only use this if the callbacks are bounding box tests anyway, or
+  if the items found are tested more precisely afterwards.
+
+  Adding or removing items drops the optimization again.
+
+  \since Coin 4.1
+*/
+void
+SbOctTree::optimize(void (*itemboxfunc)(void * const item, SbBox3f & box))
+{
+  this->dropOptimization();
+
+  SbOctTreeFlat * flat = new SbOctTreeFlat;
+  flat->nodes.resize(1);
+  SbOctTreeFlatBuilder builder(*flat, itemboxfunc);
+  builder.addNode(this->topnode, 0);
+  ROOT(this)->flat = flat;
+}
+
+/*!
+  Returns whether the octree is currently optimized.
+
+  \sa optimize()
+  \since Coin 4.1
+*/
+SbBool
+SbOctTree::isOptimized(void) const
+{
+  return ROOT(this)->flat != NULL;
+}
+
+// Drops the flattened octree made by optimize().
+void
+SbOctTree::dropOptimization(void)
+{
+  delete ROOT(this)->flat;
+  ROOT(this)->flat = NULL;
 }
 
 /*!
@@ -668,3 +1247,127 @@ SbOctTree::debugTree(FILE * fp)
   fprintf(fp, "Oct Tree:\n");
   if (this->topnode) { this->topnode->debugTree(fp, 1); }
 }
+
+#undef ROOT
+
+#ifdef COIN_TEST_SUITE
+
+#include <algorithm>
+#include <vector>
+#include <Inventor/SbOctTree.h>
+#include <Inventor/SbSphere.h>
+
+static SbBool
+octtree_test_insidebox(void * const item, const SbBox3f & box)
+{
+  return box.intersect(*static_cast<SbBox3f *>(item));
+}
+
+static SbBool
+octtree_test_insidesphere(void * const item, const SbSphere & sphere)
+{
+  const SbBox3f * itembox = static_cast<SbBox3f *>(item);
+  const SbVec3f c = sphere.getCenter();
+  SbVec3f closest;
+  for (int i = 0; i < 3; i++) {
+    closest[i] = SbClamp(c[i], itembox->getMin()[i], itembox->getMax()[i]);
+  }
+  return (closest - c).sqrLength() <= sphere.getRadius() * sphere.getRadius();
+}
+
+static void
+octtree_test_itembox(void * const item, SbBox3f & box)
+{
+  box = *static_cast<SbBox3f *>(item);
+}
+
+static std::vector<void *>
+octtree_test_sorted(const SbList<void *> & items, int start, int end)
+{
+  std::vector<void *> sorted(items.getArrayPtr() + start, items.getArrayPtr() + end);
+  std::sort(sorted.begin(), sorted.end());
+  return sorted;
+}
+
+BOOST_AUTO_TEST_CASE(optimizedQueries)
+{
+  const SbOctTreeFuncs funcs = {
+    NULL, octtree_test_insidebox, octtree_test_insidesphere, NULL
+  };
+  const SbBox3f bbox(-1.0f, -1.0f, -1.0f, 11.0f, 11.0f, 11.0f);
+  SbOctTree dynamictree(bbox, funcs, 4);
+  SbOctTree flattree(bbox, funcs, 4);
+  SbOctTree boxtree(bbox, funcs, 4);
+
+  // items of different sizes, many of them spanning several leaves
+  std::vector<SbBox3f> items;
+  for (int i = 0; i < 500; i++) {
+    const SbVec3f p((i * 7) % 10, (i * 13) % 10, (i * 17) % 10);
+    const float size = 0.1f + (i % 5) * 0.3f;
+    items.push_back(SbBox3f(p, p + SbVec3f(size, size, size)));
+  }
+  for (size_t i = 0; i < items.size(); i++) {
+    dynamictree.addItem(&items[i]);
+    flattree.addItem(&items[i]);
+    boxtree.addItem(&items[i]);
+  }
+  flattree.optimize();
+  boxtree.optimize(octtree_test_itembox);
+  BOOST_CHECK_MESSAGE(flattree.isOptimized() && !dynamictree.isOptimized(),
+                      "wrong optimization state");
+
+  std::vector<SbBox3f> queryboxes;
+  std::vector<SbSphere> queryspheres;
+  for (int i = 0; i < 50; i++) {
+    const SbVec3f p((i * 3) % 10 + 0.5f, (i * 11) % 10 + 0.25f, (i * 5) % 10);
+    queryboxes.push_back(SbBox3f(p, p + SbVec3f(1.5f, 0.5f, 2.0f)));
+    queryspheres.push_back(SbSphere(p, 0.5f + (i % 3)));
+  }
+
+  SbList<void *> expected, result, batch;
+  SbList<int> offsets;
+  for (int i = 0; i < 50; i++) {
+    expected.truncate(0);
+    dynamictree.findItems(queryboxes[i], expected);
+    const std::vector<void *> sortedexpected =
+      octtree_test_sorted(expected, 0, expected.getLength());
+    BOOST_CHECK_MESSAGE(std::adjacent_find(sortedexpected.begin(), sortedexpected.end()) ==
+                        sortedexpected.end(), "duplicates in dynamic octree result");
+
+    result.truncate(0);
+    flattree.findItems(queryboxes[i], result);
+    BOOST_CHECK_MESSAGE(octtree_test_sorted(result, 0, result.getLength()) == sortedexpected,
+                        "optimized box query differs from dynamic octree");
+    result.truncate(0);
+    boxtree.findItems(queryboxes[i], result);
+    BOOST_CHECK_MESSAGE(octtree_test_sorted(result, 0, result.getLength()) == sortedexpected,
+                        "box query on item bounding boxes differs from dynamic octree");
+  }
+
+  for (int t = 0; t < 2; t++) {
+    const SbOctTree & tree = t ? flattree : dynamictree;
+    tree.findItems(&queryboxes[0], 50, batch, offsets);
+    BOOST_CHECK_MESSAGE(offsets.getLength() == 51, "wrong number of batch offsets");
+    for (int i = 0; i < 50; i++) {
+      expected.truncate(0);
+      dynamictree.findItems(queryboxes[i], expected);
+      BOOST_CHECK_MESSAGE(octtree_test_sorted(batch, offsets[i], offsets[i+1]) ==
+                          octtree_test_sorted(expected, 0, expected.getLength()),
+                          "batch box query differs from single query");
+    }
+
+    tree.findItems(&queryspheres[0], 50, batch, offsets);
+    for (int i = 0; i < 50; i++) {
+      expected.truncate(0);
+      dynamictree.findItems(queryspheres[i], expected);
+      BOOST_CHECK_MESSAGE(octtree_test_sorted(batch, offsets[i], offsets[i+1]) ==
+                          octtree_test_sorted(expected, 0, expected.getLength()),
+                          "batch sphere query differs from single query");
+    }
+  }
+
+  flattree.removeItem(&items[0]);
+  BOOST_CHECK_MESSAGE(!flattree.isOptimized(), "removeItem() didn't drop optimization");
+}
+
+#endif // COIN_TEST_SUITE
@@ -282,7 +282,9 @@ cc_heap_remove(cc_heap * h, void * o)
 
   h->array[i] = h->array[--h->elements];
   cc_dict_put(h->hash, reinterpret_cast<uintptr_t>(h->array[i]), reinterpret_cast<void *>(i));
+  /* the last element may belong above or below the removed one */
   heap_heapify_down(h, i);
+  if (i < h->elements) heap_heapify_up(h, i);
 
   cc_dict_remove(h->hash, reinterpret_cast<uintptr_t>(o));
 
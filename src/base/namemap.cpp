@@ -32,9 +32,11 @@
 
 #include "base/namemap.h"
 
+#include <atomic>
 #include <cstdlib>
 #include <cassert>
 #include <cstring>
+#include <cstddef>
 
 #include "threads/threadsutilp.h"
 #include "tidbitsp.h"
@@ -43,8 +45,7 @@
 #ifndef COIN_WORKAROUND_NO_USING_STD_FUNCS
 using std::malloc;
 using std::free;
-using std::strcpy;
-using std::strlen;
+using std::memcpy;
 using std::strcmp;
 #endif // !COIN_WORKAROUND_NO_USING_STD_FUNCS
 
@@ -63,136 +64,284 @@ using std::strcmp;
   mortene.
 */
 
+/*
+  Implementation note: SbName construction goes through here, so this
+  is on the hot path for file import and scene graph setup, also when
+  done from several threads at once.
+
+  The name table is split into NAMEMAP_NUM_SHARDS independent shards,
+  selected by the low bits of the string hash. Each shard is an open
+  addressing (linear probing) table of pointers to immutable
+  entries. Entries are never moved or freed until process exit, and a
+  slot goes from NULL to its final value exactly once, so lookups of
+  names already present run without taking any lock at all.
+
+  Inserts take the mutex of their shard only. When a shard table gets
+  too full, a table of twice the size is built and published with a
+  single atomic store. The old table is kept alive (on the "retired"
+  list of the new table) since concurrent readers may still be probing
+  it. A reader which misses in an outdated table just falls through
+  to the locked slow path, where the lookup is repeated against the
+  current table. The retired tables add up to less memory than the
+  live table, and are released at exit.
+*/
+
 /* ************************************************************************* */
 
 #define CHUNK_SIZE (65536-32)
-static const unsigned int NAME_TABLE_SIZE = 1999;
+#define NAMEMAP_SHARD_BITS 6
+static const unsigned int NAMEMAP_NUM_SHARDS = 1 << NAMEMAP_SHARD_BITS;
+static const unsigned int NAMEMAP_INITIAL_SLOTS = 64;
 
 struct NamemapMemChunk {
-  char mem[CHUNK_SIZE];
+  struct NamemapMemChunk * next;
   char * curbyte;
   size_t bytesleft;
-  struct NamemapMemChunk * next;
+  /* memory follows directly after the struct */
+};
+
+struct NamemapEntry {
+  uint32_t hashvalue;
+  char str[1]; /* allocated to fit the string */
 };
 
-struct NamemapBucketEntry {
-  unsigned long hashvalue;
-  const char * str;
-  struct NamemapBucketEntry * next;
+struct NamemapTable {
+  unsigned int mask; /* number of slots minus one */
+  std::atomic<const struct NamemapEntry *> * slots;
+  struct NamemapTable * retired;
 };
 
-static void * access_mutex = NULL;
-static struct NamemapBucketEntry ** nametable = NULL;
-static struct NamemapMemChunk * headchunk = NULL;
+struct NamemapShard {
+  std::atomic<struct NamemapTable *> table;
+  /* the fields below are only touched with the mutex locked */
+  void * mutex;
+  unsigned int numentries;
+  struct NamemapMemChunk * headchunk;
+};
+
+static std::atomic<struct NamemapShard *> namemap_shards(NULL);
 
 /* ************************************************************************* */
 
-extern "C" {
+static struct NamemapTable *
+namemap_table_construct(unsigned int numslots)
+{
+  struct NamemapTable * table = new struct NamemapTable;
+  table->mask = numslots - 1;
+  table->slots = new std::atomic<const struct NamemapEntry *>[numslots];
+  for (unsigned int i = 0; i < numslots; i++) {
+    table->slots[i].store(NULL, std::memory_order_relaxed);
+  }
+  table->retired = NULL;
+  return table;
+}
 
-/* Deallocates static process resources. */
 static void
-namemap_cleanup(void)
+namemap_table_destruct(struct NamemapTable * table)
 {
-  unsigned int i;
-
-  struct NamemapMemChunk * chunkptr = headchunk;
-  while (chunkptr) {
-    struct NamemapMemChunk * next = chunkptr->next;
-    free(chunkptr);
-    chunkptr = next;
+  while (table) {
+    struct NamemapTable * next = table->retired;
+    delete[] table->slots;
+    delete table;
+    table = next;
   }
-  
-  for (i = 0; i < NAME_TABLE_SIZE; i++) {
-    struct NamemapBucketEntry * entry = nametable[i];
-    while (entry) {
-      struct NamemapBucketEntry * next = entry->next;
-      free(entry);
-      entry = next;
+}
+
+static void
+namemap_shards_destruct(struct NamemapShard * shards)
+{
+  for (unsigned int i = 0; i < NAMEMAP_NUM_SHARDS; i++) {
+    struct NamemapShard * shard = &shards[i];
+    struct NamemapMemChunk * chunkptr = shard->headchunk;
+    while (chunkptr) {
+      struct NamemapMemChunk * next = chunkptr->next;
+      free(chunkptr);
+      chunkptr = next;
     }
+    namemap_table_destruct(shard->table.load(std::memory_order_relaxed));
+    CC_MUTEX_DESTRUCT(shard->mutex);
   }
-  free(nametable);
-  nametable = static_cast<struct NamemapBucketEntry **>(NULL);
+  delete[] shards;
+}
 
-  CC_MUTEX_DESTRUCT(access_mutex);
+/* ************************************************************************* */
+
+extern "C" {
+
+/* Deallocates static process resources. */
+static void
+namemap_cleanup(void)
+{
+  struct NamemapShard * shards = namemap_shards.exchange(NULL);
+  if (shards) { namemap_shards_destruct(shards); }
 }
 
 } // extern "C"
 
-/* Initializes static data. */
-static void
+/* Initializes static data. Several threads may race to do this, only
+   one of them gets to publish its shard array. */
+static struct NamemapShard *
 namemap_init(void)
 {
-  unsigned int i;
-
-  nametable = static_cast<struct NamemapBucketEntry **>(
-    malloc(sizeof(struct NamemapBucketEntry *) * NAME_TABLE_SIZE));
-  for (i = 0; i < NAME_TABLE_SIZE; i++) { nametable[i] = NULL; }
+  struct NamemapShard * shards = new struct NamemapShard[NAMEMAP_NUM_SHARDS];
+  for (unsigned int i = 0; i < NAMEMAP_NUM_SHARDS; i++) {
+    struct NamemapShard * shard = &shards[i];
+    shard->table.store(namemap_table_construct(NAMEMAP_INITIAL_SLOTS),
+                       std::memory_order_relaxed);
+    shard->mutex = NULL;
+    CC_MUTEX_CONSTRUCT(shard->mutex);
+    shard->numentries = 0;
+    shard->headchunk = NULL;
+  }
 
-  headchunk = NULL;
+  struct NamemapShard * expected = NULL;
+  if (!namemap_shards.compare_exchange_strong(expected, shards,
+                                              std::memory_order_acq_rel)) {
+    namemap_shards_destruct(shards);
+    return expected;
+  }
 
   coin_atexit(static_cast<coin_atexit_f *>(namemap_cleanup), CC_ATEXIT_SBNAME);
+  return shards;
 }
 
-static const char *
-find_string_address(const char * s)
+/* FNV-1a, which spreads short and similar strings (like field names)
+   much better over the table than cc_string_hash_text(). Also
+   returns the string length, to save a strlen() call. */
+static uint32_t
+namemap_hash(const char * s, size_t * len)
 {
-  size_t len = strlen(s) + 1;
+  uint32_t h = 2166136261u;
+  const unsigned char * p = reinterpret_cast<const unsigned char *>(s);
+  while (*p) {
+    h ^= *p++;
+    h *= 16777619u;
+  }
+  *len = p - reinterpret_cast<const unsigned char *>(s);
+  return h;
+}
 
-  /* FIXME: this is an unacceptable limitation. 20030608 mortene. */
-  assert(len < CHUNK_SIZE);
+static inline unsigned int
+namemap_slot_index(uint32_t h, unsigned int mask)
+{
+  /* the low bits are used for picking the shard */
+  return (h >> NAMEMAP_SHARD_BITS) & mask;
+}
 
-  if (headchunk == NULL || headchunk->bytesleft < len) {
-    struct NamemapMemChunk * newchunk = static_cast<struct NamemapMemChunk *>(
-      malloc(sizeof(struct NamemapMemChunk))
-      );
+static const struct NamemapEntry *
+namemap_table_find(const struct NamemapTable * table, uint32_t h, const char * str)
+{
+  unsigned int i = namemap_slot_index(h, table->mask);
+  for (;;) {
+    const struct NamemapEntry * entry =
+      table->slots[i].load(std::memory_order_acquire);
+    if (entry == NULL) { return NULL; }
+    if (entry->hashvalue == h && strcmp(entry->str, str) == 0) { return entry; }
+    i = (i + 1) & table->mask;
+  }
+}
 
-    newchunk->curbyte = newchunk->mem;
-    newchunk->bytesleft = CHUNK_SIZE;
-    newchunk->next = headchunk;
+static void
+namemap_table_insert(struct NamemapTable * table, const struct NamemapEntry * entry)
+{
+  unsigned int i = namemap_slot_index(entry->hashvalue, table->mask);
+  while (table->slots[i].load(std::memory_order_relaxed) != NULL) {
+    i = (i + 1) & table->mask;
+  }
+  table->slots[i].store(entry, std::memory_order_release);
+}
 
-    headchunk = newchunk;
+/* assumes shard mutex is locked */
+static struct NamemapTable *
+namemap_shard_grow(struct NamemapShard * shard, struct NamemapTable * oldtable)
+{
+  const unsigned int oldsize = oldtable->mask + 1;
+  struct NamemapTable * newtable = namemap_table_construct(oldsize * 2);
+  for (unsigned int i = 0; i < oldsize; i++) {
+    const struct NamemapEntry * entry =
+      oldtable->slots[i].load(std::memory_order_relaxed);
+    if (entry) { namemap_table_insert(newtable, entry); }
   }
+  newtable->retired = oldtable;
+  shard->table.store(newtable, std::memory_order_release);
+  return newtable;
+}
 
-  (void)strcpy(headchunk->curbyte, s);
-  s = headchunk->curbyte;
+/* assumes shard mutex is locked */
+static const struct NamemapEntry *
+namemap_shard_alloc_entry(struct NamemapShard * shard, uint32_t h,
+                          const char * s, size_t len)
+{
+  const size_t align = sizeof(void *);
+  size_t size = offsetof(struct NamemapEntry, str) + len + 1;
+  size = (size + align - 1) & ~(align - 1);
+
+  struct NamemapMemChunk * chunk = shard->headchunk;
+  if (size > CHUNK_SIZE / 4) {
+    /* big strings get a chunk of their own, linked in behind the
+       current head so its free space is not wasted */
+    chunk = static_cast<struct NamemapMemChunk *>(
+      malloc(sizeof(struct NamemapMemChunk) + size));
+    chunk->curbyte = reinterpret_cast<char *>(chunk + 1);
+    chunk->bytesleft = size;
+    if (shard->headchunk) {
+      chunk->next = shard->headchunk->next;
+      shard->headchunk->next = chunk;
+    }
+    else {
+      chunk->next = NULL;
+      shard->headchunk = chunk;
+    }
+  }
+  else if (chunk == NULL || chunk->bytesleft < size) {
+    chunk = static_cast<struct NamemapMemChunk *>(
+      malloc(sizeof(struct NamemapMemChunk) + CHUNK_SIZE));
+    chunk->curbyte = reinterpret_cast<char *>(chunk + 1);
+    chunk->bytesleft = CHUNK_SIZE;
+    chunk->next = shard->headchunk;
+    shard->headchunk = chunk;
+  }
 
-  headchunk->curbyte += len;
-  headchunk->bytesleft -= len;
+  struct NamemapEntry * entry = reinterpret_cast<struct NamemapEntry *>(chunk->curbyte);
+  chunk->curbyte += size;
+  chunk->bytesleft -= size;
 
-  return s;
+  entry->hashvalue = h;
+  (void)memcpy(entry->str, s, len + 1);
+  return entry;
 }
 
 static const char *
 namemap_find_or_add_string(const char * str, SbBool addifnotfound)
 {
-  unsigned long h, i;
-  struct NamemapBucketEntry * entry;
+  struct NamemapShard * shards = namemap_shards.load(std::memory_order_acquire);
+  if (shards == NULL) { shards = namemap_init(); }
 
-  if (access_mutex == NULL) { CC_MUTEX_CONSTRUCT(access_mutex); }
-  CC_MUTEX_LOCK(access_mutex);
+  size_t len;
+  const uint32_t h = namemap_hash(str, &len);
+  struct NamemapShard * shard = &shards[h & (NAMEMAP_NUM_SHARDS - 1)];
 
-  if (nametable == NULL) { namemap_init(); }
-  assert(nametable != static_cast<struct NamemapBucketEntry **>(NULL) && "name hash dead");
+  /* lock-free fast path, hits for all names seen before */
+  const struct NamemapEntry * entry =
+    namemap_table_find(shard->table.load(std::memory_order_acquire), h, str);
+  if (entry) { return entry->str; }
 
-  h = cc_string_hash_text(str);
-  i = h % NAME_TABLE_SIZE;
-  entry = nametable[i];
+  CC_MUTEX_LOCK(shard->mutex);
 
-  while (entry != NULL) {
-    if (entry->hashvalue == h && strcmp(entry->str, str) == 0) { break; }
-    entry = entry->next;
-  }
+  /* table may have been grown or the string added since we looked */
+  struct NamemapTable * table = shard->table.load(std::memory_order_relaxed);
+  entry = namemap_table_find(table, h, str);
 
   if ((entry == NULL) && addifnotfound) {
-    entry = static_cast<struct NamemapBucketEntry *>(malloc(sizeof(struct NamemapBucketEntry)));
-    entry->str = find_string_address(str);
-    entry->hashvalue = h;
-    entry->next = nametable[i];
-
-    nametable[i] = entry;
+    if ((shard->numentries + 1) * 2 > table->mask + 1) {
+      table = namemap_shard_grow(shard, table);
+    }
+    entry = namemap_shard_alloc_entry(shard, h, str, len);
+    namemap_table_insert(table, entry);
+    shard->numentries++;
   }
 
-  CC_MUTEX_UNLOCK(access_mutex);
+  CC_MUTEX_UNLOCK(shard->mutex);
   return entry ? entry->str : NULL;
 }
 
@@ -202,6 +351,9 @@ namemap_find_or_add_string(const char * str, SbBool addifnotfound)
   Adds a string to the name hash and returns its permanent memory
   address pointer. If the string is already present in the name hash,
   just returns the address pointer.
+
+  Safe to call from several threads at once. Lookups of strings
+  already present in the name hash never block.
 */
 const char *
 cc_namemap_get_address(const char * str)
@@ -221,4 +373,5 @@ cc_namemap_peek_string(const char * str)
   return namemap_find_or_add_string(str, FALSE);
 }
 
+#undef NAMEMAP_SHARD_BITS
 #undef CHUNK_SIZE
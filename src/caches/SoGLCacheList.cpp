@@ -35,6 +35,29 @@
   \brief The SoGLCacheList class is used to store and manage OpenGL caches.
 
   \ingroup caches
+
+  An SoGLCacheList holds the render caches (OpenGL display lists) of
+  a single node, usually an SoSeparator. The list decides by itself
+  when a new cache should be recorded, based on whether the subgraph
+  has rendered the same way for a number of frames, how many caches
+  have been thrown away before, and hints from the shapes in the
+  subgraph (see the COIN_AUTO_CACHING and COIN_SMART_CACHING
+  environment variables).
+
+  To make it possible to find out why a node doesn't get cached, or
+  keeps rebuilding its caches, each list keeps a set of counters:
+  the number of times a cache could be used (getNumHits()) or not
+  (getNumMisses()), the number of caches built and the time spent
+  building them, and the number of invalidations per cause. The
+  counters of an SoSeparator's list can be read through
+  SoSeparator::getGLCacheList(). When the profiler is enabled, the
+  approximate memory usage of the caches is also set as the video
+  memory footprint of the node, and the time spent building caches
+  is added to the "renderCacheBuild" phase.
+
+  Applications that need their own caching heuristics can install a
+  callback with setCachePolicyCallback(), which gets the final say
+  on whether a new cache should be recorded.
 */
 
 #include <Inventor/caches/SoGLCacheList.h>
@@ -54,10 +77,14 @@
 #include <Inventor/misc/SoState.h>
 #include <Inventor/misc/SoContextHandler.h>
 #include <Inventor/system/gl.h>
+#include <Inventor/annex/Profiler/SoProfiler.h>
+#include <Inventor/annex/Profiler/elements/SoProfilerElement.h>
+#include <Inventor/annex/Profiler/SbProfilingData.h>
 
 #include "tidbitsp.h"
 #include "glue/glp.h"
 #include "rendering/SoGL.h"
+#include "caches/SoInstanceCache.h"
 
 // *************************************************************************
 
@@ -73,6 +100,11 @@
 static int COIN_AUTO_CACHING = -1;
 static int COIN_SMART_CACHING = -1;
 
+// Used to estimate the memory used by a display list. Assumes a
+// triangle with a position, a normal and a texture coordinate per
+// vertex.
+static const size_t SOGLCACHELIST_BYTES_PER_PRIMITIVE = 3 * 8 * sizeof(float);
+
 // *************************************************************************
 
 class SoGLCacheListP {
@@ -89,6 +121,45 @@ public:
   int numframesok;
   int numshapes;
 
+  // approximate memory usage of each cache in itemlist
+  SbList <size_t> memlist;
+
+  // statistics
+  int numhits;
+  int nummisses;
+  int numbuilt;
+  int numfailed;
+  SbTime buildtime;
+  SbTime openedtime;
+  uint32_t openedprimitives;
+  SbList <SoType> invalidtypes;
+  SbList <int> invalidcounts;
+
+  static SoGLCacheListPolicyCB * policycb;
+  static void * policyclosure;
+
+  void removeItem(const int idx) {
+    this->itemlist.remove(idx);
+    this->memlist.remove(idx);
+  }
+
+  void addInvalidation(const SoType type) {
+    const int idx = this->invalidtypes.find(type);
+    if (idx >= 0) this->invalidcounts[idx]++;
+    else {
+      this->invalidtypes.append(type);
+      this->invalidcounts.append(1);
+    }
+  }
+
+  size_t getMemoryUsage(void) const {
+    size_t mem = 0;
+    for (int i = 0; i < this->memlist.getLength(); i++) mem += this->memlist[i];
+    return mem;
+  }
+
+  void profile(SoGLRenderAction * action, const SbTime * buildtime) const;
+
   //
   // Callback from SoContextHandler
   //
@@ -100,7 +171,7 @@ public:
     while (i < n) {
       if (thisp->itemlist[i]->getCacheContext() == static_cast<int>(context)) {
         thisp->itemlist[i]->unref();
-        thisp->itemlist.remove(i);
+        thisp->removeItem(i);
         n--;
       }
       else i++;
@@ -108,6 +179,27 @@ public:
   }
 };
 
+SoGLCacheListPolicyCB * SoGLCacheListP::policycb = NULL;
+void * SoGLCacheListP::policyclosure = NULL;
+
+// Registers the cache memory and the build time with the profiler.
+void
+SoGLCacheListP::profile(SoGLRenderAction * action, const SbTime * buildtime) const
+{
+  SoState * state = action->getState();
+  if (!state->isElementEnabled(SoProfilerElement::getClassStackIndex())) return;
+  SoProfilerElement * profilerelt = SoProfilerElement::get(state);
+  if (!profilerelt) return;
+
+  SbProfilingData & data = profilerelt->getProfilingData();
+  if (buildtime) data.addPhaseTiming("renderCacheBuild", *buildtime);
+  const int entry = data.getIndex(action->getCurPath(), TRUE);
+  if (entry != -1) {
+    data.setNodeFootprint(entry, SbProfilingData::VIDEO_MEMORY_SIZE,
+                          this->getMemoryUsage());
+  }
+}
+
 #define PRIVATE(obj) ((obj)->pimpl)
 
 // *************************************************************************
@@ -127,6 +219,8 @@ SoGLCacheList::SoGLCacheList(int numcaches)
   PRIVATE(this)->invalidelement = NULL;
   PRIVATE(this)->numframesok = 0;
   PRIVATE(this)->numshapes = 0;
+  PRIVATE(this)->openedprimitives = 0;
+  this->resetStatistics();
 
   // auto caching must be enabled using an environment variable
   if (COIN_AUTO_CACHING < 0) {
@@ -180,30 +274,46 @@ SoGLCacheList::call(SoGLRenderAction * action)
 {
   // do a quick return if there are no caches in the list
   int n = PRIVATE(this)->itemlist.getLength();
-  if (n == 0) return FALSE;
+  if (n == 0) {
+    PRIVATE(this)->nummisses++;
+    return FALSE;
+  }
+  // render caches hold GL commands, not primitives that can be
+  // added to an instance cache
+  if (soshape_instance_capture()) return FALSE;
 
   int i;
   SoState * state = action->getState();
   int context = SoGLCacheContextElement::get(state);
+  // the most recently used cache for this context which couldn't be
+  // used, and whether that was because of the lazy GL state
+  SoGLRenderCache * missed = NULL;
+  SbBool lazymiss = FALSE;
 
   for (i = 0; i < n; i++) {
     SoGLRenderCache * cache = PRIVATE(this)->itemlist[i];
     if (cache->getCacheContext() == context) {
-      if (cache->isValid(state) &&
+      missed = cache;
+      lazymiss = cache->isValid(state);
+      if (lazymiss &&
           SoGLLazyElement::preCacheCall(state, cache->getPreLazyState())) {
         cache->ref();
         // move cache to the end of the list. The MRU cache will be at
         // the end of the list, and the LRU will be the first
         // item. This makes it easy to choose a cache to destroy when
         // the maximum number of caches is exceeded.
-        PRIVATE(this)->itemlist.remove(i);
+        const size_t mem = PRIVATE(this)->memlist[i];
+        PRIVATE(this)->removeItem(i);
         PRIVATE(this)->itemlist.append(cache);
+        PRIVATE(this)->memlist.append(mem);
         // update lazy GL state before calling cache
         SoGLLazyElement::getInstance(state)->send(state, SoLazyElement::ALL_MASK);
         cache->call(state);
         SoGLLazyElement::postCacheCall(state, cache->getPostLazyState());
         cache->unref(state);
         PRIVATE(this)->numused++;
+        PRIVATE(this)->numhits++;
+        if (SoProfiler::isEnabled()) PRIVATE(this)->profile(action, NULL);
 
 #if COIN_DEBUG
         // The GL error test is default disabled for this optimized
@@ -425,6 +535,18 @@ SoGLCacheList::call(SoGLRenderAction * action)
       }
     }
   }
+
+  PRIVATE(this)->nummisses++;
+  if (missed) {
+    if (lazymiss) {
+      PRIVATE(this)->addInvalidation(SoGLLazyElement::getClassTypeId());
+    }
+    else {
+      const SoElement * elem = missed->getInvalidElement(state);
+      if (elem) PRIVATE(this)->addInvalidation(elem->getTypeId());
+    }
+  }
+
 #if COIN_DEBUG
   if (coin_debug_caching_level() > 0) {
     SoDebugError::postInfo("SoGLCacheList::call",
@@ -529,14 +651,21 @@ SoGLCacheList::open(SoGLRenderAction * action, SbBool autocache)
     if (dontcreate >= docreate) shouldcreate = FALSE;
   }
 
+  if (SoGLCacheListP::policycb) {
+    shouldcreate = SoGLCacheListP::policycb(SoGLCacheListP::policyclosure, this,
+                                            action, autocache, shouldcreate);
+  }
+
   if (shouldcreate) {
     if (PRIVATE(this)->itemlist.getLength() >= PRIVATE(this)->numcaches) {
       // the cache at position 0 will be the LRU cache. Remove it.
       SoGLRenderCache * cache = PRIVATE(this)->itemlist[0];
       cache->unref(state);
-      PRIVATE(this)->itemlist.remove(0);
+      PRIVATE(this)->removeItem(0);
       PRIVATE(this)->numdiscarded++;
     }
+    PRIVATE(this)->openedtime = SbTime::getTimeOfDay();
+    PRIVATE(this)->openedprimitives = sogl_autocache_get_num_primitives();
     PRIVATE(this)->opencache = new SoGLRenderCache(state);
     PRIVATE(this)->opencache->ref();
     SoCacheElement::set(state, PRIVATE(this)->opencache);
@@ -573,9 +702,16 @@ SoGLCacheList::close(SoGLRenderAction * action)
   SoState * state = action->getState();
 
   // close open cache before accepting it or throwing it away
+  SbTime buildtime = SbTime::zero();
+  size_t mem = 0;
   if (PRIVATE(this)->opencache) {
     PRIVATE(this)->opencache->close();
     SoGLLazyElement::endCaching(state);
+    buildtime = SbTime::getTimeOfDay() - PRIVATE(this)->openedtime;
+    PRIVATE(this)->buildtime += buildtime;
+    const uint32_t numprimitives =
+      sogl_autocache_get_num_primitives() - PRIVATE(this)->openedprimitives;
+    mem = numprimitives * SOGLCACHELIST_BYTES_PER_PRIMITIVE;
   }
   if (SoCacheElement::setInvalid(PRIVATE(this)->savedinvalid)) {
     // notify parent caches
@@ -586,6 +722,7 @@ SoGLCacheList::close(SoGLRenderAction * action)
       PRIVATE(this)->opencache->unref();
       PRIVATE(this)->opencache = NULL;
       PRIVATE(this)->numdiscarded += 1;
+      PRIVATE(this)->numfailed++;
 
 #if COIN_DEBUG
       if (coin_debug_caching_level() > 0) {
@@ -608,7 +745,10 @@ SoGLCacheList::close(SoGLRenderAction * action)
     }
 #endif // debug
     PRIVATE(this)->itemlist.append(PRIVATE(this)->opencache);
+    PRIVATE(this)->memlist.append(mem);
     PRIVATE(this)->opencache = NULL;
+    PRIVATE(this)->numbuilt++;
+    if (SoProfiler::isEnabled()) PRIVATE(this)->profile(action, &buildtime);
   }
 
   PRIVATE(this)->numshapes = SoGLCacheContextElement::getNumShapes(state);
@@ -636,8 +776,292 @@ SoGLCacheList::invalidateAll(void)
     PRIVATE(this)->itemlist[i]->unref();
   }
   PRIVATE(this)->itemlist.truncate(0);
+  PRIVATE(this)->memlist.truncate(0);
   PRIVATE(this)->numdiscarded += n;
   PRIVATE(this)->numframesok = 0;
+  PRIVATE(this)->addInvalidation(SoType::badType());
+}
+
+/*!
+  Returns the number of caches currently in the list, for all cache
+  contexts.
+
+  \since Coin 4.1
+*/
+int
+SoGLCacheList::getNumCaches(void) const
+{
+  return PRIVATE(this)->itemlist.getLength();
+}
+
+/*!
+  Returns the number of times in a row the subgraph has been
+  traversed without anything in it preventing caching. This is what
+  the default caching heuristics use to decide whether it's time to
+  record a cache.
+
+  \since Coin 4.1
+*/
+int
+SoGLCacheList::getNumValidFrames(void) const
+{
+  return PRIVATE(this)->numframesok;
+}
+
+/*!
+  Returns the number of times call() found a cache it could use.
+
+  \sa resetStatistics()
+  \since Coin 4.1
+*/
+int
+SoGLCacheList::getNumHits(void) const
+{
+  return PRIVATE(this)->numhits;
+}
+
+/*!
+  Returns the number of times call() found no cache it could use,
+  either because there were none or because the caches were invalid.
+
+  \sa getNumInvalidations()
+  \since Coin 4.1
+*/
+int
+SoGLCacheList::getNumMisses(void) const
+{
+  return PRIVATE(this)->nummisses;
+}
+
+/*!
+  Returns the number of caches that have been recorded successfully.
+
+  \since Coin 4.1
+*/
+int
+SoGLCacheList::getNumBuilt(void) const
+{
+  return PRIVATE(this)->numbuilt;
+}
+
+/*!
+  Returns the number of caches that were thrown away when closed,
+  because something in the subgraph prevented caching (e.g. a node
+  which calls SoCacheElement::invalidate()).
+
+  \since Coin 4.1
+*/
+int
+SoGLCacheList::getNumFailedBuilds(void) const
+{
+  return PRIVATE(this)->numfailed;
+}
+
+/*!
+  Returns the total time spent traversing the subgraph while recording
+  caches, including the caches that were thrown away.
+
+  \since Coin 4.1
+*/
+SbTime
+SoGLCacheList::getBuildTime(void) const
+{
+  return PRIVATE(this)->buildtime;
+}
+
+/*!
+  Returns the total number of invalidations, for all causes.
+
+  \sa getInvalidationCauses()
+  \since Coin 4.1
+*/
+int
+SoGLCacheList::getNumInvalidations(void) const
+{
+  int num = 0;
+  for (int i = 0; i < PRIVATE(this)->invalidcounts.getLength(); i++) {
+    num += PRIVATE(this)->invalidcounts[i];
+  }
+  return num;
+}
+
+/*!
+  Returns the number of invalidations caused by \a elementtype.
+
+  A miss in call() is counted as an invalidation when there was a
+  cache for the current context which couldn't be used. The cause is
+  the element that didn't match in the most recently used of these
+  caches. If only the lazy GL state didn't match, the cause is
+  SoGLLazyElement. Changes in the scene graph below the node, which
+  invalidate all the caches through invalidateAll(), are counted
+  with SoType::badType() as the cause, also when the list holds no
+  caches at the time.
+
+  \since Coin 4.1
+*/
+int
+SoGLCacheList::getNumInvalidations(const SoType elementtype) const
+{
+  const int idx = PRIVATE(this)->invalidtypes.find(elementtype);
+  return idx >= 0 ? PRIVATE(this)->invalidcounts[idx] : 0;
+}
+
+/*!
+  Returns all the causes of invalidations in \a elementtypes, and the
+  number of invalidations for each in \a counts. The lists are
+  truncated before the causes are added.
+
+  \sa getNumInvalidations()
+  \since Coin 4.1
+*/
+void
+SoGLCacheList::getInvalidationCauses(SbList<SoType> & elementtypes,
+                                     SbList<int> & counts) const
+{
+  elementtypes = PRIVATE(this)->invalidtypes;
+  counts = PRIVATE(this)->invalidcounts;
+}
+
+/*!
+  Returns an estimate of the OpenGL memory used by the caches in the
+  list, in bytes. The estimate is based on the number of primitives
+  the shapes sent to OpenGL while the caches were recorded. Shapes
+  rendered from vertex buffer objects are not included, since their
+  vertex data isn't copied into the caches.
+
+  \since Coin 4.1
+*/
+size_t
+SoGLCacheList::getMemoryUsage(void) const
+{
+  return PRIVATE(this)->getMemoryUsage();
+}
+
+/*!
+  Resets the hit, miss, build and invalidation counters.
+
+  \since Coin 4.1
+*/
+void
+SoGLCacheList::resetStatistics(void)
+{
+  PRIVATE(this)->numhits = 0;
+  PRIVATE(this)->nummisses = 0;
+  PRIVATE(this)->numbuilt = 0;
+  PRIVATE(this)->numfailed = 0;
+  PRIVATE(this)->buildtime = SbTime::zero();
+  PRIVATE(this)->invalidtypes.truncate(0);
+  PRIVATE(this)->invalidcounts.truncate(0);
+}
+
+/*!
+  Sets a callback which decides whether a new cache should be
+  recorded, replacing the default caching heuristics for all cache
+  lists. The callback is called from open() with the list, the
+  action, whether the node is auto caching (SoSeparator::AUTO), and
+  what the default heuristics decided, and returns whether a cache
+  should be recorded. It can use the statistics of the list, e.g.
+  getNumValidFrames() and getNumInvalidations(), to make the
+  decision. Set \a func to \c NULL to use the default heuristics
+  again.
+
+  The callback is not called when a cache can't be recorded anyway:
+  when another cache is already being recorded, when the list holds
+  no caches (see SoSeparator::setNumRenderCaches()), or when auto
+  caching has been disabled with the COIN_AUTO_CACHING environment
+  variable and the node is auto caching.
+
+  \since Coin 4.1
+*/
+void
+SoGLCacheList::setCachePolicyCallback(SoGLCacheListPolicyCB * func, void * closure)
+{
+  SoGLCacheListP::policycb = func;
+  SoGLCacheListP::policyclosure = closure;
 }
 
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/elements/SoGLLazyElement.h>
+#include <Inventor/nodes/SoSeparator.h>
+
+BOOST_AUTO_TEST_CASE(initialStatistics)
+{
+  SoGLCacheList list(2);
+  BOOST_CHECK_EQUAL(list.getNumCaches(), 0);
+  BOOST_CHECK_EQUAL(list.getNumValidFrames(), 0);
+  BOOST_CHECK_EQUAL(list.getNumHits(), 0);
+  BOOST_CHECK_EQUAL(list.getNumMisses(), 0);
+  BOOST_CHECK_EQUAL(list.getNumBuilt(), 0);
+  BOOST_CHECK_EQUAL(list.getNumFailedBuilds(), 0);
+  BOOST_CHECK(list.getBuildTime() == SbTime::zero());
+  BOOST_CHECK_EQUAL(list.getNumInvalidations(), 0);
+  BOOST_CHECK_EQUAL(list.getMemoryUsage(), (size_t) 0);
+}
+
+BOOST_AUTO_TEST_CASE(invalidateAllCountsSceneGraphChanges)
+{
+  SoGLCacheList list(2);
+  for (int i = 0; i < 3; i++) list.invalidateAll();
+
+  BOOST_CHECK_EQUAL(list.getNumInvalidations(), 3);
+  BOOST_CHECK_EQUAL(list.getNumInvalidations(SoType::badType()), 3);
+  BOOST_CHECK_EQUAL(list.getNumInvalidations(SoGLLazyElement::getClassTypeId()), 0);
+  BOOST_CHECK_EQUAL(list.getNumCaches(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(invalidationCauses)
+{
+  SoGLCacheList list(2);
+  SbList<SoType> types;
+  SbList<int> counts;
+  types.append(SoGLLazyElement::getClassTypeId());
+  counts.append(7);
+
+  // the lists are truncated before the causes are added
+  list.getInvalidationCauses(types, counts);
+  BOOST_CHECK_EQUAL(types.getLength(), 0);
+  BOOST_CHECK_EQUAL(counts.getLength(), 0);
+
+  list.invalidateAll();
+  list.invalidateAll();
+  list.getInvalidationCauses(types, counts);
+  BOOST_REQUIRE_EQUAL(types.getLength(), 1);
+  BOOST_REQUIRE_EQUAL(counts.getLength(), 1);
+  BOOST_CHECK(types[0] == SoType::badType());
+  BOOST_CHECK_EQUAL(counts[0], 2);
+}
+
+BOOST_AUTO_TEST_CASE(resetStatistics)
+{
+  SoGLCacheList list(2);
+  list.invalidateAll();
+  list.resetStatistics();
+
+  BOOST_CHECK_EQUAL(list.getNumInvalidations(), 0);
+  BOOST_CHECK_EQUAL(list.getNumInvalidations(SoType::badType()), 0);
+  SbList<SoType> types;
+  SbList<int> counts;
+  list.getInvalidationCauses(types, counts);
+  BOOST_CHECK_EQUAL(types.getLength(), 0);
+  BOOST_CHECK_EQUAL(counts.getLength(), 0);
+  BOOST_CHECK_EQUAL(list.getNumHits(), 0);
+  BOOST_CHECK_EQUAL(list.getNumMisses(), 0);
+  BOOST_CHECK(list.getBuildTime() == SbTime::zero());
+
+  // counting starts over
+  list.invalidateAll();
+  BOOST_CHECK_EQUAL(list.getNumInvalidations(SoType::badType()), 1);
+}
+
+BOOST_AUTO_TEST_CASE(noListBeforeRendering)
+{
+  SoSeparator * sep = new SoSeparator;
+  sep->ref();
+  BOOST_CHECK(sep->getGLCacheList() == NULL);
+  sep->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -0,0 +1,867 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*!
+  \class SoInstanceCache
+  \brief The SoInstanceCache class holds the geometry of a subgraph for instanced rendering.
+
+  The cache is used by SoInstancedMultipleCopy. While it is being
+  built, SoShape adds the triangles of the shapes below the node
+  to the cache instead of rendering them. The triangles are stored
+  as an indexed vertex array relative to the model matrix at the
+  node. Triangles that use the diffuse color the node inherits are
+  kept apart from triangles with their own color, so that they can
+  be drawn with a per-instance color.
+
+  When the driver supports instanced arrays and GLSL vertex shaders,
+  all copies are drawn with a single glDrawElementsInstanced() call
+  per group. The per-instance matrices are passed as vertex attributes,
+  and a vertex shader emulates fixed function lighting. Otherwise the
+  copies are drawn in a loop, with one matrix multiplication and one
+  glDrawElements() call per copy.
+
+  Capturing is aborted if the subgraph contains geometry that can't
+  be handled, like lines, points, textures or transparency.
+*/
+
+#include "caches/SoInstanceCache.h"
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include <Inventor/SbColor.h>
+#include <Inventor/SbMatrix.h>
+#include <Inventor/SbVec3f.h>
+#include <Inventor/SoPrimitiveVertex.h>
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/C/tidbits.h>
+#include <Inventor/bundles/SoMaterialBundle.h>
+#include <Inventor/elements/SoClipPlaneElement.h>
+#include <Inventor/elements/SoGLCacheContextElement.h>
+#include <Inventor/elements/SoGLLazyElement.h>
+#include <Inventor/elements/SoGLLightIdElement.h>
+#include <Inventor/elements/SoGLShaderProgramElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoShapeStyleElement.h>
+#include <Inventor/errors/SoDebugError.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/misc/SoContextHandler.h>
+#include <Inventor/misc/SoGLDriverDatabase.h>
+#include <Inventor/misc/SoState.h>
+#include <Inventor/system/gl.h>
+
+#include "glue/glp.h"
+#include "misc/SbHash.h"
+#include "rendering/SoGL.h"
+#include "rendering/SoVBO.h"
+#include "shaders/SoGLShaderProgram.h"
+#include "threads/threadsutilp.h"
+#include "tidbitsp.h"
+
+// *************************************************************************
+
+// floats per instance in the instance data buffer: a 4x4 matrix, a
+// 3x3 normal matrix and an RGBA color
+static const int INSTANCE_STRIDE = 16 + 9 + 4;
+// the fixed function lighting emulation handles this many lights
+static const int INSTANCE_MAX_LIGHTS = 8;
+
+// vertex shader used when rendering with instanced arrays. The
+// lighting follows the fixed function pipeline, with the diffuse
+// color taken from the color array or the instance color.
+static const char INSTANCE_VERTEX_SHADER[] =
+  "#version 110\n"
+  "attribute vec4 coin_instance0;\n"
+  "attribute vec4 coin_instance1;\n"
+  "attribute vec4 coin_instance2;\n"
+  "attribute vec4 coin_instance3;\n"
+  "attribute vec3 coin_instancenormal0;\n"
+  "attribute vec3 coin_instancenormal1;\n"
+  "attribute vec3 coin_instancenormal2;\n"
+  "attribute vec4 coin_instancecolor;\n"
+  "uniform bool coin_useinstancecolor;\n"
+  "uniform bool coin_lighting;\n"
+  "uniform bool coin_twoside;\n"
+  "uniform int coin_numlights;\n"
+  "\n"
+  "vec4 coin_light(vec3 n, vec3 ecpos, vec4 diffuse)\n"
+  "{\n"
+  "  vec4 color = gl_FrontMaterial.emission +\n"
+  "    gl_FrontMaterial.ambient * gl_LightModel.ambient;\n"
+  "  for (int i = 0; i < 8; i++) {\n"
+  "    if (i >= coin_numlights) break;\n"
+  "    vec3 l;\n"
+  "    float att = 1.0;\n"
+  "    if (gl_LightSource[i].position.w == 0.0) {\n"
+  "      l = normalize(gl_LightSource[i].position.xyz);\n"
+  "    }\n"
+  "    else {\n"
+  "      vec3 d = gl_LightSource[i].position.xyz - ecpos;\n"
+  "      float dist = length(d);\n"
+  "      l = d / dist;\n"
+  "      att = 1.0 / (gl_LightSource[i].constantAttenuation +\n"
+  "                   gl_LightSource[i].linearAttenuation * dist +\n"
+  "                   gl_LightSource[i].quadraticAttenuation * dist * dist);\n"
+  "      if (gl_LightSource[i].spotCutoff <= 90.0) {\n"
+  "        float spot = dot(-l, normalize(gl_LightSource[i].spotDirection));\n"
+  "        att *= (spot < gl_LightSource[i].spotCosCutoff) ? 0.0 :\n"
+  "          pow(spot, gl_LightSource[i].spotExponent);\n"
+  "      }\n"
+  "    }\n"
+  "    float ndotl = max(dot(n, l), 0.0);\n"
+  "    vec4 c = gl_FrontMaterial.ambient * gl_LightSource[i].ambient +\n"
+  "      diffuse * gl_LightSource[i].diffuse * ndotl;\n"
+  "    if (ndotl > 0.0) {\n"
+  "      vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+  "      c += gl_FrontMaterial.specular * gl_LightSource[i].specular *\n"
+  "        pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess);\n"
+  "    }\n"
+  "    color += att * c;\n"
+  "  }\n"
+  "  color.a = diffuse.a;\n"
+  "  return color;\n"
+  "}\n"
+  "\n"
+  "void main(void)\n"
+  "{\n"
+  "  mat4 instance = mat4(coin_instance0, coin_instance1,\n"
+  "                      coin_instance2, coin_instance3);\n"
+  "  mat3 instancenormal = mat3(coin_instancenormal0, coin_instancenormal1,\n"
+  "                            coin_instancenormal2);\n"
+  "  vec4 ecpos = gl_ModelViewMatrix * (instance * gl_Vertex);\n"
+  "  vec4 diffuse = coin_useinstancecolor ? coin_instancecolor : gl_Color;\n"
+  "  if (coin_lighting) {\n"
+  "    vec3 n = normalize(gl_NormalMatrix * (instancenormal * gl_Normal));\n"
+  "    gl_FrontColor = coin_light(n, ecpos.xyz, diffuse);\n"
+  "    if (coin_twoside) gl_BackColor = coin_light(-n, ecpos.xyz, diffuse);\n"
+  "  }\n"
+  "  else {\n"
+  "    gl_FrontColor = diffuse;\n"
+  "    gl_BackColor = diffuse;\n"
+  "  }\n"
+  "  gl_FogFragCoord = abs(ecpos.z);\n"
+  "#ifdef COIN_CLIPVERTEX\n"
+  "  gl_ClipVertex = ecpos;\n"
+  "#endif\n"
+  "  gl_Position = gl_ProjectionMatrix * ecpos;\n"
+  "}\n";
+
+static const char * INSTANCE_ATTRIBUTE_NAMES[] = {
+  "coin_instance0", "coin_instance1", "coin_instance2", "coin_instance3",
+  "coin_instancenormal0", "coin_instancenormal1", "coin_instancenormal2",
+  "coin_instancecolor"
+};
+static const int INSTANCE_NUM_ATTRIBUTES = 8;
+
+#ifndef GL_VERTEX_PROGRAM_TWO_SIDE
+#define GL_VERTEX_PROGRAM_TWO_SIDE 0x8643
+#endif // GL_VERTEX_PROGRAM_TWO_SIDE
+
+// *************************************************************************
+
+// The shader program for one context. Programs are shared by all
+// instance caches, and are deleted when the context is destructed.
+struct soinstance_program {
+  COIN_GLhandle program;
+  GLint attributes[INSTANCE_NUM_ATTRIBUTES];
+  GLint useinstancecolor;
+  GLint lighting;
+  GLint twoside;
+  GLint numlights;
+  SbBool valid;
+};
+
+static SbHash<uint32_t, soinstance_program *> * soinstance_programs = NULL;
+
+static void
+soinstance_atexit_cleanup(void)
+{
+  for (SbHash<uint32_t, soinstance_program *>::const_iterator iter =
+         soinstance_programs->const_begin();
+       iter != soinstance_programs->const_end(); ++iter) {
+    delete iter->obj;
+  }
+  delete soinstance_programs;
+  soinstance_programs = NULL;
+}
+
+static void
+soinstance_context_destruction_cb(uint32_t contextid, void * COIN_UNUSED_ARG(closure))
+{
+  CC_GLOBAL_LOCK;
+  if (soinstance_programs) {
+    const cc_glglue * glue = cc_glglue_instance(static_cast<int>(contextid));
+    for (uint32_t clipvariant = 0; clipvariant < 2; clipvariant++) {
+      const uint32_t key = (contextid << 1) | clipvariant;
+      soinstance_program * p;
+      if (soinstance_programs->get(key, p)) {
+        if (p->valid) glue->glDeleteObjectARB(p->program);
+        soinstance_programs->erase(key);
+        delete p;
+      }
+    }
+  }
+  CC_GLOBAL_UNLOCK;
+}
+
+static SbBool
+soinstance_compile_ok(const cc_glglue * glue, COIN_GLhandle handle, GLenum pname)
+{
+  GLint flag = 0;
+  glue->glGetObjectParameterivARB(handle, pname, &flag);
+  if (!flag) {
+    GLint length = 0;
+    glue->glGetObjectParameterivARB(handle, GL_OBJECT_INFO_LOG_LENGTH_ARB, &length);
+    if (length > 1) {
+      std::vector<COIN_GLchar> log(length);
+      GLsizei written = 0;
+      glue->glGetInfoLogARB(handle, length, &written, &log[0]);
+      SoDebugError::postWarning("SoInstanceCache::render",
+                                "Couldn't build instancing shader: '%s'", &log[0]);
+    }
+  }
+  return flag != 0;
+}
+
+// Returns the instancing program for the current context, building
+// it the first time. Returns NULL if the program failed to build.
+static const soinstance_program *
+soinstance_get_program(const cc_glglue * glue, const uint32_t contextid,
+                       const SbBool clipvertex)
+{
+  const uint32_t key = (contextid << 1) | (clipvertex ? 1 : 0);
+  soinstance_program * p = NULL;
+
+  CC_GLOBAL_LOCK;
+  if (soinstance_programs == NULL) {
+    soinstance_programs = new SbHash<uint32_t, soinstance_program *>(4);
+    coin_atexit(soinstance_atexit_cleanup, CC_ATEXIT_NORMAL);
+    SoContextHandler::addContextDestructionCallback(soinstance_context_destruction_cb, NULL);
+  }
+  if (!soinstance_programs->get(key, p)) {
+    p = new soinstance_program;
+    soinstance_program & newprogram = *p;
+    newprogram.valid = FALSE;
+    newprogram.program = 0;
+
+    // the define must come after the #version directive
+    SbString src(INSTANCE_VERTEX_SHADER);
+    if (clipvertex) {
+      const int end = src.find("\n");
+      src = src.getSubString(0, end - 1) + "\n#define COIN_CLIPVERTEX\n" +
+        src.getSubString(end + 1);
+    }
+    const char * srcptr = src.getString();
+
+    COIN_GLhandle shader = glue->glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
+    if (shader) {
+      glue->glShaderSourceARB(shader, 1, (const COIN_GLchar **)&srcptr, NULL);
+      glue->glCompileShaderARB(shader);
+      if (soinstance_compile_ok(glue, shader, GL_OBJECT_COMPILE_STATUS_ARB)) {
+        COIN_GLhandle program = glue->glCreateProgramObjectARB();
+        glue->glAttachObjectARB(program, shader);
+        glue->glLinkProgramARB(program);
+        if (soinstance_compile_ok(glue, program, GL_OBJECT_LINK_STATUS_ARB)) {
+          newprogram.program = program;
+          newprogram.valid = TRUE;
+          for (int i = 0; i < INSTANCE_NUM_ATTRIBUTES; i++) {
+            newprogram.attributes[i] =
+              glue->glGetAttribLocationARB(program, INSTANCE_ATTRIBUTE_NAMES[i]);
+            if (newprogram.attributes[i] < 0) newprogram.valid = FALSE;
+          }
+          newprogram.useinstancecolor =
+            glue->glGetUniformLocationARB(program, "coin_useinstancecolor");
+          newprogram.lighting = glue->glGetUniformLocationARB(program, "coin_lighting");
+          newprogram.twoside = glue->glGetUniformLocationARB(program, "coin_twoside");
+          newprogram.numlights = glue->glGetUniformLocationARB(program, "coin_numlights");
+        }
+        if (!newprogram.valid) glue->glDeleteObjectARB(program);
+      }
+      // the shader is deleted along with the program
+      glue->glDeleteObjectARB(shader);
+    }
+    soinstance_programs->put(key, p);
+  }
+  CC_GLOBAL_UNLOCK;
+  return p->valid ? p : NULL;
+}
+
+// *************************************************************************
+
+class SoInstanceCacheP {
+public:
+  SoInstanceCacheP(void)
+    : vertexlist(256),
+      normallist(256),
+      rgbalist(256),
+      vhash(1024),
+      capturing(FALSE),
+      aborted(FALSE),
+      twoside(FALSE),
+      inheritedptr(NULL),
+      vertexvbo(NULL),
+      normalvbo(NULL),
+      rgbavbo(NULL),
+      instancevbo(NULL),
+      instancedataid(0),
+      numinstances(0)
+  {
+    this->indexvbo[0] = this->indexvbo[1] = NULL;
+  }
+
+  class Vertex {
+  public:
+    SbVec3f vertex;
+    SbVec3f normal;
+    uint8_t rgba[4];
+
+    // needed for SbHash
+    operator unsigned long(void) const;
+
+    // needed, since if we don't add this the unsigned long operator
+    // will be used when comparing two vertices.
+    int operator==(const Vertex & v);
+  };
+
+  SbList <SbVec3f> vertexlist;
+  SbList <SbVec3f> normallist;
+  SbList <uint8_t> rgbalist;
+  // indices of the triangles with their own color (0), and of the
+  // triangles using the inherited or per-instance color (1)
+  SbList <GLuint> indices[2];
+  SbHash<Vertex, int32_t> vhash;
+
+  SbBool capturing;
+  SbBool aborted;
+  SbBool twoside;
+  SbMatrix invbasematrix;
+  SbMatrix lastmatrix;
+  SbMatrix lastnormalmatrix;
+  const void * inheritedptr;
+
+  SoVBO * vertexvbo;
+  SoVBO * normalvbo;
+  SoVBO * rgbavbo;
+  SoVBO * indexvbo[2];
+  SoVBO * instancevbo;
+  SbUniqueId instancedataid;
+  int numinstances;
+  // the inherited color, restored after the color array has been used
+  SbColor inheritedcolor;
+
+  void addVertex(const Vertex & v, const int group);
+  void enableArrays(const cc_glglue * glue, const uint32_t contextid,
+                    const SbBool usevbo);
+  void disableArrays(const cc_glglue * glue, const SbBool usevbo);
+  void drawElements(const cc_glglue * glue, const uint32_t contextid,
+                    const int group, const SbBool usevbo, const int numinstances);
+  void renderLoop(const cc_glglue * glue, const uint32_t contextid,
+                  const SbBool usevbo, const SbMatrix * matrices,
+                  const SbColor * colors, const int numinstances);
+  void renderInstanced(SoState * state, const cc_glglue * glue,
+                       const uint32_t contextid, const soinstance_program * program,
+                       const SbMatrix * matrices, const SbColor * colors,
+                       const int numinstances, const SbUniqueId dataid);
+};
+
+#define PRIVATE(obj) ((obj)->pimpl)
+
+// *************************************************************************
+
+/*!
+  Constructor.
+*/
+SoInstanceCache::SoInstanceCache(SoState * state)
+  : SoCache(state)
+{
+  PRIVATE(this) = new SoInstanceCacheP;
+}
+
+/*!
+  Destructor.
+*/
+SoInstanceCache::~SoInstanceCache()
+{
+  if (PRIVATE(this)->capturing) soshape_set_instance_capture(NULL);
+  delete PRIVATE(this)->vertexvbo;
+  delete PRIVATE(this)->normalvbo;
+  delete PRIVATE(this)->rgbavbo;
+  delete PRIVATE(this)->indexvbo[0];
+  delete PRIVATE(this)->indexvbo[1];
+  delete PRIVATE(this)->instancevbo;
+  delete PRIVATE(this);
+}
+
+/*!
+  Starts capturing triangles. The current model matrix is used as
+  the base for the instance matrices.
+*/
+void
+SoInstanceCache::beginCapture(SoState * state)
+{
+  // don't use SoModelMatrixElement::get(), since it would make the
+  // cache depend on the placement of the node
+  const SoModelMatrixElement * mmelem = static_cast<const SoModelMatrixElement *>
+    (state->getElementNoPush(SoModelMatrixElement::getClassStackIndex()));
+  const SbMatrix & base = mmelem->getModelMatrix();
+  if (fabs(base.det3()) < 1e-12f) {
+    PRIVATE(this)->aborted = TRUE;
+    return;
+  }
+  PRIVATE(this)->invbasematrix = base.inverse();
+  PRIVATE(this)->lastmatrix = SbMatrix::identity();
+  PRIVATE(this)->lastnormalmatrix = SbMatrix::identity();
+
+  const SoLazyElement * lelem = SoLazyElement::getInstance(state);
+  PRIVATE(this)->inheritedptr = lelem->isPacked() ?
+    static_cast<const void *>(lelem->getPackedPointer()) :
+    static_cast<const void *>(lelem->getDiffusePointer());
+
+  PRIVATE(this)->capturing = TRUE;
+  soshape_set_instance_capture(this);
+}
+
+/*!
+  Adds a triangle generated by a shape while capturing.
+*/
+void
+SoInstanceCache::addTriangle(SoState * state,
+                             const SoPrimitiveVertex * v0,
+                             const SoPrimitiveVertex * v1,
+                             const SoPrimitiveVertex * v2)
+{
+  if (PRIVATE(this)->aborted) return;
+
+  const SoModelMatrixElement * mmelem = static_cast<const SoModelMatrixElement *>
+    (state->getElementNoPush(SoModelMatrixElement::getClassStackIndex()));
+  SbMatrix m = mmelem->getModelMatrix();
+  m.multRight(PRIVATE(this)->invbasematrix);
+  if (m != PRIVATE(this)->lastmatrix) {
+    PRIVATE(this)->lastmatrix = m;
+    PRIVATE(this)->lastnormalmatrix = m.inverse().transpose();
+  }
+  const SbMatrix & nm = PRIVATE(this)->lastnormalmatrix;
+
+  const SoLazyElement * lelem = SoLazyElement::getInstance(state);
+  const SbBool packed = lelem->isPacked();
+  const void * colorptr = packed ?
+    static_cast<const void *>(lelem->getPackedPointer()) :
+    static_cast<const void *>(lelem->getDiffusePointer());
+  const int numdiffuse = lelem->getNumDiffuse();
+  const int group = (colorptr == PRIVATE(this)->inheritedptr) ? 1 : 0;
+
+  PRIVATE(this)->twoside |= SoLazyElement::getTwoSidedLighting(state);
+
+  const SoPrimitiveVertex * vp[3] = { v0, v1, v2 };
+  for (int i = 0; i < 3; i++) {
+    SoInstanceCacheP::Vertex v;
+    m.multVecMatrix(vp[i]->getPoint(), v.vertex);
+    nm.multDirMatrix(vp[i]->getNormal(), v.normal);
+    (void) v.normal.normalize();
+
+    const int midx = vp[i]->getMaterialIndex();
+    if (group == 1) {
+      // the instance color replaces the inherited color, so a
+      // material index into it can't be honored
+      if (midx != 0 && numdiffuse > 1) {
+        PRIVATE(this)->aborted = TRUE;
+        return;
+      }
+      v.rgba[0] = v.rgba[1] = v.rgba[2] = v.rgba[3] = 0;
+    }
+    else {
+      uint32_t col;
+      if (packed) {
+        col = lelem->getPackedPointer()[SbClamp(midx, 0, numdiffuse-1)];
+      }
+      else {
+        const int numtransp = lelem->getNumTransparencies();
+        SbColor tmpc = lelem->getDiffusePointer()[SbClamp(midx, 0, numdiffuse-1)];
+        float tmpt = lelem->getTransparencyPointer()[SbClamp(midx, 0, numtransp-1)];
+        col = tmpc.getPackedValue(tmpt);
+      }
+      v.rgba[0] = col>>24;
+      v.rgba[1] = (col>>16)&0xff;
+      v.rgba[2] = (col>>8)&0xff;
+      v.rgba[3] = col&0xff;
+    }
+    PRIVATE(this)->addVertex(v, group);
+  }
+}
+
+/*!
+  Aborts the capture. The cache will not be renderable, and the
+  node using it should fall back to normal traversal.
+*/
+void
+SoInstanceCache::abortCapture(void)
+{
+  PRIVATE(this)->aborted = TRUE;
+}
+
+/*!
+  Ends the capture.
+*/
+void
+SoInstanceCache::endCapture(void)
+{
+  if (PRIVATE(this)->capturing) {
+    soshape_set_instance_capture(NULL);
+    PRIVATE(this)->capturing = FALSE;
+  }
+  PRIVATE(this)->vhash.clear();
+  if (PRIVATE(this)->aborted) {
+    PRIVATE(this)->vertexlist.truncate(0, TRUE);
+    PRIVATE(this)->normallist.truncate(0, TRUE);
+    PRIVATE(this)->rgbalist.truncate(0, TRUE);
+    PRIVATE(this)->indices[0].truncate(0, TRUE);
+    PRIVATE(this)->indices[1].truncate(0, TRUE);
+  }
+  else {
+    PRIVATE(this)->vertexlist.fit();
+    PRIVATE(this)->normallist.fit();
+    PRIVATE(this)->rgbalist.fit();
+    PRIVATE(this)->indices[0].fit();
+    PRIVATE(this)->indices[1].fit();
+  }
+}
+
+/*!
+  Returns \c TRUE if the capture completed without being aborted.
+  An empty cache is renderable.
+*/
+SbBool
+SoInstanceCache::isRenderable(void) const
+{
+  return !PRIVATE(this)->aborted && !PRIVATE(this)->capturing;
+}
+
+/*!
+  Returns the number of triangles in the cache.
+*/
+int
+SoInstanceCache::getNumTriangles(void) const
+{
+  return (PRIVATE(this)->indices[0].getLength() +
+          PRIVATE(this)->indices[1].getLength()) / 3;
+}
+
+/*!
+  Renders \a numinstances copies of the cached geometry, with
+  \a matrices multiplied onto the current model matrix. The inherited
+  diffuse color is replaced by \a colors, if not \c NULL. \a instancedataid
+  must change whenever the matrices or colors change.
+
+  Returns \c FALSE if the geometry couldn't be rendered, in which
+  case the caller should render the copies by traversing them.
+*/
+SbBool
+SoInstanceCache::render(SoGLRenderAction * action,
+                        const SbMatrix * matrices,
+                        const SbColor * colors,
+                        const int numinstances,
+                        const SbUniqueId instancedataid)
+{
+  if (!this->isRenderable()) return FALSE;
+  if (numinstances == 0 || this->getNumTriangles() == 0) return TRUE;
+
+  SoState * state = action->getState();
+  const cc_glglue * glue = sogl_glue_instance(state);
+  if (!SoGLDriverDatabase::isSupported(glue, SO_GL_VERTEX_ARRAY)) return FALSE;
+  const uint32_t contextid = SoGLCacheContextElement::get(state);
+
+  state->push();
+  if (PRIVATE(this)->twoside) SoLazyElement::setTwosideLighting(state, TRUE);
+  SoMaterialBundle mb(action);
+  mb.sendFirst();
+
+  const SbBool usevbo =
+    SoGLDriverDatabase::isSupported(glue, SO_GL_VERTEX_BUFFER_OBJECT);
+
+  const soinstance_program * program = NULL;
+  if (usevbo &&
+      cc_glglue_has_instanced_arrays(glue) &&
+      SoGLDriverDatabase::isSupported(glue, SO_GL_ARB_SHADER_OBJECT) &&
+      SoGLDriverDatabase::isSupported(glue, SO_GL_ARB_VERTEX_SHADER) &&
+      (SoShapeStyleElement::getTransparencyType(state) !=
+       SoGLRenderAction::SORTED_LAYERS_BLEND) &&
+      (SoGLLightIdElement::get(state) + 1 <= INSTANCE_MAX_LIGHTS)) {
+    SoGLShaderProgram * userprogram = SoGLShaderProgramElement::get(state);
+    const SbBool clipping = SoClipPlaneElement::getInstance(state)->getNum() > 0;
+    if ((userprogram == NULL || !userprogram->isEnabled()) &&
+        (!clipping || SoGLDriverDatabase::isSupported(glue, SO_GL_GLSL_CLIP_VERTEX_HW))) {
+      program = soinstance_get_program(glue, contextid, clipping);
+    }
+  }
+
+  glPushAttrib(GL_ENABLE_BIT);
+  if (program) {
+    PRIVATE(this)->renderInstanced(state, glue, contextid, program,
+                                   matrices, colors, numinstances, instancedataid);
+  }
+  else {
+    // instance matrices might scale the geometry
+    glEnable(GL_NORMALIZE);
+    PRIVATE(this)->inheritedcolor = SoLazyElement::getDiffuse(state, 0);
+    PRIVATE(this)->renderLoop(glue, contextid, usevbo, matrices, colors, numinstances);
+  }
+  glPopAttrib();
+
+  // inform SoGLLazyElement that we have changed the current color
+  SoGLLazyElement::getInstance(state)->reset(state, SoLazyElement::DIFFUSE_MASK);
+  state->pop();
+  return TRUE;
+}
+
+// *************************************************************************
+
+void
+SoInstanceCacheP::addVertex(const Vertex & v, const int group)
+{
+  int32_t idx;
+  if (!this->vhash.get(v, idx)) {
+    idx = this->vertexlist.getLength();
+    this->vhash.put(v, idx);
+    this->vertexlist.append(v.vertex);
+    this->normallist.append(v.normal);
+    for (int i = 0; i < 4; i++) this->rgbalist.append(v.rgba[i]);
+  }
+  this->indices[group].append(static_cast<GLuint>(idx));
+}
+
+void
+SoInstanceCacheP::enableArrays(const cc_glglue * glue, const uint32_t contextid,
+                               const SbBool usevbo)
+{
+  if (usevbo) {
+    if (this->vertexvbo == NULL) {
+      this->vertexvbo = new SoVBO;
+      this->vertexvbo->setBufferData(this->vertexlist.getArrayPtr(),
+                                     this->vertexlist.getLength() * sizeof(SbVec3f));
+      this->normalvbo = new SoVBO;
+      this->normalvbo->setBufferData(this->normallist.getArrayPtr(),
+                                     this->normallist.getLength() * sizeof(SbVec3f));
+      this->rgbavbo = new SoVBO;
+      this->rgbavbo->setBufferData(this->rgbalist.getArrayPtr(),
+                                   this->rgbalist.getLength() * sizeof(uint8_t));
+      for (int i = 0; i < 2; i++) {
+        if (this->indices[i].getLength()) {
+          this->indexvbo[i] = new SoVBO(GL_ELEMENT_ARRAY_BUFFER);
+          this->indexvbo[i]->setBufferData(this->indices[i].getArrayPtr(),
+                                           this->indices[i].getLength() * sizeof(GLuint));
+        }
+      }
+    }
+    this->vertexvbo->bindBuffer(contextid);
+    cc_glglue_glVertexPointer(glue, 3, GL_FLOAT, 0, NULL);
+    this->normalvbo->bindBuffer(contextid);
+    cc_glglue_glNormalPointer(glue, GL_FLOAT, 0, NULL);
+    this->rgbavbo->bindBuffer(contextid);
+    cc_glglue_glColorPointer(glue, 4, GL_UNSIGNED_BYTE, 0, NULL);
+  }
+  else {
+    cc_glglue_glVertexPointer(glue, 3, GL_FLOAT, 0,
+                              this->vertexlist.getArrayPtr());
+    cc_glglue_glNormalPointer(glue, GL_FLOAT, 0,
+                              this->normallist.getArrayPtr());
+    cc_glglue_glColorPointer(glue, 4, GL_UNSIGNED_BYTE, 0,
+                             this->rgbalist.getArrayPtr());
+  }
+  cc_glglue_glEnableClientState(glue, GL_VERTEX_ARRAY);
+  cc_glglue_glEnableClientState(glue, GL_NORMAL_ARRAY);
+}
+
+void
+SoInstanceCacheP::disableArrays(const cc_glglue * glue, const SbBool usevbo)
+{
+  cc_glglue_glDisableClientState(glue, GL_COLOR_ARRAY);
+  cc_glglue_glDisableClientState(glue, GL_NORMAL_ARRAY);
+  cc_glglue_glDisableClientState(glue, GL_VERTEX_ARRAY);
+  if (usevbo) {
+    cc_glglue_glBindBuffer(glue, GL_ARRAY_BUFFER, 0);
+    cc_glglue_glBindBuffer(glue, GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
+}
+
+void
+SoInstanceCacheP::drawElements(const cc_glglue * glue, const uint32_t contextid,
+                               const int group, const SbBool usevbo,
+                               const int numinstances)
+{
+  const GLsizei n = this->indices[group].getLength();
+  const GLvoid * ptr = NULL;
+  if (usevbo) this->indexvbo[group]->bindBuffer(contextid);
+  else ptr = this->indices[group].getArrayPtr();
+
+  if (numinstances > 0) {
+    cc_glglue_glDrawElementsInstanced(glue, GL_TRIANGLES, n, GL_UNSIGNED_INT,
+                                      ptr, numinstances);
+  }
+  else {
+    cc_glglue_glDrawElements(glue, GL_TRIANGLES, n, GL_UNSIGNED_INT, ptr);
+  }
+}
+
+// Renders the copies one by one. Used when instanced arrays or
+// shaders aren't available.
+void
+SoInstanceCacheP::renderLoop(const cc_glglue * glue, const uint32_t contextid,
+                             const SbBool usevbo, const SbMatrix * matrices,
+                             const SbColor * colors, const int numinstances)
+{
+  this->enableArrays(glue, contextid, usevbo);
+  // render the triangles with the inherited color last, since the
+  // color array leaves the current color undefined
+  for (int group = 0; group < 2; group++) {
+    if (this->indices[group].getLength() == 0) continue;
+    if (group == 0) cc_glglue_glEnableClientState(glue, GL_COLOR_ARRAY);
+    else {
+      cc_glglue_glDisableClientState(glue, GL_COLOR_ARRAY);
+      if (this->indices[0].getLength() && !colors) {
+        glColor3fv(this->inheritedcolor.getValue());
+      }
+    }
+    for (int i = 0; i < numinstances; i++) {
+      glPushMatrix();
+      glMultMatrixf(matrices[i][0]);
+      if (group == 1 && colors) glColor3fv(colors[i].getValue());
+      this->drawElements(glue, contextid, group, usevbo, 0);
+      glPopMatrix();
+    }
+  }
+  this->disableArrays(glue, usevbo);
+}
+
+// Renders all copies with one instanced draw per color group.
+void
+SoInstanceCacheP::renderInstanced(SoState * state, const cc_glglue * glue,
+                                  const uint32_t contextid,
+                                  const soinstance_program * program,
+                                  const SbMatrix * matrices, const SbColor * colors,
+                                  const int numinstances, const SbUniqueId dataid)
+{
+  if (this->instancevbo == NULL) this->instancevbo = new SoVBO;
+  if (this->instancedataid != dataid || this->numinstances != numinstances) {
+    GLfloat * data = static_cast<GLfloat *>
+      (this->instancevbo->allocBufferData(numinstances * INSTANCE_STRIDE * sizeof(GLfloat),
+                                          dataid));
+    for (int i = 0; i < numinstances; i++) {
+      GLfloat * dst = data + i * INSTANCE_STRIDE;
+      const SbMatrix & m = matrices[i];
+      for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) *dst++ = m[r][c];
+      }
+      const SbMatrix inv = m.inverse();
+      for (int c = 0; c < 3; c++) {
+        for (int r = 0; r < 3; r++) *dst++ = inv[r][c];
+      }
+      const SbColor col = colors ? colors[i] : SbColor(1.0f, 1.0f, 1.0f);
+      *dst++ = col[0];
+      *dst++ = col[1];
+      *dst++ = col[2];
+      *dst++ = 1.0f;
+    }
+    this->instancedataid = dataid;
+    this->numinstances = numinstances;
+  }
+
+  const GLint * attr = program->attributes;
+  const GLsizei stride = INSTANCE_STRIDE * sizeof(GLfloat);
+  this->instancevbo->bindBuffer(contextid);
+  for (int i = 0; i < INSTANCE_NUM_ATTRIBUTES; i++) {
+    const int offset = (i < 4) ? i * 4 : ((i < 7) ? 16 + (i - 4) * 3 : 25);
+    const int size = (i >= 4 && i < 7) ? 3 : 4;
+    cc_glglue_glVertexAttribPointer(glue, attr[i], size, GL_FLOAT, GL_FALSE, stride,
+                                    reinterpret_cast<const GLvoid *>(offset * sizeof(GLfloat)));
+    cc_glglue_glEnableVertexAttribArray(glue, attr[i]);
+    cc_glglue_glVertexAttribDivisor(glue, attr[i], 1);
+  }
+
+  this->enableArrays(glue, contextid, TRUE);
+
+  glue->glUseProgramObjectARB(program->program);
+  glue->glUniform1iARB(program->lighting,
+                       SoLazyElement::getLightModel(state) != SoLazyElement::BASE_COLOR);
+  glue->glUniform1iARB(program->twoside, this->twoside);
+  glue->glUniform1iARB(program->numlights, SoGLLightIdElement::get(state) + 1);
+  if (this->twoside) glEnable(GL_VERTEX_PROGRAM_TWO_SIDE);
+
+  if (this->indices[0].getLength()) {
+    glue->glUniform1iARB(program->useinstancecolor, FALSE);
+    cc_glglue_glEnableClientState(glue, GL_COLOR_ARRAY);
+    this->drawElements(glue, contextid, 0, TRUE, numinstances);
+    cc_glglue_glDisableClientState(glue, GL_COLOR_ARRAY);
+  }
+  if (this->indices[1].getLength()) {
+    glue->glUniform1iARB(program->useinstancecolor, colors != NULL);
+    this->drawElements(glue, contextid, 1, TRUE, numinstances);
+  }
+  glue->glUseProgramObjectARB(0);
+
+  for (int i = 0; i < INSTANCE_NUM_ATTRIBUTES; i++) {
+    cc_glglue_glVertexAttribDivisor(glue, attr[i], 0);
+    cc_glglue_glDisableVertexAttribArray(glue, attr[i]);
+  }
+  this->disableArrays(glue, TRUE);
+}
+
+// *************************************************************************
+
+SoInstanceCacheP::Vertex::operator unsigned long(void) const
+{
+  unsigned long key = 0;
+  // create an xor key based on the coordinates and normal
+  const unsigned char * ptr = reinterpret_cast<const unsigned char *>(this);
+  const unsigned char * stop = reinterpret_cast<const unsigned char *>(&this->rgba);
+  const ptrdiff_t size = stop-ptr;
+
+  for (int i = 0; i < size; i++) {
+    int shift = (i%4) * 8;
+    key ^= (ptr[i]<<shift);
+  }
+  return key;
+}
+
+int
+SoInstanceCacheP::Vertex::operator==(const Vertex & v)
+{
+  return
+    (this->vertex == v.vertex) &&
+    (this->normal == v.normal) &&
+    (this->rgba[0] == v.rgba[0]) &&
+    (this->rgba[1] == v.rgba[1]) &&
+    (this->rgba[2] == v.rgba[2]) &&
+    (this->rgba[3] == v.rgba[3]);
+}
+
+#undef PRIVATE
@@ -0,0 +1,82 @@
+#ifndef COIN_SOINSTANCECACHE_H
+#define COIN_SOINSTANCECACHE_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif /* !COIN_INTERNAL */
+
+#include <Inventor/caches/SoCache.h>
+#include <Inventor/SbBasic.h>
+
+class SbColor;
+class SbMatrix;
+class SoGLRenderAction;
+class SoPrimitiveVertex;
+class SoInstanceCacheP;
+
+class SoInstanceCache : public SoCache {
+  typedef SoCache inherited;
+public:
+  SoInstanceCache(SoState * state);
+  virtual ~SoInstanceCache();
+
+  void beginCapture(SoState * state);
+  void addTriangle(SoState * state,
+                   const SoPrimitiveVertex * v0,
+                   const SoPrimitiveVertex * v1,
+                   const SoPrimitiveVertex * v2);
+  void abortCapture(void);
+  void endCapture(void);
+
+  SbBool isRenderable(void) const;
+  int getNumTriangles(void) const;
+
+  SbBool render(SoGLRenderAction * action,
+                const SbMatrix * matrices,
+                const SbColor * colors,
+                const int numinstances,
+                const SbUniqueId instancedataid);
+
+private:
+  SoInstanceCacheP * pimpl;
+};
+
+// Returns the instance cache that shapes should add their triangles
+// to instead of rendering, or NULL when no instance geometry is being
+// captured in this thread. Implemented in SoShape.cpp.
+SoInstanceCache * soshape_instance_capture(void);
+void soshape_set_instance_capture(SoInstanceCache * cache);
+
+#endif // COIN_SOINSTANCECACHE_H
@@ -0,0 +1,609 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*!
+  \class SoPrimitiveBVHCache SoPrimitiveBVHCache.h
+  \brief The SoPrimitiveBVHCache class caches a bounding volume hierarchy over a shape's triangles.
+
+  \ingroup caches
+
+  The cache is used by SoShape::rayPick() to avoid testing the ray
+  against every triangle of shapes with many triangles. The triangles
+  generated by the shape are stored together with the data needed to
+  create the picked points, and a bounding volume hierarchy is built
+  over them using binned surface area heuristic splits.
+
+  The hierarchy is stored as a flat array of nodes in depth-first
+  order, so that the left child of an inner node is the node right
+  after it, and the triangles are reordered so that the triangles of
+  each leaf are stored next to each other.
+
+  Like the SoBoundingBoxCache, the cache depends on the elements read
+  while the triangles were generated, and must be checked for
+  validity before it is used.
+*/
+
+#include "caches/SoPrimitiveBVHCache.h"
+
+#include <cfloat>
+#include <algorithm>
+
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbLine.h>
+#include <Inventor/SoPrimitiveVertex.h>
+#include <Inventor/details/SoFaceDetail.h>
+#include <Inventor/details/SoPointDetail.h>
+
+#include "coindefs.h"
+
+// *************************************************************************
+
+namespace {
+
+  // number of bins used when searching for a split
+  const int NUM_BINS = 16;
+  // never create leaves with more triangles than this
+  const int MAX_LEAF_SIZE = 8;
+  // the cost of traversing a node relative to testing a triangle
+  const float TRAVERSAL_COST = 1.0f;
+
+  // A node is 32 bytes. For a leaf, the triangles are [offset,
+  // offset+count). An inner node has count == 0, the left child
+  // right after it and the right child at offset.
+  struct BVHNode {
+    float bmin[3];
+    float bmax[3];
+    int32_t offset;
+    uint16_t count;
+    uint16_t axis;
+  };
+
+  struct BuildItem {
+    int begin, end;
+    int parent; // parent node for right children, -1 otherwise
+  };
+
+  struct BuildBin {
+    SbBox3f box;
+    int count;
+  };
+
+  struct TriangleHit {
+    int triangle;
+    float t;
+  };
+
+  inline float
+  half_area(const SbBox3f & box)
+  {
+    if (box.isEmpty()) return 0.0f;
+    SbVec3f d = box.getMax() - box.getMin();
+    return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+  }
+
+  // The face record of a triangle, which the pick detail is recreated
+  // from. Triangles from the same face share their record.
+  struct FaceRecord {
+    int faceindex;
+    int partindex;
+    int firstpoint;
+    int numpoints;
+  };
+
+} // anonymous namespace
+
+class SoPrimitiveBVHCacheP {
+public:
+  // per triangle data, three entries per triangle for vertex data
+  SbList <SbVec3f> points;
+  SbList <SbVec3f> normals;
+  SbList <SbVec4f> texcoords;
+  SbList <int> materialindices;
+  SbList <int> triangleface;
+  SbList <int> origindex;
+
+  SbList <FaceRecord> faces;
+  // coordinate, material, normal and texture coordinate index for
+  // each point detail
+  SbList <int> pointdetails;
+
+  SbList <BVHNode> nodes;
+  SbBox3f rootbox;
+
+  int findFace(const SoFaceDetail * detail);
+  void reorder(const int * order, const int num);
+  SbBool intersectNode(const BVHNode & node, const SbVec3f & pos,
+                       const SbVec3f & dir, const SbVec3f & invdir,
+                       const float eps, float & tmin) const;
+};
+
+#define PRIVATE(obj) ((obj)->pimpl)
+
+// *************************************************************************
+
+/*!
+  Constructor.
+*/
+SoPrimitiveBVHCache::SoPrimitiveBVHCache(SoState * state)
+  : SoCache(state)
+{
+  PRIVATE(this) = new SoPrimitiveBVHCacheP;
+}
+
+/*!
+  Destructor.
+*/
+SoPrimitiveBVHCache::~SoPrimitiveBVHCache()
+{
+  delete PRIVATE(this);
+}
+
+/*!
+  Adds a triangle. \a pickdetail is the detail which should be set
+  for picked points on this triangle, and must be an SoFaceDetail or
+  \c NULL. The cache does not take over \a pickdetail.
+*/
+void
+SoPrimitiveBVHCache::addTriangle(const SoPrimitiveVertex * v0,
+                                 const SoPrimitiveVertex * v1,
+                                 const SoPrimitiveVertex * v2,
+                                 const SoDetail * pickdetail)
+{
+  const SoPrimitiveVertex * v[3] = { v0, v1, v2 };
+  for (int i = 0; i < 3; i++) {
+    PRIVATE(this)->points.append(v[i]->getPoint());
+    PRIVATE(this)->normals.append(v[i]->getNormal());
+    PRIVATE(this)->texcoords.append(v[i]->getTextureCoords());
+    PRIVATE(this)->materialindices.append(v[i]->getMaterialIndex());
+  }
+  int face = -1;
+  if (pickdetail) {
+    assert(pickdetail->isOfType(SoFaceDetail::getClassTypeId()));
+    face = PRIVATE(this)->findFace(static_cast<const SoFaceDetail *>(pickdetail));
+  }
+  PRIVATE(this)->triangleface.append(face);
+}
+
+/*!
+  Builds the bounding volume hierarchy. Must be called after all
+  triangles have been added, and before the cache is used for
+  picking.
+*/
+void
+SoPrimitiveBVHCache::build(void)
+{
+  const int num = PRIVATE(this)->triangleface.getLength();
+  PRIVATE(this)->nodes.truncate(0);
+  PRIVATE(this)->rootbox.makeEmpty();
+  if (num == 0) return;
+
+  int i;
+  int * indices = new int[num];
+  SbBox3f * boxes = new SbBox3f[num];
+  SbVec3f * centroids = new SbVec3f[num];
+  const SbVec3f * pts = PRIVATE(this)->points.getArrayPtr();
+  for (i = 0; i < num; i++) {
+    indices[i] = i;
+    boxes[i].makeEmpty();
+    boxes[i].extendBy(pts[i*3]);
+    boxes[i].extendBy(pts[i*3+1]);
+    boxes[i].extendBy(pts[i*3+2]);
+    centroids[i] = (boxes[i].getMin() + boxes[i].getMax()) * 0.5f;
+  }
+
+  SbList <BuildItem> stack;
+  BuildItem root = { 0, num, -1 };
+  stack.push(root);
+
+  while (stack.getLength()) {
+    const BuildItem item = stack.pop();
+    const int nodeidx = PRIVATE(this)->nodes.getLength();
+    if (item.parent >= 0) PRIVATE(this)->nodes[item.parent].offset = nodeidx;
+
+    SbBox3f box, cbox;
+    box.makeEmpty();
+    cbox.makeEmpty();
+    for (i = item.begin; i < item.end; i++) {
+      box.extendBy(boxes[indices[i]]);
+      cbox.extendBy(centroids[indices[i]]);
+    }
+    const int count = item.end - item.begin;
+
+    BVHNode node;
+    for (i = 0; i < 3; i++) {
+      node.bmin[i] = box.getMin()[i];
+      node.bmax[i] = box.getMax()[i];
+    }
+    node.offset = item.begin;
+    node.count = (uint16_t) count;
+    node.axis = 0;
+
+    int mid = item.begin;
+    if (count > 1) {
+      // split along the axis where the centroids are spread the most
+      const SbVec3f extent = cbox.getMax() - cbox.getMin();
+      int axis = 0;
+      if (extent[1] > extent[axis]) axis = 1;
+      if (extent[2] > extent[axis]) axis = 2;
+      node.axis = (uint16_t) axis;
+
+      if (extent[axis] > 0.0f) {
+        BuildBin bins[NUM_BINS];
+        for (i = 0; i < NUM_BINS; i++) {
+          bins[i].box.makeEmpty();
+          bins[i].count = 0;
+        }
+        const float cmin = cbox.getMin()[axis];
+        const float scale = float(NUM_BINS) * (1.0f - FLT_EPSILON) / extent[axis];
+        for (i = item.begin; i < item.end; i++) {
+          int b = (int) ((centroids[indices[i]][axis] - cmin) * scale);
+          b = SbClamp(b, 0, NUM_BINS - 1);
+          bins[b].box.extendBy(boxes[indices[i]]);
+          bins[b].count++;
+        }
+
+        // sweep from the right, then from the left, to find the
+        // split with the lowest surface area heuristic cost
+        float rightcost[NUM_BINS];
+        SbBox3f acc;
+        acc.makeEmpty();
+        int n = 0;
+        for (i = NUM_BINS - 1; i > 0; i--) {
+          acc.extendBy(bins[i].box);
+          n += bins[i].count;
+          rightcost[i] = half_area(acc) * float(n);
+        }
+        acc.makeEmpty();
+        n = 0;
+        float bestcost = FLT_MAX;
+        int bestsplit = -1;
+        for (i = 0; i < NUM_BINS - 1; i++) {
+          acc.extendBy(bins[i].box);
+          n += bins[i].count;
+          if (n == 0 || n == count) continue;
+          const float cost = half_area(acc) * float(n) + rightcost[i+1];
+          if (cost < bestcost) {
+            bestcost = cost;
+            bestsplit = i + 1;
+          }
+        }
+
+        const float area = half_area(box);
+        const float leafcost = float(count);
+        const float splitcost = area > 0.0f ?
+          TRAVERSAL_COST + bestcost / area : leafcost;
+
+        if (bestsplit > 0 && (splitcost < leafcost || count > MAX_LEAF_SIZE)) {
+          int * it = std::partition(indices + item.begin, indices + item.end,
+                                    [&](int tri) {
+                                      int b = (int) ((centroids[tri][axis] - cmin) * scale);
+                                      return SbClamp(b, 0, NUM_BINS - 1) < bestsplit;
+                                    });
+          mid = int(it - indices);
+        }
+      }
+      if ((mid == item.begin || mid == item.end) && count > MAX_LEAF_SIZE) {
+        // binning failed to separate the triangles, split in the
+        // middle to keep the leaves small
+        mid = (item.begin + item.end) / 2;
+        std::nth_element(indices + item.begin, indices + mid, indices + item.end,
+                         [&](int a, int b) {
+                           return centroids[a][axis] < centroids[b][axis];
+                         });
+      }
+    }
+
+    if (mid > item.begin && mid < item.end) {
+      node.count = 0;
+      node.offset = -1; // set when the right child is created
+      BuildItem right = { mid, item.end, nodeidx };
+      BuildItem left = { item.begin, mid, -1 };
+      stack.push(right);
+      stack.push(left);
+    }
+    PRIVATE(this)->nodes.append(node);
+  }
+  PRIVATE(this)->rootbox.setBounds(PRIVATE(this)->nodes[0].bmin[0],
+                                   PRIVATE(this)->nodes[0].bmin[1],
+                                   PRIVATE(this)->nodes[0].bmin[2],
+                                   PRIVATE(this)->nodes[0].bmax[0],
+                                   PRIVATE(this)->nodes[0].bmax[1],
+                                   PRIVATE(this)->nodes[0].bmax[2]);
+
+  // store the triangles in leaf order
+  PRIVATE(this)->reorder(indices, num);
+
+  delete[] indices;
+  delete[] boxes;
+  delete[] centroids;
+}
+
+/*!
+  Returns the number of triangles in the cache.
+*/
+int
+SoPrimitiveBVHCache::getNumTriangles(void) const
+{
+  return PRIVATE(this)->triangleface.getLength();
+}
+
+/*!
+  Returns the number of nodes in the hierarchy.
+*/
+int
+SoPrimitiveBVHCache::getNumNodes(void) const
+{
+  return PRIVATE(this)->nodes.getLength();
+}
+
+/*!
+  Finds the triangles intersected by \a line. For each triangle in
+  the leaves hit by the line, \a cb is called with the triangle
+  vertices, and should return \c TRUE and set the intersection point
+  if the triangle is hit.
+
+  The triangles hit are returned in \a triangles, in the order they
+  were added to the cache. If \a nearestonly is \c TRUE, subtrees
+  that lie behind the nearest hit found so far along \a line are
+  skipped, and only the hits which might be the nearest one are
+  returned.
+*/
+void
+SoPrimitiveBVHCache::findIntersections(const SbLine & line, const SbBool nearestonly,
+                                       IntersectCB * cb, void * closure,
+                                       SbList <int> & triangles) const
+{
+  if (PRIVATE(this)->nodes.getLength() == 0) return;
+
+  const SbVec3f & pos = line.getPosition();
+  const SbVec3f & dir = line.getDirection();
+  SbVec3f invdir;
+  for (int i = 0; i < 3; i++) {
+    invdir[i] = dir[i] != 0.0f ? 1.0f / dir[i] : 0.0f;
+  }
+
+  // pad the node boxes to make up for rounding errors in the slab
+  // tests, and allow for the same slack when comparing hits
+  const SbBox3f & root = PRIVATE(this)->rootbox;
+  float maxabs = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    maxabs = SbMax(maxabs, SbMax(float(fabs(root.getMin()[i])), float(fabs(root.getMax()[i]))));
+    maxabs = SbMax(maxabs, float(fabs(pos[i])));
+  }
+  const float diag = (root.getMax() - root.getMin()).length();
+  const float eps = diag * 1.0e-5f + maxabs * 1.0e-6f + FLT_MIN;
+
+  const BVHNode * nodes = PRIVATE(this)->nodes.getArrayPtr();
+  const SbVec3f * pts = PRIVATE(this)->points.getArrayPtr();
+
+  SbList <TriangleHit> hits;
+  float nearest = FLT_MAX;
+
+  int stack[64];
+  SbList <int> overflow;
+  int sp = 0;
+  stack[sp++] = 0;
+
+  while (sp > 0 || overflow.getLength()) {
+    const int idx = overflow.getLength() ? overflow.pop() : stack[--sp];
+    const BVHNode & node = nodes[idx];
+    float tmin;
+    if (!PRIVATE(this)->intersectNode(node, pos, dir, invdir, eps, tmin)) continue;
+    if (nearestonly && tmin > nearest + eps) continue;
+
+    if (node.count) {
+      for (int i = node.offset; i < node.offset + node.count; i++) {
+        SbVec3f isect;
+        if (cb(closure, pts[i*3], pts[i*3+1], pts[i*3+2], isect)) {
+          TriangleHit hit;
+          hit.triangle = i;
+          hit.t = (isect - pos).dot(dir);
+          hits.append(hit);
+          if (hit.t < nearest) nearest = hit.t;
+        }
+      }
+    }
+    else {
+      // visit the child closest to the start of the line first
+      int first = idx + 1, second = node.offset;
+      if (dir[node.axis] < 0.0f) std::swap(first, second);
+      if (sp < 62) {
+        stack[sp++] = second;
+        stack[sp++] = first;
+      }
+      else {
+        overflow.push(second);
+        overflow.push(first);
+      }
+    }
+  }
+
+  const int *  origindex = PRIVATE(this)->origindex.getArrayPtr();
+  const int num = hits.getLength();
+  int first = triangles.getLength();
+  for (int i = 0; i < num; i++) {
+    if (!nearestonly || hits[i].t <= nearest + eps) {
+      triangles.append(hits[i].triangle);
+    }
+  }
+  int * result = const_cast<int *>(triangles.getArrayPtr()) + first;
+  std::sort(result, result + (triangles.getLength() - first),
+            [origindex](int a, int b) { return origindex[a] < origindex[b]; });
+}
+
+/*!
+  Returns the vertices of \a triangle, which is a triangle returned
+  from findIntersections().
+*/
+void
+SoPrimitiveBVHCache::getTriangle(const int triangle,
+                                 SoPrimitiveVertex & v0,
+                                 SoPrimitiveVertex & v1,
+                                 SoPrimitiveVertex & v2) const
+{
+  SoPrimitiveVertex * v[3] = { &v0, &v1, &v2 };
+  for (int i = 0; i < 3; i++) {
+    const int idx = triangle * 3 + i;
+    v[i]->setPoint(PRIVATE(this)->points[idx]);
+    v[i]->setNormal(PRIVATE(this)->normals[idx]);
+    v[i]->setTextureCoords(PRIVATE(this)->texcoords[idx]);
+    v[i]->setMaterialIndex(PRIVATE(this)->materialindices[idx]);
+  }
+}
+
+/*!
+  Returns a new copy of the pick detail of \a triangle, or \c NULL if
+  the triangle had no detail.
+*/
+SoDetail *
+SoPrimitiveBVHCache::createPickDetail(const int triangle) const
+{
+  const int face = PRIVATE(this)->triangleface[triangle];
+  if (face < 0) return NULL;
+
+  const FaceRecord & rec = PRIVATE(this)->faces[face];
+  SoFaceDetail * detail = new SoFaceDetail;
+  detail->setFaceIndex(rec.faceindex);
+  detail->setPartIndex(rec.partindex);
+  detail->setNumPoints(rec.numpoints);
+  const int * pd = PRIVATE(this)->pointdetails.getArrayPtr() + rec.firstpoint * 4;
+  SoPointDetail point;
+  for (int i = 0; i < rec.numpoints; i++) {
+    point.setCoordinateIndex(pd[i*4]);
+    point.setMaterialIndex(pd[i*4+1]);
+    point.setNormalIndex(pd[i*4+2]);
+    point.setTextureCoordIndex(pd[i*4+3]);
+    detail->setPoint(i, &point);
+  }
+  return detail;
+}
+
+// *************************************************************************
+
+// Returns the record for the face in detail, reusing the record of the
+// previous triangle if it's from the same face.
+int
+SoPrimitiveBVHCacheP::findFace(const SoFaceDetail * detail)
+{
+  const int numpoints = detail->getNumPoints();
+  const int last = this->faces.getLength() - 1;
+  if (last >= 0) {
+    const FaceRecord & rec = this->faces[last];
+    if (rec.faceindex == detail->getFaceIndex() &&
+        rec.partindex == detail->getPartIndex() &&
+        rec.numpoints == numpoints) {
+      const int * pd = this->pointdetails.getArrayPtr() + rec.firstpoint * 4;
+      int i;
+      for (i = 0; i < numpoints; i++) {
+        const SoPointDetail * point = detail->getPoint(i);
+        if (pd[i*4] != point->getCoordinateIndex() ||
+            pd[i*4+1] != point->getMaterialIndex() ||
+            pd[i*4+2] != point->getNormalIndex() ||
+            pd[i*4+3] != point->getTextureCoordIndex()) break;
+      }
+      if (i == numpoints) return last;
+    }
+  }
+  FaceRecord rec;
+  rec.faceindex = detail->getFaceIndex();
+  rec.partindex = detail->getPartIndex();
+  rec.firstpoint = this->pointdetails.getLength() / 4;
+  rec.numpoints = numpoints;
+  for (int i = 0; i < numpoints; i++) {
+    const SoPointDetail * point = detail->getPoint(i);
+    this->pointdetails.append(point->getCoordinateIndex());
+    this->pointdetails.append(point->getMaterialIndex());
+    this->pointdetails.append(point->getNormalIndex());
+    this->pointdetails.append(point->getTextureCoordIndex());
+  }
+  this->faces.append(rec);
+  return last + 1;
+}
+
+// Stores the triangles in the order given, and remembers the original
+// index of each triangle.
+void
+SoPrimitiveBVHCacheP::reorder(const int * order, const int num)
+{
+  SbList <SbVec3f> newpoints(num * 3);
+  SbList <SbVec3f> newnormals(num * 3);
+  SbList <SbVec4f> newtexcoords(num * 3);
+  SbList <int> newmaterialindices(num * 3);
+  SbList <int> newtriangleface(num);
+  this->origindex.truncate(0);
+
+  for (int i = 0; i < num; i++) {
+    const int tri = order[i];
+    for (int j = 0; j < 3; j++) {
+      newpoints.append(this->points[tri*3+j]);
+      newnormals.append(this->normals[tri*3+j]);
+      newtexcoords.append(this->texcoords[tri*3+j]);
+      newmaterialindices.append(this->materialindices[tri*3+j]);
+    }
+    newtriangleface.append(this->triangleface[tri]);
+    this->origindex.append(tri);
+  }
+  this->points = newpoints;
+  this->normals = newnormals;
+  this->texcoords = newtexcoords;
+  this->materialindices = newmaterialindices;
+  this->triangleface = newtriangleface;
+}
+
+// Slab test of the (infinite) line against a node's padded bounding
+// box. Sets tmin to where the line enters the box.
+SbBool
+SoPrimitiveBVHCacheP::intersectNode(const BVHNode & node, const SbVec3f & pos,
+                                    const SbVec3f & dir, const SbVec3f & invdir,
+                                    const float eps, float & tmin) const
+{
+  float t0 = -FLT_MAX, t1 = FLT_MAX;
+  for (int i = 0; i < 3; i++) {
+    const float lo = node.bmin[i] - eps;
+    const float hi = node.bmax[i] + eps;
+    if (invdir[i] == 0.0f || !(fabs(invdir[i]) <= FLT_MAX)) {
+      // line parallel to the slab
+      if (pos[i] < lo || pos[i] > hi) return FALSE;
+      continue;
+    }
+    float ta = (lo - pos[i]) * invdir[i];
+    float tb = (hi - pos[i]) * invdir[i];
+    if (ta > tb) std::swap(ta, tb);
+    if (ta > t0) t0 = ta;
+    if (tb < t1) t1 = tb;
+    if (t0 > t1) return FALSE;
+  }
+  tmin = t0;
+  return TRUE;
+}
+
+#undef PRIVATE
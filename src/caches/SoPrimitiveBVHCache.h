@@ -0,0 +1,81 @@
+#ifndef COIN_SOPRIMITIVEBVHCACHE_H
+#define COIN_SOPRIMITIVEBVHCACHE_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif /* !COIN_INTERNAL */
+
+#include <Inventor/caches/SoCache.h>
+#include <Inventor/lists/SbList.h>
+
+class SbLine;
+class SbVec3f;
+class SoDetail;
+class SoPrimitiveVertex;
+class SoPrimitiveBVHCacheP;
+
+class SoPrimitiveBVHCache : public SoCache {
+  typedef SoCache inherited;
+public:
+  SoPrimitiveBVHCache(SoState * state);
+  virtual ~SoPrimitiveBVHCache();
+
+  void addTriangle(const SoPrimitiveVertex * v0,
+                   const SoPrimitiveVertex * v1,
+                   const SoPrimitiveVertex * v2,
+                   const SoDetail * pickdetail);
+  void build(void);
+
+  int getNumTriangles(void) const;
+  int getNumNodes(void) const;
+
+  typedef SbBool IntersectCB(void * closure,
+                             const SbVec3f & v0, const SbVec3f & v1, const SbVec3f & v2,
+                             SbVec3f & intersection);
+
+  void findIntersections(const SbLine & line, const SbBool nearestonly,
+                         IntersectCB * cb, void * closure,
+                         SbList <int> & triangles) const;
+  void getTriangle(const int triangle,
+                   SoPrimitiveVertex & v0,
+                   SoPrimitiveVertex & v1,
+                   SoPrimitiveVertex & v2) const;
+  SoDetail * createPickDetail(const int triangle) const;
+
+private:
+  SoPrimitiveBVHCacheP * pimpl;
+};
+
+#endif // COIN_SOPRIMITIVEBVHCACHE_H
@@ -51,6 +51,7 @@
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 
 #include <Inventor/C/glue/gl.h>
 #include <Inventor/C/tidbits.h>
@@ -78,6 +79,8 @@
 
 #include "tidbitsp.h"
 #include "misc/SbHash.h"
+#include "misc/SbDepthSorter.h"
+#include "threads/taskschedulerp.h"
 #include "rendering/SoGL.h"
 #include "rendering/SoVBO.h"
 #include "rendering/SoVertexArrayIndexer.h"
@@ -85,6 +88,9 @@
 
 // *************************************************************************
 
+// triangles (or vertices) per task when depth sorting in parallel
+static const int DEPTHSORT_GRAINSIZE = 16384;
+
 class SoPrimitiveVertexCacheP {
 public:
   SoPrimitiveVertexCacheP(void)
@@ -96,6 +102,7 @@ public:
       tangentlist(256),
       vhash(1024),
       deptharray(NULL),
+      unsortedindices(NULL),
       triangleindexer(NULL),
       lineindexer(NULL),
       pointindexer(NULL),
@@ -154,6 +161,9 @@ public:
   SoState * state;
   SbPlane prevsortplane;
   float * deptharray;
+  GLint * unsortedindices;
+  std::vector<float> vertexdepth;
+  SbDepthSorter depthsorter;
 
   SoVertexArrayIndexer * triangleindexer;
   SoVertexArrayIndexer * lineindexer;
@@ -320,6 +330,7 @@ SoPrimitiveVertexCache::~SoPrimitiveVertexCache()
     delete[] PRIVATE(this)->multitexcoords;
   }
   delete [] PRIVATE(this)->deptharray;
+  delete [] PRIVATE(this)->unsortedindices;
 }
 
 SbBool 
@@ -849,47 +860,44 @@ SoPrimitiveVertexCache::depthSortTriangles(SoState * state)
 
   if (PRIVATE(this)->deptharray == NULL ||
       (sortplane != PRIVATE(this)->prevsortplane)) {
+    GLint * iptr = PRIVATE(this)->triangleindexer->getWriteableIndices();
     if (!PRIVATE(this)->deptharray) {
       PRIVATE(this)->deptharray = new float[numtri];
+      // the sorted indices are rewritten from the original order
+      PRIVATE(this)->unsortedindices = new GLint[numtri*3];
+      memcpy(PRIVATE(this)->unsortedindices, iptr, numtri*3*sizeof(GLint));
     }
     PRIVATE(this)->prevsortplane = sortplane;
     float * darray = PRIVATE(this)->deptharray;
     const SbVec3f * vptr = PRIVATE(this)->vertexlist.getArrayPtr();
-    GLint * iptr = PRIVATE(this)->triangleindexer->getWriteableIndices();
-    int i,j;
-    for (i = 0; i < numtri; i++) {
-      float acc = 0.0;
-      for (j = 0; j < 3; j++) {
-        acc += sortplane.getDistance(vptr[iptr[i*3+j]]);
-      }
-      darray[i] = acc / 3.0f;
-    }
-    int distance;
-    float dtmp;
-    int itmp[3];
-
-    // shell sort algorithm (O(nlog(n))
-    for (distance = 1; distance <= numtri/9; distance = 3*distance + 1) ;
-    for (; distance > 0; distance /= 3) {
-      for (i = distance; i < numtri; i++) {
-        dtmp = darray[i];
-        itmp[0] = iptr[i*3];
-        itmp[1] = iptr[i*3+1];
-        itmp[2] = iptr[i*3+2];
-        j = i;
-        while (j >= distance && darray[j-distance] > dtmp) {
-          darray[j] = darray[j-distance];
-          iptr[j*3] = iptr[(j-distance)*3];
-          iptr[j*3+1] = iptr[(j-distance)*3+1];
-          iptr[j*3+2] = iptr[(j-distance)*3+2];
-          j -= distance;
+    const GLint * unsorted = PRIVATE(this)->unsortedindices;
+
+    // Sort on the sum of the vertex distances to the plane, which
+    // orders the triangles like the distances of their centers. The
+    // vertices are shared between triangles, so their distances are
+    // computed first.
+    PRIVATE(this)->vertexdepth.resize(numv);
+    float * vdepth = PRIVATE(this)->vertexdepth.data();
+    const SbVec3f normal = sortplane.getNormal();
+    SbTaskScheduler::parallelFor(0, numv, DEPTHSORT_GRAINSIZE, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) vdepth[i] = normal.dot(vptr[i]);
+      });
+    SbTaskScheduler::parallelFor(0, numtri, DEPTHSORT_GRAINSIZE, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+          darray[i] = vdepth[unsorted[i*3]] + vdepth[unsorted[i*3+1]] + vdepth[unsorted[i*3+2]];
         }
-        darray[j] = dtmp;
-        iptr[j*3] = itmp[0];
-        iptr[j*3+1] = itmp[1];
-        iptr[j*3+2] = itmp[2];
-      }
-    }
+      });
+
+    // radix sort, starting from the previous order (O(n))
+    const int * order = PRIVATE(this)->depthsorter.sort(darray, numtri, FALSE);
+    SbTaskScheduler::parallelFor(0, numtri, DEPTHSORT_GRAINSIZE, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+          const GLint * tri = unsorted + order[i]*3;
+          iptr[i*3] = tri[0];
+          iptr[i*3+1] = tri[1];
+          iptr[i*3+2] = tri[2];
+        }
+      });
   }
 }
 
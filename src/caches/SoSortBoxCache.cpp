@@ -0,0 +1,418 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*!
+  \class SoSortBoxCache SoSortBoxCache.h
+  \brief The SoSortBoxCache class keeps the bounding boxes of sorted transparent paths across frames.
+
+  \ingroup caches
+
+  SoGLRenderAction needs the object space bounding box of every
+  transparent path it sorts, every frame. For shapes, the box usually
+  comes from the shape's own bounding box cache. Other paths, and
+  shapes without a valid cache, would need a box computation each
+  frame, so their boxes are kept here.
+
+  The boxes are stored under a hash of the nodes and child indices of
+  the path. A shape's box is valid while the shape's node id is
+  unchanged and the elements read while computing the box match, like
+  for an SoBoundingBoxCache. Other boxes are computed with an
+  SoGetBoundingBoxAction applied to the path, and are valid while the
+  node ids along the path are unchanged. Any change below a node on
+  the path, including changes to siblings of the path, gives the node
+  a new id when the notification passes through it.
+
+  \internal
+*/
+
+#include "caches/SoSortBoxCache.h"
+
+#include <Inventor/SbMatrix.h>
+#include <Inventor/SoFullPath.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/caches/SoBoundingBoxCache.h>
+#include <Inventor/elements/SoCacheElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoViewportRegionElement.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/misc/SoState.h>
+#include <Inventor/nodes/SoShape.h>
+
+#include "SbBasicP.h"
+
+// boxes of paths which haven't been rendered for this many frames are
+// removed
+static const uint32_t SOSORTBOX_MAX_AGE = 64;
+
+// *************************************************************************
+
+SoSortBoxCache::SoSortBoxCache(void)
+  : frame(0)
+{
+}
+
+SoSortBoxCache::~SoSortBoxCache()
+{
+  this->clear();
+}
+
+/*!
+  Finds the object space bounding box and center of the tail of \a
+  path, which must be the current path of \a action. \a bboxaction is
+  used for paths not ending in a shape.
+
+  Returns \c TRUE if the box was found in a cache, and \c FALSE if it
+  was computed.
+*/
+SbBool
+SoSortBoxCache::getBox(SoAction * action, SoFullPath * path,
+                       SoGetBoundingBoxAction * bboxaction,
+                       SbBox3f & box, SbVec3f & center)
+{
+  SoState * state = action->getState();
+  SoNode * tail = path->getTail();
+  SoShape * tailshape = NULL;
+
+  // test if we can find the bbox using SoShape::getBoundingBoxCache().
+  // This is the common case, and quite a lot faster than using an
+  // SoGetBoundingBoxAction.
+  if (tail->isOfType(SoShape::getClassTypeId())) {
+    tailshape = coin_assert_cast<SoShape *>(tail);
+    const SoBoundingBoxCache * bboxcache = tailshape->getBoundingBoxCache();
+    if (bboxcache && bboxcache->isValid(state)) {
+      box = bboxcache->getProjectedBox();
+      if (bboxcache->isCenterSet()) center = bboxcache->getCenter();
+      else center = box.getCenter();
+      return TRUE;
+    }
+  }
+
+  const uint64_t stamp = tailshape ?
+    static_cast<uint64_t>(tailshape->getNodeId()) : SoSortBoxCache::getPathStamp(path);
+
+  const uint64_t key = SoSortBoxCache::getPathKey(path);
+  Entry entry;
+  (void)this->boxes.get(key, entry);
+  entry.frame = this->frame;
+  if ((entry.tail == tail) && (entry.stamp == stamp) &&
+      (entry.deps == NULL || entry.deps->isValid(state))) {
+    box = entry.box;
+    center = entry.center;
+    this->boxes.put(key, entry);
+    return TRUE;
+  }
+
+  if (entry.deps) {
+    entry.deps->unref();
+    entry.deps = NULL;
+  }
+  entry.tail = tail;
+  entry.stamp = stamp;
+
+  if (tailshape) {
+    // record the elements the box depends on, like SoShape does for
+    // its bounding box cache
+    state->push();
+    const SbBool storedinvalid = SoCacheElement::setInvalid(FALSE);
+    entry.deps = new SoBoundingBoxCache(state);
+    entry.deps->ref();
+    SoCacheElement::set(state, entry.deps);
+    box.makeEmpty();
+    tailshape->computeBBox(action, box, center);
+    entry.deps->set(box, TRUE, center);
+    state->pop();
+    SoCacheElement::setInvalid(storedinvalid);
+  }
+  else {
+    bboxaction->setViewportRegion(SoViewportRegionElement::get(state));
+    bboxaction->apply(path);
+    const SbMatrix inverse = SoModelMatrixElement::get(state).inverse();
+    box = bboxaction->getBoundingBox();
+    box.transform(inverse);
+    inverse.multVecMatrix(bboxaction->getBoundingBox().getCenter(), center);
+  }
+  entry.box = box;
+  entry.center = center;
+  this->boxes.put(key, entry);
+  return FALSE;
+}
+
+/*!
+  Starts a new frame. Boxes which haven't been used for a while are
+  removed now and then.
+*/
+void
+SoSortBoxCache::beginFrame(void)
+{
+  if ((++this->frame & 255) == 0) this->sweep();
+}
+
+/*!
+  Removes all boxes.
+*/
+void
+SoSortBoxCache::clear(void)
+{
+  for (SbHash<uint64_t, Entry>::const_iterator it = this->boxes.const_begin();
+       it != this->boxes.const_end(); ++it) {
+    if (it->obj.deps) it->obj.deps->unref();
+  }
+  this->boxes.clear();
+}
+
+/*!
+  Returns the number of boxes in the cache.
+*/
+int
+SoSortBoxCache::getNumBoxes(void) const
+{
+  return static_cast<int>(this->boxes.getNumElements());
+}
+
+/*!
+  Returns the key \a path is stored under, an FNV-1a style hash over
+  the nodes and child indices of the path.
+*/
+uint64_t
+SoSortBoxCache::getPathKey(const SoFullPath * path)
+{
+  uint64_t key = 14695981039346656037ULL;
+  const int len = path->getLength();
+  for (int i = 0; i < len; i++) {
+    key = (key ^ static_cast<uint64_t>(reinterpret_cast<uintptr_t>(path->getNode(i)))) * 1099511628211ULL;
+    key = (key ^ static_cast<uint64_t>(static_cast<uint32_t>(path->getIndex(i)))) * 1099511628211ULL;
+  }
+  return key;
+}
+
+/*!
+  Returns a hash over the node ids along \a path. It changes when
+  anything below a node on the path changes.
+*/
+uint64_t
+SoSortBoxCache::getPathStamp(const SoFullPath * path)
+{
+  uint64_t stamp = 14695981039346656037ULL;
+  const int len = path->getLength();
+  for (int i = 0; i < len; i++) {
+    stamp = (stamp ^ static_cast<uint64_t>(path->getNode(i)->getNodeId())) * 1099511628211ULL;
+  }
+  return stamp;
+}
+
+// Removes the boxes of paths which haven't been rendered for a while.
+void
+SoSortBoxCache::sweep(void)
+{
+  SbList<uint64_t> keys;
+  for (SbHash<uint64_t, Entry>::const_iterator it = this->boxes.const_begin();
+       it != this->boxes.const_end(); ++it) {
+    if (this->frame - it->obj.frame > SOSORTBOX_MAX_AGE) keys.append(it->key);
+  }
+  for (int i = 0; i < keys.getLength(); i++) {
+    Entry entry;
+    this->boxes.get(keys[i], entry);
+    if (entry.deps) entry.deps->unref();
+    this->boxes.erase(keys[i]);
+  }
+}
+
+// *************************************************************************
+
+#ifdef COIN_TEST_SUITE
+#ifdef COIN_INT_TEST_SUITE
+
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/SoFullPath.h>
+#include <Inventor/actions/SoCallbackAction.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoFaceSet.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTransform.h>
+
+namespace {
+
+  // root
+  //  +- transform
+  //  +- group (a non-shape tail)
+  //  |   +- cube
+  //  +- coords
+  //  +- faceset (a shape tail)
+  class SortBoxTestScene {
+  public:
+    SortBoxTestScene(void) : bboxaction(SbViewportRegion(100, 100)) {
+      this->root = new SoSeparator;
+      this->root->ref();
+      this->transform = new SoTransform;
+      this->root->addChild(this->transform);
+      this->group = new SoSeparator;
+      this->cube = new SoCube;
+      this->group->addChild(this->cube);
+      this->root->addChild(this->group);
+      this->coords = new SoCoordinate3;
+      this->coords->point.set1Value(0, SbVec3f(0.0f, 0.0f, 0.0f));
+      this->coords->point.set1Value(1, SbVec3f(1.0f, 0.0f, 0.0f));
+      this->coords->point.set1Value(2, SbVec3f(0.0f, 1.0f, 0.0f));
+      this->root->addChild(this->coords);
+      this->faceset = new SoFaceSet;
+      this->faceset->numVertices = 3;
+      this->root->addChild(this->faceset);
+    }
+    ~SortBoxTestScene() {
+      this->root->unref();
+    }
+
+    // Looks up the boxes of the group and the face set. Returns the
+    // number of them found in the cache.
+    int lookup(void) {
+      this->cache.beginFrame();
+      this->numhits = 0;
+      SoCallbackAction action;
+      action.addPreCallback(SoNode::getClassTypeId(), SortBoxTestScene::preCB, this);
+      action.apply(this->root);
+      return this->numhits;
+    }
+
+    static SoCallbackAction::Response preCB(void * closure, SoCallbackAction * action,
+                                            const SoNode * node) {
+      SortBoxTestScene * thisp = static_cast<SortBoxTestScene *>(closure);
+      if (node == thisp->group || node == thisp->faceset) {
+        SoFullPath * path = const_cast<SoFullPath *>
+          (static_cast<const SoFullPath *>(action->getCurPath()));
+        SbBox3f & box = (node == thisp->group) ? thisp->groupbox : thisp->facesetbox;
+        SbVec3f center;
+        if (thisp->cache.getBox(action, path, &thisp->bboxaction, box, center)) {
+          thisp->numhits++;
+        }
+      }
+      return SoCallbackAction::CONTINUE;
+    }
+
+    SoSortBoxCache cache;
+    SoGetBoundingBoxAction bboxaction;
+    SoSeparator * root;
+    SoTransform * transform;
+    SoSeparator * group;
+    SoCube * cube;
+    SoCoordinate3 * coords;
+    SoFaceSet * faceset;
+    SbBox3f groupbox, facesetbox;
+    int numhits;
+  };
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(cachedUntilChanged)
+{
+  SortBoxTestScene scene;
+  BOOST_CHECK_EQUAL(scene.lookup(), 0);
+  BOOST_CHECK_EQUAL(scene.cache.getNumBoxes(), 2);
+  BOOST_CHECK_MESSAGE(scene.groupbox.getMin() == SbVec3f(-1.0f, -1.0f, -1.0f) &&
+                      scene.groupbox.getMax() == SbVec3f(1.0f, 1.0f, 1.0f),
+                      "wrong box for the group");
+  BOOST_CHECK_MESSAGE(scene.facesetbox.getMin() == SbVec3f(0.0f, 0.0f, 0.0f) &&
+                      scene.facesetbox.getMax() == SbVec3f(1.0f, 1.0f, 0.0f),
+                      "wrong box for the face set");
+  BOOST_CHECK_MESSAGE(scene.lookup() == 2, "unchanged boxes should be cached");
+}
+
+BOOST_AUTO_TEST_CASE(siblingTransformChanged)
+{
+  SortBoxTestScene scene;
+  (void)scene.lookup();
+  scene.transform->scaleFactor = SbVec3f(2.0f, 2.0f, 2.0f);
+  // the group's box is recomputed. The face set's object space box
+  // doesn't depend on the transform.
+  BOOST_CHECK_EQUAL(scene.lookup(), 1);
+  BOOST_CHECK_MESSAGE(scene.groupbox.getMin().equals(SbVec3f(-1.0f, -1.0f, -1.0f), 1e-5f) &&
+                      scene.groupbox.getMax().equals(SbVec3f(1.0f, 1.0f, 1.0f), 1e-5f),
+                      "group box should still be in object space");
+}
+
+BOOST_AUTO_TEST_CASE(tailChanged)
+{
+  SortBoxTestScene scene;
+  (void)scene.lookup();
+  scene.cube->width = 4.0f;
+  BOOST_CHECK_EQUAL(scene.lookup(), 1);
+  BOOST_CHECK_MESSAGE(scene.groupbox.getMax() == SbVec3f(2.0f, 1.0f, 1.0f),
+                      "group box should follow the cube below it");
+
+  scene.faceset->numVertices = 2;
+  scene.faceset->numVertices = 3;
+  BOOST_CHECK_MESSAGE(scene.lookup() == 0,
+                      "a changed face set should be recomputed, along with its parent path");
+}
+
+BOOST_AUTO_TEST_CASE(shapeElementChanged)
+{
+  SortBoxTestScene scene;
+  (void)scene.lookup();
+  // the coordinates are read by the face set through the state
+  scene.coords->point.set1Value(2, SbVec3f(0.0f, 5.0f, 0.0f));
+  (void)scene.lookup();
+  BOOST_CHECK_MESSAGE(scene.facesetbox.getMax() == SbVec3f(1.0f, 5.0f, 0.0f),
+                      "face set box should follow its coordinates");
+}
+
+BOOST_AUTO_TEST_CASE(pathKeyAndStamp)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoCube * cube = new SoCube;
+  root->addChild(cube);
+  root->addChild(cube);
+
+  SoFullPath * first = static_cast<SoFullPath *>(new SoPath(root));
+  first->ref();
+  first->append(0);
+  SoFullPath * second = static_cast<SoFullPath *>(new SoPath(root));
+  second->ref();
+  second->append(1);
+
+  BOOST_CHECK_MESSAGE(SoSortBoxCache::getPathKey(first) != SoSortBoxCache::getPathKey(second),
+                      "paths through different child indices should have different keys");
+  const uint64_t stamp = SoSortBoxCache::getPathStamp(first);
+  BOOST_CHECK_EQUAL(stamp, SoSortBoxCache::getPathStamp(second));
+  cube->width = 3.0f;
+  BOOST_CHECK_MESSAGE(SoSortBoxCache::getPathStamp(first) != stamp,
+                      "a changed node on the path should change the stamp");
+
+  first->unref();
+  second->unref();
+  root->unref();
+}
+
+#endif // COIN_INT_TEST_SUITE
+#endif // COIN_TEST_SUITE
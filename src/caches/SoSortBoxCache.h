@@ -0,0 +1,82 @@
+#ifndef COIN_SOSORTBOXCACHE_H
+#define COIN_SOSORTBOXCACHE_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif /* !COIN_INTERNAL */
+
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbVec3f.h>
+
+#include "misc/SbHash.h"
+
+class SoAction;
+class SoBoundingBoxCache;
+class SoFullPath;
+class SoGetBoundingBoxAction;
+class SoNode;
+
+class SoSortBoxCache {
+public:
+  SoSortBoxCache(void);
+  ~SoSortBoxCache();
+
+  SbBool getBox(SoAction * action, SoFullPath * path,
+                SoGetBoundingBoxAction * bboxaction,
+                SbBox3f & box, SbVec3f & center);
+  void beginFrame(void);
+  void clear(void);
+  int getNumBoxes(void) const;
+
+  static uint64_t getPathKey(const SoFullPath * path);
+  static uint64_t getPathStamp(const SoFullPath * path);
+
+private:
+  struct Entry {
+    Entry(void) : tail(NULL), deps(NULL), stamp(0), frame(0) { }
+    const SoNode * tail;
+    SbBox3f box;
+    SbVec3f center;
+    SoBoundingBoxCache * deps;
+    uint64_t stamp;
+    uint32_t frame;
+  };
+  void sweep(void);
+
+  SbHash<uint64_t, Entry> boxes;
+  uint32_t frame;
+};
+
+#endif // !COIN_SOSORTBOXCACHE_H
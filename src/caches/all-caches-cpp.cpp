@@ -40,4 +40,7 @@
 #include "SoPrimitiveVertexCache.cpp"
 #include "SoGlyphCache.cpp"
 #include "SoShaderProgramCache.cpp"
+#include "SoPrimitiveBVHCache.cpp"
+#include "SoInstanceCache.cpp"
+#include "SoSortBoxCache.cpp"
 #include "SoVBOCache.cpp"
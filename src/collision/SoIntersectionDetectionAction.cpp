@@ -42,6 +42,8 @@
   Note also that the SoIntersectionDetectionAction class is not a
   high-performance component in Coin.  Using it in a continuous manner
   over complex scene graphs is doomed to be a performance killer.
+  For large scenes, the primitive testing can be spread over several
+  threads with setNumThreads().
 
   Below is a simple usage example for this class.  It was written as a
   standalone framework set up for profiling and optimization of the
@@ -120,11 +122,6 @@
 // intersection testing code in SoExtSelection. Check if that could be
 // used.
 
-// FIXME: I just noticed that there's an O(n^2) algorithm for removing
-// duplicates from SbOctTree::findItems() results in SbOctTree.cpp
-// (see the add_to_array() helper function). This may very well be a
-// serious bottleneck, should investigate. 20050512 mortene.
-
 // *************************************************************************
 
 /*! \file SoIntersectionDetectionAction.h */
@@ -170,8 +167,13 @@
 #include <Inventor/manips/SoTransformManip.h>
 #endif // HAVE_MANIPULATORS
 
+#ifdef HAVE_THREADS
+#include <Inventor/threads/SbMutex.h>
+#endif // HAVE_THREADS
+
 #include "actions/SoSubActionP.h"
 #include "collision/SbTri3f.h"
+#include "threads/taskschedulerp.h"
 #include "coindefs.h"
 
 #if BOOST_WORKAROUND(COIN_MSVC, <= COIN_MSVC_6_0_VERSION)
@@ -181,6 +183,8 @@
 
 #include "SbBasicP.h"
 
+#include <algorithm>
+#include <atomic>
 #include <list>
 #include <vector>
 
@@ -214,6 +218,8 @@
 
 class ShapeData;
 class PrimitiveData;
+class IntersectionSink;
+class IntersectionJob;
 
 class SoIntersectionDetectionAction :: PImpl {
 public:
@@ -229,6 +235,9 @@ public:
   SbBool manipsenabled;
   SbBool internalsenabled;
 
+  int numthreads;
+  SoIntersectionDetectionAction::CallbackOrdering ordering;
+
   SoIntersectionDetectionAction::SoIntersectionFilterCB * filtercb;
   void * filterclosure;
   
@@ -247,8 +256,18 @@ public:
 
   void reset(void);
   void doIntersectionTesting(void);
-  void doPrimitiveIntersectionTesting(PrimitiveData * primitives1, PrimitiveData * primitives2, SbBool & cont);
-  void doInternalPrimitiveIntersectionTesting(PrimitiveData * primitives, SbBool & cont);
+  void doPrimitiveIntersectionTesting(PrimitiveData * primitives1, PrimitiveData * primitives2, IntersectionSink & sink, SbBool & cont);
+  void doInternalPrimitiveIntersectionTesting(PrimitiveData * primitives, IntersectionSink & sink, SbBool & cont);
+  Resp invokeCallbacks(PrimitiveData * primitives1, const SbTri3f * t1,
+                       PrimitiveData * primitives2, const SbTri3f * t2);
+  class CallbackSink;
+#ifdef HAVE_THREADS
+  class RecordingSink;
+  class SerializingSink;
+  class IntersectionJobTester;
+  void doParallelIntersectionTesting(std::vector<IntersectionJob> & jobs,
+                                     SbTaskScheduler * scheduler);
+#endif // HAVE_THREADS
 
   SoTypeList * prunetypes;
 
@@ -270,6 +289,8 @@ SoIntersectionDetectionAction::PImpl::PImpl(void)
   this->draggersenabled = TRUE;
   this->manipsenabled = TRUE;
   this->internalsenabled = FALSE;
+  this->numthreads = 1;
+  this->ordering = SoIntersectionDetectionAction::ORDERED;
   this->filtercb = NULL;
   this->filterclosure = NULL;
   this->traverser = NULL;
@@ -543,6 +564,97 @@ SoIntersectionDetectionAction::isShapeInternalsEnabled(void) const
   return PRIVATE(this)->internalsenabled;
 }
 
+/*!
+  Sets the number of threads used for testing the primitives of
+  shapes with overlapping bounding boxes against each other.
+
+  The default value is 1, which does all testing on the thread
+  calling apply(). With a larger value, the shape pairs are tested in
+  parallel, on the calling thread and \a numthreads - 1 threads
+  started for the duration of apply(). The value 0 uses Coin's shared
+  worker threads, see the COIN_NUM_TASK_THREADS environment variable.
+
+  With more than one thread, the filter callback is invoked for all
+  candidate shape pairs before the primitive testing starts, instead
+  of interleaved with the intersection callbacks. It is still invoked
+  on the calling thread, in the same order as before. How the
+  intersection callbacks are invoked is controlled with
+  setCallbackOrdering().
+
+  \sa getNumThreads(), setCallbackOrdering()
+  \since Coin 4.1
+*/
+
+void
+SoIntersectionDetectionAction::setNumThreads(int numthreads)
+{
+  assert(numthreads >= 0);
+  PRIVATE(this)->numthreads = SbMax(numthreads, 0);
+}
+
+/*!
+  Returns the number of threads used for intersection testing.
+
+  \sa setNumThreads()
+  \since Coin 4.1
+*/
+
+int
+SoIntersectionDetectionAction::getNumThreads(void) const
+{
+  return PRIVATE(this)->numthreads;
+}
+
+/*!
+  \enum SoIntersectionDetectionAction::CallbackOrdering
+
+  How intersection callbacks are invoked when intersection testing is
+  done on more than one thread.
+
+  \sa setCallbackOrdering()
+  \since Coin 4.1
+*/
+
+/*!
+  Sets how the intersection callbacks are invoked when more than one
+  thread is used for intersection testing, see setNumThreads().
+
+  With \c ORDERED (the default), the callbacks are invoked on the
+  thread calling apply(), with the same intersections, in the same
+  order, and with the same effect of their return values as with a
+  single thread.
+
+  With \c UNORDERED, the callbacks are invoked from the testing
+  threads as soon as an intersection is found, so the order varies
+  from run to run. The invocations are serialized, so the callbacks
+  are never run concurrently. NEXT_SHAPE stops the testing of the
+  shape pair the intersection was found in, and ABORT stops all
+  testing as soon as possible. No callbacks are invoked after ABORT.
+
+  \sa getCallbackOrdering(), setNumThreads()
+  \since Coin 4.1
+*/
+
+void
+SoIntersectionDetectionAction::setCallbackOrdering(CallbackOrdering ordering)
+{
+  PRIVATE(this)->ordering = ordering;
+}
+
+/*!
+  Returns how the intersection callbacks are invoked with more than
+  one thread.
+
+  \sa setCallbackOrdering()
+  \since Coin 4.1
+*/
+
+SoIntersectionDetectionAction::CallbackOrdering
+SoIntersectionDetectionAction::getCallbackOrdering(void) const
+{
+  return PRIVATE(this)->ordering;
+}
+
 /*!
   The scene graph traversal can be controlled with callbacks which
   you set with this method.  Use just like you would use
@@ -788,6 +900,8 @@ public:
         SbTri3f * t = this->getTriangle(k);
         this->octtree->addItem(t);
       }
+      // the octtree is queried for every triangle of the other shape
+      this->octtree->optimize(PrimitiveData::itemboxfunc);
     }
     return this->octtree;
   }
@@ -813,6 +927,7 @@ public:
 
 private:
   static SbBool insideboxfunc(void * const item, const SbBox3f & box);
+  static void itemboxfunc(void * const item, SbBox3f & box);
 
   SoPath * path;
   SbList<SbTri3f*> triangles;
@@ -827,6 +942,13 @@ PrimitiveData::insideboxfunc(void * const item, const SbBox3f & box)
   return box.intersect(tri->getBoundingBox());
 }
 
+void
+PrimitiveData::itemboxfunc(void * const item, SbBox3f & box)
+{
+  SbTri3f * tri = static_cast<SbTri3f *>(item);
+  box = tri->getBoundingBox();
+}
+
 // *************************************************************************
 
 class ShapeData {
@@ -1162,6 +1284,55 @@ shapeinsideboxfunc(void * const item, const SbBox3f & box)
   return shape->xfbbox.intersect(box);
 }
 
+// Receives the intersecting triangle pairs found by the primitive
+// testing functions below.
+class IntersectionSink {
+public:
+  virtual ~IntersectionSink() { }
+
+  // Returns NEXT_PRIMITIVE to go on testing, NEXT_SHAPE to stop
+  // testing the current shape pair, or ABORT to stop all testing.
+  virtual SoIntersectionDetectionAction::Resp hit(PrimitiveData * primitives1, SbTri3f * t1,
+                                                  PrimitiveData * primitives2, SbTri3f * t2) = 0;
+
+  // Polled now and then during testing, for stopping early.
+  virtual SbBool isAborted(void) const { return FALSE; }
+};
+
+// Invokes the intersection callbacks right away.
+class SoIntersectionDetectionAction::PImpl::CallbackSink : public IntersectionSink {
+public:
+  CallbackSink(SoIntersectionDetectionAction::PImpl * pimplarg) : pimpl(pimplarg) { }
+
+  virtual SoIntersectionDetectionAction::Resp hit(PrimitiveData * primitives1, SbTri3f * t1,
+                                                  PrimitiveData * primitives2, SbTri3f * t2)
+  {
+    return this->pimpl->invokeCallbacks(primitives1, t1, primitives2, t2);
+  }
+
+private:
+  SoIntersectionDetectionAction::PImpl * pimpl;
+};
+
+// A shape pair to be tested on another thread.
+class IntersectionJob {
+public:
+  IntersectionJob(ShapeData * shape1arg, ShapeData * shape2arg)
+    : shape1(shape1arg), shape2(shape2arg) { }
+
+  ShapeData * shape1;
+  ShapeData * shape2; // NULL for testing shape1 against itself
+
+  // The intersections found, when the callbacks are to be invoked in
+  // order afterwards.
+  class Hit {
+  public:
+    PrimitiveData * primitives1, * primitives2;
+    SbTri3f * t1, * t2;
+  };
+  SbList<Hit> hits;
+};
+
 // Execute full set of intersection detection operations on all the
 // primitives that have been souped up from the scene graph.
 void
@@ -1183,6 +1354,23 @@ SoIntersectionDetectionAction::PImpl::doIntersectionTesting(void)
 
   }
 
+  // With more than one thread, the shape pairs to test are collected
+  // first, and tested afterwards.
+  SbTaskScheduler * scheduler = NULL;
+  SbBool ownscheduler = FALSE;
+#ifdef HAVE_THREADS
+  if (this->numthreads == 0) {
+    scheduler = SbTaskScheduler::getGlobal();
+  }
+  else if (this->numthreads > 1) {
+    scheduler = new SbTaskScheduler(this->numthreads - 1);
+    ownscheduler = TRUE;
+  }
+  if (scheduler && (scheduler->getNumWorkers() == 0)) { scheduler = NULL; }
+#endif // HAVE_THREADS
+  std::vector<IntersectionJob> jobs;
+  CallbackSink callbacksink(this);
+
   const SbOctTreeFuncs funcs = {
     NULL /* ptinsidefunc */,
     shapeinsideboxfunc,
@@ -1235,9 +1423,14 @@ SoIntersectionDetectionAction::PImpl::doIntersectionTesting(void)
     // FIXME: shouldn't we also invoke the filter-callback here? 20030403 mortene.
     if (this->internalsenabled) {
       nrselfisects++;
-      SbBool cont;
-      this->doInternalPrimitiveIntersectionTesting(shape1->getPrimitives(), cont);
-      if (!cont) { goto done; }
+      if (scheduler) {
+        jobs.push_back(IntersectionJob(shape1, NULL));
+      }
+      else {
+        SbBool cont;
+        this->doInternalPrimitiveIntersectionTesting(shape1->getPrimitives(), callbacksink, cont);
+        if (!cont) { goto done; }
+      }
     }
 
     SbBox3f shapebbox = shape1->xfbbox.project();
@@ -1301,14 +1494,24 @@ SoIntersectionDetectionAction::PImpl::doIntersectionTesting(void)
       if (!this->filtercb ||
           this->filtercb(this->filterclosure, shape1->path, shape2->path)) {
         nrshapeshapeisects++;
+        if (scheduler) {
+          jobs.push_back(IntersectionJob(shape1, shape2));
+          continue;
+        }
         SbBool cont;
-        this->doPrimitiveIntersectionTesting(shape1->getPrimitives(), shape2->getPrimitives(), cont);
+        this->doPrimitiveIntersectionTesting(shape1->getPrimitives(), shape2->getPrimitives(), callbacksink, cont);
         if (!cont) { goto done; }
       }
     }
   }
 
+#ifdef HAVE_THREADS
+  if (scheduler) { this->doParallelIntersectionTesting(jobs, scheduler); }
+#endif // HAVE_THREADS
+
  done:
+  if (ownscheduler) { delete scheduler; }
+
   if (ida_debug()) {
     SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::doIntersectionTesting",
                            "shape-shape intersections: %d, shape self-intersections: %d",
@@ -1316,10 +1519,54 @@ SoIntersectionDetectionAction::PImpl::doIntersectionTesting(void)
   }
 }
 
+// Invokes the intersection callbacks for a pair of intersecting
+// triangles. Returns NEXT_PRIMITIVE if all callbacks did, or else the
+// first other response.
+SoIntersectionDetectionAction::Resp
+SoIntersectionDetectionAction::PImpl::invokeCallbacks(PrimitiveData * primitives1, const SbTri3f * t1,
+                                                      PrimitiveData * primitives2, const SbTri3f * t2)
+{
+  SoIntersectingPrimitive p1;
+  p1.path = primitives1->getPath();
+  p1.type = SoIntersectingPrimitive::TRIANGLE;
+  t1->getValue(p1.xf_vertex[0], p1.xf_vertex[1], p1.xf_vertex[2]);
+  primitives1->invtransform.multVecMatrix(p1.xf_vertex[0], p1.vertex[0]);
+  primitives1->invtransform.multVecMatrix(p1.xf_vertex[1], p1.vertex[1]);
+  primitives1->invtransform.multVecMatrix(p1.xf_vertex[2], p1.vertex[2]);
+
+  SoIntersectingPrimitive p2;
+  p2.path = primitives2->getPath();
+  p2.type = SoIntersectingPrimitive::TRIANGLE;
+  t2->getValue(p2.xf_vertex[0], p2.xf_vertex[1], p2.xf_vertex[2]);
+  primitives2->invtransform.multVecMatrix(p2.xf_vertex[0], p2.vertex[0]);
+  primitives2->invtransform.multVecMatrix(p2.xf_vertex[1], p2.vertex[1]);
+  primitives2->invtransform.multVecMatrix(p2.xf_vertex[2], p2.vertex[2]);
+
+  std::vector<SoIntersectionCallback>::iterator it = this->callbacks.begin();
+  while (it != this->callbacks.end()) {
+    switch ( (*it).first((*it).second, &p1, &p2) ) {
+    case SoIntersectionDetectionAction::NEXT_PRIMITIVE:
+      // Break out of the switch, invoke next callback.
+      break;
+    case SoIntersectionDetectionAction::NEXT_SHAPE:
+      // FIXME: remaining callbacks won't be invoked -- should they? 20030328 mortene.
+      return SoIntersectionDetectionAction::NEXT_SHAPE;
+    case SoIntersectionDetectionAction::ABORT:
+      // FIXME: remaining callbacks won't be invoked -- should they? 20030328 mortene.
+      return SoIntersectionDetectionAction::ABORT;
+    default:
+      assert(0);
+    }
+    ++it;
+  }
+  return SoIntersectionDetectionAction::NEXT_PRIMITIVE;
+}
+
 // Intersection testing between primitives of different shapes.
 void
 SoIntersectionDetectionAction::PImpl::doPrimitiveIntersectionTesting(PrimitiveData * primitives1,
                                                              PrimitiveData * primitives2,
+                                                             IntersectionSink & sink,
                                                              SbBool & cont)
 {
   cont = TRUE;
@@ -1350,20 +1597,40 @@ SoIntersectionDetectionAction::PImpl::doPrimitiveIntersectionTesting(PrimitiveDa
   const float theepsilon = this->getEpsilon();
   const SbVec3f e(theepsilon, theepsilon, theepsilon);
 
+  // The octtree is queried for a batch of triangles at a time. The
+  // batch is kept small, as the rest of a batch is wasted when a
+  // callback asks for the next shape.
+  const unsigned int batchsize = 32;
+  SbList<SbBox3f> tribboxes(batchsize);
+  SbList<void*> candidatetris;
+  SbList<int> offsets(batchsize + 1);
+
   for (unsigned int i = 0; i < iterationprims->numTriangles(); i++) {
-    SbTri3f * t1 = static_cast<SbTri3f *>(iterationprims->getTriangle(i));
+    if (sink.isAborted()) {
+      cont = FALSE;
+      goto done;
+    }
 
-    SbBox3f tribbox = t1->getBoundingBox();
-    if (theepsilon > 0.0f) {
-      // Extend bbox in all 6 directions with the epsilon value.
-      tribbox.getMin() -= e;
-      tribbox.getMax() += e;
+    const unsigned int batchidx = i % batchsize;
+    if (batchidx == 0) {
+      const unsigned int end = SbMin(i + batchsize, iterationprims->numTriangles());
+      tribboxes.truncate(0);
+      for (unsigned int k = i; k < end; k++) {
+        SbBox3f tribbox = iterationprims->getTriangle(k)->getBoundingBox();
+        if (theepsilon > 0.0f) {
+          // Extend bbox in all 6 directions with the epsilon value.
+          tribbox.getMin() -= e;
+          tribbox.getMax() += e;
+        }
+        tribboxes.append(tribbox);
+      }
+      octtree->findItems(tribboxes.getArrayPtr(), tribboxes.getLength(),
+                         candidatetris, offsets);
     }
 
-    SbList<void*> candidatetris;
-    octtree->findItems(tribbox, candidatetris);
+    SbTri3f * t1 = static_cast<SbTri3f *>(iterationprims->getTriangle(i));
 
-    for (int j = 0; j < candidatetris.getLength(); j++) {
+    for (int j = offsets[batchidx]; j < offsets[batchidx + 1]; j++) {
       SbTri3f * t2 = static_cast<SbTri3f *>(candidatetris[j]);
 
       nrisectchks++;
@@ -1371,40 +1638,17 @@ SoIntersectionDetectionAction::PImpl::doPrimitiveIntersectionTesting(PrimitiveDa
       if (t1->intersect(*t2, theepsilon)) {
         nrhits++;
 
-        SoIntersectingPrimitive p1;
-        p1.path = iterationprims->getPath();
-        p1.type = SoIntersectingPrimitive::TRIANGLE;
-        t1->getValue(p1.xf_vertex[0], p1.xf_vertex[1], p1.xf_vertex[2]);
-        iterationprims->invtransform.multVecMatrix(p1.xf_vertex[0], p1.vertex[0]);
-        iterationprims->invtransform.multVecMatrix(p1.xf_vertex[1], p1.vertex[1]);
-        iterationprims->invtransform.multVecMatrix(p1.xf_vertex[2], p1.vertex[2]);
-
-        SoIntersectingPrimitive p2;
-        p2.path = octtreeprims->getPath();
-        p2.type = SoIntersectingPrimitive::TRIANGLE;
-        t2->getValue(p2.xf_vertex[0], p2.xf_vertex[1], p2.xf_vertex[2]);
-        octtreeprims->invtransform.multVecMatrix(p2.xf_vertex[0], p2.vertex[0]);
-        octtreeprims->invtransform.multVecMatrix(p2.xf_vertex[1], p2.vertex[1]);
-        octtreeprims->invtransform.multVecMatrix(p2.xf_vertex[2], p2.vertex[2]);
-
-        std::vector<SoIntersectionCallback>::iterator it = this->callbacks.begin();
-        while (it != this->callbacks.end()) {
-          switch ( (*it).first((*it).second, &p1, &p2) ) {
-          case SoIntersectionDetectionAction::NEXT_PRIMITIVE:
-            // Break out of the switch, invoke next callback.
-            break;
-          case SoIntersectionDetectionAction::NEXT_SHAPE:
-            // FIXME: remaining callbacks won't be invoked -- should they? 20030328 mortene.
-            cont = TRUE;
-            goto done;
-          case SoIntersectionDetectionAction::ABORT:
-            // FIXME: remaining callbacks won't be invoked -- should they? 20030328 mortene.
-            cont = FALSE;
-            goto done;
-          default:
-            assert(0);
-          }
-          ++it;
+        switch (sink.hit(iterationprims, t1, octtreeprims, t2)) {
+        case SoIntersectionDetectionAction::NEXT_PRIMITIVE:
+          break;
+        case SoIntersectionDetectionAction::NEXT_SHAPE:
+          cont = TRUE;
+          goto done;
+        case SoIntersectionDetectionAction::ABORT:
+          cont = FALSE;
+          goto done;
+        default:
+          assert(0);
         }
       }
     }
@@ -1432,6 +1676,7 @@ done:
 // between distinct shapes.
 void
 SoIntersectionDetectionAction::PImpl::doInternalPrimitiveIntersectionTesting(PrimitiveData * primitives,
+                                                                     IntersectionSink & sink,
                                                                      SbBool & cont)
 {
   // for debugging
@@ -1449,42 +1694,26 @@ SoIntersectionDetectionAction::PImpl::doInternalPrimitiveIntersectionTesting(Pri
   cont = TRUE;
   const int numprimitives = primitives->numTriangles();
   for (int i = 0; i < numprimitives; i++ ) {
+    if (sink.isAborted()) {
+      cont = FALSE;
+      goto done;
+    }
     SbTri3f * t1 = static_cast<SbTri3f *>(primitives->getTriangle(i));
     for (int j = i + 1; j < numprimitives; j++ ) {
       SbTri3f * t2 = static_cast<SbTri3f *>(primitives->getTriangle(j));
       nrisectchks++;
       if ( t1->intersect(*t2) ) {
-        SoIntersectingPrimitive p1;
-        p1.path = primitives->getPath();
-        p1.type = SoIntersectingPrimitive::TRIANGLE;
-        t1->getValue(p1.xf_vertex[0], p1.xf_vertex[1], p1.xf_vertex[2]);
-        primitives->invtransform.multVecMatrix(p1.xf_vertex[0], p1.vertex[0]);
-        primitives->invtransform.multVecMatrix(p1.xf_vertex[1], p1.vertex[1]);
-        primitives->invtransform.multVecMatrix(p1.xf_vertex[2], p1.vertex[2]);
-
-        SoIntersectingPrimitive p2;
-        p2.path = primitives->getPath();
-        p2.type = SoIntersectingPrimitive::TRIANGLE;
-        t2->getValue(p2.xf_vertex[0], p2.xf_vertex[1], p2.xf_vertex[2]);
-        primitives->invtransform.multVecMatrix(p2.xf_vertex[0], p2.vertex[0]);
-        primitives->invtransform.multVecMatrix(p2.xf_vertex[1], p2.vertex[1]);
-        primitives->invtransform.multVecMatrix(p2.xf_vertex[2], p2.vertex[2]);
-
-        std::vector<SoIntersectionCallback>::iterator it = this->callbacks.begin();
-        while (it != this->callbacks.end()) {
-          switch ( (*it).first((*it).second, &p1, &p2) ) {
-          case SoIntersectionDetectionAction::NEXT_PRIMITIVE:
-            break;
-          case SoIntersectionDetectionAction::NEXT_SHAPE:
-            cont = TRUE;
-            goto done;
-          case SoIntersectionDetectionAction::ABORT:
-            cont = FALSE;
-            goto done;
-          default:
-            assert(0);
-          }
-          ++it;
+        switch (sink.hit(primitives, t1, primitives, t2)) {
+        case SoIntersectionDetectionAction::NEXT_PRIMITIVE:
+          break;
+        case SoIntersectionDetectionAction::NEXT_SHAPE:
+          cont = TRUE;
+          goto done;
+        case SoIntersectionDetectionAction::ABORT:
+          cont = FALSE;
+          goto done;
+        default:
+          assert(0);
         }
       }
     }
@@ -1497,4 +1726,290 @@ SoIntersectionDetectionAction::PImpl::doInternalPrimitiveIntersectionTesting(Pri
   }
 }
 
+// *************************************************************************
+
+// Parallel intersection testing. The shape pairs with overlapping
+// bounding boxes are collected on the calling thread, which also
+// generates the primitives of the shapes, as that involves scene
+// graph traversal. The primitive octtrees are then built, and the
+// shape pairs tested, on all threads.
+
+#ifdef HAVE_THREADS
+
+// Collects the intersections found for a shape pair.
+class SoIntersectionDetectionAction::PImpl::RecordingSink : public IntersectionSink {
+public:
+  RecordingSink(SbList<IntersectionJob::Hit> & hitsarg) : hits(hitsarg) { }
+
+  virtual SoIntersectionDetectionAction::Resp hit(PrimitiveData * primitives1, SbTri3f * t1,
+                                                  PrimitiveData * primitives2, SbTri3f * t2)
+  {
+    IntersectionJob::Hit hit;
+    hit.primitives1 = primitives1;
+    hit.t1 = t1;
+    hit.primitives2 = primitives2;
+    hit.t2 = t2;
+    this->hits.append(hit);
+    return SoIntersectionDetectionAction::NEXT_PRIMITIVE;
+  }
+
+private:
+  SbList<IntersectionJob::Hit> & hits;
+};
+
+// Invokes the intersection callbacks from the testing threads, one
+// at a time.
+class SoIntersectionDetectionAction::PImpl::SerializingSink : public IntersectionSink {
+public:
+  SerializingSink(SoIntersectionDetectionAction::PImpl * pimplarg)
+    : pimpl(pimplarg), aborted(false) { }
+
+  virtual SoIntersectionDetectionAction::Resp hit(PrimitiveData * primitives1, SbTri3f * t1,
+                                                  PrimitiveData * primitives2, SbTri3f * t2)
+  {
+    this->mutex.lock();
+    SoIntersectionDetectionAction::Resp resp = SoIntersectionDetectionAction::ABORT;
+    if (!this->aborted.load()) {
+      resp = this->pimpl->invokeCallbacks(primitives1, t1, primitives2, t2);
+      if (resp == SoIntersectionDetectionAction::ABORT) { this->aborted.store(true); }
+    }
+    this->mutex.unlock();
+    return resp;
+  }
+
+  virtual SbBool isAborted(void) const { return this->aborted.load(); }
+
+private:
+  SoIntersectionDetectionAction::PImpl * pimpl;
+  SbMutex mutex;
+  std::atomic<bool> aborted;
+};
+
+class SoIntersectionDetectionAction::PImpl::IntersectionJobTester {
+public:
+  IntersectionJobTester(SoIntersectionDetectionAction::PImpl * pimplarg,
+                        std::vector<IntersectionJob> & jobsarg,
+                        SerializingSink * sinkarg)
+    : pimpl(pimplarg), jobs(jobsarg), sink(sinkarg) { }
+
+  void operator()(const int begin, const int end) const {
+    for (int i = begin; i < end; i++) {
+      IntersectionJob & job = this->jobs[i];
+      RecordingSink recorder(job.hits);
+      IntersectionSink & s = this->sink ? static_cast<IntersectionSink &>(*this->sink) : recorder;
+      if (s.isAborted()) return;
+
+      SbBool cont;
+      if (job.shape2) {
+        this->pimpl->doPrimitiveIntersectionTesting(job.shape1->getPrimitives(),
+                                                    job.shape2->getPrimitives(), s, cont);
+      }
+      else {
+        this->pimpl->doInternalPrimitiveIntersectionTesting(job.shape1->getPrimitives(), s, cont);
+      }
+    }
+  }
+
+private:
+  SoIntersectionDetectionAction::PImpl * pimpl;
+  std::vector<IntersectionJob> & jobs;
+  SerializingSink * sink;
+};
+
+class OctTreeBuilder {
+public:
+  OctTreeBuilder(const std::vector<PrimitiveData *> & primitivesarg)
+    : primitives(primitivesarg) { }
+
+  void operator()(const int begin, const int end) const {
+    for (int i = begin; i < end; i++) { (void)this->primitives[i]->getOctTree(); }
+  }
+
+private:
+  const std::vector<PrimitiveData *> & primitives;
+};
+
+void
+SoIntersectionDetectionAction::PImpl::doParallelIntersectionTesting(std::vector<IntersectionJob> & jobs,
+                                                                    SbTaskScheduler * scheduler)
+{
+  const int numjobs = static_cast<int>(jobs.size());
+
+  // Generate primitives, and find the primitives that will be looked
+  // up in an octtree, as doPrimitiveIntersectionTesting() would.
+  std::vector<PrimitiveData *> octtreeprims;
+  for (int i = 0; i < numjobs; i++) {
+    PrimitiveData * primitives1 = jobs[i].shape1->getPrimitives();
+    if (jobs[i].shape2 == NULL) continue;
+    PrimitiveData * primitives2 = jobs[i].shape2->getPrimitives();
+    octtreeprims.push_back((primitives1->numTriangles() < primitives2->numTriangles()) ?
+                           primitives2 : primitives1);
+  }
+  std::sort(octtreeprims.begin(), octtreeprims.end());
+  octtreeprims.erase(std::unique(octtreeprims.begin(), octtreeprims.end()), octtreeprims.end());
+  SbTaskScheduler::parallelFor(0, static_cast<int>(octtreeprims.size()), 1,
+                               OctTreeBuilder(octtreeprims), scheduler);
+
+  if (this->ordering == SoIntersectionDetectionAction::UNORDERED) {
+    SerializingSink sink(this);
+    SbTaskScheduler::parallelFor(0, numjobs, 1,
+                                 IntersectionJobTester(this, jobs, &sink), scheduler);
+    return;
+  }
+
+  // Test the shape pairs in batches, to bound the memory used for
+  // intersections waiting for their callbacks, and so that ABORT
+  // doesn't leave too much testing to be done for nothing.
+  const int batchsize = 64 * (scheduler->getNumWorkers() + 1);
+  for (int batch = 0; batch < numjobs; batch += batchsize) {
+    const int batchend = SbMin(batch + batchsize, numjobs);
+    SbTaskScheduler::parallelFor(batch, batchend, 1,
+                                 IntersectionJobTester(this, jobs, NULL), scheduler);
+
+    for (int i = batch; i < batchend; i++) {
+      const SbList<IntersectionJob::Hit> & hits = jobs[i].hits;
+      for (int j = 0; j < hits.getLength(); j++) {
+        const IntersectionJob::Hit & hit = hits[j];
+        const Resp resp = this->invokeCallbacks(hit.primitives1, hit.t1,
+                                                hit.primitives2, hit.t2);
+        if (resp == SoIntersectionDetectionAction::NEXT_SHAPE) break;
+        if (resp == SoIntersectionDetectionAction::ABORT) return;
+      }
+      jobs[i].hits.truncate(0, TRUE);
+    }
+  }
+}
+
+#endif // HAVE_THREADS
+
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoSphere.h>
+#include <Inventor/nodes/SoTranslation.h>
+#include <Inventor/nodes/SoComplexity.h>
+
+namespace {
+
+  // A row of spheres, each intersecting its neighbours.
+  SoSeparator *
+  ida_test_scene(const int num)
+  {
+    SoSeparator * root = new SoSeparator;
+    SoComplexity * complexity = new SoComplexity;
+    complexity->value = 0.3f;
+    root->addChild(complexity);
+    for (int i = 0; i < num; i++) {
+      SoSeparator * sep = new SoSeparator;
+      SoTranslation * translation = new SoTranslation;
+      translation->translation.setValue(1.5f * i, 0.1f * (i % 3), 0.0f);
+      sep->addChild(translation);
+      sep->addChild(new SoSphere);
+      root->addChild(sep);
+    }
+    return root;
+  }
+
+  struct ida_test_hits {
+    ida_test_hits(void) : maxhits(0), nextshape(FALSE) { }
+    SbList<SoNode *> shapes;
+    SbList<SbVec3f> vertices;
+    int maxhits; // ABORT after this many, if > 0
+    SbBool nextshape; // always go on to the next shape pair
+  };
+
+  SoIntersectionDetectionAction::Resp
+  ida_test_callback(void * closure,
+                    const SoIntersectingPrimitive * p1,
+                    const SoIntersectingPrimitive * p2)
+  {
+    ida_test_hits * hits = static_cast<ida_test_hits *>(closure);
+    hits->shapes.append(p1->path->getTail());
+    hits->shapes.append(p2->path->getTail());
+    hits->vertices.append(p1->xf_vertex[0]);
+    hits->vertices.append(p2->xf_vertex[0]);
+    if ((hits->maxhits > 0) && (hits->shapes.getLength() / 2 >= hits->maxhits)) {
+      return SoIntersectionDetectionAction::ABORT;
+    }
+    // test the rest of the primitives for every second pair only
+    return (hits->nextshape || (hits->shapes.getLength() % 4)) ?
+      SoIntersectionDetectionAction::NEXT_SHAPE :
+      SoIntersectionDetectionAction::NEXT_PRIMITIVE;
+  }
+
+  void
+  ida_test_apply(SoNode * root, const int numthreads,
+                 const SoIntersectionDetectionAction::CallbackOrdering ordering,
+                 ida_test_hits & hits)
+  {
+    SoIntersectionDetectionAction ida;
+    ida.setNumThreads(numthreads);
+    ida.setCallbackOrdering(ordering);
+    ida.setIntersectionDetectionEpsilon(0.05f);
+    ida.addIntersectionCallback(ida_test_callback, &hits);
+    ida.apply(root);
+  }
+
+  SbBool
+  ida_test_equal(const ida_test_hits & a, const ida_test_hits & b)
+  {
+    if (a.shapes.getLength() != b.shapes.getLength()) return FALSE;
+    for (int i = 0; i < a.shapes.getLength(); i++) {
+      if (a.shapes[i] != b.shapes[i]) return FALSE;
+      if (a.vertices[i] != b.vertices[i]) return FALSE;
+    }
+    return TRUE;
+  }
+
+}
+
+BOOST_AUTO_TEST_CASE(parallelTesting)
+{
+  SoSeparator * root = ida_test_scene(20);
+  root->ref();
+
+  ida_test_hits serial;
+  ida_test_apply(root, 1, SoIntersectionDetectionAction::ORDERED, serial);
+  BOOST_CHECK_MESSAGE(serial.shapes.getLength() > 0, "no intersections found");
+
+  ida_test_hits ordered;
+  ida_test_apply(root, 4, SoIntersectionDetectionAction::ORDERED, ordered);
+  BOOST_CHECK_MESSAGE(ida_test_equal(serial, ordered),
+                      "ordered callbacks differ from single-threaded testing");
+
+  // the same shape pairs are reported, although not necessarily in
+  // the same order
+  ida_test_hits serialpairs, unorderedpairs;
+  serialpairs.nextshape = unorderedpairs.nextshape = TRUE;
+  ida_test_apply(root, 1, SoIntersectionDetectionAction::ORDERED, serialpairs);
+  ida_test_apply(root, 4, SoIntersectionDetectionAction::UNORDERED, unorderedpairs);
+  BOOST_CHECK_EQUAL(unorderedpairs.shapes.getLength(), serialpairs.shapes.getLength());
+  SbBool samepairs = TRUE;
+  for (int i = 0; i < serialpairs.shapes.getLength(); i += 2) {
+    SbBool found = FALSE;
+    for (int j = 0; (j < unorderedpairs.shapes.getLength()) && !found; j += 2) {
+      found =
+        (serialpairs.shapes[i] == unorderedpairs.shapes[j]) &&
+        (serialpairs.shapes[i + 1] == unorderedpairs.shapes[j + 1]);
+    }
+    if (!found) samepairs = FALSE;
+  }
+  BOOST_CHECK_MESSAGE(samepairs, "unordered callbacks report other shape pairs");
+
+  // ABORT stops testing, also with more threads
+  ida_test_hits serialabort, orderedabort, unorderedabort;
+  serialabort.maxhits = orderedabort.maxhits = unorderedabort.maxhits = 5;
+  ida_test_apply(root, 1, SoIntersectionDetectionAction::ORDERED, serialabort);
+  ida_test_apply(root, 4, SoIntersectionDetectionAction::ORDERED, orderedabort);
+  ida_test_apply(root, 4, SoIntersectionDetectionAction::UNORDERED, unorderedabort);
+  BOOST_CHECK_EQUAL(serialabort.shapes.getLength(), 10);
+  BOOST_CHECK_MESSAGE(ida_test_equal(serialabort, orderedabort),
+                      "ordered callbacks differ from single-threaded testing after ABORT");
+  BOOST_CHECK_EQUAL(unorderedabort.shapes.getLength(), 10);
+
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -52,6 +52,7 @@
 #include <Inventor/system/gl.h>
 #include <Inventor/misc/SoContextHandler.h>
 #include <Inventor/misc/SoGLDriverDatabase.h>
+#include <Inventor/threads/SbStorage.h>
 
 #include "rendering/SoGL.h"
 #include "threads/threadsutilp.h"
@@ -89,6 +90,17 @@ static SbList <SoGLDisplayList*> * scheduledeletelist;
 static SbList <so_scheduledeletecb_info*> * scheduledeletecblist;
 static void * glcache_mutex;
 
+// The number of primitives each thread has sent to OpenGL as vertex
+// data while a render cache was open. Kept outside the element to
+// leave its layout unchanged.
+static SbStorage * soglcache_primitivestorage;
+
+static void
+soglcache_primitivecount_construct(void * data)
+{
+  *static_cast<uint32_t *>(data) = 0;
+}
+
 // needed to be able to remove the callback in the cleanup function
 // (SoGLCacheContextElement::cleanupContext() is private)
 static SoContextHandler::ContextDestructionCB * soglcache_contextdestructioncb;
@@ -109,6 +121,8 @@ static void soglcachecontext_cleanup(void)
   delete scheduledeletelist;
   delete scheduledeletecblist;
   CC_MUTEX_DESTRUCT(glcache_mutex);
+  delete soglcache_primitivestorage;
+  soglcache_primitivestorage = NULL;
 
   if (soglcache_contextdestructioncb) {
     SoContextHandler::removeContextDestructionCallback(soglcache_contextdestructioncb, NULL);
@@ -174,6 +188,8 @@ SoGLCacheContextElement::initClass(void)
   scheduledeletelist = new SbList <SoGLDisplayList*>;
   scheduledeletecblist = new SbList <so_scheduledeletecb_info*>;
   CC_MUTEX_CONSTRUCT(glcache_mutex);
+  soglcache_primitivestorage =
+    new SbStorage(sizeof(uint32_t), soglcache_primitivecount_construct, NULL);
   coin_atexit((coin_atexit_f *)soglcachecontext_cleanup, CC_ATEXIT_NORMAL);
 
   // add a callback which is called every time a GL-context is
@@ -541,3 +557,24 @@ SoGLCacheContextElement::getUniqueCacheContext(void)
   CC_MUTEX_UNLOCK(glcache_mutex);
   return id;
 }
+
+// *************************************************************************
+
+// Adds to the number of primitives the current thread has sent to
+// OpenGL as vertex data while recording a render cache.
+void
+sogl_autocache_add_primitives(const int numprimitives)
+{
+  *static_cast<uint32_t *>(soglcache_primitivestorage->get()) +=
+    static_cast<uint32_t>(numprimitives);
+}
+
+// Returns the number of primitives the current thread has sent to
+// OpenGL while recording render caches. SoGLCacheList uses the
+// difference between the values before and after recording a cache
+// to estimate its memory usage. The counter wraps around.
+uint32_t
+sogl_autocache_get_num_primitives(void)
+{
+  return *static_cast<uint32_t *>(soglcache_primitivestorage->get());
+}
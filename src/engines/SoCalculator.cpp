@@ -172,6 +172,15 @@
   have several statements in one expression. You just separate them
   with semicolons.
 
+  Since Coin 4.1, the expressions are compiled to a simple register
+  program the first time the engine is evaluated, and this program is
+  run on blocks of input values at a time, which is much faster than
+  evaluating the expressions one value at a time for large inputs.
+  Expressions using \e rand(), and expressions reading a temporary
+  variable before it has been assigned (i.e. using the value from the
+  previous input value), are evaluated one value at a time, like
+  before.
+
   Here is a simple example of how an SoCalculator engine may be used
   in an .iv file:
 
@@ -209,8 +218,11 @@
 #include "SbBasicP.h"
 
 #include <cassert>
+#include <cstdlib>
+#include <vector>
 
 #include <Inventor/lists/SoEngineOutputList.h>
+#include <Inventor/C/tidbits.h>
 
 #if COIN_DEBUG
 #include <Inventor/errors/SoDebugError.h>
@@ -218,6 +230,8 @@
 
 #include "engines/evaluator.h"
 #include "engines/SoSubEngineP.h"
+#include "threads/threadsutilp.h"
+#include "tidbitsp.h"
 
 /*!
   \var SoMFFloat SoCalculator::a
@@ -322,6 +336,8 @@
 
 class SoCalculatorP {
 public:
+  SoCalculatorP(void) : program(NULL) { }
+
   float ta_th[8];
   SbVec3f tA_tH[8];
 
@@ -330,8 +346,148 @@ public:
   float oa_od[4];
   SbVec3f oA_oD[4];
   SbList <struct so_eval_node*> evaluatorList;
+
+  // the expressions compiled to a register program, or NULL if they
+  // must be evaluated one element at a time with so_eval_evaluate()
+  so_eval_program * program;
+  std::vector<float> registers;
+  std::vector<float> floatout[4];
+  std::vector<SbVec3f> vecout[4];
+
+  static SbBool compile;
+  // the expression parser uses global state, and calculators can be
+  // evaluated on several threads (see SoEngine::evaluateDirtyEngines())
+  static void * parsemutex;
+
+  static void cleanup(void);
+  void deleteExpressions(void);
+  void runProgram(SoCalculator * master, const int num,
+                  const char * inused, const char * outused);
 };
 
+SbBool SoCalculatorP::compile = TRUE;
+void * SoCalculatorP::parsemutex = NULL;
+
+void
+SoCalculatorP::cleanup(void)
+{
+  CC_MUTEX_DESTRUCT(SoCalculatorP::parsemutex);
+}
+
+void
+SoCalculatorP::deleteExpressions(void)
+{
+  for (int i = 0; i < this->evaluatorList.getLength(); i++) {
+    so_eval_delete(this->evaluatorList[i]);
+  }
+  this->evaluatorList.truncate(0);
+  so_eval_program_delete(this->program);
+  this->program = NULL;
+}
+
+// Evaluates the compiled expressions for SO_EVAL_BLOCKSIZE elements
+// at a time, and writes each output field in one go.
+void
+SoCalculatorP::runProgram(SoCalculator * master, const int num,
+                          const char * inused, const char * outused)
+{
+  const int bs = SO_EVAL_BLOCKSIZE;
+  this->registers.resize(so_eval_program_num_registers(this->program) * bs);
+  float * regs = &this->registers[0];
+  int i, j;
+
+  for (i = 0; i < 4; i++) {
+    if (outused[i]) this->floatout[i].resize(num);
+    if (outused[i+4]) this->vecout[i].resize(num);
+  }
+
+  // temporary registers keep their values between evaluations
+  for (i = 0; i < 8; i++) {
+    for (j = 0; j < bs; j++) {
+      regs[(SO_EVAL_REG_TMP_FLT + i) * bs + j] = this->ta_th[i];
+      for (int k = 0; k < 3; k++) {
+        regs[(SO_EVAL_REG_TMP_VEC + i * 3 + k) * bs + j] = this->tA_tH[i][k];
+      }
+    }
+  }
+
+  const SoMFFloat * floatin[8] = {
+    &master->a, &master->b, &master->c, &master->d,
+    &master->e, &master->f, &master->g, &master->h
+  };
+  const SoMFVec3f * vecin[8] = {
+    &master->A, &master->B, &master->C, &master->D,
+    &master->E, &master->F, &master->G, &master->H
+  };
+
+  int count = 0;
+  for (int start = 0; start < num; start += bs) {
+    count = SbMin(num - start, bs);
+
+    // inputs with fewer values than the others repeat their last value
+    for (i = 0; i < 8; i++) {
+      if (inused[i]) {
+        const int n = floatin[i]->getNum();
+        const float * src = floatin[i]->getValues(0);
+        float * dst = regs + (SO_EVAL_REG_IN_FLT + i) * bs;
+        for (j = 0; j < count; j++) {
+          dst[j] = n ? src[SbMin(start + j, n - 1)] : 0.0f;
+        }
+      }
+      if (inused[i+8]) {
+        const int n = vecin[i]->getNum();
+        const SbVec3f * src = vecin[i]->getValues(0);
+        float * dst = regs + (SO_EVAL_REG_IN_VEC + i * 3) * bs;
+        for (j = 0; j < count; j++) {
+          const SbVec3f v = n ? src[SbMin(start + j, n - 1)] : SbVec3f(0.0f, 0.0f, 0.0f);
+          dst[j] = v[0];
+          dst[j + bs] = v[1];
+          dst[j + 2 * bs] = v[2];
+        }
+      }
+    }
+    // outputs start out as zero for each element
+    for (j = 0; j < (SO_EVAL_NUM_FIELD_REGS - SO_EVAL_REG_OUT_FLT) * bs; j++) {
+      regs[SO_EVAL_REG_OUT_FLT * bs + j] = 0.0f;
+    }
+
+    so_eval_program_run(this->program, regs, count);
+
+    for (i = 0; i < 4; i++) {
+      if (outused[i]) {
+        const float * src = regs + (SO_EVAL_REG_OUT_FLT + i) * bs;
+        float * dst = &this->floatout[i][start];
+        for (j = 0; j < count; j++) dst[j] = src[j];
+      }
+      if (outused[i+4]) {
+        const float * src = regs + (SO_EVAL_REG_OUT_VEC + i * 3) * bs;
+        SbVec3f * dst = &this->vecout[i][start];
+        for (j = 0; j < count; j++) {
+          dst[j].setValue(src[j], src[j + bs], src[j + 2 * bs]);
+        }
+      }
+    }
+  }
+
+  // keep the temporary registers from the last element
+  for (i = 0; i < 8; i++) {
+    this->ta_th[i] = regs[(SO_EVAL_REG_TMP_FLT + i) * bs + count - 1];
+    for (int k = 0; k < 3; k++) {
+      this->tA_tH[i][k] = regs[(SO_EVAL_REG_TMP_VEC + i * 3 + k) * bs + count - 1];
+    }
+  }
+
+  if (outused[0]) { SO_ENGINE_OUTPUT(master->oa, SoMFFloat, setValues(0, num, &this->floatout[0][0])); }
+  if (outused[1]) { SO_ENGINE_OUTPUT(master->ob, SoMFFloat, setValues(0, num, &this->floatout[1][0])); }
+  if (outused[2]) { SO_ENGINE_OUTPUT(master->oc, SoMFFloat, setValues(0, num, &this->floatout[2][0])); }
+  if (outused[3]) { SO_ENGINE_OUTPUT(master->od, SoMFFloat, setValues(0, num, &this->floatout[3][0])); }
+
+  if (outused[4]) { SO_ENGINE_OUTPUT(master->oA, SoMFVec3f, setValues(0, num, &this->vecout[0][0])); }
+  if (outused[5]) { SO_ENGINE_OUTPUT(master->oB, SoMFVec3f, setValues(0, num, &this->vecout[1][0])); }
+  if (outused[6]) { SO_ENGINE_OUTPUT(master->oC, SoMFVec3f, setValues(0, num, &this->vecout[2][0])); }
+  if (outused[7]) { SO_ENGINE_OUTPUT(master->oD, SoMFVec3f, setValues(0, num, &this->vecout[3][0])); }
+}
+
 #define PRIVATE(thisp) (thisp->pimpl)
 #define THISP(POINTER) static_cast<SoCalculator *>(POINTER)
 
@@ -386,9 +542,7 @@ SoCalculator::SoCalculator(void)
 */
 SoCalculator::~SoCalculator(void)
 {
-  for (int i = 0; i < PRIVATE(this)->evaluatorList.getLength(); i++) {
-    so_eval_delete(PRIVATE(this)->evaluatorList[i]);
-  }
+  PRIVATE(this)->deleteExpressions();
   delete PRIVATE(this);
 }
 
@@ -399,6 +553,12 @@ void
 SoCalculator::initClass(void)
 {
   SO_ENGINE_INTERNAL_INIT_CLASS(SoCalculator);
+
+  const char * env = coin_getenv("COIN_CALCULATOR_NO_COMPILE");
+  SoCalculatorP::compile = !(env && atoi(env) > 0);
+
+  CC_MUTEX_CONSTRUCT(SoCalculatorP::parsemutex);
+  coin_atexit(SoCalculatorP::cleanup, CC_ATEXIT_NORMAL);
 }
 
 // Documented in superclass.
@@ -411,6 +571,7 @@ SoCalculator::evaluate(void)
       this->expression[0].getLength() == 0) return;
 
   if (PRIVATE(this)->evaluatorList.getLength() == 0) {
+    CC_MUTEX_LOCK(SoCalculatorP::parsemutex);
     for (i = 0; i < this->expression.getNum(); i++) {
       const SbString &s = this->expression[i];
       if (s.getLength()) {
@@ -424,6 +585,12 @@ SoCalculator::evaluate(void)
       }
       else PRIVATE(this)->evaluatorList.append(NULL);
     }
+    CC_MUTEX_UNLOCK(SoCalculatorP::parsemutex);
+    if (SoCalculatorP::compile) {
+      PRIVATE(this)->program =
+        so_eval_compile(PRIVATE(this)->evaluatorList.getArrayPtr(),
+                        PRIVATE(this)->evaluatorList.getLength());
+    }
   }
 
 
@@ -465,6 +632,11 @@ SoCalculator::evaluate(void)
   if (outused[6]) { SO_ENGINE_OUTPUT(oC, SoMFVec3f, setNum(maxnum)); }
   if (outused[7]) { SO_ENGINE_OUTPUT(oD, SoMFVec3f, setNum(maxnum)); }
 
+  if (PRIVATE(this)->program) {
+    PRIVATE(this)->runProgram(this, maxnum, inused, outused);
+    return;
+  }
+
   // loop through all fieldindices and evaluate
   for (i = 0; i < maxnum; i++) {
     // just initialize output registers to default values
@@ -607,10 +779,7 @@ SoCalculator::inputChanged(SoField *which)
 {
   // if expression changes we have to rebuild the eval tree structure
   if (which == &this->expression) {
-    for (int i = 0; i < PRIVATE(this)->evaluatorList.getLength(); i++) {
-      so_eval_delete(PRIVATE(this)->evaluatorList[i]);
-    }
-    PRIVATE(this)->evaluatorList.truncate(0);
+    PRIVATE(this)->deleteExpressions();
   }
 }
 
@@ -713,3 +882,150 @@ SoCalculator::writefieldcb(const char *fieldname, float *data,
 
 #undef THISP
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <cstdlib>
+#include <Inventor/SbVec3f.h>
+#include <Inventor/fields/SoMFFloat.h>
+#include <Inventor/fields/SoMFVec3f.h>
+
+BOOST_AUTO_TEST_CASE(evaluateArrays)
+{
+  // more values than one block of the compiled program, and an input
+  // with fewer values than the others
+  const int num = 150;
+  SoCalculator * calc = new SoCalculator;
+  calc->ref();
+  calc->expression.set1Value(0, "ta = a * 2; oa = (ta > b) ? ta - b : -b");
+  calc->expression.set1Value(1, "oA = cross(A, vec3f(0, 0, 1)) + B; oA[2] = ta");
+  for (int i = 0; i < num; i++) {
+    calc->a.set1Value(i, float(i));
+    calc->b.set1Value(i, float(num - i));
+    calc->A.set1Value(i, SbVec3f(float(i), 1.0f, 0.0f));
+  }
+  calc->B.setValue(SbVec3f(0.0f, 0.0f, 5.0f));
+
+  SoMFFloat oa;
+  SoMFVec3f oA;
+  oa.connectFrom(&calc->oa);
+  oA.connectFrom(&calc->oA);
+
+  BOOST_CHECK_EQUAL(oa.getNum(), num);
+  BOOST_CHECK_EQUAL(oA.getNum(), num);
+  for (int i = 0; i < num; i++) {
+    const float ta = float(i) * 2.0f;
+    const float b = float(num - i);
+    BOOST_CHECK_EQUAL(oa[i], (ta > b) ? ta - b : -b);
+    BOOST_CHECK(oA[i] == SbVec3f(1.0f, -float(i), ta));
+  }
+
+  oa.disconnect();
+  oA.disconnect();
+  calc->unref();
+}
+
+BOOST_AUTO_TEST_CASE(temporariesCarryOver)
+{
+  // tb is read before it is assigned, so it keeps the value from the
+  // previous input value
+  SoCalculator * calc = new SoCalculator;
+  calc->ref();
+  calc->expression.setValue("tb = tb + a; oa = tb");
+  const int num = 100;
+  for (int i = 0; i < num; i++) calc->a.set1Value(i, 1.0f);
+
+  SoMFFloat oa;
+  oa.connectFrom(&calc->oa);
+  BOOST_CHECK_EQUAL(oa.getNum(), num);
+  for (int i = 0; i < num; i++) {
+    BOOST_CHECK_EQUAL(oa[i], float(i + 1));
+  }
+  oa.disconnect();
+  calc->unref();
+}
+
+static void
+evaluate_calculator(const SbBool treewalker, SoMFFloat & oa, SoMFFloat & ob,
+                    SoMFVec3f & oA)
+{
+  SoCalculator * calc = new SoCalculator;
+  calc->ref();
+  calc->expression.set1Value(0, "ta = sin(a) * pow(fabs(b), 0.5) + atan2(a, b + 0.5)");
+  calc->expression.set1Value(1, "tb = fmod(a * 7, 3) - floor(b / 3) + ceil(-a / 4)");
+  calc->expression.set1Value(2, "oa = (a > b && !(a == 3)) || b >= 10 ? ta : -tb");
+  calc->expression.set1Value(3, "ob = sqrt(a) + exp(-b / 10) + log(a + 1) + log10(b + 1) + tanh(ta) + cos(M_PI * a)");
+  calc->expression.set1Value(4, "tA = normalize(A + vec3f(1, 0, 0)); oA = cross(tA, B) * length(A) + vec3f(dot(A, B), ta, tb)");
+  // expressions using rand() are not compiled
+  if (treewalker) calc->expression.set1Value(5, "tc = rand(0)");
+  const int num = 150;
+  for (int i = 0; i < num; i++) {
+    calc->a.set1Value(i, float(i % 17));
+    calc->b.set1Value(i, float(i % 13) - 4.0f);
+    calc->A.set1Value(i, SbVec3f(float(i % 5), float(i % 3) - 1.0f, 2.0f));
+  }
+  calc->B.setValue(SbVec3f(0.5f, -1.0f, 3.0f));
+
+  oa.connectFrom(&calc->oa);
+  ob.connectFrom(&calc->ob);
+  oA.connectFrom(&calc->oA);
+  (void)oa.getNum();
+  oa.disconnect();
+  ob.disconnect();
+  oA.disconnect();
+  calc->unref();
+}
+
+BOOST_AUTO_TEST_CASE(compiledMatchesTreeWalker)
+{
+  SoMFFloat oa0, ob0, oa1, ob1;
+  SoMFVec3f oA0, oA1;
+  evaluate_calculator(TRUE, oa0, ob0, oA0);
+  evaluate_calculator(FALSE, oa1, ob1, oA1);
+
+  BOOST_REQUIRE_EQUAL(oa0.getNum(), 150);
+  BOOST_REQUIRE_EQUAL(oa1.getNum(), oa0.getNum());
+  BOOST_REQUIRE_EQUAL(ob1.getNum(), ob0.getNum());
+  BOOST_REQUIRE_EQUAL(oA1.getNum(), oA0.getNum());
+  for (int i = 0; i < oa0.getNum(); i++) {
+    BOOST_CHECK_EQUAL(oa1[i], oa0[i]);
+    BOOST_CHECK_EQUAL(ob1[i], ob0[i]);
+    BOOST_CHECK(oA1[i] == oA0[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(randomSequence)
+{
+  // rand() is called once per statement and input value, in order,
+  // and only in the branch of ?: that is used, as the tree walker
+  // does. More values than one block of the compiled program.
+  SoCalculator * calc = new SoCalculator;
+  calc->ref();
+  calc->expression.set1Value(0, "ta = rand(a)");
+  calc->expression.set1Value(1, "oa = (a > 2) ? rand(1) : ta; ob = ta");
+  const int num = 150;
+  for (int i = 0; i < num; i++) calc->a.set1Value(i, float(i % 5));
+
+  SoMFFloat oa, ob;
+  oa.connectFrom(&calc->oa);
+  ob.connectFrom(&calc->ob);
+  calc->a.touch();
+  srand(1234);
+  BOOST_CHECK_EQUAL(oa.getNum(), num);
+  BOOST_CHECK_EQUAL(ob.getNum(), num);
+
+  srand(1234);
+  for (int i = 0; i < num; i++) {
+    const float a = float(i % 5);
+    const float ta = (float(rand()) / float(RAND_MAX)) * a;
+    const float expected = (a > 2) ? float(rand()) / float(RAND_MAX) : ta;
+    BOOST_CHECK_EQUAL(oa[i], expected);
+    BOOST_CHECK_EQUAL(ob[i], ta);
+  }
+
+  oa.disconnect();
+  ob.disconnect();
+  calc->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -54,25 +54,45 @@
   If you want complete control over when an engine gets destructed,
   use SoBase::ref() and SoBase::unref() for explicit
   referencing/dereferencing.
+
+  Engines are normally evaluated lazily, when a field connected to
+  one of their outputs is read, and the engines they depend on are
+  evaluated recursively from there. With large engine networks, like
+  a character rig with thousands of independent interpolators and
+  calculators, this means the engines are evaluated one by one in the
+  middle of the render traversal. Since Coin 4.1, the engines can
+  instead be scheduled: see enableEvaluationScheduling() and
+  evaluateDirtyEngines().
 */
 
 // *************************************************************************
 
 #include <Inventor/engines/SoEngine.h>
 
+#include <cstdlib>
+#include <cstring>
+
 #include "SbBasicP.h"
 
 #include <Inventor/engines/SoEngines.h>
 #include <Inventor/engines/SoNodeEngine.h>
 #include <Inventor/engines/SoOutputData.h>
 #include <Inventor/errors/SoDebugError.h>
+#include <Inventor/fields/SoFieldData.h>
 #include <Inventor/lists/SoEngineList.h>
 #include <Inventor/lists/SoEngineOutputList.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/C/tidbits.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif // HAVE_CONFIG_H
 #include "coindefs.h" // COIN_STUB()
+#include "tidbitsp.h"
+#include "misc/SbHash.h"
+#include "misc/SoDBP.h"
+#include "threads/taskschedulerp.h"
+#include "threads/threadsutilp.h"
 #ifdef COIN_THREADSAFE
 #include "threads/recmutexp.h"
 #endif // COIN_THREADSAFE
@@ -95,6 +115,191 @@ SoType SoEngine::classTypeId STATIC_SOTYPE_INIT;
 
 // *************************************************************************
 
+inline unsigned int SbHashFunc(const SoEngine * key)
+{
+  return SbHashFunc(reinterpret_cast<size_t>(key));
+}
+
+typedef SbHash<const SoEngine *, SoEngine *> SoEngineSet;
+
+// Keeps track of the engines made dirty while evaluation scheduling
+// is enabled, and evaluates them in dependency order.
+class SoEngineP {
+public:
+  static void track(SoEngine * engine);
+  static void untrack(SoEngine * engine);
+  static void evaluate(SbList<SoEngine *> & engines, const int numthreads);
+  static SbBool isParallelSafe(const SoEngine * engine);
+  static void cleanup(void);
+
+  static SbBool scheduling;
+  static SbBool evaluating;
+  static SoEngineSet * dirtyengines;
+  static void * mutex;
+  // engine types whose evaluate() only reads their inputs and writes
+  // their outputs, so they can be evaluated on any thread
+  static SbList<SoType> * paralleltypes;
+};
+
+SbBool SoEngineP::scheduling = FALSE;
+SbBool SoEngineP::evaluating = FALSE;
+SoEngineSet * SoEngineP::dirtyengines = NULL;
+void * SoEngineP::mutex = NULL;
+SbList<SoType> * SoEngineP::paralleltypes = NULL;
+
+void
+SoEngineP::cleanup(void)
+{
+  delete SoEngineP::dirtyengines;
+  SoEngineP::dirtyengines = NULL;
+  delete SoEngineP::paralleltypes;
+  SoEngineP::paralleltypes = NULL;
+  CC_MUTEX_DESTRUCT(SoEngineP::mutex);
+  SoEngineP::scheduling = FALSE;
+}
+
+void
+SoEngineP::track(SoEngine * engine)
+{
+  // notification can happen on several threads, e.g. when reading
+  // files in parallel
+  CC_MUTEX_LOCK(SoEngineP::mutex);
+  if (!(engine->flags & SoEngine::FLAG_ISSCHEDULED)) {
+    engine->flags |= SoEngine::FLAG_ISSCHEDULED;
+    SoEngineP::dirtyengines->put(engine, engine);
+  }
+  CC_MUTEX_UNLOCK(SoEngineP::mutex);
+}
+
+void
+SoEngineP::untrack(SoEngine * engine)
+{
+  CC_MUTEX_LOCK(SoEngineP::mutex);
+  if (engine->flags & SoEngine::FLAG_ISSCHEDULED) {
+    engine->flags &= ~SoEngine::FLAG_ISSCHEDULED;
+    (void)SoEngineP::dirtyengines->erase(engine);
+  }
+  CC_MUTEX_UNLOCK(SoEngineP::mutex);
+}
+
+SbBool
+SoEngineP::isParallelSafe(const SoEngine * engine)
+{
+  if (SoEngineP::paralleltypes->find(engine->getTypeId()) < 0) return FALSE;
+  // rand() shares its state between threads, and the values an
+  // expression gets would depend on the order the threads call it in
+  if (engine->getTypeId() == SoCalculator::getClassTypeId()) {
+    const SoMFString & expression = static_cast<const SoCalculator *>(engine)->expression;
+    for (int i = 0; i < expression.getNum(); i++) {
+      if (strstr(expression[i].getString(), "rand")) return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Evaluates the dirty engines in the list in dependency order. An
+// engine depends on the engines in the list connected to its
+// inputs. The engines are grouped in levels, where each engine comes
+// after all the engines it depends on, and the engines of a level are
+// evaluated in parallel. Engines which can't be evaluated on other
+// threads, or which read inputs needing evaluation through other
+// connections (from fields, node engines or field converters), are
+// evaluated on the calling thread after the rest of their level,
+// evaluating what they depend on lazily as usual.
+void
+SoEngineP::evaluate(SbList<SoEngine *> & engines, const int numthreads)
+{
+  const int num = engines.getLength();
+  SbHash<const SoEngine *, int> index(num * 2);
+  int i;
+  for (i = 0; i < num; i++) { index.put(engines[i], i); }
+
+  // dependency edges, from the engine feeding an input to the engine
+  SbList<int> from, to;
+  SbList<SbBool> parallel(num);
+  for (i = 0; i < num; i++) {
+    SoEngine * engine = engines[i];
+    SbBool safe = SoEngineP::isParallelSafe(engine);
+    const SoFieldData * fd = engine->getFieldData();
+    const int numfields = fd ? fd->getNumFields() : 0;
+    for (int j = 0; j < numfields; j++) {
+      SoField * field = fd->getField(engine, j);
+      if (!field->isConnected()) continue;
+      SbBool fromscheduled = FALSE;
+      SoEngineOutput * output = NULL;
+      int master;
+      if (field->isConnectedFromEngine() && field->getConnectedEngine(output) &&
+          !output->isNodeEngineOutput() &&
+          index.get(output->getContainer(), master)) {
+        from.append(master);
+        to.append(i);
+        fromscheduled = !field->isConnectedFromField() &&
+          (output->getConnectionType() == field->getTypeId());
+      }
+      if (!fromscheduled && field->getDirty()) safe = FALSE;
+    }
+    parallel.append(safe);
+  }
+
+  // levels, by Kahn's algorithm
+  SbList<int> numdepends(num), firstedge(num + 1), edges(from.getLength());
+  for (i = 0; i < num; i++) { numdepends.append(0); firstedge.append(0); }
+  firstedge.append(0);
+  for (i = 0; i < from.getLength(); i++) {
+    numdepends[to[i]]++;
+    firstedge[from[i] + 1]++;
+  }
+  for (i = 0; i < num; i++) { firstedge[i + 1] += firstedge[i]; }
+  SbList<int> fill(num);
+  for (i = 0; i < num; i++) { fill.append(firstedge[i]); }
+  for (i = 0; i < from.getLength(); i++) { edges.append(0); }
+  for (i = 0; i < from.getLength(); i++) { edges[fill[from[i]]++] = to[i]; }
+
+  SbTaskScheduler * scheduler = NULL;
+  SbTaskScheduler * ownscheduler = NULL;
+  if (numthreads == 0) { scheduler = SbTaskScheduler::getGlobal(); }
+  else if (numthreads > 1) { scheduler = ownscheduler = new SbTaskScheduler(numthreads - 1); }
+
+  // Engines on dependency cycles never get into a level. They are
+  // left for lazy evaluation, which handles them as before.
+  SbList<int> level, next, parallellevel;
+  for (i = 0; i < num; i++) { if (numdepends[i] == 0) level.append(i); }
+  while (level.getLength()) {
+    parallellevel.truncate(0);
+    for (i = 0; i < level.getLength(); i++) {
+      if (parallel[level[i]]) parallellevel.append(level[i]);
+    }
+    if (scheduler && parallellevel.getLength() > 1) {
+      const int * idx = parallellevel.getArrayPtr();
+      SoEngine * const * list = engines.getArrayPtr();
+      SbTaskScheduler::parallelFor(0, parallellevel.getLength(), 0, [=](int begin, int end) {
+        for (int k = begin; k < end; k++) { list[idx[k]]->evaluateWrapper(); }
+      }, scheduler);
+    }
+    else {
+      for (i = 0; i < parallellevel.getLength(); i++) {
+        engines[parallellevel[i]]->evaluateWrapper();
+      }
+    }
+    for (i = 0; i < level.getLength(); i++) {
+      if (!parallel[level[i]]) engines[level[i]]->evaluateWrapper();
+    }
+
+    next.truncate(0);
+    for (i = 0; i < level.getLength(); i++) {
+      const int e = level[i];
+      for (int k = firstedge[e]; k < firstedge[e + 1]; k++) {
+        if (--numdepends[edges[k]] == 0) next.append(edges[k]);
+      }
+    }
+    level = next;
+  }
+
+  delete ownscheduler;
+}
+
+// *************************************************************************
+
 /*!
   Default constructor.
 */
@@ -135,6 +340,8 @@ SoEngine::destroy(void)
   // by setting SoEngineOutput::isEnabled() to FALSE before
   // decoupling.
 
+  if (this->flags & FLAG_ISSCHEDULED) SoEngineP::untrack(this);
+
   // need to lock to avoid that evaluateWrapper() is called
   // simultaneously from more than one thread
 #ifdef COIN_THREADSAFE
@@ -165,6 +372,44 @@ SoEngine::initClass(void)
     SoType::createType(SoFieldContainer::getClassTypeId(), SbName("Engine"));
 
   SoEngine::initClasses();
+
+  CC_MUTEX_CONSTRUCT(SoEngineP::mutex);
+  SoEngineP::dirtyengines = new SoEngineSet;
+  SoEngineP::paralleltypes = new SbList<SoType>;
+  const SoType types[] = {
+    SoBoolOperation::getClassTypeId(),
+    SoCalculator::getClassTypeId(),
+    SoComposeMatrix::getClassTypeId(),
+    SoComposeRotation::getClassTypeId(),
+    SoComposeRotationFromTo::getClassTypeId(),
+    SoComposeVec2f::getClassTypeId(),
+    SoComposeVec3f::getClassTypeId(),
+    SoComposeVec4f::getClassTypeId(),
+    SoConcatenate::getClassTypeId(),
+    SoCounter::getClassTypeId(),
+    SoDecomposeMatrix::getClassTypeId(),
+    SoDecomposeRotation::getClassTypeId(),
+    SoDecomposeVec2f::getClassTypeId(),
+    SoDecomposeVec3f::getClassTypeId(),
+    SoDecomposeVec4f::getClassTypeId(),
+    SoGate::getClassTypeId(),
+    SoInterpolateFloat::getClassTypeId(),
+    SoInterpolateRotation::getClassTypeId(),
+    SoInterpolateVec2f::getClassTypeId(),
+    SoInterpolateVec3f::getClassTypeId(),
+    SoInterpolateVec4f::getClassTypeId(),
+    SoOnOff::getClassTypeId(),
+    SoSelectOne::getClassTypeId(),
+    SoTransformVec3f::getClassTypeId(),
+    SoTriggerAny::getClassTypeId()
+  };
+  for (unsigned int i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    SoEngineP::paralleltypes->append(types[i]);
+  }
+  coin_atexit(SoEngineP::cleanup, CC_ATEXIT_NORMAL);
+
+  const char * env = coin_getenv("COIN_ENGINE_SCHEDULING");
+  if (env && atoi(env) > 0) SoEngine::enableEvaluationScheduling(TRUE);
 }
 
 /*!
@@ -323,6 +568,9 @@ SoEngine::notify(SoNotList * nl)
   // whatever this engine is connected to, so we need to be evaluated
   // on the next attempted read on our output(s).
   this->flags |= FLAG_ISDIRTY;
+  if (SoEngineP::scheduling && !(this->flags & FLAG_ISSCHEDULED)) {
+    SoEngineP::track(this);
+  }
 
   // Call inputChanged() only if we're being notified through one of
   // the engine's fields (lastrec == CONTAINER, set in
@@ -353,6 +601,125 @@ SoEngine::notify(SoNotList * nl)
 #endif // debug
 }
 
+/*!
+  Enables or disables scheduling of the engine evaluation. When
+  enabled, the engines made dirty by changes to their inputs are kept
+  track of, so they can be evaluated with evaluateDirtyEngines()
+  before anything reads their outputs. SoGLRenderAction then calls
+  evaluateDirtyEngines() at the start of each render traversal, so
+  the traversal only reads up-to-date field values.
+
+  Engines not evaluated this way are still evaluated lazily, as
+  usual. The default is to not schedule the evaluation, unless the
+  COIN_ENGINE_SCHEDULING environment variable is set to "1".
+
+  \sa isEvaluationSchedulingEnabled()
+  \since Coin 4.1
+*/
+void
+SoEngine::enableEvaluationScheduling(const SbBool onoff)
+{
+  if (!onoff && SoEngineP::scheduling) {
+    SbList<const SoEngine *> tracked;
+    CC_MUTEX_LOCK(SoEngineP::mutex);
+    SoEngineP::dirtyengines->makeKeyList(tracked);
+    for (int i = 0; i < tracked.getLength(); i++) {
+      const_cast<SoEngine *>(tracked[i])->flags &= ~FLAG_ISSCHEDULED;
+    }
+    SoEngineP::dirtyengines->clear();
+    CC_MUTEX_UNLOCK(SoEngineP::mutex);
+  }
+  SoEngineP::scheduling = onoff;
+}
+
+/*!
+  Returns whether the engine evaluation is scheduled.
+
+  \sa enableEvaluationScheduling()
+  \since Coin 4.1
+*/
+SbBool
+SoEngine::isEvaluationSchedulingEnabled(void)
+{
+  return SoEngineP::scheduling;
+}
+
+/*!
+  Evaluates the engines made dirty since the last call, when
+  evaluation scheduling is enabled.
+
+  The engines are sorted so that each engine is evaluated after the
+  engines connected to its inputs, and engines which don't depend on
+  each other are evaluated in parallel. The results are the same as
+  with lazy evaluation, no matter how many threads are used.
+
+  \a numthreads is the number of threads to use. The value 0 (the
+  default) uses Coin's shared worker threads, see the
+  COIN_NUM_TASK_THREADS environment variable, 1 evaluates all engines
+  on the calling thread, and a larger value uses the calling thread
+  and \a numthreads - 1 threads started for the duration of the call.
+
+  Only the built-in engines which just compute their outputs from
+  their inputs (like SoCalculator, SoComposeMatrix and the
+  SoInterpolate engines) are evaluated on other threads, except
+  SoCalculator engines with expressions using rand(). Other
+  engines, and engines reading inputs connected from fields, node
+  engines or through field converters, are evaluated on the calling
+  thread. While this function runs, no other threads should read
+  fields connected to engines.
+
+  \sa enableEvaluationScheduling()
+  \since Coin 4.1
+*/
+void
+SoEngine::evaluateDirtyEngines(const int numthreads)
+{
+  assert(numthreads >= 0);
+  if (SoEngineP::evaluating || !SoEngineP::scheduling) return;
+
+  SbList<SoEngine *> engines;
+  CC_MUTEX_LOCK(SoEngineP::mutex);
+  const int numtracked = SoEngineP::dirtyengines->getNumElements();
+  if (numtracked == 0) {
+    CC_MUTEX_UNLOCK(SoEngineP::mutex);
+    return;
+  }
+  SbList<const SoEngine *> tracked(numtracked);
+  SoEngineP::dirtyengines->makeKeyList(tracked);
+  SoEngineP::dirtyengines->clear();
+  for (int i = 0; i < tracked.getLength(); i++) {
+    SoEngine * engine = const_cast<SoEngine *>(tracked[i]);
+    engine->flags &= ~FLAG_ISSCHEDULED;
+    // Engines without references have no connected outputs, so
+    // nothing reads them.
+    if ((engine->flags & FLAG_ISDIRTY) && engine->getRefCount() > 0) {
+      engine->ref();
+      engines.append(engine);
+    }
+  }
+  CC_MUTEX_UNLOCK(SoEngineP::mutex);
+
+  // Worker threads writing engine outputs go through the notification
+  // calls of the output fields (with notification disabled). Keep them
+  // from processing the sensor queues when they are done, as the
+  // sensor manager is not protected by mutexes in non-threadsafe
+  // builds. Changes inside a notification batch are queued in lists
+  // which are not protected either, so evaluate serially then.
+  int threads = numthreads;
+  if (SoDBP::notificationbatchcounter > 0) threads = 1;
+  SoEngineP::evaluating = TRUE;
+#ifndef COIN_THREADSAFE
+  if (threads != 1) SoDB::startNotify();
+#endif // !COIN_THREADSAFE
+  SoEngineP::evaluate(engines, threads);
+#ifndef COIN_THREADSAFE
+  if (threads != 1) SoDB::endNotify();
+#endif // !COIN_THREADSAFE
+  SoEngineP::evaluating = FALSE;
+
+  for (int i = 0; i < engines.getLength(); i++) { engines[i]->unref(); }
+}
+
 /*!
   Triggers an engine evaluation.
 */
@@ -552,3 +919,110 @@ SoEngine::setDirty(void)
 {
   this->flags |= FLAG_ISDIRTY;
 }
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/engines/SoCalculator.h>
+#include <Inventor/engines/SoCompose.h>
+#include <Inventor/engines/SoInterpolateVec3f.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTransform.h>
+
+// Builds chains of engines driving SoTransform nodes: compose ->
+// calculator -> interpolator -> translation, and back out of the
+// translation field through a field connection (which is evaluated
+// lazily) into a decompose -> compose pair driving the scale factor.
+static SoSeparator *
+make_engine_network(const int numchains, SbList<SoComposeVec3f *> & inputs)
+{
+  SoSeparator * root = new SoSeparator;
+  for (int i = 0; i < numchains; i++) {
+    SoComposeVec3f * compose = new SoComposeVec3f;
+    compose->x.setValue(float(i));
+    compose->y.setValue(1.0f);
+    compose->z.setValue(-float(i));
+    inputs.append(compose);
+
+    SoCalculator * calc = new SoCalculator;
+    calc->expression.setValue("oA = A * a + vec3f(b, 0, 0)");
+    calc->A.connectFrom(&compose->vector);
+    calc->a.setValue(0.5f);
+    calc->b.setValue(float(i % 7));
+
+    SoInterpolateVec3f * interp = new SoInterpolateVec3f;
+    interp->input0.connectFrom(&calc->oA);
+    interp->input1.setValue(SbVec3f(10.0f, 20.0f, 30.0f));
+    interp->alpha.setValue(0.25f);
+
+    SoTransform * transform = new SoTransform;
+    transform->translation.connectFrom(&interp->output);
+
+    SoDecomposeVec3f * decompose = new SoDecomposeVec3f;
+    decompose->vector.connectFrom(&transform->translation);
+    SoComposeVec3f * scale = new SoComposeVec3f;
+    scale->x.connectFrom(&decompose->y);
+    scale->y.connectFrom(&decompose->x);
+    scale->z.setValue(1.0f);
+    transform->scaleFactor.connectFrom(&scale->vector);
+
+    root->addChild(transform);
+  }
+  return root;
+}
+
+static void
+change_engine_network(SbList<SoComposeVec3f *> & inputs, const float value)
+{
+  for (int i = 0; i < inputs.getLength(); i++) {
+    inputs[i]->y.setValue(value + float(i));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(scheduledEvaluation)
+{
+  const int numchains = 100;
+  SoEngine::enableEvaluationScheduling(TRUE);
+
+  SbList<SoComposeVec3f *> lazyinputs, scheduledinputs;
+  SoSeparator * lazy = make_engine_network(numchains, lazyinputs);
+  lazy->ref();
+  SoSeparator * scheduled = make_engine_network(numchains, scheduledinputs);
+  scheduled->ref();
+
+  for (int round = 0; round < 3; round++) {
+    change_engine_network(lazyinputs, float(round) * 0.5f);
+    change_engine_network(scheduledinputs, float(round) * 0.5f);
+    // the first round also parses the calculator expressions
+    SoEngine::evaluateDirtyEngines(round == 1 ? 1 : 3);
+
+    for (int i = 0; i < numchains; i++) {
+      SoTransform * t = static_cast<SoTransform *>(scheduled->getChild(i));
+      BOOST_CHECK_MESSAGE(!t->translation.getDirty(),
+                          "scheduled engines should have been evaluated");
+      SoTransform * l = static_cast<SoTransform *>(lazy->getChild(i));
+      BOOST_CHECK(t->translation.getValue() == l->translation.getValue());
+      BOOST_CHECK(t->scaleFactor.getValue() == l->scaleFactor.getValue());
+    }
+  }
+
+  SoEngine::enableEvaluationScheduling(FALSE);
+  lazy->unref();
+  scheduled->unref();
+}
+
+BOOST_AUTO_TEST_CASE(schedulingDisabled)
+{
+  SbList<SoComposeVec3f *> inputs;
+  SoSeparator * root = make_engine_network(10, inputs);
+  root->ref();
+  change_engine_network(inputs, 2.0f);
+  SoEngine::evaluateDirtyEngines(1);
+  SoTransform * t = static_cast<SoTransform *>(root->getChild(3));
+  BOOST_CHECK_MESSAGE(t->translation.getDirty(),
+                      "engines should only be scheduled when enabled");
+  BOOST_CHECK(t->translation.getValue().equals(SbVec3f(5.875f, 6.875f, 6.375f), 1e-5f));
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
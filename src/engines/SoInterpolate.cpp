@@ -51,8 +51,17 @@
 #include <Inventor/errors/SoDebugError.h>
 #endif // COIN_DEBUG
 
+#include "engines/SoInterpolateP.h"
 #include "engines/SoSubEngineP.h"
 
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define SOINTERPOLATE_SSE 1
+#include <xmmintrin.h>
+#endif
+
 /*!
   \var SoSFFloat SoInterpolate::alpha
 
@@ -126,3 +135,166 @@ SoInterpolate::~SoInterpolate()
   delete this->inputdata; this->inputdata = NULL;
   delete this->outputdata; this->outputdata = NULL;
 }
+
+// *************************************************************************
+
+// The values are computed in the same order as the (v1-v0)*a+v0
+// expressions the interpolators used before, so the SSE and the
+// scalar code give identical results.
+void
+SoInterpolateP::lerp(float * dst, const float * v0, const float * v1,
+                     const int num, const float t)
+{
+  int i = 0;
+#ifdef SOINTERPOLATE_SSE
+  const __m128 vt = _mm_set1_ps(t);
+  for (; i + 16 <= num; i += 16) {
+    const __m128 a0 = _mm_loadu_ps(v0 + i);
+    const __m128 a1 = _mm_loadu_ps(v0 + i + 4);
+    const __m128 a2 = _mm_loadu_ps(v0 + i + 8);
+    const __m128 a3 = _mm_loadu_ps(v0 + i + 12);
+    const __m128 b0 = _mm_loadu_ps(v1 + i);
+    const __m128 b1 = _mm_loadu_ps(v1 + i + 4);
+    const __m128 b2 = _mm_loadu_ps(v1 + i + 8);
+    const __m128 b3 = _mm_loadu_ps(v1 + i + 12);
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(b0, a0), vt), a0));
+    _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(b1, a1), vt), a1));
+    _mm_storeu_ps(dst + i + 8, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(b2, a2), vt), a2));
+    _mm_storeu_ps(dst + i + 12, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(b3, a3), vt), a3));
+  }
+  for (; i + 4 <= num; i += 4) {
+    const __m128 a = _mm_loadu_ps(v0 + i);
+    const __m128 b = _mm_loadu_ps(v1 + i);
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(b, a), vt), a));
+  }
+#endif // SOINTERPOLATE_SSE
+  for (; i < num; i++) {
+    dst[i] = (v1[i] - v0[i]) * t + v0[i];
+  }
+}
+
+// Same as calling SbRotation::slerp() for each pair, but t is
+// checked once, and no temporary SbRotation instances are made.
+void
+SoInterpolateP::slerp(SbRotation * dst, const SbRotation * r0,
+                      const SbRotation * r1, const int num, float t)
+{
+#if COIN_DEBUG
+  if (t < 0.0f || t > 1.0f) {
+    SoDebugError::postWarning("SoInterpolateP::slerp",
+                              "The t parameter (%f) is out of bounds [0,1]. "
+                              "Clamping to bounds.", t);
+    if (t < 0.0f) t = 0.0f;
+    else if (t > 1.0f) t = 1.0f;
+  }
+#endif // COIN_DEBUG
+
+  for (int i = 0; i < num; i++) {
+    const float * from = r0[i].getValue();
+    const float * to = r1[i].getValue();
+    float dot = from[0]*to[0] + from[1]*to[1] + from[2]*to[2] + from[3]*to[3];
+
+    // Find the correct direction of the interpolation.
+    float sign = 1.0f;
+    if (dot < 0.0f) {
+      dot = -dot;
+      sign = -1.0f;
+    }
+
+    // fall back to linear interpolation, in case we run out of
+    // floating point precision
+    float scale0 = 1.0f - t;
+    float scale1 = t;
+    if ((1.0f - dot) > FLT_EPSILON) {
+      const float angle = static_cast<float>(acos(dot));
+      const float sinangle = static_cast<float>(sin(angle));
+      if (sinangle > FLT_EPSILON) {
+        scale0 = float(sin((1.0 - t) * angle)) / sinangle;
+        scale1 = float(sin(t * angle)) / sinangle;
+      }
+    }
+    scale1 *= sign;
+    dst[i].setValue(scale0 * from[0] + scale1 * to[0],
+                    scale0 * from[1] + scale1 * to[1],
+                    scale0 * from[2] + scale1 * to[2],
+                    scale0 * from[3] + scale1 * to[3]);
+  }
+}
+
+#undef SOINTERPOLATE_SSE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/engines/SoInterpolateRotation.h>
+#include <Inventor/engines/SoInterpolateVec3f.h>
+#include <Inventor/fields/SoMFRotation.h>
+#include <Inventor/fields/SoMFVec3f.h>
+
+BOOST_AUTO_TEST_CASE(interpolateArrays)
+{
+  // enough values for the SSE loops, plus a tail, and an input with
+  // fewer values than the other
+  const int num = 103;
+  SoInterpolateVec3f * engine = new SoInterpolateVec3f;
+  engine->ref();
+  engine->input0.setNum(num);
+  engine->input1.setNum(num - 10);
+  for (int i = 0; i < num; i++) {
+    engine->input0.set1Value(i, SbVec3f(float(i), 0.5f * i, -1.0f));
+    if (i < num - 10) engine->input1.set1Value(i, SbVec3f(1.0f, float(i * i), 3.0f));
+  }
+  engine->alpha = 0.3f;
+
+  SoMFVec3f out0, out1;
+  out1.setNum(2 * num);
+  out0.connectFrom(&engine->output);
+  out1.connectFrom(&engine->output);
+
+  BOOST_CHECK_EQUAL(out0.getNum(), num);
+  BOOST_CHECK_EQUAL(out1.getNum(), num);
+  for (int i = 0; i < num; i++) {
+    const SbVec3f v0 = engine->input0[i];
+    const SbVec3f v1 = engine->input1[SbMin(i, num - 11)];
+    const SbVec3f expected = (v1 - v0) * 0.3f + v0;
+    BOOST_CHECK(out0[i] == expected);
+    BOOST_CHECK(out1[i] == expected);
+  }
+
+  out0.disconnect();
+  out1.disconnect();
+  engine->unref();
+}
+
+BOOST_AUTO_TEST_CASE(interpolateRotations)
+{
+  const int num = 50;
+  SoInterpolateRotation * engine = new SoInterpolateRotation;
+  engine->ref();
+  engine->input0.setNum(num);
+  engine->input1.setNum(num);
+  for (int i = 0; i < num; i++) {
+    engine->input0.set1Value(i, SbRotation(SbVec3f(1.0f, float(i), 0.0f), 0.1f * i));
+    engine->input1.set1Value(i, SbRotation(SbVec3f(0.0f, 1.0f, float(i)), -0.2f * i));
+  }
+  // identical and opposite quaternions
+  engine->input1.set1Value(0, engine->input0[0]);
+  engine->input1.set1Value(1, SbRotation(-engine->input0[1].getValue()[0],
+                                         -engine->input0[1].getValue()[1],
+                                         -engine->input0[1].getValue()[2],
+                                         -engine->input0[1].getValue()[3]));
+  engine->alpha = 0.75f;
+
+  SoMFRotation out;
+  out.connectFrom(&engine->output);
+  BOOST_CHECK_EQUAL(out.getNum(), num);
+  for (int i = 0; i < num; i++) {
+    const SbRotation expected =
+      SbRotation::slerp(engine->input0[i], engine->input1[i], 0.75f);
+    BOOST_CHECK(out[i] == expected);
+  }
+
+  out.disconnect();
+  engine->unref();
+}
+
+#endif // COIN_TEST_SUITE
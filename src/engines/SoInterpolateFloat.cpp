@@ -39,6 +39,7 @@
 
 #include <Inventor/engines/SoInterpolateFloat.h>
 
+#include "engines/SoInterpolateP.h"
 #include "engines/SoSubEngineP.h"
 
 /*!
@@ -56,5 +57,4 @@ SO_INTERPOLATE_INTERNAL_SOURCE(SoInterpolateFloat,
                                SoMFFloat,
                                float,
                                (0.0f),
-                               (1.0f),
-                               (v1-v0)*a+v0);
+                               (1.0f));
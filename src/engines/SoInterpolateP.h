@@ -0,0 +1,133 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_SOINTERPOLATEP_H
+#define COIN_SOINTERPOLATEP_H
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif // !COIN_INTERNAL
+
+#include <cassert>
+
+#include <Inventor/SbRotation.h>
+#include <Inventor/SbVec2f.h>
+#include <Inventor/SbVec3f.h>
+#include <Inventor/SbVec4f.h>
+#include <Inventor/engines/SoEngineOutput.h>
+
+// SoInterpolateP holds the array kernels used by the interpolator
+// engines and the VRML interpolator nodes, which can morph meshes
+// with a large number of values. The values are written straight
+// into the storage of the connected fields, which is only
+// reallocated when the number of values changes.
+
+class SoInterpolateP {
+public:
+  // dst[i] = v0[i] + (v1[i] - v0[i]) * t, for i in [0, num), with
+  // SSE where available.
+  static void lerp(float * dst, const float * v0, const float * v1,
+                   const int num, const float t);
+  // dst[i] = SbRotation::slerp(r0[i], r1[i], t), for i in [0, num).
+  static void slerp(SbRotation * dst, const SbRotation * r0,
+                    const SbRotation * r1, const int num, float t);
+
+  static void interpolate(float * dst, const float * v0, const float * v1,
+                          const int num, const float t) {
+    lerp(dst, v0, v1, num, t);
+  }
+  static void interpolate(SbVec2f * dst, const SbVec2f * v0, const SbVec2f * v1,
+                          const int num, const float t) {
+    lerp(&dst[0][0], v0[0].getValue(), v1[0].getValue(), num * 2, t);
+  }
+  static void interpolate(SbVec3f * dst, const SbVec3f * v0, const SbVec3f * v1,
+                          const int num, const float t) {
+    lerp(&dst[0][0], v0[0].getValue(), v1[0].getValue(), num * 3, t);
+  }
+  static void interpolate(SbVec4f * dst, const SbVec4f * v0, const SbVec4f * v1,
+                          const int num, const float t) {
+    lerp(&dst[0][0], v0[0].getValue(), v1[0].getValue(), num * 4, t);
+  }
+  static void interpolate(SbRotation * dst, const SbRotation * r0,
+                          const SbRotation * r1, const int num, const float t) {
+    slerp(dst, r0, r1, num, t);
+  }
+
+  // Interpolates between v0 and v1 and writes the result to the
+  // fields connected to output. If n0 and n1 differ, the output gets
+  // max(n0, n1) values, and the shorter input repeats its last
+  // value. The values are computed once, for the first field, and
+  // copied to the others.
+  template <class FieldType, class ValueType>
+  static void writeOutput(SoEngineOutput & output,
+                          const ValueType * v0, const int n0,
+                          const ValueType * v1, const int n1,
+                          const float t)
+  {
+    if (!output.isEnabled()) return;
+    const int num = (n0 && n1) ? SbMax(n0, n1) : 0;
+    const int common = SbMin(n0, n1);
+    const ValueType * first = NULL;
+    const int numconnections = output.getNumConnections();
+    for (int i = 0; i < numconnections; i++) {
+      FieldType * field = static_cast<FieldType *>(output[i]);
+      if (field->isReadOnly()) continue;
+      field->setNum(num);
+      if (num == 0) continue;
+      ValueType * dst = field->startEditing();
+      if (first) {
+        for (int j = 0; j < num; j++) dst[j] = first[j];
+      }
+      else {
+        if (common) interpolate(dst, v0, v1, common, t);
+        for (int j = common; j < num; j++) {
+          interpolate(dst + j, v0 + SbMin(j, n0 - 1), v1 + SbMin(j, n1 - 1), 1, t);
+        }
+        first = dst;
+      }
+      field->finishEditing();
+    }
+    assert(output.getNumConnections() == numconnections);
+  }
+
+  // The evaluate() method of the interpolator engines.
+  template <class FieldType, class ValueType>
+  static void evaluate(SoEngineOutput & output, const FieldType & input0,
+                       const FieldType & input1, const float t)
+  {
+    writeOutput<FieldType, ValueType>(output,
+                                      input0.getValues(0), input0.getNum(),
+                                      input1.getValues(0), input1.getNum(), t);
+  }
+};
+
+#endif // !COIN_SOINTERPOLATEP_H
@@ -40,6 +40,7 @@
 #include <Inventor/engines/SoInterpolateRotation.h>
 #include <Inventor/SbVec3f.h>
 
+#include "engines/SoInterpolateP.h"
 #include "engines/SoSubEngineP.h"
 
 /*!
@@ -57,5 +58,4 @@ SO_INTERPOLATE_INTERNAL_SOURCE(SoInterpolateRotation,
                                SoMFRotation,
                                SbRotation,
                                (SbVec3f(0.0f,0.0f,1.0f),0.0f),
-                               (SbVec3f(0.0f,0.0f,1.0f),0.0f),
-                               SbRotation::slerp(v0,v1,a));
+                               (SbVec3f(0.0f,0.0f,1.0f),0.0f));
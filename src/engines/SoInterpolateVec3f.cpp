@@ -39,6 +39,7 @@
 
 #include <Inventor/engines/SoInterpolateVec3f.h>
 
+#include "engines/SoInterpolateP.h"
 #include "engines/SoSubEngineP.h"
 
 /*!
@@ -56,5 +57,4 @@ SO_INTERPOLATE_INTERNAL_SOURCE(SoInterpolateVec3f,
                                SoMFVec3f,
                                SbVec3f,
                                (0.0f,0.0f,0.0f),
-                               (0.0f,0.0f,0.0f),
-                               (v1-v0)*a+v0);
+                               (0.0f,0.0f,0.0f));
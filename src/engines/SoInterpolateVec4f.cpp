@@ -39,6 +39,7 @@
 
 #include <Inventor/engines/SoInterpolateVec4f.h>
 
+#include "engines/SoInterpolateP.h"
 #include "engines/SoSubEngineP.h"
 
 /*!
@@ -56,5 +57,4 @@ SO_INTERPOLATE_INTERNAL_SOURCE(SoInterpolateVec4f,
                                SoMFVec4f,
                                SbVec4f,
                                (0.0f,0.0f,0.0f,0.0f),
-                               (0.0f,0.0f,0.0f,0.0f),
-                               (v1-v0)*a+v0);
+                               (0.0f,0.0f,0.0f,0.0f));
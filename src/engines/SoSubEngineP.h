@@ -90,7 +90,12 @@ _class_::initClass(void) \
 }
 
 
-#define SO_INTERPOLATE_INTERNAL_SOURCE(_class_, _type_, _valtype_, _default0_, _default1_, _interpexp_) \
+// Unlike SO_INTERPOLATE_SOURCE, this macro has no interpolation
+// expression argument. The built-in interpolators use the array
+// kernels in SoInterpolateP.h, which must be included before the
+// macro is used.
+
+#define SO_INTERPOLATE_INTERNAL_SOURCE(_class_, _type_, _valtype_, _default0_, _default1_) \
  \
 SO_ENGINE_SOURCE(_class_); \
  \
@@ -101,7 +106,14 @@ _class_::_class_(void) \
 } \
  \
 PRIVATE_SO_INTERPOLATE_DESTRUCTOR(_class_) \
-PRIVATE_SO_INTERPOLATE_EVALUATE(_class_, _type_, _valtype_, _interpexp_)
+ \
+void \
+_class_::evaluate(void) \
+{ \
+  SoInterpolateP::evaluate<_type_, _valtype_>(this->output, this->input0, \
+                                              this->input1, \
+                                              this->alpha.getValue()); \
+}
 
 
 #define SO_INTERNAL_ENGINE_SOURCE_DYNAMIC_IO(_class_) \
@@ -476,3 +476,532 @@ so_eval_delete(so_eval_node *node)
     free(node);
   }
 }
+
+/*
+ * The compiled register program.
+ */
+
+enum {
+  OP_CONST,     /* dst = value */
+  OP_COPY,      /* dst = a */
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_FMOD,
+  OP_NEG,
+  OP_AND,
+  OP_OR,
+  OP_NOT,
+  OP_LEQ,
+  OP_GEQ,
+  OP_EQ,
+  OP_NEQ,
+  OP_LT,
+  OP_GT,
+  OP_TEST,      /* dst = a != 0 */
+  OP_TEST3,     /* dst = a[0..2] != 0 */
+  OP_SELECT,    /* dst = c ? a : b */
+  OP_FUNC,      /* dst = f(a), with the node id of f in 'func' */
+  OP_ATAN2,
+  OP_POW,
+  OP_DOT3,      /* dst = dot(a[0..2], b[0..2]) */
+  OP_LEN3,      /* dst = length(a[0..2]) */
+  OP_NORMALIZE3 /* dst[0..2] = normalize(a[0..2]) */
+};
+
+typedef struct {
+  int op;
+  int func;
+  int dst, a, b, c;
+  float value;
+} so_eval_instr;
+
+struct so_eval_program {
+  so_eval_instr *code;
+  int numinstr;
+  int maxinstr;
+  int numregs;
+  int failed;
+  /* which of the temporary registers have been written */
+  char tmpwritten[SO_EVAL_REG_OUT_FLT - SO_EVAL_REG_TMP_FLT];
+};
+
+static void
+emit(so_eval_program *p, int op, int dst, int a, int b, int c)
+{
+  so_eval_instr *instr;
+  if (p->numinstr == p->maxinstr) {
+    p->maxinstr = p->maxinstr ? p->maxinstr * 2 : 32;
+    p->code = (so_eval_instr*) realloc(p->code, p->maxinstr * sizeof(so_eval_instr));
+  }
+  instr = &p->code[p->numinstr++];
+  instr->op = op;
+  instr->func = 0;
+  instr->dst = dst;
+  instr->a = a;
+  instr->b = b;
+  instr->c = c;
+  instr->value = 0.0f;
+}
+
+/*
+ * allocates 'num' consecutive registers for intermediate results.
+ */
+static int
+alloc_regs(so_eval_program *p, int num)
+{
+  int reg = p->numregs;
+  p->numregs += num;
+  return reg;
+}
+
+/*
+ * returns the first register of a field, temporary or output
+ * register, and checks that temporary registers are written before
+ * they are read.
+ */
+static int
+field_reg(so_eval_program *p, const char *regname, int numcomp, int comp, int write)
+{
+  int reg, i;
+  char c = regname[0];
+
+  if (c == 't' || c == 'o') {
+    char r = regname[1];
+    if (r >= 'a' && r <= 'h') {
+      reg = (c == 't' ? SO_EVAL_REG_TMP_FLT : SO_EVAL_REG_OUT_FLT) + (r - 'a');
+    }
+    else {
+      reg = (c == 't' ? SO_EVAL_REG_TMP_VEC : SO_EVAL_REG_OUT_VEC) + (r - 'A') * 3;
+    }
+    if (c == 't') {
+      for (i = comp; i < comp + numcomp; i++) {
+        char *written = &p->tmpwritten[reg + i - SO_EVAL_REG_TMP_FLT];
+        if (write) *written = 1;
+        else if (!*written) p->failed = 1;
+      }
+    }
+  }
+  else if (c >= 'a' && c <= 'h') {
+    reg = SO_EVAL_REG_IN_FLT + (c - 'a');
+  }
+  else {
+    reg = SO_EVAL_REG_IN_VEC + (c - 'A') * 3;
+  }
+  return reg + comp;
+}
+
+/*
+ * emits code for a node, and returns the register (or the first of
+ * three registers for vectors) holding the result. Expressions are
+ * compiled in the same order as so_eval_traverse() evaluates them.
+ */
+static int
+compile_node(so_eval_program *p, so_eval_node *node)
+{
+  int r1 = -1, r2 = -1, r3 = -1;
+  int dst = -1;
+  int i;
+
+  if (node == NULL || p->failed) return -1;
+
+  if (node->id != ID_ASSIGN_FLT && node->id != ID_ASSIGN_VEC) {
+    if (node->child1) r1 = compile_node(p, node->child1);
+    if (node->child2) r2 = compile_node(p, node->child2);
+    if (node->child3) r3 = compile_node(p, node->child3);
+  }
+
+  switch (node->id) {
+  case ID_ADD: case ID_SUB: case ID_MUL: case ID_DIV: case ID_FMOD:
+  case ID_AND: case ID_OR: case ID_LEQ: case ID_GEQ: case ID_EQ:
+  case ID_NEQ: case ID_LT: case ID_GT: case ID_ATAN2: case ID_POW:
+    {
+      int op;
+      switch (node->id) {
+      case ID_ADD: op = OP_ADD; break;
+      case ID_SUB: op = OP_SUB; break;
+      case ID_MUL: op = OP_MUL; break;
+      case ID_DIV: op = OP_DIV; break;
+      case ID_FMOD: op = OP_FMOD; break;
+      case ID_AND: op = OP_AND; break;
+      case ID_OR: op = OP_OR; break;
+      case ID_LEQ: op = OP_LEQ; break;
+      case ID_GEQ: op = OP_GEQ; break;
+      /* vectors are compared on the first component, like in
+         so_eval_traverse() */
+      case ID_EQ: op = OP_EQ; break;
+      case ID_NEQ: op = OP_NEQ; break;
+      case ID_LT: op = OP_LT; break;
+      case ID_GT: op = OP_GT; break;
+      case ID_ATAN2: op = OP_ATAN2; break;
+      default: op = OP_POW; break;
+      }
+      dst = alloc_regs(p, 1);
+      emit(p, op, dst, r1, r2, -1);
+    }
+    break;
+  case ID_ADD_VEC:
+  case ID_SUB_VEC:
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) {
+      emit(p, node->id == ID_ADD_VEC ? OP_ADD : OP_SUB, dst + i, r1 + i, r2 + i, -1);
+    }
+    break;
+  case ID_MUL_VEC_FLT:
+  case ID_DIV_VEC_FLT:
+    /* OP_DIV divides by FLT_EPSILON instead of zero, like ID_DIV_VEC_FLT */
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) {
+      emit(p, node->id == ID_MUL_VEC_FLT ? OP_MUL : OP_DIV, dst + i, r1 + i, r2, -1);
+    }
+    break;
+  case ID_NEG:
+  case ID_NOT:
+  case ID_TEST_FLT:
+    dst = alloc_regs(p, 1);
+    emit(p, node->id == ID_NEG ? OP_NEG : (node->id == ID_NOT ? OP_NOT : OP_TEST),
+         dst, r1, -1, -1);
+    break;
+  case ID_NEG_VEC:
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) emit(p, OP_NEG, dst + i, r1 + i, -1, -1);
+    break;
+  case ID_COS: case ID_SIN: case ID_TAN: case ID_ACOS: case ID_ASIN:
+  case ID_ATAN: case ID_COSH: case ID_SINH: case ID_TANH: case ID_SQRT:
+  case ID_EXP: case ID_LOG: case ID_LOG10: case ID_CEIL: case ID_FLOOR:
+  case ID_FABS:
+    dst = alloc_regs(p, 1);
+    emit(p, OP_FUNC, dst, r1, -1, -1);
+    p->code[p->numinstr - 1].func = node->id;
+    break;
+  case ID_RAND:
+    /* the program evaluates both branches of ?:, and each statement
+       for a whole block before the next, which would change the
+       sequence of rand() calls. Leave these to so_eval_traverse(). */
+    p->failed = 1;
+    break;
+  case ID_CROSS:
+    {
+      int tmp = alloc_regs(p, 1);
+      dst = alloc_regs(p, 3);
+      for (i = 0; i < 3; i++) {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        emit(p, OP_MUL, tmp, r1 + j, r2 + k, -1);
+        emit(p, OP_MUL, dst + i, r1 + k, r2 + j, -1);
+        emit(p, OP_SUB, dst + i, tmp, dst + i, -1);
+      }
+    }
+    break;
+  case ID_DOT:
+    dst = alloc_regs(p, 1);
+    emit(p, OP_DOT3, dst, r1, r2, -1);
+    break;
+  case ID_LEN:
+    dst = alloc_regs(p, 1);
+    emit(p, OP_LEN3, dst, r1, -1, -1);
+    break;
+  case ID_NORMALIZE:
+    dst = alloc_regs(p, 3);
+    emit(p, OP_NORMALIZE3, dst, r1, -1, -1);
+    break;
+  case ID_TEST_VEC:
+    dst = alloc_regs(p, 1);
+    emit(p, OP_TEST3, dst, r1, -1, -1);
+    break;
+  case ID_VEC3F:
+    dst = alloc_regs(p, 3);
+    emit(p, OP_COPY, dst, r1, -1, -1);
+    emit(p, OP_COPY, dst + 1, r2, -1, -1);
+    emit(p, OP_COPY, dst + 2, r3, -1, -1);
+    break;
+  case ID_FLT_REG:
+    dst = field_reg(p, node->regname, 1, 0, 0);
+    break;
+  case ID_VEC_REG:
+    dst = field_reg(p, node->regname, 3, 0, 0);
+    break;
+  case ID_VEC_REG_COMP:
+    if (node->regidx < 0 || node->regidx > 2) p->failed = 1;
+    else dst = field_reg(p, node->regname, 1, node->regidx, 0);
+    break;
+  case ID_FLT_COND:
+    /* both branches are evaluated, and the result selected */
+    dst = alloc_regs(p, 1);
+    emit(p, OP_SELECT, dst, r2, r3, r1);
+    break;
+  case ID_VEC_COND:
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) emit(p, OP_SELECT, dst + i, r2 + i, r3 + i, r1);
+    break;
+  case ID_VALUE:
+    dst = alloc_regs(p, 1);
+    emit(p, OP_CONST, dst, -1, -1, -1);
+    p->code[p->numinstr - 1].value = node->value;
+    break;
+  case ID_ASSIGN_FLT:
+    r2 = compile_node(p, node->child2);
+    /* regidx is -1 for scalar registers, and the component for vectors */
+    if (node->child1->regidx > 2) p->failed = 1;
+    else {
+      const int comp = node->child1->regidx < 0 ? 0 : node->child1->regidx;
+      dst = field_reg(p, node->child1->regname, 1, comp, 1);
+      emit(p, OP_COPY, dst, r2, -1, -1);
+    }
+    break;
+  case ID_ASSIGN_VEC:
+    r2 = compile_node(p, node->child2);
+    dst = field_reg(p, node->child1->regname, 3, 0, 1);
+    for (i = 0; i < 3; i++) emit(p, OP_COPY, dst + i, r2 + i, -1, -1);
+    break;
+  case ID_SEPARATOR:
+    break;
+  default:
+    assert(0 && "Whoops. Unknown node id!\n");
+    p->failed = 1;
+    break;
+  }
+  return dst;
+}
+
+so_eval_program *
+so_eval_compile(so_eval_node * const *nodes, int numnodes)
+{
+  int i;
+  so_eval_program *p = (so_eval_program*) malloc(sizeof(so_eval_program));
+  p->code = NULL;
+  p->numinstr = 0;
+  p->maxinstr = 0;
+  p->numregs = SO_EVAL_NUM_FIELD_REGS;
+  p->failed = 0;
+  for (i = 0; i < (int) sizeof(p->tmpwritten); i++) p->tmpwritten[i] = 0;
+
+  for (i = 0; i < numnodes && !p->failed; i++) {
+    (void) compile_node(p, nodes[i]);
+  }
+  if (p->failed) {
+    so_eval_program_delete(p);
+    return NULL;
+  }
+  return p;
+}
+
+void
+so_eval_program_delete(so_eval_program *program)
+{
+  if (program) {
+    free(program->code);
+    free(program);
+  }
+}
+
+int
+so_eval_program_num_registers(const so_eval_program *program)
+{
+  return program->numregs;
+}
+
+/*
+ * The arithmetic and comparison instructions are evaluated four
+ * elements at a time with SSE when available. The results are the
+ * same as for the scalar code.
+ */
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define SO_EVAL_SSE 1
+#include <xmmintrin.h>
+#endif /* SSE */
+
+#ifdef SO_EVAL_SSE
+#define SSE_LOOP(expr) \
+  for (; j + 4 <= count; j += 4) { \
+    const __m128 va = _mm_loadu_ps(a + j); \
+    const __m128 vb = b ? _mm_loadu_ps(b + j) : zero; \
+    const __m128 vc = c ? _mm_loadu_ps(c + j) : zero; \
+    (void) vb; (void) vc; \
+    _mm_storeu_ps(d + j, (expr)); \
+  }
+#else /* !SO_EVAL_SSE */
+#define SSE_LOOP(expr)
+#endif /* !SO_EVAL_SSE */
+
+#define SCALAR_LOOP(expr) \
+  for (; j < count; j++) { d[j] = (expr); }
+
+void
+so_eval_program_run(const so_eval_program *program, float *registers, int count)
+{
+  int i, j;
+#ifdef SO_EVAL_SSE
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 eps = _mm_set1_ps(FLT_EPSILON);
+  const __m128 sign = _mm_set1_ps(-0.0f);
+#endif /* SO_EVAL_SSE */
+
+  for (i = 0; i < program->numinstr; i++) {
+    const so_eval_instr *instr = &program->code[i];
+    float *d = registers + instr->dst * SO_EVAL_BLOCKSIZE;
+    const float *a = instr->a >= 0 ? registers + instr->a * SO_EVAL_BLOCKSIZE : NULL;
+    const float *b = instr->b >= 0 ? registers + instr->b * SO_EVAL_BLOCKSIZE : NULL;
+    const float *c = instr->c >= 0 ? registers + instr->c * SO_EVAL_BLOCKSIZE : NULL;
+    j = 0;
+
+    switch (instr->op) {
+    case OP_CONST:
+      SCALAR_LOOP(instr->value);
+      break;
+    case OP_COPY:
+      SCALAR_LOOP(a[j]);
+      break;
+    case OP_ADD:
+      SSE_LOOP(_mm_add_ps(va, vb));
+      SCALAR_LOOP(a[j] + b[j]);
+      break;
+    case OP_SUB:
+      SSE_LOOP(_mm_sub_ps(va, vb));
+      SCALAR_LOOP(a[j] - b[j]);
+      break;
+    case OP_MUL:
+      SSE_LOOP(_mm_mul_ps(va, vb));
+      SCALAR_LOOP(a[j] * b[j]);
+      break;
+    case OP_DIV:
+      /* see ID_DIV in so_eval_traverse() */
+      SSE_LOOP(_mm_div_ps(va, _mm_or_ps(_mm_andnot_ps(_mm_cmpeq_ps(vb, zero), vb),
+                                        _mm_and_ps(_mm_cmpeq_ps(vb, zero), eps))));
+      SCALAR_LOOP(a[j] / (b[j] == 0.0f ? FLT_EPSILON : b[j]));
+      break;
+    case OP_FMOD:
+      SCALAR_LOOP(b[j] != 0.0f ? (float) fmod(a[j], b[j]) : 0.0f);
+      break;
+    case OP_NEG:
+      SSE_LOOP(_mm_xor_ps(va, sign));
+      SCALAR_LOOP(-a[j]);
+      break;
+    case OP_AND:
+      SSE_LOOP(_mm_and_ps(_mm_and_ps(_mm_cmpneq_ps(va, zero), _mm_cmpneq_ps(vb, zero)), one));
+      SCALAR_LOOP((a[j] != 0.0f && b[j] != 0.0f) ? 1.0f : 0.0f);
+      break;
+    case OP_OR:
+      SSE_LOOP(_mm_and_ps(_mm_or_ps(_mm_cmpneq_ps(va, zero), _mm_cmpneq_ps(vb, zero)), one));
+      SCALAR_LOOP((a[j] != 0.0f || b[j] != 0.0f) ? 1.0f : 0.0f);
+      break;
+    case OP_NOT:
+      SSE_LOOP(_mm_and_ps(_mm_cmpeq_ps(va, zero), one));
+      SCALAR_LOOP(a[j] == 0.0f ? 1.0f : 0.0f);
+      break;
+    case OP_LEQ:
+      SSE_LOOP(_mm_and_ps(_mm_cmple_ps(va, vb), one));
+      SCALAR_LOOP(a[j] <= b[j] ? 1.0f : 0.0f);
+      break;
+    case OP_GEQ:
+      SSE_LOOP(_mm_and_ps(_mm_cmpge_ps(va, vb), one));
+      SCALAR_LOOP(a[j] >= b[j] ? 1.0f : 0.0f);
+      break;
+    case OP_EQ:
+      SSE_LOOP(_mm_and_ps(_mm_cmpeq_ps(va, vb), one));
+      SCALAR_LOOP(a[j] == b[j] ? 1.0f : 0.0f);
+      break;
+    case OP_NEQ:
+      SSE_LOOP(_mm_and_ps(_mm_cmpneq_ps(va, vb), one));
+      SCALAR_LOOP(a[j] != b[j] ? 1.0f : 0.0f);
+      break;
+    case OP_LT:
+      SSE_LOOP(_mm_and_ps(_mm_cmplt_ps(va, vb), one));
+      SCALAR_LOOP(a[j] < b[j] ? 1.0f : 0.0f);
+      break;
+    case OP_GT:
+      SSE_LOOP(_mm_and_ps(_mm_cmpgt_ps(va, vb), one));
+      SCALAR_LOOP(a[j] > b[j] ? 1.0f : 0.0f);
+      break;
+    case OP_TEST:
+      SSE_LOOP(_mm_and_ps(_mm_cmpneq_ps(va, zero), one));
+      SCALAR_LOOP(a[j] != 0.0f ? 1.0f : 0.0f);
+      break;
+    case OP_TEST3:
+      {
+        const float *ay = a + SO_EVAL_BLOCKSIZE, *az = ay + SO_EVAL_BLOCKSIZE;
+        SCALAR_LOOP((a[j] != 0.0f || ay[j] != 0.0f || az[j] != 0.0f) ? 1.0f : 0.0f);
+      }
+      break;
+    case OP_SELECT:
+      SSE_LOOP(_mm_or_ps(_mm_and_ps(_mm_cmpneq_ps(vc, zero), va),
+                         _mm_andnot_ps(_mm_cmpneq_ps(vc, zero), vb)));
+      SCALAR_LOOP(c[j] != 0.0f ? a[j] : b[j]);
+      break;
+    case OP_FUNC:
+      switch (instr->func) {
+      case ID_COS: SCALAR_LOOP((float) cos(a[j])); break;
+      case ID_SIN: SCALAR_LOOP((float) sin(a[j])); break;
+      case ID_TAN: SCALAR_LOOP((float) tan(a[j])); break;
+      case ID_ACOS: SCALAR_LOOP((float) acos(clamp(a[j], -1.0f, 1.0f))); break;
+      case ID_ASIN: SCALAR_LOOP((float) asin(clamp(a[j], -1.0f, 1.0f))); break;
+      case ID_ATAN: SCALAR_LOOP((float) atan(a[j])); break;
+      case ID_COSH: SCALAR_LOOP((float) cosh(a[j])); break;
+      case ID_SINH: SCALAR_LOOP((float) sinh(a[j])); break;
+      case ID_TANH: SCALAR_LOOP((float) tanh(a[j])); break;
+      case ID_SQRT: SCALAR_LOOP(a[j] > 0.0f ? (float) sqrt(a[j]) : 0.0f); break;
+      case ID_EXP: SCALAR_LOOP((float) exp(a[j])); break;
+      case ID_LOG: SCALAR_LOOP(a[j] <= 0.0f ? -128.0f : (float) log(a[j])); break;
+      case ID_LOG10: SCALAR_LOOP(a[j] <= 0.0f ? -38.0f : (float) log10(a[j])); break;
+      case ID_CEIL: SCALAR_LOOP((float) ceil(a[j])); break;
+      case ID_FLOOR: SCALAR_LOOP((float) floor(a[j])); break;
+      case ID_FABS: SCALAR_LOOP((float) fabs(a[j])); break;
+      default: assert(0 && "unknown function"); break;
+      }
+      break;
+    case OP_ATAN2:
+      SCALAR_LOOP(b[j] == 0.0f ?
+                  (float) (a[j] >= 0.0f ? M_PI * 0.5 : - M_PI * 0.5) :
+                  (float) atan2(a[j], b[j]));
+      break;
+    case OP_POW:
+      for (; j < count; j++) {
+        if (a[j] == 0.0f) d[j] = 0.0f;
+        else if (a[j] > 0.0f) d[j] = (float) pow(a[j], b[j]);
+        else d[j] = (float) pow(a[j], floor(b[j] + 0.5));
+      }
+      break;
+    case OP_DOT3:
+    case OP_LEN3:
+      {
+        const float *ay = a + SO_EVAL_BLOCKSIZE, *az = ay + SO_EVAL_BLOCKSIZE;
+        if (instr->op == OP_LEN3) b = a;
+        {
+          const float *by = b + SO_EVAL_BLOCKSIZE, *bz = by + SO_EVAL_BLOCKSIZE;
+          if (instr->op == OP_DOT3) {
+            SCALAR_LOOP(a[j]*b[j] + ay[j]*by[j] + az[j]*bz[j]);
+          }
+          else {
+            SCALAR_LOOP((float) sqrt(a[j]*b[j] + ay[j]*by[j] + az[j]*bz[j]));
+          }
+        }
+      }
+      break;
+    case OP_NORMALIZE3:
+      {
+        const float *ay = a + SO_EVAL_BLOCKSIZE, *az = ay + SO_EVAL_BLOCKSIZE;
+        float *dy = d + SO_EVAL_BLOCKSIZE, *dz = dy + SO_EVAL_BLOCKSIZE;
+        for (; j < count; j++) {
+          const float x = a[j], y = ay[j], z = az[j];
+          const float len = (float) sqrt(x*x + y*y + z*z);
+          if (len > 0.0f) {
+            d[j] = x / len;
+            dy[j] = y / len;
+            dz[j] = z / len;
+          }
+          else {
+            d[j] = dy[j] = dz[j] = 0.0f;
+          }
+        }
+      }
+      break;
+    default:
+      assert(0 && "unknown instruction");
+      break;
+    }
+  }
+}
+
+#undef SSE_LOOP
+#undef SCALAR_LOOP
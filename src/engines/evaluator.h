@@ -99,6 +99,51 @@ extern "C" {
      check this after calling so_eval_parse() */
   char * so_eval_error(void); /* defined in epsilon.y */
 
+  /*
+   * Expressions can also be compiled into a flat register program,
+   * which is evaluated for a block of up to SO_EVAL_BLOCKSIZE array
+   * elements at a time, instead of traversing the tree for each
+   * element. A register is an array of SO_EVAL_BLOCKSIZE floats (one
+   * for each element), a vector uses three consecutive registers,
+   * and booleans are stored as 0.0 or 1.0. The first registers are
+   * the SoCalculator fields, see the SO_EVAL_REG_* enum below.
+   * Registers after those are used for intermediate results.
+   *
+   * The caller loads the input registers before calling
+   * so_eval_program_run(), clears the output registers, and reads the
+   * results from the output and temporary registers afterwards.
+   */
+  typedef struct so_eval_program so_eval_program;
+
+  /* compiles a list of expressions, which are evaluated in order for
+     each element. Entries may be NULL. Returns NULL if the
+     expressions can't be evaluated one block at a time (when a
+     temporary register is read before it's written, which makes one
+     element depend on the previous one, or when rand() is used, as
+     the calls would be made in a different order) */
+  so_eval_program *so_eval_compile(so_eval_node * const *nodes, int numnodes);
+
+  void so_eval_program_delete(so_eval_program *program);
+
+  /* returns the total number of registers used by the program */
+  int so_eval_program_num_registers(const so_eval_program *program);
+
+  /* evaluates the program for 'count' (<= SO_EVAL_BLOCKSIZE) elements */
+  void so_eval_program_run(const so_eval_program *program, float *registers, int count);
+
+#define SO_EVAL_BLOCKSIZE 64
+
+/* register layout, a-h, A-H, ta-th, tA-tH, oa-od, oA-oD */
+enum {
+  SO_EVAL_REG_IN_FLT = 0,
+  SO_EVAL_REG_IN_VEC = 8,
+  SO_EVAL_REG_TMP_FLT = 32,
+  SO_EVAL_REG_TMP_VEC = 40,
+  SO_EVAL_REG_OUT_FLT = 64,
+  SO_EVAL_REG_OUT_VEC = 68,
+  SO_EVAL_NUM_FIELD_REGS = 80
+};
+
   /* methods to create misc nodes */
   so_eval_node *so_eval_create_unary(int id, so_eval_node *topnode);
   so_eval_node *so_eval_create_binary(int id, so_eval_node *lhs, so_eval_node *rhs);
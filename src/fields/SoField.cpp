@@ -143,6 +143,7 @@ inline unsigned int SbHashFunc(const void * key)
 {
   return SbHashFunc(reinterpret_cast<size_t>(key));
 }
+#include "misc/SoDBP.h"
 #include "coindefs.h" // COIN_STUB()
 
 #ifdef COIN_THREADSAFE
@@ -556,6 +557,9 @@ SoField::~SoField()
   // disconnecting connections.
   this->setStatusBits(FLAG_ISDESTRUCTING);
 
+  // don't notify from a pending notification batch
+  SoDBP::forgetDeferredNotify(this);
+
 #if COIN_DEBUG_EXTRA
   int wLevel =
     SoConfigSettings::getInstance()->settingAsInt("COIN_WARNING_LEVEL");
@@ -1438,6 +1442,21 @@ SoField::touch(void)
 void
 SoField::startNotify(void)
 {
+#ifdef COIN_THREADSAFE
+  // a notification batch holds the notification lock until it is
+  // committed, so other threads wait here until then
+  (void) cc_recmutex_internal_notify_lock();
+#endif // COIN_THREADSAFE
+  // inside a notification batch, the field is notified when the
+  // batch is committed
+  if (SoDBP::notificationbatchcounter > 0 && this->container) {
+    SoDBP::deferNotify(this);
+#ifdef COIN_THREADSAFE
+    (void) cc_recmutex_internal_notify_unlock();
+#endif // COIN_THREADSAFE
+    return;
+  }
+
   SoNotList l;
 #if COIN_DEBUG_EXTRA
   int wLevel =
@@ -1450,6 +1469,9 @@ SoField::startNotify(void)
   SoDB::startNotify();
   this->notify(&l);
   SoDB::endNotify();
+#ifdef COIN_THREADSAFE
+  (void) cc_recmutex_internal_notify_unlock();
+#endif // COIN_THREADSAFE
 
 #if COIN_DEBUG_EXTRA
   if (wLevel>=3)
@@ -113,6 +113,9 @@ SoType SoFieldContainer::classTypeId STATIC_SOTYPE_INIT;
 typedef SbHash<const SoFieldContainer *, void *> UserDataMap;
 static UserDataMap * sofieldcontainer_userdata_dict = NULL;
 
+// see setCopySharesValues()
+static SbBool sofieldcontainer_copysharesvalues = FALSE;
+
 void
 sofieldcontainer_userdata_cleanup(void)
 {
@@ -369,6 +372,50 @@ SoFieldContainer::copyFieldValues(const SoFieldContainer * container,
   fd0->overlay(this, container, copyconnections);
 }
 
+/*!
+  Sets whether copies of multiple-value fields made with
+  copyFieldValues(), and thereby with SoNode::copy(), should share the
+  value arrays of the original fields instead of copying them. The
+  default is \c FALSE.
+
+  Sharing is done with SoMField::shareValues(), and each field gets a
+  copy of the values of its own when it is changed. This saves memory
+  and time when copying scene graphs with large coordinate, normal or
+  index fields, like when instantiating parts of a CAD assembly:
+
+  \code
+  SoFieldContainer::setCopySharesValues(TRUE);
+  SoNode * instance = part->copy();
+  SoFieldContainer::setCopySharesValues(FALSE);
+  \endcode
+
+  The setting is global, and is not enabled by default since fields
+  holding shared values must not be edited by code compiled against
+  the headers of Coin versions before 4.1 through startEditing() (see
+  SoMField::shareValues()).
+
+  \sa getCopySharesValues()
+  \since Coin 4.1
+*/
+void
+SoFieldContainer::setCopySharesValues(const SbBool onoff)
+{
+  sofieldcontainer_copysharesvalues = onoff;
+}
+
+/*!
+  Returns whether copied multiple-value fields share their values
+  with the original fields.
+
+  \sa setCopySharesValues()
+  \since Coin 4.1
+*/
+SbBool
+SoFieldContainer::getCopySharesValues(void)
+{
+  return sofieldcontainer_copysharesvalues;
+}
+
 
 /*!
   This method parses the values of one or more fields from the
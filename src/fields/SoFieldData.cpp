@@ -76,6 +76,7 @@
 #include <Inventor/errors/SoReadError.h>
 #include <Inventor/fields/SoField.h>
 #include <Inventor/fields/SoFieldContainer.h>
+#include <Inventor/fields/SoMField.h>
 #include <Inventor/lists/SoFieldList.h>
 #include <Inventor/misc/SoProto.h>
 
@@ -290,7 +291,13 @@ SoFieldData::overlay(SoFieldContainer * to, const SoFieldContainer * from,
     // copy value only if necessary (note how SoTexture2::filename and
     // SoTexture2::image would affect each other without this test)
     if ( !field0->isDefault() || !field1->isDefault() ) {
-      field0->copyFrom(*field1);
+      if (SoFieldContainer::getCopySharesValues() &&
+          field0->isOfType(SoMField::getClassTypeId())) {
+        (void)static_cast<SoMField *>(field0)->shareValues(*static_cast<const SoMField *>(field1));
+      }
+      else {
+        field0->copyFrom(*field1);
+      }
       field0->setDefault(field1->isDefault());
     }
     // copy flags
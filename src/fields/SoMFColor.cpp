@@ -40,9 +40,11 @@
   need to store multiple color values (i.e. "Red Green Blue"
   triplets).
 
-  This field supports application data sharing through a
-  setValuesPointer() method. See SoMField documentation for
-  information on how to use this function.
+  This field supports application data sharing through the
+  setValuesPointer() and setValuesBuffer() methods, and can share
+  its values with other fields of the same type with shareValues().
+  See SoMField documentation for information on how to use these
+  functions.
 
   \sa SbColor, SoSFColor
 
@@ -107,6 +109,7 @@ SoMFColor::write1Value(SoOutput * out, int idx) const
 void
 SoMFColor::setValues(int start, int numarg, const float rgb[][3])
 {
+  this->detachValues();
   if(start+numarg > this->maxNum) this->makeRoom(start+numarg);
   else if(start+numarg > this->num) this->num = start+numarg;
 
@@ -120,6 +123,7 @@ SoMFColor::setValues(int start, int numarg, const float rgb[][3])
 void
 SoMFColor::setHSVValues(int start, int numarg, const float hsv[][3])
 {
+  this->detachValues();
   if(start+numarg > this->maxNum) this->makeRoom(start+numarg);
   else if(start+numarg > this->num) this->num = start+numarg;
 
@@ -40,9 +40,11 @@
   need to store multiple color values (i.e. "Red Green Blue"
   triplets).
 
-  This field supports application data sharing through a
-  setValuesPointer() method. See SoMField documentation for
-  information on how to use this function.
+  This field supports application data sharing through the
+  setValuesPointer() and setValuesBuffer() methods, and can share
+  its values with other fields of the same type with shareValues().
+  See SoMField documentation for information on how to use these
+  functions.
 
   \sa SbColor4f, SoSFColorRGBA
 
@@ -107,6 +109,7 @@ SoMFColorRGBA::write1Value(SoOutput * out, int idx) const
 void
 SoMFColorRGBA::setValues(int start, int numarg, const float rgba[][4])
 {
+  this->detachValues();
   if(start+numarg > this->maxNum) this->makeRoom(start+numarg);
   else if(start+numarg > this->num) this->num = start+numarg;
 
@@ -120,6 +123,7 @@ SoMFColorRGBA::setValues(int start, int numarg, const float rgba[][4])
 void
 SoMFColorRGBA::setHSVValues(int start, int numarg, const float hsva[][4])
 {
+  this->detachValues();
   if(start+numarg > this->maxNum) this->makeRoom(start+numarg);
   else if(start+numarg > this->num) this->num = start+numarg;
 
@@ -39,9 +39,11 @@
   This field is used where nodes, engines or other field containers
   need to store a group of multiple 32-bit integer values.
 
-  This field supports application data sharing through a
-  setValuesPointer() method. See SoMField documentation for
-  information on how to use this function.
+  This field supports application data sharing through the
+  setValuesPointer() and setValuesBuffer() methods, and can share
+  its values with other fields of the same type with shareValues().
+  See SoMField documentation for information on how to use these
+  functions.
 
   \sa SoSFInt32
 */
@@ -39,9 +39,11 @@
   This field is used where nodes, engines or other field containers
   need to store an array of vectors with two elements.
 
-  This field supports application data sharing through a
-  setValuesPointer() method. See SoMField documentation for
-  information on how to use this function.
+  This field supports application data sharing through the
+  setValuesPointer() and setValuesBuffer() methods, and can share
+  its values with other fields of the same type with shareValues().
+  See SoMField documentation for information on how to use these
+  functions.
 
   \sa SbVec2d, SoSFVec2d
   \COIN_CLASS_EXTENSION
@@ -111,6 +113,7 @@ SoMFVec2d::write1Value(SoOutput * out, int idx) const
 void
 SoMFVec2d::setValues(int start, int numarg, const double xy[][2])
 {
+  this->detachValues();
   if (start+numarg > this->maxNum) this->allocValues(start+numarg);
   else if (start+numarg > this->num) this->num = start+numarg;
 
@@ -39,6 +39,12 @@
   This field is used where nodes, engines or other field containers
   need to store an array of vectors with three elements.
 
+  This field supports application data sharing through the
+  setValuesPointer() and setValuesBuffer() methods, and can share
+  its values with other fields of the same type with shareValues().
+  See SoMField documentation for information on how to use these
+  functions.
+
   \sa SbVec3d, SoSFVec3d, SoMFVec3f
 */
 
@@ -107,6 +113,7 @@ SoMFVec3d::write1Value(SoOutput * out, int idx) const
 void
 SoMFVec3d::setValues(int start, int numarg, const double xyz[][3])
 {
+  this->detachValues();
   if (start+numarg > this->maxNum) this->allocValues(start+numarg);
   else if (start+numarg > this->num) this->num = start+numarg;
 
@@ -39,9 +39,11 @@
   This field is used where nodes, engines or other field containers
   need to store an array of vectors with three elements.
 
-  This field supports application data sharing through a
-  setValuesPointer() method. See SoMField documentation for
-  information on how to use this function.
+  This field supports application data sharing through the
+  setValuesPointer() and setValuesBuffer() methods, and can share
+  its values with other fields of the same type with shareValues().
+  See SoMField documentation for information on how to use these
+  functions.
 
   \sa SbVec3f, SoSFVec3f
 */
@@ -120,6 +122,7 @@ SoMFVec3f::write1Value(SoOutput * out, int idx) const
 void
 SoMFVec3f::setValues(int start, int numarg, const float xyz[][3])
 {
+  this->detachValues();
   if (start+numarg > this->maxNum) this->allocValues(start+numarg);
   else if (start+numarg > this->num) this->num = start+numarg;
 
@@ -170,6 +173,10 @@ SoMFVec3f::setValue(const float xyz[3])
 
 #ifdef COIN_TEST_SUITE
 
+#include <Inventor/fields/SoFieldContainer.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoSeparator.h>
+
 BOOST_AUTO_TEST_CASE(initialized)
 {
   SoMFVec3f field;
@@ -178,4 +185,132 @@ BOOST_AUTO_TEST_CASE(initialized)
   BOOST_CHECK_EQUAL(field.getNum(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(copiesShareValues)
+{
+  SoMFVec3f * field = new SoMFVec3f;
+  for (int i = 0; i < 100; i++) field->set1Value(i, float(i), 0.0f, 0.0f);
+
+  // the = operator copies the values
+  SoMFVec3f copy0;
+  copy0 = *field;
+  BOOST_CHECK(copy0.getValues(0) != field->getValues(0));
+  BOOST_CHECK(copy0 == *field);
+
+  SoMFVec3f copy1, copy2;
+  BOOST_CHECK(copy1.shareValues(*field));
+  BOOST_CHECK(copy2.shareValues(copy1));
+  BOOST_CHECK(copy1.getValues(0) == field->getValues(0));
+  BOOST_CHECK(copy2.getValues(0) == field->getValues(0));
+  BOOST_CHECK(copy2 == *field);
+
+  copy1.set1Value(10, SbVec3f(-1.0f, -1.0f, -1.0f));
+  BOOST_CHECK(copy1.getValues(0) != field->getValues(0));
+  BOOST_CHECK_EQUAL(copy1.getNum(), 100);
+  BOOST_CHECK_EQUAL(copy1[10][0], -1.0f);
+  BOOST_CHECK_EQUAL((*field)[10][0], 10.0f);
+  BOOST_CHECK_EQUAL(copy2[10][0], 10.0f);
+
+  // the last copy holding the buffer takes it over
+  delete field;
+  BOOST_CHECK_EQUAL(copy2.getNum(), 100);
+  BOOST_CHECK_EQUAL(copy2[99][0], 99.0f);
+  SbVec3f * values = copy2.startEditing();
+  values[0].setValue(5.0f, 5.0f, 5.0f);
+  copy2.finishEditing();
+  BOOST_CHECK(copy2.getValues(0) == values);
+
+  copy2.setNum(50);
+  BOOST_CHECK_EQUAL(copy2.getNum(), 50);
+  BOOST_CHECK_EQUAL(copy2[0][0], 5.0f);
+
+  SoMFVec3f small;
+  small.setValue(SbVec3f(1.0f, 2.0f, 3.0f));
+  BOOST_CHECK(!copy1.shareValues(small));
+  BOOST_CHECK(copy1.getValues(0) != small.getValues(0));
+  BOOST_CHECK(copy1 == small);
+}
+
+BOOST_AUTO_TEST_CASE(nodeCopySharesValues)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoCoordinate3 * coords = new SoCoordinate3;
+  root->addChild(coords);
+  for (int i = 0; i < 1000; i++) coords->point.set1Value(i, float(i), 0.0f, 0.0f);
+
+  // copies by default
+  SoSeparator * copy0 = static_cast<SoSeparator *>(root->copy());
+  copy0->ref();
+  SoCoordinate3 * coords0 = static_cast<SoCoordinate3 *>(copy0->getChild(0));
+  BOOST_CHECK(coords0->point.getValues(0) != coords->point.getValues(0));
+  BOOST_CHECK(coords0->point == coords->point);
+
+  BOOST_CHECK(!SoFieldContainer::getCopySharesValues());
+  SoFieldContainer::setCopySharesValues(TRUE);
+  SoSeparator * copy1 = static_cast<SoSeparator *>(root->copy());
+  SoFieldContainer::setCopySharesValues(FALSE);
+  copy1->ref();
+  SoCoordinate3 * coords1 = static_cast<SoCoordinate3 *>(copy1->getChild(0));
+  BOOST_CHECK(coords1->point.getValues(0) == coords->point.getValues(0));
+  BOOST_CHECK(!coords1->point.isDefault());
+
+  // shared until one of them is edited
+  coords1->point.set1Value(500, SbVec3f(-1.0f, -1.0f, -1.0f));
+  BOOST_CHECK(coords1->point.getValues(0) != coords->point.getValues(0));
+  BOOST_CHECK_EQUAL(coords1->point.getNum(), 1000);
+  BOOST_CHECK_EQUAL(coords1->point[500][0], -1.0f);
+  BOOST_CHECK_EQUAL(coords1->point[999][0], 999.0f);
+  BOOST_CHECK_EQUAL(coords->point[500][0], 500.0f);
+
+  copy1->unref();
+  copy0->unref();
+  root->unref();
+}
+
+static int releasecount = 0;
+
+static void
+release_values(void * data, void * closure)
+{
+  releasecount++;
+  delete[] static_cast<SbVec3f *>(data);
+}
+
+BOOST_AUTO_TEST_CASE(valuesBuffer)
+{
+  const int n = 64;
+  SbVec3f * buffer = new SbVec3f[n];
+  for (int i = 0; i < n; i++) buffer[i].setValue(float(i), 1.0f, 2.0f);
+
+  releasecount = 0;
+  SoMFVec3f * field = new SoMFVec3f;
+  BOOST_CHECK(field->setValuesBuffer(n, buffer, release_values, NULL));
+  BOOST_CHECK(field->getValues(0) == buffer);
+
+  // written in place while not shared
+  field->set1Value(3, SbVec3f(0.0f, 0.0f, 0.0f));
+  BOOST_CHECK(field->getValues(0) == buffer);
+  BOOST_CHECK_EQUAL(buffer[3][0], 0.0f);
+
+  SoMFVec3f * copy = new SoMFVec3f;
+  BOOST_CHECK(copy->shareValues(*field));
+  BOOST_CHECK(copy->getValues(0) == buffer);
+  copy->set1Value(4, SbVec3f(0.0f, 0.0f, 0.0f));
+  BOOST_CHECK(copy->getValues(0) != buffer);
+  BOOST_CHECK_EQUAL(buffer[4][0], 4.0f);
+
+  BOOST_CHECK(copy->shareValues(*field));
+  delete field;
+  BOOST_CHECK_EQUAL(releasecount, 0);
+  BOOST_CHECK_EQUAL((*copy)[n-1][0], float(n-1));
+
+  // growing beyond the buffer releases it
+  copy->set1Value(n, SbVec3f(0.0f, 0.0f, 0.0f));
+  BOOST_CHECK_EQUAL(releasecount, 1);
+  BOOST_CHECK_EQUAL(copy->getNum(), n+1);
+  BOOST_CHECK_EQUAL((*copy)[n-1][0], float(n-1));
+  delete copy;
+  BOOST_CHECK_EQUAL(releasecount, 1);
+}
+
 #endif // COIN_TEST_SUITE
@@ -236,6 +236,38 @@
   very careful about how your application and DLLs are linked to the
   underlying C library.
 
+  Since Coin 4.1, the built-in fields with plain data values (like
+  SoMFVec3f, SoMFColor and SoMFInt32) can share their value array
+  with other fields of the same type, until one of them is changed.
+  This is not done by default: the = operator, copyFrom() and
+  SoNode::copy() still copy the values. An application making many
+  copies of large fields, e.g. of the coordinates of parts it
+  instantiates, can instead let the copies share the values with
+  shareValues(), or have SoNode::copy() share the values of all the
+  copied fields with SoFieldContainer::setCopySharesValues(). The
+  setValuesBuffer() method works like
+  setValuesPointer(), but lets Coin call a function to release the
+  array when no field uses it anymore:
+
+  \code
+
+  static void free_aligned(void * data, void * closure) { _mm_free(data); }
+
+  SbVec3f * coords = (SbVec3f *)_mm_malloc(n * sizeof(SbVec3f), 16);
+  fill_coordinates(coords, n);
+  mynode->point.setValuesBuffer(n, coords, free_aligned, NULL);
+
+  \endcode
+
+  Edits of the field still write directly to the array, as long as
+  the field doesn't share it and isn't expanded beyond \c n values.
+
+  Fields holding shared values get a copy of their own when they are
+  changed, also through startEditing(). Code compiled against the
+  headers of earlier Coin versions doesn't do that in
+  startEditing(), so fields holding shared values must not be edited
+  by it.
+
   \sa SoSField
 */
 
@@ -251,8 +283,12 @@
 #include <Inventor/SoOutput.h>
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/errors/SoReadError.h>
+#include <Inventor/lists/SbList.h>
 #include <Inventor/fields/SoSubField.h>
+#include <Inventor/fields/SoFields.h>
 
+#include "io/SoInputP.h"
+#include "misc/SbHash.h"
 #include "threads/threadsutilp.h"
 #include "tidbitsp.h"
 #include "coindefs.h" // COIN_WORKAROUND_*
@@ -283,6 +319,10 @@ using std::strlen;
   \var SbBool SoMField::userDataIsUsed
   Is \c TRUE if data have been set through a setValuesPointer() call
   and set to \c FALSE through a enableDeleteValues() call.
+
+  Fields holding a value buffer shared with other fields (see
+  shareValues() and setValuesBuffer()) also have this set to a non-zero
+  value, different from \c TRUE.
 */
 
 // *************************************************************************
@@ -298,6 +338,42 @@ somfield_mutex_cleanup(void)
   CC_MUTEX_DESTRUCT(somfield_mutex);
 }
 
+// Value buffers shared between fields (see shareValues() and
+// setValuesBuffer()). A field holding a shared buffer has userDataIsUsed
+// set to SOMFIELD_SHARED, which code testing userDataIsUsed for
+// "don't delete the values" handles as if it was TRUE.
+#define SOMFIELD_SHARED 2
+
+// Smaller arrays are cheaper to copy than to share.
+static const int SOMFIELD_MIN_SHARED_VALUES = 32;
+
+struct SoMFieldBuffer {
+  void * data;
+  int maxnum;
+  SbList<SoMField *> holders;
+  SbBool external; // set with setValuesBuffer(), so the fields can't delete it
+  SoMField::ReleaseBufferCB * release;
+  void * closure;
+};
+
+inline unsigned int SbHashFunc(const SoMField * key)
+{
+  return SbHashFunc(reinterpret_cast<size_t>(key));
+}
+
+typedef SbHash<const SoMField *, SoMFieldBuffer *> SoMFieldBufferMap;
+
+static SoMFieldBufferMap * somfield_buffers = NULL;
+static void * somfield_buffer_mutex = NULL;
+
+static void
+somfield_buffer_cleanup(void)
+{
+  delete somfield_buffers;
+  somfield_buffers = NULL;
+  CC_MUTEX_DESTRUCT(somfield_buffer_mutex);
+}
+
 // *************************************************************************
 
 
@@ -320,6 +396,10 @@ SoMField::initClass(void)
 
   CC_MUTEX_CONSTRUCT(somfield_mutex);
   coin_atexit(somfield_mutex_cleanup, CC_ATEXIT_NORMAL);
+
+  CC_MUTEX_CONSTRUCT(somfield_buffer_mutex);
+  somfield_buffers = new SoMFieldBufferMap;
+  coin_atexit(somfield_buffer_cleanup, CC_ATEXIT_NORMAL);
 }
 
 void
@@ -368,6 +448,7 @@ SoMField::makeRoom(int newnum)
 SbBool
 SoMField::set1(const int index, const char * const valuestring)
 {
+  this->detachValues();
   int oldnum = this->num;
   // make sure the array has room for the new item
   if (index >= this->maxNum) this->allocValues(index+1);
@@ -460,6 +541,68 @@ SoMField::get1(const int index, SbString & valuestring)
   CC_MUTEX_UNLOCK(somfield_mutex);
 }
 
+// Fields which store their values as plain arrays of numbers, and
+// read them with SoInput::read() one number at a time. These can be
+// parsed in bulk from ASCII files. Subclasses of these fields are
+// not included, as they may read their values differently.
+enum SoMFieldNumbers {
+  SOMFIELD_NO_NUMBERS,
+  SOMFIELD_FLOATS,
+  SOMFIELD_DOUBLES,
+  SOMFIELD_INT32S,
+  SOMFIELD_UINT32S
+};
+
+static SoMFieldNumbers
+somfield_numbers(const SoType type, int & numcomponents)
+{
+  numcomponents = 1;
+  if (type == SoMFFloat::getClassTypeId()) return SOMFIELD_FLOATS;
+  if (type == SoMFInt32::getClassTypeId()) return SOMFIELD_INT32S;
+  if (type == SoMFUInt32::getClassTypeId()) return SOMFIELD_UINT32S;
+  if (type == SoMFDouble::getClassTypeId()) return SOMFIELD_DOUBLES;
+
+  numcomponents = 2;
+  if (type == SoMFVec2f::getClassTypeId()) return SOMFIELD_FLOATS;
+  if (type == SoMFVec2d::getClassTypeId()) return SOMFIELD_DOUBLES;
+
+  numcomponents = 3;
+  if (type == SoMFVec3f::getClassTypeId()) return SOMFIELD_FLOATS;
+  if (type == SoMFColor::getClassTypeId()) return SOMFIELD_FLOATS;
+  if (type == SoMFVec3d::getClassTypeId()) return SOMFIELD_DOUBLES;
+
+  numcomponents = 4;
+  if (type == SoMFVec4f::getClassTypeId()) return SOMFIELD_FLOATS;
+  if (type == SoMFVec4d::getClassTypeId()) return SOMFIELD_DOUBLES;
+
+  return SOMFIELD_NO_NUMBERS;
+}
+
+// Reads as many values as possible, up to maxnum, straight into the
+// array at index idx. Returns the number of values read.
+static int
+somfield_read_numbers(SoInput * in, void * array, const SoMFieldNumbers numbers,
+                      const int numcomponents, const int idx, const int maxnum)
+{
+  const int offset = idx * numcomponents;
+  switch (numbers) {
+  case SOMFIELD_FLOATS:
+    return SoInputP::readValues(in, static_cast<float *>(array) + offset,
+                                maxnum - idx, numcomponents);
+  case SOMFIELD_DOUBLES:
+    return SoInputP::readValues(in, static_cast<double *>(array) + offset,
+                                maxnum - idx, numcomponents);
+  case SOMFIELD_INT32S:
+    return SoInputP::readValues(in, static_cast<int32_t *>(array) + offset,
+                                maxnum - idx, numcomponents);
+  case SOMFIELD_UINT32S:
+    return SoInputP::readValues(in, static_cast<uint32_t *>(array) + offset,
+                                maxnum - idx, numcomponents);
+  default:
+    return 0;
+  }
+}
+
 /*!
   Read and set all values for this field from input stream \a in.
   Returns \c TRUE if import went ok, otherwise \c FALSE.
@@ -467,6 +610,8 @@ SoMField::get1(const int index, SbString & valuestring)
 SbBool
 SoMField::readValue(SoInput * in)
 {
+  this->detachValues();
+
   // FIXME: temporary disable notification (if on) during reading the
   // field elements. 20000429 mortene.
 
@@ -518,11 +663,28 @@ SoMField::readValue(SoInput * in)
       else {
         in->putBack(c);
 
+        int numcomponents;
+        const SoMFieldNumbers numbers =
+          somfield_numbers(this->getTypeId(), numcomponents);
+
         while (TRUE) {
           // makeRoom() makes sure the allocation strategy is decent.
           if (currentidx >= this->num) this->makeRoom(currentidx + 1);
 
-          if (!this->read1Value(in, currentidx++)) return FALSE;
+          // Parse runs of plain numbers in one go into the allocated
+          // room, falling back on read1Value() for anything the bulk
+          // parser leaves alone.
+          int numread = 0;
+          if (numbers != SOMFIELD_NO_NUMBERS) {
+            numread = somfield_read_numbers(in, this->valuesPtr(), numbers,
+                                            numcomponents, currentidx,
+                                            this->maxNum);
+          }
+          if (numread > 0) {
+            currentidx += numread;
+            if (currentidx > this->num) this->makeRoom(currentidx);
+          }
+          else if (!this->read1Value(in, currentidx++)) return FALSE;
 
           READ_VAL(c);
           if (c == ',') { READ_VAL(c); } // Treat trailing comma as whitespace.
@@ -727,6 +889,9 @@ SoMField::deleteValues(int start, int numarg)
 void
 SoMField::enableDeleteValues(void)
 {
+  // Shared buffers are released when the last field holding them
+  // lets go of them.
+  if (this->userDataIsUsed == SOMFIELD_SHARED) return;
   this->userDataIsUsed = FALSE;
 }
 
@@ -745,7 +910,7 @@ SoMField::enableDeleteValues(void)
 SbBool
 SoMField::isDeleteValuesEnabled(void) const
 {
-  return !this->userDataIsUsed;
+  return this->userDataIsUsed != TRUE;
 }
 
 /*!
@@ -784,6 +949,227 @@ SoMField::insertSpace(int start, int numarg)
   this->valueChanged();
 }
 
+// Returns TRUE for the built-in fields with plain data values, whose
+// values can be copied with memcpy() and which detach their values
+// before writing to them.
+static SbBool
+somfield_can_share(const SoType type)
+{
+  return
+    type == SoMFBool::getClassTypeId() ||
+    type == SoMFColor::getClassTypeId() ||
+    type == SoMFColorRGBA::getClassTypeId() ||
+    type == SoMFDouble::getClassTypeId() ||
+    type == SoMFFloat::getClassTypeId() ||
+    type == SoMFInt32::getClassTypeId() ||
+    type == SoMFShort::getClassTypeId() ||
+    type == SoMFUInt32::getClassTypeId() ||
+    type == SoMFUShort::getClassTypeId() ||
+    type == SoMFVec2b::getClassTypeId() ||
+    type == SoMFVec2d::getClassTypeId() ||
+    type == SoMFVec2f::getClassTypeId() ||
+    type == SoMFVec2i32::getClassTypeId() ||
+    type == SoMFVec2s::getClassTypeId() ||
+    type == SoMFVec3b::getClassTypeId() ||
+    type == SoMFVec3d::getClassTypeId() ||
+    type == SoMFVec3f::getClassTypeId() ||
+    type == SoMFVec3i32::getClassTypeId() ||
+    type == SoMFVec3s::getClassTypeId() ||
+    type == SoMFVec4b::getClassTypeId() ||
+    type == SoMFVec4d::getClassTypeId() ||
+    type == SoMFVec4f::getClassTypeId() ||
+    type == SoMFVec4i32::getClassTypeId() ||
+    type == SoMFVec4s::getClassTypeId() ||
+    type == SoMFVec4ub::getClassTypeId() ||
+    type == SoMFVec4ui32::getClassTypeId() ||
+    type == SoMFVec4us::getClassTypeId();
+}
+
+/*!
+  Sets this field to the values of \a field, which must be of the
+  same type, letting the fields share the value buffer instead of
+  copying it. The buffer is shared until one of the fields holding it
+  is changed, which then gets its own copy of the values.
+
+  Only the built-in fields with plain data values (like SoMFVec3f,
+  SoMFColor and SoMFInt32) share their values. For other fields, for
+  fields with less than 32 values, and for values set with
+  setValuesPointer(), the values are copied, like with copyFrom().
+  Returns \c TRUE if the values are shared.
+
+  \sa setValuesBuffer()
+  \since Coin 4.1
+*/
+SbBool
+SoMField::shareValues(const SoMField & field)
+{
+  if (&field == this) return TRUE;
+  assert(field.getTypeId() == this->getTypeId());
+  const int numvalues = field.getNum();
+  if (!somfield_can_share(this->getTypeId()) ||
+      numvalues < SOMFIELD_MIN_SHARED_VALUES ||
+      field.userDataIsUsed == TRUE) {
+    this->copyFrom(field);
+    return FALSE;
+  }
+
+  SoMField * source = const_cast<SoMField *>(&field);
+  source->evaluate();
+  this->allocValues(0);
+
+  CC_MUTEX_LOCK(somfield_buffer_mutex);
+  SoMFieldBuffer * buffer = NULL;
+  if (!somfield_buffers->get(source, buffer)) {
+    buffer = new SoMFieldBuffer;
+    buffer->data = source->valuesPtr();
+    buffer->maxnum = source->maxNum;
+    buffer->external = FALSE;
+    buffer->release = NULL;
+    buffer->closure = NULL;
+    buffer->holders.append(source);
+    somfield_buffers->put(source, buffer);
+    source->userDataIsUsed = SOMFIELD_SHARED;
+  }
+  buffer->holders.append(this);
+  somfield_buffers->put(this, buffer);
+  this->setValuesPtr(buffer->data);
+  this->num = this->maxNum = numvalues;
+  this->userDataIsUsed = SOMFIELD_SHARED;
+  CC_MUTEX_UNLOCK(somfield_buffer_mutex);
+
+  this->valueChanged();
+  return TRUE;
+}
+
+/*!
+  Sets the field to use the \a num values in the application buffer
+  \a data, which must be an array of the field's value type (e.g.
+  SbVec3f for SoMFVec3f). Unlike setValuesPointer(), the buffer can be
+  shared with other fields through shareValues(), and when the last
+  field holding it lets go of it (because the field is destructed,
+  resized beyond \a num values or set to other values), \a release
+  is called with \a data and \a closure, so the application can free
+  it. \a release can be \c NULL if the application manages the buffer
+  lifetime itself.
+
+  While only one field holds the buffer, the values are written in
+  place, like with setValuesPointer(). This makes it possible to
+  let a field use e.g. a suitably aligned array for SIMD processing
+  or buffer object upload.
+
+  Returns \c FALSE, and leaves the field and the buffer alone, if the
+  field isn't one of the built-in fields with plain data values (see
+  shareValues()).
+
+  \since Coin 4.1
+*/
+SbBool
+SoMField::setValuesBuffer(const int numarg, void * data,
+                          ReleaseBufferCB * release, void * closure)
+{
+  if (!somfield_can_share(this->getTypeId())) return FALSE;
+
+  this->allocValues(0);
+  if (numarg <= 0 || data == NULL) {
+    if (data && release) release(data, closure);
+    this->valueChanged();
+    return TRUE;
+  }
+
+  SoMFieldBuffer * buffer = new SoMFieldBuffer;
+  buffer->data = data;
+  buffer->maxnum = numarg;
+  buffer->external = TRUE;
+  buffer->release = release;
+  buffer->closure = closure;
+  buffer->holders.append(this);
+
+  CC_MUTEX_LOCK(somfield_buffer_mutex);
+  somfield_buffers->put(this, buffer);
+  CC_MUTEX_UNLOCK(somfield_buffer_mutex);
+
+  this->setValuesPtr(data);
+  this->num = this->maxNum = numarg;
+  this->userDataIsUsed = SOMFIELD_SHARED;
+  this->valueChanged();
+  return TRUE;
+}
+
+/*!
+  Makes sure the values of this field can be written to, by copying
+  them to a buffer of its own if the current buffer is shared with
+  other fields. Must be called before writing to the values array
+  directly.
+
+  \since Coin 4.1
+*/
+void
+SoMField::detachValues(void)
+{
+  if (this->userDataIsUsed == SOMFIELD_SHARED) {
+    (void)this->resizeSharedValues(this->num);
+  }
+}
+
+/*!
+  Resizes a field holding a shared value buffer to \a newnum values,
+  copying the values to a buffer of its own unless it is the only
+  field holding an application buffer with room for them. Returns \c
+  FALSE if the field doesn't hold a shared buffer, and must be resized
+  the usual way.
+
+  \since Coin 4.1
+*/
+SbBool
+SoMField::resizeSharedValues(const int newnum)
+{
+  if (this->userDataIsUsed != SOMFIELD_SHARED) return FALSE;
+
+  CC_MUTEX_LOCK(somfield_buffer_mutex);
+  SoMFieldBuffer * buffer = NULL;
+  (void)somfield_buffers->get(this, buffer);
+  assert(buffer && "shared field values not registered");
+
+  if (buffer->external && buffer->holders.getLength() == 1 &&
+      newnum > 0 && newnum <= buffer->maxnum) {
+    this->num = newnum;
+    CC_MUTEX_UNLOCK(somfield_buffer_mutex);
+    return TRUE;
+  }
+
+  buffer->holders.removeItem(this);
+  somfield_buffers->erase(this);
+  if (buffer->holders.getLength() == 1 && !buffer->external) {
+    // The last holder takes over the buffer.
+    SoMField * owner = buffer->holders[0];
+    owner->userDataIsUsed = FALSE;
+    owner->maxNum = buffer->maxnum;
+    somfield_buffers->erase(owner);
+    buffer->holders.truncate(0);
+  }
+
+  // Copy while still locked, so the other holders can't free the
+  // buffer meanwhile.
+  const unsigned char * oldvalues = static_cast<unsigned char *>(this->valuesPtr());
+  const int keep = SbMin(this->num, newnum);
+  this->setValuesPtr(NULL);
+  this->num = this->maxNum = 0;
+  this->userDataIsUsed = FALSE;
+  this->allocValues(newnum);
+  if (keep > 0) {
+    (void)memcpy(this->valuesPtr(), oldvalues, size_t(keep) * size_t(this->fieldSizeof()));
+  }
+  CC_MUTEX_UNLOCK(somfield_buffer_mutex);
+
+  if (buffer->holders.getLength() == 0) {
+    if (buffer->external && buffer->release) {
+      buffer->release(buffer->data, buffer->closure);
+    }
+    delete buffer;
+  }
+  return TRUE;
+}
+
 #ifndef DOXYGEN_SKIP_THIS // Internal method.
 void
 SoMField::allocValues(int newnum)
@@ -794,6 +1180,7 @@ SoMField::allocValues(int newnum)
   // method as well.
 
   assert(newnum >= 0);
+  if (this->userDataIsUsed && this->resizeSharedValues(newnum)) return;
 
   if (newnum == 0) {
     if (!this->userDataIsUsed) {
@@ -850,6 +850,8 @@ cc_glglue_glext_supported(const cc_glglue * wrapper, const char * extension)
 #define GL_ARB_shader_objects 1
 #define GL_ARB_vertex_shader 1
 #define GL_ARB_occlusion_query 1
+#define GL_ARB_draw_instanced 1
+#define GL_ARB_instanced_arrays 1
 
 #else /* static binding */
 
@@ -1846,6 +1848,22 @@ glglue_resolve_symbols(cc_glglue * w)
     }
   }
 
+#if defined(GL_ARB_draw_instanced)
+  if ((w->glDrawElementsInstanced == NULL) && cc_glglue_glext_supported(w, "GL_ARB_draw_instanced")) {
+    w->glDrawElementsInstanced = (COIN_PFNGLDRAWELEMENTSINSTANCEDPROC)PROC(w, glDrawElementsInstancedARB);
+  }
+#endif /* GL_ARB_draw_instanced */
+
+  w->glVertexAttribDivisor = NULL; /* so that cc_glglue_has_instanced_arrays() works */
+#if defined(GL_ARB_instanced_arrays)
+  if (cc_glglue_glversion_matches_at_least(w, 3, 3, 0)) {
+    w->glVertexAttribDivisor = (COIN_PFNGLVERTEXATTRIBDIVISORPROC)PROC(w, glVertexAttribDivisor);
+  }
+  if ((w->glVertexAttribDivisor == NULL) && cc_glglue_glext_supported(w, "GL_ARB_instanced_arrays")) {
+    w->glVertexAttribDivisor = (COIN_PFNGLVERTEXATTRIBDIVISORPROC)PROC(w, glVertexAttribDivisorARB);
+  }
+#endif /* GL_ARB_instanced_arrays */
+
   w->glVertexArrayRangeNV = NULL;
 #if defined(GL_NV_vertex_array_range) && (defined(HAVE_GLX) || defined(HAVE_WGL))
   if (cc_glglue_glext_supported(w, "GL_NV_vertex_array_range")) {
@@ -4276,6 +4294,26 @@ cc_glglue_glGetQueryObjectuiv(const cc_glglue * glue,
   glue->glGetQueryObjectuiv(id, pname, params);
 }
 
+/* GL_ARB_instanced_arrays */
+
+SbBool
+cc_glglue_has_instanced_arrays(const cc_glglue * glue)
+{
+  if (!glglue_allow_newer_opengl(glue)) return FALSE;
+
+  return
+    (glue->glVertexAttribDivisor != NULL) &&
+    (glue->glDrawElementsInstanced != NULL);
+}
+
+void
+cc_glglue_glVertexAttribDivisor(const cc_glglue * glue,
+                                GLuint index, GLuint divisor)
+{
+  assert(glue->glVertexAttribDivisor);
+  glue->glVertexAttribDivisor(index, divisor);
+}
+
 /* GL_NV_texture_rectangle (identical to GL_EXT_texture_rectangle) */
 SbBool
 cc_glglue_has_nv_texture_rectangle(const cc_glglue * glue)
@@ -538,6 +538,10 @@ typedef void (APIENTRY * COIN_PFNGLGETQUERYIVPROC)(GLenum target, GLenum pname,
 typedef void (APIENTRY * COIN_PFNGLGETQUERYOBJECTIVPROC)(GLuint id, GLenum pname, GLint * params);
 typedef void (APIENTRY * COIN_PFNGLGETQUERYOBJECTUIVPROC)(GLuint id, GLenum pname, GLuint * params);
 
+/* Typedefs for instanced arrays -- GL_ARB_instanced_arrays */
+
+typedef void (APIENTRY * COIN_PFNGLVERTEXATTRIBDIVISORPROC)(GLuint index, GLuint divisor);
+
 /* Typedefs for GLX functions. */
 typedef void *(APIENTRY * COIN_PFNGLXGETCURRENTDISPLAYPROC)(void);
 typedef void *(APIENTRY * COIN_PFNGLXGETPROCADDRESSPROC)(const GLubyte *);
@@ -814,6 +818,8 @@ struct cc_glglue {
   COIN_PFNGLGETQUERYOBJECTIVPROC glGetQueryObjectiv;
   COIN_PFNGLGETQUERYOBJECTUIVPROC glGetQueryObjectuiv;
 
+  COIN_PFNGLVERTEXATTRIBDIVISORPROC glVertexAttribDivisor;
+
   /* FBO */
   COIN_PFNGLISRENDERBUFFERPROC glIsRenderbuffer;
   COIN_PFNGLBINDRENDERBUFFERPROC glBindRenderbuffer;
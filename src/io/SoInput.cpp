@@ -1457,10 +1457,18 @@ SbBool
 SoInput::readBinaryArray(int32_t * l, int length)
 {
   assert(length > 0);
-  if (!this->checkHeader() ||
-      !this->getTopOfStack()->getChunkOfBytes((unsigned char *)l,
-                                              length * sizeof(int32_t)))
-    return FALSE;
+  if (!this->checkHeader()) return FALSE;
+
+  SoInput_FileInfo * fi = this->getTopOfStack();
+  const size_t numbytes = size_t(length) * sizeof(int32_t);
+  // convert directly from the read buffer if possible, saving a copy
+  const char * src = fi->getChunkPointer(numbytes);
+  if (src) {
+    this->convertInt32Array(const_cast<char *>(src), l, length);
+    return TRUE;
+  }
+
+  if (!fi->getChunkOfBytes((unsigned char *)l, numbytes)) return FALSE;
 
   this->convertInt32Array((char *)l, l, length);
   return TRUE;
@@ -1475,10 +1483,18 @@ SbBool
 SoInput::readBinaryArray(float * f, int length)
 {
   assert(length > 0);
-  if (!this->checkHeader() ||
-      !this->getTopOfStack()->getChunkOfBytes((unsigned char *)f,
-                                              length * sizeof(float)))
-    return FALSE;
+  if (!this->checkHeader()) return FALSE;
+
+  SoInput_FileInfo * fi = this->getTopOfStack();
+  const size_t numbytes = size_t(length) * sizeof(float);
+  // convert directly from the read buffer if possible, saving a copy
+  const char * src = fi->getChunkPointer(numbytes);
+  if (src) {
+    this->convertFloatArray(const_cast<char *>(src), f, length);
+    return TRUE;
+  }
+
+  if (!fi->getChunkOfBytes((unsigned char *)f, numbytes)) return FALSE;
 
   this->convertFloatArray((char *)f, f, length);
 
@@ -1494,10 +1510,18 @@ SbBool
 SoInput::readBinaryArray(double * d, int length)
 {
   assert(length > 0);
-  if (!this->checkHeader() ||
-      !this->getTopOfStack()->getChunkOfBytes((unsigned char *)d,
-                                              length * sizeof(double)))
-    return FALSE;
+  if (!this->checkHeader()) return FALSE;
+
+  SoInput_FileInfo * fi = this->getTopOfStack();
+  const size_t numbytes = size_t(length) * sizeof(double);
+  // convert directly from the read buffer if possible, saving a copy
+  const char * src = fi->getChunkPointer(numbytes);
+  if (src) {
+    this->convertDoubleArray(const_cast<char *>(src), d, length);
+    return TRUE;
+  }
+
+  if (!fi->getChunkOfBytes((unsigned char *)d, numbytes)) return FALSE;
 
   this->convertDoubleArray((char *)d, d, length);
   return TRUE;
@@ -2339,6 +2363,52 @@ SoInput::convertDouble(char * from, double * d)
   *d = coin_ntoh_double_bytes(from);
 }
 
+static inline uint32_t
+soinput_bswap32(uint32_t v)
+{
+  return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+// Converts len 32-bit (or 64-bit) words in network byte order at
+// from to native byte order at to, which may be the same address. This
+// is a plain copy on big endian hosts, and a byte swap loop simple
+// enough for the compiler to vectorize on little endian hosts. Goes
+// through memcpy() as the words may be unaligned, and to hold floats.
+static void
+soinput_ntoh_array32(const char * from, void * to, int len)
+{
+  static const int endianness = coin_host_get_endianness();
+  char * dst = static_cast<char *>(to);
+  if (endianness == COIN_HOST_IS_BIGENDIAN) {
+    if (from != dst) { (void)memmove(dst, from, size_t(len) * sizeof(uint32_t)); }
+    return;
+  }
+  for (int i = 0; i < len; i++) {
+    uint32_t v;
+    (void)memcpy(&v, from + i * sizeof(uint32_t), sizeof(uint32_t));
+    v = soinput_bswap32(v);
+    (void)memcpy(dst + i * sizeof(uint32_t), &v, sizeof(uint32_t));
+  }
+}
+
+static void
+soinput_ntoh_array64(const char * from, void * to, int len)
+{
+  static const int endianness = coin_host_get_endianness();
+  char * dst = static_cast<char *>(to);
+  if (endianness == COIN_HOST_IS_BIGENDIAN) {
+    if (from != dst) { (void)memmove(dst, from, size_t(len) * sizeof(uint64_t)); }
+    return;
+  }
+  for (int i = 0; i < len; i++) {
+    uint64_t v;
+    (void)memcpy(&v, from + i * sizeof(uint64_t), sizeof(uint64_t));
+    v = (uint64_t(soinput_bswap32(uint32_t(v))) << 32) |
+      soinput_bswap32(uint32_t(v >> 32));
+    (void)memcpy(dst + i * sizeof(uint64_t), &v, sizeof(uint64_t));
+  }
+}
+
 /*!
   Convert a block of short numbers in network format to native format.
 
@@ -2362,11 +2432,7 @@ SoInput::convertShortArray(char * from, short * to, int len)
 void
 SoInput::convertInt32Array(char * from, int32_t * to, int len)
 {
-  for (int i=0; i < len; i++) {
-    this->convertInt32(from, to);
-    from += sizeof(int32_t);
-    to++;
-  }
+  soinput_ntoh_array32(from, to, len);
 }
 
 /*!
@@ -2378,11 +2444,7 @@ SoInput::convertInt32Array(char * from, int32_t * to, int len)
 void
 SoInput::convertFloatArray(char * from, float * to, int len)
 {
-  for (int i=0; i < len; i++) {
-    this->convertFloat(from, to);
-    from += sizeof(float);
-    to++;
-  }
+  soinput_ntoh_array32(from, to, len);
 }
 
 /*!
@@ -2394,11 +2456,7 @@ SoInput::convertFloatArray(char * from, float * to, int len)
 void
 SoInput::convertDoubleArray(char * from, double * to, int len)
 {
-  for (int i=0; i < len; i++) {
-    this->convertDouble(from, to);
-    from += sizeof(double);
-    to++;
-  }
+  soinput_ntoh_array64(from, to, len);
 }
 
 /*!
@@ -2616,3 +2674,189 @@ SoInput::findFile(const char * basename, SbString & fullname)
 #undef READ_UNSIGNED_INTEGER
 #undef READ_REAL
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <Inventor/SoInput.h>
+#include <Inventor/SoOutput.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/actions/SoWriteAction.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/fields/SoMFDouble.h>
+#include <Inventor/fields/SoMFFloat.h>
+#include <Inventor/fields/SoMFInt32.h>
+#include <Inventor/fields/SoMFVec3f.h>
+
+namespace {
+
+  // Makes a scene big enough for the binary file to be memory mapped
+  // when read back through SoInput::openFile().
+  SoSeparator *
+  SoInput_test_scene(const int num)
+  {
+    SoSeparator * root = new SoSeparator;
+    SoCoordinate3 * coords = new SoCoordinate3;
+    SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+    coords->point.setNum(num);
+    ifs->coordIndex.setNum(num);
+    for (int i = 0; i < num; i++) {
+      coords->point.set1Value(i, SbVec3f(float(i), float(-i) * 0.5f, 1.0f / float(i + 1)));
+      ifs->coordIndex.set1Value(i, (i % 4) == 3 ? -1 : i);
+    }
+    root->addChild(coords);
+    root->addChild(ifs);
+    return root;
+  }
+
+  SbBool
+  SoInput_test_compare(SoSeparator * a, SoSeparator * b)
+  {
+    if (!a || !b || (a->getNumChildren() != 2) || (b->getNumChildren() != 2)) return FALSE;
+    const SoMFVec3f & pa = static_cast<SoCoordinate3 *>(a->getChild(0))->point;
+    const SoMFVec3f & pb = static_cast<SoCoordinate3 *>(b->getChild(0))->point;
+    const SoMFInt32 & ia = static_cast<SoIndexedFaceSet *>(a->getChild(1))->coordIndex;
+    const SoMFInt32 & ib = static_cast<SoIndexedFaceSet *>(b->getChild(1))->coordIndex;
+    if ((pa.getNum() != pb.getNum()) || (ia.getNum() != ib.getNum())) return FALSE;
+    for (int i = 0; i < pa.getNum(); i++) { if (pa[i] != pb[i]) return FALSE; }
+    for (int i = 0; i < ia.getNum(); i++) { if (ia[i] != ib[i]) return FALSE; }
+    return TRUE;
+  }
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(binaryArrayRoundTrip)
+{
+  SoSeparator * root = SoInput_test_scene(50000);
+  root->ref();
+
+  // memory buffer, parsed in place
+  SoOutput out;
+  out.setBinary(TRUE);
+  out.setBuffer(malloc(1024), 1024, realloc);
+  SoWriteAction wa(&out);
+  wa.apply(root);
+  void * buf;
+  size_t size;
+  out.getBuffer(buf, size);
+
+  SoInput in;
+  in.setBuffer(buf, size);
+  SoSeparator * readroot = SoDB::readAll(&in);
+  BOOST_CHECK_MESSAGE(readroot != NULL, "failed to read binary buffer");
+  if (readroot) {
+    readroot->ref();
+    BOOST_CHECK_MESSAGE(SoInput_test_compare(root, readroot),
+                        "binary buffer did not read back unchanged");
+    readroot->unref();
+  }
+  free(buf);
+
+  // file, memory mapped by openFile()
+  const char * filename = "SoInput_binaryArrayRoundTrip.iv";
+  SoOutput fileout;
+  fileout.setBinary(TRUE);
+  if (fileout.openFile(filename)) {
+    SoWriteAction fwa(&fileout);
+    fwa.apply(root);
+    fileout.closeFile();
+
+    SoInput filein;
+    BOOST_CHECK_MESSAGE(filein.openFile(filename), "failed to open binary file");
+    readroot = SoDB::readAll(&filein);
+    BOOST_CHECK_MESSAGE(readroot != NULL, "failed to read binary file");
+    if (readroot) {
+      readroot->ref();
+      BOOST_CHECK_MESSAGE(SoInput_test_compare(root, readroot),
+                          "binary file did not read back unchanged");
+      readroot->unref();
+    }
+    filein.closeFile();
+    (void)remove(filename);
+  }
+
+  root->unref();
+}
+
+BOOST_AUTO_TEST_CASE(asciiArrayParsing)
+{
+  // the bulk parser must give the same values as strtod() / strtol()
+  const char * reals[] = {
+    "0", "-0", "1", "+2", "-3.5", ".25", "7.", "0.1", "0.3", "1e10", "2.5E+3",
+    "-1.25e-2", "3.4028235e38", "1e-320", "0.30000001192092896",
+    "123456789012345678901234", "1.00000000000000000000001",
+    "0.000000000000000000000000001234", "9007199254740993", "4.9e-324",
+    "12345678.87654321", "000123.4500"
+  };
+  const int numreals = sizeof(reals) / sizeof(reals[0]);
+  const char * separators[] = { " ", ", ", "\n  ", ",\r\n", "\t" };
+
+  SbString str("[ ");
+  for (int i = 0; i < numreals; i++) {
+    str += reals[i];
+    str += (i == numreals - 1) ? " ]" : separators[i % 5];
+  }
+  SoMFDouble doubles;
+  BOOST_CHECK_MESSAGE(doubles.set(str.getString()), "failed to read doubles");
+  BOOST_CHECK_EQUAL(doubles.getNum(), numreals);
+  for (int i = 0; i < doubles.getNum(); i++) {
+    BOOST_CHECK_MESSAGE(doubles[i] == strtod(reals[i], NULL),
+                        "double mismatch for " << reals[i]);
+  }
+  SoMFFloat floats;
+  BOOST_CHECK_MESSAGE(floats.set(str.getString()), "failed to read floats");
+  BOOST_CHECK_EQUAL(floats.getNum(), numreals);
+  for (int i = 0; i < floats.getNum(); i++) {
+    BOOST_CHECK_MESSAGE(floats[i] == float(strtod(reals[i], NULL)),
+                        "float mismatch for " << reals[i]);
+  }
+
+  // many random values, printed with different precisions
+  srand(42);
+  const int numrandom = 3 * 10000;
+  SbList<SbString> tokens;
+  str = "[ ";
+  for (int i = 0; i < numrandom; i++) {
+    const double v = (double(rand()) / RAND_MAX - 0.5) * pow(10.0, (rand() % 40) - 20);
+    SbString token;
+    token.sprintf((i % 3) == 0 ? "%.17g" : ((i % 3) == 1 ? "%.9g" : "%g"), v);
+    tokens.append(token);
+    str += token;
+    str += ((i % 3) == 2) ? ",\n" : " ";
+  }
+  str += "]";
+  SoMFVec3f points;
+  BOOST_CHECK_MESSAGE(points.set(str.getString()), "failed to read points");
+  BOOST_CHECK_EQUAL(points.getNum(), numrandom / 3);
+  int mismatches = 0;
+  for (int i = 0; i < points.getNum() * 3; i++) {
+    if (points[i / 3][i % 3] != float(strtod(tokens[i].getString(), NULL))) mismatches++;
+  }
+  BOOST_CHECK_EQUAL(mismatches, 0);
+
+  // integers, including formats left to the regular parser
+  const char * ints[] = {
+    "0", "1", "-1", "+5", "123456789", "2147483647", "-2147483648",
+    "0x1f", "017", "1000000000"
+  };
+  const int numints = sizeof(ints) / sizeof(ints[0]);
+  str = "[ ";
+  for (int i = 0; i < numints; i++) {
+    str += ints[i];
+    str += (i == numints - 1) ? " ]" : ", # comment\n";
+  }
+  SoMFInt32 indices;
+  BOOST_CHECK_MESSAGE(indices.set(str.getString()), "failed to read integers");
+  BOOST_CHECK_EQUAL(indices.getNum(), numints);
+  for (int i = 0; i < indices.getNum(); i++) {
+    BOOST_CHECK_MESSAGE(indices[i] == int32_t(strtol(ints[i], NULL, 0)),
+                        "integer mismatch for " << ints[i]);
+  }
+}
+
+#endif // COIN_TEST_SUITE
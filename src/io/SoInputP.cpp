@@ -332,3 +332,45 @@ SoInputP::isNameCharVRML2(unsigned char c, SbBool validIdent)
   if (validIdent) return (valid_ident_invalid_vrml2_table[c] == 0);
   return (invalid_vrml2_table[c] == 0);
 }
+
+// *************************************************************************
+
+// Bulk parsing of ASCII number arrays, used by SoMField::readValue().
+// Returns the number of values read, which is 0 whenever the values
+// must be read one by one through the regular parser instead.
+
+int
+SoInputP::readValues(SoInput * in, float * values,
+                     const int maxnum, const int numcomponents)
+{
+  SoInput_FileInfo * fi = in->getTopOfStack();
+  if ((fi == NULL) || fi->isBinary()) return 0;
+  return fi->readRealValues(values, maxnum, numcomponents);
+}
+
+int
+SoInputP::readValues(SoInput * in, double * values,
+                     const int maxnum, const int numcomponents)
+{
+  SoInput_FileInfo * fi = in->getTopOfStack();
+  if ((fi == NULL) || fi->isBinary()) return 0;
+  return fi->readRealValues(values, maxnum, numcomponents);
+}
+
+int
+SoInputP::readValues(SoInput * in, int32_t * values,
+                     const int maxnum, const int numcomponents)
+{
+  SoInput_FileInfo * fi = in->getTopOfStack();
+  if ((fi == NULL) || fi->isBinary()) return 0;
+  return fi->readIntegerValues(values, maxnum, numcomponents);
+}
+
+int
+SoInputP::readValues(SoInput * in, uint32_t * values,
+                     const int maxnum, const int numcomponents)
+{
+  SoInput_FileInfo * fi = in->getTopOfStack();
+  if ((fi == NULL) || fi->isBinary()) return 0;
+  return fi->readUnsignedIntegerValues(values, maxnum, numcomponents);
+}
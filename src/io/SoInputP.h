@@ -65,6 +65,15 @@ public:
   static SbBool isNameStartCharVRML2(unsigned char c, SbBool validIdent);
   static SbBool isNameCharVRML2(unsigned char c, SbBool validIdent);
 
+  static int readValues(SoInput * in, float * values,
+                        const int maxnum, const int numcomponents);
+  static int readValues(SoInput * in, double * values,
+                        const int maxnum, const int numcomponents);
+  static int readValues(SoInput * in, int32_t * values,
+                        const int maxnum, const int numcomponents);
+  static int readValues(SoInput * in, uint32_t * values,
+                        const int maxnum, const int numcomponents);
+
   SbBool usingstdin;
 
   SbHash<const char *, SoBase *> copied_references;
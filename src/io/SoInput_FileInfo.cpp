@@ -33,7 +33,9 @@
 #include "io/SoInput_FileInfo.h"
 
 #include <cstring>
-#include <cmath> // pow()
+#include <cfloat>
+#include <clocale>
+#include <cstdlib>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -70,10 +72,10 @@ SoInput_FileInfo::SoInput_FileInfo(SoInput_Reader * readerptr,
   this->threadreadidx = 0;
   this->threadbufidx = 0;
   this->threadeof = FALSE;
+#endif // HAVE_THREADS && SOINPUT_ASYNC_IO
+  // allocated on demand, as readers with a direct buffer don't need it
+  this->ownbuf = NULL;
   this->readbuf = NULL;
-#else // HAVE_THREADS && SOINPUT_ASYNC_IO
-  this->readbuf = new char[READBUFSIZE];
-#endif // !(HAVE_THREADS && SOINPUT_ASYNC_IO)
   this->readbuflen = 0;
   this->readbufidx = 0;
 
@@ -109,9 +111,8 @@ SoInput_FileInfo::~SoInput_FileInfo()
   cc_mutex_destruct(this->mutex);
   delete[] this->threadbuf[0];
   delete[] this->threadbuf[1];
-#else // HAVE_THREADS && SOINPUT_ASYNC_IO
-  delete[] this->readbuf;
-#endif // !(HAVE_THREADS && SOINPUT_ASYNC_IO)
+#endif // HAVE_THREADS && SOINPUT_ASYNC_IO
+  delete[] this->ownbuf;
   delete this->reader;
   // to be safe, delete this after deleting the reader
   delete[] this->deletebuffer;
@@ -181,7 +182,20 @@ SoInput_FileInfo::doBufferRead(void)
 
 #else // HAVE_THREADS && SOINPUT_ASYNC_IO
 
-  size_t len = this->getReader()->readBuffer(this->readbuf, READBUFSIZE);
+  // Parse straight from the reader's memory if it has all data
+  // available (memory mapped files and memory buffers). Everything
+  // is then handed over in one go, and we'll only get here again to
+  // detect the EOF.
+  size_t len;
+  const char * direct = this->getReader()->getDirectBuffer(len);
+  if (direct) {
+    this->readbuf = direct;
+  }
+  else {
+    if (this->ownbuf == NULL) { this->ownbuf = new char[READBUFSIZE]; }
+    this->readbuf = this->ownbuf;
+    len = this->getReader()->readBuffer(this->ownbuf, READBUFSIZE);
+  }
   if (len == 0) {
     this->readbufidx = 0;
     this->readbuflen = 0;
@@ -198,6 +212,39 @@ SoInput_FileInfo::doBufferRead(void)
 #endif // !(HAVE_THREADS && SOINPUT_ASYNC_IO)
 }
 
+// Returns a pointer to all data not yet parsed, if the reader handed
+// over the complete file in memory (see
+// SoInput_Reader::getDirectBuffer()). Returns NULL if some of the
+// data is still to be read from the reader, or if characters have
+// been put back.
+const char *
+SoInput_FileInfo::getDirectRemainder(size_t & length)
+{
+#if defined(HAVE_THREADS) && defined(SOINPUT_ASYNC_IO)
+  return NULL;
+#else // HAVE_THREADS && SOINPUT_ASYNC_IO
+  if (this->backbuffer.getLength() > 0) return NULL;
+  if (this->readbuf == NULL || this->readbuf == this->ownbuf) return NULL;
+  length = this->readbuflen - this->readbufidx;
+  return this->readbuf + this->readbufidx;
+#endif // !(HAVE_THREADS && SOINPUT_ASYNC_IO)
+}
+
+// Marks the data returned from getDirectRemainder() as parsed. The
+// next read will hit EOF.
+void
+SoInput_FileInfo::skipDirectRemainder(void)
+{
+  assert(this->backbuffer.getLength() == 0);
+  const char * ptr = this->readbuf + this->readbufidx;
+  const char * end = this->readbuf + this->readbuflen;
+  while ((ptr = static_cast<const char *>(memchr(ptr, '\n', end - ptr))) != NULL) {
+    this->linenr++;
+    ptr++;
+  }
+  this->readbufidx = this->readbuflen;
+}
+
 size_t
 SoInput_FileInfo::getNumBytesParsedSoFar(void) const
 {
@@ -215,9 +262,13 @@ SoInput_FileInfo::getChunkOfBytes(unsigned char * ptr, size_t length)
 
   do {
     // Grab bytes from the buffer.
-    while ((this->readbufidx < this->readbuflen) && (length > 0)) {
-      *ptr++ = this->readbuf[this->readbufidx++];
-      --length;
+    size_t n = this->readbuflen - this->readbufidx;
+    if (n > length) { n = length; }
+    if (n > 0) {
+      (void)memcpy(ptr, this->readbuf + this->readbufidx, n);
+      this->readbufidx += n;
+      ptr += n;
+      length -= n;
     }
 
     // Fetch more bytes if necessary. doBufferRead() sets the eof-flag
@@ -229,6 +280,26 @@ SoInput_FileInfo::getChunkOfBytes(unsigned char * ptr, size_t length)
   return !this->eof;
 }
 
+// Returns a pointer to the next length bytes in the read buffer and
+// skips past them, if they are available as one contiguous block. This
+// lets binary array data be converted directly from the buffer (which
+// for memory mapped files is the file itself) without an intermediate
+// copy. Returns NULL if the data is not directly available, in which
+// case getChunkOfBytes() must be used.
+const char *
+SoInput_FileInfo::getChunkPointer(size_t length)
+{
+  if (this->backbuffer.getLength() > 0) { return NULL; }
+  if ((this->readbufidx == this->readbuflen) && !this->eof) {
+    this->doBufferRead();
+  }
+  if (this->readbuflen - this->readbufidx < length) { return NULL; }
+
+  const char * ptr = this->readbuf + this->readbufidx;
+  this->readbufidx += length;
+  return ptr;
+}
+
 void
 SoInput_FileInfo::addReference(const SbName & name, SoBase * base,
                                SbBool /* addToGlobalDict */) // FIXME: why the unused arg?
@@ -490,6 +561,334 @@ SoInput_FileInfo::getReader(void)
   return this->reader;
 }
 
+// *************************************************************************
+
+// Number parsing for readReal() and the bulk array readers. The
+// parse functions read from [ptr, end), and return a pointer past
+// the number, or NULL if there is no number on the expected form at
+// ptr or if the number runs into end (the rest of it might not have
+// been read into the buffer yet).
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SOINPUT_SWAR_DIGITS
+#endif // little endian
+#elif defined(_WIN32)
+#define SOINPUT_SWAR_DIGITS
+#endif // _WIN32
+
+// Multiplying or dividing an exactly representable mantissa by an
+// exactly representable power of ten gives a correctly rounded
+// result, as long as the FPU doesn't compute with extended precision.
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+#define SOINPUT_EXACT_DOUBLE_OPS
+#endif // FLT_EVAL_METHOD == 0
+
+static inline SbBool
+soinput_isdigit(const char c)
+{
+  return (c >= '0') && (c <= '9');
+}
+
+#ifdef SOINPUT_SWAR_DIGITS
+
+// Checks and converts eight characters at a time, using 64-bit
+// arithmetic on the characters loaded as a little-endian word.
+static inline SbBool
+soinput_is_eight_digits(const uint64_t val)
+{
+  return (((val & 0xf0f0f0f0f0f0f0f0ULL) |
+           (((val + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) ==
+          0x3333333333333333ULL);
+}
+
+static inline uint32_t
+soinput_eight_digits_value(uint64_t val)
+{
+  val = ((val & 0x0f0f0f0f0f0f0f0fULL) * 2561) >> 8;
+  val = ((val & 0x00ff00ff00ff00ffULL) * 6553601) >> 16;
+  return static_cast<uint32_t>(((val & 0x0000ffff0000ffffULL) * 42949672960001ULL) >> 32);
+}
+
+#endif // SOINPUT_SWAR_DIGITS
+
+// Accumulates a run of digits into mantissa, keeping at most 19
+// significant digits (which always fit in 64 bits). Returns the
+// number of digits kept, and adds the number of digits that didn't
+// fit to dropped.
+static inline int
+soinput_read_digits(const char *& ptr, const char * end,
+                    uint64_t & mantissa, int & numdigits, int & dropped)
+{
+  const int before = numdigits;
+#ifdef SOINPUT_SWAR_DIGITS
+  while (((end - ptr) >= 8) && (numdigits <= 19 - 8)) {
+    uint64_t val;
+    (void)memcpy(&val, ptr, 8);
+    if (!soinput_is_eight_digits(val)) break;
+    mantissa = mantissa * 100000000 + soinput_eight_digits_value(val);
+    numdigits += 8;
+    ptr += 8;
+  }
+#endif // SOINPUT_SWAR_DIGITS
+  while ((ptr < end) && soinput_isdigit(*ptr)) {
+    if (numdigits < 19) {
+      mantissa = mantissa * 10 + (*ptr - '0');
+      numdigits++;
+    }
+    else {
+      dropped++;
+    }
+    ptr++;
+  }
+  return numdigits - before;
+}
+
+// Conversion of the cases the fast path in soinput_parse_real() can't
+// do exactly.
+static double
+soinput_strtod(const char * ptr, const char * end)
+{
+  char buf[64];
+  const size_t len = end - ptr;
+  char * str = (len < sizeof(buf)) ? buf : new char[len + 1];
+  (void)memcpy(str, ptr, len);
+  str[len] = '\0';
+
+  // strtod() expects the decimal point of the current locale.
+  const char point = localeconv()->decimal_point[0];
+  if (point != '.') {
+    char * dot = strchr(str, '.');
+    if (dot) *dot = point;
+  }
+  const double d = strtod(str, NULL);
+  if (str != buf) delete[] str;
+  return d;
+}
+
+// Parses [+-]digits[.digits][(e|E)[+-]digits], where at least one
+// mantissa digit must be present. The result is correctly rounded,
+// i.e. bit-exact with what strtod() returns.
+static const char *
+soinput_parse_real(const char * ptr, const char * end, double & d)
+{
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  const char * p = ptr;
+  SbBool minus = FALSE;
+  if ((p < end) && ((*p == '-') || (*p == '+'))) { minus = (*p++ == '-'); }
+  const char * number = p;
+
+  uint64_t mantissa = 0;
+  int numdigits = 0, dropped = 0, exponent = 0;
+  SbBool gotnum = FALSE;
+
+  // leading zeros are not significant
+  while ((p < end) && (*p == '0')) { p++; gotnum = TRUE; }
+  if (soinput_read_digits(p, end, mantissa, numdigits, dropped) > 0) gotnum = TRUE;
+  // digits dropped from the integer part are still powers of ten
+  exponent += dropped;
+
+  if ((p < end) && (*p == '.')) {
+    p++;
+    if (mantissa == 0) {
+      while ((p < end) && (*p == '0')) { p++; exponent--; gotnum = TRUE; }
+    }
+    // digits dropped from the fraction part don't change the exponent
+    const int n = soinput_read_digits(p, end, mantissa, numdigits, dropped);
+    if (n > 0) gotnum = TRUE;
+    exponent -= n;
+  }
+  if (!gotnum) return NULL;
+
+  if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+    p++;
+    SbBool expminus = FALSE;
+    if ((p < end) && ((*p == '-') || (*p == '+'))) { expminus = (*p++ == '-'); }
+    if ((p == end) || !soinput_isdigit(*p)) return NULL;
+    int e = 0;
+    while ((p < end) && soinput_isdigit(*p)) {
+      if (e < 100000) { e = e * 10 + (*p - '0'); }
+      p++;
+    }
+    exponent += expminus ? -e : e;
+  }
+  if (p == end) return NULL;
+
+  double value;
+  if (mantissa == 0) {
+    value = 0.0;
+  }
+#ifdef SOINPUT_EXACT_DOUBLE_OPS
+  else if ((dropped == 0) && (mantissa <= (uint64_t(1) << 53)) &&
+           (exponent >= -22) && (exponent <= 22)) {
+    value = static_cast<double>(mantissa);
+    if (exponent < 0) value /= powers[-exponent];
+    else value *= powers[exponent];
+  }
+#endif // SOINPUT_EXACT_DOUBLE_OPS
+  else {
+    value = soinput_strtod(number, p);
+  }
+  d = minus ? -value : value;
+  return p;
+}
+
+// Parses an integer the same way as readInteger() and
+// readUnsignedInteger(), but only handles plain decimal numbers of up
+// to nine digits. Anything else (hex or octal numbers, larger values)
+// is left to strtol() / strtoul() through the regular parser.
+static const char *
+soinput_parse_decimal(const char * ptr, const char * end,
+                      const SbBool allowsign, SbBool & minus, uint32_t & value)
+{
+  const char * p = ptr;
+  minus = FALSE;
+  if (allowsign && (p < end) && ((*p == '-') || (*p == '+'))) { minus = (*p++ == '-'); }
+  if ((p == end) || !soinput_isdigit(*p)) return NULL;
+
+  const char * digits = p;
+  uint32_t v = 0;
+  while ((p < end) && soinput_isdigit(*p)) {
+    v = v * 10 + (*p++ - '0');
+    if (p - digits > 9) return NULL;
+  }
+  if (p == end) return NULL;
+  // leading '0' means octal, and "0x" hex
+  if ((*digits == '0') && ((p - digits > 1) || (*p == 'x'))) return NULL;
+
+  value = v;
+  return p;
+}
+
+static inline const char *
+soinput_parse_value(const char * ptr, const char * end, float & value)
+{
+  double d;
+  ptr = soinput_parse_real(ptr, end, d);
+  if (ptr == NULL) return NULL;
+  // non-finite values are reported by SoInput::read()
+  value = static_cast<float>(d);
+  return coin_finite(value) ? ptr : NULL;
+}
+
+static inline const char *
+soinput_parse_value(const char * ptr, const char * end, double & value)
+{
+  ptr = soinput_parse_real(ptr, end, value);
+  if (ptr == NULL) return NULL;
+  return coin_finite(value) ? ptr : NULL;
+}
+
+static inline const char *
+soinput_parse_value(const char * ptr, const char * end, int32_t & value)
+{
+  SbBool minus;
+  uint32_t v;
+  ptr = soinput_parse_decimal(ptr, end, TRUE, minus, v);
+  if (ptr) value = minus ? -static_cast<int32_t>(v) : static_cast<int32_t>(v);
+  return ptr;
+}
+
+static inline const char *
+soinput_parse_value(const char * ptr, const char * end, uint32_t & value)
+{
+  SbBool minus;
+  return soinput_parse_decimal(ptr, end, FALSE, minus, value);
+}
+
+// *************************************************************************
+
+template <typename Type>
+int
+SoInput_FileInfo::readNumberValues(Type * values, const int maxnum,
+                                   const int numcomponents)
+{
+  assert(!this->isBinary());
+  if (this->backbuffer.getLength() > 0) return 0;
+  if (this->readbufidx >= this->readbuflen) return 0;
+
+  const char * const start = this->readbuf + this->readbufidx;
+  const char * const end = this->readbuf + this->readbuflen;
+  const SbBool commaisspace = this->vrml2file;
+
+  const char * ptr = start;
+  const char * committed = start;
+  unsigned int lines = 0, committedlines = 0;
+  int num = 0;
+
+  while (num < maxnum) {
+    Type * value = values + num * numcomponents;
+    int i;
+    for (i = 0; i < numcomponents; i++) {
+      // Whitespace in front of each number, as skipWhiteSpace(), and
+      // a single comma between values, as SoMField::readValue().
+      // Comments are left to the regular parser.
+      SbBool allowcomma = commaisspace || ((i == 0) && (num > 0));
+      while (ptr < end) {
+        const char c = *ptr;
+        if ((c == ' ') || (c == '\t') || (c == '\f') || (c == '\v')) { }
+        else if (c == '\r') { lines++; }
+        else if (c == '\n') {
+          // count "\r\n" as one line, as get() does
+          const int prev = (ptr > start) ? ptr[-1] : this->lastchar;
+          if (prev != '\r') lines++;
+        }
+        else if ((c == ',') && allowcomma) { allowcomma = commaisspace; }
+        else break;
+        ptr++;
+      }
+      const char * next = soinput_parse_value(ptr, end, value[i]);
+      if (next == NULL) break;
+      ptr = next;
+    }
+    if (i < numcomponents) break;
+
+    committed = ptr;
+    committedlines = lines;
+    num++;
+  }
+
+  if (num > 0) {
+    this->readbufidx += committed - start;
+    this->linenr += committedlines;
+    this->lastchar = committed[-1];
+    this->lastputback = -1;
+  }
+  return num;
+}
+
+int
+SoInput_FileInfo::readRealValues(float * values, const int maxnum,
+                                 const int numcomponents)
+{
+  return this->readNumberValues(values, maxnum, numcomponents);
+}
+
+int
+SoInput_FileInfo::readRealValues(double * values, const int maxnum,
+                                 const int numcomponents)
+{
+  return this->readNumberValues(values, maxnum, numcomponents);
+}
+
+int
+SoInput_FileInfo::readIntegerValues(int32_t * values, const int maxnum,
+                                    const int numcomponents)
+{
+  return this->readNumberValues(values, maxnum, numcomponents);
+}
+
+int
+SoInput_FileInfo::readUnsignedIntegerValues(uint32_t * values, const int maxnum,
+                                            const int numcomponents)
+{
+  return this->readNumberValues(values, maxnum, numcomponents);
+}
+
 SbBool
 SoInput_FileInfo::readUnsignedIntegerString(char * str)
 {
@@ -595,45 +994,26 @@ SoInput_FileInfo::readReal(double & d)
 {
   assert(!this->isBinary());
   const int BUFSIZE = 2048;
-  SbBool minus = FALSE;
   SbBool gotNum = FALSE;
-  int i, n;
+  int n;
   char str[BUFSIZE];
   char * s = str;
 
-  double number;
-  double exponent;
-
   n = this->readChar(s, '-');
   if (n == 0) {
     n = this->readChar(s, '+');
   }
-  else minus = TRUE;
   s += n;
 
   if ((n = this->readDigits(s)) > 0) {
     gotNum = TRUE;
-    number = 0.0;
-    double mul = 1.0;
-    for (i = 0; i < n; i++) {
-      number += (s[(n-1)-i] - '0') * mul;
-      mul *= 10.0;
-    }
     s += n;
   }
-  else {
-    number = 0.0;
-  }
   if (this->readChar(s, '.') > 0) {
     s++;
 
     if ((n = this->readDigits(s)) > 0) {
       gotNum = TRUE;
-      double mul = 0.1;
-      for (i = 0; i < n; i++) {
-        number += (s[i]-'0') * mul;
-        mul *= 0.1;
-      }
       s += n;
     }
   }
@@ -641,8 +1021,6 @@ SoInput_FileInfo::readReal(double & d)
   if (! gotNum)
     return FALSE;
 
-  if (minus) number = -number;
-
   n = this->readChar(s, 'e');
   if (n == 0)
     n = this->readChar(s, 'E');
@@ -650,31 +1028,24 @@ SoInput_FileInfo::readReal(double & d)
   if (n > 0) {
     s += n;
 
-    minus = FALSE;
     n = this->readChar(s, '-');
     if (n == 0) {
       n = this->readChar(s, '+');
     }
-    else minus = TRUE;
     s += n;
 
     if ((n = this->readDigits(s)) > 0) {
-      exponent = 0.0;
-      double mul = 1.0;
-      for (i = 0; i < n; i++) {
-        exponent += (s[(n-1)-i]-'0') * mul;
-        mul *= 10.0;
-      }
-      if (minus) exponent = -exponent;
-
-      number *= pow(10.0, exponent);
+      s += n;
     }
     else
       return FALSE;
   }
 
-  d = number;
-  return TRUE;
+  // Convert the same way as the bulk array parsing does, so that
+  // values come out identical no matter which path read them. The
+  // terminating '\0' stops the parser.
+  *s = '\0';
+  return soinput_parse_real(str, s + 1, d) != NULL;
 }
 
 int
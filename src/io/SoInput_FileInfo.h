@@ -79,6 +79,9 @@ public:
   size_t getNumBytesParsedSoFar(void) const;
 
   SbBool getChunkOfBytes(unsigned char * ptr, size_t length);
+  const char * getChunkPointer(size_t length);
+  const char * getDirectRemainder(size_t & length);
+  void skipDirectRemainder(void);
   SbBool get(char & c);
 
   void putBack(const char c);
@@ -210,6 +213,17 @@ public:
   SbBool readInteger(int32_t & l);
   SbBool readReal(double & d);
 
+  // Bulk parsing of ASCII number arrays, for SoMField::readValue().
+  // Reads at most maxnum values of numcomponents numbers each straight
+  // from the read buffer, and returns how many complete values were
+  // read. Stops at anything the regular parser must handle (comments,
+  // unusual number formats, the end of the buffer), leaving the
+  // stream right after the last value read.
+  int readRealValues(float * values, const int maxnum, const int numcomponents);
+  int readRealValues(double * values, const int maxnum, const int numcomponents);
+  int readIntegerValues(int32_t * values, const int maxnum, const int numcomponents);
+  int readUnsignedIntegerValues(uint32_t * values, const int maxnum, const int numcomponents);
+
   const SbHash<const char *, SoBase *> & getReferences() const {
     return this->references;
   }
@@ -218,6 +232,8 @@ private:
   SoInput_Reader * getReader(void);
   SoInput_Reader * reader;
   SbBool readHeaderInternal(SoInput * input);
+  template <typename Type>
+  int readNumberValues(Type * values, const int maxnum, const int numcomponents);
 
   unsigned int linenr;
 
@@ -228,7 +244,8 @@ private:
   void * userdata;
   SbBool isbinary;
 
-  char * readbuf;
+  const char * readbuf; // current buffer, either ownbuf or data owned by the reader
+  char * ownbuf;
   size_t readbufidx;
   size_t readbuflen;
   size_t totalread;
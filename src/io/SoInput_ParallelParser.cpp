@@ -0,0 +1,860 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*
+  Parallel import of ASCII Inventor files, used by SoDB::readAll().
+
+  A quick scan over the file text (which only knows about comments,
+  strings, braces and the DEF / USE keywords) splits the file into
+  ranges holding one node each. These are either the top-level nodes
+  of the file, or, if the file has just a single top-level group
+  node, the children of that group. Consecutive ranges are then
+  gathered into chunks of roughly equal size, and each chunk is parsed
+  by a standard SoInput reading from a copy of the chunk text.
+
+  Chunks which USE names defined in earlier chunks are read on the
+  calling thread once the independent chunks have been read by the
+  worker threads, with the names they need seeded into their SoInput
+  from the chunks which defined them. So are chunks containing node
+  types which set up sensors or otherwise touch global state when
+  read, as that is not safe to do from several threads at once.
+
+  The scan bails out (and the file is read serially as before) on
+  anything it doesn't fully understand, so that a successful parallel
+  import gives the same scene graph as a serial import.
+*/
+
+#include "io/SoInput_ParallelParser.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cstring>
+#include <atomic>
+
+#include <Inventor/SoDB.h>
+#include <Inventor/SoInput.h>
+#include <Inventor/SoType.h>
+#include <Inventor/SbName.h>
+#include <Inventor/SbString.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/nodes/SoGroup.h>
+#include <Inventor/errors/SoReadError.h>
+#include <Inventor/engines/SoEngine.h>
+#include <Inventor/lists/SoFieldList.h>
+#include <Inventor/fields/SoSFNode.h>
+#include <Inventor/fields/SoMFNode.h>
+
+#ifdef HAVE_THREADS
+#include <Inventor/C/threads/thread.h>
+#endif // HAVE_THREADS
+
+#include "io/SoInput_FileInfo.h"
+#include "misc/SbHash.h"
+#include "coindefs.h" // COIN_UNUSED_ARG()
+
+// *************************************************************************
+
+// Files (or rather, the part of them to be split up) smaller than
+// this are not worth the overhead.
+static const size_t SOPP_MIN_PARALLEL_SIZE = 64 * 1024;
+// The smallest chunk size we'll bother handing to a thread.
+static const size_t SOPP_MIN_CHUNK_SIZE = 16 * 1024;
+// Chunks per thread, to even out the load.
+static const int SOPP_CHUNKS_PER_THREAD = 4;
+
+// Node types which must be created on the calling thread, as they set
+// up sensors, connect to global fields or do file I/O while being
+// read. Subtypes are also included.
+static const char * sopp_serial_types[] = {
+  "File", "Texture2", "Texture3", "TextureCubeMap", "BumpMap", "Image",
+  "Text2", "Rotor", "Blinker", "Shuttle", "Pendulum", "ExtSelection",
+  "ShaderProgram", "ShaderObject", "BaseKit", "TransformManip",
+  "ClipPlaneManip", "DirectionalLightManip", "PointLightManip",
+  "SpotLightManip", "VRMLParent", "VRMLScript", "VRMLTimeSensor",
+  "VRMLInline", "VRMLImageTexture", "VRMLAudioClip", "VRMLSound",
+  "VRMLBackground", "VRMLFog", "VRMLText", NULL
+};
+
+// Same as coin_isspace(), but inlined for the scanner loops.
+static inline SbBool
+sopp_isspace(const char c)
+{
+  return (c == ' ') || (c == '\n') || (c == '\t') ||
+         (c == '\r') || (c == '\f') || (c == '\v');
+}
+
+enum SoppToken {
+  SOPP_END,
+  SOPP_WORD,
+  SOPP_STRING,
+  SOPP_OPEN_BRACE,
+  SOPP_CLOSE_BRACE,
+  SOPP_OPEN_BRACKET,
+  SOPP_CLOSE_BRACKET,
+  SOPP_ERROR
+};
+
+enum SoppClass {
+  SOPP_CLASS_INVALID,
+  SOPP_CLASS_PARALLEL,
+  SOPP_CLASS_SERIAL
+};
+
+// One node in the file.
+struct SoppRange {
+  size_t begin, end;
+  SbBool serial;
+  // The names DEF'ed in the range, and the names USE'd in the range
+  // before being DEF'ed in it, as index spans into the lists in
+  // SoppScanner.
+  int firstdef, numdefs;
+  int firstuse, numuses;
+};
+
+// A consecutive run of ranges to be read by a single SoInput.
+struct SoppChunk {
+  int firstrange, numranges;
+  SbBool dependent;
+  SbList<SbName> imports;
+  char * buffer;
+  SoInput * input;
+  SbList<SoNode *> nodes;
+  SbBool ok;
+};
+
+// *************************************************************************
+
+// The tokenizer and scanner for finding node ranges.
+class SoppScanner {
+public:
+  SoppScanner(const char * buf, size_t len)
+    : start(buf), ptr(buf), end(buf + len), tokstart(NULL), toklen(0) { }
+
+  size_t offset(void) const { return this->ptr - this->start; }
+  size_t tokenOffset(void) const { return this->tokstart - this->start; }
+
+  SbBool scanTopLevel(SbList<SoppRange> & ranges, SoppRange & top,
+                      size_t & bodystart, size_t & bodyend);
+  SbBool scanChildren(SbList<SoppRange> & ranges);
+
+  SbList<SbName> defs;
+  SbList<SbName> uses;
+
+private:
+  void skipWhiteSpace(void);
+  SoppToken next(void);
+  SbBool readRawWord(void);
+  SbBool tokenIs(const char * s) const {
+    const size_t len = strlen(s);
+    return (this->toklen == len) && (memcmp(this->tokstart, s, len) == 0);
+  }
+  SbName tokenName(void) const {
+    return SbName(SbString(this->tokstart, 0, int(this->toklen) - 1).getString());
+  }
+
+  SbBool scanNode(SoppToken token, SoppRange & range,
+                  size_t * bodystart = NULL, size_t * bodyend = NULL);
+  SbBool scanBody(SoppRange & range);
+  SbBool checkClass(SoppRange & range);
+  void addDef(SoppRange & range);
+  void addUse(SoppRange & range);
+
+  const char * start;
+  const char * ptr;
+  const char * end;
+  const char * tokstart;
+  size_t toklen;
+
+  SbHash<const char *, int> classcache;
+  SbHash<const char *, int> rangedefs;
+};
+
+void
+SoppScanner::skipWhiteSpace(void)
+{
+  while (this->ptr < this->end) {
+    const char c = *this->ptr;
+    if (c == '#') {
+      while ((this->ptr < this->end) &&
+             (*this->ptr != '\n') && (*this->ptr != '\r')) { this->ptr++; }
+    }
+    else if (sopp_isspace(c)) { this->ptr++; }
+    else break;
+  }
+}
+
+SoppToken
+SoppScanner::next(void)
+{
+  this->skipWhiteSpace();
+  this->tokstart = this->ptr;
+  this->toklen = 0;
+  if (this->ptr == this->end) return SOPP_END;
+
+  const char c = *this->ptr++;
+  this->toklen = 1;
+  switch (c) {
+  case '{': return SOPP_OPEN_BRACE;
+  case '}': return SOPP_CLOSE_BRACE;
+  case '[': return SOPP_OPEN_BRACKET;
+  case ']': return SOPP_CLOSE_BRACKET;
+  case '"':
+    while (this->ptr < this->end) {
+      const char s = *this->ptr++;
+      if (s == '\\') { if (this->ptr < this->end) this->ptr++; }
+      else if (s == '"') {
+        this->toklen = this->ptr - this->tokstart;
+        return SOPP_STRING;
+      }
+    }
+    return SOPP_ERROR; // unterminated string
+  default:
+    break;
+  }
+
+  while (this->ptr < this->end) {
+    const char w = *this->ptr;
+    if (sopp_isspace(w) || w == '{' || w == '}' || w == '[' || w == ']' || w == '"') break;
+    this->ptr++;
+  }
+  this->toklen = this->ptr - this->tokstart;
+  return SOPP_WORD;
+}
+
+// DEF and USE names may contain any non-whitespace character, also
+// braces (see SoInput::read(SbName &, FALSE)).
+SbBool
+SoppScanner::readRawWord(void)
+{
+  this->skipWhiteSpace();
+  this->tokstart = this->ptr;
+  while ((this->ptr < this->end) && !sopp_isspace(*this->ptr)) { this->ptr++; }
+  this->toklen = this->ptr - this->tokstart;
+  return this->toklen > 0;
+}
+
+void
+SoppScanner::addDef(SoppRange & range)
+{
+  const SbName name = this->tokenName();
+  this->defs.append(name);
+  range.numdefs++;
+  this->rangedefs.put(name.getString(), 1);
+}
+
+void
+SoppScanner::addUse(SoppRange & range)
+{
+  // Strip off any ".fieldname" part (from field connections), as is
+  // done in SoBase::PImpl::readReference().
+  const char * dot = static_cast<const char *>(memchr(this->tokstart, '.', this->toklen));
+  if (dot) this->toklen = dot - this->tokstart;
+
+  const SbName name = this->tokenName();
+  int dummy;
+  if (!this->rangedefs.get(name.getString(), dummy)) {
+    this->uses.append(name);
+    range.numuses++;
+  }
+}
+
+static SoppClass
+sopp_classify(const SoType & type)
+{
+  if ((type == SoType::badType()) || !type.canCreateInstance()) {
+    return SOPP_CLASS_INVALID;
+  }
+  // Engines may connect to global fields (like realTime).
+  if (type.isDerivedFrom(SoEngine::getClassTypeId())) return SOPP_CLASS_SERIAL;
+  if (!type.isDerivedFrom(SoNode::getClassTypeId())) return SOPP_CLASS_INVALID;
+
+  for (int i = 0; sopp_serial_types[i]; i++) {
+    const SoType serial = SoType::fromName(sopp_serial_types[i]);
+    if ((serial != SoType::badType()) && type.isDerivedFrom(serial)) {
+      return SOPP_CLASS_SERIAL;
+    }
+  }
+  return SOPP_CLASS_PARALLEL;
+}
+
+// Checks that the current token is a node or engine class we can
+// read, and whether it needs to be read on the calling thread.
+SbBool
+SoppScanner::checkClass(SoppRange & range)
+{
+  const SbName name = this->tokenName();
+  int cls;
+  if (!this->classcache.get(name.getString(), cls)) {
+    cls = sopp_classify(SoType::fromName(name));
+    this->classcache.put(name.getString(), cls);
+  }
+  if (cls == SOPP_CLASS_SERIAL) range.serial = TRUE;
+  return cls != SOPP_CLASS_INVALID;
+}
+
+// Scans a node starting with the given token, which has already been
+// read. If bodystart and bodyend are given, they are set to the
+// offsets just after the opening brace and at the closing brace.
+SbBool
+SoppScanner::scanNode(SoppToken token, SoppRange & range,
+                      size_t * bodystart, size_t * bodyend)
+{
+  range.begin = this->tokenOffset();
+  range.serial = FALSE;
+  range.firstdef = this->defs.getLength();
+  range.numdefs = 0;
+  range.firstuse = this->uses.getLength();
+  range.numuses = 0;
+  this->rangedefs.clear();
+
+  if (token != SOPP_WORD) return FALSE;
+
+  if (this->tokenIs("USE")) {
+    if (!this->readRawWord()) return FALSE;
+    this->addUse(range);
+    range.end = this->offset();
+    return TRUE;
+  }
+  if (this->tokenIs("DEF")) {
+    if (!this->readRawWord()) return FALSE;
+    this->addDef(range);
+    if (this->next() != SOPP_WORD) return FALSE;
+  }
+  if (!this->checkClass(range)) return FALSE;
+  if (this->next() != SOPP_OPEN_BRACE) return FALSE;
+
+  if (bodystart) *bodystart = this->offset();
+  if (!this->scanBody(range)) return FALSE;
+  if (bodyend) *bodyend = this->tokenOffset();
+  range.end = this->offset();
+  return TRUE;
+}
+
+// Scans up to and including the closing brace of a node.
+SbBool
+SoppScanner::scanBody(SoppRange & range)
+{
+  int depth = 1;
+  SbBool prevword = FALSE;
+  for (;;) {
+    const SoppToken token = this->next();
+    switch (token) {
+    case SOPP_END:
+    case SOPP_ERROR:
+      return FALSE;
+    case SOPP_OPEN_BRACE:
+      // The preceding word is the class name of a child node, engine
+      // or node field value.
+      if (!prevword) return FALSE;
+      depth++;
+      break;
+    case SOPP_CLOSE_BRACE:
+      if (--depth == 0) return TRUE;
+      break;
+    case SOPP_WORD:
+      if (this->tokenIs("DEF")) {
+        if (!this->readRawWord()) return FALSE;
+        this->addDef(range);
+        prevword = FALSE;
+        continue;
+      }
+      if (this->tokenIs("USE")) {
+        if (!this->readRawWord()) return FALSE;
+        this->addUse(range);
+        prevword = FALSE;
+        continue;
+      }
+      if (this->tokenIs("PROTO") || this->tokenIs("EXTERNPROTO") ||
+          this->tokenIs("ROUTE")) {
+        return FALSE;
+      }
+      {
+        // Check the class if the word is followed by a brace.
+        const char * save = this->ptr;
+        const char * savetok = this->tokstart;
+        const size_t savelen = this->toklen;
+        this->skipWhiteSpace();
+        const SbBool isclass = (this->ptr < this->end) && (*this->ptr == '{');
+        this->ptr = save;
+        this->tokstart = savetok;
+        this->toklen = savelen;
+        if (isclass && !this->checkClass(range)) return FALSE;
+      }
+      prevword = TRUE;
+      continue;
+    default:
+      break;
+    }
+    prevword = FALSE;
+  }
+}
+
+// Scans the top-level nodes of the file. If there is just one, and it
+// is a group node, top is set to it, together with the span of its
+// body.
+SbBool
+SoppScanner::scanTopLevel(SbList<SoppRange> & ranges, SoppRange & top,
+                          size_t & bodystart, size_t & bodyend)
+{
+  SoppToken token;
+  while ((token = this->next()) != SOPP_END) {
+    SoppRange range;
+    if (!this->scanNode(token, range, &bodystart, &bodyend)) return FALSE;
+    ranges.append(range);
+  }
+  if (ranges.getLength() == 1) top = ranges[0];
+  return TRUE;
+}
+
+// Scans the children of a group node, starting at the beginning of
+// its body, and stopping at the closing brace. Field values are
+// allowed before the first child.
+SbBool
+SoppScanner::scanChildren(SbList<SoppRange> & ranges)
+{
+  SbBool inchildren = FALSE;
+  for (;;) {
+    const SoppToken token = this->next();
+    switch (token) {
+    case SOPP_CLOSE_BRACE:
+      return TRUE;
+    case SOPP_WORD:
+      {
+        // A child node starts with DEF, USE or a class name followed
+        // by an opening brace.
+        SbBool ischild = this->tokenIs("DEF") || this->tokenIs("USE");
+        if (!ischild) {
+          const char * save = this->ptr;
+          this->skipWhiteSpace();
+          ischild = (this->ptr < this->end) && (*this->ptr == '{');
+          this->ptr = save;
+        }
+        if (ischild) {
+          SoppRange range;
+          if (!this->scanNode(token, range)) return FALSE;
+          ranges.append(range);
+          inchildren = TRUE;
+        }
+        else {
+          // Field connections ("field = ...") are left for the serial
+          // import to handle.
+          if (inchildren || memchr(this->tokstart, '=', this->toklen)) return FALSE;
+        }
+      }
+      break;
+    case SOPP_STRING:
+      if (inchildren) return FALSE;
+      break;
+    case SOPP_OPEN_BRACKET:
+      // A multiple-value field.
+      if (inchildren) return FALSE;
+      for (;;) {
+        const SoppToken t = this->next();
+        if (t == SOPP_CLOSE_BRACKET) break;
+        if (t != SOPP_WORD && t != SOPP_STRING) return FALSE;
+      }
+      break;
+    default:
+      return FALSE;
+    }
+  }
+}
+
+// *************************************************************************
+
+// Shared state for the threads reading chunks.
+struct SoppContext {
+  const char * data;
+  SbString header;
+  SbList<SoppRange> * ranges;
+  SbList<SoppChunk *> chunks;
+  std::atomic<int> nextchunk;
+};
+
+static void
+sopp_setup_chunk(SoppContext * context, SoppChunk * chunk)
+{
+  const SoppRange & first = (*context->ranges)[chunk->firstrange];
+  const SoppRange & last = (*context->ranges)[chunk->firstrange + chunk->numranges - 1];
+  const size_t headerlen = context->header.getLength();
+  const size_t datalen = last.end - first.begin;
+
+  chunk->buffer = new char[headerlen + 1 + datalen];
+  memcpy(chunk->buffer, context->header.getString(), headerlen);
+  chunk->buffer[headerlen] = '\n';
+  memcpy(chunk->buffer + headerlen + 1, context->data + first.begin, datalen);
+  chunk->input->setBuffer(chunk->buffer, headerlen + 1 + datalen);
+}
+
+static void
+sopp_read_chunk(SoppChunk * chunk)
+{
+  chunk->ok = FALSE;
+  SoNode * node;
+  do {
+    if (!SoDB::read(chunk->input, node)) return;
+    if (node) {
+      node->ref();
+      chunk->nodes.append(node);
+    }
+  } while (node);
+  // A mismatch here means the scan got it wrong, which the serial
+  // import will have to sort out.
+  chunk->ok = (chunk->nodes.getLength() == chunk->numranges) && chunk->input->eof();
+}
+
+static void *
+sopp_thread_entry(void * closure)
+{
+  SoppContext * context = static_cast<SoppContext *>(closure);
+  const int numchunks = context->chunks.getLength();
+  for (;;) {
+    const int idx = context->nextchunk++;
+    if (idx >= numchunks) break;
+    SoppChunk * chunk = context->chunks[idx];
+    if (!chunk->dependent) {
+      sopp_setup_chunk(context, chunk);
+      sopp_read_chunk(chunk);
+    }
+  }
+  return NULL;
+}
+
+// Finds the node named name in the chunks before idx (the chunk
+// defining it last wins), in the top-level group node, or in the
+// SoInput we're reading for.
+static SoBase *
+sopp_find_reference(SoppContext * context, SoInput * in, SoInput * topinput,
+                    int idx, const SbName & name)
+{
+  for (int i = idx - 1; i >= 0; i--) {
+    SoBase * base = context->chunks[i]->input->findReference(name);
+    if (base) return base;
+  }
+  if (topinput) {
+    SoBase * base = topinput->findReference(name);
+    if (base) return base;
+  }
+  return in->findReference(name);
+}
+
+// Returns TRUE if the type is a group we can split up the children
+// of, i.e. it has no fields which may hold nodes.
+static SbBool
+sopp_is_splittable_group(const SoType & type)
+{
+  if ((sopp_classify(type) != SOPP_CLASS_PARALLEL) ||
+      !type.isDerivedFrom(SoGroup::getClassTypeId())) {
+    return FALSE;
+  }
+  SoGroup * group = static_cast<SoGroup *>(type.createInstance());
+  group->ref();
+  SbBool ok = TRUE;
+  SoFieldList fields;
+  const int numfields = group->getFields(fields);
+  for (int i = 0; i < numfields; i++) {
+    const SoField * field = fields[i];
+    if (field->isOfType(SoSFNode::getClassTypeId()) ||
+        field->isOfType(SoMFNode::getClassTypeId())) {
+      ok = FALSE;
+      break;
+    }
+  }
+  group->unref();
+  return ok;
+}
+
+// Read errors are not reported while reading chunks. The serial
+// import taking over on failure reports them, with the proper line
+// numbers.
+static void
+sopp_ignore_error(const SoError * COIN_UNUSED_ARG(error), void * COIN_UNUSED_ARG(data))
+{
+}
+
+static void
+sopp_cleanup(SoppContext * context, SoInput * topinput, SoNode * topnode)
+{
+  for (int i = 0; i < context->chunks.getLength(); i++) {
+    SoppChunk * chunk = context->chunks[i];
+    for (int j = 0; j < chunk->nodes.getLength(); j++) {
+      chunk->nodes[j]->unref();
+    }
+    delete chunk->input;
+    delete[] chunk->buffer;
+    delete chunk;
+  }
+  if (topnode) topnode->unref();
+  delete topinput;
+}
+
+// *************************************************************************
+
+SbBool
+SoInput_ParallelParser::readAll(SoInput * in, SoInput_FileInfo * info,
+                                const int numthreads, SoGroup * root)
+{
+#ifndef HAVE_THREADS
+  return FALSE;
+#else // HAVE_THREADS
+  if (numthreads < 2) return FALSE;
+  if (info->isBinary() || info->isFileVRML1() || info->isFileVRML2()) return FALSE;
+  if (info->ivVersion() != 2.1f) return FALSE;
+  if (in->getCurrentProto()) return FALSE;
+
+  // The chunks will be read by SoInput instances of their own, which
+  // would trigger the header callbacks once for each chunk.
+  SbBool isbinary;
+  float ivversion;
+  SoDBHeaderCB * precb, * postcb;
+  void * userdata;
+  if (!SoDB::getHeaderData(info->ivHeader(), isbinary, ivversion,
+                           precb, postcb, userdata, TRUE) ||
+      precb || postcb) {
+    return FALSE;
+  }
+
+  size_t datalen;
+  const char * data = info->getDirectRemainder(datalen);
+  if (!data || datalen < SOPP_MIN_PARALLEL_SIZE) return FALSE;
+
+  // Find the nodes to read in parallel.
+  SoppScanner scanner(data, datalen);
+  SbList<SoppRange> ranges;
+  SoppRange top;
+  top.begin = top.end = 0;
+  size_t bodystart = 0, bodyend = 0;
+  if (!scanner.scanTopLevel(ranges, top, bodystart, bodyend)) return FALSE;
+
+  SbBool split = FALSE;
+  SbName topname;
+  if (ranges.getLength() == 1) {
+    // Split up the children of a single top-level group. Pick up the
+    // class name after the optional DEF name first.
+    SbList<SbString> words;
+    const char * p = data + top.begin;
+    const char * end = data + bodystart - 1;
+    while (p < end) {
+      while (p < end && sopp_isspace(*p)) p++;
+      const char * w = p;
+      while (p < end && !sopp_isspace(*p)) p++;
+      if (p > w) words.append(SbString(w, 0, int(p - w) - 1));
+    }
+    SbName classname;
+    if ((words.getLength() == 3) && (words[0] == "DEF")) {
+      topname = words[1];
+      classname = words[2];
+    }
+    else if (words.getLength() == 1) {
+      classname = words[0];
+    }
+    if (!sopp_is_splittable_group(SoType::fromName(classname))) return FALSE;
+
+    ranges.truncate(0);
+    SoppScanner childscanner(data + bodystart, datalen - bodystart);
+    if (!childscanner.scanChildren(ranges)) return FALSE;
+    // The children scan keeps its own name lists, so move them over.
+    scanner.defs.truncate(0);
+    scanner.uses.truncate(0);
+    for (int i = 0; i < childscanner.defs.getLength(); i++) scanner.defs.append(childscanner.defs[i]);
+    for (int i = 0; i < childscanner.uses.getLength(); i++) scanner.uses.append(childscanner.uses[i]);
+    for (int i = 0; i < ranges.getLength(); i++) {
+      ranges[i].begin += bodystart;
+      ranges[i].end += bodystart;
+    }
+    split = TRUE;
+  }
+  const int numranges = ranges.getLength();
+  if (numranges < 2) return FALSE;
+
+  // Gather the ranges into chunks.
+  SoppContext context;
+  context.data = data;
+  context.header = info->ivHeader();
+  context.ranges = &ranges;
+  context.nextchunk = 0;
+
+  const size_t total = ranges[numranges - 1].end - ranges[0].begin;
+  const size_t chunksize =
+    SbMax(total / (numthreads * SOPP_CHUNKS_PER_THREAD), SOPP_MIN_CHUNK_SIZE);
+
+  SbHash<const char *, int> chunkdefs;
+  int numindependent = 0;
+  for (int i = 0; i < numranges; ) {
+    SoppChunk * chunk = new SoppChunk;
+    chunk->firstrange = i;
+    chunk->dependent = FALSE;
+    chunk->input = NULL;
+    chunk->buffer = NULL;
+    chunk->ok = FALSE;
+    chunkdefs.clear();
+    do {
+      const SoppRange & range = ranges[i];
+      if (range.serial) chunk->dependent = TRUE;
+      int dummy;
+      for (int j = 0; j < range.numuses; j++) {
+        const SbName & name = scanner.uses[range.firstuse + j];
+        if (!chunkdefs.get(name.getString(), dummy)) {
+          chunk->imports.append(name);
+          chunkdefs.put(name.getString(), 0);
+        }
+      }
+      for (int j = 0; j < range.numdefs; j++) {
+        chunkdefs.put(scanner.defs[range.firstdef + j].getString(), 1);
+      }
+      i++;
+    } while (i < numranges && ranges[i - 1].end - ranges[chunk->firstrange].begin < chunksize);
+    chunk->numranges = i - chunk->firstrange;
+    if (chunk->imports.getLength()) chunk->dependent = TRUE;
+    if (!chunk->dependent) numindependent++;
+    context.chunks.append(chunk);
+  }
+  const int numchunks = context.chunks.getLength();
+  if (numindependent < 2) {
+    sopp_cleanup(&context, NULL, NULL);
+    return FALSE;
+  }
+  // SoInput keeps some per-thread bookkeeping, so the instances must
+  // be constructed and destructed on the same thread.
+  for (int i = 0; i < numchunks; i++) {
+    context.chunks[i]->input = new SoInput;
+  }
+
+  SoErrorCB * prevhandler = SoReadError::getHandlerCallback();
+  void * prevhandlerdata = SoReadError::getHandlerData();
+  SoReadError::setHandlerCallback(sopp_ignore_error, NULL);
+
+  // The top-level group of a split file is read first, without its
+  // children. It can't be referenced from the children (see
+  // sopp_is_splittable_group()), but its name can.
+  SoInput * topinput = NULL;
+  SoNode * topnode = NULL;
+  if (split) {
+    SbString toptext(info->ivHeader());
+    toptext += "\n";
+    toptext += SbString(data + top.begin, 0, int(ranges[0].begin - top.begin) - 1);
+    toptext += "}";
+    topinput = new SoInput;
+    topinput->setBuffer(toptext.getString(), toptext.getLength());
+    if (!SoDB::read(topinput, topnode) || !topnode) {
+      SoReadError::setHandlerCallback(prevhandler, prevhandlerdata);
+      sopp_cleanup(&context, topinput, NULL);
+      return FALSE;
+    }
+    topnode->ref();
+  }
+
+  // Keep the worker threads from processing the sensor queues when
+  // they are done notifying, as the sensor manager is not protected
+  // by mutexes in non-threadsafe builds. With COIN_THREADSAFE,
+  // notification is serialized by the notify lock.
+#ifndef COIN_THREADSAFE
+  SoDB::startNotify();
+#endif // !COIN_THREADSAFE
+
+  const int numworkers = SbMin(numthreads, numindependent) - 1;
+  SbList<cc_thread *> threads;
+  for (int i = 0; i < numworkers; i++) {
+    threads.append(cc_thread_construct(sopp_thread_entry, &context));
+  }
+  (void)sopp_thread_entry(&context);
+  for (int i = 0; i < threads.getLength(); i++) {
+    (void)cc_thread_join(threads[i], NULL);
+    cc_thread_destruct(threads[i]);
+  }
+
+#ifndef COIN_THREADSAFE
+  SoDB::endNotify();
+#endif // !COIN_THREADSAFE
+
+  // Read the dependent chunks in order, now that the names they
+  // import are available.
+  SbBool ok = TRUE;
+  for (int i = 0; ok && i < numchunks; i++) {
+    SoppChunk * chunk = context.chunks[i];
+    if (!chunk->dependent) {
+      ok = chunk->ok;
+      continue;
+    }
+    sopp_setup_chunk(&context, chunk);
+    for (int j = 0; ok && j < chunk->imports.getLength(); j++) {
+      const SbName & name = chunk->imports[j];
+      SoBase * base = sopp_find_reference(&context, in, topinput, i, name);
+      if (base) chunk->input->addReference(name, base, FALSE);
+      else ok = FALSE; // let the serial import report the error
+    }
+    if (ok) {
+      sopp_read_chunk(chunk);
+      ok = chunk->ok;
+    }
+  }
+
+  SoReadError::setHandlerCallback(prevhandler, prevhandlerdata);
+
+  if (!ok) {
+    sopp_cleanup(&context, topinput, topnode);
+    return FALSE;
+  }
+
+  // Put the scene graph together, and make the names available
+  // from the SoInput the file is read through, as after a serial
+  // import.
+  SoGroup * parent = split ? static_cast<SoGroup *>(topnode) : root;
+  for (int i = 0; i < numchunks; i++) {
+    const SoppChunk * chunk = context.chunks[i];
+    for (int j = 0; j < chunk->nodes.getLength(); j++) {
+      parent->addChild(chunk->nodes[j]);
+    }
+  }
+  if (split) {
+    root->addChild(topnode);
+    if (topname.getLength() > 0) { in->addReference(topname, topnode, FALSE); }
+  }
+  for (int i = 0; i < numchunks; i++) {
+    const SoppChunk * chunk = context.chunks[i];
+    for (int r = chunk->firstrange; r < chunk->firstrange + chunk->numranges; r++) {
+      const SoppRange & range = ranges[r];
+      for (int j = 0; j < range.numdefs; j++) {
+        const SbName & name = scanner.defs[range.firstdef + j];
+        SoBase * base = chunk->input->findReference(name);
+        if (base) in->addReference(name, base, FALSE);
+      }
+    }
+  }
+
+  info->skipDirectRemainder();
+  sopp_cleanup(&context, topinput, topnode);
+  return TRUE;
+#endif // HAVE_THREADS
+}
@@ -33,6 +33,7 @@
 #include "io/SoInput_Reader.h"
 
 #include <cstring>
+#include <cstdlib>
 #include <cassert>
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -50,6 +51,13 @@
 #include <sys/stat.h>
 #endif
 
+#if defined(HAVE_UNISTD_H) && defined(_POSIX_MAPPED_FILES) && (_POSIX_MAPPED_FILES > 0)
+#include <sys/mman.h> // mmap()
+#define SOINPUT_HAVE_MMAP 1
+#endif // POSIX mapped files
+
+#include <Inventor/C/tidbits.h>
+
 #include <Inventor/errors/SoDebugError.h>
 
 #include "io/gzmemio.h"
@@ -91,6 +99,13 @@ SoInput_Reader::getFilePointer(void)
   return NULL;
 }
 
+const char *
+SoInput_Reader::getDirectBuffer(size_t & len)
+{
+  len = 0;
+  return NULL;
+}
+
 // creates the correct reader based on the file type in fp (will
 // examine the file header). If fullname is empty, it's assumed that
 // file FILE pointer is passed from the user, and that we cannot
@@ -181,6 +196,14 @@ SoInput_Reader::createReader(FILE * fp, const SbString & fullname)
     }
   }
 
+  // Only map files we have opened ourselves. A FILE * passed in by
+  // the application might be expected to be positioned after the
+  // data we read when we're done.
+  if ((reader == NULL) && trycompression &&
+      fullname.getLength() && (fullname != "<stdin>")) {
+    reader = SoInput_MappedFileReader::createReader(fullname.getString(), fp);
+  }
+
   if (reader == NULL) {
     reader = new SoInput_FileReader(fullname.getString(), fp);
   }
@@ -236,6 +259,105 @@ SoInput_FileReader::getFilePointer(void)
   return this->fp;
 }
 
+//
+// memory mapped file class
+//
+
+// Files smaller than this are read through fread() as before, as
+// setting up a mapping costs more than copying a few buffers.
+static const size_t SOINPUT_MMAP_MIN_SIZE = 256 * 1024;
+
+SoInput_MappedFileReader::SoInput_MappedFileReader(const char * const filenamearg,
+                                                   FILE * filepointer,
+                                                   void * mappingarg,
+                                                   size_t maplenarg,
+                                                   size_t startpos)
+  : SoInput_FileReader(filenamearg, filepointer)
+{
+  this->mapping = mappingarg;
+  this->maplen = maplenarg;
+  this->mappos = startpos;
+}
+
+SoInput_MappedFileReader::~SoInput_MappedFileReader()
+{
+#ifdef SOINPUT_HAVE_MMAP
+  (void)munmap(this->mapping, this->maplen);
+#endif // SOINPUT_HAVE_MMAP
+}
+
+// Maps the file opened as fp into memory, from the current file
+// position. Returns NULL if the file is too small to be worth
+// mapping, if mapping is not supported, or if it fails, in which
+// case the caller should fall back to a regular SoInput_FileReader.
+SoInput_Reader *
+SoInput_MappedFileReader::createReader(const char * const filename, FILE * fp)
+{
+#ifdef SOINPUT_HAVE_MMAP
+  static int nommap = -1;
+  if (nommap == -1) {
+    const char * env = coin_getenv("COIN_SOINPUT_NO_MMAP");
+    nommap = (env && (atoi(env) > 0)) ? 1 : 0;
+  }
+  if (nommap) { return NULL; }
+
+  const int fd = fileno(fp);
+  struct stat sb;
+  if ((fd < 0) || (fstat(fd, &sb) != 0) || !(sb.st_mode & S_IFREG)) { return NULL; }
+
+  const long offset = ftell(fp);
+  if ((offset < 0) || (sb.st_size < offset) ||
+      (size_t(sb.st_size - offset) < SOINPUT_MMAP_MIN_SIZE)) {
+    return NULL;
+  }
+  // don't try to map files that doesn't fit in the address space
+  if (sizeof(size_t) < sizeof(sb.st_size) &&
+      (sb.st_size > (off_t)((size_t)-1 >> 1))) {
+    return NULL;
+  }
+
+  const size_t len = (size_t)sb.st_size;
+  void * mapping = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) { return NULL; }
+
+#ifdef MADV_SEQUENTIAL
+  // we parse from start to end, let the OS read ahead aggressively
+  (void)madvise(mapping, len, MADV_SEQUENTIAL);
+#endif // MADV_SEQUENTIAL
+
+  return new SoInput_MappedFileReader(filename, fp, mapping, len, (size_t)offset);
+#else // !SOINPUT_HAVE_MMAP
+  return NULL;
+#endif // !SOINPUT_HAVE_MMAP
+}
+
+SoInput_Reader::ReaderType
+SoInput_MappedFileReader::getType(void) const
+{
+  return MAPPED_FILE;
+}
+
+size_t
+SoInput_MappedFileReader::readBuffer(char * buf, const size_t readlen)
+{
+  size_t len = this->maplen - this->mappos;
+  if (len > readlen) len = readlen;
+
+  memcpy(buf, static_cast<const char *>(this->mapping) + this->mappos, len);
+  this->mappos += len;
+
+  return len;
+}
+
+const char *
+SoInput_MappedFileReader::getDirectBuffer(size_t & len)
+{
+  len = this->maplen - this->mappos;
+  const char * ptr = static_cast<const char *>(this->mapping) + this->mappos;
+  this->mappos = this->maplen;
+  return len ? ptr : NULL;
+}
+
 //
 // standard membuffer class
 //
@@ -269,6 +391,15 @@ SoInput_MemBufferReader::readBuffer(char * buffer, const size_t readlen)
   return len;
 }
 
+const char *
+SoInput_MemBufferReader::getDirectBuffer(size_t & len)
+{
+  len = this->buflen - this->bufpos;
+  const char * ptr = this->buf + this->bufpos;
+  this->bufpos = this->buflen;
+  return len ? ptr : NULL;
+}
+
 //
 // gzip readers
 //
@@ -55,7 +55,8 @@ public:
     MEMBUFFER,
     GZFILE,
     BZ2FILE,
-    GZMEMBUFFER
+    GZMEMBUFFER,
+    MAPPED_FILE
   };
 
   // must be overloaded to return type
@@ -73,6 +74,13 @@ public:
   // reader uses FILE * to read data.
   virtual FILE * getFilePointer(void);
 
+  // should be overloaded by readers which have all their data
+  // available in memory, to return a pointer to the data not yet
+  // read, so that it can be parsed in place instead of being copied
+  // through readBuffer(). The data is considered read after this
+  // call. Default method returns NULL.
+  virtual const char * getDirectBuffer(size_t & len);
+
   static SoInput_Reader * createReader(FILE * fp, const SbString & fullname);
 
 public:
@@ -96,6 +104,24 @@ public:
 
 };
 
+class SoInput_MappedFileReader : public SoInput_FileReader {
+public:
+  SoInput_MappedFileReader(const char * const filename, FILE * filepointer,
+                           void * mapping, size_t maplen, size_t startpos);
+  virtual ~SoInput_MappedFileReader();
+
+  static SoInput_Reader * createReader(const char * const filename, FILE * fp);
+
+  virtual ReaderType getType(void) const;
+  virtual size_t readBuffer(char * buf, const size_t readlen);
+  virtual const char * getDirectBuffer(size_t & len);
+
+public:
+  void * mapping;
+  size_t maplen;
+  size_t mappos;
+};
+
 class SoInput_MemBufferReader : public SoInput_Reader {
 public:
   SoInput_MemBufferReader(const void * bufPointer, size_t bufSize);
@@ -103,6 +129,7 @@ public:
 
   virtual ReaderType getType(void) const;
   virtual size_t readBuffer(char * buf, const size_t readlen);
+  virtual const char * getDirectBuffer(size_t & len);
 
 public:
   char * buf;
@@ -0,0 +1,300 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+
+#include "misc/SbCoordBounds.h"
+
+#include <cfloat>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define SBCOORDBOUNDS_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "threads/taskschedulerp.h"
+
+/*!
+  \class SbCoordBounds SbCoordBounds.h misc/SbCoordBounds.h
+  \brief The SbCoordBounds class computes the bounds of coordinate arrays.
+
+  It accumulates the axis aligned bounding box, the sum and the
+  number of coordinates, either from a contiguous array, or from an
+  array through a list of indices.
+
+  With SSE, four coordinates of a contiguous array are loaded into
+  three vectors, which are folded into the min, max and sum vectors
+  lane by lane, and the lanes are sorted out into x, y and z at the
+  end. Indexed coordinates are loaded one per vector. NaNs are left
+  out of the min and max, like in SbBox3f::extendBy().
+
+  The arrays are scanned in chunks of a fixed size, and the results
+  of the chunks are combined in order, so that the center does not
+  depend on whether they were scanned in parallel.
+
+  \internal
+*/
+
+// *************************************************************************
+
+// coordinates or indices per chunk
+static const int SBCOORDBOUNDS_CHUNK_SIZE = 65536;
+
+namespace {
+
+  SbCoordBounds::Range
+  sbcoordbounds_empty(void)
+  {
+    SbCoordBounds::Range r;
+    for (int c = 0; c < 3; c++) {
+      r.min[c] = FLT_MAX;
+      r.max[c] = -FLT_MAX;
+      r.sum[c] = 0.0;
+    }
+    r.num = r.numinvalid = 0;
+    return r;
+  }
+
+  SbCoordBounds::Range
+  sbcoordbounds_join(const SbCoordBounds::Range & a, const SbCoordBounds::Range & b)
+  {
+    SbCoordBounds::Range r;
+    for (int c = 0; c < 3; c++) {
+      r.min[c] = SbMin(a.min[c], b.min[c]);
+      r.max[c] = SbMax(a.max[c], b.max[c]);
+      r.sum[c] = a.sum[c] + b.sum[c];
+    }
+    r.num = a.num + b.num;
+    r.numinvalid = a.numinvalid + b.numinvalid;
+    return r;
+  }
+
+  inline void
+  sbcoordbounds_extend(SbCoordBounds::Range & r, const float * v, float * sum)
+  {
+    for (int c = 0; c < 3; c++) {
+      if (v[c] < r.min[c]) r.min[c] = v[c];
+      if (v[c] > r.max[c]) r.max[c] = v[c];
+      sum[c] += v[c];
+    }
+  }
+
+#ifdef SBCOORDBOUNDS_SSE
+
+  // Folds lane of the vectors into component c of the range.
+  inline void
+  sbcoordbounds_fold_lane(SbCoordBounds::Range & r, float * sum, const int c,
+                          const float * mn, const float * mx, const float * s,
+                          const int lane)
+  {
+    r.min[c] = SbMin(r.min[c], mn[lane]);
+    r.max[c] = SbMax(r.max[c], mx[lane]);
+    sum[c] += s[lane];
+  }
+
+#endif // SBCOORDBOUNDS_SSE
+
+  SbCoordBounds::Range
+  sbcoordbounds_scan(const SbVec3f * coords, const int begin, const int end)
+  {
+    SbCoordBounds::Range r = sbcoordbounds_empty();
+    float sum[3] = { 0.0f, 0.0f, 0.0f };
+    const float * ptr = reinterpret_cast<const float *>(coords + begin);
+    int i = begin;
+
+#ifdef SBCOORDBOUNDS_SSE
+    if (end - i >= 4) {
+      // (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3)
+      __m128 min[3], max[3], s[3];
+      for (int v = 0; v < 3; v++) {
+        min[v] = _mm_set1_ps(FLT_MAX);
+        max[v] = _mm_set1_ps(-FLT_MAX);
+        s[v] = _mm_setzero_ps();
+      }
+      for (; end - i >= 4; i += 4, ptr += 12) {
+        for (int v = 0; v < 3; v++) {
+          const __m128 p = _mm_loadu_ps(ptr + 4 * v);
+          // the second operand is returned for NaNs
+          min[v] = _mm_min_ps(p, min[v]);
+          max[v] = _mm_max_ps(p, max[v]);
+          s[v] = _mm_add_ps(s[v], p);
+        }
+      }
+      float mn[12], mx[12], sm[12];
+      for (int v = 0; v < 3; v++) {
+        _mm_storeu_ps(mn + 4 * v, min[v]);
+        _mm_storeu_ps(mx + 4 * v, max[v]);
+        _mm_storeu_ps(sm + 4 * v, s[v]);
+      }
+      // lane l of the three vectors holds component l % 3
+      for (int lane = 0; lane < 12; lane++) {
+        sbcoordbounds_fold_lane(r, sum, lane % 3, mn, mx, sm, lane);
+      }
+    }
+#endif // SBCOORDBOUNDS_SSE
+
+    for (; i < end; i++, ptr += 3) {
+      sbcoordbounds_extend(r, ptr, sum);
+    }
+    for (int c = 0; c < 3; c++) r.sum[c] = sum[c];
+    r.num = end - begin;
+    return r;
+  }
+
+  SbCoordBounds::Range
+  sbcoordbounds_gather(const SbVec3f * coords, const int numcoords,
+                       const int32_t * indices, const int begin, const int end)
+  {
+    SbCoordBounds::Range r = sbcoordbounds_empty();
+    float sum[3] = { 0.0f, 0.0f, 0.0f };
+    const float * base = reinterpret_cast<const float *>(coords);
+
+#ifdef SBCOORDBOUNDS_SSE
+    // the fourth lane holds the x of the next coordinate, and is
+    // ignored. The last coordinate, which has no next one, is done
+    // without SSE.
+    __m128 min = _mm_set1_ps(FLT_MAX);
+    __m128 max = _mm_set1_ps(-FLT_MAX);
+    __m128 s = _mm_setzero_ps();
+#endif // SBCOORDBOUNDS_SSE
+
+    for (int i = begin; i < end; i++) {
+      const int32_t idx = indices[i];
+      if (idx < 0) continue;
+      if (idx >= numcoords) {
+        r.numinvalid++;
+        continue;
+      }
+      r.num++;
+#ifdef SBCOORDBOUNDS_SSE
+      if (idx < numcoords - 1) {
+        const __m128 p = _mm_loadu_ps(base + 3 * idx);
+        min = _mm_min_ps(p, min);
+        max = _mm_max_ps(p, max);
+        s = _mm_add_ps(s, p);
+        continue;
+      }
+#endif // SBCOORDBOUNDS_SSE
+      sbcoordbounds_extend(r, base + 3 * idx, sum);
+    }
+
+#ifdef SBCOORDBOUNDS_SSE
+    float mn[4], mx[4], sm[4];
+    _mm_storeu_ps(mn, min);
+    _mm_storeu_ps(mx, max);
+    _mm_storeu_ps(sm, s);
+    for (int c = 0; c < 3; c++) {
+      sbcoordbounds_fold_lane(r, sum, c, mn, mx, sm, c);
+    }
+#endif // SBCOORDBOUNDS_SSE
+
+    for (int c = 0; c < 3; c++) r.sum[c] = sum[c];
+    return r;
+  }
+
+  // Scans [0, num) in chunks with body(begin, end), and joins the
+  // results in order.
+  template <class Body>
+  SbCoordBounds::Range
+  sbcoordbounds_reduce(const int num, const Body & body, SbTaskScheduler * scheduler)
+  {
+    if (scheduler && num > SBCOORDBOUNDS_CHUNK_SIZE) {
+      return SbTaskScheduler::parallelReduce(0, num, SBCOORDBOUNDS_CHUNK_SIZE,
+                                             sbcoordbounds_empty(), body,
+                                             sbcoordbounds_join, scheduler);
+    }
+    SbCoordBounds::Range r = sbcoordbounds_empty();
+    for (int begin = 0; begin < num; begin += SBCOORDBOUNDS_CHUNK_SIZE) {
+      const int end = SbMin(num, begin + SBCOORDBOUNDS_CHUNK_SIZE);
+      r = sbcoordbounds_join(r, body(begin, end));
+    }
+    return r;
+  }
+
+} // namespace
+
+// *************************************************************************
+
+SbCoordBounds::SbCoordBounds(void)
+  : range(sbcoordbounds_empty())
+{
+}
+
+void
+SbCoordBounds::extendBy(const SbVec3f * coords, const int num,
+                        SbTaskScheduler * scheduler)
+{
+  const Range r =
+    sbcoordbounds_reduce(num,
+                         [coords](int begin, int end) {
+                           return sbcoordbounds_scan(coords, begin, end);
+                         },
+                         scheduler);
+  this->range = sbcoordbounds_join(this->range, r);
+}
+
+void
+SbCoordBounds::extendBy(const SbVec3f * coords, const int numcoords,
+                        const int32_t * indices, const int numindices,
+                        SbTaskScheduler * scheduler)
+{
+  const Range r =
+    sbcoordbounds_reduce(numindices,
+                         [coords, numcoords, indices](int begin, int end) {
+                           return sbcoordbounds_gather(coords, numcoords, indices,
+                                                       begin, end);
+                         },
+                         scheduler);
+  this->range = sbcoordbounds_join(this->range, r);
+}
+
+SbBox3f
+SbCoordBounds::getBox(void) const
+{
+  SbBox3f box;
+  if (this->range.min[0] <= this->range.max[0] &&
+      this->range.min[1] <= this->range.max[1] &&
+      this->range.min[2] <= this->range.max[2]) {
+    box.setBounds(this->range.min[0], this->range.min[1], this->range.min[2],
+                  this->range.max[0], this->range.max[1], this->range.max[2]);
+  }
+  return box;
+}
+
+SbVec3f
+SbCoordBounds::getCenter(void) const
+{
+  if (this->range.num == 0) return SbVec3f(0.0f, 0.0f, 0.0f);
+  const double n = this->range.num;
+  return SbVec3f(float(this->range.sum[0] / n),
+                 float(this->range.sum[1] / n),
+                 float(this->range.sum[2] / n));
+}
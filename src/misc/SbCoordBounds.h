@@ -0,0 +1,86 @@
+#ifndef COIN_SBCOORDBOUNDS_H
+#define COIN_SBCOORDBOUNDS_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif // !COIN_INTERNAL
+
+#include <Inventor/SbBasic.h>
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbVec3f.h>
+
+class SbTaskScheduler;
+
+// SbCoordBounds is an internal class in Coin, used by the vertex
+// based shapes to compute the bounding box and the average of their
+// coordinates. The coordinates are scanned with SSE min / max
+// instructions where available, and large arrays are split into
+// chunks which can be scanned on the threads of a task scheduler.
+
+class SbCoordBounds {
+public:
+  SbCoordBounds(void);
+
+  // Extends the bounds by coords[0 .. num-1]. The chunks are
+  // scanned in parallel on scheduler, or on the calling thread if
+  // it is NULL. The result is the same either way.
+  void extendBy(const SbVec3f * coords, const int num,
+                SbTaskScheduler * scheduler = NULL);
+  // Extends the bounds by coords[indices[i]], for i in [0,
+  // numindices). Negative indices are skipped, and indices of
+  // numcoords or more are skipped and counted as invalid.
+  void extendBy(const SbVec3f * coords, const int numcoords,
+                const int32_t * indices, const int numindices,
+                SbTaskScheduler * scheduler = NULL);
+
+  SbBox3f getBox(void) const;
+  // The average of the coordinates, counting repeated indices.
+  SbVec3f getCenter(void) const;
+  int getNumCoords(void) const { return this->range.num; }
+  int getNumInvalidIndices(void) const { return this->range.numinvalid; }
+
+  // The bounds of a part of the coordinates.
+  struct Range {
+    float min[3], max[3];
+    double sum[3];
+    int num, numinvalid;
+  };
+
+private:
+  Range range;
+};
+
+#endif // !COIN_SBCOORDBOUNDS_H
@@ -0,0 +1,478 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include "misc/SbDepthSorter.h"
+
+#include <cassert>
+#include <cfloat>
+
+#include <Inventor/SbBasic.h>
+
+#include "threads/taskschedulerp.h"
+
+/*!
+  \class SbDepthSorter SbDepthSorter.h misc/SbDepthSorter.h
+  \brief The SbDepthSorter class orders items on their depth.
+
+  The depth values are quantized to integer keys spanning the depth
+  range of the items, and sorted with a least significant digit radix
+  sort in linear time. The sort is stable, and starts from the order
+  of the previous sort, so that items with equal keys don't swap
+  places between frames.
+
+  Transparent geometry is usually sorted again every frame while the
+  camera moves, and then the previous order is nearly right. Before
+  radix sorting, the previous order is therefore checked, and if it
+  has only a few items out of place, it is repaired with an insertion
+  sort instead. The result is the same either way.
+
+  For large arrays, the key computation and the histogram and scatter
+  steps of the radix sort are split into chunks which are run on the
+  worker threads of the shared SbTaskScheduler.
+
+  \internal
+*/
+
+// *************************************************************************
+
+// bits per radix sort pass
+static const int SBDEPTHSORTER_RADIX_BITS = 11;
+static const int SBDEPTHSORTER_RADIX_SIZE = 1 << SBDEPTHSORTER_RADIX_BITS;
+// bits in the quantized depth keys (two passes)
+static const int SBDEPTHSORTER_KEY_BITS = 2 * SBDEPTHSORTER_RADIX_BITS;
+// arrays smaller than this are always sorted on the calling thread
+static const int SBDEPTHSORTER_PARALLEL_LIMIT = 65536;
+static const int SBDEPTHSORTER_MAX_CHUNKS = 64;
+
+namespace {
+
+  struct sbdepthsorter_range {
+    float min, max;
+  };
+
+  sbdepthsorter_range
+  sbdepthsorter_find_range(const float * depth, const int begin, const int end)
+  {
+    sbdepthsorter_range range = { FLT_MAX, -FLT_MAX };
+    for (int i = begin; i < end; i++) {
+      // NaNs and infinite depths are left out
+      if (!(depth[i] >= -FLT_MAX && depth[i] <= FLT_MAX)) continue;
+      if (depth[i] < range.min) range.min = depth[i];
+      if (depth[i] > range.max) range.max = depth[i];
+    }
+    return range;
+  }
+
+  // The arrays are chunked even without worker threads, so that the
+  // chunked code paths run (serially) on every machine.
+  int
+  sbdepthsorter_num_chunks(const int num, const SbBool parallel)
+  {
+    if (!parallel || num < SBDEPTHSORTER_PARALLEL_LIMIT) return 1;
+    const int numworkers = SbTaskScheduler::getGlobal()->getNumWorkers();
+    const int numchunks = SbMin(4 * (numworkers + 1), num / (SBDEPTHSORTER_PARALLEL_LIMIT / 4));
+    return SbClamp(numchunks, 1, SBDEPTHSORTER_MAX_CHUNKS);
+  }
+
+  // Calls body(chunk) for each chunk, in parallel if there is more
+  // than one.
+  template <class Body>
+  void
+  sbdepthsorter_for_chunks(const int numchunks, const Body & body)
+  {
+    if (numchunks == 1) {
+      body(0);
+      return;
+    }
+    SbTaskScheduler::parallelFor(0, numchunks, 1,
+                                 [&](int begin, int end) {
+                                   for (int c = begin; c < end; c++) body(c);
+                                 });
+  }
+
+} // namespace
+
+// *************************************************************************
+
+SbDepthSorter::SbDepthSorter(void)
+{
+}
+
+SbDepthSorter::~SbDepthSorter()
+{
+}
+
+void
+SbDepthSorter::reset(void)
+{
+  this->order.clear();
+}
+
+const int *
+SbDepthSorter::sort(const float * depth, const int num,
+                    const SbBool descending,
+                    const unsigned char * tiebreak,
+                    const SbBool parallel)
+{
+  assert(num >= 0);
+  if (static_cast<int>(this->order.size()) != num) {
+    this->order.resize(num);
+    for (int i = 0; i < num; i++) this->order[i] = i;
+  }
+  if (num < 2) return this->order.data();
+
+  this->computeKeys(depth, num, descending, tiebreak, parallel);
+  if (!this->repairOrder()) this->radixSort(parallel);
+  return this->order.data();
+}
+
+// Quantizes the depth values to keys of SBDEPTHSORTER_KEY_BITS bits,
+// which sort ascending, and stores them in this->sortkeys in the
+// previous order.
+void
+SbDepthSorter::computeKeys(const float * depth, const int num, const SbBool descending,
+                           const unsigned char * tiebreak, const SbBool parallel)
+{
+  const int numchunks = sbdepthsorter_num_chunks(num, parallel);
+  const int chunksize = (num + numchunks - 1) / numchunks;
+
+  sbdepthsorter_range range;
+  if (numchunks == 1) {
+    range = sbdepthsorter_find_range(depth, 0, num);
+  }
+  else {
+    const sbdepthsorter_range identity = { FLT_MAX, -FLT_MAX };
+    range = SbTaskScheduler::parallelReduce(0, num, chunksize, identity,
+                                            [depth](int begin, int end) {
+                                              return sbdepthsorter_find_range(depth, begin, end);
+                                            },
+                                            [](const sbdepthsorter_range & a,
+                                               const sbdepthsorter_range & b) {
+                                              sbdepthsorter_range r;
+                                              r.min = SbMin(a.min, b.min);
+                                              r.max = SbMax(a.max, b.max);
+                                              return r;
+                                            });
+  }
+
+  // with a tiebreak, one bit of depth precision is given up for it,
+  // so that the keys still sort in two passes
+  const int depthbits = tiebreak ? SBDEPTHSORTER_KEY_BITS - 1 : SBDEPTHSORTER_KEY_BITS;
+  const uint32_t maxkey = (1u << depthbits) - 1;
+  const float scale = (range.max > range.min) ?
+    float(maxkey) / (range.max - range.min) : 0.0f;
+  const float offset = range.min;
+
+  this->sortkeys.resize(num);
+  uint32_t * keyptr = this->sortkeys.data();
+  const int * ord = this->order.data();
+  sbdepthsorter_for_chunks(numchunks, [&](int chunk) {
+      const int end = SbMin(num, (chunk + 1) * chunksize);
+      for (int i = chunk * chunksize; i < end; i++) {
+        const int item = ord[i];
+        float q = (depth[item] - offset) * scale;
+        // NaNs and infinite depths are clamped
+        if (!(q > 0.0f)) q = 0.0f;
+        if (q > float(maxkey)) q = float(maxkey);
+        uint32_t key = static_cast<uint32_t>(q);
+        if (descending) key = maxkey - key;
+        if (tiebreak) key = (key << 1) | (tiebreak[item] ? 0u : 1u);
+        keyptr[i] = key;
+      }
+    });
+}
+
+// Checks if the previous order is still sorted on the new keys, and
+// repairs it with an insertion sort if only a few items are out of
+// place. Returns FALSE if the order needs a full sort.
+SbBool
+SbDepthSorter::repairOrder(void)
+{
+  const int num = static_cast<int>(this->order.size());
+  uint32_t * keyptr = this->sortkeys.data();
+  int * ord = this->order.data();
+
+  int descents = 0;
+  for (int i = 1; i < num; i++) {
+    if (keyptr[i] < keyptr[i-1]) descents++;
+  }
+  if (descents == 0) return TRUE;
+  if (descents > num / 64) return FALSE;
+
+  // Bound the number of moves, since a few items may have moved far.
+  // An aborted insertion sort leaves a valid order with equal keys in
+  // their previous relative order, so the radix sort gives the same
+  // result as if it had started from the previous order.
+  int budget = 8 * num;
+  for (int i = 1; i < num; i++) {
+    const int item = ord[i];
+    const uint32_t key = keyptr[i];
+    int j = i;
+    while (j > 0 && keyptr[j-1] > key) {
+      keyptr[j] = keyptr[j-1];
+      ord[j] = ord[j-1];
+      j--;
+      budget--;
+    }
+    keyptr[j] = key;
+    ord[j] = item;
+    if (budget < 0) return FALSE;
+  }
+  return TRUE;
+}
+
+// Stable least significant digit radix sort of this->order on
+// this->sortkeys.
+void
+SbDepthSorter::radixSort(const SbBool parallel)
+{
+  const int num = static_cast<int>(this->order.size());
+  const int numchunks = sbdepthsorter_num_chunks(num, parallel);
+  const int chunksize = (num + numchunks - 1) / numchunks;
+  const int numpasses = (SBDEPTHSORTER_KEY_BITS + SBDEPTHSORTER_RADIX_BITS - 1) / SBDEPTHSORTER_RADIX_BITS;
+  const uint32_t mask = SBDEPTHSORTER_RADIX_SIZE - 1;
+
+  this->tmpkeys.resize(num);
+  this->tmporder.resize(num);
+
+  // the keys are moved along with the indices, for sequential access
+  uint32_t * srckeys = this->sortkeys.data();
+  uint32_t * dstkeys = this->tmpkeys.data();
+  int * srcidx = this->order.data();
+  int * dstidx = this->tmporder.data();
+
+  // one histogram per chunk, turned into the chunk's output
+  // positions for each digit
+  std::vector<int> counts(numchunks * SBDEPTHSORTER_RADIX_SIZE);
+  int * countptr = counts.data();
+  SbBool swapped = FALSE;
+
+  for (int pass = 0; pass < numpasses; pass++) {
+    const int shift = pass * SBDEPTHSORTER_RADIX_BITS;
+    sbdepthsorter_for_chunks(numchunks, [&](int chunk) {
+        int * count = countptr + chunk * SBDEPTHSORTER_RADIX_SIZE;
+        for (int d = 0; d < SBDEPTHSORTER_RADIX_SIZE; d++) count[d] = 0;
+        const int end = SbMin(num, (chunk + 1) * chunksize);
+        for (int i = chunk * chunksize; i < end; i++) {
+          count[(srckeys[i] >> shift) & mask]++;
+        }
+      });
+
+    int sum = 0;
+    SbBool skip = FALSE;
+    for (int d = 0; d < SBDEPTHSORTER_RADIX_SIZE && !skip; d++) {
+      const int start = sum;
+      for (int c = 0; c < numchunks; c++) {
+        const int n = countptr[c * SBDEPTHSORTER_RADIX_SIZE + d];
+        countptr[c * SBDEPTHSORTER_RADIX_SIZE + d] = sum;
+        sum += n;
+      }
+      // all keys have the same digit, nothing to do in this pass
+      if (sum - start == num) skip = TRUE;
+    }
+    if (skip) continue;
+
+    sbdepthsorter_for_chunks(numchunks, [&](int chunk) {
+        int * pos = countptr + chunk * SBDEPTHSORTER_RADIX_SIZE;
+        const int end = SbMin(num, (chunk + 1) * chunksize);
+        for (int i = chunk * chunksize; i < end; i++) {
+          const int p = pos[(srckeys[i] >> shift) & mask]++;
+          dstkeys[p] = srckeys[i];
+          dstidx[p] = srcidx[i];
+        }
+      });
+    uint32_t * tk = srckeys; srckeys = dstkeys; dstkeys = tk;
+    int * ti = srcidx; srcidx = dstidx; dstidx = ti;
+    swapped = !swapped;
+  }
+  if (swapped) {
+    this->order.swap(this->tmporder);
+    this->sortkeys.swap(this->tmpkeys);
+  }
+}
+
+// *************************************************************************
+
+#ifdef COIN_TEST_SUITE
+#ifdef COIN_INT_TEST_SUITE
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+static SbBool
+sbdepthsorter_is_sorted(const float * depth, const int * order, const int num,
+                        const SbBool descending)
+{
+  for (int i = 1; i < num; i++) {
+    const float a = depth[order[i-1]], b = depth[order[i]];
+    if (descending ? (a < b) : (a > b)) return FALSE;
+  }
+  return TRUE;
+}
+
+static SbBool
+sbdepthsorter_is_permutation(const int * order, const int num)
+{
+  std::vector<char> seen(num, 0);
+  for (int i = 0; i < num; i++) {
+    if (order[i] < 0 || order[i] >= num || seen[order[i]]) return FALSE;
+    seen[order[i]] = 1;
+  }
+  return TRUE;
+}
+
+BOOST_AUTO_TEST_CASE(ascendingAndDescending)
+{
+  const int num = 1000;
+  std::vector<float> depth(num);
+  srand(1);
+  for (int i = 0; i < num; i++) depth[i] = float(rand() % 100000) * 0.01f - 500.0f;
+
+  SbDepthSorter sorter;
+  const int * order = sorter.sort(depth.data(), num, FALSE);
+  BOOST_CHECK(sbdepthsorter_is_permutation(order, num));
+  BOOST_CHECK_MESSAGE(sbdepthsorter_is_sorted(depth.data(), order, num, FALSE),
+                      "items should be sorted ascending");
+
+  sorter.reset();
+  order = sorter.sort(depth.data(), num, TRUE);
+  BOOST_CHECK(sbdepthsorter_is_permutation(order, num));
+  BOOST_CHECK_MESSAGE(sbdepthsorter_is_sorted(depth.data(), order, num, TRUE),
+                      "items should be sorted descending");
+}
+
+BOOST_AUTO_TEST_CASE(stableOnPreviousOrder)
+{
+  SbDepthSorter sorter;
+  const float depth0[] = { 1.0f, 1.0f, 1.0f, 0.0f };
+  const int * order = sorter.sort(depth0, 4, FALSE);
+  const int expected0[] = { 3, 0, 1, 2 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(order, order + 4, expected0, expected0 + 4);
+
+  // item 3 now has the same depth as items 1 and 2, and stays in front
+  // of them, as in the previous order
+  const float depth1[] = { 0.0f, 1.0f, 1.0f, 1.0f };
+  order = sorter.sort(depth1, 4, FALSE);
+  const int expected1[] = { 0, 3, 1, 2 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(order, order + 4, expected1, expected1 + 4);
+
+  // a new number of items starts from the index order again
+  const float depth2[] = { 2.0f, 2.0f, 2.0f };
+  order = sorter.sort(depth2, 3, FALSE);
+  const int expected2[] = { 0, 1, 2 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(order, order + 3, expected2, expected2 + 3);
+}
+
+BOOST_AUTO_TEST_CASE(tiebreak)
+{
+  SbDepthSorter sorter;
+  const float depth[] = { 5.0f, 5.0f, 5.0f, 5.0f, 1.0f, 1.0f };
+  const unsigned char backface[] = { 0, 1, 0, 1, 0, 1 };
+  const int * order = sorter.sort(depth, 6, TRUE, backface);
+  // back to front, with the back faces first among equal depths
+  const int expected[] = { 1, 3, 0, 2, 5, 4 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(order, order + 6, expected, expected + 6);
+}
+
+BOOST_AUTO_TEST_CASE(nonFiniteDepths)
+{
+  SbDepthSorter sorter;
+  const float inf = HUGE_VALF;
+  const float depth[] = { 2.0f, std::numeric_limits<float>::quiet_NaN(), 1.0f,
+                          inf, -inf, 3.0f };
+  const int * order = sorter.sort(depth, 6, FALSE);
+  BOOST_REQUIRE(sbdepthsorter_is_permutation(order, 6));
+  // the range comes from the finite depths only, and the others are
+  // clamped to it, tying with the nearest and farthest finite depth
+  BOOST_CHECK_EQUAL(order[4], 3);
+  BOOST_CHECK_EQUAL(order[5], 5);
+  std::vector<int> finite;
+  for (int i = 0; i < 6; i++) {
+    if (std::isfinite(depth[order[i]])) finite.push_back(order[i]);
+  }
+  const int expected[] = { 2, 0, 5 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(finite.begin(), finite.end(), expected, expected + 3);
+}
+
+BOOST_AUTO_TEST_CASE(repairBudgetExceeded)
+{
+  const int num = 6400;
+  std::vector<float> depth(num);
+  for (int i = 0; i < num; i++) depth[i] = float(i);
+
+  SbDepthSorter sorter;
+  (void)sorter.sort(depth.data(), num, FALSE);
+
+  // A few items move from the back to the front. The previous order
+  // has few descents, but the insertion sort would move each of the
+  // items past all the others, so the repair gives up and the order
+  // is radix sorted.
+  for (int i = num - 10; i < num; i++) depth[i] = -float(i);
+  const int * order = sorter.sort(depth.data(), num, FALSE);
+  BOOST_CHECK(sbdepthsorter_is_permutation(order, num));
+  BOOST_CHECK_MESSAGE(sbdepthsorter_is_sorted(depth.data(), order, num, FALSE),
+                      "items should be sorted after a failed repair");
+
+  // a few neighbours swapping places are repaired
+  std::swap(depth[100], depth[101]);
+  order = sorter.sort(depth.data(), num, FALSE);
+  BOOST_CHECK_MESSAGE(sbdepthsorter_is_sorted(depth.data(), order, num, FALSE),
+                      "items should be sorted after a repair");
+}
+
+BOOST_AUTO_TEST_CASE(parallelMatchesSerial)
+{
+  const int num = 200000;
+  std::vector<float> depth(num);
+  std::vector<unsigned char> backface(num);
+  srand(2);
+  for (int i = 0; i < num; i++) {
+    // many equal depths, to check that the chunks keep the order stable
+    depth[i] = float(rand() % 5000);
+    backface[i] = (unsigned char)(rand() & 1);
+  }
+
+  SbDepthSorter serial, parallel;
+  for (int round = 0; round < 2; round++) {
+    const int * s = serial.sort(depth.data(), num, TRUE, backface.data(), FALSE);
+    const int * p = parallel.sort(depth.data(), num, TRUE, backface.data(), TRUE);
+    BOOST_CHECK_EQUAL_COLLECTIONS(s, s + num, p, p + num);
+    BOOST_CHECK(sbdepthsorter_is_sorted(depth.data(), p, num, TRUE));
+    for (int i = 0; i < num; i += 7) depth[i] += 3000.0f;
+  }
+}
+
+#endif // COIN_INT_TEST_SUITE
+#endif // COIN_TEST_SUITE
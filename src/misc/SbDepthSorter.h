@@ -0,0 +1,86 @@
+#ifndef COIN_SBDEPTHSORTER_H
+#define COIN_SBDEPTHSORTER_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif // !COIN_INTERNAL
+
+#include <vector>
+
+#include <Inventor/SbBasic.h>
+
+// SbDepthSorter is an internal class in Coin, used for ordering
+// transparent triangles back to front. It sorts quantized depth
+// values with a radix sort, and remembers the resulting order so
+// that the next sort can start from it. When the camera has moved
+// only a little since the previous sort, the old order is almost
+// sorted, and is just repaired with an insertion sort.
+
+class SbDepthSorter {
+public:
+  SbDepthSorter(void);
+  ~SbDepthSorter();
+
+  // Sorts the indices 0 .. num-1 on depth[index], ascending or
+  // descending. Items with (nearly) equal depths are kept in the
+  // order of the previous sort. If tiebreak is not NULL, items with
+  // equal quantized depths and a tiebreak value of 1 are placed
+  // before those with 0. For large arrays, the work is spread over
+  // the shared task scheduler's worker threads if parallel is TRUE.
+  // Returns the sorted indices, valid until the next call.
+  const int * sort(const float * depth, const int num,
+                   const SbBool descending,
+                   const unsigned char * tiebreak = NULL,
+                   const SbBool parallel = TRUE);
+
+  const int * getOrder(void) const { return this->order.data(); }
+  int getNumItems(void) const { return static_cast<int>(this->order.size()); }
+
+  // Forgets the previous order.
+  void reset(void);
+
+private:
+  SbBool repairOrder(void);
+  void radixSort(const SbBool parallel);
+  void computeKeys(const float * depth, const int num, const SbBool descending,
+                   const unsigned char * tiebreak, const SbBool parallel);
+
+  std::vector<int> order;
+  std::vector<int> tmporder;
+  std::vector<uint32_t> sortkeys;
+  std::vector<uint32_t> tmpkeys;
+};
+
+#endif // !COIN_SBDEPTHSORTER_H
@@ -50,6 +50,15 @@
   and will self destruct on the appropriate time. For this to work,
   they must be explicitly allocated in heap memory. See the class
   documentation of SoNode for more information.
+
+  Reference counting is thread safe: ref(), unref() and
+  unrefNoDelete() update the count atomically, so instances can be
+  shared between threads, e.g. a rendering thread and a thread
+  loading new parts of the scene graph. addAuditor(), removeAuditor()
+  and getAuditors() may also be called from several threads at
+  once. Notification is not protected, though: an instance must not
+  have auditors added or removed while another thread is sending
+  notifications from it.
 */
 
 // *************************************************************************
@@ -66,6 +75,7 @@
 
 #include <Inventor/misc/SoBase.h>
 
+#include <atomic>
 #include <cassert>
 #include <cstring>
 
@@ -179,6 +189,53 @@ SoType SoBase::classTypeId STATIC_SOTYPE_INIT;
 // <mortene@sim.no>
 #define ALIVE_PATTERN 0xd
 
+// The reference count and the "alive" bitpattern share a single
+// 32-bit word (SoBase::objdata). To make ref() and unref() thread
+// safe without a global mutex, the word is accessed as an atomic
+// integer, and modified by compare-and-swap on a copy of the bitfield
+// struct. This leaves the layout of the public class unchanged.
+
+template <typename ObjData>
+static inline std::atomic<uint32_t> &
+sobase_objdata_word(const ObjData & objdata)
+{
+  static_assert(sizeof(ObjData) == sizeof(uint32_t) &&
+                sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                "SoBase::objdata must fit in an atomic 32-bit word");
+  return *reinterpret_cast<std::atomic<uint32_t> *>(const_cast<ObjData *>(&objdata));
+}
+
+template <typename ObjData>
+static inline ObjData
+sobase_objdata_load(const ObjData & objdata)
+{
+  const uint32_t word = sobase_objdata_word(objdata).load(std::memory_order_acquire);
+  ObjData copy;
+  memcpy(&copy, &word, sizeof(copy));
+  return copy;
+}
+
+// Adds delta to the reference count. Returns the new count, and
+// stores the previous count in oldcount.
+template <typename ObjData>
+static inline int32_t
+sobase_objdata_addref(const ObjData & objdata, const int delta, int32_t & oldcount)
+{
+  std::atomic<uint32_t> & word = sobase_objdata_word(objdata);
+  uint32_t oldword = word.load(std::memory_order_relaxed);
+  uint32_t newword;
+  ObjData data;
+  do {
+    memcpy(&data, &oldword, sizeof(data));
+    oldcount = data.referencecount;
+    data.referencecount = oldcount + delta;
+    memcpy(&newword, &data, sizeof(newword));
+  } while (!word.compare_exchange_weak(oldword, newword,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_relaxed));
+  return data.referencecount;
+}
+
 unsigned int SbHashFunc(const SoBase * key) {
   return SbHashFunc(reinterpret_cast<size_t>(key));
 }
@@ -237,12 +294,16 @@ SoBase::~SoBase()
   // used to check that we are still alive.
   this->objdata.alive = (~ALIVE_PATTERN) & 0xf;
 
-  if (SoBase::PImpl::auditordict) {
-    //SoAuditorList * l;
-    if (SoBase::PImpl::auditordict->find(this)!=SoBase::PImpl::auditordict->const_end()) {
-      SoBase::PImpl::auditordict->erase(this);
-      //delete l;
+  SoBase::PImpl::AuditorShard & shard = SoBase::PImpl::getAuditorShard(this);
+  if (shard.dict) {
+    SoBase::PImpl::lockAuditorShard(shard);
+    SbHash<const SoBase *, SoAuditorList *>::const_iterator iter =
+      shard.dict->find(this);
+    if (iter != shard.dict->const_end()) {
+      delete iter->obj;
+      shard.dict->erase(this);
     }
+    SoBase::PImpl::unlockAuditorShard(shard);
   }
   cc_rbptree_clean(&this->auditortree);
 
@@ -370,12 +431,14 @@ SoBase::initClass(void)
   SoBase::PImpl::refwriteprefix = new SbString("+");
   SoBase::PImpl::allbaseobj = new SoBaseSet;
 
-  CC_MUTEX_CONSTRUCT(SoBase::PImpl::mutex);
   CC_MUTEX_CONSTRUCT(SoBase::PImpl::obj2name_mutex);
   CC_MUTEX_CONSTRUCT(SoBase::PImpl::name2obj_mutex);
   CC_MUTEX_CONSTRUCT(SoBase::PImpl::allbaseobj_mutex);
-  CC_MUTEX_CONSTRUCT(SoBase::PImpl::auditor_mutex);
   CC_MUTEX_CONSTRUCT(SoBase::PImpl::global_mutex);
+  for (int i = 0; i < SoBase::PImpl::AUDITOR_SHARDS; i++) {
+    CC_MUTEX_CONSTRUCT(SoBase::PImpl::auditorshard[i].mutex);
+  }
+  coin_atexit((coin_atexit_f*)SoBase::PImpl::cleanup_auditordict, CC_ATEXIT_NORMAL);
 
   // debug
   const char * str = coin_getenv("COIN_DEBUG_TRACK_SOBASE_INSTANCES");
@@ -411,12 +474,13 @@ SoBase::cleanClass(void)
 
   SoBase::classTypeId STATIC_SOTYPE_INIT;
 
-  CC_MUTEX_DESTRUCT(SoBase::PImpl::mutex);
   CC_MUTEX_DESTRUCT(SoBase::PImpl::obj2name_mutex);
   CC_MUTEX_DESTRUCT(SoBase::PImpl::allbaseobj_mutex);
   CC_MUTEX_DESTRUCT(SoBase::PImpl::name2obj_mutex);
-  CC_MUTEX_DESTRUCT(SoBase::PImpl::auditor_mutex);
   CC_MUTEX_DESTRUCT(SoBase::PImpl::global_mutex);
+  for (int i = 0; i < SoBase::PImpl::AUDITOR_SHARDS; i++) {
+    CC_MUTEX_DESTRUCT(SoBase::PImpl::auditorshard[i].mutex);
+  }
 
   SoBase::PImpl::tracerefs = FALSE;
   SoBase::PImpl::writecounter = 0;
@@ -446,7 +510,7 @@ SoBase::cleanClass(void)
 void
 SoBase::assertAlive(void) const
 {
-  if (this->objdata.alive != ALIVE_PATTERN) {
+  if (sobase_objdata_load(this->objdata).alive != ALIVE_PATTERN) {
     SoDebugError::post("SoBase::assertAlive",
                        "Detected an attempt to access an instance (%p) of an "
                        "SoBase-derived class after it was destructed!  "
@@ -476,19 +540,16 @@ SoBase::ref(void) const
 {
   if (COIN_DEBUG) this->assertAlive();
 
-  CC_MUTEX_LOCK(SoBase::PImpl::mutex);
-#if COIN_DEBUG
-  int32_t currentrefcount = this->objdata.referencecount;
-#endif // COIN_DEBUG
-  this->objdata.referencecount++;
-  CC_MUTEX_UNLOCK(SoBase::PImpl::mutex);
+  int32_t currentrefcount;
+  const int32_t refcount =
+    sobase_objdata_addref(this->objdata, 1, currentrefcount);
 
 #if COIN_DEBUG
-  if (this->objdata.referencecount < currentrefcount) {
+  if (refcount < currentrefcount) {
     SoDebugError::post("SoBase::ref",
                        "%p ('%s') - referencecount overflow!: %d -> %d",
                        this, this->getTypeId().getName().getString(),
-                       currentrefcount, this->objdata.referencecount);
+                       currentrefcount, refcount);
 
     // The reference counter is contained within 27 bits of signed
     // integer, which means it can go up to about ~67 million
@@ -507,9 +568,11 @@ SoBase::ref(void) const
     SoDebugError::postInfo("SoBase::ref",
                            "%p ('%s') - referencecount: %d",
                            this, this->getTypeId().getName().getString(),
-                           this->objdata.referencecount);
+                           refcount);
   }
-#endif // COIN_DEBUG
+#else // !COIN_DEBUG
+  (void)refcount;
+#endif // !COIN_DEBUG
 }
 
 /*!
@@ -526,18 +589,16 @@ SoBase::unref(void) const
 {
   if (COIN_DEBUG) this->assertAlive();
 
-  CC_MUTEX_LOCK(SoBase::PImpl::mutex);
-  this->objdata.referencecount--;
-  int refcount = this->objdata.referencecount;
-
-  CC_MUTEX_UNLOCK(SoBase::PImpl::mutex);
+  int32_t oldrefcount;
+  const int32_t refcount =
+    sobase_objdata_addref(this->objdata, -1, oldrefcount);
 
 #if COIN_DEBUG
   if (SoBase::PImpl::tracerefs) {
     SoDebugError::postInfo("SoBase::unref",
                            "%p ('%s') - referencecount: %d",
                            this, this->getTypeId().getName().getString(),
-                           this->objdata.referencecount);
+                           refcount);
   }
   if (refcount < 0) {
     // Do the debug output in two calls, since the getTypeId() might
@@ -565,15 +626,19 @@ SoBase::unrefNoDelete(void) const
 {
   if (COIN_DEBUG) this->assertAlive();
 
-  this->objdata.referencecount--;
+  int32_t oldrefcount;
+  const int32_t refcount =
+    sobase_objdata_addref(this->objdata, -1, oldrefcount);
 #if COIN_DEBUG
   if (SoBase::PImpl::tracerefs) {
     SoDebugError::postInfo("SoBase::unrefNoDelete",
                            "%p ('%s') - referencecount: %d",
                            this, this->getTypeId().getName().getString(),
-                           this->objdata.referencecount);
+                           refcount);
   }
-#endif // COIN_DEBUG
+#else // !COIN_DEBUG
+  (void)refcount;
+#endif // !COIN_DEBUG
 }
 
 /*!
@@ -582,7 +647,7 @@ SoBase::unrefNoDelete(void) const
 int32_t
 SoBase::getRefCount(void) const
 {
-  return this->objdata.referencecount;
+  return sobase_objdata_load(this->objdata).referencecount;
 }
 
 /*!
@@ -825,7 +890,10 @@ SoBase::addAuditor(void * const auditor, const SoNotRec::Type type)
   // MSVC7 on 64-bit Windows wants to go through this type before
   // casting to void*.
   const uintptr_t val = (uintptr_t)type;
+  SoBase::PImpl::AuditorShard & shard = SoBase::PImpl::getAuditorShard(this);
+  SoBase::PImpl::lockAuditorShard(shard);
   cc_rbptree_insert(&this->auditortree, auditor, (void *)val);
+  SoBase::PImpl::unlockAuditorShard(shard);
 }
 
 /*!
@@ -837,7 +905,10 @@ SoBase::addAuditor(void * const auditor, const SoNotRec::Type type)
 void
 SoBase::removeAuditor(void * const auditor, const SoNotRec::Type COIN_UNUSED_ARG(type))
 {
+  SoBase::PImpl::AuditorShard & shard = SoBase::PImpl::getAuditorShard(this);
+  SoBase::PImpl::lockAuditorShard(shard);
   cc_rbptree_remove(&this->auditortree, auditor);
+  SoBase::PImpl::unlockAuditorShard(shard);
 }
 
 
@@ -859,30 +930,30 @@ sobase_audlist_add(void * pointer, void * type, void * closure)
 const SoAuditorList &
 SoBase::getAuditors(void) const
 {
-  CC_MUTEX_LOCK(SoBase::PImpl::auditor_mutex);
+  SoBase::PImpl::AuditorShard & shard = SoBase::PImpl::getAuditorShard(this);
+  SoBase::PImpl::lockAuditorShard(shard);
 
-  if (SoBase::PImpl::auditordict == NULL) {
-    SoBase::PImpl::auditordict = new SbHash<const SoBase *, SoAuditorList *>();
-    coin_atexit((coin_atexit_f*)SoBase::PImpl::cleanup_auditordict, CC_ATEXIT_NORMAL);
+  if (shard.dict == NULL) {
+    shard.dict = new SbHash<const SoBase *, SoAuditorList *>();
   }
 
   SoAuditorList * l = NULL;
-  SbHash<const SoBase *, SoAuditorList *>::const_iterator iter
-    = 
-    SoBase::PImpl::auditordict->find(this);
-  if (iter!=SoBase::PImpl::auditordict->const_end()) {
+  SbHash<const SoBase *, SoAuditorList *>::const_iterator iter =
+    shard.dict->find(this);
+  if (iter != shard.dict->const_end()) {
     l = iter->obj;
     // empty list before copying in new values
-    for (int i = 0; i < l->getLength(); i++) {
+    for (int i = l->getLength() - 1; i >= 0; i--) {
       l->remove(i);
     }
   }
   else {
-    (*SoBase::PImpl::auditordict)[this] = new SoAuditorList;
+    l = new SoAuditorList;
+    (*shard.dict)[this] = l;
   }
   cc_rbptree_traverse(&this->auditortree, (cc_rbptree_traversecb*)sobase_audlist_add, (void*) l);
 
-  CC_MUTEX_UNLOCK(SoBase::PImpl::auditor_mutex);
+  SoBase::PImpl::unlockAuditorShard(shard);
 
   return *l;
 }
@@ -1828,6 +1899,55 @@ DEF root Separator {
 	   newroot->unref();
  }
 
+#include <Inventor/C/threads/thread.h>
+#include <Inventor/lists/SoAuditorList.h>
+
+static void *
+ref_unref_thread(void * closure)
+{
+  SoNode * node = (SoNode *)closure;
+  for (int i = 0; i < 100000; i++) {
+    node->ref();
+    node->unrefNoDelete();
+  }
+  return NULL;
+}
+
+BOOST_AUTO_TEST_CASE(auditorsAndRefCount)
+{
+  SoSeparator * child = new SoSeparator;
+  child->ref();
+  SoSeparator * parent1 = new SoSeparator;
+  parent1->ref();
+  SoSeparator * parent2 = new SoSeparator;
+  parent2->ref();
+
+  parent1->addChild(child);
+  parent2->addChild(child);
+  BOOST_CHECK_MESSAGE(child->getAuditors().getLength() == 2,
+                      "both parents should audit the child");
+  parent1->removeChild(child);
+  BOOST_CHECK_MESSAGE(child->getAuditors().getLength() == 1,
+                      "auditor list should be refreshed on each call");
+  BOOST_CHECK_MESSAGE(child->getAuditors().getObject(0) == parent2,
+                      "remaining auditor should be the second parent");
+
+  cc_thread * threads[4];
+  for (int i = 0; i < 4; i++) {
+    threads[i] = cc_thread_construct(ref_unref_thread, child);
+  }
+  for (int i = 0; i < 4; i++) {
+    cc_thread_join(threads[i], NULL);
+    cc_thread_destruct(threads[i]);
+  }
+  BOOST_CHECK_MESSAGE(child->getRefCount() == 2,
+                      "concurrent ref() and unref() should not lose updates");
+
+  parent2->unref();
+  parent1->unref();
+  child->unref();
+}
+
 #endif // COIN_TEST_SUITE
 
 /* *********************************************************************** */
@@ -66,13 +66,11 @@ const char SoBase::PImpl::ROUTE_KEYWORD[] = "ROUTE";
 const char SoBase::PImpl::PROTO_KEYWORD[] = "PROTO";
 const char SoBase::PImpl::EXTERNPROTO_KEYWORD[] = "EXTERNPROTO";
 
-void * SoBase::PImpl::mutex = NULL;
 void * SoBase::PImpl::name2obj_mutex = NULL;
 void * SoBase::PImpl::obj2name_mutex = NULL;
-void * SoBase::PImpl::auditor_mutex = NULL;
 void * SoBase::PImpl::global_mutex = NULL;
 
-SbHash<const SoBase *, SoAuditorList *> * SoBase::PImpl::auditordict = NULL;
+SoBase::PImpl::AuditorShard SoBase::PImpl::auditorshard[SoBase::PImpl::AUDITOR_SHARDS];
 
 // Only a small number of SoBase derived objects will under usual
 // conditions have designated names, so we use a couple of static
@@ -136,21 +134,47 @@ SoBase::PImpl::removeObj2Name(SoBase * const base, const char * const COIN_UNUSE
   CC_MUTEX_UNLOCK(SoBase::PImpl::obj2name_mutex);
 }
 
+SoBase::PImpl::AuditorShard &
+SoBase::PImpl::getAuditorShard(const SoBase * base)
+{
+  // instances are heap allocated, so the lowest bits carry little
+  // information
+  const uintptr_t key = reinterpret_cast<uintptr_t>(base);
+  return SoBase::PImpl::auditorshard[((key >> 4) ^ (key >> 10)) % AUDITOR_SHARDS];
+}
+
+// The shard mutexes are destructed in SoBase::cleanClass(), but
+// instances may still die after that.
+void
+SoBase::PImpl::lockAuditorShard(AuditorShard & shard)
+{
+  if (shard.mutex) { CC_MUTEX_LOCK(shard.mutex); }
+}
+
+void
+SoBase::PImpl::unlockAuditorShard(AuditorShard & shard)
+{
+  if (shard.mutex) { CC_MUTEX_UNLOCK(shard.mutex); }
+}
+
 void
 SoBase::PImpl::cleanup_auditordict(void)
 {
-  if (SoBase::PImpl::auditordict) {
+  for (int i = 0; i < AUDITOR_SHARDS; i++) {
+    SbHash<const SoBase *, SoAuditorList *> * dict =
+      SoBase::PImpl::auditorshard[i].dict;
+    if (dict == NULL) continue;
     for(
        SbHash<const SoBase *, SoAuditorList *>::const_iterator iter =
-         SoBase::PImpl::auditordict->const_begin();
-       iter!=SoBase::PImpl::auditordict->const_end();
+         dict->const_begin();
+       iter!=dict->const_end();
        ++iter
        ) {
       delete iter->obj;
     }
 
-    delete SoBase::PImpl::auditordict;
-    SoBase::PImpl::auditordict = NULL;
+    delete dict;
+    SoBase::PImpl::auditorshard[i].dict = NULL;
   }
 }
 
@@ -62,13 +62,24 @@ public:
   static const char PROTO_KEYWORD[];
   static const char EXTERNPROTO_KEYWORD[];
 
-  static void * mutex;
   static void * name2obj_mutex;
   static void * obj2name_mutex;
-  static void * auditor_mutex;
   static void * global_mutex;
 
-  static SbHash<const SoBase *, SoAuditorList *> * auditordict;
+  // The locks protecting each instance's auditortree, and the lists
+  // handed out by SoBase::getAuditors(), are spread over a number of
+  // shards picked from the instance's address. Threads working on
+  // different parts of a scene graph will then seldom contend for
+  // the same mutex.
+  enum { AUDITOR_SHARDS = 64 };
+  struct AuditorShard {
+    void * mutex;
+    SbHash<const SoBase *, SoAuditorList *> * dict;
+  };
+  static AuditorShard auditorshard[AUDITOR_SHARDS];
+  static AuditorShard & getAuditorShard(const SoBase * base);
+  static void lockAuditorShard(AuditorShard & shard);
+  static void unlockAuditorShard(AuditorShard & shard);
   static SbHash<const char *, SbPList *> * name2obj;
   static SbHash<const SoBase *, const char *> * obj2name;
 
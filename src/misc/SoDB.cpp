@@ -120,6 +120,7 @@
 #include "misc/SoDBP.h"
 #include "misc/SbHash.h"
 #include "misc/SoConfigSettings.h"
+#include "io/SoInput_ParallelParser.h"
 #include "rendering/SoVBO.h"
 
 #ifdef HAVE_VRML97
@@ -151,6 +152,7 @@
 #ifndef DOXYGEN_SKIP_THIS
 const char * SoDBP::EnvVars::COIN_PROFILER = "COIN_PROFILER";
 const char * SoDBP::EnvVars::COIN_PROFILER_OVERLAY = "COIN_PROFILER_OVERLAY";
+const char * SoDBP::EnvVars::COIN_PARALLEL_READ_THREADS = "COIN_PARALLEL_READ_THREADS";
 #endif // DOXYGEN_SKIP_THIS
 
 // *************************************************************************
@@ -704,6 +706,52 @@ SoDB::readAllVRML(SoInput * in)
 #endif // ! HAVE_VRML97
 }
 
+/*!
+  Sets the number of threads readAll() and readAllVRML() may use for
+  parsing a file.
+
+  With more than one thread, the top-level nodes of a file (or the
+  children of the file's single top-level group node, which is the
+  common layout for exported models) are located by a quick scan over
+  the file, and then parsed in parallel. DEF / USE references between
+  the parts are resolved after the independent parts have been read.
+
+  This is only done for ASCII Inventor V2.1 files which are kept in
+  memory, i.e. memory buffers and files large enough to be memory
+  mapped, and which do not contain constructs which depend on reading
+  the file strictly in order (like global fields). Other files, and
+  files where the scan finds something it can't handle, are read on
+  the calling thread just as before.
+
+  Reading in parallel is not done by default. The default value can
+  be overridden with the environment variable
+  COIN_PARALLEL_READ_THREADS.
+
+  \sa getNumReadThreads(), readAll()
+  \since Coin 4.1
+*/
+void
+SoDB::setNumReadThreads(const int numthreads)
+{
+  SoDBP::numreadthreads = SbMax(numthreads, 1);
+}
+
+/*!
+  Returns the number of threads used for reading files.
+
+  \sa setNumReadThreads()
+  \since Coin 4.1
+*/
+int
+SoDB::getNumReadThreads(void)
+{
+  if (SoDBP::numreadthreads < 0) {
+    const char * env = coin_getenv(SoDBP::EnvVars::COIN_PARALLEL_READ_THREADS);
+    SoDBP::numreadthreads = env ? SbMax(atoi(env), 1) : 1;
+  }
+  return SoDBP::numreadthreads;
+}
+
 /*!
   Check if \a testString is a valid file format header identifier string.
 
@@ -1161,8 +1209,7 @@ SoDB::isNotifying(void)
 void
 SoDB::endNotify(void)
 {
-  SoDBP::notificationcounter--;
-  if (SoDBP::notificationcounter == 0) {
+  if (--SoDBP::notificationcounter == 0) {
     // Process zero-priority sensors after notification has been done.
     SoSensorManager * sm = SoDB::getSensorManager();
     if (sm->isDelaySensorPending()) sm->processImmediateQueue();
@@ -1173,6 +1220,94 @@ SoDB::endNotify(void)
 
 }
 
+/*!
+  Starts a notification batch. Until the matching
+  commitNotificationBatch() call, changes to field values will not be
+  propagated to the field auditors and containers right away.
+  Instead, each changed field is queued (once, no matter how many
+  times it is changed), and all the queued fields are notified as one
+  notification sequence when the batch is committed.
+
+  Batching is useful when a lot of fields are changed at the same
+  time, like when an application updates the SoTransform nodes of a
+  large number of objects for every frame:
+
+  \code
+  SoDB::beginNotificationBatch();
+  for (int i = 0; i < numobjects; i++) {
+    transforms[i]->translation.setValue(positions[i]);
+    transforms[i]->rotation.setValue(rotations[i]);
+  }
+  SoDB::commitNotificationBatch();
+  \endcode
+
+  Without the batch, each setValue() call is a separate notification
+  sequence, which walks all the way up through the parent groups to
+  the node sensors attached to the root of the scene graph. In a
+  batch, a node reached from more than one of the changed fields
+  only passes the notification on once, so the groups, sensors and
+  caches above the changed nodes are notified once per commit.
+
+  Node sensors, field sensors and caches end up in the same state
+  after the commit as they would without the batch, but note that
+  immediate (zero-priority) sensors are triggered once, at the end of
+  the commit, and not for each change. Also note that fields
+  connected from changed fields (directly or through engines) are not
+  marked for re-evaluation until the batch is committed, so reading
+  them inside the batch gives the old values.
+
+  Batches can be nested. The fields are notified when the outermost
+  batch is committed. The batch belongs to the thread that started
+  it: in thread safe builds, other threads changing field values
+  wait until the batch is committed, in the same way as during any
+  other notification sequence, and their changes are notified right
+  away and not as part of the batch.
+
+  \sa commitNotificationBatch(), isNotificationBatchActive()
+  \since Coin 4.1
+*/
+void
+SoDB::beginNotificationBatch(void)
+{
+#ifdef COIN_THREADSAFE
+  (void) cc_recmutex_internal_notify_lock();
+#endif // COIN_THREADSAFE
+  SoDBP::notificationbatchcounter++;
+}
+
+/*!
+  Ends a notification batch started with beginNotificationBatch(),
+  and notifies the auditors of the fields changed during the batch if
+  this was the outermost batch.
+
+  \sa beginNotificationBatch()
+  \since Coin 4.1
+*/
+void
+SoDB::commitNotificationBatch(void)
+{
+  assert(SoDBP::notificationbatchcounter > 0 &&
+         "commitNotificationBatch() without beginNotificationBatch()");
+  if (--SoDBP::notificationbatchcounter == 0) {
+    SoDBP::flushDeferredNotify();
+  }
+#ifdef COIN_THREADSAFE
+  (void) cc_recmutex_internal_notify_unlock();
+#endif // COIN_THREADSAFE
+}
+
+/*!
+  Returns \c TRUE if a notification batch is active.
+
+  \sa beginNotificationBatch()
+  \since Coin 4.1
+*/
+SbBool
+SoDB::isNotificationBatchActive(void)
+{
+  return SoDBP::notificationbatchcounter > 0;
+}
+
 /*!
   Turn on or off the real time sensor.
 
@@ -1246,6 +1381,16 @@ SoDB::readAllWrapper(SoInput * in, const SoType & grouptype)
   const int stackdepth = in->filestack.getLength();
 
   SoGroup * root = (SoGroup *)grouptype.createInstance();
+
+  // Let several threads do the work if possible. This consumes the
+  // complete file on success, and does not touch it at all
+  // otherwise, so the loop below will either just hit EOF or do the
+  // import the usual way.
+  if ((SoDB::getNumReadThreads() > 1) && (stackdepth == 1)) {
+    (void)SoInput_ParallelParser::readAll(in, in->getTopOfStack(),
+                                          SoDB::getNumReadThreads(), root);
+  }
+
   SoNode * topnode;
   do {
     if (!SoDB::read(in, topnode)) {
@@ -1700,6 +1845,13 @@ SoDB::removeRoute(SoNode * fromnode, const char * eventout,
 #include <Inventor/nodes/SoNode.h>
 #include <Inventor/nodes/SoSeparator.h>
 #include <Inventor/nodes/SoRotationXYZ.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoTransform.h>
+#include <Inventor/sensors/SoFieldSensor.h>
+#include <Inventor/sensors/SoNodeSensor.h>
+#include <Inventor/SoOutput.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/actions/SoWriteAction.h>
 #include <boost/detail/workaround.hpp>
 
 BOOST_AUTO_TEST_CASE(globalRealTimeField)
@@ -1897,6 +2049,147 @@ BOOST_AUTO_TEST_CASE(globalfield_import)
   g->unref();
 }
 
+static SbString
+writeToString(SoNode * root)
+{
+  SoOutput out;
+  out.setBuffer(malloc(1024), 1024, realloc);
+  SoWriteAction wa(&out);
+  wa.apply(root);
+  void * buf;
+  size_t size;
+  out.getBuffer(buf, size);
+  SbString s(static_cast<const char *>(buf));
+  free(buf);
+  return s;
+}
+
+BOOST_AUTO_TEST_CASE(parallelReadAll)
+{
+  // A flat separator with many children, with references across
+  // the children, large enough to be split up.
+  SbString scene("#Inventor V2.1 ascii\n\n"
+                 "DEF parallelroot Separator {\n"
+                 "  renderCaching OFF\n");
+  const int numchildren = 2000;
+  for (int i = 0; i < numchildren; i++) {
+    SbString child;
+    if (i % 100 == 0) {
+      child.sprintf("  DEF parallelmat%d Material { diffuseColor %d 0.5 0.25 }\n", i, i % 2);
+    }
+    else if (i % 10 == 0) {
+      child.sprintf("  USE parallelmat%d\n", (i / 100) * 100);
+    }
+    else {
+      child.sprintf("  Separator { # child %d\n"
+                    "    Info { string \"{ not a brace }\" }\n"
+                    "    Translation { translation %d 0 0 }\n"
+                    "    Cube { }\n"
+                    "  }\n", i, i);
+    }
+    scene += child;
+  }
+  scene += "}\n";
+
+  const int prevthreads = SoDB::getNumReadThreads();
+  SoNode * roots[2];
+  for (int pass = 0; pass < 2; pass++) {
+    SoDB::setNumReadThreads(pass == 0 ? 1 : 4);
+    SoInput in;
+    in.setBuffer(scene.getString(), scene.getLength());
+    roots[pass] = SoDB::readAll(&in);
+    BOOST_REQUIRE(roots[pass] != NULL);
+    roots[pass]->ref();
+    BOOST_CHECK(in.findReference("parallelroot") == roots[pass]);
+  }
+  SoDB::setNumReadThreads(prevthreads);
+
+  SoSeparator * root = static_cast<SoSeparator *>(roots[1]);
+  BOOST_CHECK(root->getName() == "parallelroot");
+  BOOST_CHECK(!root->renderCaching.isDefault());
+  BOOST_REQUIRE_EQUAL(root->getNumChildren(), numchildren);
+  BOOST_CHECK(root->getChild(1000) == root->getChild(1090));
+  BOOST_CHECK(root->getChild(1000) != root->getChild(1100));
+  BOOST_CHECK(writeToString(roots[0]) == writeToString(roots[1]));
+
+  roots[0]->unref();
+  roots[1]->unref();
+}
+
+static void
+countTriggersCB(void * data, SoSensor *)
+{
+  (*static_cast<int *>(data))++;
+}
+
+BOOST_AUTO_TEST_CASE(notificationBatch)
+{
+  const int numobjects = 50;
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoTransform * transforms[numobjects];
+  for (int i = 0; i < numobjects; i++) {
+    SoSeparator * sep = new SoSeparator;
+    transforms[i] = new SoTransform;
+    sep->addChild(transforms[i]);
+    sep->addChild(new SoCube);
+    root->addChild(sep);
+  }
+
+  int rootcount = 0, fieldcount = 0, delaycount = 0;
+  SoNodeSensor rootsensor(countTriggersCB, &rootcount);
+  rootsensor.setPriority(0);
+  rootsensor.attach(root);
+  SoFieldSensor fieldsensor(countTriggersCB, &fieldcount);
+  fieldsensor.setPriority(0);
+  fieldsensor.attach(&transforms[3]->translation);
+  SoNodeSensor delaysensor(countTriggersCB, &delaycount);
+  delaysensor.attach(transforms[3]);
+
+  SbViewportRegion vp(100, 100);
+  SoGetBoundingBoxAction bboxaction(vp);
+  bboxaction.apply(root); // sets up the bounding box caches
+
+  BOOST_CHECK(!SoDB::isNotificationBatchActive());
+  SoDB::beginNotificationBatch();
+  SoDB::beginNotificationBatch(); // nested
+  BOOST_CHECK(SoDB::isNotificationBatchActive());
+  for (int i = 0; i < numobjects; i++) {
+    transforms[i]->translation.setValue(float(i), 100.0f, 0.0f);
+    transforms[i]->rotation.setValue(SbVec3f(0.0f, 1.0f, 0.0f), 0.5f);
+    transforms[i]->translation.setValue(float(i), 10.0f, 0.0f);
+  }
+  SoDB::commitNotificationBatch();
+  BOOST_CHECK_MESSAGE(rootcount == 0 && fieldcount == 0 && !delaysensor.isScheduled(),
+                      "notification not deferred inside a batch");
+
+  // a changed node destructed before the commit shouldn't be notified
+  SoSeparator * last = static_cast<SoSeparator *>(root->getChild(numobjects - 1));
+  last->removeChild(transforms[numobjects - 1]);
+  rootcount = 0;
+  SoDB::commitNotificationBatch();
+  BOOST_CHECK(!SoDB::isNotificationBatchActive());
+
+  BOOST_CHECK_MESSAGE(rootcount == 1, "root sensor should be triggered once");
+  BOOST_CHECK_MESSAGE(fieldcount == 1, "field sensor should be triggered once");
+  BOOST_CHECK_MESSAGE(delaysensor.isScheduled(), "delay sensor not scheduled");
+  BOOST_CHECK(transforms[3]->translation.getValue() == SbVec3f(3.0f, 10.0f, 0.0f));
+
+  bboxaction.apply(root);
+  const SbBox3f box = bboxaction.getBoundingBox();
+  BOOST_CHECK_MESSAGE(box.getMax()[1] > 10.5f && box.getMax()[1] < 11.5f,
+                      "bounding box caches not invalidated by the batch");
+
+  // outside a batch, every change is notified right away
+  rootcount = 0;
+  transforms[0]->translation.setValue(0.0f, 0.0f, 0.0f);
+  transforms[1]->translation.setValue(0.0f, 0.0f, 0.0f);
+  BOOST_CHECK(rootcount == 2);
+
+  delaysensor.detach();
+  root->unref();
+}
+
 // *************************************************************************
 
 #endif // COIN_TEST_SUITE
@@ -4,6 +4,7 @@
 #include <Inventor/SoInput.h>
 #include <Inventor/fields/SoField.h>
 #include <Inventor/fields/SoSFTime.h>
+#include <Inventor/misc/SoNotification.h>
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/sensors/SoTimerSensor.h>
 
@@ -18,10 +19,16 @@
 #include "fields/SoGlobalField.h"
 #include "coindefs.h"
 
+inline unsigned int SbHashFunc(const SoField * key)
+{
+  return SbHashFunc(reinterpret_cast<size_t>(key));
+}
+
 #ifdef COIN_THREADSAFE
 // need to include SbRWMutex.h to make C++ call the actual destructor,
 // and not just default destructor
 #include <Inventor/threads/SbRWMutex.h>
+#include "threads/recmutexp.h"
 SbRWMutex * SoDBP::globalmutex = NULL;
 #endif // COIN_THREADSAFE
 SbList<SoDB_HeaderInfo *> * SoDBP::headerlist = NULL;
@@ -29,7 +36,11 @@ SoSensorManager * SoDBP::sensormanager = NULL;
 SoTimerSensor * SoDBP::globaltimersensor = NULL;
 UInt32ToInt16Map * SoDBP::converters = NULL;
 SbBool SoDBP::isinitialized = FALSE;
-int SoDBP::notificationcounter = 0;
+std::atomic<int> SoDBP::notificationcounter(0);
+std::atomic<int> SoDBP::notificationbatchcounter(0);
+SbList<SoField *> * SoDBP::batchedfields = NULL;
+SbHash<const SoField *, int> * SoDBP::batchedfieldindex = NULL;
+int SoDBP::numreadthreads = -1;
 SbList<SoDBP::ProgressCallbackInfo> * SoDBP::progresscblist = NULL;
 
 // *************************************************************************
@@ -110,6 +121,11 @@ SoDBP::clean(void)
   delete SoDBP::progresscblist;
   SoDBP::progresscblist = NULL;
 
+  delete SoDBP::batchedfields;
+  SoDBP::batchedfields = NULL;
+  delete SoDBP::batchedfieldindex;
+  SoDBP::batchedfieldindex = NULL;
+
   // Avoid having the SoSensorManager instance trigging the callback
   // into the So@Gui@ class -- not only have it possible "died", but
   // the whole GUI toolkit could have died until we come here.
@@ -166,6 +182,80 @@ SoDBP::updateRealTimeFieldCB(void * COIN_UNUSED_ARG(data), SoSensor * COIN_UNUSE
   }
 }
 
+// Called from SoField::startNotify() while a notification batch is
+// active. The field is queued (once) and notified when the batch is
+// committed.
+void
+SoDBP::deferNotify(SoField * field)
+{
+#ifdef COIN_THREADSAFE
+  (void) cc_recmutex_internal_notify_lock();
+#endif // COIN_THREADSAFE
+  if (SoDBP::batchedfields == NULL) {
+    SoDBP::batchedfields = new SbList<SoField *>;
+    SoDBP::batchedfieldindex = new SbHash<const SoField *, int>;
+  }
+  int dummy;
+  if (!SoDBP::batchedfieldindex->get(field, dummy)) {
+    SoDBP::batchedfieldindex->put(field, SoDBP::batchedfields->getLength());
+    SoDBP::batchedfields->append(field);
+  }
+#ifdef COIN_THREADSAFE
+  (void) cc_recmutex_internal_notify_unlock();
+#endif // COIN_THREADSAFE
+}
+
+// Called from the SoField destructor, so a field destructed before
+// the batch is committed isn't notified.
+void
+SoDBP::forgetDeferredNotify(SoField * field)
+{
+#ifdef COIN_THREADSAFE
+  (void) cc_recmutex_internal_notify_lock();
+#endif // COIN_THREADSAFE
+  int idx;
+  if (SoDBP::batchedfieldindex &&
+      SoDBP::batchedfieldindex->getNumElements() > 0 &&
+      SoDBP::batchedfieldindex->get(field, idx)) {
+    (*SoDBP::batchedfields)[idx] = NULL;
+    SoDBP::batchedfieldindex->erase(field);
+  }
+#ifdef COIN_THREADSAFE
+  (void) cc_recmutex_internal_notify_unlock();
+#endif // COIN_THREADSAFE
+}
+
+// Notifies the fields queued during a notification batch, in the
+// order they were first changed, as one notification sequence.
+void
+SoDBP::flushDeferredNotify(void)
+{
+  if (SoDBP::batchedfields == NULL) return;
+  if (SoDBP::batchedfields->getLength() == 0) return;
+
+  SoDB::startNotify();
+  // All the lists get the time stamp of this one, so that a node
+  // reached from more than one of the changed fields (typically a
+  // group above them, or the container of several changed fields)
+  // passes the notification on to its auditors only once. The
+  // containers still get one notification per changed field.
+  SoNotList stamp;
+  // Note: the length is read in each iteration, and entries are
+  // cleared before they are notified, since a notification might
+  // start and commit a new batch.
+  for (int i = 0; i < SoDBP::batchedfields->getLength(); i++) {
+    SoField * field = (*SoDBP::batchedfields)[i];
+    if (field == NULL) continue;
+    (*SoDBP::batchedfields)[i] = NULL;
+    SoDBP::batchedfieldindex->erase(field);
+    SoNotList l(&stamp);
+    field->notify(&l);
+  }
+  SoDBP::batchedfields->truncate(0);
+  SoDBP::batchedfieldindex->clear();
+  SoDB::endNotify();
+}
+
 SbBool
 SoDBP::is3dsFile(SoInput * in)
 {
@@ -46,7 +46,10 @@
 
 #include "misc/SbHash.h"
 
+#include <atomic>
+
 class SoSensor;
+class SoField;
 class SbRWMutex;
 
 // *************************************************************************
@@ -75,6 +78,7 @@ public:
   struct EnvVars {
     static const char * COIN_PROFILER;
     static const char * COIN_PROFILER_OVERLAY;
+    static const char * COIN_PARALLEL_READ_THREADS;
   };
 
   static void variableArgsSanityCheck(void);
@@ -84,6 +88,10 @@ public:
   static void updateRealTimeFieldCB(void * data, SoSensor * sensor);
   static void listWin32ProcessModules(void);
 
+  static void deferNotify(SoField * field);
+  static void forgetDeferredNotify(SoField * field);
+  static void flushDeferredNotify(void);
+
 #ifdef COIN_THREADSAFE
   static SbRWMutex * globalmutex;
 #endif // COIN_THREADSAFE
@@ -91,7 +99,11 @@ public:
   static SoSensorManager * sensormanager;
   static SoTimerSensor * globaltimersensor;
   static UInt32ToInt16Map * converters;
-  static int notificationcounter;
+  static std::atomic<int> notificationcounter;
+  static std::atomic<int> notificationbatchcounter;
+  static SbList<SoField *> * batchedfields;
+  static SbHash<const SoField *, int> * batchedfieldindex;
+  static int numreadthreads;
   static SbBool isinitialized;
 
   static SbBool is3dsFile(SoInput * in);
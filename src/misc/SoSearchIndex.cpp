@@ -0,0 +1,750 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+
+/*!
+  \class SoSearchIndex SoSearchIndex.h Inventor/misc/SoSearchIndex.h
+  \brief The SoSearchIndex class lets SoSearchAction find nodes without traversing.
+
+  \ingroup general
+
+  The index keeps a list of the nodes an SoSearchAction visits when
+  it is applied to the \e root node, in traversal order, together
+  with where they are in the scene graph. Searches for a node
+  pointer, a type or a name are answered from lookup tables into
+  that list, instead of by a traversal of the scene graph:
+
+  \code
+    SoSearchIndex * index = new SoSearchIndex(root);
+
+    SoSearchAction sa;
+    sa.setIndex(index);
+    sa.setType(SoCamera::getClassTypeId());
+    sa.setInterest(SoSearchAction::ALL);
+    sa.apply(root); // no traversal
+  \endcode
+
+  The index is made by a traversal at the first search. After that,
+  it is kept up to date from the notifications sent by the scene
+  graph. Changes to the fields of nodes without children, which are
+  by far the most common changes, leave the index as it is. When a
+  node with children changes (a child is added, removed or replaced,
+  or for instance SoSwitch::whichChild is set), only the subgraphs
+  under that node are traversed again, at the next search.
+
+  Changes made while notification is disabled for a node can not be
+  seen by the index. Call invalidate() after such changes.
+
+  The index follows the normal search traversal rules, or searches
+  every single node if \e searchall is \c TRUE, see
+  SoSearchAction::setSearchingAll(). The settings of
+  SoBaseKit::setSearchingChildren() and SoFile::setSearchOK() are
+  taken into account.
+
+  The index does not ref the root node. If the root is destructed,
+  the index is left empty and is not used.
+
+  \sa SoSearchAction::setIndex()
+  \since Coin 4.1
+*/
+
+#include <Inventor/misc/SoSearchIndex.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <Inventor/SoFullPath.h>
+#include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/lists/SoNodeList.h>
+#include <Inventor/misc/SoChildList.h>
+#include <Inventor/misc/SoNotification.h>
+#include <Inventor/nodekits/SoBaseKit.h>
+#include <Inventor/nodes/SoFile.h>
+#include <Inventor/nodes/SoSwitch.h>
+#include <Inventor/sensors/SoNodeSensor.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#ifdef HAVE_VRML97
+#include <Inventor/VRMLnodes/SoVRMLSwitch.h>
+#endif // HAVE_VRML97
+
+#include "misc/SbHash.h"
+
+// *************************************************************************
+
+namespace {
+
+// One occurrence of a node in the search traversal. The entries make
+// up a tree which mirrors the traversal, and 'order' increases in
+// traversal order. An entry keeps its place in the entry array while
+// it is in use, so that a subgraph can be replaced without touching
+// the rest of the entries.
+struct SoSearchIndexEntry {
+  SoNode * node;        // NULL for unused entries
+  int16_t typekey;
+  SbBool found;         // the node was visited by SoNode::search()
+  int parent;           // -1 for the root
+  int childindex;       // index in the children of the parent node
+  int firstchild, lastchild, nextsibling;
+  int prevnode, nextnode; // entries with the same node
+  int prevtype, nexttype; // found entries with the same type
+  uint64_t order;
+};
+
+// The state of a recording traversal, see SoSearchIndexP::record().
+struct SoSearchIndexRecording {
+  SoSearchIndexP * thisp;
+  const SoFullPath * subgraph;
+  int depth;
+  std::vector<int> stack;
+  int numnew;
+};
+
+} // namespace
+
+class SoSearchIndexP {
+public:
+  SoSearchIndexP(SoSearchIndex * master) : master(master) { }
+
+  void clear(void);
+  void refresh(void);
+  void rebuild(void);
+  void record(const int entry);
+  static void recordPath(void * closure, SoPath * path);
+
+  int newEntry(SoNode * node, const int parent, const int childindex);
+  void setFound(const int entry);
+  void removeChildren(const int entry);
+  int nextEntry(int entry, const int subgraph) const;
+  void setOrder(const int entry, const int numnew);
+
+  SoPath * makePath(const int entry) const;
+  void addCandidates(const int first, const SbBool isnode, std::vector<int> & candidates) const;
+  SbBool isChanged(int entry) const;
+  static SbBool isInactiveChild(const SoNode * parent, const int childindex);
+
+  static void rootDeletedCB(void * data, SoSensor * sensor);
+
+  SoSearchIndex * master;
+  SoNode * root;
+  SbBool searchall;
+  SoNodeSensor * sensor;
+
+  SbBool valid;
+  SbBool kitsearch;
+  SbBool filesearch;
+  SbHash<const SoNode *, SbBool> changed;
+
+  std::vector<SoSearchIndexEntry> entries;
+  std::vector<int> freeentries;
+  SbHash<const SoNode *, int> firstofnode;
+  SbHash<int, int> firstoftype;
+  int numfound;
+
+  // inactive children of switches and their node ids, when searching
+  // all nodes
+  SbHash<int, SbUniqueId> watched;
+};
+
+#define PRIVATE(obj) ((obj)->pimpl)
+
+// *************************************************************************
+
+namespace {
+
+// Listens to the notifications from the scene graph, and marks the
+// nodes with children where the notifications start. Notifications
+// starting at nodes without children can not change what a search
+// traversal visits.
+class SoSearchIndexSensor : public SoNodeSensor {
+  typedef SoNodeSensor inherited;
+
+public:
+  SoSearchIndexSensor(SoSearchIndexP * thisp) : inherited(NULL, NULL), thisp(thisp) { }
+  virtual ~SoSearchIndexSensor() { }
+
+  virtual void notify(SoNotList * l)
+  {
+    // the sensor is never scheduled, so the inherited method is not
+    // called
+    const SoNotRec * rec = l->getFirstRecAtNode();
+    const SoBase * base = rec ? rec->getBase() : NULL;
+    if (!base || !base->isOfType(SoNode::getClassTypeId())) {
+      this->thisp->valid = FALSE;
+    }
+    else if (static_cast<const SoNode *>(base)->getChildren()) {
+      this->thisp->changed.put(static_cast<const SoNode *>(base), TRUE);
+    }
+  }
+
+private:
+  SoSearchIndexP * thisp;
+};
+
+} // namespace
+
+// *************************************************************************
+
+/*!
+  Constructor. Sets up an index for searches applied to \a root, with
+  SoSearchAction::isSearchingAll() equal to \a searchall.
+
+  The index is made at the first search which uses it.
+*/
+SoSearchIndex::SoSearchIndex(SoNode * root, const SbBool searchall)
+{
+  PRIVATE(this) = new SoSearchIndexP(this);
+  PRIVATE(this)->root = root;
+  PRIVATE(this)->searchall = searchall;
+  PRIVATE(this)->valid = FALSE;
+  PRIVATE(this)->kitsearch = FALSE;
+  PRIVATE(this)->filesearch = FALSE;
+  PRIVATE(this)->numfound = 0;
+  PRIVATE(this)->sensor = new SoSearchIndexSensor(PRIVATE(this));
+  PRIVATE(this)->sensor->setDeleteCallback(SoSearchIndexP::rootDeletedCB, PRIVATE(this));
+  if (root) PRIVATE(this)->sensor->attach(root);
+}
+
+/*!
+  Destructor.
+*/
+SoSearchIndex::~SoSearchIndex()
+{
+  delete PRIVATE(this)->sensor;
+  delete PRIVATE(this);
+}
+
+/*!
+  Returns the root node of the index, or \c NULL if the root has been
+  destructed.
+*/
+SoNode *
+SoSearchIndex::getRoot(void) const
+{
+  return PRIVATE(this)->root;
+}
+
+/*!
+  Returns whether the index is for searches of every single node.
+
+  \sa SoSearchAction::setSearchingAll()
+*/
+SbBool
+SoSearchIndex::isSearchingAll(void) const
+{
+  return PRIVATE(this)->searchall;
+}
+
+/*!
+  Makes the index traverse the whole scene graph again at the next
+  search.
+*/
+void
+SoSearchIndex::invalidate(void)
+{
+  PRIVATE(this)->valid = FALSE;
+}
+
+/*!
+  Returns the number of node occurrences in the index, that is the
+  number of paths a search with SoSearchAction::ALL interest for the
+  SoNode type would find. The index is brought up to date first.
+*/
+int
+SoSearchIndex::getNumNodes(void)
+{
+  PRIVATE(this)->refresh();
+  return PRIVATE(this)->numfound;
+}
+
+/*!
+  \COININTERNAL
+
+  Does the search of \a action from the index. Returns \c FALSE if
+  the index can not be used for the search, and the scene graph must
+  be traversed as usual.
+*/
+SbBool
+SoSearchIndex::search(SoSearchAction * action)
+{
+  SoSearchIndexP * thisp = PRIVATE(this);
+  if (!thisp->root ||
+      action->getWhatAppliedTo() != SoAction::NODE ||
+      action->getNodeAppliedTo() != thisp->root ||
+      action->isSearchingAll() != thisp->searchall) {
+    return FALSE;
+  }
+  thisp->refresh();
+
+  const int lookfor = action->getFind();
+  if (lookfor == 0) return TRUE;
+
+  SoNode * node = action->getNode();
+  const SbName name = action->getName();
+  SbBool chkderived;
+  const SoType type = action->getType(chkderived);
+
+  // the candidates are collected from the most specific table, and
+  // checked against all the criteria, like in SoNode::search()
+  std::vector<int> candidates;
+  int first;
+  if (lookfor & SoSearchAction::NODE) {
+    if (thisp->firstofnode.get(node, first)) {
+      thisp->addCandidates(first, TRUE, candidates);
+    }
+  }
+  else if ((lookfor & SoSearchAction::NAME) && name != SbName::empty()) {
+    SoNodeList named;
+    const int num = SoNode::getByName(name, named);
+    for (int i = 0; i < num; i++) {
+      if (thisp->firstofnode.get(named[i], first)) {
+        thisp->addCandidates(first, TRUE, candidates);
+      }
+    }
+  }
+  else if (lookfor & SoSearchAction::TYPE) {
+    SbList<int> keys;
+    thisp->firstoftype.makeKeyList(keys);
+    for (int i = 0; i < keys.getLength(); i++) {
+      const SoType t = SoType::fromKey(static_cast<int16_t>(keys[i]));
+      if ((t == type || (chkderived && t.isDerivedFrom(type))) &&
+          thisp->firstoftype.get(keys[i], first)) {
+        thisp->addCandidates(first, FALSE, candidates);
+      }
+    }
+  }
+  else {
+    // nodes without a name
+    for (int i = 0; i < static_cast<int>(thisp->entries.size()); i++) {
+      if (thisp->entries[i].node && thisp->entries[i].found) candidates.push_back(i);
+    }
+  }
+
+  int num = 0;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    const SoSearchIndexEntry & entry = thisp->entries[candidates[i]];
+    const SoNode * n = entry.node;
+    if (!entry.found) continue;
+    if ((lookfor & SoSearchAction::NODE) && n != node) continue;
+    if ((lookfor & SoSearchAction::NAME) && n->getName() != name) continue;
+    if ((lookfor & SoSearchAction::TYPE) &&
+        !(n->getTypeId() == type ||
+          (chkderived && n->getTypeId().isDerivedFrom(type)))) continue;
+    candidates[num++] = candidates[i];
+  }
+  if (num == 0) return TRUE;
+
+  const SoSearchAction::Interest interest = action->getInterest();
+  if (interest == SoSearchAction::ALL) {
+    std::vector<std::pair<uint64_t, int> > sorted(num);
+    for (int i = 0; i < num; i++) {
+      sorted[i] = std::make_pair(thisp->entries[candidates[i]].order, candidates[i]);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    for (int i = 0; i < num; i++) action->addPath(thisp->makePath(sorted[i].second));
+  }
+  else {
+    int best = candidates[0];
+    for (int i = 1; i < num; i++) {
+      const uint64_t order = thisp->entries[candidates[i]].order;
+      if ((interest == SoSearchAction::FIRST) == (order < thisp->entries[best].order)) {
+        best = candidates[i];
+      }
+    }
+    action->addPath(thisp->makePath(best));
+  }
+  return TRUE;
+}
+
+// *************************************************************************
+
+void
+SoSearchIndexP::clear(void)
+{
+  this->entries.clear();
+  this->freeentries.clear();
+  this->firstofnode.clear();
+  this->firstoftype.clear();
+  this->watched.clear();
+  this->numfound = 0;
+}
+
+// Brings the index up to date. Subgraphs under changed nodes are
+// traversed again, and the rest of the entries are kept.
+void
+SoSearchIndexP::refresh(void)
+{
+  if (!this->root) {
+    this->clear();
+    return;
+  }
+  if (this->kitsearch != SoBaseKit::isSearchingChildren() ||
+      this->filesearch != SoFile::getSearchOK()) {
+    this->valid = FALSE;
+  }
+  if (!this->valid) {
+    this->rebuild();
+    this->changed.clear();
+    this->valid = TRUE;
+    return;
+  }
+
+  // Switches don't pass on notifications from their inactive
+  // children. The node id of such a child changes with every
+  // notification it gets, so a new id means that the subgraph under
+  // it may have changed. The child may have been destructed if one
+  // of its ancestors changed, so that is checked first, in traversal
+  // order.
+  if (this->watched.getNumElements() > 0) {
+    std::vector<std::pair<uint64_t, int> > watchlist;
+    for (SbHash<int, SbUniqueId>::const_iterator it = this->watched.const_begin();
+         it != this->watched.const_end(); ++it) {
+      watchlist.push_back(std::make_pair(this->entries[it->key].order, it->key));
+    }
+    std::sort(watchlist.begin(), watchlist.end());
+    for (size_t i = 0; i < watchlist.size(); i++) {
+      const int entry = watchlist[i].second;
+      SbUniqueId id = 0;
+      this->watched.get(entry, id);
+      if (!this->isChanged(entry) && this->entries[entry].node->getNodeId() != id) {
+        this->changed.put(this->entries[entry].node, TRUE);
+      }
+    }
+  }
+  if (this->changed.getNumElements() == 0) return;
+
+  // The occurrences of the changed nodes are traversed again, unless
+  // an ancestor has changed as well. Then the whole subgraph under
+  // the ancestor is traversed, and the ancestors of the occurrences
+  // which are left can not have changed.
+  SbList<const SoNode *> nodes;
+  this->changed.makeKeyList(nodes);
+  std::vector<int> occurrences;
+  for (int i = 0; i < nodes.getLength(); i++) {
+    int entry;
+    if (!this->firstofnode.get(nodes[i], entry)) continue;
+    for (; entry >= 0; entry = this->entries[entry].nextnode) {
+      const int parent = this->entries[entry].parent;
+      if (parent < 0 || !this->isChanged(parent)) occurrences.push_back(entry);
+    }
+  }
+  this->changed.clear();
+  for (size_t i = 0; i < occurrences.size(); i++) {
+    this->removeChildren(occurrences[i]);
+    this->record(occurrences[i]);
+  }
+}
+
+// Traverses the whole scene graph.
+void
+SoSearchIndexP::rebuild(void)
+{
+  this->clear();
+  this->kitsearch = SoBaseKit::isSearchingChildren();
+  this->filesearch = SoFile::getSearchOK();
+  const int entry = this->newEntry(this->root, -1, -1);
+  this->entries[entry].order = 0;
+  this->record(entry);
+}
+
+// Records the nodes visited by a search traversal of the subgraph
+// under the node of entry. entry must not have any children.
+void
+SoSearchIndexP::record(const int entry)
+{
+  SoPath * path = this->makePath(entry);
+  path->ref();
+
+  SoSearchIndexRecording recording;
+  recording.thisp = this;
+  recording.subgraph = static_cast<SoFullPath *>(path);
+  recording.depth = recording.subgraph->getLength() - 1;
+  recording.stack.push_back(entry);
+  recording.numnew = 0;
+
+  SoSearchAction sa;
+  sa.setType(SoNode::getClassTypeId());
+  sa.setInterest(SoSearchAction::ALL);
+  sa.setSearchingAll(this->searchall);
+  sa.setPathCallback(SoSearchIndexP::recordPath, &recording);
+  if (recording.depth == 0) sa.apply(this->root);
+  else sa.apply(path);
+  path->unref();
+
+  this->setOrder(entry, recording.numnew);
+}
+
+// Called for each node found by a recording traversal. The found
+// paths come in traversal order, and the entries of the nodes on the
+// path to the current node are kept on a stack, so that each path
+// only adds the nodes below where it branches off from the previous
+// one.
+void
+SoSearchIndexP::recordPath(void * closure, SoPath * path)
+{
+  SoSearchIndexRecording * recording = static_cast<SoSearchIndexRecording *>(closure);
+  SoSearchIndexP * thisp = recording->thisp;
+  const SoFullPath * p = static_cast<const SoFullPath *>(path);
+  const int length = p->getLength();
+  const int depth = recording->depth;
+  if (length <= depth) return;
+
+  // when applied to a path, nodes off the path which affect the state
+  // are visited as well
+  int d;
+  for (d = 1; d <= depth && p->getIndex(d) == recording->subgraph->getIndex(d); d++) { }
+  if (d <= depth) return;
+
+  std::vector<int> & stack = recording->stack;
+  int k = 1;
+  while (k < static_cast<int>(stack.size()) && depth + k < length) {
+    const SoSearchIndexEntry & entry = thisp->entries[stack[k]];
+    if (entry.node != p->getNode(depth + k) ||
+        entry.childindex != p->getIndex(depth + k)) break;
+    k++;
+  }
+  stack.resize(k);
+  for (d = depth + k; d < length; d++) {
+    stack.push_back(thisp->newEntry(p->getNode(d), stack.back(), p->getIndex(d)));
+    recording->numnew++;
+  }
+  thisp->setFound(stack.back());
+}
+
+int
+SoSearchIndexP::newEntry(SoNode * node, const int parent, const int childindex)
+{
+  int idx;
+  if (this->freeentries.empty()) {
+    idx = static_cast<int>(this->entries.size());
+    this->entries.push_back(SoSearchIndexEntry());
+  }
+  else {
+    idx = this->freeentries.back();
+    this->freeentries.pop_back();
+  }
+  SoSearchIndexEntry & entry = this->entries[idx];
+  entry.node = node;
+  entry.typekey = node->getTypeId().getKey();
+  entry.found = FALSE;
+  entry.parent = parent;
+  entry.childindex = childindex;
+  entry.firstchild = entry.lastchild = entry.nextsibling = -1;
+  entry.prevnode = -1;
+  entry.prevtype = entry.nexttype = -1;
+  entry.order = 0;
+
+  if (parent >= 0) {
+    SoSearchIndexEntry & p = this->entries[parent];
+    if (p.lastchild >= 0) this->entries[p.lastchild].nextsibling = idx;
+    else p.firstchild = idx;
+    p.lastchild = idx;
+  }
+
+  int next;
+  if (!this->firstofnode.get(node, next)) next = -1;
+  entry.nextnode = next;
+  if (next >= 0) this->entries[next].prevnode = idx;
+  this->firstofnode.put(node, idx);
+
+  if (this->searchall && parent >= 0 &&
+      SoSearchIndexP::isInactiveChild(this->entries[parent].node, childindex)) {
+    this->watched.put(idx, node->getNodeId());
+  }
+  return idx;
+}
+
+void
+SoSearchIndexP::setFound(const int idx)
+{
+  SoSearchIndexEntry & entry = this->entries[idx];
+  if (entry.found) return;
+  entry.found = TRUE;
+  this->numfound++;
+
+  int next;
+  if (!this->firstoftype.get(entry.typekey, next)) next = -1;
+  entry.nexttype = next;
+  if (next >= 0) this->entries[next].prevtype = idx;
+  this->firstoftype.put(entry.typekey, idx);
+}
+
+// Removes the entries of the subgraph under entry. The nodes of the
+// entries may have been destructed, so they are only used as keys.
+void
+SoSearchIndexP::removeChildren(const int idx)
+{
+  std::vector<int> subgraph;
+  for (int e = this->nextEntry(idx, idx); e >= 0; e = this->nextEntry(e, idx)) {
+    subgraph.push_back(e);
+  }
+  for (size_t i = 0; i < subgraph.size(); i++) {
+    SoSearchIndexEntry & entry = this->entries[subgraph[i]];
+
+    if (entry.prevnode >= 0) this->entries[entry.prevnode].nextnode = entry.nextnode;
+    else if (entry.nextnode >= 0) this->firstofnode.put(entry.node, entry.nextnode);
+    else this->firstofnode.erase(entry.node);
+    if (entry.nextnode >= 0) this->entries[entry.nextnode].prevnode = entry.prevnode;
+
+    if (entry.found) {
+      if (entry.prevtype >= 0) this->entries[entry.prevtype].nexttype = entry.nexttype;
+      else if (entry.nexttype >= 0) this->firstoftype.put(entry.typekey, entry.nexttype);
+      else this->firstoftype.erase(entry.typekey);
+      if (entry.nexttype >= 0) this->entries[entry.nexttype].prevtype = entry.prevtype;
+      this->numfound--;
+    }
+    this->watched.erase(subgraph[i]);
+  }
+  for (size_t i = 0; i < subgraph.size(); i++) {
+    this->entries[subgraph[i]].node = NULL;
+    this->freeentries.push_back(subgraph[i]);
+  }
+  this->entries[idx].firstchild = this->entries[idx].lastchild = -1;
+}
+
+// Returns the entry after entry in traversal order, within the
+// subgraph under subgraph, or -1 at the end.
+int
+SoSearchIndexP::nextEntry(int entry, const int subgraph) const
+{
+  if (this->entries[entry].firstchild >= 0) return this->entries[entry].firstchild;
+  while (entry != subgraph) {
+    const SoSearchIndexEntry & e = this->entries[entry];
+    if (e.nextsibling >= 0) return e.nextsibling;
+    entry = e.parent;
+  }
+  return -1;
+}
+
+// Sets the order of the numnew entries under entry, between the
+// order of entry and the entry after the subgraph. If there is not
+// enough room, the whole index is given new orders.
+void
+SoSearchIndexP::setOrder(const int idx, const int numnew)
+{
+  if (numnew == 0) return;
+  uint64_t end = ~static_cast<uint64_t>(0);
+  for (int e = idx; e >= 0; e = this->entries[e].parent) {
+    const int sibling = this->entries[e].nextsibling;
+    if (sibling >= 0) {
+      end = this->entries[sibling].order;
+      break;
+    }
+  }
+  const uint64_t start = this->entries[idx].order;
+  uint64_t step = (end - start) / static_cast<uint64_t>(numnew + 1);
+  int subgraph = idx;
+  uint64_t order = start;
+  if (step == 0) {
+    subgraph = 0;
+    order = 0;
+    step = static_cast<uint64_t>(1) << 20;
+    this->entries[0].order = 0;
+  }
+  for (int e = this->nextEntry(subgraph, subgraph); e >= 0; e = this->nextEntry(e, subgraph)) {
+    order += step;
+    this->entries[e].order = order;
+  }
+}
+
+// Returns a path from the root to the node of entry.
+SoPath *
+SoSearchIndexP::makePath(const int entry) const
+{
+  SbList<int> indices;
+  for (int i = entry; this->entries[i].parent >= 0; i = this->entries[i].parent) {
+    indices.append(this->entries[i].childindex);
+  }
+  SoPath * path = new SoPath(indices.getLength() + 1);
+  path->setHead(this->root);
+  for (int i = indices.getLength() - 1; i >= 0; i--) path->append(indices[i]);
+  return path;
+}
+
+// Appends the list of entries starting at first, either of the same
+// node or of the same type.
+void
+SoSearchIndexP::addCandidates(const int first, const SbBool isnode,
+                              std::vector<int> & candidates) const
+{
+  for (int i = first; i >= 0;
+       i = isnode ? this->entries[i].nextnode : this->entries[i].nexttype) {
+    candidates.push_back(i);
+  }
+}
+
+// Returns whether the node of entry, or any of its ancestors, is
+// marked as changed.
+SbBool
+SoSearchIndexP::isChanged(int entry) const
+{
+  SbBool dummy;
+  for (; entry >= 0; entry = this->entries[entry].parent) {
+    if (this->changed.get(this->entries[entry].node, dummy)) return TRUE;
+  }
+  return FALSE;
+}
+
+// Returns whether notifications from the child at childindex are
+// ignored by parent, see SoSwitch::notify().
+SbBool
+SoSearchIndexP::isInactiveChild(const SoNode * parent, const int childindex)
+{
+  int which;
+  if (parent->isOfType(SoSwitch::getClassTypeId())) {
+    which = static_cast<const SoSwitch *>(parent)->whichChild.getValue();
+  }
+#ifdef HAVE_VRML97
+  else if (parent->isOfType(SoVRMLSwitch::getClassTypeId())) {
+    which = static_cast<const SoVRMLSwitch *>(parent)->whichChoice.getValue();
+  }
+#endif // HAVE_VRML97
+  else {
+    return FALSE;
+  }
+  return which == -1 || (which >= 0 && which != childindex);
+}
+
+void
+SoSearchIndexP::rootDeletedCB(void * data, SoSensor * COIN_UNUSED_ARG(sensor))
+{
+  SoSearchIndexP * thisp = static_cast<SoSearchIndexP *>(data);
+  thisp->root = NULL;
+  thisp->valid = FALSE;
+  thisp->changed.clear();
+  thisp->clear();
+}
+
+#undef PRIVATE
@@ -50,6 +50,8 @@
 #include "AudioTools.cpp"
 #include "CoinResources.cpp"
 #include "CoinStaticObjectInDLL.cpp"
+#include "SbCoordBounds.cpp"
+#include "SbDepthSorter.cpp"
 #include "SoAudioDevice.cpp"
 #include "SoBaseP.cpp"
 #include "SoChildList.cpp"
@@ -77,6 +79,7 @@
 #include "SoProtoInstance.cpp"
 #include "SoSceneManager.cpp"
 #include "SoSceneManagerP.cpp"
+#include "SoSearchIndex.cpp"
 #include "SoShaderGenerator.cpp"
 #include "SoState.cpp"
 #include "SoTempPath.cpp"
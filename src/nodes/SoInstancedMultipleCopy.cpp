@@ -0,0 +1,488 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*!
+  \class SoInstancedMultipleCopy SoInstancedMultipleCopy.h Inventor/nodes/SoInstancedMultipleCopy.h
+  \brief The SoInstancedMultipleCopy class renders many copies of its children with instancing.
+
+  \ingroup nodes
+
+  Like SoMultipleCopy, this node traverses its children once for each
+  matrix in SoMultipleCopy::matrix. In addition, the SoInstancedMultipleCopy::color
+  field can give each copy its own diffuse color.
+
+  SoMultipleCopy renders by traversing the children once per copy,
+  which makes the traversal overhead dominate when there are many
+  copies of a small subgraph. This node instead generates the
+  triangles of its children once, and keeps them in a vertex array.
+  When the OpenGL driver supports instanced arrays and GLSL, all the
+  copies are then rendered with one instanced draw call, with the
+  matrices and colors as per-instance attributes. Otherwise the
+  copies are rendered in a tight loop, with one matrix multiplication
+  and one draw call per copy. The vertex array is kept until the
+  children change. Changing the \e matrix or \e color fields only
+  updates the per-instance data.
+
+  Instancing is only used for opaque, untextured triangle geometry,
+  and only the diffuse color of materials below the node is stored
+  per vertex. When the children contain lines, points, textures,
+  transparency, lights, cameras, shader programs, callbacks or nodes
+  that depend on the position of the copy (like level of detail
+  nodes), the node falls back to traversing its children once per
+  copy, like SoMultipleCopy.
+
+  Actions other than SoGLRenderAction, like SoRayPickAction and
+  SoGetBoundingBoxAction, always traverse the children once per copy,
+  so that picked points and bounding boxes are those of the individual
+  copies.
+
+  <b>FILE FORMAT/DEFAULTS:</b>
+  \code
+    InstancedMultipleCopy {
+        matrix 1 0 0 0
+        0 1 0 0
+        0 0 1 0
+        0 0 0 1
+        color [  ]
+    }
+  \endcode
+
+  \sa SoMultipleCopy
+  \COIN_CLASS_EXTENSION
+  \since Coin 4.1
+*/
+
+// *************************************************************************
+
+#include <Inventor/nodes/SoInstancedMultipleCopy.h>
+
+#include <Inventor/actions/SoCallbackAction.h>
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/actions/SoGetPrimitiveCountAction.h>
+#include <Inventor/actions/SoPickAction.h>
+#include <Inventor/elements/SoCacheElement.h>
+#include <Inventor/elements/SoGLLazyElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoSwitchElement.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/misc/SoChildList.h>
+#include <Inventor/misc/SoNotification.h>
+#include <Inventor/misc/SoState.h>
+#include <Inventor/nodes/SoAnnotation.h>
+#include <Inventor/nodes/SoCallback.h>
+#include <Inventor/nodes/SoCamera.h>
+#include <Inventor/nodes/SoImage.h>
+#include <Inventor/nodes/SoLOD.h>
+#include <Inventor/nodes/SoLevelOfDetail.h>
+#include <Inventor/nodes/SoLight.h>
+#include <Inventor/nodes/SoShaderProgram.h>
+#include <Inventor/nodes/SoSwitch.h>
+#include <Inventor/nodes/SoText2.h>
+#include <Inventor/threads/SbMutex.h>
+#include <Inventor/VRMLnodes/SoVRMLBillboard.h>
+#include <Inventor/VRMLnodes/SoVRMLLOD.h>
+
+#include "nodes/SoSubNodeP.h"
+#include "caches/SoInstanceCache.h"
+
+// *************************************************************************
+
+/*!
+  \var SoMFColor SoInstancedMultipleCopy::color
+
+  The diffuse color of each copy. The color replaces the diffuse
+  color the children inherit, while children with their own materials
+  keep their colors. Copies with no corresponding color use the last
+  color. When empty (the default), all copies use the inherited
+  color.
+*/
+
+// *************************************************************************
+
+class SoInstancedMultipleCopyP {
+public:
+  SoInstancedMultipleCopyP(SoInstancedMultipleCopy * master)
+    : master(master),
+      cache(NULL),
+      instancedataid(0)
+  { }
+
+  SoInstancedMultipleCopy * master;
+  SoInstanceCache * cache;
+  // the colors of each copy, and the colors packed for SoLazyElement
+  SbList<SbColor> instancecolors;
+  SbList<uint32_t> packedcolors;
+  SbUniqueId instancedataid;
+  SbMutex mutex;
+
+  void updateInstanceData(void);
+  void setColor(SoState * state, const int idx);
+  void buildCache(SoGLRenderAction * action);
+  SbBool renderInstanced(SoGLRenderAction * action);
+
+  static SbBool isCapturable(SoNode * node);
+};
+
+#define PRIVATE(obj) ((obj)->pimpl)
+#define PUBLIC(obj) ((obj)->master)
+
+// *************************************************************************
+
+SO_NODE_SOURCE(SoInstancedMultipleCopy);
+
+/*!
+  Constructor.
+*/
+SoInstancedMultipleCopy::SoInstancedMultipleCopy(void)
+{
+  PRIVATE(this) = new SoInstancedMultipleCopyP(this);
+
+  SO_NODE_INTERNAL_CONSTRUCTOR(SoInstancedMultipleCopy);
+
+  SO_NODE_ADD_FIELD(color, (SbColor(0.8f, 0.8f, 0.8f)));
+  this->color.setNum(0);
+  this->color.setDefault(TRUE);
+}
+
+/*!
+  Destructor.
+*/
+SoInstancedMultipleCopy::~SoInstancedMultipleCopy()
+{
+  if (PRIVATE(this)->cache) PRIVATE(this)->cache->unref();
+  delete PRIVATE(this);
+}
+
+// Doc in superclass.
+/*!
+  \copybrief SoBase::initClass(void)
+*/
+void
+SoInstancedMultipleCopy::initClass(void)
+{
+  SO_NODE_INTERNAL_INIT_CLASS(SoInstancedMultipleCopy, SO_FROM_COIN_4_0);
+}
+
+// Doc in superclass.
+void
+SoInstancedMultipleCopy::doAction(SoAction * action)
+{
+  SoState * state = action->getState();
+  PRIVATE(this)->mutex.lock();
+  PRIVATE(this)->updateInstanceData();
+  PRIVATE(this)->mutex.unlock();
+  const SbBool hascolors = PRIVATE(this)->packedcolors.getLength() > 0;
+  const SbBool isgl = action->isOfType(SoGLRenderAction::getClassTypeId());
+
+  for (int i = 0; i < this->matrix.getNum(); i++) {
+    state->push();
+    SoSwitchElement::set(state, i);
+    SoModelMatrixElement::mult(state, this, this->matrix[i]);
+    PRIVATE(this)->setColor(state, i);
+    SoGroup::doAction(action);
+    state->pop();
+    if (hascolors && isgl) {
+      // the colors of all copies have the same node id, so make sure
+      // the next one is sent to GL
+      SoGLLazyElement::getInstance(state)->reset(state, SoLazyElement::DIFFUSE_MASK);
+    }
+  }
+}
+
+// Doc in superclass.
+void
+SoInstancedMultipleCopy::callback(SoCallbackAction * action)
+{
+  SoInstancedMultipleCopy::doAction(action);
+}
+
+// Doc in superclass.
+void
+SoInstancedMultipleCopy::GLRender(SoGLRenderAction * action)
+{
+  int numindices;
+  const int * indices;
+  // traverse the copies if an enclosing instancing node is capturing
+  // geometry, or if only a path below the node is rendered
+  if (soshape_instance_capture() ||
+      (action->getPathCode(numindices, indices) == SoAction::IN_PATH) ||
+      !PRIVATE(this)->renderInstanced(action)) {
+    SoInstancedMultipleCopy::doAction(action);
+  }
+}
+
+// Doc in superclass.
+void
+SoInstancedMultipleCopy::pick(SoPickAction * action)
+{
+  SoInstancedMultipleCopy::doAction(action);
+}
+
+// Doc in superclass.
+void
+SoInstancedMultipleCopy::getPrimitiveCount(SoGetPrimitiveCountAction * action)
+{
+  SoInstancedMultipleCopy::doAction(action);
+}
+
+// Doc in superclass.
+void
+SoInstancedMultipleCopy::notify(SoNotList * nl)
+{
+  inherited::notify(nl);
+
+  // changes to the matrices and colors are picked up from the node
+  // id, while other changes mean that the geometry must be captured
+  // again
+  const SoField * f = nl->getLastField();
+  if (f != &this->matrix && f != &this->color) {
+    PRIVATE(this)->mutex.lock();
+    if (PRIVATE(this)->cache) PRIVATE(this)->cache->invalidate();
+    PRIVATE(this)->mutex.unlock();
+  }
+}
+
+#undef PUBLIC
+#undef PRIVATE
+
+// *************************************************************************
+
+#define PUBLIC(obj) ((obj)->master)
+
+// Updates the colors when the node has changed. Must be called with
+// the mutex locked.
+void
+SoInstancedMultipleCopyP::updateInstanceData(void)
+{
+  const SbUniqueId id = PUBLIC(this)->getNodeId();
+  if (id == this->instancedataid) return;
+  this->instancedataid = id;
+
+  const int numcolors = PUBLIC(this)->color.getNum();
+  const int numcopies = PUBLIC(this)->matrix.getNum();
+  this->instancecolors.truncate(0);
+  this->packedcolors.truncate(0);
+  if (numcolors == 0) return;
+
+  const SbColor * colors = PUBLIC(this)->color.getValues(0);
+  for (int i = 0; i < numcolors; i++) {
+    this->packedcolors.append(colors[i].getPackedValue(0.0f));
+  }
+  for (int i = 0; i < numcopies; i++) {
+    this->instancecolors.append(colors[SbMin(i, numcolors-1)]);
+  }
+}
+
+void
+SoInstancedMultipleCopyP::setColor(SoState * state, const int idx)
+{
+  const int numcolors = this->packedcolors.getLength();
+  if (numcolors == 0) return;
+  // packed colors are used since each copy has a different color,
+  // but the same node id. They don't need an SoColorPacker.
+  SoLazyElement::setPacked(state, PUBLIC(this), 1,
+                           this->packedcolors.getArrayPtr() + SbMin(idx, numcolors-1),
+                           FALSE);
+}
+
+// Returns FALSE if the subgraph has nodes that don't give the same
+// result for all copies when they are captured once.
+SbBool
+SoInstancedMultipleCopyP::isCapturable(SoNode * node)
+{
+  if (node->isOfType(SoCallback::getClassTypeId()) ||
+      node->isOfType(SoAnnotation::getClassTypeId()) ||
+      node->isOfType(SoText2::getClassTypeId()) ||
+      node->isOfType(SoImage::getClassTypeId()) ||
+      node->isOfType(SoLOD::getClassTypeId()) ||
+      node->isOfType(SoLevelOfDetail::getClassTypeId()) ||
+      node->isOfType(SoLight::getClassTypeId()) ||
+      node->isOfType(SoCamera::getClassTypeId()) ||
+      node->isOfType(SoShaderProgram::getClassTypeId()) ||
+      node->isOfType(SoVRMLLOD::getClassTypeId()) ||
+      node->isOfType(SoVRMLBillboard::getClassTypeId())) {
+    return FALSE;
+  }
+  if (node->isOfType(SoSwitch::getClassTypeId()) &&
+      static_cast<SoSwitch *>(node)->whichChild.getValue() == SO_SWITCH_INHERIT) {
+    return FALSE;
+  }
+  SoChildList * children = node->getChildren();
+  if (children) {
+    for (int i = 0; i < children->getLength(); i++) {
+      if (!isCapturable((*children)[i])) return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Captures the triangles of the children into a new instance cache.
+// Must be called with the mutex locked.
+void
+SoInstancedMultipleCopyP::buildCache(SoGLRenderAction * action)
+{
+  SoState * state = action->getState();
+  SbBool storedinvalid = SoCacheElement::setInvalid(FALSE);
+  // must push state to make cache dependencies work
+  state->push();
+  this->cache = new SoInstanceCache(state);
+  this->cache->ref();
+  SoCacheElement::set(state, this->cache);
+
+  if (isCapturable(PUBLIC(this))) {
+    SoSwitchElement::set(state, 0);
+    this->setColor(state, 0);
+    this->cache->beginCapture(state);
+    PUBLIC(this)->SoGroup::doAction(action);
+  }
+  else {
+    this->cache->abortCapture();
+  }
+  state->pop();
+  // something below the node can't be cached
+  if (SoCacheElement::setInvalid(storedinvalid)) this->cache->abortCapture();
+  this->cache->endCapture();
+}
+
+// Renders all copies from the instance cache. Returns FALSE if the
+// copies must be rendered by traversing the children instead.
+SbBool
+SoInstancedMultipleCopyP::renderInstanced(SoGLRenderAction * action)
+{
+  SoState * state = action->getState();
+
+  this->mutex.lock();
+  this->updateInstanceData();
+  if (this->cache && !this->cache->isValid(state)) {
+    this->cache->unref();
+    this->cache = NULL;
+  }
+  if (this->cache == NULL) this->buildCache(action);
+  SoInstanceCache * rendercache = NULL;
+  if (this->cache->isRenderable()) {
+    rendercache = this->cache;
+    rendercache->ref();
+  }
+  this->mutex.unlock();
+  if (rendercache == NULL) return FALSE;
+
+  SbBool ok = TRUE;
+  // the cache only holds opaque geometry
+  if (!action->handleTransparency(FALSE)) {
+    // instanced draws with vertex buffers and shaders can't be put
+    // in render caches
+    SoCacheElement::invalidate(state);
+    ok = rendercache->render(action,
+                             PUBLIC(this)->matrix.getValues(0),
+                             this->instancecolors.getLength() ?
+                             this->instancecolors.getArrayPtr() : NULL,
+                             PUBLIC(this)->matrix.getNum(),
+                             this->instancedataid);
+  }
+  rendercache->unref();
+  return ok;
+}
+
+#undef PUBLIC
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/SoPickedPoint.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/actions/SoRayPickAction.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoSeparator.h>
+
+static SoInstancedMultipleCopy *
+soinstanced_test_copies(void)
+{
+  SoInstancedMultipleCopy * copies = new SoInstancedMultipleCopy;
+  SbMatrix m;
+  m.setTranslate(SbVec3f(-5.0f, 0.0f, 0.0f));
+  copies->matrix.set1Value(0, m);
+  m.setTranslate(SbVec3f(5.0f, 0.0f, 0.0f));
+  copies->matrix.set1Value(1, m);
+  copies->color.set1Value(0, SbColor(1.0f, 0.0f, 0.0f));
+  copies->addChild(new SoCube);
+  return copies;
+}
+
+BOOST_AUTO_TEST_CASE(initialized)
+{
+  SoInstancedMultipleCopy * node = new SoInstancedMultipleCopy;
+  assert(node);
+  node->ref();
+  BOOST_CHECK_MESSAGE(node->getTypeId() != SoType::badType(),
+                      "missing class initialization");
+  node->unref();
+}
+
+BOOST_AUTO_TEST_CASE(boundingBox)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  root->addChild(soinstanced_test_copies());
+
+  SoGetBoundingBoxAction bboxaction(SbViewportRegion(100, 100));
+  bboxaction.apply(root);
+  const SbBox3f box = bboxaction.getBoundingBox();
+  BOOST_CHECK_MESSAGE(box.getMin() == SbVec3f(-6.0f, -1.0f, -1.0f) &&
+                      box.getMax() == SbVec3f(6.0f, 1.0f, 1.0f),
+                      "bounding box should enclose both copies");
+  root->unref();
+}
+
+BOOST_AUTO_TEST_CASE(rayPick)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  root->addChild(soinstanced_test_copies());
+
+  SoRayPickAction ra(SbViewportRegion(100, 100));
+  ra.setRay(SbVec3f(5.5f, 0.5f, 10.0f), SbVec3f(0.0f, 0.0f, -1.0f));
+  ra.apply(root);
+  const SoPickedPoint * pp = ra.getPickedPoint();
+  BOOST_REQUIRE_MESSAGE(pp != NULL, "the second copy should be picked");
+  BOOST_CHECK_MESSAGE((pp->getPoint() - SbVec3f(5.5f, 0.5f, 1.0f)).length() < 1e-5f,
+                      "wrong world space point");
+  BOOST_CHECK_MESSAGE((pp->getObjectPoint() - SbVec3f(0.5f, 0.5f, 1.0f)).length() < 1e-5f,
+                      "object space point should be relative to the copy");
+
+  ra.setRay(SbVec3f(0.0f, 0.0f, 10.0f), SbVec3f(0.0f, 0.0f, -1.0f));
+  ra.apply(root);
+  BOOST_CHECK_MESSAGE(ra.getPickedPoint() == NULL,
+                      "nothing between the copies should be picked");
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
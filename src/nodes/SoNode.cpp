@@ -450,6 +450,10 @@ SoNode::~SoNode()
   fields within this node (and ditto for any children and children's
   children etc.).
 
+  The copies of multiple-value fields can share the values of the
+  original fields until they are changed, see
+  SoFieldContainer::setCopySharesValues().
+
 
   Note that this function has been made virtual in Coin, which is not
   the case in the original Open Inventor API. We may change this
@@ -735,6 +739,8 @@ SoNode::initClasses(void)
 
   SoDepthBuffer::initClass();
   SoAlphaTest::initClass();
+  SoInstancedMultipleCopy::initClass();
+  SoLODIndexedFaceSet::initClass();
 }
 
 /*!
@@ -93,9 +93,11 @@
 #endif // COIN_THREADSAFE
 
 #include "coindefs.h" // COIN_OBSOLETED()
+#include "actions/SoGetBoundingBoxActionP.h"
 #include "nodes/SoSubNodeP.h"
 #include "glue/glp.h"
 #include "rendering/SoGL.h"
+#include "rendering/SoOcclusionCuller.h"
 #include "misc/SoDBP.h"
 
 #include <Inventor/annex/Profiler/SoProfiler.h>
@@ -355,6 +357,7 @@ public:
 
   static SbBool doCull(SoSeparatorP * thisp, SoState * state,
                        SbBool (* cullfunc)(SoState *, const SbBox3f &, const SbBool));
+  SbBool occlusionCull(SoOcclusionCuller * culler, SoState * state);
 };
 
 #define PRIVATE(obj) ((obj)->pimpl)
@@ -549,6 +552,9 @@ SoSeparator::getBoundingBox(SoGetBoundingBoxAction * action)
     }
 
     if (iscaching) {
+      // compute the boxes of the child subgraphs in parallel first,
+      // if the action uses several threads
+      SoGetBoundingBoxActionP::computeSubgraphs(action, this);
       storedinvalid = SoCacheElement::setInvalid(FALSE);
     }
     state->push();
@@ -656,14 +662,18 @@ SoSeparator::GLRenderBelowPath(SoGLRenderAction * action)
   state->push();
   SbBool didcull = FALSE;
 
+  // a render cache would store the occlusion culling done below us,
+  // so only cache when explicitly asked to while it's active
+  SoOcclusionCuller * culler = sogl_occlusion_culler(action);
   SoGLCacheList * createcache = NULL;
   if ((this->renderCaching.getValue() != OFF) &&
-      (SoSeparator::getNumRenderCaches() > 0)) {
+      (SoSeparator::getNumRenderCaches() > 0) &&
+      !(culler && this->renderCaching.getValue() == AUTO)) {
 
-    // test if bbox is outside view-volume
+    // test if bbox is outside view-volume or hidden
     if (!state->isCacheOpen()) {
       didcull = TRUE;
-      if (this->cullTest(state)) {
+      if (this->cullTest(state) || PRIVATE(this)->occlusionCull(culler, state)) {
         state->pop();
         return;
       }
@@ -703,7 +713,7 @@ SoSeparator::GLRenderBelowPath(SoGLRenderAction * action)
 
   SbBool outsidefrustum =
     (createcache || state->isCacheOpen() || didcull) ?
-    FALSE : this->cullTest(state);
+    FALSE : (this->cullTest(state) || PRIVATE(this)->occlusionCull(culler, state));
   if (createcache || !outsidefrustum) {
     int n = this->children->getLength();
     SoNode ** childarray = (n!=0)? reinterpret_cast<SoNode**>(this->children->getArrayPtr()) : NULL;
@@ -927,6 +937,26 @@ SoSeparator::getNumRenderCaches(void)
   return SoSeparator::numrendercaches;
 }
 
+/*!
+  Returns the render cache list of this node for the current thread,
+  or \c NULL if the node hasn't been rendered with render caching
+  enabled yet. The list can be used to find out how well render
+  caching works for the node, e.g. how often the caches are
+  invalidated and why.
+
+  \sa SoGLCacheList::getNumHits(), SoGLCacheList::getInvalidationCauses()
+  \since Coin 4.1
+*/
+SoGLCacheList *
+SoSeparator::getGLCacheList(void) const
+{
+  SoSeparatorP & thisp = PRIVATE(this).get();
+  thisp.lock();
+  SoGLCacheList * glcachelist = thisp.getGLCacheList(FALSE);
+  thisp.unlock();
+  return glcachelist;
+}
+
 // Doc from superclass.
 SbBool
 SoSeparator::affectsState(void) const
@@ -1011,6 +1041,20 @@ SoSeparatorP::doCull(SoSeparatorP * thisp, SoState * state,
   return outside;
 }
 
+// Returns TRUE if the separator's bounding box is hidden behind
+// geometry rendered earlier, according to culler.
+SbBool
+SoSeparatorP::occlusionCull(SoOcclusionCuller * culler, SoState * state)
+{
+  if (culler == NULL) return FALSE;
+  if (PUBLIC(this)->renderCulling.getValue() == SoSeparator::OFF) return FALSE;
+  if (this->bboxcache == NULL || !this->bboxcache->isValid(state)) return FALSE;
+
+  const SbBox3f & bbox = this->bboxcache->getProjectedBox();
+  if (bbox.isEmpty()) return FALSE;
+  return culler->isOccluded(state, PUBLIC(this), bbox);
+}
+
 /*!
   Internal method which do view frustum culling. For now, view frustum
   culling is performed if the renderCulling field is \c AUTO or \c ON,
@@ -59,6 +59,7 @@
 #include "SoFrustumCamera.cpp"
 #include "SoGroup.cpp"
 #include "SoInfo.cpp"
+#include "SoInstancedMultipleCopy.cpp"
 #include "SoLOD.cpp"
 #include "SoLabel.cpp"
 #include "SoLevelOfDetail.cpp"
@@ -151,6 +151,9 @@ public:
   std::map<SbProfilingNodeTypeKey, SbTypeProfilingData> nodeTypeData;
   std::map<SbProfilingNodeNameKey, SbNameProfilingData> nodeNameData;
 
+  // keyed on SbName strings
+  std::map<const char *, SbTime> phaseData;
+
 }; // SbProfilingDataP
 
 #define PRIVATE(obj) ((obj)->pimpl)
@@ -217,6 +220,7 @@ SbProfilingData::reset(void)
   PRIVATE(this)->nodeData.clear();
   PRIVATE(this)->nodeTypeData.clear();
   PRIVATE(this)->nodeNameData.clear();
+  PRIVATE(this)->phaseData.clear();
   assert(PRIVATE(this)->nodeData.size() == 0);
   assert(PRIVATE(this)->nodeTypeData.size() == 0);
   assert(PRIVATE(this)->nodeNameData.size() == 0);
@@ -236,6 +240,7 @@ SbProfilingData::operator = (const SbProfilingData & rhs)
   PRIVATE(this)->nodeData = PRIVATE(&rhs)->nodeData;
   PRIVATE(this)->nodeTypeData = PRIVATE(&rhs)->nodeTypeData;
   PRIVATE(this)->nodeNameData = PRIVATE(&rhs)->nodeNameData;
+  PRIVATE(this)->phaseData = PRIVATE(&rhs)->phaseData;
   assert(PRIVATE(this)->nodeData.size() == PRIVATE(&rhs)->nodeData.size());
   return *this;
 }
@@ -398,6 +403,13 @@ SbProfilingData::operator += (const SbProfilingData & rhs)
     }
   }
 
+  { // phaseData
+    std::map<const char *, SbTime>::const_iterator it = PRIVATE(&rhs)->phaseData.begin();
+    for (; it != PRIVATE(&rhs)->phaseData.end(); ++it) {
+      this->addPhaseTiming(it->first, it->second);
+    }
+  }
+
   assert(PRIVATE(this)->nodeData.size() >= PRIVATE(&rhs)->nodeData.size());
   assert(PRIVATE(this)->nodeTypeData.size() >= PRIVATE(&rhs)->nodeTypeData.size());
   assert(PRIVATE(this)->nodeNameData.size() >= PRIVATE(&rhs)->nodeNameData.size());
@@ -480,6 +492,55 @@ SbProfilingData::getActionDuration(void) const
   return (this->actionStopTime - this->actionStartTime);
 }
 
+/*!
+  Adds \a timing to the time spent in the named \a phase of the
+  action. Phases are parts of the traversal that are not attributed
+  to a single node, like the setup and sorting of delayed transparent
+  paths in SoGLRenderAction.
+
+  Phase timings may overlap the node timings.
+*/
+
+void
+SbProfilingData::addPhaseTiming(const char * phase, SbTime timing)
+{
+  const char * key = SbName(phase).getString();
+  std::map<const char *, SbTime>::iterator it = PRIVATE(this)->phaseData.find(key);
+  if (it != PRIVATE(this)->phaseData.end()) {
+    it->second += timing;
+  } else {
+    PRIVATE(this)->phaseData.insert(std::pair<const char *, SbTime>(key, timing));
+  }
+}
+
+/*!
+  Returns the accumulated time spent in the named \a phase, or zero
+  if no timing has been registered for it.
+*/
+
+SbTime
+SbProfilingData::getPhaseTiming(const char * phase) const
+{
+  std::map<const char *, SbTime>::const_iterator it =
+    PRIVATE(this)->phaseData.find(SbName(phase).getString());
+  if (it == PRIVATE(this)->phaseData.end()) return SbTime::zero();
+  return it->second;
+}
+
+/*!
+  Fills in \a keys_out with the names of all the phases that have
+  registered timings.
+*/
+
+void
+SbProfilingData::getPhaseKeyList(SbList<const char *> & keys_out) const
+{
+  std::map<const char *, SbTime>::const_iterator it = PRIVATE(this)->phaseData.begin();
+  for (; it != PRIVATE(this)->phaseData.end(); ++it) {
+    keys_out.append(it->first);
+  }
+}
+
 // *************************************************************************
 
 /*
@@ -583,6 +583,16 @@ SoProfilerP::dumpToConsole(const SbProfilingData & data)
                                        callback,
                                        NULL);
 
+  // phases of the action that are not attributed to single nodes
+  SbList<const char *> phases;
+  data.getPhaseKeyList(phases);
+  for (int i = 0; i < phases.getLength(); ++i) {
+    SbString text;
+    text.sprintf("%s: %.3f ms", phases[i],
+                 data.getPhaseTiming(phases[i]).getValue() * 1000.0);
+    callback(NULL, -1, text.getString());
+  }
+
   SoProfilingReportGenerator::freeCriteria(sortsettings);
   SoProfilingReportGenerator::freeCriteria(printsettings);
 }
@@ -2401,6 +2401,10 @@ sogl_autocache_update(SoState * state, const int numprimitives, SbBool didusevbo
     SoGLCacheContextElement::shouldAutoCache(state, SoGLCacheContextElement::DONT_AUTO_CACHE);
   }
   SoGLCacheContextElement::incNumShapes(state);
+  // vertex data in a VBO isn't copied into a render cache
+  if (!didusevbo && state->isCacheOpen()) {
+    sogl_autocache_add_primitives(numprimitives);
+  }
 
   if (didusevbo) {
     // avoid creating caches when rendering large VBOs
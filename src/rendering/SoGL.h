@@ -173,5 +173,7 @@ SbBool sogl_glerror_debugging(void);
 
 void sogl_autocache_update(SoState * state, const int numprimitives, 
                            SbBool didusevbo);
+void sogl_autocache_add_primitives(const int numprimitives);
+uint32_t sogl_autocache_get_num_primitives(void);
 
 #endif // !COIN_SOGL_H
@@ -0,0 +1,821 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*!
+  \class SoOcclusionCuller
+  \brief The SoOcclusionCuller class decides which separators are hidden behind other geometry.
+
+  An instance is owned by each SoGLRenderAction. SoSeparator asks it
+  whether the bounding box cache of the separator is occluded before
+  the children are traversed, and skips the subtree if it is.
+
+  In SoGLRenderAction::OCCLUSION_CULLING_SOFTWARE mode, the opaque
+  shapes that cover a large enough part of the screen are rasterized
+  into a small depth buffer in main memory when they are rendered. A
+  separator is occluded when every buffer pixel its bounding box
+  covers holds a depth in front of the box. The buffer is cleared at
+  the start of each rendering pass, so only geometry rendered earlier
+  in the same pass acts as occluders.
+
+  In SoGLRenderAction::OCCLUSION_CULLING_HARDWARE mode, the bounding
+  box of the separator is drawn with an OpenGL occlusion query, with
+  color and depth writes disabled. The result is not read back until
+  the separator is traversed in a later frame, so there are no
+  pipeline stalls. Separators that were occluded are skipped until a
+  query shows them as visible again, while visible separators are
+  only queried every few frames.
+*/
+
+#include "rendering/SoOcclusionCuller.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cassert>
+
+#include <Inventor/elements/SoDepthBufferElement.h>
+#include <Inventor/elements/SoDrawStyleElement.h>
+#include <Inventor/elements/SoGLCacheContextElement.h>
+#include <Inventor/elements/SoGLShaderProgramElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoProjectionMatrixElement.h>
+#include <Inventor/elements/SoViewingMatrixElement.h>
+#include <Inventor/elements/SoViewportRegionElement.h>
+#include <Inventor/misc/SoContextHandler.h>
+#include <Inventor/misc/SoState.h>
+#include <Inventor/nodes/SoNode.h>
+
+#include "rendering/SoGL.h"
+#include "glue/glp.h"
+
+// width of the software depth buffer. The height follows the aspect
+// ratio of the viewport.
+static const int SOOCCLUSION_BUFFER_WIDTH = 256;
+// the buffer is split into square tiles, with the farthest depth of
+// each tile kept to reject boxes quickly
+static const int SOOCCLUSION_TILE_SIZE = 8;
+// shapes must cover at least this part of the buffer to be used as
+// occluders
+static const float SOOCCLUSION_MIN_OCCLUDER_AREA = 0.005f;
+// shapes with more triangles are not rasterized again until they change
+static const int SOOCCLUSION_MAX_OCCLUDER_TRIANGLES = 20000;
+// how often separators that were visible are queried again
+static const uint32_t SOOCCLUSION_VISIBLE_QUERY_INTERVAL = 4;
+// queries for separators that haven't been traversed for this many
+// frames are deleted
+static const uint32_t SOOCCLUSION_QUERY_MAX_AGE = 64;
+// vertices closer to the eye plane than this (in clip coordinates)
+// are treated as if they are behind the camera
+static const float SOOCCLUSION_MIN_W = 1e-5f;
+
+// *************************************************************************
+
+SoOcclusionCuller::SoOcclusionCuller(void)
+  : type(SoGLRenderAction::OCCLUSION_CULLING_NONE),
+    frame(0),
+    numtested(0),
+    numculled(0),
+    numoccluders(0),
+    numqueries(0),
+    bufferready(FALSE),
+    width(0),
+    height(0),
+    tilesx(0),
+    tilesy(0),
+    occluder(NULL),
+    occludertriangles(0),
+    querycontext(0),
+    hasquerycontext(FALSE)
+{
+  SoContextHandler::addContextDestructionCallback(context_destruction_cb, this);
+}
+
+SoOcclusionCuller::~SoOcclusionCuller()
+{
+  SoContextHandler::removeContextDestructionCallback(context_destruction_cb, this);
+  this->releaseQueries();
+}
+
+void
+SoOcclusionCuller::setType(const SoGLRenderAction::OcclusionCullingType typearg)
+{
+  if (typearg != this->type) {
+    if (this->type == SoGLRenderAction::OCCLUSION_CULLING_HARDWARE) {
+      this->releaseQueries();
+    }
+    this->type = typearg;
+    this->bufferready = FALSE;
+  }
+}
+
+SoGLRenderAction::OcclusionCullingType
+SoOcclusionCuller::getType(void) const
+{
+  return this->type;
+}
+
+// Called at the start of each SoGLRenderAction::apply(). Resets the
+// statistics.
+void
+SoOcclusionCuller::beginFrame(void)
+{
+  this->frame++;
+  this->numtested = 0;
+  this->numculled = 0;
+  this->numoccluders = 0;
+  this->numqueries = 0;
+  // forget about shapes that were too heavy now and then, in case
+  // the nodes have been deleted and the pointers reused
+  if ((this->frame & 1023) == 0) this->heavyoccluders.clear();
+}
+
+// Called at the start of each rendering pass, when the GL depth
+// buffer has been cleared.
+void
+SoOcclusionCuller::beginPass(void)
+{
+  this->bufferready = FALSE;
+}
+
+/*!
+  Returns \c TRUE if \a box, in the current object space, is hidden
+  behind geometry rendered earlier. \a node is the separator the box
+  belongs to.
+*/
+SbBool
+SoOcclusionCuller::isOccluded(SoState * state, const SoNode * node, const SbBox3f & box)
+{
+  // geometry rendered without depth testing is never occluded
+  if (!SoDepthBufferElement::getTestEnable(state)) return FALSE;
+
+  switch (this->type) {
+  case SoGLRenderAction::OCCLUSION_CULLING_SOFTWARE:
+    {
+      this->updateViewProjection(state);
+      SbVec4f corners[8];
+      if (!this->projectBox(state, box, corners)) return FALSE;
+      this->numtested++;
+      if (this->isOccludedSoftware(corners)) {
+        this->numculled++;
+        return TRUE;
+      }
+      return FALSE;
+    }
+  case SoGLRenderAction::OCCLUSION_CULLING_HARDWARE:
+    return this->isOccludedHardware(state, node, box);
+  default:
+    return FALSE;
+  }
+}
+
+/*!
+  Starts rasterizing the opaque shape \a node into the software depth
+  buffer, if it is a good occluder. \a box is the bounding box of the
+  shape. Returns \c FALSE if the shape shouldn't be rasterized, in
+  which case addTriangle() and endOccluder() should not be called.
+*/
+SbBool
+SoOcclusionCuller::beginOccluder(SoState * state, const SoNode * node, const SbBox3f & box)
+{
+  if (this->type != SoGLRenderAction::OCCLUSION_CULLING_SOFTWARE) return FALSE;
+  if (box.isEmpty()) return FALSE;
+  if (!SoDepthBufferElement::getTestEnable(state) ||
+      !SoDepthBufferElement::getWriteEnable(state)) return FALSE;
+  if (SoDrawStyleElement::get(state) != SoDrawStyleElement::FILLED) return FALSE;
+
+  SbUniqueId heavyid;
+  if (this->heavyoccluders.get(node, heavyid)) {
+    if (heavyid == node->getNodeId()) return FALSE;
+    this->heavyoccluders.erase(node);
+  }
+
+  this->updateViewProjection(state);
+
+  SbVec4f corners[8];
+  // shapes crossing the near plane are always tried, as they are
+  // likely to cover much of the screen. Their triangles are
+  // tested one by one in addTriangle().
+  if (this->projectBox(state, box, corners)) {
+    float minx = FLT_MAX, maxx = -FLT_MAX, miny = FLT_MAX, maxy = -FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+      const float x = corners[i][0] / corners[i][3];
+      const float y = corners[i][1] / corners[i][3];
+      if (x < minx) minx = x;
+      if (x > maxx) maxx = x;
+      if (y < miny) miny = y;
+      if (y > maxy) maxy = y;
+    }
+    if (minx < -1.0f) minx = -1.0f;
+    if (maxx > 1.0f) maxx = 1.0f;
+    if (miny < -1.0f) miny = -1.0f;
+    if (maxy > 1.0f) maxy = 1.0f;
+    // the size of the screen in normalized device coordinates is 2x2
+    if (minx >= maxx || miny >= maxy ||
+        (maxx - minx) * (maxy - miny) < 4.0f * SOOCCLUSION_MIN_OCCLUDER_AREA) {
+      return FALSE;
+    }
+  }
+
+  this->occludermatrix = SoModelMatrixElement::get(state) * this->viewprojection;
+  this->occluder = node;
+  this->occludertriangles = 0;
+  this->numoccluders++;
+  return TRUE;
+}
+
+/*!
+  Rasterizes a triangle of the current occluder, in object space, into
+  the software depth buffer. Each covered pixel gets the farthest
+  depth the triangle has within the pixel, so that boxes are only
+  culled when they are behind the occluder over the whole pixel.
+*/
+void
+SoOcclusionCuller::addTriangle(const SbVec3f & v0, const SbVec3f & v1, const SbVec3f & v2)
+{
+  assert(this->occluder);
+  if (++this->occludertriangles > SOOCCLUSION_MAX_OCCLUDER_TRIANGLES) return;
+
+  const SbVec3f * v[3] = { &v0, &v1, &v2 };
+  float sx[3], sy[3], sz[3];
+  for (int i = 0; i < 3; i++) {
+    SbVec4f c;
+    this->occludermatrix.multVecMatrix(SbVec4f((*v[i])[0], (*v[i])[1], (*v[i])[2], 1.0f), c);
+    // triangles clipped by the near plane are skipped. Only the
+    // clipped part would be rendered.
+    if (c[3] <= SOOCCLUSION_MIN_W || c[2] < -c[3]) return;
+    const float iw = 1.0f / c[3];
+    sx[i] = (c[0] * iw * 0.5f + 0.5f) * float(this->width);
+    sy[i] = (c[1] * iw * 0.5f + 0.5f) * float(this->height);
+    sz[i] = c[2] * iw;
+  }
+
+  float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+  if (fabs(area) < 1e-6f) return;
+
+  // pixels whose centers are inside the triangle
+  const float minsx = SbMin(sx[0], SbMin(sx[1], sx[2]));
+  const float maxsx = SbMax(sx[0], SbMax(sx[1], sx[2]));
+  const float minsy = SbMin(sy[0], SbMin(sy[1], sy[2]));
+  const float maxsy = SbMax(sy[0], SbMax(sy[1], sy[2]));
+  if (maxsx < 0.0f || maxsy < 0.0f ||
+      minsx > float(this->width) || minsy > float(this->height)) return;
+
+  const int x0 = SbMax(0, int(ceil(minsx - 0.5f)));
+  const int x1 = SbMin(this->width - 1, int(floor(maxsx - 0.5f)));
+  const int y0 = SbMax(0, int(ceil(minsy - 0.5f)));
+  const int y1 = SbMin(this->height - 1, int(floor(maxsy - 0.5f)));
+  if (x0 > x1 || y0 > y1) return;
+
+  // depth is linear in screen space
+  const float dzdx = ((sz[1] - sz[0]) * (sy[2] - sy[0]) - (sz[2] - sz[0]) * (sy[1] - sy[0])) / area;
+  const float dzdy = ((sx[1] - sx[0]) * (sz[2] - sz[0]) - (sx[2] - sx[0]) * (sz[1] - sz[0])) / area;
+  const float slack = 0.5f * (float(fabs(dzdx)) + float(fabs(dzdy)));
+  const float zmax = SbMax(sz[0], SbMax(sz[1], sz[2]));
+
+  // make the edge functions positive inside the triangle
+  const float sign = area > 0.0f ? 1.0f : -1.0f;
+  float ex[3], ey[3], ec[3];
+  for (int i = 0; i < 3; i++) {
+    const int a = (i + 1) % 3;
+    const int b = (i + 2) % 3;
+    // edge(a, b, p) = (bx - ax) * (py - ay) - (by - ay) * (px - ax)
+    ex[i] = -(sy[b] - sy[a]) * sign;
+    ey[i] = (sx[b] - sx[a]) * sign;
+    ec[i] = ((sy[b] - sy[a]) * sx[a] - (sx[b] - sx[a]) * sy[a]) * sign;
+  }
+
+  float * depthbuf = const_cast<float *>(this->depth.getArrayPtr());
+  unsigned char * dirty = const_cast<unsigned char *>(this->tiledirty.getArrayPtr());
+  for (int y = y0; y <= y1; y++) {
+    const float py = float(y) + 0.5f;
+    float * row = depthbuf + y * this->width;
+    const int tilerow = (y / SOOCCLUSION_TILE_SIZE) * this->tilesx;
+    for (int x = x0; x <= x1; x++) {
+      const float px = float(x) + 0.5f;
+      if (ex[0] * px + ey[0] * py + ec[0] < 0.0f ||
+          ex[1] * px + ey[1] * py + ec[1] < 0.0f ||
+          ex[2] * px + ey[2] * py + ec[2] < 0.0f) continue;
+      float z = sz[0] + dzdx * (px - sx[0]) + dzdy * (py - sy[0]) + slack;
+      if (z > zmax) z = zmax;
+      if (z < row[x]) {
+        row[x] = z;
+        dirty[tilerow + x / SOOCCLUSION_TILE_SIZE] = 1;
+      }
+    }
+  }
+}
+
+// Ends rasterizing the current occluder.
+void
+SoOcclusionCuller::endOccluder(void)
+{
+  assert(this->occluder);
+  if (this->occludertriangles > SOOCCLUSION_MAX_OCCLUDER_TRIANGLES) {
+    this->heavyoccluders.put(this->occluder, this->occluder->getNodeId());
+  }
+  this->occluder = NULL;
+}
+
+/*!
+  Returns the statistics for the last frame. \a numtested is the
+  number of separators tested, and \a numculled how many of them were
+  skipped. \a numoccluders is the number of shapes rasterized in
+  software mode, and \a numqueries the number of occlusion queries
+  issued in hardware mode.
+*/
+void
+SoOcclusionCuller::getStatistics(int & numtestedout, int & numculledout,
+                                 int & numoccludersout, int & numqueriesout) const
+{
+  numtestedout = this->numtested;
+  numculledout = this->numculled;
+  numoccludersout = this->numoccluders;
+  numqueriesout = this->numqueries;
+}
+
+// *************************************************************************
+
+// Transforms the corners of box to clip coordinates. Returns FALSE if
+// the box is (partly) behind the near plane, since it can't be
+// occluded then.
+SbBool
+SoOcclusionCuller::projectBox(SoState * state, const SbBox3f & box,
+                              SbVec4f corners[8]) const
+{
+  const SbMatrix mvp = SoModelMatrixElement::get(state) * this->viewprojection;
+  const SbVec3f & bmin = box.getMin();
+  const SbVec3f & bmax = box.getMax();
+  for (int i = 0; i < 8; i++) {
+    const SbVec4f p((i & 1) ? bmax[0] : bmin[0],
+                    (i & 2) ? bmax[1] : bmin[1],
+                    (i & 4) ? bmax[2] : bmin[2],
+                    1.0f);
+    mvp.multVecMatrix(p, corners[i]);
+    if (corners[i][3] <= SOOCCLUSION_MIN_W || corners[i][2] < -corners[i][3]) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Fetches the current camera matrices, and clears the software
+// buffer if they differ from the ones the buffer was rendered with.
+void
+SoOcclusionCuller::updateViewProjection(SoState * state)
+{
+  const SbMatrix vp =
+    SoViewingMatrixElement::get(state) * SoProjectionMatrixElement::get(state);
+  if (this->bufferready && vp == this->viewprojection) return;
+
+  this->viewprojection = vp;
+  if (this->type == SoGLRenderAction::OCCLUSION_CULLING_SOFTWARE) {
+    const SbVec2s size = SoViewportRegionElement::get(state).getViewportSizePixels();
+    this->width = SOOCCLUSION_BUFFER_WIDTH;
+    this->height = SOOCCLUSION_BUFFER_WIDTH;
+    if (size[0] > 0 && size[1] > 0) {
+      this->height = int(float(SOOCCLUSION_BUFFER_WIDTH) * float(size[1]) / float(size[0]) + 0.5f);
+      this->height = SbMax(1, SbMin(this->height, 4 * SOOCCLUSION_BUFFER_WIDTH));
+    }
+    this->clearDepthBuffer();
+  }
+  this->bufferready = TRUE;
+}
+
+void
+SoOcclusionCuller::clearDepthBuffer(void)
+{
+  this->tilesx = (this->width + SOOCCLUSION_TILE_SIZE - 1) / SOOCCLUSION_TILE_SIZE;
+  this->tilesy = (this->height + SOOCCLUSION_TILE_SIZE - 1) / SOOCCLUSION_TILE_SIZE;
+  const int numpixels = this->width * this->height;
+  const int numtiles = this->tilesx * this->tilesy;
+
+  this->depth.truncate(0);
+  for (int i = 0; i < numpixels; i++) this->depth.append(FLT_MAX);
+  this->tilemax.truncate(0);
+  this->tiledirty.truncate(0);
+  for (int i = 0; i < numtiles; i++) {
+    this->tilemax.append(FLT_MAX);
+    this->tiledirty.append(0);
+  }
+}
+
+// Returns the farthest depth within a tile of the software buffer.
+float
+SoOcclusionCuller::getTileMax(const int tile)
+{
+  if (this->tiledirty[tile]) {
+    const int tx = (tile % this->tilesx) * SOOCCLUSION_TILE_SIZE;
+    const int ty = (tile / this->tilesx) * SOOCCLUSION_TILE_SIZE;
+    const int ex = SbMin(tx + SOOCCLUSION_TILE_SIZE, this->width);
+    const int ey = SbMin(ty + SOOCCLUSION_TILE_SIZE, this->height);
+    const float * depthbuf = this->depth.getArrayPtr();
+    float m = -FLT_MAX;
+    for (int y = ty; y < ey; y++) {
+      for (int x = tx; x < ex; x++) {
+        m = SbMax(m, depthbuf[y * this->width + x]);
+      }
+    }
+    this->tilemax[tile] = m;
+    this->tiledirty[tile] = 0;
+  }
+  return this->tilemax[tile];
+}
+
+SbBool
+SoOcclusionCuller::isOccludedSoftware(const SbVec4f corners[8])
+{
+  float minx = FLT_MAX, maxx = -FLT_MAX, miny = FLT_MAX, maxy = -FLT_MAX;
+  float minz = FLT_MAX;
+  for (int i = 0; i < 8; i++) {
+    const float iw = 1.0f / corners[i][3];
+    const float x = (corners[i][0] * iw * 0.5f + 0.5f) * float(this->width);
+    const float y = (corners[i][1] * iw * 0.5f + 0.5f) * float(this->height);
+    const float z = corners[i][2] * iw;
+    if (x < minx) minx = x;
+    if (x > maxx) maxx = x;
+    if (y < miny) miny = y;
+    if (y > maxy) maxy = y;
+    if (z < minz) minz = z;
+  }
+  // outside the buffer. Left to view frustum culling.
+  if (maxx < 0.0f || maxy < 0.0f ||
+      minx >= float(this->width) || miny >= float(this->height)) return FALSE;
+
+  // every pixel the box touches
+  const int x0 = SbMax(0, int(floor(minx)));
+  const int x1 = SbMin(this->width - 1, int(floor(maxx)));
+  const int y0 = SbMax(0, int(floor(miny)));
+  const int y1 = SbMin(this->height - 1, int(floor(maxy)));
+
+  const float * depthbuf = this->depth.getArrayPtr();
+  const int tx0 = x0 / SOOCCLUSION_TILE_SIZE, tx1 = x1 / SOOCCLUSION_TILE_SIZE;
+  const int ty0 = y0 / SOOCCLUSION_TILE_SIZE, ty1 = y1 / SOOCCLUSION_TILE_SIZE;
+  for (int ty = ty0; ty <= ty1; ty++) {
+    for (int tx = tx0; tx <= tx1; tx++) {
+      if (this->getTileMax(ty * this->tilesx + tx) < minz) continue;
+      const int sx = SbMax(x0, tx * SOOCCLUSION_TILE_SIZE);
+      const int ex = SbMin(x1, tx * SOOCCLUSION_TILE_SIZE + SOOCCLUSION_TILE_SIZE - 1);
+      const int sy = SbMax(y0, ty * SOOCCLUSION_TILE_SIZE);
+      const int ey = SbMin(y1, ty * SOOCCLUSION_TILE_SIZE + SOOCCLUSION_TILE_SIZE - 1);
+      for (int y = sy; y <= ey; y++) {
+        const float * row = depthbuf + y * this->width;
+        for (int x = sx; x <= ex; x++) {
+          if (row[x] >= minz) return FALSE;
+        }
+      }
+    }
+  }
+  return TRUE;
+}
+
+// *************************************************************************
+
+static uintptr_t
+soocclusion_key(const SoNode * node, const SbMatrix & m)
+{
+  // separators used several times are told apart by their model matrix
+  const unsigned char * bytes = reinterpret_cast<const unsigned char *>(m[0]);
+  uintptr_t h = reinterpret_cast<uintptr_t>(node);
+  for (size_t i = 0; i < sizeof(float) * 16; i++) {
+    h = (h ^ bytes[i]) * 16777619u;
+  }
+  return h;
+}
+
+SbBool
+SoOcclusionCuller::isOccludedHardware(SoState * state, const SoNode * node,
+                                      const SbBox3f & box)
+{
+  const cc_glglue * glue = sogl_glue_instance(state);
+  if (!cc_glglue_has_occlusion_query(glue)) return FALSE;
+  // the box would be drawn with the shader program of the subgraph
+  if (state->isElementEnabled(SoGLShaderProgramElement::getClassStackIndex()) &&
+      SoGLShaderProgramElement::get(state) != NULL) return FALSE;
+
+  // a box the camera is inside of is always visible
+  this->updateViewProjection(state);
+  SbVec4f corners[8];
+  if (!this->projectBox(state, box, corners)) return FALSE;
+
+  const uint32_t contextid = SoGLCacheContextElement::get(state);
+  if (!this->hasquerycontext || contextid != this->querycontext) {
+    this->releaseQueries();
+    this->querycontext = contextid;
+    this->hasquerycontext = TRUE;
+  }
+  if ((this->frame & 255) == 0) this->sweepQueries(glue);
+
+  const uintptr_t key = soocclusion_key(node, SoModelMatrixElement::get(state));
+  Query q;
+  (void)this->queries.get(key, q);
+  if (q.visitframe == 0 || q.nodeid != node->getNodeId()) {
+    // a new separator, or one that has changed. The query object is
+    // reused.
+    q.nodeid = node->getNodeId();
+    q.queryframe = this->frame - SOOCCLUSION_VISIBLE_QUERY_INTERVAL;
+    q.pending = FALSE;
+    q.visible = TRUE;
+  }
+  q.visitframe = this->frame;
+  this->numtested++;
+
+  if (q.pending) {
+    GLuint available = 0;
+    cc_glglue_glGetQueryObjectuiv(glue, q.id, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint samples = 0;
+      cc_glglue_glGetQueryObjectuiv(glue, q.id, GL_QUERY_RESULT, &samples);
+      q.visible = samples > 0;
+      q.pending = FALSE;
+    }
+  }
+
+  if (!q.pending &&
+      (!q.visible ||
+       this->frame - q.queryframe >= SOOCCLUSION_VISIBLE_QUERY_INTERVAL)) {
+    if (q.id == 0) cc_glglue_glGenQueries(glue, 1, &q.id);
+    cc_glglue_glBeginQuery(glue, GL_SAMPLES_PASSED, q.id);
+    this->renderQueryBox(box);
+    cc_glglue_glEndQuery(glue, GL_SAMPLES_PASSED);
+    q.pending = TRUE;
+    q.queryframe = this->frame;
+    this->numqueries++;
+  }
+
+  this->queries.put(key, q);
+
+  if (!q.visible) {
+    this->numculled++;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+// Draws box, in the current object space, without changing the
+// color or depth buffer.
+void
+SoOcclusionCuller::renderQueryBox(const SbBox3f & box) const
+{
+  glPushAttrib(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_ENABLE_BIT|GL_POLYGON_BIT);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_TEXTURE_2D);
+  glDisable(GL_ALPHA_TEST);
+  glDisable(GL_STENCIL_TEST);
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+  const SbVec3f & bmin = box.getMin();
+  const SbVec3f & bmax = box.getMax();
+  // corner i has max x if bit 0 is set, max y for bit 1, max z for bit 2
+  static const int faces[6][4] = {
+    { 0, 2, 3, 1 }, { 4, 5, 7, 6 },
+    { 0, 1, 5, 4 }, { 2, 6, 7, 3 },
+    { 0, 4, 6, 2 }, { 1, 3, 7, 5 }
+  };
+  glBegin(GL_QUADS);
+  for (int f = 0; f < 6; f++) {
+    for (int i = 0; i < 4; i++) {
+      const int c = faces[f][i];
+      glVertex3f((c & 1) ? bmax[0] : bmin[0],
+                 (c & 2) ? bmax[1] : bmin[1],
+                 (c & 4) ? bmax[2] : bmin[2]);
+    }
+  }
+  glEnd();
+
+  glPopAttrib();
+}
+
+// Deletes the queries of separators that haven't been traversed for
+// a while. Called with the query context current.
+void
+SoOcclusionCuller::sweepQueries(const cc_glglue * glue)
+{
+  SbList <uintptr_t> keys;
+  this->queries.makeKeyList(keys);
+  for (int i = 0; i < keys.getLength(); i++) {
+    Query q;
+    (void)this->queries.get(keys[i], q);
+    if (this->frame - q.visitframe > SOOCCLUSION_QUERY_MAX_AGE) {
+      if (q.id) cc_glglue_glDeleteQueries(glue, 1, &q.id);
+      this->queries.erase(keys[i]);
+    }
+  }
+}
+
+// Schedules all queries for deletion in the context they were created
+// in.
+void
+SoOcclusionCuller::releaseQueries(void)
+{
+  if (this->hasquerycontext) {
+    for (SbHash<uintptr_t, Query>::const_iterator iter = this->queries.const_begin();
+         iter != this->queries.const_end(); ++iter) {
+      if (iter->obj.id) {
+        void * ptr = reinterpret_cast<void *>(static_cast<uintptr_t>(iter->obj.id));
+        SoGLCacheContextElement::scheduleDeleteCallback(this->querycontext,
+                                                        SoOcclusionCuller::query_delete, ptr);
+      }
+    }
+  }
+  this->queries.clear();
+  this->hasquerycontext = FALSE;
+}
+
+//
+// Callback from SoGLCacheContextElement
+//
+void
+SoOcclusionCuller::query_delete(void * closure, uint32_t contextid)
+{
+  const cc_glglue * glue = cc_glglue_instance(static_cast<int>(contextid));
+  GLuint id = static_cast<GLuint>(reinterpret_cast<uintptr_t>(closure));
+  cc_glglue_glDeleteQueries(glue, 1, &id);
+}
+
+//
+// Callback from SoContextHandler. The queries die with the context.
+//
+void
+SoOcclusionCuller::context_destruction_cb(uint32_t contextid, void * userdata)
+{
+  SoOcclusionCuller * thisp = static_cast<SoOcclusionCuller *>(userdata);
+  if (thisp->hasquerycontext && thisp->querycontext == contextid) {
+    thisp->queries.clear();
+    thisp->hasquerycontext = FALSE;
+  }
+}
+
+// *************************************************************************
+
+#ifdef COIN_TEST_SUITE
+#ifdef COIN_INT_TEST_SUITE
+
+#include <cmath>
+#include <Inventor/SbViewVolume.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoCallbackAction.h>
+#include <Inventor/elements/SoDepthBufferElement.h>
+#include <Inventor/elements/SoDrawStyleElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoProjectionMatrixElement.h>
+#include <Inventor/elements/SoViewingMatrixElement.h>
+#include <Inventor/elements/SoViewportRegionElement.h>
+#include <Inventor/lists/SoTypeList.h>
+#include <Inventor/misc/SoState.h>
+#include <Inventor/nodes/SoCube.h>
+
+// A state with the elements the culler reads, and a camera at the
+// origin looking down the negative z axis.
+class SoOcclusionTestState {
+public:
+  SoOcclusionTestState(void) {
+    SoTypeList elements;
+    elements.append(SoDepthBufferElement::getClassTypeId());
+    elements.append(SoDrawStyleElement::getClassTypeId());
+    elements.append(SoModelMatrixElement::getClassTypeId());
+    elements.append(SoProjectionMatrixElement::getClassTypeId());
+    elements.append(SoViewingMatrixElement::getClassTypeId());
+    elements.append(SoViewportRegionElement::getClassTypeId());
+    this->state = new SoState(&this->action, elements);
+    this->state->push();
+
+    SbViewVolume vv;
+    vv.perspective(float(M_PI) / 4.0f, 1.0f, 1.0f, 100.0f);
+    SbMatrix affine, proj;
+    vv.getMatrices(affine, proj);
+    SoViewingMatrixElement::set(this->state, NULL, affine);
+    SoProjectionMatrixElement::set(this->state, NULL, proj);
+    SoViewportRegionElement::set(this->state, SbViewportRegion(256, 256));
+
+    this->node = new SoCube;
+    this->node->ref();
+    this->culler.setType(SoGLRenderAction::OCCLUSION_CULLING_SOFTWARE);
+    this->culler.beginFrame();
+    this->culler.beginPass();
+  }
+  ~SoOcclusionTestState() {
+    this->state->pop();
+    delete this->state;
+    this->node->unref();
+  }
+
+  // Rasterizes the quad [x0, x1] x [y0, y1] at depth z as an occluder.
+  SbBool addQuad(float x0, float y0, float x1, float y1, float z) {
+    if (!this->culler.beginOccluder(this->state, this->node,
+                                    SbBox3f(x0, y0, z, x1, y1, z))) {
+      return FALSE;
+    }
+    this->culler.addTriangle(SbVec3f(x0, y0, z), SbVec3f(x1, y0, z), SbVec3f(x1, y1, z));
+    this->culler.addTriangle(SbVec3f(x0, y0, z), SbVec3f(x1, y1, z), SbVec3f(x0, y1, z));
+    this->culler.endOccluder();
+    return TRUE;
+  }
+
+  SbBool isOccluded(const SbBox3f & box) {
+    return this->culler.isOccluded(this->state, this->node, box);
+  }
+
+  SoOcclusionCuller culler;
+  SoCallbackAction action;
+  SoState * state;
+  SoCube * node;
+};
+
+BOOST_AUTO_TEST_CASE(hiddenBehindQuad)
+{
+  SoOcclusionTestState t;
+  BOOST_REQUIRE(t.addQuad(-10.0f, -10.0f, 10.0f, 10.0f, -5.0f));
+  BOOST_CHECK_MESSAGE(t.isOccluded(SbBox3f(-1.0f, -1.0f, -20.0f, 1.0f, 1.0f, -18.0f)),
+                      "box behind a quad covering the screen should be occluded");
+
+  // a new pass starts with an empty buffer
+  t.culler.beginPass();
+  BOOST_CHECK_MESSAGE(!t.isOccluded(SbBox3f(-1.0f, -1.0f, -20.0f, 1.0f, 1.0f, -18.0f)),
+                      "nothing should be occluded after the buffer is cleared");
+}
+
+BOOST_AUTO_TEST_CASE(inFrontNotCulled)
+{
+  SoOcclusionTestState t;
+  BOOST_REQUIRE(t.addQuad(-10.0f, -10.0f, 10.0f, 10.0f, -5.0f));
+  BOOST_CHECK_MESSAGE(!t.isOccluded(SbBox3f(-1.0f, -1.0f, -3.0f, 1.0f, 1.0f, -2.0f)),
+                      "box in front of the occluder should be visible");
+  BOOST_CHECK_MESSAGE(!t.isOccluded(SbBox3f(-1.0f, -1.0f, -8.0f, 1.0f, 1.0f, -2.0f)),
+                      "box intersecting the occluder should be visible");
+  BOOST_CHECK_MESSAGE(!t.isOccluded(SbBox3f(-1.0f, -1.0f, -20.0f, 1.0f, 1.0f, 2.0f)),
+                      "box crossing the near plane should be visible");
+}
+
+BOOST_AUTO_TEST_CASE(partlyOutsideBuffer)
+{
+  SoOcclusionTestState t;
+  // covers the left half of the screen only
+  BOOST_REQUIRE(t.addQuad(-10.0f, -10.0f, 0.0f, 10.0f, -5.0f));
+  BOOST_CHECK_MESSAGE(t.isOccluded(SbBox3f(-40.0f, -1.0f, -20.0f, -2.0f, 1.0f, -18.0f)),
+                      "the part of a box outside the buffer should be ignored");
+  BOOST_CHECK_MESSAGE(!t.isOccluded(SbBox3f(-40.0f, -1.0f, -20.0f, 40.0f, 1.0f, -18.0f)),
+                      "box reaching the uncovered half should be visible");
+  BOOST_CHECK_MESSAGE(!t.isOccluded(SbBox3f(100.0f, -1.0f, -20.0f, 110.0f, 1.0f, -18.0f)),
+                      "box outside the buffer is left to view frustum culling");
+}
+
+BOOST_AUTO_TEST_CASE(statistics)
+{
+  SoOcclusionTestState t;
+  BOOST_REQUIRE(t.addQuad(-10.0f, -10.0f, 10.0f, 10.0f, -5.0f));
+  BOOST_CHECK_MESSAGE(!t.addQuad(-0.01f, -0.01f, 0.01f, 0.01f, -50.0f),
+                      "a quad covering a few pixels should not be an occluder");
+
+  (void)t.isOccluded(SbBox3f(-1.0f, -1.0f, -20.0f, 1.0f, 1.0f, -18.0f));
+  (void)t.isOccluded(SbBox3f(2.0f, -1.0f, -20.0f, 4.0f, 1.0f, -18.0f));
+  (void)t.isOccluded(SbBox3f(-1.0f, -1.0f, -3.0f, 1.0f, 1.0f, -2.0f));
+  // not tested, as it crosses the near plane
+  (void)t.isOccluded(SbBox3f(-1.0f, -1.0f, -20.0f, 1.0f, 1.0f, 2.0f));
+
+  int numtested, numculled, numoccluders, numqueries;
+  t.culler.getStatistics(numtested, numculled, numoccluders, numqueries);
+  BOOST_CHECK_EQUAL(numtested, 3);
+  BOOST_CHECK_EQUAL(numculled, 2);
+  BOOST_CHECK_EQUAL(numoccluders, 1);
+  BOOST_CHECK_EQUAL(numqueries, 0);
+
+  t.culler.beginFrame();
+  t.culler.getStatistics(numtested, numculled, numoccluders, numqueries);
+  BOOST_CHECK_MESSAGE(numtested == 0 && numculled == 0 && numoccluders == 0,
+                      "statistics should be reset for each frame");
+}
+
+#endif // COIN_INT_TEST_SUITE
+#endif // COIN_TEST_SUITE
@@ -0,0 +1,133 @@
+#ifndef COIN_SOOCCLUSIONCULLER_H
+#define COIN_SOOCCLUSIONCULLER_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif /* !COIN_INTERNAL */
+
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbMatrix.h>
+#include <Inventor/SbVec4f.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/system/gl.h>
+#include <Inventor/C/glue/gl.h>
+
+#include "misc/SbHash.h"
+
+class SoNode;
+class SoState;
+
+class SoOcclusionCuller {
+public:
+  SoOcclusionCuller(void);
+  ~SoOcclusionCuller();
+
+  void setType(const SoGLRenderAction::OcclusionCullingType type);
+  SoGLRenderAction::OcclusionCullingType getType(void) const;
+
+  void beginFrame(void);
+  void beginPass(void);
+
+  SbBool isOccluded(SoState * state, const SoNode * node, const SbBox3f & box);
+
+  SbBool beginOccluder(SoState * state, const SoNode * node, const SbBox3f & box);
+  void addTriangle(const SbVec3f & v0, const SbVec3f & v1, const SbVec3f & v2);
+  void endOccluder(void);
+
+  void getStatistics(int & numtested, int & numculled,
+                     int & numoccluders, int & numqueries) const;
+
+private:
+  struct Query {
+    Query(void)
+      : nodeid(0), id(0), visitframe(0), queryframe(0),
+        pending(FALSE), visible(TRUE) { }
+    SbUniqueId nodeid;
+    GLuint id;
+    uint32_t visitframe;
+    uint32_t queryframe;
+    SbBool pending;
+    SbBool visible;
+  };
+
+  SbBool projectBox(SoState * state, const SbBox3f & box,
+                    SbVec4f corners[8]) const;
+  void updateViewProjection(SoState * state);
+  void clearDepthBuffer(void);
+  SbBool isOccludedSoftware(const SbVec4f corners[8]);
+  SbBool isOccludedHardware(SoState * state, const SoNode * node,
+                            const SbBox3f & box);
+  void renderQueryBox(const SbBox3f & box) const;
+  void sweepQueries(const cc_glglue * glue);
+  void releaseQueries(void);
+  float getTileMax(const int tile);
+
+  static void query_delete(void * closure, uint32_t contextid);
+  static void context_destruction_cb(uint32_t contextid, void * userdata);
+
+  SoGLRenderAction::OcclusionCullingType type;
+  uint32_t frame;
+
+  int numtested;
+  int numculled;
+  int numoccluders;
+  int numqueries;
+
+  // software depth buffer, in normalized device coordinates
+  SbBool bufferready;
+  SbMatrix viewprojection;
+  SbMatrix occludermatrix;
+  int width, height;
+  int tilesx, tilesy;
+  SbList <float> depth;
+  SbList <float> tilemax;
+  SbList <unsigned char> tiledirty;
+  const SoNode * occluder;
+  int occludertriangles;
+  SbHash<const SoNode *, SbUniqueId> heavyoccluders;
+
+  // occlusion queries, with their results from earlier frames
+  uint32_t querycontext;
+  SbBool hasquerycontext;
+  SbHash<uintptr_t, Query> queries;
+};
+
+// Returns the occlusion culler to use for the current traversal of
+// action, or NULL if no occlusion culling should be done right now.
+// Implemented in SoGLRenderAction.cpp.
+SoOcclusionCuller * sogl_occlusion_culler(SoGLRenderAction * action);
+
+#endif // !COIN_SOOCCLUSIONCULLER_H
@@ -44,4 +44,5 @@
 #include "SoRenderManager.cpp"
 #include "SoRenderManagerP.cpp"
 #include "SoVBO.cpp"
+#include "SoOcclusionCuller.cpp"
 #include "SoVertexArrayIndexer.cpp"
@@ -134,6 +134,128 @@
 
 // *************************************************************************
 
+// A priority queue of sensors, ordered on a key (priority for delay
+// queue sensors, trigger time for timer queue sensors). Sensors with
+// equal keys are kept in FIFO order through an insertion sequence
+// number.
+//
+// The queue is a binary heap, so insert and takeFirst are O(log n).
+// The heap entry of a sensor isn't removed from the heap on remove(),
+// the sensor is just removed from the table of queued sensors, which
+// makes the entry stale. Stale entries are skipped when they get to
+// the top of the heap, and the heap is compacted when more than half
+// of it is stale. The old sorted SbList implementation was O(n) for
+// all three operations, which made scheduling quadratic with many
+// sensors.
+template <class Sensor>
+class SoSensorQueue {
+public:
+  SoSensorQueue(void) : sequence(0) { }
+
+  void insert(Sensor * sensor, const double key) {
+    const Entry entry = { key, this->sequence++, sensor };
+    // a sensor can only be in the queue once
+    (void) this->queued.put(sensor, entry.sequence);
+    this->heap.append(entry);
+    this->siftUp(this->heap.getLength() - 1);
+  }
+
+  SbBool remove(Sensor * sensor) {
+    if (!this->queued.erase(sensor)) return FALSE;
+    if (this->heap.getLength() > 32 &&
+        this->heap.getLength() > 2 * this->getLength()) this->compact();
+    return TRUE;
+  }
+
+  // returns NULL if the queue is empty
+  Sensor * getFirst(void) {
+    this->purge();
+    return this->heap.getLength() ? this->heap[0].sensor : NULL;
+  }
+
+  Sensor * takeFirst(void) {
+    Sensor * sensor = this->getFirst();
+    if (sensor) {
+      (void) this->queued.erase(sensor);
+      this->removeTop();
+    }
+    return sensor;
+  }
+
+  int getLength(void) const {
+    return static_cast<int>(this->queued.getNumElements());
+  }
+
+private:
+  struct Entry {
+    double key;
+    uint64_t sequence;
+    Sensor * sensor;
+  };
+
+  static SbBool isBefore(const Entry & a, const Entry & b) {
+    return (a.key < b.key) || (a.key == b.key && a.sequence < b.sequence);
+  }
+
+  SbBool isStale(const Entry & entry) const {
+    uint64_t sequence;
+    return !this->queued.get(entry.sensor, sequence) || sequence != entry.sequence;
+  }
+
+  void purge(void) {
+    while (this->heap.getLength() && this->isStale(this->heap[0])) {
+      this->removeTop();
+    }
+  }
+
+  void removeTop(void) {
+    const int last = this->heap.getLength() - 1;
+    this->heap[0] = this->heap[last];
+    this->heap.truncate(last);
+    if (last > 0) this->siftDown(0);
+  }
+
+  void compact(void) {
+    int n = 0;
+    for (int i = 0; i < this->heap.getLength(); i++) {
+      if (!this->isStale(this->heap[i])) this->heap[n++] = this->heap[i];
+    }
+    this->heap.truncate(n);
+    for (int i = n / 2 - 1; i >= 0; i--) this->siftDown(i);
+  }
+
+  void siftUp(int i) {
+    const Entry entry = this->heap[i];
+    while (i > 0) {
+      const int parent = (i - 1) / 2;
+      if (!isBefore(entry, this->heap[parent])) break;
+      this->heap[i] = this->heap[parent];
+      i = parent;
+    }
+    this->heap[i] = entry;
+  }
+
+  void siftDown(int i) {
+    const int n = this->heap.getLength();
+    const Entry entry = this->heap[i];
+    for (;;) {
+      int child = 2 * i + 1;
+      if (child >= n) break;
+      if (child + 1 < n && isBefore(this->heap[child + 1], this->heap[child])) child++;
+      if (!isBefore(this->heap[child], entry)) break;
+      this->heap[i] = this->heap[child];
+      i = child;
+    }
+    this->heap[i] = entry;
+  }
+
+  SbList<Entry> heap;
+  SbHash<SoSensor *, uint64_t> queued; // sensor -> sequence of its entry
+  uint64_t sequence;
+};
+
+// *************************************************************************
+
 class SoSensorManagerP {
 public:
   SoSensorManagerP(void) : alive(ALIVE_PATTERN) { }
@@ -143,12 +265,12 @@ public:
   SbBool processingimmediatequeue;
 
   // immediatequeue - stores SoDelayQueueSensors with priority 0. FIFO.
-  // delayqueue   - stores SoDelayQueueSensor's in sorted order.
-  // timerqueue - stores SoTimerSensors in sorted order.
+  // delayqueue   - stores SoDelayQueueSensor's in priority order.
+  // timerqueue - stores SoTimerSensors in trigger time order.
 
-  SbList <SoDelayQueueSensor *> immediatequeue;
-  SbList <SoDelayQueueSensor *> delayqueue;
-  SbList <SoTimerQueueSensor *> timerqueue;
+  SoSensorQueue<SoDelayQueueSensor> immediatequeue;
+  SoSensorQueue<SoDelayQueueSensor> delayqueue;
+  SoSensorQueue<SoTimerQueueSensor> timerqueue;
   SbList <SoTimerSensor*> reschedulelist;
 
   // FIXME: from what I can see, the two dicts below are simply used
@@ -294,7 +416,7 @@ SoSensorManager::insertDelaySensor(SoDelayQueueSensor * newentry)
   // strategy.
   if (newentry->getPriority() == 0) {
     LOCK_IMMEDIATE_QUEUE(this);
-    PRIVATE(this)->immediatequeue.append(newentry);
+    PRIVATE(this)->immediatequeue.insert(newentry, 0.0);
     UNLOCK_IMMEDIATE_QUEUE(this);
   }
   else {
@@ -305,17 +427,8 @@ SoSensorManager::insertDelaySensor(SoDelayQueueSensor * newentry)
     }
 
     LOCK_DELAY_QUEUE(this);
-    SbList <SoDelayQueueSensor *> & delayqueue = PRIVATE(this)->delayqueue;
-
-    // <= in test since the sensors should be processed FIFO for
-    // sensors with equal priority
-    uint32_t newsensorpriority = newentry->getPriority();
-    int pos = 0;
-    while((pos < delayqueue.getLength()) &&
-          (delayqueue[pos]->getPriority() <= newsensorpriority)) {
-      pos++;
-    }
-    delayqueue.insert(newentry, pos);
+    // sensors with equal priority are processed FIFO
+    PRIVATE(this)->delayqueue.insert(newentry, double(newentry->getPriority()));
     UNLOCK_DELAY_QUEUE(this);
     this->notifyChanged();
   }
@@ -343,20 +456,9 @@ SoSensorManager::insertTimerSensor(SoTimerQueueSensor * newentry)
   SoSensorManagerP::assertAlive(PRIVATE(this));
   assert(newentry);
 
-  SbList <SoTimerQueueSensor *> & timerqueue = PRIVATE(this)->timerqueue;
-
   LOCK_TIMER_QUEUE(this);
-  int i = 0;
-
-  // <= in test since the sensors should be processed FIFO for sensors
-  // with the same trigger time
-  double newtime = newentry->getTriggerTime().getValue();
-  while ((i < timerqueue.getLength()) &&
-         (timerqueue[i]->getTriggerTime().getValue() <= newtime)) {
-    i++;
-  }
-  timerqueue.insert(newentry, i);
-
+  // sensors with the same trigger time are processed FIFO
+  PRIVATE(this)->timerqueue.insert(newentry, newentry->getTriggerTime().getValue());
   UNLOCK_TIMER_QUEUE(this);
 
 #if DEBUG_TIMER_SENSORHANDLING || 0 // debug
@@ -387,28 +489,24 @@ SoSensorManager::removeDelaySensor(SoDelayQueueSensor * entry)
 
   LOCK_DELAY_QUEUE(this);
   // Check "real" queue first..
-  int idx = PRIVATE(this)->delayqueue.find(entry);
-  if (idx != -1) PRIVATE(this)->delayqueue.remove(idx);
+  SbBool found = PRIVATE(this)->delayqueue.remove(entry);
   UNLOCK_DELAY_QUEUE(this);
 
   // ..then the immediate queue.
-  if (idx == -1) {
+  if (!found) {
     LOCK_IMMEDIATE_QUEUE(this);
-    idx = PRIVATE(this)->immediatequeue.find(entry);
-    if (idx != -1) PRIVATE(this)->immediatequeue.remove(idx);
+    found = PRIVATE(this)->immediatequeue.remove(entry);
     UNLOCK_IMMEDIATE_QUEUE(this);
   }
   // ..then the reinsert list
-  if (idx == -1) {
-    if (PRIVATE(this)->reinsertdict.erase(entry)) {
-      idx = 0; // make sure notifyChanged() is called.
-    }
+  if (!found) {
+    found = PRIVATE(this)->reinsertdict.erase(entry);
   }
 
-  if (idx != -1) this->notifyChanged();
+  if (found) this->notifyChanged();
 
 #if COIN_DEBUG
-  if (idx == -1) {
+  if (!found) {
     SoDebugError::postWarning("SoSensorManager::removeDelaySensor",
                               "trying to remove element not in list");
   }
@@ -424,9 +522,7 @@ SoSensorManager::removeTimerSensor(SoTimerQueueSensor * entry)
   SoSensorManagerP::assertAlive(PRIVATE(this));
 
   LOCK_TIMER_QUEUE(this);
-  int idx = PRIVATE(this)->timerqueue.find(entry);
-  if (idx != -1) {
-    PRIVATE(this)->timerqueue.remove(idx);
+  if (PRIVATE(this)->timerqueue.remove(entry)) {
     UNLOCK_TIMER_QUEUE(this);
     this->notifyChanged();
   }
@@ -478,15 +574,15 @@ SoSensorManager::processTimerQueue(void)
   LOCK_TIMER_QUEUE(this);
 
   SbTime currenttime = SbTime::getTimeOfDay();
-  while (PRIVATE(this)->timerqueue.getLength() > 0 &&
-         PRIVATE(this)->timerqueue[0]->getTriggerTime() <= currenttime) {
+  SoTimerQueueSensor * first;
+  while ((first = PRIVATE(this)->timerqueue.getFirst()) != NULL &&
+         first->getTriggerTime() <= currenttime) {
 #if DEBUG_TIMER_SENSORHANDLING // debug
     SoDebugError::postInfo("SoSensorManager::processTimerQueue",
                            "process element with triggertime %s",
-                           PRIVATE(this)->timerqueue[0]->getTriggerTime().format().getString());
+                           first->getTriggerTime().format().getString());
 #endif // debug
-    SoSensor * sensor = PRIVATE(this)->timerqueue[0];
-    PRIVATE(this)->timerqueue.remove(0);
+    SoSensor * sensor = PRIVATE(this)->timerqueue.takeFirst();
     UNLOCK_TIMER_QUEUE(this);
     sensor->trigger();
     LOCK_TIMER_QUEUE(this);
@@ -585,15 +681,14 @@ SoSensorManager::processDelayQueue(SbBool isidle)
 
   // Sensors with higher priorities are triggered first.
   while (PRIVATE(this)->delayqueue.getLength()) {
+    SoDelayQueueSensor * sensor = PRIVATE(this)->delayqueue.takeFirst();
+    UNLOCK_DELAY_QUEUE(this);
 #if DEBUG_DELAY_SENSORHANDLING // debug
     SoDebugError::postInfo("SoSensorManager::processDelayQueue",
                            "treat element with pri %d",
-                           PRIVATE(this)->delayqueue[0]->getPriority());
+                           sensor->getPriority());
 #endif // debug
 
-    SoDelayQueueSensor * sensor = PRIVATE(this)->delayqueue[0];
-    PRIVATE(this)->delayqueue.remove(0);
-    UNLOCK_DELAY_QUEUE(this);
 
     if (!isidle && sensor->isIdleOnly()) {
       // move sensor to another temporary list. It will be reinserted
@@ -692,8 +787,7 @@ SoSensorManager::processImmediateQueue(void)
     SoDebugError::postInfo("SoSensorManager::processImmediateQueue",
                            "trigger element");
 #endif // debug
-    SoSensor * sensor = PRIVATE(this)->immediatequeue[0];
-    PRIVATE(this)->immediatequeue.remove(0);
+    SoSensor * sensor = PRIVATE(this)->immediatequeue.takeFirst();
     UNLOCK_IMMEDIATE_QUEUE(this);
 
     sensor->trigger();
@@ -772,8 +866,9 @@ SoSensorManager::isTimerSensorPending(SbTime & tm)
   SoSensorManagerP::assertAlive(PRIVATE(this));
 
   LOCK_TIMER_QUEUE(this);
-  if (PRIVATE(this)->timerqueue.getLength() > 0) {
-    tm = PRIVATE(this)->timerqueue[0]->getTriggerTime();
+  SoTimerQueueSensor * first = PRIVATE(this)->timerqueue.getFirst();
+  if (first) {
+    tm = first->getTriggerTime();
     UNLOCK_TIMER_QUEUE(this);
     return TRUE;
   }
@@ -912,3 +1007,116 @@ SoSensorManager::mergeDelayQueues(void)
 #undef LOCK_RESCHEDULE_LIST
 #undef UNLOCK_RESCHEDULE_LIST
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/SoDB.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/sensors/SoAlarmSensor.h>
+#include <Inventor/sensors/SoOneShotSensor.h>
+
+static void
+recordTriggerCB(void * data, SoSensor * sensor)
+{
+  static_cast<SbList<SoSensor *> *>(data)->append(sensor);
+}
+
+static int
+sensorIndex(SoSensor ** sensors, const int num, const SoSensor * sensor)
+{
+  for (int i = 0; i < num; i++) { if (sensors[i] == sensor) return i; }
+  return -1;
+}
+
+BOOST_AUTO_TEST_CASE(delayQueueOrder)
+{
+  SoSensorManager * sm = SoDB::getSensorManager();
+  const int num = 300;
+  SbList<SoSensor *> triggered;
+  SoSensor * sensors[num];
+  for (int i = 0; i < num; i++) {
+    SoOneShotSensor * sensor = new SoOneShotSensor(recordTriggerCB, &triggered);
+    // a few distinct priorities, and every fifth an immediate sensor
+    sensor->setPriority((i * 7) % 5 * 50);
+    sensor->schedule();
+    sensors[i] = sensor;
+  }
+
+  sm->processImmediateQueue();
+  BOOST_CHECK_EQUAL(triggered.getLength(), num / 5);
+  SbBool ok = TRUE;
+  for (int i = 0; i < triggered.getLength(); i++) {
+    if (sensorIndex(sensors, num, triggered[i]) != i * 5) ok = FALSE;
+  }
+  BOOST_CHECK_MESSAGE(ok, "immediate sensors not triggered in FIFO order");
+
+  // unschedule every third, and reschedule every ninth, which puts
+  // those last among the sensors with the same priority
+  for (int i = 0; i < num; i += 3) {
+    SoOneShotSensor * sensor = static_cast<SoOneShotSensor *>(sensors[i]);
+    if (sensor->isScheduled()) sensor->unschedule();
+    if (i % 9 == 0 && sensor->getPriority() != 0) sensor->schedule();
+  }
+
+  triggered.truncate(0);
+  sm->processDelayQueue(TRUE);
+  int expected = 0;
+  for (int i = 0; i < num; i++) {
+    if (i % 5 != 0 && (i % 3 != 0 || i % 9 == 0)) expected++;
+  }
+  BOOST_CHECK_EQUAL(triggered.getLength(), expected);
+
+  ok = TRUE;
+  for (int i = 1; i < triggered.getLength(); i++) {
+    const uint32_t prevpri = static_cast<SoOneShotSensor *>(triggered[i - 1])->getPriority();
+    const uint32_t curpri = static_cast<SoOneShotSensor *>(triggered[i])->getPriority();
+    if (prevpri > curpri) ok = FALSE;
+    if (prevpri == curpri) {
+      const int previdx = sensorIndex(sensors, num, triggered[i - 1]);
+      const int curidx = sensorIndex(sensors, num, triggered[i]);
+      const SbBool prevlate = (previdx % 9) == 0;
+      const SbBool curlate = (curidx % 9) == 0;
+      if ((prevlate == curlate) ? (previdx > curidx) : prevlate) ok = FALSE;
+    }
+  }
+  BOOST_CHECK_MESSAGE(ok, "delay sensors not triggered in priority / FIFO order");
+
+  for (int i = 0; i < num; i++) delete sensors[i];
+}
+
+BOOST_AUTO_TEST_CASE(timerQueueOrder)
+{
+  SoSensorManager * sm = SoDB::getSensorManager();
+  const int num = 200;
+  SbList<SoSensor *> triggered;
+  SoSensor * sensors[num];
+  const SbTime now = SbTime::getTimeOfDay();
+  for (int i = 0; i < num; i++) {
+    SoAlarmSensor * sensor = new SoAlarmSensor(recordTriggerCB, &triggered);
+    // all in the past, many with equal trigger times
+    sensor->setTime(now - SbTime(1.0 + (i * 13) % 17));
+    sensor->schedule();
+    sensors[i] = sensor;
+  }
+  for (int i = 0; i < num; i += 4) static_cast<SoAlarmSensor *>(sensors[i])->unschedule();
+  SbTime first;
+  BOOST_CHECK(sm->isTimerSensorPending(first) && first <= now - SbTime(17.0));
+
+  sm->processTimerQueue();
+  BOOST_CHECK_EQUAL(triggered.getLength(), num - num / 4);
+  SbBool ok = TRUE;
+  for (int i = 1; i < triggered.getLength(); i++) {
+    const SbTime prevtime = static_cast<SoAlarmSensor *>(triggered[i - 1])->getTime();
+    const SbTime curtime = static_cast<SoAlarmSensor *>(triggered[i])->getTime();
+    if (prevtime > curtime) ok = FALSE;
+    if (prevtime == curtime &&
+        sensorIndex(sensors, num, triggered[i - 1]) > sensorIndex(sensors, num, triggered[i])) {
+      ok = FALSE;
+    }
+  }
+  BOOST_CHECK_MESSAGE(ok, "timer sensors not triggered in time / FIFO order");
+
+  for (int i = 0; i < num; i++) delete sensors[i];
+}
+
+#endif // COIN_TEST_SUITE
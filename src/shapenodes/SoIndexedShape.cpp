@@ -52,6 +52,8 @@
 #include <Inventor/caches/SoNormalCache.h>
 #include <Inventor/nodes/SoVertexProperty.h>
 
+#include "actions/SoGetBoundingBoxActionP.h"
+#include "misc/SbCoordBounds.h"
 #include "nodes/SoSubNodeP.h"
 #include "coindefs.h" // COIN_OBSOLETED()
 
@@ -164,28 +166,24 @@ SoIndexedShape::computeBBox(SoAction * action, SbBox3f & box, SbVec3f & center)
       vp->vertex.getValues(0) :
       coordelem->getArrayPtr3();
 
-    const int32_t * ptr = this->coordIndex.getValues(0);
-    const int32_t * endptr = ptr + this->coordIndex.getNum();
-    while (ptr < endptr) {
-      const int idx = *ptr++;
-      if (idx < numcoords) {
-        if (idx >= 0) {
-          box.extendBy(coords[idx]);
-          center += coords[idx];
-          numacc++;
-        }
-      }
+    const int32_t * indices = this->coordIndex.getValues(0);
+    const int numindices = this->coordIndex.getNum();
+    SbCoordBounds bounds;
+    bounds.extendBy(coords, numcoords, indices, numindices,
+                    SoGetBoundingBoxActionP::getScheduler(action));
+    if (bounds.getNumCoords() > 0) box.extendBy(bounds.getBox());
+    center = bounds.getCenter();
 #if COIN_DEBUG
-      else {
-        const ptrdiff_t faultyidxpos = (ptr - this->coordIndex.getValues(0)) - 1;
-        error_idx_out_of_bounds(this, (int)faultyidxpos, numcoords - 1);
+    for (int i = 0; bounds.getNumInvalidIndices() > 0 && i < numindices; i++) {
+      if (indices[i] >= numcoords) {
+        error_idx_out_of_bounds(this, i, numcoords - 1);
         if (numcoords <= 1) break; // give only one error msg on missing coords
         // (the default state is that there's a default
         // SoCoordinateElement element with a single default
         // coordinate point setup)
       }
-#endif // COIN_DEBUG
     }
+#endif // COIN_DEBUG
   }
   else {
     SbVec3f tmp;
@@ -214,8 +212,8 @@ SoIndexedShape::computeBBox(SoAction * action, SbBox3f & box, SbVec3f & center)
       }
 #endif // COIN_DEBUG
     }
+    if (numacc) center /= (float) numacc;
   }
-  if (numacc) center /= (float) numacc;
 }
 
 /*!
@@ -0,0 +1,339 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*!
+  \class SoLODIndexedFaceSet SoLODIndexedFaceSet.h Inventor/nodes/SoLODIndexedFaceSet.h
+  \brief The SoLODIndexedFaceSet class is an indexed face set with automatic level of detail.
+
+  \ingroup nodes
+
+  This node is used like SoIndexedFaceSet, but renders large meshes
+  (terrains, scanned models) at a cost which depends on how large
+  they are on the screen rather than on the number of polygons.
+
+  The first time the node is rendered, its triangles are split into
+  small spatially coherent clusters, which are grouped into a binary
+  hierarchy. Each group of clusters also gets a simplified version of
+  its triangles, made with quadric error metric edge collapses, and
+  an error bound telling how far the simplified triangles are from
+  the original ones. The simplification never creates new vertices,
+  so normals, colors and texture coordinates are preserved, and it
+  does not move vertices on texture coordinate or color seams, on
+  non-manifold edges or on the borders between groups.
+
+  When rendering, the node walks the hierarchy and picks, for each
+  part of the mesh, the coarsest group whose error projects to at
+  most SoLODIndexedFaceSet::screenSpaceError pixels. Groups outside
+  the view volume are skipped. Since the borders between groups are
+  never simplified independently, the picked groups always form a
+  mesh without cracks.
+
+  The SoComplexity::value (through SoComplexityElement) scales the
+  allowed error: the default complexity, 0.5, uses
+  SoLODIndexedFaceSet::screenSpaceError as it is, 1.0 allows 1/16 of
+  it, and 0.0 allows 16 times it.
+
+  The hierarchy is rebuilt when the node or its coordinates, normals
+  or materials change, so the node is best suited for static
+  geometry. Only the first texture unit is used. The level of detail
+  is only used for rendering; other actions, like SoRayPickAction and
+  SoGetBoundingBoxAction, always use the full resolution mesh. The
+  node falls back to rendering like SoIndexedFaceSet when the mesh
+  can't be used, for instance when it contains line or point
+  primitives, and in the special rendering modes handled by SoShape,
+  like sorted transparent triangles and big textures.
+
+  <b>FILE FORMAT/DEFAULTS:</b>
+  \code
+    LODIndexedFaceSet {
+        vertexProperty NULL
+        coordIndex 0
+        materialIndex -1
+        normalIndex -1
+        textureCoordIndex -1
+        screenSpaceError 1
+    }
+  \endcode
+
+  \sa SoIndexedFaceSet, SoLOD, SoLevelOfDetail
+  \COIN_CLASS_EXTENSION
+  \since Coin 4.1
+*/
+
+// *************************************************************************
+
+#include <Inventor/nodes/SoLODIndexedFaceSet.h>
+
+#include <cmath>
+
+#include <Inventor/SbColor.h>
+
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/bundles/SoMaterialBundle.h>
+#include <Inventor/caches/SoPrimitiveVertexCache.h>
+#include <Inventor/elements/SoCacheElement.h>
+#include <Inventor/elements/SoComplexityElement.h>
+#include <Inventor/elements/SoGLCacheContextElement.h>
+#include <Inventor/elements/SoGLMultiTextureImageElement.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/misc/SoState.h>
+#include <Inventor/nodes/SoVertexProperty.h>
+#include <Inventor/threads/SbMutex.h>
+
+#include "nodes/SoSubNodeP.h"
+#include "shapenodes/soshape_clusterlod.h"
+
+// *************************************************************************
+
+/*!
+  \var SoSFFloat SoLODIndexedFaceSet::screenSpaceError
+
+  The largest allowed error, in pixels, at the default complexity.
+  Smaller values render more triangles. The default value is 1.0.
+*/
+
+// *************************************************************************
+
+class SoLODIndexedFaceSetP {
+public:
+  SoLODIndexedFaceSetP(void)
+    : lod(NULL),
+      nodeid(0),
+      numclusters(0),
+      numtriangles(0)
+  { }
+
+  soshape_clusterlod * lod;
+  SbUniqueId nodeid;
+  // the selection in the last frame
+  SbList <int> ranges;
+  int numclusters;
+  int numtriangles;
+  SbMutex mutex;
+};
+
+#define PRIVATE(obj) ((obj)->pimpl)
+
+// *************************************************************************
+
+SO_NODE_SOURCE(SoLODIndexedFaceSet);
+
+/*!
+  Constructor.
+*/
+SoLODIndexedFaceSet::SoLODIndexedFaceSet(void)
+{
+  PRIVATE(this) = new SoLODIndexedFaceSetP;
+
+  SO_NODE_INTERNAL_CONSTRUCTOR(SoLODIndexedFaceSet);
+
+  SO_NODE_ADD_FIELD(screenSpaceError, (1.0f));
+}
+
+/*!
+  Destructor.
+*/
+SoLODIndexedFaceSet::~SoLODIndexedFaceSet()
+{
+  delete PRIVATE(this)->lod;
+  delete PRIVATE(this);
+}
+
+// Doc in superclass.
+/*!
+  \copybrief SoBase::initClass(void)
+*/
+void
+SoLODIndexedFaceSet::initClass(void)
+{
+  SO_NODE_INTERNAL_INIT_CLASS(SoLODIndexedFaceSet, SO_FROM_COIN_4_0);
+}
+
+// Doc in superclass.
+void
+SoLODIndexedFaceSet::GLRender(SoGLRenderAction * action)
+{
+  if (this->coordIndex.getNum() < 3) return;
+  SoState * state = action->getState();
+
+  state->push();
+  if (this->vertexProperty.getValue()) {
+    this->vertexProperty.getValue()->GLRender(action);
+  }
+  if (!this->shouldGLRender(action)) {
+    state->pop();
+    return;
+  }
+
+  PRIVATE(this)->mutex.lock();
+  soshape_clusterlod * lod = PRIVATE(this)->lod;
+  if (lod == NULL ||
+      PRIVATE(this)->nodeid != this->getNodeId() ||
+      !lod->getPrimitiveVertexCache()->isValid(state)) {
+    delete lod;
+
+    // capture the triangles like SoShape does for vertex array
+    // rendering, with the same cache dependencies
+    SoCacheElement::invalidate(state);
+    SbBool storedinvalid = SoCacheElement::setInvalid(FALSE);
+    state->push();
+    SoPrimitiveVertexCache * pvcache = new SoPrimitiveVertexCache(state);
+    pvcache->ref();
+    SoCacheElement::set(state, pvcache);
+    soshape_set_pvcache_capture(pvcache);
+    this->generatePrimitives(action);
+    soshape_set_pvcache_capture(NULL);
+    state->pop();
+    SoCacheElement::setInvalid(storedinvalid);
+    pvcache->close(state);
+
+    lod = PRIVATE(this)->lod = new soshape_clusterlod(pvcache);
+    pvcache->unref();
+    PRIVATE(this)->nodeid = this->getNodeId();
+  }
+
+  const SoPrimitiveVertexCache * pvcache = lod->getPrimitiveVertexCache();
+  if (lod->getNumTriangles() == 0 ||
+      pvcache->getNumLineIndices() || pvcache->getNumPointIndices()) {
+    PRIVATE(this)->numclusters = 0;
+    PRIVATE(this)->numtriangles = 0;
+    PRIVATE(this)->mutex.unlock();
+    state->pop();
+    inherited::GLRender(action);
+    return;
+  }
+
+  // the selection depends on the camera, so don't let a render cache
+  // keep it
+  SoGLCacheContextElement::shouldAutoCache(state,
+                                           SoGLCacheContextElement::DONT_AUTO_CACHE);
+
+  const float complexity =
+    SoShape::getDecimatedComplexity(state, SoComplexityElement::get(state));
+  const float maxpixels = this->screenSpaceError.getValue() *
+    static_cast<float>(pow(2.0, (0.5 - complexity) * 8.0));
+
+  lod->select(state, maxpixels, PRIVATE(this)->ranges, PRIVATE(this)->numclusters);
+  int numindices = 0;
+  for (int i = 1; i < PRIVATE(this)->ranges.getLength(); i += 2) {
+    numindices += PRIVATE(this)->ranges[i];
+  }
+  PRIVATE(this)->numtriangles = numindices / 3;
+
+  SoGLMultiTextureImageElement::Model model;
+  SbColor blendcolor;
+  const SbBool texture =
+    SoGLMultiTextureImageElement::get(state, 0, model, blendcolor) != NULL;
+
+  SoMaterialBundle mb(action);
+  mb.sendFirst();
+  lod->render(state, PRIVATE(this)->ranges, texture);
+  PRIVATE(this)->mutex.unlock();
+
+  state->pop();
+}
+
+/*!
+  Returns the number of clusters and triangles rendered in the last
+  frame. Both are 0 if the node was not rendered with level of
+  detail.
+*/
+void
+SoLODIndexedFaceSet::getLODStatistics(int & numclusters, int & numtriangles) const
+{
+  numclusters = PRIVATE(this)->numclusters;
+  numtriangles = PRIVATE(this)->numtriangles;
+}
+
+#undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoInput.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/actions/SoGetPrimitiveCountAction.h>
+#include <Inventor/nodes/SoSeparator.h>
+
+BOOST_AUTO_TEST_CASE(initialized)
+{
+  SoLODIndexedFaceSet * node = new SoLODIndexedFaceSet;
+  assert(node);
+  node->ref();
+  BOOST_CHECK_MESSAGE(node->getTypeId() != SoType::badType(),
+                      "missing class initialization");
+  BOOST_CHECK_MESSAGE(node->screenSpaceError.getValue() == 1.0f,
+                      "wrong default screenSpaceError");
+  int numclusters, numtriangles;
+  node->getLODStatistics(numclusters, numtriangles);
+  BOOST_CHECK_MESSAGE(numclusters == 0 && numtriangles == 0,
+                      "statistics should be empty before rendering");
+  node->unref();
+}
+
+BOOST_AUTO_TEST_CASE(fullResolutionActions)
+{
+  static const char scene[] =
+    "#Inventor V2.1 ascii\n"
+    "Separator {\n"
+    "  Coordinate3 { point [ 0 0 0, 1 0 0, 1 1 0, 0 1 0, 2 0 1, 2 1 1 ] }\n"
+    "  LODIndexedFaceSet {\n"
+    "    coordIndex [ 0, 1, 2, 3, -1, 1, 4, 5, 2, -1 ]\n"
+    "    screenSpaceError 4\n"
+    "  }\n"
+    "}\n";
+  SoInput in;
+  in.setBuffer(scene, strlen(scene));
+  SoSeparator * root = SoDB::readAll(&in);
+  BOOST_REQUIRE_MESSAGE(root != NULL, "failed to read LODIndexedFaceSet");
+  root->ref();
+  BOOST_CHECK_MESSAGE(root->getChild(1)->isOfType(SoLODIndexedFaceSet::getClassTypeId()),
+                      "wrong node type");
+  BOOST_CHECK_MESSAGE(static_cast<SoLODIndexedFaceSet *>(root->getChild(1))->screenSpaceError.getValue() == 4.0f,
+                      "screenSpaceError not read");
+
+  SoGetBoundingBoxAction bboxaction(SbViewportRegion(100, 100));
+  bboxaction.apply(root);
+  const SbBox3f box = bboxaction.getBoundingBox();
+  BOOST_CHECK_MESSAGE(box.getMin() == SbVec3f(0.0f, 0.0f, 0.0f) &&
+                      box.getMax() == SbVec3f(2.0f, 1.0f, 1.0f),
+                      "wrong bounding box");
+
+  SoGetPrimitiveCountAction countaction;
+  countaction.apply(root);
+  BOOST_CHECK_MESSAGE(countaction.getTriangleCount() == 4,
+                      "other actions should see the full resolution mesh");
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -46,6 +46,8 @@
 #include <Inventor/actions/SoAction.h>
 #include <Inventor/elements/SoCoordinateElement.h>
 
+#include "actions/SoGetBoundingBoxActionP.h"
+#include "misc/SbCoordBounds.h"
 #include "nodes/SoSubNodeP.h"
 
 /*!  
@@ -130,11 +132,12 @@ SoNonIndexedShape::computeCoordBBox(SoAction * action, int numVertices,
     const SbVec3f * coords = vpvtx ?
       vp->vertex.getValues(0) :
       coordelem->getArrayPtr3();
-    
-    for (int i = startidx; i <= lastidx; i++) {
-      box.extendBy(coords[i]);
-      center += coords[i];
-    }
+
+    SbCoordBounds bounds;
+    bounds.extendBy(coords + startidx, lastidx + 1 - startidx,
+                    SoGetBoundingBoxActionP::getScheduler(action));
+    if (bounds.getNumCoords() > 0) box.extendBy(bounds.getBox());
+    center = bounds.getCenter();
   }
   else { // 4D
     SbVec3f tmp;
@@ -145,9 +148,9 @@ SoNonIndexedShape::computeCoordBBox(SoAction * action, int numVertices,
       box.extendBy(tmp);
       center += tmp;
     }
-  }
-  if (lastidx+1 - startidx) {
-    center /= float(lastidx + 1 - startidx);
+    if (lastidx+1 - startidx) {
+      center /= float(lastidx + 1 - startidx);
+    }
   }
 }
 
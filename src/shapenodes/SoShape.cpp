@@ -56,6 +56,7 @@
 #include <Inventor/C/tidbits.h>
 #include <Inventor/SbBox2f.h>
 #include <Inventor/SbClip.h>
+#include <Inventor/SbLine.h>
 #include <Inventor/SbPlane.h>
 #include <Inventor/SbTime.h>
 #include <Inventor/SoPickedPoint.h>
@@ -90,6 +91,7 @@
 #include <Inventor/elements/SoMultiTextureCoordinateElement.h>
 #include <Inventor/elements/SoMultiTextureEnabledElement.h>
 #include <Inventor/elements/SoNormalElement.h>
+#include <Inventor/elements/SoPickStyleElement.h>
 #include <Inventor/elements/SoProjectionMatrixElement.h>
 #include <Inventor/elements/SoShapeHintsElement.h>
 #include <Inventor/elements/SoShapeStyleElement.h>
@@ -101,7 +103,12 @@
 #include <Inventor/misc/SoGLBigImage.h>
 #include <Inventor/misc/SoGLDriverDatabase.h>
 #include <Inventor/misc/SoState.h>
+#include <Inventor/nodes/SoFaceSet.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoIndexedTriangleStripSet.h>
 #include <Inventor/nodes/SoLight.h>
+#include <Inventor/nodes/SoQuadMesh.h>
+#include <Inventor/nodes/SoTriangleStripSet.h>
 #include <Inventor/nodes/SoVertexProperty.h>
 #include <Inventor/nodes/SoVertexShape.h>
 #include <Inventor/system/gl.h>
@@ -120,6 +127,9 @@
 #include "threads/threadsutilp.h"
 #include "tidbitsp.h"
 #include "rendering/SoVBO.h"
+#include "rendering/SoOcclusionCuller.h"
+#include "caches/SoPrimitiveBVHCache.h"
+#include "caches/SoInstanceCache.h"
 #include "coindefs.h" // COIN_OBSOLETED()
 
 // SoShape.cpp grew too big, so I had to move some code into new
@@ -128,6 +138,7 @@
 #include "soshape_trianglesort.h"
 #include "soshape_bigtexture.h"
 #include "soshape_bumprender.h"
+#include "soshape_clusterlod.h"
 
 // *************************************************************************
 
@@ -175,6 +186,7 @@ public:
   SoShapeP() {
     this->bboxcache = NULL;
     this->pvcache = NULL;
+    this->bvhcache = NULL;
     this->bumprender = NULL;
     this->rendercnt = 0;
     this->flags = 0;
@@ -182,6 +194,7 @@ public:
   ~SoShapeP() {
     if (this->bboxcache) { this->bboxcache->unref(); }
     if (this->pvcache) { this->pvcache->unref(); }
+    if (this->bvhcache) { this->bvhcache->unref(); }
     delete this->bumprender;
   }
   enum {
@@ -192,12 +205,14 @@ public:
     SHOULD_BBOX_CACHE = 0x1,
     NEED_SETUP_SHAPE_HINTS = 0x2,
     DISABLE_VERTEX_ARRAY_CACHE = 0x4,
+    SHOULD_BVH_CACHE = 0x8
   };
 
   static void calibrateBBoxCache(void);
   static double bboxcachetimelimit;
   SoBoundingBoxCache * bboxcache;
   SoPrimitiveVertexCache * pvcache;
+  SoPrimitiveBVHCache * bvhcache;
   soshape_bumprender * bumprender;
   uint32_t flags : FLAG_BITS;
   // stores the number of frames rendered with no node changes
@@ -248,9 +263,13 @@ public:
 #endif // ! COIN_THREADSAFE
 
   static void cleanup(void);
+
+  static int bvhmintriangles;
+  static SbBool canUseBVHCache(SoShape * shape);
 };
 
 double SoShapeP::bboxcachetimelimit;
+int SoShapeP::bvhmintriangles;
 
 SbMutex * SoShapeP::mutex = NULL;
 
@@ -264,7 +283,9 @@ enum SoShapeRenderMode {
   NORMAL,
   BIGTEXTURE,
   SORTED_TRIANGLES,
-  PVCACHE
+  PVCACHE,
+  OCCLUDER,
+  INSTANCE
 };
 
 typedef struct {
@@ -273,6 +294,21 @@ typedef struct {
   SbList <uint32_t> * bigtexturecontext;
   soshape_trianglesort * trianglesort;
 
+  // set while the triangles for a BVH cache are generated
+  SoPrimitiveBVHCache * bvhcapture;
+  // number of triangles tested during the last pick
+  int picktriangles;
+
+  // set while an occluder is rasterized
+  SoOcclusionCuller * occlusionculler;
+
+  // set while the geometry for an SoInstancedMultipleCopy is captured
+  SoInstanceCache * instancecapture;
+
+  // set while an SoLODIndexedFaceSet captures its triangles. Used
+  // instead of the shape's own cache in PVCACHE mode.
+  SoPrimitiveVertexCache * pvcapture;
+
   soshape_bigtexture * currentbigtexture;
   // used in generatePrimitives() callbacks to set correct material
   SoMaterialBundle * currentbundle;
@@ -304,6 +340,11 @@ soshape_construct_staticdata(void * closure)
   data->primdata = new soshape_primdata();
   data->trianglesort = new soshape_trianglesort();
   data->rendermode = NORMAL;
+  data->bvhcapture = NULL;
+  data->picktriangles = 0;
+  data->occlusionculler = NULL;
+  data->instancecapture = NULL;
+  data->pvcapture = NULL;
 }
 
 static void
@@ -327,6 +368,26 @@ soshape_get_staticdata(void)
   return (soshape_staticdata*) soshape_staticstorage->get();
 }
 
+SoInstanceCache *
+soshape_instance_capture(void)
+{
+  return soshape_get_staticdata()->instancecapture;
+}
+
+void
+soshape_set_instance_capture(SoInstanceCache * cache)
+{
+  soshape_get_staticdata()->instancecapture = cache;
+}
+
+void
+soshape_set_pvcache_capture(SoPrimitiveVertexCache * cache)
+{
+  soshape_staticdata * data = soshape_get_staticdata();
+  data->pvcapture = cache;
+  data->rendermode = cache ? PVCACHE : NORMAL;
+}
+
 // called by atexit
 void
 SoShapeP::cleanup(void)
@@ -379,6 +440,12 @@ SoShape::initClass(void)
                   soshape_destruct_staticdata);
   SoShapeP::calibrateBBoxCache();
 
+  // shapes with fewer triangles than this are picked without a BVH
+  // cache
+  SoShapeP::bvhmintriangles = 128;
+  const char * env = coin_getenv("COIN_PICK_BVH_MIN_TRIANGLES");
+  if (env) SoShapeP::bvhmintriangles = atoi(env);
+
   coin_atexit((coin_atexit_f *)SoShapeP::cleanup, CC_ATEXIT_NORMAL);
 }
 
@@ -445,9 +512,72 @@ soshape_ray_intersect(SoRayPickAction * action, const SbBox3f & box)
   return action->intersect(box, TRUE);
 }
 
+// test triangle intersection, and add a picked point if the triangle
+// is hit. The caller must set the detail of the picked point.
+static SoPickedPoint *
+soshape_ray_pick_triangle(SoRayPickAction * ra,
+                          const SoPrimitiveVertex * v1,
+                          const SoPrimitiveVertex * v2,
+                          const SoPrimitiveVertex * v3)
+{
+  SbVec3f intersection;
+  SbVec3f barycentric;
+  SbBool front;
+
+  if (!ra->intersect(v1->getPoint(), v2->getPoint(), v3->getPoint(),
+                     intersection, barycentric, front)) return NULL;
+  if (!ra->isBetweenPlanes(intersection)) return NULL;
+
+  if (SoShapeHintsElement::getVertexOrdering(ra->getState()) ==
+      SoShapeHintsElement::CLOCKWISE) {
+    front = !front;
+  }
+  SoPickedPoint * pp = ra->addIntersection(intersection, front);
+  if (pp) {
+    // calculate normal at picked point
+    SbVec3f n =
+      v1->getNormal() * barycentric[0] +
+      v2->getNormal() * barycentric[1] +
+      v3->getNormal() * barycentric[2];
+    n.normalize();
+    pp->setObjectNormal(n);
+
+    // calculate texture coordinate at picked point
+    SbVec4f tc =
+      v1->getTextureCoords() * barycentric[0] +
+      v2->getTextureCoords() * barycentric[1] +
+      v3->getTextureCoords() * barycentric[2];
+
+    pp->setObjectTextureCoords(tc);
+
+    // material index need to be approximated, since there is no
+    // way to average material indices :( This makes it
+    // impossible to fully support color per vertex. An
+    // extension to the OIV API would perhaps be a good idea
+    // here? Maybe calculate the rgba value for diffuse and
+    // transparency and set it in SoPickedPoint?
+    float maxval = barycentric[0];
+    const SoPrimitiveVertex * maxv = v1;
+    if (barycentric[1] > maxval) {
+      maxv = v2;
+      maxval = barycentric[1];
+    }
+    if (barycentric[2] > maxval) {
+      maxv = v3;
+    }
+    pp->setMaterialIndex(maxv->getMaterialIndex());
+  }
+  return pp;
+}
 
 /*!
   Calculates picked point based on primitives generated by subclasses.
+
+  For the face set and triangle strip set nodes, a bounding volume
+  hierarchy over the generated triangles is cached when a shape with
+  many triangles is picked repeatedly without changing, so that only
+  the triangles close to the pick ray need to be tested. The picked
+  points are the same as without the cache.
 */
 void
 SoShape::rayPick(SoRayPickAction * action)
@@ -458,7 +588,19 @@ SoShape::rayPick(SoRayPickAction * action)
     if (!PRIVATE(this)->bboxcache ||
         !PRIVATE(this)->bboxcache->isValid(action->getState()) ||
         soshape_ray_intersect(action, PRIVATE(this)->bboxcache->getProjectedBox())) {
-      this->generatePrimitives(action);
+      if (!this->rayPickBVH(action)) {
+        soshape_staticdata * shapedata = soshape_get_staticdata();
+        shapedata->picktriangles = 0;
+        this->generatePrimitives(action);
+        // create a BVH cache the next time if the shape doesn't change
+        if (SoShapeP::bvhmintriangles > 0 &&
+            shapedata->picktriangles >= SoShapeP::bvhmintriangles &&
+            SoShapeP::canUseBVHCache(this)) {
+          PRIVATE(this)->lock();
+          PRIVATE(this)->flags |= SoShapeP::SHOULD_BVH_CACHE;
+          PRIVATE(this)->unlock();
+        }
+      }
     }
   }
 }
@@ -573,6 +715,27 @@ SoShape::shouldGLRender(SoGLRenderAction * action)
   SbBool transparent = (shapestyleflags & (SoShapeStyleElement::TRANSP_TEXTURE|
                                            SoShapeStyleElement::TRANSP_MATERIAL)) != 0;
 
+  // add the triangles to the instance cache instead of rendering
+  soshape_staticdata * capturedata = soshape_get_staticdata();
+  if (capturedata->instancecapture) {
+    if (transparent ||
+        (shapestyleflags & (SoShapeStyleElement::TEXENABLED|
+                            SoShapeStyleElement::TEX3ENABLED|
+                            SoShapeStyleElement::BBOXCMPLX|
+                            SoShapeStyleElement::BIGIMAGE|
+                            SoShapeStyleElement::BUMPMAP|
+                            SoShapeStyleElement::SHADOWMAP|
+                            SoShapeStyleElement::SHADOWS))) {
+      capturedata->instancecapture->abortCapture();
+    }
+    else {
+      capturedata->rendermode = INSTANCE;
+      this->generatePrimitives(action);
+      capturedata->rendermode = NORMAL;
+    }
+    return FALSE;
+  }
+
   if (shapestyleflags & SoShapeStyleElement::SHADOWMAP) {
     if (transparent) return FALSE;
     int style = SoShadowStyleElement::get(state);
@@ -588,6 +751,26 @@ SoShape::shouldGLRender(SoGLRenderAction * action)
     return FALSE;
   }
 
+  // opaque shapes covering much of the screen are rasterized into the
+  // software occlusion buffer before they are rendered
+  if (!transparent && !state->isCacheOpen()) {
+    SoOcclusionCuller * culler = sogl_occlusion_culler(action);
+    if (culler && culler->getType() == SoGLRenderAction::OCCLUSION_CULLING_SOFTWARE) {
+      SbBox3f box;
+      SbVec3f center;
+      this->getBBox(action, box, center);
+      if (culler->beginOccluder(state, this, box)) {
+        soshape_staticdata * shapedata = soshape_get_staticdata();
+        shapedata->occlusionculler = culler;
+        shapedata->rendermode = OCCLUDER;
+        this->generatePrimitives(action);
+        shapedata->rendermode = NORMAL;
+        shapedata->occlusionculler = NULL;
+        culler->endOccluder();
+      }
+    }
+  }
+
   // test if we should sort triangles before rendering
   if (transparent && (shapestyleflags & SoShapeStyleElement::TRANSP_SORTED_TRIANGLES)) {
     // lock since pvcache is shared among all threads
@@ -988,56 +1171,20 @@ SoShape::invokeTriangleCallbacks(SoAction * const action,
 {
   if (action->getTypeId().isDerivedFrom(SoRayPickAction::getClassTypeId())) {
     SoRayPickAction * ra = (SoRayPickAction *) action;
+    soshape_staticdata * shapedata = soshape_get_staticdata();
 
-    SbVec3f intersection;
-    SbVec3f barycentric;
-    SbBool front;
-
-    if (ra->intersect(v1->getPoint(), v2->getPoint(), v3->getPoint(),
-                      intersection, barycentric, front)) {
-
-      if (ra->isBetweenPlanes(intersection)) {
-        if (SoShapeHintsElement::getVertexOrdering(ra->getState()) ==
-            SoShapeHintsElement::CLOCKWISE) {
-          front = !front;
-        }
-        SoPickedPoint * pp = ra->addIntersection(intersection, front);
-        if (pp) {
-          pp->setDetail(this->createTriangleDetail(ra, v1, v2, v3, pp), this);
-          // calculate normal at picked point
-          SbVec3f n =
-            v1->getNormal() * barycentric[0] +
-            v2->getNormal() * barycentric[1] +
-            v3->getNormal() * barycentric[2];
-          n.normalize();
-          pp->setObjectNormal(n);
-
-          // calculate texture coordinate at picked point
-          SbVec4f tc =
-            v1->getTextureCoords() * barycentric[0] +
-            v2->getTextureCoords() * barycentric[1] +
-            v3->getTextureCoords() * barycentric[2];
-
-          pp->setObjectTextureCoords(tc);
+    if (shapedata->bvhcapture) {
+      SoDetail * detail = shapedata->primdata->faceDetail ?
+        shapedata->primdata->createPickDetail() : NULL;
+      shapedata->bvhcapture->addTriangle(v1, v2, v3, detail);
+      delete detail;
+      return;
+    }
+    shapedata->picktriangles++;
 
-          // material index need to be approximated, since there is no
-          // way to average material indices :( This makes it
-          // impossible to fully support color per vertex. An
-          // extension to the OIV API would perhaps be a good idea
-          // here? Maybe calculate the rgba value for diffuse and
-          // transparency and set it in SoPickedPoint?
-          float maxval = barycentric[0];
-          const SoPrimitiveVertex * maxv = v1;
-          if (barycentric[1] > maxval) {
-            maxv = v2;
-            maxval = barycentric[1];
-          }
-          if (barycentric[2] > maxval) {
-            maxv = v3;
-          }
-          pp->setMaterialIndex(maxv->getMaterialIndex());
-        }
-      }
+    SoPickedPoint * pp = soshape_ray_pick_triangle(ra, v1, v2, v3);
+    if (pp) {
+      pp->setDetail(this->createTriangleDetail(ra, v1, v2, v3, pp), this);
     }
   }
   else if (action->getTypeId().isDerivedFrom(SoCallbackAction::getClassTypeId())) {
@@ -1058,13 +1205,21 @@ SoShape::invokeTriangleCallbacks(SoAction * const action,
     case BIGTEXTURE:
       shapedata->currentbigtexture->triangle(action->getState(), v1, v2, v3);
       break;
+    case OCCLUDER:
+      shapedata->occlusionculler->addTriangle(v1->getPoint(), v2->getPoint(), v3->getPoint());
+      break;
+    case INSTANCE:
+      shapedata->instancecapture->addTriangle(action->getState(), v1, v2, v3);
+      break;
     case PVCACHE:
       {
         int pdidx[3];
         pdidx[0] = shapedata->primdata->getPointDetailIndex(v1);
         pdidx[1] = shapedata->primdata->getPointDetailIndex(v2);
         pdidx[2] = shapedata->primdata->getPointDetailIndex(v3);
-        PRIVATE(this)->pvcache->addTriangle(v1, v2, v3, pdidx);
+        SoPrimitiveVertexCache * pvcache = shapedata->pvcapture ?
+          shapedata->pvcapture : PRIVATE(this)->pvcache;
+        pvcache->addTriangle(v1, v2, v3, pdidx);
       }
       break;
     default:
@@ -1099,6 +1254,12 @@ SoShape::invokeLineSegmentCallbacks(SoAction * const action,
 {
   if (action->getTypeId().isDerivedFrom(SoRayPickAction::getClassTypeId())) {
     SoRayPickAction * ra = (SoRayPickAction *) action;
+    soshape_staticdata * shapedata = soshape_get_staticdata();
+    if (shapedata->bvhcapture) {
+      // the BVH cache only handles triangles
+      shapedata->bvhcapture->invalidate();
+      return;
+    }
 
     SbVec3f intersection;
     if (ra->intersect(v1->getPoint(), v2->getPoint(), intersection)) {
@@ -1145,7 +1306,12 @@ SoShape::invokeLineSegmentCallbacks(SoAction * const action,
     soshape_staticdata * shapedata = soshape_get_staticdata();
     switch (shapedata->rendermode) {
     case PVCACHE:
-      PRIVATE(this)->pvcache->addLine(v1, v2);
+      (shapedata->pvcapture ? shapedata->pvcapture : PRIVATE(this)->pvcache)->addLine(v1, v2);
+      break;
+    case OCCLUDER:
+      break;
+    case INSTANCE:
+      shapedata->instancecapture->abortCapture();
       break;
     default:
       glBegin(GL_LINES);
@@ -1173,6 +1339,12 @@ SoShape::invokePointCallbacks(SoAction * const action,
 {
   if (action->getTypeId().isDerivedFrom(SoRayPickAction::getClassTypeId())) {
     SoRayPickAction * ra = (SoRayPickAction *) action;
+    soshape_staticdata * shapedata = soshape_get_staticdata();
+    if (shapedata->bvhcapture) {
+      // the BVH cache only handles triangles
+      shapedata->bvhcapture->invalidate();
+      return;
+    }
 
     SbVec3f intersection = v->getPoint();
     if (ra->intersect(intersection)) {
@@ -1200,7 +1372,12 @@ SoShape::invokePointCallbacks(SoAction * const action,
 
     switch (shapedata->rendermode) {
     case PVCACHE:
-      PRIVATE(this)->pvcache->addPoint(v);
+      (shapedata->pvcapture ? shapedata->pvcapture : PRIVATE(this)->pvcache)->addPoint(v);
+      break;
+    case OCCLUDER:
+      break;
+    case INSTANCE:
+      shapedata->instancecapture->abortCapture();
       break;
     default:
       glBegin(GL_POINTS);
@@ -1428,7 +1605,10 @@ SoShape::notify(SoNotList * nl)
   if (PRIVATE(this)->pvcache) {
     PRIVATE(this)->pvcache->invalidate();
   }
-  PRIVATE(this)->flags &= ~SoShapeP::SHOULD_BBOX_CACHE;
+  if (PRIVATE(this)->bvhcache) {
+    PRIVATE(this)->bvhcache->invalidate();
+  }
+  PRIVATE(this)->flags &= ~(SoShapeP::SHOULD_BBOX_CACHE|SoShapeP::SHOULD_BVH_CACHE);
   PRIVATE(this)->rendercnt = 0;
   PRIVATE(this)->unlock();
 }
@@ -1788,5 +1968,243 @@ SoShape::validatePVCache(SoGLRenderAction * action)
   }
 }
 
+// The shapes we know create the same pick details as
+// SoShape::createTriangleDetail(), and only generate triangles.
+SbBool
+SoShapeP::canUseBVHCache(SoShape * shape)
+{
+  return
+    shape->isOfType(SoIndexedFaceSet::getClassTypeId()) ||
+    shape->isOfType(SoFaceSet::getClassTypeId()) ||
+    shape->isOfType(SoIndexedTriangleStripSet::getClassTypeId()) ||
+    shape->isOfType(SoTriangleStripSet::getClassTypeId()) ||
+    shape->isOfType(SoQuadMesh::getClassTypeId())
+#ifdef HAVE_VRML97
+    || shape->isOfType(SoVRMLIndexedFaceSet::getClassTypeId())
+#endif // HAVE_VRML97
+    ;
+}
+
+typedef struct {
+  SoRayPickAction * action;
+  SbBool cullbackfaces;
+  SbBool clockwise;
+} soshape_bvh_pickdata;
+
+// returns TRUE if the triangle is hit, and the hit would not be
+// rejected by SoRayPickAction::addIntersection() because of back face
+// culling.
+static SbBool
+soshape_bvh_intersect_cb(void * closure,
+                         const SbVec3f & v0, const SbVec3f & v1, const SbVec3f & v2,
+                         SbVec3f & intersection)
+{
+  soshape_bvh_pickdata * data = (soshape_bvh_pickdata *) closure;
+  SbVec3f barycentric;
+  SbBool front;
+  if (!data->action->intersect(v0, v1, v2, intersection, barycentric, front)) return FALSE;
+  if (!data->action->isBetweenPlanes(intersection)) return FALSE;
+  if (data->clockwise) front = !front;
+  return front || !data->cullbackfaces;
+}
+
+// picks the shape using the BVH cache, creating it if the shape was
+// picked before without changing. Returns FALSE if the shape should
+// be picked the usual way.
+SbBool
+SoShape::rayPickBVH(SoRayPickAction * action)
+{
+  if (!PRIVATE(this)->bvhcache && !(PRIVATE(this)->flags & SoShapeP::SHOULD_BVH_CACHE)) {
+    return FALSE;
+  }
+  const SbLine & line = action->getLine();
+  if (line.getDirection() == SbVec3f(0.0f, 0.0f, 0.0f)) return FALSE;
+
+  SoState * state = action->getState();
+
+  // lock since the cache is shared among all threads
+  PRIVATE(this)->lock();
+  if (PRIVATE(this)->bvhcache && !PRIVATE(this)->bvhcache->isValid(state)) {
+    PRIVATE(this)->bvhcache->unref();
+    PRIVATE(this)->bvhcache = NULL;
+  }
+  if (!PRIVATE(this)->bvhcache) {
+    if (!(PRIVATE(this)->flags & SoShapeP::SHOULD_BVH_CACHE)) {
+      PRIVATE(this)->unlock();
+      return FALSE;
+    }
+    soshape_staticdata * shapedata = soshape_get_staticdata();
+    SbBool storedinvalid = SoCacheElement::setInvalid(FALSE);
+    // must push state to make cache dependencies work
+    state->push();
+    SoPrimitiveBVHCache * cache = new SoPrimitiveBVHCache(state);
+    cache->ref();
+    SoCacheElement::set(state, cache);
+    shapedata->bvhcapture = cache;
+    this->generatePrimitives(action);
+    shapedata->bvhcapture = NULL;
+    state->pop();
+    SoCacheElement::setInvalid(storedinvalid);
+
+    if (!cache->isValid(state)) {
+      // the shape generated lines or points, or changed while
+      // generating its triangles
+      cache->unref();
+      PRIVATE(this)->flags &= ~SoShapeP::SHOULD_BVH_CACHE;
+      PRIVATE(this)->unlock();
+      return FALSE;
+    }
+    cache->build();
+    PRIVATE(this)->bvhcache = cache;
+  }
+  SoPrimitiveBVHCache * cache = PRIVATE(this)->bvhcache;
+  cache->ref();
+  PRIVATE(this)->unlock();
+
+  const SoPickStyleElement::Style style = SoPickStyleElement::get(state);
+  soshape_bvh_pickdata data;
+  data.action = action;
+  data.cullbackfaces =
+    style == SoPickStyleElement::SHAPE_FRONTFACES &&
+    SoShapeHintsElement::getShapeType(state) == SoShapeHintsElement::SOLID &&
+    (SoShapeHintsElement::getVertexOrdering(state) == SoShapeHintsElement::COUNTERCLOCKWISE ||
+     SoShapeHintsElement::getVertexOrdering(state) == SoShapeHintsElement::CLOCKWISE);
+  data.clockwise =
+    SoShapeHintsElement::getVertexOrdering(state) == SoShapeHintsElement::CLOCKWISE;
+
+  // with SHAPE_ON_TOP, all hits have the same distance, and the first
+  // triangle hit is picked
+  const SbBool nearestonly =
+    !action->isPickAll() && style != SoPickStyleElement::SHAPE_ON_TOP;
+
+  SbList <int> triangles;
+  cache->findIntersections(line, nearestonly, soshape_bvh_intersect_cb, &data, triangles);
+
+  // add the picked points in the order the triangles were generated,
+  // so that we get the same result as when generating the primitives
+  SoPrimitiveVertex v1, v2, v3;
+  for (int i = 0; i < triangles.getLength(); i++) {
+    cache->getTriangle(triangles[i], v1, v2, v3);
+    SoPickedPoint * pp = soshape_ray_pick_triangle(action, &v1, &v2, &v3);
+    if (pp) {
+      pp->setDetail(cache->createPickDetail(triangles[i]), this);
+    }
+  }
+  cache->unref();
+  return TRUE;
+}
+
 
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <cmath>
+#include <Inventor/SbString.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/SoPickedPoint.h>
+#include <Inventor/actions/SoRayPickAction.h>
+#include <Inventor/details/SoFaceDetail.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoPickStyle.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoShapeHints.h>
+#include <Inventor/nodes/SoVertexProperty.h>
+
+// describes the picked points, so that picks with and without the BVH
+// cache can be compared
+static SbString
+soshape_test_pick(SoNode * root, const SbVec3f & start, const SbVec3f & dir,
+                  SbBool pickall)
+{
+  SoRayPickAction ra(SbViewportRegion(100, 100));
+  ra.setRay(start, dir);
+  ra.setPickAll(pickall);
+  ra.apply(root);
+
+  SbString result;
+  const SoPickedPointList & list = ra.getPickedPointList();
+  for (int i = 0; i < list.getLength(); i++) {
+    const SoPickedPoint * pp = list[i];
+    const SoFaceDetail * fd = (const SoFaceDetail *) pp->getDetail();
+    SbString str;
+    str.sprintf("(%g %g %g face %d, %d points, coord %d, normal %g %g %g, material %d) ",
+                pp->getObjectPoint()[0], pp->getObjectPoint()[1], pp->getObjectPoint()[2],
+                fd ? fd->getFaceIndex() : -1,
+                fd ? fd->getNumPoints() : -1,
+                fd ? fd->getPoint(0)->getCoordinateIndex() : -1,
+                pp->getObjectNormal()[0], pp->getObjectNormal()[1], pp->getObjectNormal()[2],
+                pp->getMaterialIndex());
+    result += str;
+  }
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(rayPickBVHCache)
+{
+  // two wavy layers of quads, so that vertical rays hit two faces,
+  // and some of them hit the edges and corners between faces
+  const int N = 24;
+  SoVertexProperty * vp = new SoVertexProperty;
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  ifs->vertexProperty = vp;
+  int i, j, layer, idx = 0;
+  for (layer = 0; layer < 2; layer++) {
+    for (j = 0; j <= N; j++) {
+      for (i = 0; i <= N; i++) {
+        vp->vertex.set1Value(layer * (N+1) * (N+1) + j * (N+1) + i,
+                             SbVec3f(float(i), float(j),
+                                     float(layer) + 0.3f * float(sin(i * 0.7) * cos(j * 0.4))));
+      }
+    }
+    for (j = 0; j < N; j++) {
+      for (i = 0; i < N; i++) {
+        const int base = layer * (N+1) * (N+1) + j * (N+1) + i;
+        ifs->coordIndex.set1Value(idx++, base);
+        ifs->coordIndex.set1Value(idx++, base + 1);
+        ifs->coordIndex.set1Value(idx++, base + N + 2);
+        if ((i + j) % 3) ifs->coordIndex.set1Value(idx++, base + N + 1);
+        ifs->coordIndex.set1Value(idx++, -1);
+      }
+    }
+  }
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoShapeHints * hints = new SoShapeHints;
+  SoPickStyle * pickstyle = new SoPickStyle;
+  root->addChild(hints);
+  root->addChild(pickstyle);
+  root->addChild(ifs);
+
+  for (int config = 0; config < 4; config++) {
+    if (config == 2) {
+      hints->vertexOrdering = SoShapeHints::COUNTERCLOCKWISE;
+      hints->shapeType = SoShapeHints::SOLID;
+      pickstyle->style = SoPickStyle::SHAPE_FRONTFACES;
+    }
+    const SbBool pickall = (config % 2) == 0;
+    for (int ray = 0; ray < 60; ray++) {
+      // the first rays go through the grid corners
+      const float x = ray < 20 ? float(ray % N) : 0.37f * ray;
+      const float y = ray < 20 ? float((ray * 7) % N) : 0.23f * ray;
+      const SbVec3f start(x, y, ray % 2 ? -5.0f : 5.0f);
+      const SbVec3f dir(0.01f * (ray % 5), 0.0f, ray % 2 ? 1.0f : -1.0f);
+
+      // touching the shape makes it pick without the cache
+      ifs->touch();
+      const SbString expected = soshape_test_pick(root, start, dir, pickall);
+      // the second pick creates the cache, the third one uses it
+      const SbString created = soshape_test_pick(root, start, dir, pickall);
+      const SbString cached = soshape_test_pick(root, start, dir, pickall);
+
+      BOOST_CHECK_MESSAGE(created == expected,
+                          (SbString("picked ") + created + "expected " + expected).getString());
+      BOOST_CHECK_MESSAGE(cached == expected,
+                          (SbString("picked ") + cached + "expected " + expected).getString());
+    }
+  }
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -44,6 +44,7 @@
 #include "SoIndexedPointSet.cpp"
 #include "SoIndexedShape.cpp"
 #include "SoIndexedTriangleStripSet.cpp"
+#include "SoLODIndexedFaceSet.cpp"
 #include "SoLineSet.cpp"
 #include "SoMarkerSet.cpp"
 #include "SoNonIndexedShape.cpp"
@@ -61,3 +62,4 @@
 #include "soshape_primdata.cpp"
 #include "soshape_trianglesort.cpp"
 #include "soshape_bumprender.cpp"
+#include "soshape_clusterlod.cpp"
@@ -0,0 +1,1236 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include "shapenodes/soshape_clusterlod.h"
+
+#include <cassert>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <Inventor/SbMatrix.h>
+#include <Inventor/SbViewVolume.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/caches/SoPrimitiveVertexCache.h>
+#include <Inventor/elements/SoCacheElement.h>
+#include <Inventor/elements/SoCullElement.h>
+#include <Inventor/elements/SoGLCacheContextElement.h>
+#include <Inventor/elements/SoGLLazyElement.h>
+#include <Inventor/elements/SoGLVBOElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoMultiTextureEnabledElement.h>
+#include <Inventor/elements/SoViewVolumeElement.h>
+#include <Inventor/elements/SoViewportRegionElement.h>
+#include <Inventor/misc/SoGLDriverDatabase.h>
+#include <Inventor/misc/SoState.h>
+
+#include "glue/glp.h"
+#include "rendering/SoVBO.h"
+
+// the maximum number of triangles in a leaf cluster
+static const int CLUSTERLOD_LEAF_SIZE = 256;
+
+// a node is only kept if it has at most this fraction of the
+// triangles of its children
+static const float CLUSTERLOD_MIN_REDUCTION = 0.85f;
+
+// relative weight of the planes keeping open borders in place
+static const double CLUSTERLOD_BORDER_WEIGHT = 10.0;
+
+enum {
+  // the position can never be moved: non-manifold, on an attribute
+  // seam, or where more than one border meets
+  CLUSTERLOD_LOCKED = 0x1,
+  // the position is on an open border, and may only slide along it
+  CLUSTERLOD_BORDER = 0x2
+};
+
+// *************************************************************************
+
+// symmetric 4x4 quadric for the sum of squared distances to a set of
+// planes, stored together with the total weight
+class soshape_clusterlod_quadric {
+public:
+  void reset(void) {
+    a2 = b2 = c2 = ab = ac = bc = ad = bd = cd = d2 = w = 0.0;
+  }
+  void addPlane(const SbVec3f & n, const double d, const double weight) {
+    const double a = n[0], b = n[1], c = n[2];
+    a2 += weight*a*a; b2 += weight*b*b; c2 += weight*c*c;
+    ab += weight*a*b; ac += weight*a*c; bc += weight*b*c;
+    ad += weight*a*d; bd += weight*b*d; cd += weight*c*d;
+    d2 += weight*d*d;
+    w += weight;
+  }
+  void add(const soshape_clusterlod_quadric & q) {
+    a2 += q.a2; b2 += q.b2; c2 += q.c2;
+    ab += q.ab; ac += q.ac; bc += q.bc;
+    ad += q.ad; bd += q.bd; cd += q.cd;
+    d2 += q.d2; w += q.w;
+  }
+  // the mean squared distance from p to the planes
+  double error(const SbVec3f & p) const {
+    const double x = p[0], y = p[1], z = p[2];
+    const double r =
+      a2*x*x + b2*y*y + c2*z*z +
+      2.0 * (ab*x*y + ac*x*z + bc*y*z) +
+      2.0 * (ad*x + bd*y + cd*z) + d2;
+    return w > 0.0 ? fabs(r) / w : 0.0;
+  }
+
+  double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2, w;
+};
+
+// *************************************************************************
+
+class soshape_clusterlod_builder {
+public:
+  soshape_clusterlod_builder(soshape_clusterlod * lod,
+                             const SbVec3f * vertices, const int numvertices,
+                             const SbVec3f * normals,
+                             const SbVec4f * texcoords,
+                             const uint8_t * colors);
+  void build(const GLint * triangles, const int numindices);
+
+private:
+  class candidate {
+  public:
+    float cost;
+    int u, v;
+    bool operator<(const candidate & c) const { return this->cost < c.cost; }
+  };
+
+  void calcPositions(void);
+  void calcFlags(void);
+  int partition(const int first, const int num);
+  float simplifyNode(const int idx, std::vector <int> & mesh);
+  float simplify(std::vector <int> & mesh, const int lo, const int hi, const int target);
+  int numShared(const int u, const int v) const;
+  void buildAdjacency(void);
+  int findWedge(const int * wedges, const int numwedges, const int oldvertex) const;
+  bool collapse(std::vector <int> & mesh, const int u, const int v);
+
+  soshape_clusterlod * lod;
+  const SbVec3f * vertices;
+  int numvertices;
+  const SbVec3f * normals;
+  const SbVec4f * texcoords;
+  const uint8_t * colors;
+
+  // all vertices with the same coordinates share one position,
+  // identified by the first such vertex
+  std::vector <int> remap;
+  std::vector <unsigned char> flags;
+  std::vector <int> minleaf, maxleaf;
+
+  // the input triangles, reordered into leaves by partition()
+  std::vector <int> triangles;
+  std::vector <SbVec3f> centroids;
+  std::vector <int> order;
+  int numleaves;
+  std::vector <int> leafof;
+  // the range of leaves below each node
+  std::vector <int> nodelo, nodehi;
+
+  std::vector <GLuint> leafindices;
+  std::vector <GLuint> nodeindices;
+
+  // scratch data for simplify(), indexed by local position
+  std::vector <int> localid;
+  std::vector <int> lpos;
+  std::vector <int> lcorner;
+  std::vector <unsigned char> lflags;
+  std::vector <soshape_clusterlod_quadric> quadrics;
+  std::vector <unsigned char> alive;
+  std::vector <unsigned char> touched;
+  std::vector <int> adjstart;
+  std::vector <int> adjtri;
+  std::vector <int> adjfill;
+  std::vector <int> stamp;
+  int curstamp;
+  std::vector <candidate> candidates;
+  int live;
+};
+
+soshape_clusterlod_builder::soshape_clusterlod_builder(soshape_clusterlod * lod,
+                                                       const SbVec3f * vertices,
+                                                       const int numvertices,
+                                                       const SbVec3f * normals,
+                                                       const SbVec4f * texcoords,
+                                                       const uint8_t * colors)
+  : lod(lod),
+    vertices(vertices),
+    numvertices(numvertices),
+    normals(normals),
+    texcoords(texcoords),
+    colors(colors),
+    numleaves(0),
+    curstamp(0),
+    live(0)
+{
+}
+
+void
+soshape_clusterlod_builder::build(const GLint * tris, const int numindices)
+{
+  this->calcPositions();
+
+  // skip triangles which are degenerate in position
+  this->triangles.reserve(numindices);
+  for (int i = 0; i + 2 < numindices; i += 3) {
+    const int p0 = this->remap[tris[i]];
+    const int p1 = this->remap[tris[i+1]];
+    const int p2 = this->remap[tris[i+2]];
+    if (p0 == p1 || p1 == p2 || p0 == p2) continue;
+    this->triangles.push_back(tris[i]);
+    this->triangles.push_back(tris[i+1]);
+    this->triangles.push_back(tris[i+2]);
+  }
+  const int numtris = static_cast<int>(this->triangles.size()) / 3;
+  if (numtris == 0) return;
+
+  this->calcFlags();
+
+  this->centroids.resize(numtris);
+  this->order.resize(numtris);
+  for (int i = 0; i < numtris; i++) {
+    this->centroids[i] =
+      (this->vertices[this->triangles[i*3]] +
+       this->vertices[this->triangles[i*3+1]] +
+       this->vertices[this->triangles[i*3+2]]) / 3.0f;
+    this->order[i] = i;
+  }
+  this->leafof.resize(numtris);
+  this->partition(0, numtris);
+
+  // the range of leaves using each position
+  this->minleaf.assign(this->numvertices, INT_MAX);
+  this->maxleaf.assign(this->numvertices, -1);
+  for (int i = 0; i < numtris; i++) {
+    const int t = this->order[i];
+    const int leaf = this->leafof[i];
+    for (int j = 0; j < 3; j++) {
+      const int p = this->remap[this->triangles[t*3+j]];
+      this->minleaf[p] = SbMin(this->minleaf[p], leaf);
+      this->maxleaf[p] = SbMax(this->maxleaf[p], leaf);
+    }
+  }
+
+  this->localid.assign(this->numvertices, -1);
+  this->stamp.assign(this->numvertices, 0);
+
+  std::vector <int> mesh;
+  this->simplifyNode(0, mesh);
+
+  // leaves first, so that a full resolution cut renders as a few
+  // large ranges
+  const int numleafindices = static_cast<int>(this->leafindices.size());
+  std::vector <soshape_clusterlod::node> & nodes = this->lod->nodes;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    if (nodes[i].child[0] >= 0 && nodes[i].first >= 0) {
+      nodes[i].first += numleafindices;
+    }
+  }
+  std::vector <GLuint> & indices = this->lod->indices;
+  indices.reserve(this->leafindices.size() + this->nodeindices.size());
+  indices.insert(indices.end(), this->leafindices.begin(), this->leafindices.end());
+  indices.insert(indices.end(), this->nodeindices.begin(), this->nodeindices.end());
+  this->lod->numleafindices = numleafindices;
+}
+
+class soshape_clusterlod_vertexcmp {
+public:
+  soshape_clusterlod_vertexcmp(const SbVec3f * vertices) : vertices(vertices) { }
+  bool operator()(const int a, const int b) const {
+    const SbVec3f & va = this->vertices[a];
+    const SbVec3f & vb = this->vertices[b];
+    if (va[0] != vb[0]) return va[0] < vb[0];
+    if (va[1] != vb[1]) return va[1] < vb[1];
+    if (va[2] != vb[2]) return va[2] < vb[2];
+    return a < b;
+  }
+  const SbVec3f * vertices;
+};
+
+void
+soshape_clusterlod_builder::calcPositions(void)
+{
+  std::vector <int> sorted(this->numvertices);
+  for (int i = 0; i < this->numvertices; i++) sorted[i] = i;
+  std::sort(sorted.begin(), sorted.end(), soshape_clusterlod_vertexcmp(this->vertices));
+
+  this->remap.resize(this->numvertices);
+  this->flags.assign(this->numvertices, 0);
+  int first = 0;
+  for (int i = 0; i < this->numvertices; i++) {
+    const int v = sorted[i];
+    if (i == 0 || this->vertices[v] != this->vertices[sorted[i-1]]) {
+      first = v;
+    }
+    else {
+      // more than one vertex at this position. Differences in the
+      // normal are handled when collapsing, but color and texture
+      // coordinate seams must stay where they are.
+      if (this->texcoords && this->texcoords[v] != this->texcoords[first]) {
+        this->flags[first] |= CLUSTERLOD_LOCKED;
+      }
+      if (this->colors && memcmp(this->colors + v*4, this->colors + first*4, 4) != 0) {
+        this->flags[first] |= CLUSTERLOD_LOCKED;
+      }
+    }
+    this->remap[v] = first;
+  }
+}
+
+void
+soshape_clusterlod_builder::calcFlags(void)
+{
+  // count the triangles using each edge
+  const int numtris = static_cast<int>(this->triangles.size()) / 3;
+  std::vector <uint64_t> edges;
+  edges.reserve(numtris * 3);
+  for (int i = 0; i < numtris; i++) {
+    for (int j = 0; j < 3; j++) {
+      uint64_t p0 = this->remap[this->triangles[i*3+j]];
+      uint64_t p1 = this->remap[this->triangles[i*3+(j+1)%3]];
+      if (p0 > p1) std::swap(p0, p1);
+      edges.push_back((p0 << 32) | p1);
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+
+  std::vector <int> numopen(this->numvertices, 0);
+  for (size_t i = 0; i < edges.size(); ) {
+    size_t j = i + 1;
+    while (j < edges.size() && edges[j] == edges[i]) j++;
+    const int p0 = static_cast<int>(edges[i] >> 32);
+    const int p1 = static_cast<int>(edges[i] & 0xffffffff);
+    if (j - i > 2) {
+      this->flags[p0] |= CLUSTERLOD_LOCKED;
+      this->flags[p1] |= CLUSTERLOD_LOCKED;
+    }
+    else if (j - i == 1) {
+      numopen[p0]++;
+      numopen[p1]++;
+    }
+    i = j;
+  }
+  for (int i = 0; i < this->numvertices; i++) {
+    if (numopen[i] == 2) this->flags[i] |= CLUSTERLOD_BORDER;
+    else if (numopen[i]) this->flags[i] |= CLUSTERLOD_LOCKED;
+  }
+}
+
+class soshape_clusterlod_centroidcmp {
+public:
+  soshape_clusterlod_centroidcmp(const std::vector <SbVec3f> & c, const int axis)
+    : centroids(c), axis(axis) { }
+  bool operator()(const int a, const int b) const {
+    return this->centroids[a][this->axis] < this->centroids[b][this->axis];
+  }
+  const std::vector <SbVec3f> & centroids;
+  int axis;
+};
+
+// splits the triangles order[first, first+num> at the median of the
+// longest axis until the leaves are small enough. Nodes are created
+// in depth first order, with the root at index 0.
+int
+soshape_clusterlod_builder::partition(const int first, const int num)
+{
+  std::vector <soshape_clusterlod::node> & nodes = this->lod->nodes;
+  const int idx = static_cast<int>(nodes.size());
+  nodes.push_back(soshape_clusterlod::node());
+  nodes[idx].child[0] = nodes[idx].child[1] = -1;
+  nodes[idx].first = -1;
+  nodes[idx].num = 0;
+  nodes[idx].error = 0.0f;
+  this->nodelo.push_back(-1);
+  this->nodehi.push_back(-1);
+
+  SbBox3f box;
+  for (int i = first; i < first + num; i++) {
+    const int t = this->order[i];
+    for (int j = 0; j < 3; j++) box.extendBy(this->vertices[this->triangles[t*3+j]]);
+  }
+  nodes[idx].box = box;
+  nodes[idx].center = box.getCenter();
+  nodes[idx].radius = (box.getMax() - box.getMin()).length() * 0.5f;
+
+  if (num <= CLUSTERLOD_LEAF_SIZE) {
+    for (int i = first; i < first + num; i++) this->leafof[i] = this->numleaves;
+    this->nodelo[idx] = this->nodehi[idx] = this->numleaves;
+    this->numleaves++;
+    // stash the triangle range until simplifyNode() fills in the indices
+    nodes[idx].first = first;
+    nodes[idx].num = num;
+    return idx;
+  }
+
+  SbBox3f cbox;
+  for (int i = first; i < first + num; i++) cbox.extendBy(this->centroids[this->order[i]]);
+  float dx, dy, dz;
+  cbox.getSize(dx, dy, dz);
+  const int axis = (dx >= dy && dx >= dz) ? 0 : (dy >= dz ? 1 : 2);
+  const int half = num / 2;
+  std::nth_element(this->order.begin() + first,
+                   this->order.begin() + first + half,
+                   this->order.begin() + first + num,
+                   soshape_clusterlod_centroidcmp(this->centroids, axis));
+
+  const int c0 = this->partition(first, half);
+  const int c1 = this->partition(first + half, num - half);
+  nodes[idx].child[0] = c0;
+  nodes[idx].child[1] = c1;
+  this->nodelo[idx] = this->nodelo[c0];
+  this->nodehi[idx] = this->nodehi[c1];
+  return idx;
+}
+
+// simplifies the hierarchy bottom up. Returns the error of the mesh
+// returned in mesh, which is passed on to the parent.
+float
+soshape_clusterlod_builder::simplifyNode(const int idx, std::vector <int> & mesh)
+{
+  std::vector <soshape_clusterlod::node> & nodes = this->lod->nodes;
+  mesh.clear();
+  if (nodes[idx].child[0] < 0) {
+    const int first = nodes[idx].first;
+    const int num = nodes[idx].num;
+    mesh.reserve(num * 3);
+    for (int i = first; i < first + num; i++) {
+      const int t = this->order[i];
+      for (int j = 0; j < 3; j++) mesh.push_back(this->triangles[t*3+j]);
+    }
+    nodes[idx].first = static_cast<int>(this->leafindices.size());
+    nodes[idx].num = num * 3;
+    this->leafindices.insert(this->leafindices.end(), mesh.begin(), mesh.end());
+    return 0.0f;
+  }
+
+  std::vector <int> m1;
+  const float e0 = this->simplifyNode(nodes[idx].child[0], mesh);
+  const float e1 = this->simplifyNode(nodes[idx].child[1], m1);
+  mesh.insert(mesh.end(), m1.begin(), m1.end());
+  m1.clear();
+
+  const int input = static_cast<int>(mesh.size()) / 3;
+  const float error = SbMax(e0, e1) +
+    this->simplify(mesh, this->nodelo[idx], this->nodehi[idx], input / 2);
+  nodes[idx].error = error;
+  const int output = static_cast<int>(mesh.size()) / 3;
+  if (output <= input * CLUSTERLOD_MIN_REDUCTION) {
+    nodes[idx].first = static_cast<int>(this->nodeindices.size());
+    nodes[idx].num = output * 3;
+    this->nodeindices.insert(this->nodeindices.end(), mesh.begin(), mesh.end());
+  }
+  // else not worth storing, always render the children instead
+  return error;
+}
+
+// the number of live triangles around u which also use v
+int
+soshape_clusterlod_builder::numShared(const int u, const int v) const
+{
+  int n = 0;
+  for (int i = this->adjstart[u]; i < this->adjstart[u+1]; i++) {
+    const int t = this->adjtri[i];
+    if (!this->alive[t]) continue;
+    if (this->lcorner[t*3] == v || this->lcorner[t*3+1] == v || this->lcorner[t*3+2] == v) n++;
+  }
+  return n;
+}
+
+void
+soshape_clusterlod_builder::buildAdjacency(void)
+{
+  const int numlocal = static_cast<int>(this->lpos.size());
+  const int numtris = static_cast<int>(this->alive.size());
+  this->adjstart.assign(numlocal + 1, 0);
+  for (int t = 0; t < numtris; t++) {
+    if (!this->alive[t]) continue;
+    for (int j = 0; j < 3; j++) this->adjstart[this->lcorner[t*3+j] + 1]++;
+  }
+  for (int i = 0; i < numlocal; i++) this->adjstart[i+1] += this->adjstart[i];
+  this->adjfill.assign(this->adjstart.begin(), this->adjstart.end() - 1);
+  this->adjtri.resize(this->adjstart[numlocal]);
+  for (int t = 0; t < numtris; t++) {
+    if (!this->alive[t]) continue;
+    for (int j = 0; j < 3; j++) this->adjtri[this->adjfill[this->lcorner[t*3+j]]++] = t;
+  }
+}
+
+// Finds the vertex to use for a corner which used oldvertex before
+// the collapse, among the vertices the triangles on the collapsed
+// edge use at v. Only these are sure to have the texture coordinates
+// and colors of u, as v may be locked and have other vertices across
+// an attribute seam. Of these, pick the one with the closest normal.
+int
+soshape_clusterlod_builder::findWedge(const int * wedges, const int numwedges,
+                                      const int oldvertex) const
+{
+  int best = wedges[0];
+  float bestdist = FLT_MAX;
+  for (int i = 0; i < numwedges && this->normals; i++) {
+    const float dist = (this->normals[wedges[i]] - this->normals[oldvertex]).sqrLength();
+    if (dist < bestdist) {
+      best = wedges[i];
+      bestdist = dist;
+    }
+  }
+  return best;
+}
+
+// collapses the position u onto the position v, if that doesn't
+// change the topology or flip any triangles
+bool
+soshape_clusterlod_builder::collapse(std::vector <int> & mesh, const int u, const int v)
+{
+  const int ufirst = this->adjstart[u];
+  const int ulast = this->adjstart[u+1];
+
+  // mark the neighbours of u
+  const int mark = ++this->curstamp;
+  int shared = 0;
+  int i, j;
+  for (i = ufirst; i < ulast; i++) {
+    const int t = this->adjtri[i];
+    if (!this->alive[t]) continue;
+    for (j = 0; j < 3; j++) {
+      const int c = this->lcorner[t*3+j];
+      if (c == v) shared++;
+      if (c != u) this->stamp[c] = mark;
+    }
+  }
+  if (shared != ((this->lflags[u] & CLUSTERLOD_BORDER) ? 1 : 2)) return false;
+
+  // link condition: u and v may only have the neighbours of the
+  // triangles around the edge in common
+  const int seen = ++this->curstamp;
+  int common = 0;
+  for (i = this->adjstart[v]; i < this->adjstart[v+1]; i++) {
+    const int t = this->adjtri[i];
+    if (!this->alive[t]) continue;
+    for (j = 0; j < 3; j++) {
+      const int c = this->lcorner[t*3+j];
+      if (c != v && this->stamp[c] == mark) {
+        this->stamp[c] = seen;
+        common++;
+      }
+    }
+  }
+  if (common != shared) return false;
+
+  // the remaining triangles around u must not flip or degenerate
+  const SbVec3f & pv = this->vertices[this->lpos[v]];
+  for (i = ufirst; i < ulast; i++) {
+    const int t = this->adjtri[i];
+    if (!this->alive[t]) continue;
+    const int * c = &this->lcorner[t*3];
+    if (c[0] == v || c[1] == v || c[2] == v) continue;
+    SbVec3f p[3];
+    for (j = 0; j < 3; j++) p[j] = this->vertices[this->lpos[c[j]]];
+    const SbVec3f n0 = (p[1] - p[0]).cross(p[2] - p[0]);
+    for (j = 0; j < 3; j++) if (c[j] == u) p[j] = pv;
+    const SbVec3f n1 = (p[1] - p[0]).cross(p[2] - p[0]);
+    if (n0.dot(n1) <= 0.25f * n0.length() * n1.length()) return false;
+  }
+
+  // remove the triangles on the edge, and move the rest onto v
+  int wedges[2];
+  int numwedges = 0;
+  for (i = ufirst; i < ulast; i++) {
+    const int t = this->adjtri[i];
+    if (!this->alive[t]) continue;
+    const int * c = &this->lcorner[t*3];
+    for (j = 0; j < 3; j++) {
+      if (c[j] == v) {
+        wedges[numwedges++] = mesh[t*3+j];
+        this->alive[t] = 0;
+        this->live--;
+      }
+    }
+  }
+  for (i = ufirst; i < ulast; i++) {
+    const int t = this->adjtri[i];
+    if (!this->alive[t]) continue;
+    int * c = &this->lcorner[t*3];
+    for (j = 0; j < 3; j++) {
+      if (c[j] == u) {
+        c[j] = v;
+        mesh[t*3+j] = this->findWedge(wedges, numwedges, mesh[t*3+j]);
+      }
+    }
+  }
+  this->quadrics[v].add(this->quadrics[u]);
+  this->touched[u] = this->touched[v] = 1;
+  return true;
+}
+
+// Simplifies mesh towards target triangles, moving only the positions
+// used solely by the leaves [lo, hi]. Returns the error introduced.
+float
+soshape_clusterlod_builder::simplify(std::vector <int> & mesh,
+                                     const int lo, const int hi, const int target)
+{
+  const int numtris = static_cast<int>(mesh.size()) / 3;
+  if (numtris <= target) return 0.0f;
+
+  int i, j;
+  this->lpos.clear();
+  this->lcorner.resize(mesh.size());
+  for (i = 0; i < numtris * 3; i++) {
+    const int p = this->remap[mesh[i]];
+    if (this->localid[p] < 0) {
+      this->localid[p] = static_cast<int>(this->lpos.size());
+      this->lpos.push_back(p);
+    }
+    this->lcorner[i] = this->localid[p];
+  }
+  const int numlocal = static_cast<int>(this->lpos.size());
+  this->lflags.resize(numlocal);
+  for (i = 0; i < numlocal; i++) {
+    const int p = this->lpos[i];
+    this->lflags[i] = this->flags[p];
+    if (this->minleaf[p] < lo || this->maxleaf[p] > hi) this->lflags[i] |= CLUSTERLOD_LOCKED;
+  }
+  this->stamp.assign(numlocal, 0);
+  this->curstamp = 0;
+
+  this->alive.assign(numtris, 1);
+  this->live = numtris;
+  this->buildAdjacency();
+
+  // area weighted triangle planes, and planes perpendicular to the
+  // triangles along open edges to keep borders in place
+  this->quadrics.resize(numlocal);
+  for (i = 0; i < numlocal; i++) this->quadrics[i].reset();
+  for (i = 0; i < numtris; i++) {
+    const int * c = &this->lcorner[i*3];
+    const SbVec3f & p0 = this->vertices[this->lpos[c[0]]];
+    const SbVec3f & p1 = this->vertices[this->lpos[c[1]]];
+    const SbVec3f & p2 = this->vertices[this->lpos[c[2]]];
+    SbVec3f n = (p1 - p0).cross(p2 - p0);
+    const float len = n.length();
+    if (len <= 0.0f) continue;
+    n /= len;
+    const double d = -n.dot(p0);
+    for (j = 0; j < 3; j++) this->quadrics[c[j]].addPlane(n, d, len * 0.5);
+
+    for (j = 0; j < 3; j++) {
+      const int a = c[j];
+      const int b = c[(j+1)%3];
+      if (this->numShared(a, b) != 1) continue;
+      const SbVec3f & pa = this->vertices[this->lpos[a]];
+      const SbVec3f e = this->vertices[this->lpos[b]] - pa;
+      SbVec3f bn = e.cross(n);
+      if (bn.normalize() <= 0.0f) continue;
+      const double bd = -bn.dot(pa);
+      const double w = e.sqrLength() * CLUSTERLOD_BORDER_WEIGHT;
+      this->quadrics[a].addPlane(bn, bd, w);
+      this->quadrics[b].addPlane(bn, bd, w);
+    }
+  }
+
+  double maxcost = 0.0;
+  SbBool first = TRUE;
+  while (this->live > target) {
+    if (!first) this->buildAdjacency();
+    first = FALSE;
+    this->touched.assign(numlocal, 0);
+
+    // the cheapest collapse for each movable position
+    this->candidates.clear();
+    for (int u = 0; u < numlocal; u++) {
+      if (this->lflags[u] & CLUSTERLOD_LOCKED) continue;
+      candidate best;
+      best.cost = FLT_MAX;
+      best.u = u;
+      best.v = -1;
+      for (i = this->adjstart[u]; i < this->adjstart[u+1]; i++) {
+        const int t = this->adjtri[i];
+        for (j = 0; j < 3; j++) {
+          const int v = this->lcorner[t*3+j];
+          if (v == u || v == best.v) continue;
+          if ((this->lflags[u] & CLUSTERLOD_BORDER) && this->numShared(u, v) != 1) continue;
+          const float cost = static_cast<float>(this->quadrics[u].error(this->vertices[this->lpos[v]]));
+          if (cost < best.cost) {
+            best.cost = cost;
+            best.v = v;
+          }
+        }
+      }
+      if (best.v >= 0) this->candidates.push_back(best);
+    }
+    if (this->candidates.empty()) break;
+    std::sort(this->candidates.begin(), this->candidates.end());
+
+    // Each collapse removes about two triangles. Collapses which are
+    // much more expensive than the ones needed to reach the target
+    // wait for the next pass, where the costs are up to date.
+    const int needed = SbMin(static_cast<int>(this->candidates.size()),
+                             (this->live - target + 1) / 2);
+    const float bound = this->candidates[SbMax(needed - 1, 0)].cost * 1.5f;
+    int collapsed = 0;
+    for (i = 0; i < static_cast<int>(this->candidates.size()); i++) {
+      const candidate & c = this->candidates[i];
+      if (this->live <= target) break;
+      if (c.cost > bound && collapsed > 0) break;
+      if (this->touched[c.u] || this->touched[c.v]) continue;
+      if (!this->collapse(mesh, c.u, c.v)) continue;
+      maxcost = SbMax(maxcost, static_cast<double>(c.cost));
+      collapsed++;
+    }
+    if (collapsed == 0) break;
+  }
+
+  // compact the mesh, and clear the local ids for the next node
+  int n = 0;
+  for (i = 0; i < numtris; i++) {
+    if (!this->alive[i]) continue;
+    for (j = 0; j < 3; j++) mesh[n++] = mesh[i*3+j];
+  }
+  mesh.resize(n);
+  for (i = 0; i < numlocal; i++) this->localid[this->lpos[i]] = -1;
+
+  return static_cast<float>(sqrt(maxcost));
+}
+
+// *************************************************************************
+
+soshape_clusterlod::soshape_clusterlod(SoPrimitiveVertexCache * pvcache)
+  : pvcache(pvcache),
+    numleafindices(0),
+    vertexvbo(NULL),
+    normalvbo(NULL),
+    colorvbo(NULL),
+    texcoordvbo(NULL),
+    indexvbo(NULL)
+{
+  this->pvcache->ref();
+  const int numindices = pvcache->getNumTriangleIndices();
+  if (numindices >= 3) {
+    soshape_clusterlod_builder builder(this,
+                                       pvcache->getVertexArray(),
+                                       pvcache->getNumVertices(),
+                                       pvcache->getNormalArray(),
+                                       pvcache->getTexCoordArray(),
+                                       pvcache->colorPerVertex() ?
+                                       pvcache->getColorArray() : NULL);
+    builder.build(pvcache->getTriangleIndices(), numindices);
+  }
+}
+
+soshape_clusterlod::~soshape_clusterlod()
+{
+  delete this->vertexvbo;
+  delete this->normalvbo;
+  delete this->colorvbo;
+  delete this->texcoordvbo;
+  delete this->indexvbo;
+  this->pvcache->unref();
+}
+
+SoPrimitiveVertexCache *
+soshape_clusterlod::getPrimitiveVertexCache(void) const
+{
+  return this->pvcache;
+}
+
+int
+soshape_clusterlod::getNumNodes(void) const
+{
+  return static_cast<int>(this->nodes.size());
+}
+
+int
+soshape_clusterlod::getNumTriangles(void) const
+{
+  return this->numleafindices / 3;
+}
+
+float
+soshape_clusterlod::getNodeError(const int idx) const
+{
+  return this->nodes[idx].error;
+}
+
+int
+soshape_clusterlod::getNodeChild(const int idx, const int which) const
+{
+  return this->nodes[idx].child[which];
+}
+
+const GLuint *
+soshape_clusterlod::getIndices(void) const
+{
+  return this->indices.empty() ? NULL : &this->indices[0];
+}
+
+void
+soshape_clusterlod::select(SoState * state, const float maxpixels,
+                           SbList <int> & ranges, int & numclusters) const
+{
+  ranges.truncate(0);
+  numclusters = 0;
+  if (this->nodes.empty()) return;
+
+  const SbViewVolume & vv = SoViewVolumeElement::get(state);
+  const SbMatrix & mm = SoModelMatrixElement::get(state);
+  const float vpheight = static_cast<float>
+    (SoViewportRegionElement::get(state).getViewportSizePixels()[1]);
+  const float height = vv.getHeight() > 0.0f ? vv.getHeight() : 1.0f;
+
+  // errors are measured in object space, so the eye point is moved
+  // there too. For orthographic views the size in pixels only
+  // depends on the scale of the model matrix.
+  const SbBool ortho = vv.getProjectionType() == SbViewVolume::ORTHOGRAPHIC;
+  SbVec3f eye;
+  mm.inverse().multVecMatrix(vv.getProjectionPoint(), eye);
+  float scale;
+  if (ortho) {
+    float maxscale = 0.0f;
+    for (int i = 0; i < 3; i++) {
+      const SbVec3f axis(mm[i][0], mm[i][1], mm[i][2]);
+      maxscale = SbMax(maxscale, axis.length());
+    }
+    scale = maxscale * vpheight / height;
+  }
+  else {
+    scale = vpheight * vv.getNearDist() / height;
+  }
+  this->select(0, state, eye, scale, ortho, maxpixels, ranges, numclusters);
+}
+
+void
+soshape_clusterlod::select(const int idx, SoState * state, const SbVec3f & eye,
+                           const float scale, const SbBool ortho, const float maxpixels,
+                           SbList <int> & ranges, int & numclusters) const
+{
+  const node & n = this->nodes[idx];
+  if (SoCullElement::cullTest(state, n.box, TRUE)) return;
+
+  SbBool use = n.child[0] < 0;
+  if (!use && n.first >= 0) {
+    if (ortho) {
+      use = n.error * scale <= maxpixels;
+    }
+    else {
+      const float dist = (eye - n.center).length() - n.radius;
+      use = dist > 0.0f && n.error * scale <= maxpixels * dist;
+    }
+  }
+  if (!use) {
+    this->select(n.child[0], state, eye, scale, ortho, maxpixels, ranges, numclusters);
+    this->select(n.child[1], state, eye, scale, ortho, maxpixels, ranges, numclusters);
+    return;
+  }
+  numclusters++;
+  const int len = ranges.getLength();
+  if (len && ranges[len-2] + ranges[len-1] == n.first) {
+    ranges[len-1] += n.num;
+  }
+  else {
+    ranges.append(n.first);
+    ranges.append(n.num);
+  }
+}
+
+void
+soshape_clusterlod::render(SoState * state, const SbList <int> & ranges, const SbBool texture)
+{
+  const int numranges = ranges.getLength() / 2;
+  if (numranges == 0) return;
+
+  const uint32_t contextid = SoGLCacheContextElement::get(state);
+  const cc_glglue * glue = cc_glglue_instance(static_cast<int>(contextid));
+  const SoPrimitiveVertexCache * pv = this->pvcache;
+  const int numvertices = pv->getNumVertices();
+  const SbBool color = pv->colorPerVertex();
+  int i;
+
+  if (!SoGLDriverDatabase::isSupported(glue, SO_GL_VERTEX_ARRAY)) {
+    // fall back to immediate mode rendering
+    const SbVec3f * vertices = pv->getVertexArray();
+    const SbVec3f * normals = pv->getNormalArray();
+    const SbVec4f * texcoords = pv->getTexCoordArray();
+    const uint8_t * colors = pv->getColorArray();
+    glBegin(GL_TRIANGLES);
+    for (i = 0; i < numranges; i++) {
+      const int first = ranges[i*2];
+      const int last = first + ranges[i*2+1];
+      for (int j = first; j < last; j++) {
+        const GLuint idx = this->indices[j];
+        if (color) glColor4ubv(reinterpret_cast<const GLubyte *>(&colors[idx*4]));
+        if (texture) glTexCoord4fv(texcoords[idx].getValue());
+        glNormal3fv(normals[idx].getValue());
+        glVertex3fv(vertices[idx].getValue());
+      }
+    }
+    glEnd();
+  }
+  else {
+    const SbBool usevbo = SoGLVBOElement::shouldCreateVBO(state, numvertices);
+    if (usevbo) {
+      if (!SoGLDriverDatabase::isSupported(glue, SO_GL_VBO_IN_DISPLAYLIST)) {
+        SoCacheElement::invalidate(state);
+      }
+      if (this->vertexvbo == NULL) {
+        this->vertexvbo = new SoVBO;
+        this->vertexvbo->setBufferData(pv->getVertexArray(), numvertices * sizeof(SbVec3f));
+        this->normalvbo = new SoVBO;
+        this->normalvbo->setBufferData(pv->getNormalArray(), numvertices * sizeof(SbVec3f));
+        this->texcoordvbo = new SoVBO;
+        this->texcoordvbo->setBufferData(pv->getTexCoordArray(), numvertices * sizeof(SbVec4f));
+        this->colorvbo = new SoVBO;
+        this->colorvbo->setBufferData(pv->getColorArray(), numvertices * 4 * sizeof(uint8_t));
+        this->indexvbo = new SoVBO(GL_ELEMENT_ARRAY_BUFFER);
+        this->indexvbo->setBufferData(&this->indices[0], this->indices.size() * sizeof(GLuint));
+      }
+      this->vertexvbo->bindBuffer(contextid);
+      cc_glglue_glVertexPointer(glue, 3, GL_FLOAT, 0, NULL);
+      this->normalvbo->bindBuffer(contextid);
+      cc_glglue_glNormalPointer(glue, GL_FLOAT, 0, NULL);
+      if (texture) {
+        this->texcoordvbo->bindBuffer(contextid);
+        cc_glglue_glTexCoordPointer(glue, 4, GL_FLOAT, 0, NULL);
+      }
+      if (color) {
+        this->colorvbo->bindBuffer(contextid);
+        cc_glglue_glColorPointer(glue, 4, GL_UNSIGNED_BYTE, 0, NULL);
+      }
+      this->indexvbo->bindBuffer(contextid);
+    }
+    else {
+      cc_glglue_glVertexPointer(glue, 3, GL_FLOAT, 0, pv->getVertexArray());
+      cc_glglue_glNormalPointer(glue, GL_FLOAT, 0, pv->getNormalArray());
+      if (texture) cc_glglue_glTexCoordPointer(glue, 4, GL_FLOAT, 0, pv->getTexCoordArray());
+      if (color) cc_glglue_glColorPointer(glue, 4, GL_UNSIGNED_BYTE, 0, pv->getColorArray());
+    }
+    cc_glglue_glEnableClientState(glue, GL_VERTEX_ARRAY);
+    cc_glglue_glEnableClientState(glue, GL_NORMAL_ARRAY);
+    if (texture) cc_glglue_glEnableClientState(glue, GL_TEXTURE_COORD_ARRAY);
+    if (color) cc_glglue_glEnableClientState(glue, GL_COLOR_ARRAY);
+
+    for (i = 0; i < numranges; i++) {
+      const GLuint * ptr = usevbo ?
+        reinterpret_cast<const GLuint *>(NULL) + ranges[i*2] :
+        &this->indices[ranges[i*2]];
+      cc_glglue_glDrawElements(glue, GL_TRIANGLES, ranges[i*2+1], GL_UNSIGNED_INT, ptr);
+    }
+
+    if (color) cc_glglue_glDisableClientState(glue, GL_COLOR_ARRAY);
+    if (texture) cc_glglue_glDisableClientState(glue, GL_TEXTURE_COORD_ARRAY);
+    cc_glglue_glDisableClientState(glue, GL_NORMAL_ARRAY);
+    cc_glglue_glDisableClientState(glue, GL_VERTEX_ARRAY);
+    if (usevbo) {
+      cc_glglue_glBindBuffer(glue, GL_ARRAY_BUFFER, 0);
+      cc_glglue_glBindBuffer(glue, GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+  }
+
+  // inform SoGLLazyElement that we might have changed the current color
+  if (color) {
+    SoGLLazyElement::getInstance(state)->reset(state, SoLazyElement::DIFFUSE_MASK);
+  }
+}
+
+#ifdef COIN_TEST_SUITE
+#ifdef COIN_INT_TEST_SUITE
+
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+#include <Inventor/SbViewVolume.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/SoPrimitiveVertex.h>
+#include <Inventor/actions/SoCallbackAction.h>
+#include <Inventor/caches/SoPrimitiveVertexCache.h>
+#include <Inventor/elements/SoBumpMapCoordinateElement.h>
+#include <Inventor/elements/SoCacheElement.h>
+#include <Inventor/elements/SoCullElement.h>
+#include <Inventor/elements/SoLazyElement.h>
+#include <Inventor/elements/SoModelMatrixElement.h>
+#include <Inventor/elements/SoMultiTextureEnabledElement.h>
+#include <Inventor/elements/SoShapeStyleElement.h>
+#include <Inventor/elements/SoViewVolumeElement.h>
+#include <Inventor/elements/SoViewportRegionElement.h>
+#include <Inventor/lists/SoTypeList.h>
+#include <Inventor/misc/SoState.h>
+#include <Inventor/nodes/SoInfo.h>
+
+// A closed, bumpy sphere made from a cube with each side split into
+// n x n squares. Each side has its own color and texture
+// coordinates, so the cube edges are attribute seams. The camera is
+// close to the sphere, so the cuts use finer clusters on the near
+// side than on the far side.
+class SoClusterLODTestMesh {
+public:
+  SoClusterLODTestMesh(const int n) {
+    SoTypeList elements;
+    elements.append(SoBumpMapCoordinateElement::getClassTypeId());
+    elements.append(SoCacheElement::getClassTypeId());
+    elements.append(SoCullElement::getClassTypeId());
+    elements.append(SoLazyElement::getClassTypeId());
+    elements.append(SoModelMatrixElement::getClassTypeId());
+    elements.append(SoMultiTextureEnabledElement::getClassTypeId());
+    elements.append(SoShapeStyleElement::getClassTypeId());
+    elements.append(SoViewVolumeElement::getClassTypeId());
+    elements.append(SoViewportRegionElement::getClassTypeId());
+    this->state = new SoState(&this->action, elements);
+    this->state->push();
+
+    this->node = new SoInfo;
+    this->node->ref();
+    SbViewVolume vv;
+    vv.perspective(float(M_PI) / 4.0f, 1.0f, 0.5f, 10.0f);
+    vv.translateCamera(SbVec3f(0.0f, 0.0f, 2.5f));
+    SoViewVolumeElement::set(this->state, this->node, vv);
+    SoViewportRegionElement::set(this->state, SbViewportRegion(512, 512));
+    static const uint32_t colors[6] = {
+      0xff0000ff, 0x00ff00ff, 0x0000ffff, 0xffff00ff, 0xff00ffff, 0x00ffffff
+    };
+    SoLazyElement::setPacked(this->state, this->node, 6, colors);
+
+    SoPrimitiveVertexCache * pvcache = new SoPrimitiveVertexCache(this->state);
+    pvcache->ref();
+    for (int side = 0; side < 6; side++) {
+      for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+          SoPrimitiveVertex v[4];
+          for (int k = 0; k < 4; k++) {
+            this->setVertex(v[k], n, side, i + ((k == 1 || k == 2) ? 1 : 0),
+                            j + ((k >= 2) ? 1 : 0));
+          }
+          this->addTriangle(pvcache, v[0], v[1], v[2]);
+          this->addTriangle(pvcache, v[0], v[2], v[3]);
+        }
+      }
+    }
+    pvcache->close(this->state);
+    this->lod = new soshape_clusterlod(pvcache);
+    pvcache->unref();
+
+    // the vertices at the same position share one id
+    const int numvertices = pvcache->getNumVertices();
+    const SbVec3f * vertices = pvcache->getVertexArray();
+    std::map <std::pair <float, std::pair <float, float> >, int> ids;
+    for (int i = 0; i < numvertices; i++) {
+      const SbVec3f & p = vertices[i];
+      const std::pair <float, std::pair <float, float> > key(p[0], std::make_pair(p[1], p[2]));
+      const int id = static_cast<int>(ids.size());
+      this->position.push_back(ids.insert(std::make_pair(key, id)).first->second);
+    }
+  }
+  ~SoClusterLODTestMesh() {
+    delete this->lod;
+    this->state->pop();
+    delete this->state;
+    this->node->unref();
+  }
+
+  // Selects the cut for maxpixels, and returns its triangles. A
+  // negative maxpixels selects the leaves.
+  int cut(const float maxpixels, std::vector <GLuint> & triangles) const {
+    SbList <int> ranges;
+    int numclusters;
+    this->lod->select(this->state, maxpixels, ranges, numclusters);
+    const GLuint * indices = this->lod->getIndices();
+    triangles.clear();
+    for (int i = 0; i < ranges.getLength(); i += 2) {
+      triangles.insert(triangles.end(), indices + ranges[i], indices + ranges[i] + ranges[i+1]);
+    }
+    return numclusters;
+  }
+
+  // the number of edges used by only one triangle
+  int numOpenEdges(const std::vector <GLuint> & triangles) const {
+    std::map <std::pair <int, int>, int> edges;
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+      for (int j = 0; j < 3; j++) {
+        int p0 = this->position[triangles[i+j]];
+        int p1 = this->position[triangles[i+(j+1)%3]];
+        if (p0 > p1) std::swap(p0, p1);
+        edges[std::make_pair(p0, p1)]++;
+      }
+    }
+    int open = 0;
+    for (std::map <std::pair <int, int>, int>::const_iterator it = edges.begin();
+         it != edges.end(); ++it) {
+      if (it->second == 1) open++;
+    }
+    return open;
+  }
+
+  SoCallbackAction action;
+  SoState * state;
+  SoInfo * node;
+  soshape_clusterlod * lod;
+  std::vector <int> position;
+
+private:
+  void setVertex(SoPrimitiveVertex & v, const int n, const int side,
+                 const int i, const int j) const {
+    const int axis = side / 2;
+    SbVec3f p;
+    p[axis] = (side & 1) ? -1.0f : 1.0f;
+    p[(axis + 1) % 3] = float(2 * i - n) / float(n);
+    p[(axis + 2) % 3] = float(2 * j - n) / float(n);
+    p.normalize();
+    const float r = 1.0f + 0.05f * float(sin(6.0f * p[0]) * sin(6.0f * p[1]) * sin(6.0f * p[2]));
+    v.setPoint(p * r);
+    v.setNormal(p);
+    v.setTextureCoords(SbVec4f(float(i) / float(n), float(j) / float(n), 0.0f, 1.0f));
+    v.setMaterialIndex(side);
+  }
+  void addTriangle(SoPrimitiveVertexCache * pvcache, const SoPrimitiveVertex & v0,
+                   const SoPrimitiveVertex & v1, const SoPrimitiveVertex & v2) const {
+    // counterclockwise seen from the outside
+    const SbVec3f n = (v1.getPoint() - v0.getPoint()).cross(v2.getPoint() - v0.getPoint());
+    if (n.dot(v0.getPoint()) > 0.0f) pvcache->addTriangle(&v0, &v1, &v2);
+    else pvcache->addTriangle(&v0, &v2, &v1);
+  }
+};
+
+static const float soclusterlod_test_pixels[] = {
+  0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 64.0f, 256.0f, 1.0e6f
+};
+static const int soclusterlod_test_numpixels =
+  sizeof(soclusterlod_test_pixels) / sizeof(soclusterlod_test_pixels[0]);
+
+BOOST_AUTO_TEST_CASE(fewerTrianglesAtCoarserCuts)
+{
+  SoClusterLODTestMesh mesh(24);
+  const int numtriangles = 6 * 24 * 24 * 2;
+  BOOST_REQUIRE_EQUAL(mesh.lod->getNumTriangles(), numtriangles);
+  BOOST_CHECK(mesh.lod->getNumNodes() > 7);
+
+  std::vector <GLuint> triangles;
+  mesh.cut(-1.0f, triangles);
+  BOOST_CHECK_EQUAL(static_cast<int>(triangles.size()) / 3, numtriangles);
+
+  int prev = numtriangles;
+  for (int i = 0; i < soclusterlod_test_numpixels; i++) {
+    mesh.cut(soclusterlod_test_pixels[i], triangles);
+    const int num = static_cast<int>(triangles.size()) / 3;
+    BOOST_CHECK_MESSAGE(num <= prev, "more triangles at " << soclusterlod_test_pixels[i] << " pixels");
+    prev = num;
+  }
+  BOOST_CHECK_MESSAGE(prev < numtriangles / 4, "the coarsest cut has " << prev << " triangles");
+}
+
+BOOST_AUTO_TEST_CASE(errorGrowsTowardsRoot)
+{
+  SoClusterLODTestMesh mesh(24);
+  BOOST_CHECK(mesh.lod->getNodeError(0) > 0.0f);
+  for (int i = 0; i < mesh.lod->getNumNodes(); i++) {
+    const int c0 = mesh.lod->getNodeChild(i, 0);
+    const int c1 = mesh.lod->getNodeChild(i, 1);
+    if (c0 < 0) {
+      BOOST_CHECK_EQUAL(mesh.lod->getNodeError(i), 0.0f);
+      continue;
+    }
+    BOOST_CHECK(mesh.lod->getNodeError(i) >= mesh.lod->getNodeError(c0));
+    BOOST_CHECK(mesh.lod->getNodeError(i) >= mesh.lod->getNodeError(c1));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(cutsAreCrackFree)
+{
+  SoClusterLODTestMesh mesh(24);
+  std::vector <GLuint> triangles;
+  mesh.cut(-1.0f, triangles);
+  BOOST_REQUIRE_EQUAL(mesh.numOpenEdges(triangles), 0);
+  const int numtriangles = static_cast<int>(triangles.size()) / 3;
+
+  // the cuts between the finest and the coarsest mix clusters from
+  // different levels
+  mesh.cut(1.0e6f, triangles);
+  const int coarsest = static_cast<int>(triangles.size()) / 3;
+  int nummixed = 0;
+  for (int i = 0; i < soclusterlod_test_numpixels; i++) {
+    const int numclusters = mesh.cut(soclusterlod_test_pixels[i], triangles);
+    const int num = static_cast<int>(triangles.size()) / 3;
+    if (num > coarsest && num < numtriangles && numclusters > 1) nummixed++;
+    BOOST_CHECK_MESSAGE(mesh.numOpenEdges(triangles) == 0,
+                        "cracks in the cut at " << soclusterlod_test_pixels[i] << " pixels");
+  }
+  BOOST_CHECK(nummixed > 0);
+}
+
+BOOST_AUTO_TEST_CASE(attributesSurvive)
+{
+  SoClusterLODTestMesh mesh(24);
+  const SoPrimitiveVertexCache * pvcache = mesh.lod->getPrimitiveVertexCache();
+  BOOST_REQUIRE(pvcache->colorPerVertex());
+  const uint32_t * colors = reinterpret_cast<const uint32_t *>(pvcache->getColorArray());
+  const SbVec3f * vertices = pvcache->getVertexArray();
+  const SbVec3f * normals = pvcache->getNormalArray();
+  const SbVec4f * texcoords = pvcache->getTexCoordArray();
+
+  std::vector <GLuint> triangles;
+  for (int i = 0; i < soclusterlod_test_numpixels; i++) {
+    mesh.cut(soclusterlod_test_pixels[i], triangles);
+    int mixed = 0, badnormal = 0, badtexcoord = 0;
+    std::map <uint32_t, int> numpercolor;
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+      // each side has one color, so a triangle with corners of
+      // different colors has been dragged across a seam
+      const uint32_t color = colors[triangles[t]];
+      if (colors[triangles[t+1]] != color || colors[triangles[t+2]] != color) mixed++;
+      numpercolor[color]++;
+      for (int j = 0; j < 3; j++) {
+        const GLuint v = triangles[t+j];
+        SbVec3f dir = vertices[v];
+        dir.normalize();
+        if (dir.dot(normals[v]) < 0.999f) badnormal++;
+        const SbVec4f & tc = texcoords[v];
+        if (tc[0] < 0.0f || tc[0] > 1.0f || tc[1] < 0.0f || tc[1] > 1.0f) badtexcoord++;
+      }
+    }
+    BOOST_CHECK_MESSAGE(mixed == 0, mixed << " triangles with mixed colors at "
+                        << soclusterlod_test_pixels[i] << " pixels");
+    BOOST_CHECK_EQUAL(badnormal, 0);
+    BOOST_CHECK_EQUAL(badtexcoord, 0);
+    BOOST_CHECK_EQUAL(static_cast<int>(numpercolor.size()), 6);
+  }
+}
+
+#endif // COIN_INT_TEST_SUITE
+#endif // COIN_TEST_SUITE
@@ -0,0 +1,123 @@
+#ifndef COIN_SOSHAPE_CLUSTERLOD_H
+#define COIN_SOSHAPE_CLUSTERLOD_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif /* !COIN_INTERNAL */
+
+#include <vector>
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbVec3f.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/system/gl.h>
+
+class SoState;
+class SoVBO;
+class SoPrimitiveVertexCache;
+
+// A continuous level of detail cluster hierarchy for a triangle
+// mesh. The triangles are split into small spatially coherent
+// clusters, and each internal node of the hierarchy holds a
+// simplified version of the union of its children. The
+// simplification uses quadric error metric edge collapses, and the
+// node error is the (conservative) object space distance between the
+// node mesh and the original triangles.
+//
+// Vertices are never created or moved: a collapse snaps one vertex
+// onto a neighbour, so all levels index the vertices, normals, colors
+// and texture coordinates of the primitive vertex cache the hierarchy
+// was built from. Vertices on the border between the regions of two
+// nodes are locked while the node is simplified, so any cut through
+// the hierarchy gives a crack free mesh.
+
+class soshape_clusterlod {
+public:
+  soshape_clusterlod(SoPrimitiveVertexCache * pvcache);
+  ~soshape_clusterlod();
+
+  SoPrimitiveVertexCache * getPrimitiveVertexCache(void) const;
+  int getNumNodes(void) const;
+  int getNumTriangles(void) const;
+
+  // the hierarchy, with the root at index 0. A child index is -1 for
+  // leaves.
+  float getNodeError(const int idx) const;
+  int getNodeChild(const int idx, const int which) const;
+  // the indices the ranges from select() refer to
+  const GLuint * getIndices(void) const;
+
+  // Selects the coarsest cut through the hierarchy where the
+  // projected error is at most maxpixels. Nodes outside the view
+  // volume are culled. The result is a list of (first index, number
+  // of indices) pairs, merged where possible.
+  void select(SoState * state, const float maxpixels,
+              SbList <int> & ranges, int & numclusters) const;
+  void render(SoState * state, const SbList <int> & ranges, const SbBool texture);
+
+private:
+  class node {
+  public:
+    SbBox3f box;
+    SbVec3f center;
+    float radius;
+    float error;
+    int first;
+    int num;
+    int child[2];
+  };
+
+  void select(const int idx, SoState * state, const SbVec3f & eye,
+              const float scale, const SbBool ortho, const float maxpixels,
+              SbList <int> & ranges, int & numclusters) const;
+
+  SoPrimitiveVertexCache * pvcache;
+  std::vector <node> nodes;
+  std::vector <GLuint> indices;
+  int numleafindices;
+
+  SoVBO * vertexvbo;
+  SoVBO * normalvbo;
+  SoVBO * colorvbo;
+  SoVBO * texcoordvbo;
+  SoVBO * indexvbo;
+
+  friend class soshape_clusterlod_builder;
+};
+
+// set while an SoLODIndexedFaceSet captures its triangles in an
+// SoPrimitiveVertexCache
+void soshape_set_pvcache_capture(SoPrimitiveVertexCache * cache);
+
+#endif // !COIN_SOSHAPE_CLUSTERLOD_H
@@ -32,7 +32,6 @@
 
 #include "shapenodes/soshape_trianglesort.h"
 
-#include <cstdlib>
 #include <cassert>
 
 #ifdef HAVE_CONFIG_H
@@ -85,24 +84,6 @@ soshape_trianglesort::triangle(SoState *,
   this->pvlist->append(*v3);
 }
 
-// qsort() callback.
-//
-// "extern C" wrapper is needed with the OSF1/cxx compiler (probably a
-// bug in the compiler, but it doesn't seem to hurt to do this
-// anyway).
-extern "C" {
-static int
-compare_triangles(const void * ptr1, const void * ptr2)
-{
-  soshape_trianglesort::sorted_triangle * tri1 = (soshape_trianglesort::sorted_triangle*) ptr1;
-  soshape_trianglesort::sorted_triangle * tri2 = (soshape_trianglesort::sorted_triangle*) ptr2;
-
-  if (tri1->dist > tri2->dist) return -1;
-  if (tri1->dist == tri2->dist) return tri2->backface - tri1->backface;
-  return 1;
-}
-}
-
 void
 soshape_trianglesort::endShape(SoState * state, SoMaterialBundle & mb)
 {
@@ -180,8 +161,16 @@ soshape_trianglesort::endShape(SoState * state, SoMaterialBundle & mb)
     }
   }
 
+  // sort back to front, with back faces first for equal distances
   const sorted_triangle * tarray = this->trianglelist->getArrayPtr();
-  qsort((void*)tarray, n, sizeof(sorted_triangle), compare_triangles);
+  this->depthlist.truncate(0);
+  this->backfacelist.truncate(0);
+  for (i = 0; i < n; i++) {
+    this->depthlist.append(tarray[i].dist);
+    this->backfacelist.append(tarray[i].backface);
+  }
+  const int * order = this->sorter.sort(this->depthlist.getArrayPtr(), n, TRUE,
+                                        this->backfacelist.getArrayPtr());
 
   int idx;
 
@@ -190,7 +179,7 @@ soshape_trianglesort::endShape(SoState * state, SoMaterialBundle & mb)
   // sort the triangles anyway.
   glBegin(GL_TRIANGLES);
   for (i = 0; i < n; i++) {
-    idx = tarray[i].idx;
+    idx = tarray[order[i]].idx;
     v = varray + idx;
     glTexCoord4fv(v->getTextureCoords().getValue());
     glNormal3fv(v->getNormal().getValue());
@@ -40,6 +40,8 @@
 #include <Inventor/lists/SbList.h>
 #include <Inventor/SoPrimitiveVertex.h>
 
+#include "misc/SbDepthSorter.h"
+
 class SoState;
 class SoPrimitiveVertex;
 class SoMaterialBundle;
@@ -66,6 +68,9 @@ private:
 
   SbList <SoPrimitiveVertex> * pvlist;
   SbList <sorted_triangle> * trianglelist;
+  SbList <float> depthlist;
+  SbList <unsigned char> backfacelist;
+  SbDepthSorter sorter;
 };
 
 #endif // !COIN_SOSHAPE_TRIANGLESORT_H
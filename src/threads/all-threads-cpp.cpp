@@ -31,6 +31,7 @@
 \**************************************************************************/
 
 #include "common.cpp"
+#include "taskscheduler.cpp" /* runs tasks inline without thread support */
 #include "storage.cpp" /* cc_storage ADT works without the thread abstractions */
 
 #ifdef HAVE_CONFIG_H
@@ -96,10 +96,9 @@ void cc_sched_change_priority(cc_sched * sched,
 
 #include <Inventor/C/errors/debugerror.h>
 #include <Inventor/C/threads/mutex.h>
-#include <Inventor/C/threads/thread.h>
-#include <Inventor/C/threads/wpool.h>
 
 #include "threads/schedp.h"
+#include "threads/taskschedulerp.h"
 
 /* ********************************************************************** */
 
@@ -142,14 +141,35 @@ sched_item_compare(void * o1, void * o2)
 static SbBool
 sched_try_trigger(cc_sched * sched)
 {
-  if (cc_wpool_try_begin(sched->pool, 1)) {
-    cc_wpool_start_worker(sched->pool, sched_worker_entry_point, sched);
-    cc_wpool_end(sched->pool);
+  /* The scheduler has at least one worker thread when numthreads > 0,
+     so the worker loop never runs inline here, with the mutex held. */
+  if (sched->numrunning < sched->numthreads) {
+    sched->numrunning++;
+    sched->group->run(sched_worker_entry_point, sched);
     return TRUE;
   }
   return FALSE;
 }
 
+/* Each cc_sched has its own task scheduler, as the jobs are typically
+   long-running and blocking (e.g. image loading), and shouldn't hold
+   up the fine-grained tasks of the global task scheduler. */
+static void
+sched_create_workers(cc_sched * sched, int numthreads)
+{
+  sched->numthreads = numthreads > 0 ? numthreads : 0;
+  sched->scheduler = new SbTaskScheduler(sched->numthreads);
+  sched->group = new SbTaskGroup(sched->scheduler);
+}
+
+static void
+sched_destroy_workers(SbTaskScheduler * scheduler, SbTaskGroup * group)
+{
+  group->wait(FALSE);
+  delete group;
+  delete scheduler;
+}
+
 void
 sched_worker_entry_point(void * userdata)
 {
@@ -167,6 +187,9 @@ sched_worker_entry_point(void * userdata)
     cc_memalloc_deallocate(sched->itemalloc, (void *)item);
     if (sched->numallowed > 0) sched->numallowed--;
   }
+  /* in the same critical section as the check above, so that new jobs
+     either get picked up by this loop, or trigger a new one */
+  sched->numrunning--;
   cc_mutex_unlock(sched->mutex);
 }
 
@@ -182,7 +205,8 @@ cc_sched_construct(int numthreads)
 {
   cc_sched * sched = (cc_sched *) malloc(sizeof(cc_sched));
   assert(sched);
-  sched->pool = cc_wpool_construct(numthreads);
+  sched->numrunning = 0;
+  sched_create_workers(sched, numthreads);
   sched->mutex = cc_mutex_construct();
  
   sched->itemheap = cc_heap_construct(64, sched_item_compare, TRUE);
@@ -208,13 +232,13 @@ void
 cc_sched_destruct(cc_sched * sched)
 {
   cc_sched_set_num_allowed(sched, 0); // Exit inner scheduler loop faster
-  cc_wpool_wait_all(sched->pool); // Make sure all worker threads are finished
 
   cc_dict_destruct(sched->schedid_dict);
   cc_heap_destruct(sched->itemheap);
   cc_memalloc_destruct(sched->itemalloc);
+  // Make sure all worker loops are finished
+  sched_destroy_workers(sched->scheduler, sched->group);
   cc_mutex_destruct(sched->mutex);
-  cc_wpool_destruct(sched->pool);
   free(sched);
 }
 
@@ -224,8 +248,20 @@ cc_sched_destruct(cc_sched * sched)
 void
 cc_sched_set_num_threads(cc_sched * sched, int num)
 {
+  SbTaskScheduler * oldscheduler;
+  SbTaskGroup * oldgroup;
+
   cc_sched_wait_all(sched);
-  cc_wpool_set_num_workers(sched->pool, num);
+
+  cc_mutex_lock(sched->mutex);
+  oldscheduler = sched->scheduler;
+  oldgroup = sched->group;
+  sched_create_workers(sched, num);
+  cc_mutex_unlock(sched->mutex);
+
+  /* Worker loops started after cc_sched_wait_all() returned still
+     count in numrunning, and are waited for here. */
+  sched_destroy_workers(oldscheduler, oldgroup);
 }
 
 /*!
@@ -234,7 +270,7 @@ cc_sched_set_num_threads(cc_sched * sched, int num)
 int
 cc_sched_get_num_threads(cc_sched * sched)
 {
-  return cc_wpool_get_num_workers(sched->pool);
+  return sched->numthreads;
 }
 
 /*! 
@@ -254,6 +290,7 @@ cc_sched_schedule(cc_sched * sched,
                   float priority)
 {
   sched_item * item;
+  uint32_t schedid;
 
   cc_mutex_lock(sched->mutex);
   item = (sched_item *)cc_memalloc_allocate(sched->itemalloc);
@@ -268,13 +305,14 @@ cc_sched_schedule(cc_sched * sched,
   }
   cc_heap_add(sched->itemheap, (void *)item);
   cc_dict_put(sched->schedid_dict, item->schedid, (void *)item);
-  if (cc_dict_get_num_elements(sched->schedid_dict) == 1) {
-    sched_try_trigger(sched);
-  }
+  /* start another worker loop if there's a thread available for it */
+  sched_try_trigger(sched);
+  /* the item may be run and reused as soon as the mutex is released */
+  schedid = item->schedid;
 
   cc_mutex_unlock(sched->mutex);
 
-  return item->schedid;
+  return schedid;
 }
 
 /*!
@@ -330,7 +368,8 @@ cc_sched_wait_all(cc_sched * sched)
   while (!cc_heap_empty(sched->itemheap) && sched_try_trigger(sched)) { }
 
   cc_mutex_unlock(sched->mutex);
-  cc_wpool_wait_all(sched->pool);
+  /* don't help out, jobs are always run by the scheduler's threads */
+  sched->group->wait(FALSE);
 
   cc_mutex_lock(sched->mutex);
   sched->iswaitingall = FALSE;
@@ -380,3 +419,118 @@ cc_sched_change_priority(cc_sched * sched,
 #endif /* __cplusplus */
 
 #endif /* HAVE_THREADS */
+
+#ifdef COIN_TEST_SUITE
+
+#include <atomic>
+#include <Inventor/SbTime.h>
+
+namespace {
+
+  struct sched_test_job {
+    std::atomic<int> * counter;
+    int * order; // records the order the jobs are run in, if set
+    int index;
+  };
+
+  void
+  sched_test_count(void * closure)
+  {
+    sched_test_job * job = static_cast<sched_test_job *>(closure);
+    const int pos = job->counter->fetch_add(1);
+    if (job->order) job->order[pos] = job->index;
+  }
+
+  // Waits until the counter reaches the expected value, for at most a
+  // few seconds.
+  SbBool
+  sched_test_await(const std::atomic<int> & counter, const int expected)
+  {
+    const SbTime timeout = SbTime::getTimeOfDay() + SbTime(10.0);
+    while ((counter.load() < expected) && (SbTime::getTimeOfDay() < timeout)) {
+      SbTime::sleep(1);
+    }
+    return counter.load() == expected;
+  }
+
+}
+
+BOOST_AUTO_TEST_CASE(scheduleAndWaitAll)
+{
+  const int num = 1000;
+  std::atomic<int> counter(0);
+  sched_test_job * jobs = new sched_test_job[num];
+
+  cc_sched * sched = cc_sched_construct(4);
+  BOOST_CHECK_EQUAL(cc_sched_get_num_threads(sched), 4);
+  for (int i = 0; i < num; i++) {
+    jobs[i].counter = &counter;
+    jobs[i].order = NULL;
+    jobs[i].index = i;
+    BOOST_CHECK(cc_sched_schedule(sched, sched_test_count, &jobs[i], 0.0f) != 0);
+  }
+  cc_sched_wait_all(sched);
+  BOOST_CHECK_EQUAL(counter.load(), num);
+  BOOST_CHECK_EQUAL(cc_sched_get_num_remaining(sched), 0);
+
+  // the jobs run on the new threads after this
+  cc_sched_set_num_threads(sched, 2);
+  BOOST_CHECK_EQUAL(cc_sched_get_num_threads(sched), 2);
+  for (int i = 0; i < num; i++) {
+    cc_sched_schedule(sched, sched_test_count, &jobs[i], 0.0f);
+  }
+  cc_sched_wait_all(sched);
+  BOOST_CHECK_EQUAL(counter.load(), 2 * num);
+
+  cc_sched_destruct(sched);
+  delete[] jobs;
+}
+
+BOOST_AUTO_TEST_CASE(priorityAndUnschedule)
+{
+  const int num = 64;
+  std::atomic<int> counter(0);
+  sched_test_job jobs[num];
+  uint32_t ids[num];
+  int order[num];
+
+  // with a single thread, the jobs run one by one in priority order
+  cc_sched * sched = cc_sched_construct(1);
+  cc_sched_set_num_allowed(sched, 0);
+  for (int i = 0; i < num; i++) {
+    jobs[i].counter = &counter;
+    jobs[i].order = order;
+    jobs[i].index = i;
+    ids[i] = cc_sched_schedule(sched, sched_test_count, &jobs[i], (float)i);
+  }
+  // give the odd jobs the highest priority, then unschedule them
+  for (int i = 1; i < num; i += 2) {
+    cc_sched_change_priority(sched, ids[i], (float)(num + i));
+  }
+  for (int i = 1; i < num; i += 2) {
+    BOOST_CHECK(cc_sched_unschedule(sched, ids[i]));
+    BOOST_CHECK(!cc_sched_unschedule(sched, ids[i]));
+  }
+  BOOST_CHECK_EQUAL(cc_sched_get_num_remaining(sched), num / 2);
+  BOOST_CHECK_EQUAL(counter.load(), 0);
+
+  // run a batch of 4 jobs, then the rest through cc_sched_wait_all()
+  cc_sched_set_num_allowed(sched, 4);
+  BOOST_CHECK(sched_test_await(counter, 4));
+  SbTime::sleep(10);
+  BOOST_CHECK_EQUAL(counter.load(), 4);
+  BOOST_CHECK_EQUAL(cc_sched_get_num_remaining(sched), num / 2 - 4);
+  cc_sched_wait_all(sched);
+  BOOST_CHECK_EQUAL(counter.load(), num / 2);
+
+  // the even jobs, highest priority first
+  SbBool inorder = TRUE;
+  for (int i = 0; i < num / 2; i++) {
+    if (order[i] != num - 2 - 2 * i) inorder = FALSE;
+  }
+  BOOST_CHECK_MESSAGE(inorder, "jobs were not run in priority order");
+
+  cc_sched_destruct(sched);
+}
+
+#endif // COIN_TEST_SUITE
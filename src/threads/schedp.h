@@ -46,6 +46,9 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+class SbTaskScheduler;
+class SbTaskGroup;
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -53,7 +56,10 @@ extern "C" {
 /* ********************************************************************** */
 
 struct cc_sched {
-  cc_wpool * pool;               /*! Pool of worker threads */
+  SbTaskScheduler * scheduler;   /*! Worker threads of this scheduler */
+  SbTaskGroup * group;           /*! Running worker loops */
+  int numthreads;                /*! Max # of concurrently running jobs */
+  int numrunning;                /*! # of worker loops started */
   cc_mutex * mutex;              /*! Protects this struct */
   cc_heap * itemheap;            /*! Scheduled jobs sorted by priority */
   cc_memalloc * itemalloc;
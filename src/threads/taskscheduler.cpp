@@ -0,0 +1,488 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+// The work-stealing task scheduler, see threads/taskschedulerp.h.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "threads/taskschedulerp.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <thread>
+
+#include <Inventor/C/tidbits.h>
+#include <Inventor/lists/SbList.h>
+
+#include "threads/threadsutilp.h"
+#include "tidbitsp.h"
+#include "coindefs.h"
+
+#ifdef HAVE_THREADS
+#include <Inventor/C/threads/condvar.h>
+#include <Inventor/C/threads/mutex.h>
+#include <Inventor/C/threads/thread.h>
+#endif // HAVE_THREADS
+
+// *************************************************************************
+
+struct SbTask {
+  SbTaskScheduler::TaskFunc * func;
+  void * closure;
+  SbTaskGroup * group;
+};
+
+#ifdef HAVE_THREADS
+
+// Chase-Lev work-stealing deque, with the memory orderings from Le,
+// Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing
+// for Weak Memory Models" (PPoPP 2013). Only the owner may call push()
+// and pop(), while any thread may call steal(). steal() also returns
+// NULL if it lost a race for the top item, the caller just tries
+// again later.
+class SbTaskDeque {
+public:
+  SbTaskDeque(void) : top(0), bottom(0) {
+    this->array.store(new Array(64), std::memory_order_relaxed);
+  }
+  ~SbTaskDeque() {
+    delete this->array.load(std::memory_order_relaxed);
+    for (int i = 0; i < this->retired.getLength(); i++) { delete this->retired[i]; }
+  }
+
+  void push(SbTask * task) {
+    const int64_t b = this->bottom.load(std::memory_order_relaxed);
+    const int64_t t = this->top.load(std::memory_order_acquire);
+    Array * a = this->array.load(std::memory_order_relaxed);
+    if (b - t > a->size - 1) { a = this->grow(a, t, b); }
+    a->put(b, task);
+    std::atomic_thread_fence(std::memory_order_release);
+    this->bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  SbTask * pop(void) {
+    const int64_t b = this->bottom.load(std::memory_order_relaxed) - 1;
+    Array * a = this->array.load(std::memory_order_relaxed);
+    this->bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = this->top.load(std::memory_order_relaxed);
+    SbTask * task = NULL;
+    if (t <= b) {
+      task = a->get(b);
+      if (t == b) {
+        // the last item, which thieves may be after as well
+        if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                               std::memory_order_relaxed)) {
+          task = NULL;
+        }
+        this->bottom.store(b + 1, std::memory_order_relaxed);
+      }
+    }
+    else {
+      this->bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+  }
+
+  SbTask * steal(void) {
+    int64_t t = this->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = this->bottom.load(std::memory_order_acquire);
+    if (t >= b) return NULL;
+    Array * a = this->array.load(std::memory_order_acquire);
+    SbTask * task = a->get(t);
+    if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed)) {
+      return NULL;
+    }
+    return task;
+  }
+
+private:
+  class Array {
+  public:
+    Array(const int64_t n) : size(n), items(new std::atomic<SbTask *>[n]) { }
+    ~Array() { delete[] this->items; }
+    SbTask * get(const int64_t i) const {
+      return this->items[i & (this->size - 1)].load(std::memory_order_relaxed);
+    }
+    void put(const int64_t i, SbTask * task) {
+      this->items[i & (this->size - 1)].store(task, std::memory_order_relaxed);
+    }
+    const int64_t size;
+    std::atomic<SbTask *> * items;
+  };
+
+  Array * grow(Array * a, const int64_t t, const int64_t b) {
+    Array * bigger = new Array(a->size * 2);
+    for (int64_t i = t; i < b; i++) { bigger->put(i, a->get(i)); }
+    // thieves may still be reading from the old array
+    this->retired.append(a);
+    this->array.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  std::atomic<int64_t> top, bottom;
+  std::atomic<Array *> array;
+  SbList<Array *> retired;
+};
+
+class SbTaskWorker {
+public:
+  SbTaskSchedulerP * scheduler;
+  SbTaskDeque deque;
+  cc_thread * thread;
+};
+
+// The worker running on the current thread, if any.
+static thread_local SbTaskWorker * sbtask_current_worker = NULL;
+// For picking a random worker to steal from.
+static thread_local uint32_t sbtask_random_seed = 0;
+
+#endif // HAVE_THREADS
+
+// *************************************************************************
+
+class SbTaskSchedulerP {
+public:
+  SbTaskSchedulerP(const int numworkersarg);
+  ~SbTaskSchedulerP();
+
+  int numworkers;
+
+#ifdef HAVE_THREADS
+  void spawn(SbTask * task);
+  SbTask * take(void);
+  void execute(SbTask * task);
+  static void * workerEntry(void * closure);
+
+  SbTaskWorker * workers;
+  // tasks spawned from threads which are not workers
+  SbTaskDeque injected;
+  cc_mutex * injectmutex;
+
+  // number of tasks spawned but not yet taken
+  std::atomic<int> numqueued;
+  std::atomic<int> numsleeping;
+  std::atomic<bool> stop;
+  cc_mutex * sleepmutex;
+  cc_condvar * sleepcond;
+#endif // HAVE_THREADS
+};
+
+#ifdef HAVE_THREADS
+
+SbTaskSchedulerP::SbTaskSchedulerP(const int numworkersarg)
+  : numworkers(numworkersarg), numqueued(0), numsleeping(0), stop(false)
+{
+  this->injectmutex = cc_mutex_construct();
+  this->sleepmutex = cc_mutex_construct();
+  this->sleepcond = cc_condvar_construct();
+  this->workers = (this->numworkers > 0) ? new SbTaskWorker[this->numworkers] : NULL;
+  for (int i = 0; i < this->numworkers; i++) {
+    this->workers[i].scheduler = this;
+    this->workers[i].thread = cc_thread_construct(SbTaskSchedulerP::workerEntry,
+                                                  &this->workers[i]);
+  }
+}
+
+SbTaskSchedulerP::~SbTaskSchedulerP()
+{
+  cc_mutex_lock(this->sleepmutex);
+  this->stop.store(true);
+  cc_condvar_wake_all(this->sleepcond);
+  cc_mutex_unlock(this->sleepmutex);
+  for (int i = 0; i < this->numworkers; i++) {
+    cc_thread_join(this->workers[i].thread, NULL);
+    cc_thread_destruct(this->workers[i].thread);
+  }
+  assert(this->numqueued.load() == 0 && "scheduler destructed with pending tasks");
+  delete[] this->workers;
+  cc_condvar_destruct(this->sleepcond);
+  cc_mutex_destruct(this->sleepmutex);
+  cc_mutex_destruct(this->injectmutex);
+}
+
+void
+SbTaskSchedulerP::spawn(SbTask * task)
+{
+  // Count the task before it can be taken, so the count never goes
+  // negative.
+  this->numqueued.fetch_add(1);
+
+  SbTaskWorker * worker = sbtask_current_worker;
+  if (worker && (worker->scheduler == this)) {
+    worker->deque.push(task);
+  }
+  else {
+    cc_mutex_lock(this->injectmutex);
+    this->injected.push(task);
+    cc_mutex_unlock(this->injectmutex);
+  }
+
+  // Sleeping workers check numqueued after announcing themselves in
+  // numsleeping, so either they see the new task, or we see them.
+  if (this->numsleeping.load() > 0) {
+    cc_mutex_lock(this->sleepmutex);
+    cc_condvar_wake_one(this->sleepcond);
+    cc_mutex_unlock(this->sleepmutex);
+  }
+}
+
+SbTask *
+SbTaskSchedulerP::take(void)
+{
+  SbTaskWorker * worker = sbtask_current_worker;
+  if (worker && (worker->scheduler != this)) worker = NULL;
+
+  SbTask * task = worker ? worker->deque.pop() : NULL;
+  if (task == NULL) task = this->injected.steal();
+  if ((task == NULL) && (this->numworkers > 0)) {
+    // xorshift
+    uint32_t x = sbtask_random_seed;
+    if (x == 0) x = (uint32_t)(size_t)&sbtask_random_seed | 1;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    sbtask_random_seed = x;
+
+    const int start = (int)(x % (uint32_t)this->numworkers);
+    for (int i = 0; (i < this->numworkers) && (task == NULL); i++) {
+      SbTaskWorker * victim = &this->workers[(start + i) % this->numworkers];
+      if (victim != worker) task = victim->deque.steal();
+    }
+  }
+  if (task) this->numqueued.fetch_sub(1);
+  return task;
+}
+
+void
+SbTaskSchedulerP::execute(SbTask * task)
+{
+  task->func(task->closure);
+  SbTaskGroup * group = task->group;
+  delete task;
+  group->taskDone();
+}
+
+void *
+SbTaskSchedulerP::workerEntry(void * closure)
+{
+  SbTaskWorker * worker = static_cast<SbTaskWorker *>(closure);
+  SbTaskSchedulerP * thisp = worker->scheduler;
+  sbtask_current_worker = worker;
+
+  while (!thisp->stop.load()) {
+    SbTask * task = thisp->take();
+    if (task) {
+      thisp->execute(task);
+      continue;
+    }
+    // More work often follows shortly, so spin a little before going
+    // to sleep.
+    SbBool found = FALSE;
+    for (int i = 0; (i < 64) && !found; i++) {
+      std::this_thread::yield();
+      found = (thisp->numqueued.load() > 0);
+    }
+    if (found) continue;
+
+    cc_mutex_lock(thisp->sleepmutex);
+    thisp->numsleeping.fetch_add(1);
+    while ((thisp->numqueued.load() <= 0) && !thisp->stop.load()) {
+      cc_condvar_wait(thisp->sleepcond, thisp->sleepmutex);
+    }
+    thisp->numsleeping.fetch_sub(1);
+    cc_mutex_unlock(thisp->sleepmutex);
+  }
+  sbtask_current_worker = NULL;
+  return NULL;
+}
+
+#else // !HAVE_THREADS
+
+SbTaskSchedulerP::SbTaskSchedulerP(const int COIN_UNUSED_ARG(numworkersarg))
+  : numworkers(0)
+{
+}
+
+SbTaskSchedulerP::~SbTaskSchedulerP()
+{
+}
+
+#endif // !HAVE_THREADS
+
+// *************************************************************************
+
+SbTaskScheduler::SbTaskScheduler(const int numworkers)
+{
+  this->pimpl = new SbTaskSchedulerP(SbMax(numworkers, 0));
+}
+
+SbTaskScheduler::~SbTaskScheduler()
+{
+  delete this->pimpl;
+}
+
+int
+SbTaskScheduler::getNumWorkers(void) const
+{
+  return this->pimpl->numworkers;
+}
+
+static std::atomic<SbTaskScheduler *> sbtaskscheduler_global(NULL);
+
+static void
+sbtaskscheduler_cleanup(void)
+{
+  delete sbtaskscheduler_global.load();
+  sbtaskscheduler_global.store(NULL);
+}
+
+SbTaskScheduler *
+SbTaskScheduler::getGlobal(void)
+{
+  SbTaskScheduler * scheduler = sbtaskscheduler_global.load();
+  if (scheduler) return scheduler;
+
+  CC_GLOBAL_LOCK;
+  scheduler = sbtaskscheduler_global.load();
+  if (scheduler == NULL) {
+    int numthreads = (int)std::thread::hardware_concurrency();
+    const char * env = coin_getenv("COIN_NUM_TASK_THREADS");
+    if (env) numthreads = atoi(env);
+    // the thread waiting for the tasks is the last one
+    scheduler = new SbTaskScheduler(SbMax(numthreads, 1) - 1);
+    sbtaskscheduler_global.store(scheduler);
+    coin_atexit(sbtaskscheduler_cleanup, CC_ATEXIT_TASK_SCHEDULER);
+  }
+  CC_GLOBAL_UNLOCK;
+  return scheduler;
+}
+
+int
+SbTaskScheduler::getGrainSize(const int num, const int grainsize,
+                              SbTaskScheduler * scheduler)
+{
+  if (grainsize > 0) return grainsize;
+  if (scheduler == NULL) scheduler = SbTaskScheduler::getGlobal();
+  // a few ranges per thread, to even out differences in work per range
+  const int numthreads = scheduler->getNumWorkers() + 1;
+  return SbMax(num / (numthreads * 4), 1);
+}
+
+// *************************************************************************
+
+SbTaskGroup::SbTaskGroup(SbTaskScheduler * schedulerarg)
+  : scheduler(schedulerarg ? schedulerarg : SbTaskScheduler::getGlobal()),
+    pending(0), signalling(0)
+{
+#ifdef HAVE_THREADS
+  this->mutex = cc_mutex_construct();
+  this->condvar = cc_condvar_construct();
+#else // !HAVE_THREADS
+  this->mutex = NULL;
+  this->condvar = NULL;
+#endif // !HAVE_THREADS
+}
+
+SbTaskGroup::~SbTaskGroup()
+{
+  this->wait();
+#ifdef HAVE_THREADS
+  cc_condvar_destruct(static_cast<cc_condvar *>(this->condvar));
+  cc_mutex_destruct(static_cast<cc_mutex *>(this->mutex));
+#endif // HAVE_THREADS
+}
+
+void
+SbTaskGroup::run(SbTaskScheduler::TaskFunc * func, void * closure)
+{
+#ifdef HAVE_THREADS
+  if (this->scheduler->getNumWorkers() > 0) {
+    SbTask * task = new SbTask;
+    task->func = func;
+    task->closure = closure;
+    task->group = this;
+    this->pending.fetch_add(1);
+    this->scheduler->pimpl->spawn(task);
+    return;
+  }
+#endif // HAVE_THREADS
+  // nobody else to run it
+  func(closure);
+}
+
+void
+SbTaskGroup::wait(const SbBool help)
+{
+#ifdef HAVE_THREADS
+  cc_mutex * m = static_cast<cc_mutex *>(this->mutex);
+  cc_condvar * c = static_cast<cc_condvar *>(this->condvar);
+
+  while (this->pending.load() > 0) {
+    if (help) {
+      SbTask * task = this->scheduler->pimpl->take();
+      if (task) {
+        this->scheduler->pimpl->execute(task);
+        continue;
+      }
+    }
+    // The remaining tasks are running on other threads. Block until
+    // they are done, but look for tasks to help with now and then,
+    // as they may spawn more.
+    cc_mutex_lock(m);
+    if (this->pending.load() > 0) {
+      if (help) (void)cc_condvar_timed_wait(c, m, 0.001);
+      else (void)cc_condvar_wait(c, m);
+    }
+    cc_mutex_unlock(m);
+  }
+  // Don't let the group be destructed while the thread finishing
+  // the last task is still signalling it.
+  while (this->signalling.load() > 0) { std::this_thread::yield(); }
+#endif // HAVE_THREADS
+}
+
+void
+SbTaskGroup::taskDone(void)
+{
+#ifdef HAVE_THREADS
+  this->signalling.fetch_add(1);
+  if (this->pending.fetch_sub(1) == 1) {
+    cc_mutex_lock(static_cast<cc_mutex *>(this->mutex));
+    cc_condvar_wake_all(static_cast<cc_condvar *>(this->condvar));
+    cc_mutex_unlock(static_cast<cc_mutex *>(this->mutex));
+  }
+  this->signalling.fetch_sub(1);
+#endif // HAVE_THREADS
+}
@@ -0,0 +1,236 @@
+#ifndef COIN_TASKSCHEDULERP_H
+#define COIN_TASKSCHEDULERP_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif /* ! COIN_INTERNAL */
+
+// *************************************************************************
+
+// A work-stealing task scheduler for fine-grained parallel work in
+// Coin's internals. Each worker thread owns a deque of tasks: tasks
+// spawned from a worker are pushed onto and popped from the bottom of
+// its own deque (depth first), while idle workers steal from the top
+// of the other deques (the biggest pieces of work, when work is
+// split recursively). Tasks spawned from other threads go through a
+// shared injection deque.
+//
+// Tasks are spawned through an SbTaskGroup, which can be waited on.
+// A thread waiting for a group executes pending tasks while waiting,
+// so waiting from within a task (nested parallelism) doesn't tie up
+// the worker.
+//
+// Without thread support, tasks are run immediately by the spawning
+// thread.
+
+#include <atomic>
+
+#include <Inventor/SbBasic.h>
+
+class SbTaskSchedulerP;
+class SbTaskGroup;
+
+// *************************************************************************
+
+class SbTaskScheduler {
+public:
+  typedef void TaskFunc(void * closure);
+
+  SbTaskScheduler(const int numworkers);
+  ~SbTaskScheduler();
+
+  int getNumWorkers(void) const;
+
+  // The shared scheduler used for parallel traversals and the
+  // parallelFor() / parallelReduce() helpers. Its number of worker
+  // threads is one less than the number of CPUs (the thread waiting
+  // for the work takes part), or as set by the COIN_NUM_TASK_THREADS
+  // environment variable.
+  static SbTaskScheduler * getGlobal(void);
+
+  // Calls body(begin, end) for subranges of [begin, end) of at most
+  // grainsize elements, in parallel on the given scheduler, or the
+  // global one if NULL. A grainsize of 0 picks one giving a few
+  // subranges per thread.
+  template <class Body>
+  static void parallelFor(const int begin, const int end, const int grainsize,
+                          const Body & body, SbTaskScheduler * scheduler = NULL);
+
+  // Computes body(begin, end) for subranges of [begin, end) of
+  // grainsize elements in parallel, and combines the results in
+  // order with join(), starting with identity. The result is the
+  // same regardless of the number of threads. The scheduler is
+  // picked like for parallelFor().
+  template <typename Type, class Body, class Join>
+  static Type parallelReduce(const int begin, const int end, const int grainsize,
+                             const Type & identity, const Body & body,
+                             const Join & join, SbTaskScheduler * scheduler = NULL);
+
+  static int getGrainSize(const int num, const int grainsize,
+                          SbTaskScheduler * scheduler = NULL);
+
+private:
+  friend class SbTaskGroup;
+  friend class SbTaskSchedulerP;
+  SbTaskSchedulerP * pimpl;
+};
+
+// *************************************************************************
+
+class SbTaskGroup {
+public:
+  SbTaskGroup(SbTaskScheduler * scheduler = NULL);
+  ~SbTaskGroup();
+
+  void run(SbTaskScheduler::TaskFunc * func, void * closure);
+
+  // Waits until all tasks spawned through this group are done. If
+  // help is TRUE, the calling thread executes pending tasks of the
+  // scheduler while waiting, otherwise it just blocks.
+  void wait(const SbBool help = TRUE);
+
+  SbTaskScheduler * getScheduler(void) const { return this->scheduler; }
+
+private:
+  friend class SbTaskSchedulerP;
+  void taskDone(void);
+
+  SbTaskScheduler * scheduler;
+  std::atomic<int> pending;
+  std::atomic<int> signalling;
+  void * mutex;
+  void * condvar;
+};
+
+// *************************************************************************
+
+// Implementation of the parallel helpers.
+
+template <class Body>
+class SbParallelForRange {
+public:
+  SbParallelForRange(const Body & bodyref, SbTaskGroup & groupref,
+                     const int grain, const int first, const int last)
+    : body(bodyref), group(groupref), grainsize(grain), begin(first), end(last) { }
+
+  static void
+  run(const Body & body, SbTaskGroup & group, const int grainsize,
+      const int begin, int end)
+  {
+    // Spawn the upper halves and go on with the lower half, so that
+    // thieves take the biggest ranges.
+    while (end - begin > grainsize) {
+      const int mid = begin + (end - begin) / 2;
+      group.run(SbParallelForRange::task,
+                new SbParallelForRange(body, group, grainsize, mid, end));
+      end = mid;
+    }
+    body(begin, end);
+  }
+
+  static void
+  task(void * closure)
+  {
+    SbParallelForRange * range = static_cast<SbParallelForRange *>(closure);
+    run(range->body, range->group, range->grainsize, range->begin, range->end);
+    delete range;
+  }
+
+private:
+  const Body & body;
+  SbTaskGroup & group;
+  const int grainsize, begin, end;
+};
+
+template <class Body>
+void
+SbTaskScheduler::parallelFor(const int begin, const int end, const int grainsize,
+                             const Body & body, SbTaskScheduler * scheduler)
+{
+  if (end <= begin) return;
+  if (scheduler == NULL) scheduler = SbTaskScheduler::getGlobal();
+  const int grain = SbTaskScheduler::getGrainSize(end - begin, grainsize, scheduler);
+  if ((end - begin <= grain) || (scheduler->getNumWorkers() == 0)) {
+    body(begin, end);
+    return;
+  }
+  SbTaskGroup group(scheduler);
+  SbParallelForRange<Body>::run(body, group, grain, begin, end);
+  group.wait();
+}
+
+template <typename Type, class Body>
+class SbParallelReduceChunks {
+public:
+  SbParallelReduceChunks(Type * resultsptr, const Body & bodyref,
+                         const int first, const int last, const int grain)
+    : results(resultsptr), body(bodyref), begin(first), end(last), grainsize(grain) { }
+
+  void operator()(const int firstchunk, const int lastchunk) const {
+    for (int i = firstchunk; i < lastchunk; i++) {
+      const int first = this->begin + i * this->grainsize;
+      const int last = SbMin(first + this->grainsize, this->end);
+      this->results[i] = this->body(first, last);
+    }
+  }
+
+private:
+  Type * results;
+  const Body & body;
+  const int begin, end, grainsize;
+};
+
+template <typename Type, class Body, class Join>
+Type
+SbTaskScheduler::parallelReduce(const int begin, const int end, const int grainsize,
+                                const Type & identity, const Body & body,
+                                const Join & join, SbTaskScheduler * scheduler)
+{
+  if (end <= begin) return identity;
+  const int grain = SbTaskScheduler::getGrainSize(end - begin, grainsize, scheduler);
+  const int numchunks = (end - begin + grain - 1) / grain;
+
+  Type * results = new Type[numchunks];
+  SbTaskScheduler::parallelFor(0, numchunks, 1,
+                               SbParallelReduceChunks<Type, Body>(results, body,
+                                                                  begin, end, grain),
+                               scheduler);
+  Type result = identity;
+  for (int i = 0; i < numchunks; i++) { result = join(result, results[i]); }
+  delete[] results;
+  return result;
+}
+
+#endif // !COIN_TASKSCHEDULERP_H
@@ -147,6 +147,10 @@ enum coin_atexit_priorities {
   */
   CC_ATEXIT_SBNAME = CC_ATEXIT_NORMAL - 500,
 
+  /* stop the task scheduler's worker threads after everything that
+     might still run tasks, but before the threading subsystem goes: */
+  CC_ATEXIT_TASK_SCHEDULER = CC_ATEXIT_NORMAL - 900,
+
   /* needs to happen late, since CC_ATEXIT_NORMAL cleanup routines
      will for instance often want to dealloc mutexes: */
   CC_ATEXIT_THREADING_SUBSYSTEM = CC_ATEXIT_NORMAL - 1000,
@@ -65,15 +65,14 @@
 #include <Inventor/VRMLnodes/SoVRMLCoordinateInterpolator.h>
 
 #include <Inventor/VRMLnodes/SoVRMLMacros.h>
-#include <Inventor/lists/SbList.h>
 
+#include "engines/SoInterpolateP.h"
 #include "engines/SoSubNodeEngineP.h"
 
 #ifndef DOXYGEN_SKIP_THIS
 
 class SoVRMLCoordinateInterpolatorP {
 public:
-  SbList <SbVec3f> tmplist;
 };
 
 #endif // DOXYGEN_SKIP_THIS
@@ -113,10 +112,9 @@ SoVRMLCoordinateInterpolator::evaluate(void)
   if (!this->value_changed.isEnabled()) return;
 
   float interp;
-  int i, idx = this->getKeyValueIndex(interp, this->keyValue.getNum());
+  int idx = this->getKeyValueIndex(interp, this->keyValue.getNum());
   if (idx < 0) return;
 
-  PRIVATE(this)->tmplist.truncate(0);
   const int numkeys = this->key.getNum();
   const int numcoords = this->keyValue.getNum() / numkeys;
 
@@ -124,14 +122,8 @@ SoVRMLCoordinateInterpolator::evaluate(void)
   const SbVec3f * c1 = c0;
   if (interp > 0.0f) c1 = this->keyValue.getValues((idx+1)*numcoords);
 
-  for (i = 0; i < numcoords; i++) {
-    PRIVATE(this)->tmplist.append(c0[i] + (c1[i]-c0[i]) * interp);
-  }
-
-  const SbVec3f * coords = PRIVATE(this)->tmplist.getArrayPtr();
-
-  SO_ENGINE_OUTPUT(value_changed, SoMFVec3f, setNum(numcoords));
-  SO_ENGINE_OUTPUT(value_changed, SoMFVec3f, setValues(0, numcoords, coords));
+  SoInterpolateP::writeOutput<SoMFVec3f>(this->value_changed, c0, numcoords,
+                                         c1, numcoords, interp);
 }
 
 #undef PRIVATE
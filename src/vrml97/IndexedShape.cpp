@@ -70,6 +70,8 @@
 #include <Inventor/actions/SoAction.h>
 #include <Inventor/errors/SoDebugError.h>
 
+#include "actions/SoGetBoundingBoxActionP.h"
+#include "misc/SbCoordBounds.h"
 #include "nodes/SoSubNodeP.h"
 
 SO_NODE_ABSTRACT_SOURCE(SoVRMLIndexedShape);
@@ -167,7 +169,7 @@ SoVRMLIndexedShape::notify(SoNotList * list)
 
 // Doc in parent
 void
-SoVRMLIndexedShape::computeBBox(SoAction * COIN_UNUSED_ARG(action), SbBox3f & box,
+SoVRMLIndexedShape::computeBBox(SoAction * action, SbBox3f & box,
                                 SbVec3f & center)
 {
   SoVRMLCoordinate * node = (SoVRMLCoordinate*) this->coord.getValue();
@@ -175,23 +177,21 @@ SoVRMLIndexedShape::computeBBox(SoAction * COIN_UNUSED_ARG(action), SbBox3f & bo
 
   int numCoords = node->point.getNum();
   const SbVec3f * coords = node->point.getValues(0);
-
-  box.makeEmpty();
-  const int32_t * ptr = coordIndex.getValues(0);
-  const int32_t * endptr = ptr + coordIndex.getNum();
-  while (ptr < endptr) {
-    int idx = *ptr++;
-
-    if (idx >= numCoords) {
+  const int32_t * indices = coordIndex.getValues(0);
+  const int numindices = coordIndex.getNum();
+
+  SbCoordBounds bounds;
+  bounds.extendBy(coords, numCoords, indices, numindices,
+                  SoGetBoundingBoxActionP::getScheduler(action));
+  for (int i = 0; bounds.getNumInvalidIndices() > 0 && i < numindices; i++) {
+    if (indices[i] >= numCoords) {
       SoDebugError::post("SoVRMLIndexedShape::computeBBox",
                          "index @ %d: %d is out of bounds [%d, %d]",
-                         (ptr - coordIndex.getValues(0)) / sizeof(*ptr),
-                         idx, numCoords ? 0 : -1, numCoords - 1);
-      continue;
+                         i, indices[i], numCoords ? 0 : -1, numCoords - 1);
     }
-
-    if (idx >= 0) box.extendBy(coords[idx]);
   }
+
+  box = bounds.getBox();
   if (!box.isEmpty()) center = box.getCenter();
 }
 
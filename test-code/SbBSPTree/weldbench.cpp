@@ -0,0 +1,93 @@
+/************************************************************************
+ *
+ * SbBSPTree vertex welding benchmark
+ *
+ * Makes the unwelded vertex array of a triangulated grid mesh, where
+ * each vertex is shared by up to six triangles and thus repeated up to
+ * six times, and welds it with an SbBSPTree, first by calling
+ * SbBSPTree::addPoint() for each vertex, then with one call to
+ * SbBSPTree::addPoints(). Then runs closest point and k-nearest
+ * queries on the welded tree.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build weldbench weldbench.cpp
+ *   ./weldbench [vertices]
+ *
+ * The default is 10 million unwelded vertices.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SbBSPTree.h>
+#include <Inventor/lists/SbIntList.h>
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int numvertices = argc > 1 ? atoi(argv[1]) : 10000000;
+
+  // two triangles per grid cell, six vertices
+  const int side = (int)sqrt((double)numvertices / 6.0) + 1;
+  SbVec3f * vertices = new SbVec3f[numvertices];
+  int n = 0;
+  for (int y = 0; y < side && n < numvertices; y++) {
+    for (int x = 0; x < side && n < numvertices; x++) {
+      const int corners[6][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 0}, {1, 1}, {0, 1} };
+      for (int c = 0; c < 6 && n < numvertices; c++) {
+        const float px = (float)(x + corners[c][0]);
+        const float py = (float)(y + corners[c][1]);
+        vertices[n++].setValue(px, py, (float)sin(px * 0.1f) * (float)cos(py * 0.1f));
+      }
+    }
+  }
+  int * indices = new int[numvertices];
+
+  SbTime start = SbTime::getTimeOfDay();
+  SbBSPTree single;
+  for (int i = 0; i < numvertices; i++) {
+    indices[i] = single.addPoint(vertices[i]);
+  }
+  const double singletime = (SbTime::getTimeOfDay() - start).getValue();
+
+  start = SbTime::getTimeOfDay();
+  SbBSPTree bulk;
+  bulk.addPoints(vertices, numvertices, indices);
+  const double bulktime = (SbTime::getTimeOfDay() - start).getValue();
+
+  fprintf(stdout, "%d vertices welded to %d\n", numvertices, bulk.numPoints());
+  fprintf(stdout, "addPoint():  %7.3f s\n", singletime);
+  fprintf(stdout, "addPoints(): %7.3f s (speedup %5.2f)\n",
+          bulktime, singletime / bulktime);
+
+  const int numqueries = 1000000;
+  start = SbTime::getTimeOfDay();
+  long sum = 0;
+  for (int i = 0; i < numqueries; i++) {
+    const SbVec3f & v = vertices[(int)(((long)i * 7919) % numvertices)];
+    sum += bulk.findClosest(v + SbVec3f(0.3f, 0.2f, 0.1f));
+  }
+  fprintf(stdout, "%d findClosest() queries: %7.3f s\n", numqueries,
+          (SbTime::getTimeOfDay() - start).getValue());
+
+  start = SbTime::getTimeOfDay();
+  SbIntList nearest;
+  for (int i = 0; i < numqueries; i++) {
+    const SbVec3f & v = vertices[(int)(((long)i * 7919) % numvertices)];
+    nearest.truncate(0);
+    bulk.findNearest(v + SbVec3f(0.3f, 0.2f, 0.1f), 8, nearest);
+    sum += nearest[0];
+  }
+  fprintf(stdout, "%d findNearest() queries, k = 8: %7.3f s (%ld)\n", numqueries,
+          (SbTime::getTimeOfDay() - start).getValue(), sum);
+
+  delete[] vertices;
+  delete[] indices;
+  return 0;
+}
@@ -0,0 +1,114 @@
+/************************************************************************
+ *
+ * SbName construction benchmark
+ *
+ * Measures SbName creation throughput, both from a single thread and
+ * from several threads at the same time, for names that are already
+ * in the name table (the common case when reading files) and for
+ * names that are new.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build namebench namebench.cpp
+ *   ./namebench [numthreads] [numnames]
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbName.h>
+#include <Inventor/SbString.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/threads/SbThread.h>
+
+static int numnames = 200000;
+static const int ROUNDS = 10;
+
+class thread_data {
+public:
+  const SbString * strings;
+  int first;
+  int count;
+};
+
+static void *
+create_names(void * closure)
+{
+  thread_data * data = (thread_data *) closure;
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = data->first; i < data->first + data->count; i++) {
+      SbName name(data->strings[i]);
+      (void)name;
+    }
+  }
+  return NULL;
+}
+
+// Runs create_names() on numthreads threads, each creating all the
+// strings (contended == TRUE) or a separate slice of them.
+static double
+run(const SbString * strings, int numthreads, SbBool contended)
+{
+  thread_data * data = new thread_data[numthreads];
+  SbThread ** threads = new SbThread*[numthreads];
+  const int slice = numnames / numthreads;
+
+  SbTime start = SbTime::getTimeOfDay();
+  for (int t = 0; t < numthreads; t++) {
+    data[t].strings = strings;
+    data[t].first = contended ? 0 : t * slice;
+    data[t].count = contended ? numnames : slice;
+    threads[t] = SbThread::create(create_names, &data[t]);
+  }
+  for (int t = 0; t < numthreads; t++) {
+    threads[t]->join();
+    SbThread::destroy(threads[t]);
+  }
+  double elapsed = (SbTime::getTimeOfDay() - start).getValue();
+
+  delete[] threads;
+  delete[] data;
+  return elapsed;
+}
+
+static void
+report(const char * label, int numthreads, SbBool contended, double secs)
+{
+  const double ops = double(ROUNDS) * numnames * (contended ? numthreads : 1);
+  (void)fprintf(stdout, "%-28s %2d thread(s): %8.3f s, %7.2f Mnames/s\n",
+                label, numthreads, secs, ops / secs / 1.0e6);
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  int maxthreads = argc > 1 ? atoi(argv[1]) : 4;
+  if (maxthreads < 1) maxthreads = 1;
+  if (argc > 2) numnames = atoi(argv[2]);
+  if (numnames < maxthreads) numnames = maxthreads;
+
+  SbString * strings = new SbString[numnames];
+  for (int i = 0; i < numnames; i++) {
+    strings[i].sprintf("benchmarkName_%d", i);
+  }
+
+  // first pass inserts the names, the rest are pure lookups
+  SbTime start = SbTime::getTimeOfDay();
+  for (int i = 0; i < numnames; i++) { SbName name(strings[i]); }
+  double secs = (SbTime::getTimeOfDay() - start).getValue();
+  (void)fprintf(stdout, "%-28s %2d thread(s): %8.3f s, %7.2f Mnames/s\n",
+                "insert new names", 1, secs, numnames / secs / 1.0e6);
+
+  for (int n = 1; n <= maxthreads; n *= 2) {
+    report("lookup, disjoint names", n, FALSE, run(strings, n, FALSE));
+  }
+  for (int n = 1; n <= maxthreads; n *= 2) {
+    report("lookup, contended names", n, TRUE, run(strings, n, TRUE));
+  }
+
+  delete[] strings;
+  return 0;
+}
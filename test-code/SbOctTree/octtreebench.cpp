@@ -0,0 +1,121 @@
+/************************************************************************
+ *
+ * SbOctTree query benchmark
+ *
+ * Fills an SbOctTree with small boxes scattered in a unit cube, and
+ * runs a large number of box queries on it: one at a time on the
+ * pointer-based tree, one at a time and in batches on the optimized
+ * tree (see SbOctTree::optimize()), and in batches on an optimized
+ * tree which tests the stored item bounding boxes instead of calling
+ * the item callback.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build octtreebench octtreebench.cpp
+ *   ./octtreebench [items] [queries]
+ *
+ * The default is 200000 items and 200000 queries.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SbOctTree.h>
+
+static SbBool
+insidebox(void * const item, const SbBox3f & box)
+{
+  return box.intersect(*(SbBox3f *) item);
+}
+
+static void
+itembox(void * const item, SbBox3f & box)
+{
+  box = *(SbBox3f *) item;
+}
+
+static float
+random_float(unsigned int & seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return (float)(seed >> 8) / (float)(1 << 24);
+}
+
+static void
+make_boxes(SbBox3f * boxes, int num, float size, unsigned int seed)
+{
+  for (int i = 0; i < num; i++) {
+    const SbVec3f p(random_float(seed), random_float(seed), random_float(seed));
+    const float s = size * (0.5f + random_float(seed));
+    boxes[i].setBounds(p, p + SbVec3f(s, s, s));
+  }
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int numitems = argc > 1 ? atoi(argv[1]) : 200000;
+  const int numqueries = argc > 2 ? atoi(argv[2]) : 200000;
+
+  SbBox3f * items = new SbBox3f[numitems];
+  SbBox3f * queries = new SbBox3f[numqueries];
+  make_boxes(items, numitems, 0.01f, 1);
+  make_boxes(queries, numqueries, 0.02f, 2);
+
+  const SbOctTreeFuncs funcs = { NULL, insidebox, NULL, NULL };
+  const SbBox3f bbox(-0.1f, -0.1f, -0.1f, 1.1f, 1.1f, 1.1f);
+  SbOctTree tree(bbox, funcs);
+  for (int i = 0; i < numitems; i++) { tree.addItem(&items[i]); }
+
+  SbList<void *> result;
+  SbList<int> offsets;
+  long found;
+
+  SbTime start = SbTime::getTimeOfDay();
+  found = 0;
+  for (int i = 0; i < numqueries; i++) {
+    result.truncate(0);
+    tree.findItems(queries[i], result);
+    found += result.getLength();
+  }
+  const double dynamic = (SbTime::getTimeOfDay() - start).getValue();
+  fprintf(stdout, "%d items, %d queries, %ld items found\n", numitems, numqueries, found);
+  fprintf(stdout, "pointer-based tree, single queries:  %7.3f s\n", dynamic);
+
+  start = SbTime::getTimeOfDay();
+  tree.optimize();
+  fprintf(stdout, "optimize():                          %7.3f s\n",
+          (SbTime::getTimeOfDay() - start).getValue());
+
+  start = SbTime::getTimeOfDay();
+  found = 0;
+  for (int i = 0; i < numqueries; i++) {
+    result.truncate(0);
+    tree.findItems(queries[i], result);
+    found += result.getLength();
+  }
+  double elapsed = (SbTime::getTimeOfDay() - start).getValue();
+  fprintf(stdout, "optimized tree, single queries:      %7.3f s (speedup %5.2f, %ld found)\n",
+          elapsed, dynamic / elapsed, found);
+
+  start = SbTime::getTimeOfDay();
+  tree.findItems(queries, numqueries, result, offsets);
+  elapsed = (SbTime::getTimeOfDay() - start).getValue();
+  fprintf(stdout, "optimized tree, batch query:         %7.3f s (speedup %5.2f, %d found)\n",
+          elapsed, dynamic / elapsed, result.getLength());
+
+  tree.optimize(itembox);
+  start = SbTime::getTimeOfDay();
+  tree.findItems(queries, numqueries, result, offsets);
+  elapsed = (SbTime::getTimeOfDay() - start).getValue();
+  fprintf(stdout, "item bounding boxes, batch query:    %7.3f s (speedup %5.2f, %d found)\n",
+          elapsed, dynamic / elapsed, result.getLength());
+
+  delete[] items;
+  delete[] queries;
+  return 0;
+}
@@ -0,0 +1,98 @@
+/************************************************************************
+ *
+ * SoCalculator evaluation benchmark
+ *
+ * Evaluates a few typical SoCalculator expressions (scalar
+ * arithmetic, a conditional, and vector math with temporaries) on
+ * large input arrays, and prints the average time per evaluation.
+ *
+ * Run it once as is, and once with COIN_CALCULATOR_NO_COMPILE=1 set
+ * in the environment, to compare the compiled register programs with
+ * evaluating the expression trees one value at a time.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build calculatorbench calculatorbench.cpp
+ *   ./calculatorbench [values] [evaluations]
+ *
+ * The default is 100000 values, and 20 evaluations per expression.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/engines/SoCalculator.h>
+#include <Inventor/fields/SoMFFloat.h>
+#include <Inventor/fields/SoMFVec3f.h>
+
+static const char * expressions[] = {
+  "oa = a * (0.5 + b) / c + sin(a)",
+  "oa = (a > b) ? (a * 0.5) : (b * c)",
+  "ta = dot(A, B); tA = normalize(cross(A, B)); oA = tA * ta + A * a; ob = length(oA)"
+};
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int num = argc > 1 ? atoi(argv[1]) : 100000;
+  const int evaluations = argc > 2 ? atoi(argv[2]) : 20;
+  fprintf(stdout, "%d values, %s\n", num,
+          getenv("COIN_CALCULATOR_NO_COMPILE") ? "interpreted" : "compiled");
+
+  SoCalculator * calc = new SoCalculator;
+  calc->ref();
+  calc->a.setNum(num);
+  calc->b.setNum(num);
+  calc->c.setNum(num);
+  calc->A.setNum(num);
+  calc->B.setNum(num);
+  float * a = calc->a.startEditing();
+  float * b = calc->b.startEditing();
+  float * c = calc->c.startEditing();
+  SbVec3f * A = calc->A.startEditing();
+  SbVec3f * B = calc->B.startEditing();
+  srand(1);
+  for (int i = 0; i < num; i++) {
+    a[i] = rand() / (float)RAND_MAX;
+    b[i] = rand() / (float)RAND_MAX;
+    c[i] = 1.0f + rand() / (float)RAND_MAX;
+    A[i].setValue(a[i], b[i], c[i]);
+    B[i].setValue(c[i], a[i], -b[i]);
+  }
+  calc->a.finishEditing();
+  calc->b.finishEditing();
+  calc->c.finishEditing();
+  calc->A.finishEditing();
+  calc->B.finishEditing();
+
+  SoMFFloat oa, ob;
+  SoMFVec3f oA;
+  oa.connectFrom(&calc->oa);
+  ob.connectFrom(&calc->ob);
+  oA.connectFrom(&calc->oA);
+
+  for (unsigned int e = 0; e < sizeof(expressions) / sizeof(expressions[0]); e++) {
+    calc->expression.setValue(expressions[e]);
+    double time = 0.0;
+    for (int i = 0; i < evaluations; i++) {
+      calc->a.set1Value(0, float(i));
+      SbTime start = SbTime::getTimeOfDay();
+      oa.evaluate();
+      ob.evaluate();
+      oA.evaluate();
+      time += (SbTime::getTimeOfDay() - start).getValue();
+    }
+    fprintf(stdout, "%8.3f ms per evaluation: %s\n",
+            1000.0 * time / evaluations, expressions[e]);
+  }
+
+  oa.disconnect();
+  ob.disconnect();
+  oA.disconnect();
+  calc->unref();
+  return 0;
+}
@@ -0,0 +1,105 @@
+/************************************************************************
+ *
+ * SoDB notification batch benchmark
+ *
+ * Builds a scene graph like the ones of a simulation: a number of
+ * objects grouped under some intermediate separators, each object
+ * with its own SoTransform. A node sensor is attached to the root,
+ * like the one a viewer (or SoRenderManager) uses to trigger
+ * redraws. For each frame, the translation and rotation of every
+ * SoTransform is changed, first with one notification for each
+ * setValue() call, then inside SoDB::beginNotificationBatch() /
+ * SoDB::commitNotificationBatch().
+ *
+ * The average time per frame for updating the fields (including the
+ * commit) is printed for both modes.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build notifybench notifybench.cpp
+ *   ./notifybench [objects] [frames]
+ *
+ * The default is 10000 objects, and 100 frames per mode.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTransform.h>
+#include <Inventor/sensors/SoNodeSensor.h>
+
+static void
+redraw_cb(void * data, SoSensor * sensor)
+{
+  (*(int *)data)++;
+}
+
+static void
+update(SoTransform ** transforms, int objects, int frame)
+{
+  for (int i = 0; i < objects; i++) {
+    transforms[i]->translation.setValue(float(i % 100), float(frame), float(i / 100));
+    transforms[i]->rotation.setValue(SbVec3f(0.0f, 1.0f, 0.0f), frame * 0.01f + i);
+  }
+}
+
+static void
+run(SoTransform ** transforms, int objects, int frames, SbBool batch,
+    int & redraws, const char * name)
+{
+  redraws = 0;
+  double time = 0.0;
+  for (int i = 0; i < frames; i++) {
+    SbTime start = SbTime::getTimeOfDay();
+    if (batch) SoDB::beginNotificationBatch();
+    update(transforms, objects, i);
+    if (batch) SoDB::commitNotificationBatch();
+    time += (SbTime::getTimeOfDay() - start).getValue();
+    SoDB::getSensorManager()->processDelayQueue(FALSE);
+  }
+  fprintf(stdout, "%-10s %8.3f ms per frame, %d redraws\n",
+          name, 1000.0 * time / frames, redraws);
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int objects = argc > 1 ? atoi(argv[1]) : 10000;
+  const int frames = argc > 2 ? atoi(argv[2]) : 100;
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoTransform ** transforms = new SoTransform*[objects];
+  SoSeparator * group = NULL;
+  SoCube * cube = new SoCube;
+  for (int i = 0; i < objects; i++) {
+    if (i % 100 == 0) {
+      group = new SoSeparator;
+      root->addChild(group);
+    }
+    SoSeparator * object = new SoSeparator;
+    transforms[i] = new SoTransform;
+    object->addChild(transforms[i]);
+    object->addChild(cube);
+    group->addChild(object);
+  }
+  fprintf(stdout, "%d objects\n", objects);
+
+  int redraws = 0;
+  SoNodeSensor * sensor = new SoNodeSensor(redraw_cb, &redraws);
+  sensor->attach(root);
+
+  run(transforms, objects, frames, FALSE, redraws, "unbatched");
+  run(transforms, objects, frames, TRUE, redraws, "batched");
+
+  delete sensor;
+  delete[] transforms;
+  root->unref();
+  return 0;
+}
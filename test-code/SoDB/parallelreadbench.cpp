@@ -0,0 +1,148 @@
+/************************************************************************
+ *
+ * SoDB::readAll() parallel parsing benchmark
+ *
+ * Writes a large ASCII Inventor file laid out like a typical CAD
+ * export: a single top-level separator with many small, independent
+ * child separators (a material, a transform and a little mesh each),
+ * with some materials shared between the children through DEF / USE.
+ * The file is then read back with SoDB::readAll() for an increasing
+ * number of threads (see SoDB::setNumReadThreads()).
+ *
+ * Build and run with:
+ *
+ *   coin-config --build parallelreadbench parallelreadbench.cpp
+ *   ./parallelreadbench [megabytes] [maxthreads] [filename]
+ *
+ * The default is a 256 MB file in the current directory, read with
+ * 1, 2, 4, ... up to 8 threads.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoInput.h>
+#include <Inventor/SoOutput.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/actions/SoWriteAction.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoTransform.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+
+static void
+write_file(const char * filename, int megabytes)
+{
+  // roughly 1 KB of ASCII text per child
+  const int numchildren = megabytes * 1024;
+  const int side = 5;
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+
+  SoMaterial * shared[16];
+  for (int i = 0; i < 16; i++) {
+    SbString name;
+    name.sprintf("material%d", i);
+    shared[i] = new SoMaterial;
+    shared[i]->setName(name.getString());
+    shared[i]->diffuseColor.setValue((i & 1) ? 1.0f : 0.2f,
+                                     (i & 2) ? 1.0f : 0.2f,
+                                     (i & 4) ? 1.0f : 0.2f);
+  }
+
+  for (int c = 0; c < numchildren; c++) {
+    SoSeparator * child = new SoSeparator;
+    child->addChild(shared[c % 16]);
+
+    SoTransform * transform = new SoTransform;
+    transform->translation.setValue((float)(c % 100), (float)(c / 100), 0.0f);
+    child->addChild(transform);
+
+    SoCoordinate3 * coords = new SoCoordinate3;
+    coords->point.setNum(side * side);
+    SbVec3f * pts = coords->point.startEditing();
+    for (int y = 0; y < side; y++) {
+      for (int x = 0; x < side; x++) {
+        pts[y * side + x].setValue(x * 0.1f, y * 0.1f, ((x + c) % 7) * 0.01f);
+      }
+    }
+    coords->point.finishEditing();
+    child->addChild(coords);
+
+    SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+    ifs->coordIndex.setNum((side - 1) * (side - 1) * 5);
+    int32_t * idx = ifs->coordIndex.startEditing();
+    for (int y = 0; y < side - 1; y++) {
+      for (int x = 0; x < side - 1; x++) {
+        const int32_t i0 = y * side + x;
+        *idx++ = i0; *idx++ = i0 + 1; *idx++ = i0 + side + 1; *idx++ = i0 + side; *idx++ = -1;
+      }
+    }
+    ifs->coordIndex.finishEditing();
+    child->addChild(ifs);
+
+    root->addChild(child);
+  }
+
+  SoOutput out;
+  if (!out.openFile(filename)) {
+    fprintf(stderr, "unable to open %s for writing\n", filename);
+    exit(1);
+  }
+  SoWriteAction wa(&out);
+  wa.apply(root);
+  out.closeFile();
+  root->unref();
+}
+
+static double
+read_file(const char * filename, int numthreads, int & numchildren)
+{
+  SoDB::setNumReadThreads(numthreads);
+
+  SoInput in;
+  SbTime start = SbTime::getTimeOfDay();
+  if (!in.openFile(filename)) {
+    fprintf(stderr, "unable to open %s\n", filename);
+    exit(1);
+  }
+  SoSeparator * root = SoDB::readAll(&in);
+  double elapsed = (SbTime::getTimeOfDay() - start).getValue();
+  if (!root) {
+    fprintf(stderr, "unable to read %s\n", filename);
+    exit(1);
+  }
+  root->ref();
+  numchildren = root->getNumChildren();
+  root->unref();
+  return elapsed;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int megabytes = argc > 1 ? atoi(argv[1]) : 256;
+  const int maxthreads = argc > 2 ? atoi(argv[2]) : 8;
+  const char * filename = argc > 3 ? argv[3] : "parallelreadbench.iv";
+
+  fprintf(stdout, "writing ~%d MB ASCII file %s...\n", megabytes, filename);
+  write_file(filename, megabytes);
+
+  int numchildren;
+  // warm up the OS file cache
+  (void)read_file(filename, 1, numchildren);
+
+  double serial = 0.0;
+  for (int threads = 1; threads <= maxthreads; threads *= 2) {
+    const double elapsed = read_file(filename, threads, numchildren);
+    if (threads == 1) serial = elapsed;
+    fprintf(stdout, "%2d thread(s): %7.3f s, %8.1f MB/s, speedup %5.2f (%d children)\n",
+            threads, elapsed, megabytes / elapsed, serial / elapsed, numchildren);
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+/************************************************************************
+ *
+ * SoEngine evaluation scheduling benchmark
+ *
+ * Builds a number of independent engine chains, each made of an
+ * SoComposeVec3f, an SoCalculator and an SoInterpolateVec3f engine
+ * driving the translation of an SoTransform. For each frame, the
+ * inputs of every chain are changed and the translations are read
+ * back, first with the engines evaluated lazily on the reads, then
+ * with SoEngine::evaluateDirtyEngines() run before the reads, both
+ * serially and on the shared worker threads.
+ *
+ * The average time per frame for evaluating the engines and reading
+ * the translations is printed for each mode. Note that the parallel
+ * mode can only be faster than the serial one on a machine with
+ * several cores.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build schedulebench schedulebench.cpp
+ *   ./schedulebench [chains] [frames]
+ *
+ * The default is 10000 chains, and 50 frames per mode.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/engines/SoCalculator.h>
+#include <Inventor/engines/SoCompose.h>
+#include <Inventor/engines/SoInterpolateVec3f.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTransform.h>
+
+static void
+run(SoComposeVec3f ** inputs, SoTransform ** transforms, int chains,
+    int frames, int numthreads, const char * name)
+{
+  SoEngine::enableEvaluationScheduling(numthreads >= 0);
+  double time = 0.0, sum = 0.0;
+  for (int f = 0; f < frames; f++) {
+    for (int i = 0; i < chains; i++) {
+      inputs[i]->x = float(f);
+      inputs[i]->y = float(i % 100);
+    }
+    SbTime start = SbTime::getTimeOfDay();
+    if (numthreads >= 0) SoEngine::evaluateDirtyEngines(numthreads);
+    for (int i = 0; i < chains; i++) {
+      sum += transforms[i]->translation.getValue()[0];
+    }
+    time += (SbTime::getTimeOfDay() - start).getValue();
+  }
+  SoEngine::enableEvaluationScheduling(FALSE);
+  fprintf(stdout, "%-10s %8.3f ms per frame (checksum %g)\n",
+          name, 1000.0 * time / frames, sum);
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int chains = argc > 1 ? atoi(argv[1]) : 10000;
+  const int frames = argc > 2 ? atoi(argv[2]) : 50;
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoComposeVec3f ** inputs = new SoComposeVec3f*[chains];
+  SoTransform ** transforms = new SoTransform*[chains];
+  for (int i = 0; i < chains; i++) {
+    inputs[i] = new SoComposeVec3f;
+    SoCalculator * calc = new SoCalculator;
+    calc->expression.setValue("oA = A * a + vec3f(b, 0, 0)");
+    calc->a = 0.5f;
+    calc->b = float(i % 7);
+    calc->A.connectFrom(&inputs[i]->vector);
+    SoInterpolateVec3f * interp = new SoInterpolateVec3f;
+    interp->input0.connectFrom(&calc->oA);
+    interp->input1 = SbVec3f(10.0f, 20.0f, 30.0f);
+    interp->alpha = 0.25f;
+    transforms[i] = new SoTransform;
+    transforms[i]->translation.connectFrom(&interp->output);
+    root->addChild(transforms[i]);
+  }
+  fprintf(stdout, "%d engine chains\n", chains);
+
+  run(inputs, transforms, chains, frames, -1, "lazy");
+  run(inputs, transforms, chains, frames, 1, "serial");
+  run(inputs, transforms, chains, frames, 0, "parallel");
+
+  delete[] inputs;
+  delete[] transforms;
+  root->unref();
+  return 0;
+}
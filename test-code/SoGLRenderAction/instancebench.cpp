@@ -0,0 +1,144 @@
+/************************************************************************
+ *
+ * SoInstancedMultipleCopy benchmark
+ *
+ * Renders a field of small "bolts" (a thin cylinder with a wide head)
+ * offscreen, first with SoMultipleCopy, then with
+ * SoInstancedMultipleCopy with and without per-instance colors. The
+ * bolts are placed on a grid with random rotations.
+ *
+ * For each mode, the average render time (SoOffscreenRenderer::render(),
+ * which waits for OpenGL to finish) is printed. The first frames are
+ * not counted, so that the instance cache is in place.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build instancebench instancebench.cpp
+ *   ./instancebench [bolts] [frames]
+ *
+ * The default is 100000 bolts, and 50 frames per mode.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoOffscreenRenderer.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/nodes/SoComplexity.h>
+#include <Inventor/nodes/SoCylinder.h>
+#include <Inventor/nodes/SoDirectionalLight.h>
+#include <Inventor/nodes/SoInstancedMultipleCopy.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoPerspectiveCamera.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+static SoSeparator *
+make_bolt(void)
+{
+  SoSeparator * bolt = new SoSeparator;
+  SoComplexity * complexity = new SoComplexity;
+  complexity->value = 0.2f;
+  bolt->addChild(complexity);
+  SoCylinder * shaft = new SoCylinder;
+  shaft->radius = 0.1f;
+  shaft->height = 1.0f;
+  bolt->addChild(shaft);
+  SoTranslation * t = new SoTranslation;
+  t->translation.setValue(0.0f, 0.55f, 0.0f);
+  bolt->addChild(t);
+  SoMaterial * headmat = new SoMaterial;
+  headmat->diffuseColor.setValue(0.6f, 0.6f, 0.65f);
+  bolt->addChild(headmat);
+  SoCylinder * head = new SoCylinder;
+  head->radius = 0.2f;
+  head->height = 0.1f;
+  bolt->addChild(head);
+  return bolt;
+}
+
+static void
+fill_matrices(SoMFMatrix & matrix, int bolts)
+{
+  const int side = (int) ceil(sqrt((double) bolts));
+  matrix.setNum(bolts);
+  SbMatrix * m = matrix.startEditing();
+  srand(1);
+  for (int i = 0; i < bolts; i++) {
+    SbRotation rot(SbVec3f(rand() / (float)RAND_MAX, 1.0f, rand() / (float)RAND_MAX),
+                   6.28f * rand() / (float)RAND_MAX);
+    m[i].setTransform(SbVec3f(float(i % side), 0.0f, float(i / side)), rot,
+                      SbVec3f(1.0f, 1.0f, 1.0f));
+  }
+  matrix.finishEditing();
+}
+
+static void
+run(SoOffscreenRenderer * renderer, SoSeparator * root, int frames, const char * name)
+{
+  double render = 0.0;
+  for (int i = -3; i < frames; i++) {
+    SbTime start = SbTime::getTimeOfDay();
+    if (!renderer->render(root)) {
+      fprintf(stderr, "couldn't render offscreen\n");
+      exit(1);
+    }
+    if (i >= 0) render += (SbTime::getTimeOfDay() - start).getValue();
+  }
+  fprintf(stdout, "%-22s render %8.3f ms per frame\n", name, 1000.0 * render / frames);
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int bolts = argc > 1 ? atoi(argv[1]) : 100000;
+  const int frames = argc > 2 ? atoi(argv[2]) : 50;
+  const int side = (int) ceil(sqrt((double) bolts));
+
+  SoPerspectiveCamera * camera = new SoPerspectiveCamera;
+  camera->position.setValue(side * 0.5f, side * 0.6f, side * 1.2f);
+  camera->pointAt(SbVec3f(side * 0.5f, 0.0f, side * 0.5f));
+  camera->nearDistance = 0.5f;
+  camera->farDistance = side * 3.0f;
+
+  SoMultipleCopy * plain = new SoMultipleCopy;
+  SoInstancedMultipleCopy * instanced = new SoInstancedMultipleCopy;
+  fill_matrices(plain->matrix, bolts);
+  fill_matrices(instanced->matrix, bolts);
+  SoSeparator * bolt = make_bolt();
+  plain->addChild(bolt);
+  instanced->addChild(bolt);
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  root->addChild(camera);
+  root->addChild(new SoDirectionalLight);
+  root->addChild(plain);
+  fprintf(stdout, "%d bolts\n", bolts);
+
+  SbViewportRegion vp(1024, 768);
+  SoOffscreenRenderer * renderer = new SoOffscreenRenderer(vp);
+
+  run(renderer, root, frames, "SoMultipleCopy");
+
+  root->replaceChild(plain, instanced);
+  run(renderer, root, frames, "instanced");
+
+  instanced->color.setNum(bolts);
+  SbColor * colors = instanced->color.startEditing();
+  for (int i = 0; i < bolts; i++) {
+    colors[i].setHSVValue(rand() / (float)RAND_MAX, 0.6f, 0.9f);
+  }
+  instanced->color.finishEditing();
+  run(renderer, root, frames, "instanced with colors");
+
+  delete renderer;
+  root->unref();
+  return 0;
+}
@@ -0,0 +1,152 @@
+/************************************************************************
+ *
+ * SoLODIndexedFaceSet benchmark
+ *
+ * Renders a generated terrain offscreen from a low camera looking
+ * towards the horizon, first as an SoIndexedFaceSet, then as an
+ * SoLODIndexedFaceSet with a few complexity values.
+ *
+ * For each mode, the average render time (SoOffscreenRenderer::render(),
+ * which waits for OpenGL to finish) and the number of clusters and
+ * triangles rendered per frame are printed. The first frames are not
+ * counted, so that the level of detail hierarchy is in place.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build lodbench lodbench.cpp
+ *   ./lodbench [size] [frames]
+ *
+ * The default is a 1024x1024 grid (2M triangles), and 50 frames per
+ * mode.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoOffscreenRenderer.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/nodes/SoComplexity.h>
+#include <Inventor/nodes/SoDirectionalLight.h>
+#include <Inventor/nodes/SoLODIndexedFaceSet.h>
+#include <Inventor/nodes/SoPerspectiveCamera.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoShapeHints.h>
+#include <Inventor/nodes/SoVertexProperty.h>
+
+static SoVertexProperty *
+make_terrain(int size)
+{
+  SoVertexProperty * vp = new SoVertexProperty;
+  vp->vertex.setNum((size + 1) * (size + 1));
+  SbVec3f * v = vp->vertex.startEditing();
+  for (int y = 0; y <= size; y++) {
+    for (int x = 0; x <= size; x++) {
+      const float h =
+        8.0f * sinf(x * 0.013f) * cosf(y * 0.011f) +
+        2.0f * sinf(x * 0.071f + y * 0.053f) +
+        0.3f * sinf(x * 0.31f) * sinf(y * 0.29f);
+      v[y * (size + 1) + x].setValue(float(x), h, float(y));
+    }
+  }
+  vp->vertex.finishEditing();
+  return vp;
+}
+
+static void
+fill_indices(SoMFInt32 & coordindex, int size)
+{
+  coordindex.setNum(size * size * 5);
+  int32_t * idx = coordindex.startEditing();
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      const int a = y * (size + 1) + x;
+      *idx++ = a;
+      *idx++ = a + size + 1;
+      *idx++ = a + size + 2;
+      *idx++ = a + 1;
+      *idx++ = -1;
+    }
+  }
+  coordindex.finishEditing();
+}
+
+static void
+run(SoOffscreenRenderer * renderer, SoSeparator * root, SoLODIndexedFaceSet * lod,
+    int frames, const char * name)
+{
+  double render = 0.0, clusters = 0.0, triangles = 0.0;
+  for (int i = -3; i < frames; i++) {
+    SbTime start = SbTime::getTimeOfDay();
+    if (!renderer->render(root)) {
+      fprintf(stderr, "couldn't render offscreen\n");
+      exit(1);
+    }
+    if (i < 0) continue;
+    render += (SbTime::getTimeOfDay() - start).getValue();
+    if (lod) {
+      int numclusters, numtriangles;
+      lod->getLODStatistics(numclusters, numtriangles);
+      clusters += numclusters;
+      triangles += numtriangles;
+    }
+  }
+  fprintf(stdout, "%-22s render %8.3f ms per frame, %8.1f clusters, %10.1f triangles\n",
+          name, 1000.0 * render / frames, clusters / frames, triangles / frames);
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int size = argc > 1 ? atoi(argv[1]) : 1024;
+  const int frames = argc > 2 ? atoi(argv[2]) : 50;
+
+  SoPerspectiveCamera * camera = new SoPerspectiveCamera;
+  camera->position.setValue(size * 0.5f, 20.0f, -10.0f);
+  camera->pointAt(SbVec3f(size * 0.5f, 0.0f, size * 0.5f));
+  camera->nearDistance = 1.0f;
+  camera->farDistance = size * 2.0f;
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  root->addChild(camera);
+  root->addChild(new SoDirectionalLight);
+  SoShapeHints * hints = new SoShapeHints;
+  hints->creaseAngle = 1.0f;
+  root->addChild(hints);
+  SoComplexity * complexity = new SoComplexity;
+  root->addChild(complexity);
+
+  SoVertexProperty * vp = make_terrain(size);
+  SoIndexedFaceSet * plain = new SoIndexedFaceSet;
+  plain->vertexProperty = vp;
+  fill_indices(plain->coordIndex, size);
+  SoLODIndexedFaceSet * lod = new SoLODIndexedFaceSet;
+  lod->vertexProperty = vp;
+  fill_indices(lod->coordIndex, size);
+
+  root->addChild(plain);
+  fprintf(stdout, "%dx%d terrain, %d triangles\n", size, size, size * size * 2);
+
+  SbViewportRegion viewport(1024, 768);
+  SoOffscreenRenderer * renderer = new SoOffscreenRenderer(viewport);
+
+  run(renderer, root, NULL, frames, "SoIndexedFaceSet");
+
+  root->replaceChild(plain, lod);
+  const float values[] = { 0.5f, 0.8f, 1.0f };
+  for (int i = 0; i < 3; i++) {
+    char name[64];
+    sprintf(name, "LOD, complexity %.1f", values[i]);
+    complexity->value = values[i];
+    run(renderer, root, lod, frames, name);
+  }
+
+  delete renderer;
+  root->unref();
+  return 0;
+}
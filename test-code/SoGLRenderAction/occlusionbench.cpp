@@ -0,0 +1,233 @@
+/************************************************************************
+ *
+ * SoGLRenderAction occlusion culling benchmark
+ *
+ * Generates a walkthrough scene: a grid of rooms separated by walls
+ * with doorways, where each room holds a number of pieces of
+ * equipment (detailed spheres and cylinders, each under its own
+ * SoSeparator). The walls come first in the scene graph. The camera
+ * walks through the middle of the grid while turning around, and the
+ * scene is rendered offscreen for a number of frames with each
+ * SoGLRenderAction::OcclusionCullingType.
+ *
+ * For each mode, the average traversal time (from the start of the
+ * traversal until the last node has been traversed) and render time
+ * (SoOffscreenRenderer::render(), which waits for OpenGL to finish)
+ * are printed, together with the average number of separators tested
+ * and culled per frame.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build occlusionbench occlusionbench.cpp
+ *   ./occlusionbench [rooms] [objects] [frames]
+ *
+ * The default is a 12x12 grid of rooms with 40 objects in each, and
+ * 100 frames per mode.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoOffscreenRenderer.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/nodes/SoCallback.h>
+#include <Inventor/nodes/SoComplexity.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoCylinder.h>
+#include <Inventor/nodes/SoDirectionalLight.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoPerspectiveCamera.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoSphere.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+static const float ROOMSIZE = 10.0f;
+static const float WALLHEIGHT = 4.0f;
+static const float DOORWIDTH = 1.5f;
+
+static SbTime traversalstart;
+static SbTime traversalend;
+
+static void
+prerender_cb(void * closure, SoGLRenderAction * action)
+{
+  traversalstart = SbTime::getTimeOfDay();
+}
+
+static void
+end_cb(void * closure, SoAction * action)
+{
+  if (action->isOfType(SoGLRenderAction::getClassTypeId())) {
+    traversalend = SbTime::getTimeOfDay();
+  }
+}
+
+static void
+add_wall(SoSeparator * walls, float x, float z, float width, float depth)
+{
+  SoSeparator * sep = new SoSeparator;
+  SoTranslation * t = new SoTranslation;
+  t->translation.setValue(x, WALLHEIGHT * 0.5f, z);
+  SoCube * cube = new SoCube;
+  cube->width = width;
+  cube->height = WALLHEIGHT;
+  cube->depth = depth;
+  sep->addChild(t);
+  sep->addChild(cube);
+  walls->addChild(sep);
+}
+
+// a wall along x or z from (x, z), with a doorway in the middle
+static void
+add_wall_with_door(SoSeparator * walls, float x, float z, SbBool alongx)
+{
+  const float piece = (ROOMSIZE - DOORWIDTH) * 0.5f;
+  const float offset = (piece + DOORWIDTH) * 0.5f;
+  const float c = alongx ? x + ROOMSIZE * 0.5f : z + ROOMSIZE * 0.5f;
+  for (int side = -1; side <= 1; side += 2) {
+    if (alongx) add_wall(walls, c + side * offset, z, piece, 0.2f);
+    else add_wall(walls, x, c + side * offset, 0.2f, piece);
+  }
+}
+
+static SoSeparator *
+make_scene(int rooms, int objects, SoPerspectiveCamera * camera)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  root->addChild(camera);
+  root->addChild(new SoDirectionalLight);
+
+  SoSeparator * walls = new SoSeparator;
+  SoMaterial * wallmat = new SoMaterial;
+  wallmat->diffuseColor.setValue(0.8f, 0.8f, 0.7f);
+  walls->addChild(wallmat);
+  for (int i = 0; i <= rooms; i++) {
+    for (int j = 0; j < rooms; j++) {
+      add_wall_with_door(walls, j * ROOMSIZE, i * ROOMSIZE, TRUE);
+      add_wall_with_door(walls, i * ROOMSIZE, j * ROOMSIZE, FALSE);
+    }
+  }
+  root->addChild(walls);
+
+  SoComplexity * complexity = new SoComplexity;
+  complexity->value = 0.8f;
+  root->addChild(complexity);
+  SoMaterial * equipmat = new SoMaterial;
+  equipmat->diffuseColor.setValue(0.3f, 0.5f, 0.8f);
+  root->addChild(equipmat);
+
+  srand(1);
+  for (int i = 0; i < rooms; i++) {
+    for (int j = 0; j < rooms; j++) {
+      SoSeparator * room = new SoSeparator;
+      SoTranslation * t = new SoTranslation;
+      t->translation.setValue(j * ROOMSIZE, 0.0f, i * ROOMSIZE);
+      room->addChild(t);
+      for (int k = 0; k < objects; k++) {
+        SoSeparator * sep = new SoSeparator;
+        SoTranslation * pos = new SoTranslation;
+        pos->translation.setValue(1.0f + (ROOMSIZE - 2.0f) * (rand() / (float)RAND_MAX),
+                                  0.5f + 2.0f * (rand() / (float)RAND_MAX),
+                                  1.0f + (ROOMSIZE - 2.0f) * (rand() / (float)RAND_MAX));
+        sep->addChild(pos);
+        if (k % 2) {
+          SoSphere * sphere = new SoSphere;
+          sphere->radius = 0.3f;
+          sep->addChild(sphere);
+        }
+        else {
+          SoCylinder * cylinder = new SoCylinder;
+          cylinder->radius = 0.15f;
+          cylinder->height = 1.0f;
+          sep->addChild(cylinder);
+        }
+        room->addChild(sep);
+      }
+      root->addChild(room);
+    }
+  }
+
+  SoCallback * end = new SoCallback;
+  end->setCallback(end_cb, NULL);
+  root->addChild(end);
+  return root;
+}
+
+static void
+place_camera(SoPerspectiveCamera * camera, int rooms, int frame, int frames)
+{
+  // walk along the middle row of rooms, turning around
+  const float t = (float)frame / (float)frames;
+  const float mid = (rooms / 2 + 0.5f) * ROOMSIZE;
+  camera->position.setValue(ROOMSIZE * 0.5f + t * (rooms - 1) * ROOMSIZE, 1.7f, mid);
+  camera->orientation.setValue(SbVec3f(0.0f, 1.0f, 0.0f), t * 4.0f * (float)M_PI);
+  camera->nearDistance = 0.1f;
+  camera->farDistance = rooms * ROOMSIZE * 1.5f;
+}
+
+static void
+run(SoOffscreenRenderer * renderer, SoSeparator * root, SoPerspectiveCamera * camera,
+    int rooms, int frames, SoGLRenderAction::OcclusionCullingType type, const char * name)
+{
+  SoGLRenderAction * action = renderer->getGLRenderAction();
+  action->setOcclusionCullingType(type);
+
+  double traversal = 0.0, render = 0.0;
+  double tested = 0.0, culled = 0.0;
+  SoGetBoundingBoxAction bboxaction(renderer->getViewportRegion());
+  for (int i = -5; i < frames; i++) {
+    place_camera(camera, rooms, i < 0 ? 0 : i, frames);
+    // sets up the bounding box caches used for culling, like the
+    // viewers do when they adjust the clipping planes
+    bboxaction.apply(root);
+    SbTime start = SbTime::getTimeOfDay();
+    if (!renderer->render(root)) {
+      fprintf(stderr, "couldn't render offscreen\n");
+      exit(1);
+    }
+    SbTime end = SbTime::getTimeOfDay();
+    if (i < 0) continue; // warm up caches and queries
+    traversal += (traversalend - traversalstart).getValue();
+    render += (end - start).getValue();
+    int numtested, numculled, numoccluders, numqueries;
+    action->getOcclusionCullingStatistics(numtested, numculled, numoccluders, numqueries);
+    tested += numtested;
+    culled += numculled;
+  }
+  fprintf(stdout, "%-10s traversal %8.3f ms, render %8.3f ms, "
+          "tested %8.1f, culled %8.1f per frame\n",
+          name, 1000.0 * traversal / frames, 1000.0 * render / frames,
+          tested / frames, culled / frames);
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int rooms = argc > 1 ? atoi(argv[1]) : 12;
+  const int objects = argc > 2 ? atoi(argv[2]) : 40;
+  const int frames = argc > 3 ? atoi(argv[3]) : 100;
+
+  SoPerspectiveCamera * camera = new SoPerspectiveCamera;
+  SoSeparator * root = make_scene(rooms, objects, camera);
+  fprintf(stdout, "%dx%d rooms, %d objects\n", rooms, rooms, rooms * rooms * objects);
+
+  SbViewportRegion vp(1024, 768);
+  SoOffscreenRenderer * renderer = new SoOffscreenRenderer(vp);
+  renderer->getGLRenderAction()->addPreRenderCallback(prerender_cb, NULL);
+
+  run(renderer, root, camera, rooms, frames, SoGLRenderAction::OCCLUSION_CULLING_NONE, "none");
+  run(renderer, root, camera, rooms, frames, SoGLRenderAction::OCCLUSION_CULLING_SOFTWARE, "software");
+  run(renderer, root, camera, rooms, frames, SoGLRenderAction::OCCLUSION_CULLING_HARDWARE, "hardware");
+
+  delete renderer;
+  root->unref();
+  return 0;
+}
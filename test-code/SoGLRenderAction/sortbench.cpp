@@ -0,0 +1,147 @@
+/************************************************************************
+ *
+ * Transparent triangle sorting benchmark
+ *
+ * Renders a transparent, bumpy sphere made from a large number of
+ * triangles offscreen, with the SORTED_OBJECT_SORTED_TRIANGLE_BLEND
+ * transparency type, so that the triangles are depth sorted in the
+ * shape's vertex array cache whenever the view changes.
+ *
+ * The mesh is first rendered a number of frames with a fixed camera,
+ * where the triangles are sorted only once, and then the same number
+ * of frames with the camera orbiting the mesh by a small angle each
+ * frame, where the triangles are sorted every frame. The difference
+ * in the average frame time is reported as the sort time per frame.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build sortbench sortbench.cpp
+ *   ./sortbench [subdivisions] [frames] [degrees per frame]
+ *
+ * The default is a sphere with 1000x500 quads (1000000 triangles),
+ * 50 frames, and 1 degree per frame. The number of threads used for
+ * large sorts can be set with the COIN_NUM_TASK_THREADS environment
+ * variable.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoOffscreenRenderer.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/nodes/SoDirectionalLight.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoPerspectiveCamera.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoShapeHints.h>
+#include <Inventor/nodes/SoVertexProperty.h>
+
+static SoIndexedFaceSet *
+make_sphere(int nu, int nv)
+{
+  SoVertexProperty * vp = new SoVertexProperty;
+  vp->vertex.setNum(nu * (nv + 1));
+  SbVec3f * v = vp->vertex.startEditing();
+  for (int j = 0; j <= nv; j++) {
+    const double theta = M_PI * j / nv;
+    for (int i = 0; i < nu; i++) {
+      const double phi = 2.0 * M_PI * i / nu;
+      const double r = 1.0 + 0.05 * sin(phi * 12.0) * sin(theta * 9.0);
+      v[j * nu + i].setValue((float) (r * sin(theta) * cos(phi)),
+                             (float) (r * cos(theta)),
+                             (float) (r * sin(theta) * sin(phi)));
+    }
+  }
+  vp->vertex.finishEditing();
+
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  ifs->vertexProperty = vp;
+  ifs->coordIndex.setNum(nu * nv * 8);
+  int32_t * idx = ifs->coordIndex.startEditing();
+  for (int j = 0; j < nv; j++) {
+    for (int i = 0; i < nu; i++) {
+      const int i1 = (i + 1) % nu;
+      *idx++ = j * nu + i;
+      *idx++ = j * nu + i1;
+      *idx++ = (j + 1) * nu + i1;
+      *idx++ = -1;
+      *idx++ = j * nu + i;
+      *idx++ = (j + 1) * nu + i1;
+      *idx++ = (j + 1) * nu + i;
+      *idx++ = -1;
+    }
+  }
+  ifs->coordIndex.finishEditing();
+  return ifs;
+}
+
+static void
+place_camera(SoPerspectiveCamera * camera, float angle)
+{
+  camera->position.setValue(4.0f * sinf(angle), 1.0f, 4.0f * cosf(angle));
+  camera->pointAt(SbVec3f(0.0f, 0.0f, 0.0f));
+}
+
+static double
+run(SoOffscreenRenderer * renderer, SoSeparator * root, SoPerspectiveCamera * camera,
+    int frames, float step)
+{
+  // warm up, so that the vertex array cache is built
+  place_camera(camera, 0.0f);
+  for (int i = 0; i < 3; i++) renderer->render(root);
+
+  SbTime start = SbTime::getTimeOfDay();
+  for (int i = 0; i < frames; i++) {
+    place_camera(camera, step * (i + 1));
+    if (!renderer->render(root)) {
+      fprintf(stderr, "couldn't render offscreen\n");
+      exit(1);
+    }
+  }
+  return (SbTime::getTimeOfDay() - start).getValue() / frames;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int nu = argc > 1 ? atoi(argv[1]) : 1000;
+  const int frames = argc > 2 ? atoi(argv[2]) : 50;
+  const float degrees = argc > 3 ? (float) atof(argv[3]) : 1.0f;
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoPerspectiveCamera * camera = new SoPerspectiveCamera;
+  root->addChild(camera);
+  root->addChild(new SoDirectionalLight);
+  SoShapeHints * hints = new SoShapeHints;
+  hints->vertexOrdering = SoShapeHints::COUNTERCLOCKWISE;
+  root->addChild(hints);
+  SoMaterial * material = new SoMaterial;
+  material->diffuseColor.setValue(0.2f, 0.6f, 0.9f);
+  material->transparency = 0.5f;
+  root->addChild(material);
+  root->addChild(make_sphere(nu, nu / 2));
+  fprintf(stdout, "%d triangles\n", nu * (nu / 2) * 2);
+
+  SbViewportRegion vp(512, 512);
+  SoOffscreenRenderer * renderer = new SoOffscreenRenderer(vp);
+  renderer->getGLRenderAction()->setTransparencyType(SoGLRenderAction::SORTED_OBJECT_SORTED_TRIANGLE_BLEND);
+
+  const double fixed = run(renderer, root, camera, frames, 0.0f);
+  const double orbiting = run(renderer, root, camera, frames, degrees * (float) M_PI / 180.0f);
+
+  fprintf(stdout, "fixed camera %8.3f ms/frame, orbiting %8.3f ms/frame, "
+          "sort time %8.3f ms/frame\n",
+          fixed * 1000.0, orbiting * 1000.0, (orbiting - fixed) * 1000.0);
+
+  delete renderer;
+  root->unref();
+  return 0;
+}
@@ -0,0 +1,99 @@
+/************************************************************************
+ *
+ * SoGetBoundingBoxAction scaling benchmark
+ *
+ * Sets up a scene of point clouds, each under its own SoSeparator
+ * with an SoCoordinate3 and an SoPointSet, and computes the bounding
+ * box of it for an increasing number of threads (see
+ * SoGetBoundingBoxAction::setNumThreads()). For each number of
+ * threads, the scene is rebuilt, and the time of the first (cold)
+ * traversal and the average time of the following (cached)
+ * traversals are printed.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build bboxbench bboxbench.cpp
+ *   ./bboxbench [clouds] [points] [maxthreads]
+ *
+ * The default is 64 clouds of 100000 points each, tested with 1, 2,
+ * 4, ... up to 8 threads.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoPointSet.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+static SoSeparator *
+make_scene(int clouds, int points)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  srand(1);
+  for (int i = 0; i < clouds; i++) {
+    SoSeparator * sep = new SoSeparator;
+    SoTranslation * t = new SoTranslation;
+    t->translation.setValue(float(i % 8) * 2.0f, 0.0f, float(i / 8) * 2.0f);
+    sep->addChild(t);
+    SoCoordinate3 * coords = new SoCoordinate3;
+    coords->point.setNum(points);
+    SbVec3f * pts = coords->point.startEditing();
+    for (int j = 0; j < points; j++) {
+      pts[j].setValue(rand() / (float)RAND_MAX,
+                      rand() / (float)RAND_MAX,
+                      rand() / (float)RAND_MAX);
+    }
+    coords->point.finishEditing();
+    sep->addChild(coords);
+    sep->addChild(new SoPointSet);
+    root->addChild(sep);
+  }
+  return root;
+}
+
+static void
+run(int clouds, int points, int threads, int repeats)
+{
+  SoSeparator * root = make_scene(clouds, points);
+  SoGetBoundingBoxAction action(SbViewportRegion(640, 480));
+  action.setNumThreads(threads);
+
+  SbTime start = SbTime::getTimeOfDay();
+  action.apply(root);
+  const double cold = (SbTime::getTimeOfDay() - start).getValue();
+
+  start = SbTime::getTimeOfDay();
+  for (int i = 0; i < repeats; i++) action.apply(root);
+  const double warm = (SbTime::getTimeOfDay() - start).getValue() / repeats;
+
+  SbVec3f bmin = action.getBoundingBox().getMin();
+  SbVec3f bmax = action.getBoundingBox().getMax();
+  fprintf(stdout, "%2d threads: cold %8.3f ms, cached %8.3f ms, "
+          "box <%g %g %g> - <%g %g %g>\n",
+          threads, 1000.0 * cold, 1000.0 * warm,
+          bmin[0], bmin[1], bmin[2], bmax[0], bmax[1], bmax[2]);
+  root->unref();
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int clouds = argc > 1 ? atoi(argv[1]) : 64;
+  const int points = argc > 2 ? atoi(argv[2]) : 100000;
+  const int maxthreads = argc > 3 ? atoi(argv[3]) : 8;
+  fprintf(stdout, "%d clouds, %d points\n", clouds, clouds * points);
+
+  for (int threads = 1; threads <= maxthreads; threads *= 2) {
+    run(clouds, points, threads, 20);
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+/************************************************************************
+ *
+ * SoInput ASCII number array parsing benchmark
+ *
+ * Writes an ASCII Inventor scene with a large SoCoordinate3 point
+ * array and, separately, one with a large SoIndexedFaceSet index
+ * array to memory buffers, and reads each of them back with
+ * SoDB::readAll(). This measures the parsing speed of SoMFVec3f and
+ * SoMFInt32 values, which are read in bulk straight from the input
+ * buffer.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build asciiarraybench asciiarraybench.cpp
+ *   ./asciiarraybench [megabytes]
+ *
+ * The default is 256 MB of text for each of the two arrays.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoInput.h>
+#include <Inventor/SoOutput.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/actions/SoWriteAction.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+
+static void *
+write_buffer(SoNode * node, size_t & size)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  root->addChild(node);
+
+  SoOutput out;
+  out.setBuffer(malloc(1024), 1024, realloc);
+  SoWriteAction wa(&out);
+  wa.apply(root);
+  void * buf;
+  out.getBuffer(buf, size);
+  root->unref();
+  return buf;
+}
+
+static SoNode *
+make_points(int megabytes)
+{
+  // about 30 bytes of text per point, like "12.345 -0.0625 1024.5,\n"
+  const int num = (int)((double)megabytes * 1024 * 1024 / 30);
+  SoCoordinate3 * coords = new SoCoordinate3;
+  coords->point.setNum(num);
+  SbVec3f * pts = coords->point.startEditing();
+  for (int i = 0; i < num; i++) {
+    pts[i].setValue((float)(i % 1000) * 0.125f + 0.001f * (float)(i % 7),
+                    (float)sin((double)i) * 100.0f,
+                    (float)(i / 1000) * -0.5f);
+  }
+  coords->point.finishEditing();
+  return coords;
+}
+
+static SoNode *
+make_indices(int megabytes)
+{
+  // about 8 bytes of text per index, like "123456, "
+  const int num = (int)((double)megabytes * 1024 * 1024 / 8);
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  ifs->coordIndex.setNum(num);
+  int32_t * idx = ifs->coordIndex.startEditing();
+  for (int i = 0; i < num; i++) {
+    idx[i] = ((i % 4) == 3) ? -1 : (i / 2) % 1000000;
+  }
+  ifs->coordIndex.finishEditing();
+  return ifs;
+}
+
+static double
+read_buffer(void * buf, size_t size)
+{
+  SoInput in;
+  SbTime start = SbTime::getTimeOfDay();
+  in.setBuffer(buf, size);
+  SoSeparator * root = SoDB::readAll(&in);
+  double elapsed = (SbTime::getTimeOfDay() - start).getValue();
+  if (!root) {
+    fprintf(stderr, "unable to read buffer\n");
+    exit(1);
+  }
+  root->ref();
+  root->unref();
+  return elapsed;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int megabytes = argc > 1 ? atoi(argv[1]) : 256;
+
+  size_t pointsize, indexsize;
+  void * points = write_buffer(make_points(megabytes), pointsize);
+  void * indices = write_buffer(make_indices(megabytes), indexsize);
+  const double pointmb = (double)pointsize / (1024 * 1024);
+  const double indexmb = (double)indexsize / (1024 * 1024);
+  fprintf(stdout, "SoMFVec3f: %.1f MB of text, SoMFInt32: %.1f MB of text\n",
+          pointmb, indexmb);
+
+  for (int i = 0; i < 3; i++) {
+    const double pointtime = read_buffer(points, pointsize);
+    const double indextime = read_buffer(indices, indexsize);
+    fprintf(stdout, "SoMFVec3f: %7.3f s, %8.1f MB/s   "
+            "SoMFInt32: %7.3f s, %8.1f MB/s\n",
+            pointtime, pointmb / pointtime, indextime, indexmb / indextime);
+  }
+
+  free(points);
+  free(indices);
+  return 0;
+}
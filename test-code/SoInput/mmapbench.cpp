@@ -0,0 +1,135 @@
+/************************************************************************
+ *
+ * SoInput file loading benchmark
+ *
+ * Writes a large binary Inventor file with an SoCoordinate3 and an
+ * SoIndexedFaceSet, then reads it back twice: once with
+ * SoInput::openFile(), which memory maps big files and parses them
+ * in place, and once through SoInput::setFilePointer(), which reads
+ * the file through fread() into an intermediate buffer.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build mmapbench mmapbench.cpp
+ *   ./mmapbench [megabytes] [filename]
+ *
+ * The default is a 1024 MB file in the current directory. Setting
+ * the COIN_SOINPUT_NO_MMAP environment variable to 1 disables memory
+ * mapping in openFile() as well.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoInput.h>
+#include <Inventor/SoOutput.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/actions/SoWriteAction.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+
+static void
+write_file(const char * filename, int megabytes)
+{
+  // 12 bytes per vertex and 16 bytes per triangle (3 indices + -1),
+  // with about twice as many triangles as vertices on a grid
+  const int bytes = megabytes * 1024 * 1024;
+  const int numverts = bytes / (12 + 2 * 16);
+  const int side = (int)sqrt((double)numverts);
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+
+  SoCoordinate3 * coords = new SoCoordinate3;
+  coords->point.setNum(side * side);
+  SbVec3f * pts = coords->point.startEditing();
+  for (int y = 0; y < side; y++) {
+    for (int x = 0; x < side; x++) {
+      pts[y * side + x].setValue((float)x, (float)y, (float)((x * y) % 17));
+    }
+  }
+  coords->point.finishEditing();
+  root->addChild(coords);
+
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  ifs->coordIndex.setNum((side - 1) * (side - 1) * 8);
+  int32_t * idx = ifs->coordIndex.startEditing();
+  for (int y = 0; y < side - 1; y++) {
+    for (int x = 0; x < side - 1; x++) {
+      const int32_t i0 = y * side + x;
+      *idx++ = i0; *idx++ = i0 + 1; *idx++ = i0 + side + 1; *idx++ = -1;
+      *idx++ = i0; *idx++ = i0 + side + 1; *idx++ = i0 + side; *idx++ = -1;
+    }
+  }
+  ifs->coordIndex.finishEditing();
+  root->addChild(ifs);
+
+  SoOutput out;
+  if (!out.openFile(filename)) {
+    fprintf(stderr, "unable to open %s for writing\n", filename);
+    exit(1);
+  }
+  out.setBinary(TRUE);
+  SoWriteAction wa(&out);
+  wa.apply(root);
+  out.closeFile();
+  root->unref();
+}
+
+static double
+read_file(const char * filename, SbBool usefilepointer)
+{
+  SoInput in;
+  FILE * fp = NULL;
+  SbTime start = SbTime::getTimeOfDay();
+  if (usefilepointer) {
+    fp = fopen(filename, "rb");
+    if (!fp) {
+      fprintf(stderr, "unable to open %s\n", filename);
+      exit(1);
+    }
+    in.setFilePointer(fp);
+  }
+  else if (!in.openFile(filename)) {
+    fprintf(stderr, "unable to open %s\n", filename);
+    exit(1);
+  }
+  SoSeparator * root = SoDB::readAll(&in);
+  double elapsed = (SbTime::getTimeOfDay() - start).getValue();
+  if (!root) {
+    fprintf(stderr, "unable to read %s\n", filename);
+    exit(1);
+  }
+  root->ref();
+  root->unref();
+  in.closeFile();
+  if (fp) fclose(fp);
+  return elapsed;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int megabytes = argc > 1 ? atoi(argv[1]) : 1024;
+  const char * filename = argc > 2 ? argv[2] : "mmapbench.iv";
+
+  fprintf(stdout, "writing %d MB binary file %s...\n", megabytes, filename);
+  write_file(filename, megabytes);
+
+  // first read warms up the OS file cache, so both ways read from memory
+  (void)read_file(filename, TRUE);
+
+  for (int i = 0; i < 3; i++) {
+    const double mapped = read_file(filename, FALSE);
+    const double buffered = read_file(filename, TRUE);
+    fprintf(stdout, "openFile() (mapped): %7.3f s, %8.1f MB/s   "
+            "setFilePointer() (fread): %7.3f s, %8.1f MB/s\n",
+            mapped, megabytes / mapped, buffered, megabytes / buffered);
+  }
+  return 0;
+}
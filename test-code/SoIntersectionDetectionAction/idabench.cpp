@@ -0,0 +1,122 @@
+/************************************************************************
+ *
+ * SoIntersectionDetectionAction scaling benchmark
+ *
+ * Sets up a plant-like scene: a 3D grid of pipes (cylinders) and
+ * valves (spheres), where neighbouring shapes touch or overlap, and
+ * runs an SoIntersectionDetectionAction on it for an increasing number
+ * of threads (see SoIntersectionDetectionAction::setNumThreads()),
+ * with both ordered and unordered callbacks.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build idabench idabench.cpp
+ *   ./idabench [shapes] [maxthreads]
+ *
+ * The default is 4000 shapes, tested with 1, 2, 4, ... up to 8
+ * threads.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoInteraction.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/collision/SoIntersectionDetectionAction.h>
+#include <Inventor/nodes/SoComplexity.h>
+#include <Inventor/nodes/SoCylinder.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoSphere.h>
+#include <Inventor/nodes/SoTransform.h>
+
+static int numhits = 0;
+
+static SoIntersectionDetectionAction::Resp
+intersection_callback(void * closure,
+                      const SoIntersectingPrimitive * p1,
+                      const SoIntersectingPrimitive * p2)
+{
+  numhits++;
+  return SoIntersectionDetectionAction::NEXT_PRIMITIVE;
+}
+
+static SoSeparator *
+make_scene(int numshapes)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoComplexity * complexity = new SoComplexity;
+  complexity->value = 0.6f;
+  root->addChild(complexity);
+
+  const int side = (int)ceil(pow((double)numshapes, 1.0 / 3.0));
+  for (int i = 0; i < numshapes; i++) {
+    const int x = i % side, y = (i / side) % side, z = i / (side * side);
+    SoSeparator * sep = new SoSeparator;
+    SoTransform * transform = new SoTransform;
+    transform->translation.setValue(x * 2.0f, y * 2.0f, z * 2.0f);
+    if (i % 3) {
+      // a pipe along one of the axes, reaching into the next cell
+      transform->rotation.setValue(SbVec3f(i % 2, 0, (i + 1) % 2), (float)M_PI / 2.0f);
+      SoCylinder * pipe = new SoCylinder;
+      pipe->radius = 0.3f;
+      pipe->height = 2.2f;
+      sep->addChild(transform);
+      sep->addChild(pipe);
+    }
+    else {
+      SoSphere * valve = new SoSphere;
+      valve->radius = 0.6f;
+      sep->addChild(transform);
+      sep->addChild(valve);
+    }
+    root->addChild(sep);
+  }
+  return root;
+}
+
+static double
+run(SoNode * root, int numthreads,
+    SoIntersectionDetectionAction::CallbackOrdering ordering)
+{
+  SoIntersectionDetectionAction ida;
+  ida.setNumThreads(numthreads);
+  ida.setCallbackOrdering(ordering);
+  ida.setIntersectionDetectionEpsilon(0.01f);
+  ida.addIntersectionCallback(intersection_callback, NULL);
+
+  numhits = 0;
+  SbTime start = SbTime::getTimeOfDay();
+  ida.apply(root);
+  return (SbTime::getTimeOfDay() - start).getValue();
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+  SoInteraction::init();
+
+  const int numshapes = argc > 1 ? atoi(argv[1]) : 4000;
+  const int maxthreads = argc > 2 ? atoi(argv[2]) : 8;
+
+  SoSeparator * root = make_scene(numshapes);
+  fprintf(stdout, "%d shapes\n", numshapes);
+
+  double serial = 0.0;
+  for (int threads = 1; threads <= maxthreads; threads *= 2) {
+    const double ordered = run(root, threads, SoIntersectionDetectionAction::ORDERED);
+    const int orderedhits = numhits;
+    const double unordered = run(root, threads, SoIntersectionDetectionAction::UNORDERED);
+    if (threads == 1) serial = ordered;
+    fprintf(stdout, "%2d thread(s): ordered %7.3f s (speedup %5.2f, %d hits), "
+            "unordered %7.3f s (speedup %5.2f, %d hits)\n",
+            threads, ordered, serial / ordered, orderedhits,
+            unordered, serial / unordered, numhits);
+  }
+
+  root->unref();
+  return 0;
+}
@@ -0,0 +1,145 @@
+/************************************************************************
+ *
+ * SoMField value sharing benchmark
+ *
+ * Builds a scene graph like a CAD assembly: a number of parts, each
+ * with an SoCoordinate3, an SoNormal and an SoIndexedFaceSet with a
+ * few thousand values in each field. The scene is then copied a
+ * number of times, and the copies are changed in a few fields, as
+ * when an application instantiates and modifies parts. The copies
+ * are made with SoNode::copy(), both with the default behaviour, which
+ * copies the values, and with SoFieldContainer::setCopySharesValues()
+ * enabled, which lets the copied fields share the values with the
+ * original.
+ *
+ * Prints the average time per copy, and the number of bytes of field
+ * values allocated for all the copies (counting shared arrays once).
+ *
+ * Build and run with:
+ *
+ *   coin-config --build copybench copybench.cpp
+ *   ./copybench [parts] [points] [copies]
+ *
+ * The default is 200 parts with 5000 points each, and 20 copies.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/fields/SoFieldContainer.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoNormal.h>
+#include <Inventor/nodes/SoSeparator.h>
+
+static size_t
+count_bytes(SoNode * root, std::set<const void *> & seen)
+{
+  size_t bytes = 0;
+  SoSearchAction sa;
+  sa.setInterest(SoSearchAction::ALL);
+  sa.setType(SoCoordinate3::getClassTypeId());
+  sa.apply(root);
+  for (int i = 0; i < sa.getPaths().getLength(); i++) {
+    SoCoordinate3 * c = (SoCoordinate3 *)sa.getPaths()[i]->getTail();
+    if (seen.insert(c->point.getValues(0)).second) bytes += c->point.getNum() * sizeof(SbVec3f);
+  }
+  sa.setType(SoNormal::getClassTypeId());
+  sa.apply(root);
+  for (int i = 0; i < sa.getPaths().getLength(); i++) {
+    SoNormal * n = (SoNormal *)sa.getPaths()[i]->getTail();
+    if (seen.insert(n->vector.getValues(0)).second) bytes += n->vector.getNum() * sizeof(SbVec3f);
+  }
+  sa.setType(SoIndexedFaceSet::getClassTypeId());
+  sa.apply(root);
+  for (int i = 0; i < sa.getPaths().getLength(); i++) {
+    SoIndexedFaceSet * f = (SoIndexedFaceSet *)sa.getPaths()[i]->getTail();
+    if (seen.insert(f->coordIndex.getValues(0)).second) bytes += f->coordIndex.getNum() * sizeof(int32_t);
+  }
+  return bytes;
+}
+
+static void
+run(SoSeparator * root, int parts, int copies, SbBool share, const char * name)
+{
+  SoNode ** copied = new SoNode*[copies];
+  SbTime start = SbTime::getTimeOfDay();
+  for (int i = 0; i < copies; i++) {
+    SoFieldContainer::setCopySharesValues(share);
+    copied[i] = root->copy();
+    copied[i]->ref();
+  }
+  SoFieldContainer::setCopySharesValues(FALSE);
+  double copytime = (SbTime::getTimeOfDay() - start).getValue();
+
+  // modify one part of each copy
+  start = SbTime::getTimeOfDay();
+  for (int i = 0; i < copies; i++) {
+    SoSeparator * part = (SoSeparator *)((SoSeparator *)copied[i])->getChild(i % parts);
+    ((SoCoordinate3 *)part->getChild(0))->point.set1Value(0, SbVec3f(-1.0f, -1.0f, -1.0f));
+  }
+  double edittime = (SbTime::getTimeOfDay() - start).getValue();
+
+  std::set<const void *> seen;
+  size_t original = count_bytes(root, seen);
+  size_t total = 0;
+  for (int i = 0; i < copies; i++) total += count_bytes(copied[i], seen);
+
+  fprintf(stdout, "%-7s copy %8.3f ms per copy, edit %8.3f ms per copy, "
+          "%.1f MB of values in the original, %.1f MB in the copies\n",
+          name, 1000.0 * copytime / copies, 1000.0 * edittime / copies,
+          original / 1048576.0, total / 1048576.0);
+
+  for (int i = 0; i < copies; i++) copied[i]->unref();
+  delete[] copied;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int parts = argc > 1 ? atoi(argv[1]) : 200;
+  const int points = argc > 2 ? atoi(argv[2]) : 5000;
+  const int copies = argc > 3 ? atoi(argv[3]) : 20;
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  for (int p = 0; p < parts; p++) {
+    SoSeparator * part = new SoSeparator;
+    SoCoordinate3 * coords = new SoCoordinate3;
+    SoNormal * normals = new SoNormal;
+    SoIndexedFaceSet * faces = new SoIndexedFaceSet;
+    coords->point.setNum(points);
+    SbVec3f * c = coords->point.startEditing();
+    normals->vector.setNum(points);
+    SbVec3f * n = normals->vector.startEditing();
+    for (int i = 0; i < points; i++) {
+      c[i].setValue(float(p), float(i % 100), float(i / 100));
+      n[i].setValue(0.0f, 0.0f, 1.0f);
+    }
+    coords->point.finishEditing();
+    normals->vector.finishEditing();
+    faces->coordIndex.setNum((points - 2) * 4);
+    int32_t * idx = faces->coordIndex.startEditing();
+    for (int i = 0; i < points - 2; i++) {
+      idx[i*4] = i; idx[i*4+1] = i + 1; idx[i*4+2] = i + 2; idx[i*4+3] = -1;
+    }
+    faces->coordIndex.finishEditing();
+    part->addChild(coords);
+    part->addChild(normals);
+    part->addChild(faces);
+    root->addChild(part);
+  }
+  fprintf(stdout, "%d parts with %d points, %d copies\n", parts, points, copies);
+
+  run(root, parts, copies, FALSE, "copy()");
+  run(root, parts, copies, TRUE, "shared");
+
+  root->unref();
+  return 0;
+}
@@ -0,0 +1,156 @@
+/************************************************************************
+ *
+ * SoRayPickAction pick latency benchmark
+ *
+ * Sets up a terrain-like SoIndexedFaceSet with a large number of
+ * triangles, and picks it with random rays from above, both for the
+ * nearest hit and with pickAll set. Each series is timed without the
+ * shape's BVH cache (by touching the shape before each pick), for the
+ * pick that builds the cache, and with the cache in place. The picked
+ * points with and without the cache are compared.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build pickbench pickbench.cpp
+ *   ./pickbench [gridsize] [picks]
+ *
+ * The default is a 512x512 grid of quads (524288 triangles), and
+ * 1000 picks.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoPickedPoint.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoRayPickAction.h>
+#include <Inventor/details/SoFaceDetail.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoVertexProperty.h>
+
+static SoIndexedFaceSet *
+make_terrain(int n)
+{
+  SoVertexProperty * vp = new SoVertexProperty;
+  vp->vertex.setNum((n + 1) * (n + 1));
+  SbVec3f * v = vp->vertex.startEditing();
+  for (int j = 0; j <= n; j++) {
+    for (int i = 0; i <= n; i++) {
+      const float x = float(i) / n, y = float(j) / n;
+      v[j * (n + 1) + i].setValue(x, y, 0.05f * (float) (sin(x * 40.0) * cos(y * 30.0)));
+    }
+  }
+  vp->vertex.finishEditing();
+
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  ifs->vertexProperty = vp;
+  ifs->coordIndex.setNum(n * n * 5);
+  int32_t * idx = ifs->coordIndex.startEditing();
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < n; i++) {
+      const int base = j * (n + 1) + i;
+      *idx++ = base;
+      *idx++ = base + 1;
+      *idx++ = base + n + 2;
+      *idx++ = base + n + 1;
+      *idx++ = -1;
+    }
+  }
+  ifs->coordIndex.finishEditing();
+  return ifs;
+}
+
+class pick_result {
+public:
+  int numpoints;
+  SbVec3f point;
+  int face;
+};
+
+static pick_result
+pick(SoNode * root, const SbVec3f & start, SbBool pickall)
+{
+  SoRayPickAction ra(SbViewportRegion(100, 100));
+  ra.setRay(start, SbVec3f(0.1f, 0.05f, -1.0f));
+  ra.setPickAll(pickall);
+  ra.apply(root);
+
+  pick_result result;
+  result.numpoints = ra.getPickedPointList().getLength();
+  result.face = -1;
+  const SoPickedPoint * pp = ra.getPickedPoint();
+  if (pp) {
+    result.point = pp->getObjectPoint();
+    const SoDetail * detail = pp->getDetail();
+    if (detail && detail->isOfType(SoFaceDetail::getClassTypeId())) {
+      result.face = ((const SoFaceDetail *) detail)->getFaceIndex();
+    }
+  }
+  return result;
+}
+
+static void
+run_series(SoSeparator * root, SoIndexedFaceSet * ifs, int numpicks, SbBool pickall)
+{
+  SbVec3f * starts = new SbVec3f[numpicks];
+  pick_result * expected = new pick_result[numpicks];
+  srand(1234);
+  for (int i = 0; i < numpicks; i++) {
+    starts[i].setValue(float(rand()) / RAND_MAX, float(rand()) / RAND_MAX, 1.0f);
+  }
+
+  SbTime start = SbTime::getTimeOfDay();
+  for (int i = 0; i < numpicks; i++) {
+    ifs->touch(); // discards the BVH cache
+    expected[i] = pick(root, starts[i], pickall);
+  }
+  const double nocache = (SbTime::getTimeOfDay() - start).getValue() / numpicks;
+
+  start = SbTime::getTimeOfDay();
+  (void) pick(root, starts[0], pickall);
+  const double build = (SbTime::getTimeOfDay() - start).getValue();
+
+  int mismatches = 0;
+  start = SbTime::getTimeOfDay();
+  for (int i = 0; i < numpicks; i++) {
+    pick_result result = pick(root, starts[i], pickall);
+    if (result.numpoints != expected[i].numpoints || result.face != expected[i].face ||
+        (result.numpoints && result.point != expected[i].point)) {
+      mismatches++;
+    }
+  }
+  const double cached = (SbTime::getTimeOfDay() - start).getValue() / numpicks;
+
+  fprintf(stdout, "%-8s: no cache %9.3f ms/pick, building cache %9.3f ms, "
+          "cached %8.4f ms/pick (speedup %7.1f), %d mismatches\n",
+          pickall ? "pickAll" : "nearest", nocache * 1000.0, build * 1000.0,
+          cached * 1000.0, nocache / cached, mismatches);
+
+  delete[] starts;
+  delete[] expected;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int gridsize = argc > 1 ? atoi(argv[1]) : 512;
+  const int numpicks = argc > 2 ? atoi(argv[2]) : 1000;
+
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoIndexedFaceSet * ifs = make_terrain(gridsize);
+  root->addChild(ifs);
+  fprintf(stdout, "%d triangles, %d picks\n", gridsize * gridsize * 2, numpicks);
+
+  run_series(root, ifs, numpicks, FALSE);
+  run_series(root, ifs, numpicks, TRUE);
+
+  root->unref();
+  return 0;
+}
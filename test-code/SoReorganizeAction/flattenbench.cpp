@@ -0,0 +1,144 @@
+/************************************************************************
+ *
+ * SoReorganizeAction shape merging benchmark
+ *
+ * Generates a CAD-like scene with a large number of small parts, each
+ * under its own SoSeparator with a translation, a material from a
+ * small palette and a low-complexity cube or cylinder. The scene is
+ * flattened with SoReorganizeAction::mergeShapes(), and the time used
+ * by the action and the number of nodes before and after are
+ * printed. Both scene graphs are then rendered offscreen, and the
+ * average render time (SoOffscreenRenderer::render(), which waits for
+ * OpenGL to finish) is printed for each.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build flattenbench flattenbench.cpp
+ *   ./flattenbench [parts] [frames]
+ *
+ * The default is 200000 parts, and 50 frames.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SoOffscreenRenderer.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoGLRenderAction.h>
+#include <Inventor/actions/SoReorganizeAction.h>
+#include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/nodes/SoComplexity.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoCylinder.h>
+#include <Inventor/nodes/SoDirectionalLight.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoPerspectiveCamera.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+static SoSeparator *
+make_scene(int parts, SoPerspectiveCamera * camera)
+{
+  const int side = (int) ceil(sqrt((double) parts));
+  SoSeparator * root = new SoSeparator;
+  root->addChild(camera);
+  root->addChild(new SoDirectionalLight);
+  SoComplexity * complexity = new SoComplexity;
+  complexity->value = 0.1f;
+  root->addChild(complexity);
+
+  SoMaterial * palette[8];
+  for (int i = 0; i < 8; i++) {
+    palette[i] = new SoMaterial;
+    palette[i]->diffuseColor.setHSVValue(i / 8.0f, 0.6f, 0.9f);
+  }
+
+  srand(1);
+  for (int i = 0; i < parts; i++) {
+    SoSeparator * sep = new SoSeparator;
+    SoTranslation * t = new SoTranslation;
+    t->translation.setValue(float(i % side), 0.0f, float(i / side));
+    sep->addChild(t);
+    sep->addChild(palette[rand() % 8]);
+    if (i % 2) {
+      SoCube * cube = new SoCube;
+      cube->width = cube->height = cube->depth = 0.5f;
+      sep->addChild(cube);
+    }
+    else {
+      SoCylinder * cylinder = new SoCylinder;
+      cylinder->radius = 0.25f;
+      cylinder->height = 0.8f;
+      sep->addChild(cylinder);
+    }
+    root->addChild(sep);
+  }
+  return root;
+}
+
+static int
+count_nodes(SoNode * root)
+{
+  SoSearchAction sa;
+  sa.setType(SoNode::getClassTypeId());
+  sa.setInterest(SoSearchAction::ALL);
+  sa.apply(root);
+  return sa.getPaths().getLength();
+}
+
+static void
+run(SoOffscreenRenderer * renderer, SoNode * root, int frames, const char * name)
+{
+  double render = 0.0;
+  for (int i = -3; i < frames; i++) {
+    SbTime start = SbTime::getTimeOfDay();
+    if (!renderer->render(root)) {
+      fprintf(stderr, "couldn't render offscreen\n");
+      exit(1);
+    }
+    if (i >= 0) render += (SbTime::getTimeOfDay() - start).getValue();
+  }
+  fprintf(stdout, "%-10s render %8.3f ms per frame\n", name, 1000.0 * render / frames);
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int parts = argc > 1 ? atoi(argv[1]) : 200000;
+  const int frames = argc > 2 ? atoi(argv[2]) : 50;
+  const int side = (int) ceil(sqrt((double) parts));
+
+  SoPerspectiveCamera * camera = new SoPerspectiveCamera;
+  camera->position.setValue(side * 0.5f, side * 0.6f, side * 1.2f);
+  camera->pointAt(SbVec3f(side * 0.5f, 0.0f, side * 0.5f));
+  camera->nearDistance = 0.5f;
+  camera->farDistance = side * 3.0f;
+
+  SoSeparator * root = make_scene(parts, camera);
+  root->ref();
+
+  SbTime start = SbTime::getTimeOfDay();
+  SoReorganizeAction reorg;
+  reorg.mergeShapes(TRUE);
+  reorg.apply(root);
+  SoSeparator * flattened = reorg.getSimplifiedSceneGraph();
+  flattened->ref();
+  const double merge = (SbTime::getTimeOfDay() - start).getValue();
+  fprintf(stdout, "%d parts, merged in %.3f s, %d nodes before, %d after\n",
+          parts, merge, count_nodes(root), count_nodes(flattened));
+
+  SbViewportRegion vp(1024, 768);
+  SoOffscreenRenderer * renderer = new SoOffscreenRenderer(vp);
+  run(renderer, root, frames, "original");
+  run(renderer, flattened, frames, "flattened");
+
+  delete renderer;
+  flattened->unref();
+  root->unref();
+  return 0;
+}
@@ -0,0 +1,151 @@
+/************************************************************************
+ *
+ * SoSearchAction benchmark
+ *
+ * Generates a large scene graph of parts, each under its own
+ * SoSeparator with a transform, a material and a shape, grouped in
+ * assemblies. Some of the parts are named, and a few cameras are
+ * spread out in the graph. Then a number of searches by type and by
+ * name are done, with FIRST, LAST and ALL interest, first by
+ * traversal and then with an SoSearchIndex.
+ *
+ * For the index, the time to make it (at the first search) is
+ * printed separately. Then the searches are repeated while the scene
+ * graph is changed between each search, first by setting a field in
+ * a part, and then by adding a part to an assembly, to show the cost
+ * of keeping the index up to date.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build searchbench searchbench.cpp
+ *   ./searchbench [assemblies] [parts] [searches]
+ *
+ * The default is 200 assemblies of 250 parts each (200000 nodes), and
+ * 100 searches of each kind.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/misc/SoSearchIndex.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoPerspectiveCamera.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoSphere.h>
+#include <Inventor/nodes/SoTransform.h>
+
+static SoSeparator *
+make_part(int i)
+{
+  SoSeparator * part = new SoSeparator;
+  SoTransform * t = new SoTransform;
+  t->translation.setValue(float(i % 100), float(i / 100), 0.0f);
+  part->addChild(t);
+  SoMaterial * m = new SoMaterial;
+  m->diffuseColor.setValue(0.8f, 0.5f, 0.2f);
+  part->addChild(m);
+  if (i % 2) part->addChild(new SoCube);
+  else part->addChild(new SoSphere);
+  return part;
+}
+
+static SoSeparator *
+make_scene(int assemblies, int parts)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  char name[32];
+  for (int i = 0; i < assemblies; i++) {
+    SoSeparator * assembly = new SoSeparator;
+    sprintf(name, "assembly%d", i);
+    assembly->setName(name);
+    if (i % 50 == 25) assembly->addChild(new SoPerspectiveCamera);
+    for (int j = 0; j < parts; j++) {
+      SoSeparator * part = make_part(j);
+      if (j % 10 == 0) {
+        sprintf(name, "part%d", j);
+        part->setName(name);
+      }
+      assembly->addChild(part);
+    }
+    root->addChild(assembly);
+  }
+  return root;
+}
+
+enum Change { NONE, FIELD, CHILD };
+
+static double
+run(SoSeparator * root, SoSearchIndex * index, int searches, Change change)
+{
+  static const SoSearchAction::Interest interests[] = {
+    SoSearchAction::FIRST, SoSearchAction::LAST, SoSearchAction::ALL
+  };
+  SoSearchAction sa;
+  sa.setIndex(index);
+  SoSeparator * assembly = (SoSeparator *) root->getChild(root->getNumChildren() / 2);
+  SoTransform * transform = (SoTransform *)
+    ((SoSeparator *) assembly->getChild(assembly->getNumChildren() / 2))->getChild(0);
+  int found = 0;
+  char name[32];
+
+  SbTime start = SbTime::getTimeOfDay();
+  for (int i = 0; i < searches; i++) {
+    for (int k = 0; k < 3; k++) {
+      if (change == FIELD) {
+        transform->translation.setValue(float(i), float(k), 0.0f);
+      }
+      else if (change == CHILD) {
+        assembly->addChild(make_part(i));
+      }
+      sa.reset();
+      sa.setType(SoCamera::getClassTypeId());
+      sa.setInterest(interests[k]);
+      sa.apply(root);
+      found += sa.getPath() ? 1 : sa.getPaths().getLength();
+
+      sa.reset();
+      sprintf(name, "part%d", (i * 10) % 250);
+      sa.setName(name);
+      sa.setInterest(interests[k]);
+      sa.apply(root);
+      found += sa.getPath() ? 1 : sa.getPaths().getLength();
+    }
+  }
+  double t = (SbTime::getTimeOfDay() - start).getValue();
+  if (found == 0) fprintf(stderr, "nothing found\n");
+  return 1000.0 * t / (searches * 6);
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int assemblies = argc > 1 ? atoi(argv[1]) : 200;
+  const int parts = argc > 2 ? atoi(argv[2]) : 250;
+  const int searches = argc > 3 ? atoi(argv[3]) : 100;
+
+  SoSeparator * root = make_scene(assemblies, parts);
+  fprintf(stdout, "%d assemblies, %d nodes\n", assemblies, assemblies * (parts * 4 + 1) + 1);
+
+  fprintf(stdout, "traversal          %10.4f ms per search\n", run(root, NULL, searches, NONE));
+
+  SoSearchIndex * index = new SoSearchIndex(root);
+  SbTime start = SbTime::getTimeOfDay();
+  const int numnodes = index->getNumNodes(); // makes the index
+  fprintf(stdout, "making the index   %10.4f ms for %d nodes\n",
+          1000.0 * (SbTime::getTimeOfDay() - start).getValue(), numnodes);
+  fprintf(stdout, "index              %10.4f ms per search\n", run(root, index, searches, NONE));
+  fprintf(stdout, "index, set field   %10.4f ms per search\n", run(root, index, searches, FIELD));
+  fprintf(stdout, "index, add child   %10.4f ms per search\n", run(root, index, searches, CHILD));
+  fprintf(stdout, "traversal, add child %8.4f ms per search\n", run(root, NULL, searches, CHILD));
+
+  delete index;
+  root->unref();
+  return 0;
+}
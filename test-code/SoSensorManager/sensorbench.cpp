@@ -0,0 +1,117 @@
+/************************************************************************
+ *
+ * SoSensorManager sensor churn benchmark
+ *
+ * Creates a number of delay queue sensors (SoFieldSensor instances
+ * with a few different priorities, attached to the fields of
+ * SoTranslation nodes) and timer queue sensors (SoAlarmSensor
+ * instances with random trigger times), and measures:
+ *
+ *  - scheduling all the delay sensors by changing the fields, and
+ *    processing the delay queue,
+ *  - scheduling and unscheduling the delay sensors in random order,
+ *  - scheduling the timer sensors, unscheduling half of them, and
+ *    processing the timer queue.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build sensorbench sensorbench.cpp
+ *   ./sensorbench [sensors] [rounds]
+ *
+ * The default is 20000 sensors of each kind, and 5 rounds.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/nodes/SoTranslation.h>
+#include <Inventor/sensors/SoAlarmSensor.h>
+#include <Inventor/sensors/SoFieldSensor.h>
+#include <Inventor/sensors/SoSensorManager.h>
+
+static int triggercount = 0;
+
+static void
+trigger_cb(void * data, SoSensor * sensor)
+{
+  triggercount++;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int num = argc > 1 ? atoi(argv[1]) : 20000;
+  const int rounds = argc > 2 ? atoi(argv[2]) : 5;
+  SoSensorManager * sm = SoDB::getSensorManager();
+
+  SoTranslation ** nodes = new SoTranslation*[num];
+  SoFieldSensor ** fieldsensors = new SoFieldSensor*[num];
+  SoAlarmSensor ** alarms = new SoAlarmSensor*[num];
+  for (int i = 0; i < num; i++) {
+    nodes[i] = new SoTranslation;
+    nodes[i]->ref();
+    fieldsensors[i] = new SoFieldSensor(trigger_cb, NULL);
+    fieldsensors[i]->setPriority(50 + (i % 4) * 25);
+    fieldsensors[i]->attach(&nodes[i]->translation);
+    alarms[i] = new SoAlarmSensor(trigger_cb, NULL);
+  }
+  fprintf(stdout, "%d sensors of each kind\n", num);
+
+  double notify = 0.0, process = 0.0, churn = 0.0, timers = 0.0;
+  srand(1);
+  for (int r = 0; r < rounds; r++) {
+    SbTime start = SbTime::getTimeOfDay();
+    for (int i = 0; i < num; i++) {
+      nodes[i]->translation.setValue(float(r), float(i), 0.0f);
+    }
+    SbTime mid = SbTime::getTimeOfDay();
+    triggercount = 0;
+    sm->processDelayQueue(TRUE);
+    SbTime end = SbTime::getTimeOfDay();
+    notify += (mid - start).getValue();
+    process += (end - mid).getValue();
+    if (triggercount != num) fprintf(stderr, "expected %d triggers, got %d\n", num, triggercount);
+
+    start = SbTime::getTimeOfDay();
+    for (int i = 0; i < num; i++) fieldsensors[rand() % num]->schedule();
+    for (int i = 0; i < num; i++) {
+      SoFieldSensor * s = fieldsensors[rand() % num];
+      if (s->isScheduled()) s->unschedule();
+    }
+    for (int i = 0; i < num; i++) {
+      if (fieldsensors[i]->isScheduled()) fieldsensors[i]->unschedule();
+    }
+    churn += (SbTime::getTimeOfDay() - start).getValue();
+
+    start = SbTime::getTimeOfDay();
+    const SbTime now = SbTime::getTimeOfDay();
+    for (int i = 0; i < num; i++) {
+      alarms[i]->setTime(now - SbTime(rand() / (double)RAND_MAX));
+      alarms[i]->schedule();
+    }
+    for (int i = 0; i < num; i += 2) alarms[i]->unschedule();
+    triggercount = 0;
+    sm->processTimerQueue();
+    timers += (SbTime::getTimeOfDay() - start).getValue();
+    if (triggercount != num / 2) fprintf(stderr, "expected %d timer triggers, got %d\n", num / 2, triggercount);
+  }
+
+  fprintf(stdout, "notify %8.3f ms, process delay queue %8.3f ms, "
+          "schedule/unschedule %8.3f ms, timers %8.3f ms per round\n",
+          1000.0 * notify / rounds, 1000.0 * process / rounds,
+          1000.0 * churn / rounds, 1000.0 * timers / rounds);
+
+  for (int i = 0; i < num; i++) {
+    delete fieldsensors[i];
+    delete alarms[i];
+    nodes[i]->unref();
+  }
+  delete[] nodes;
+  delete[] fieldsensors;
+  delete[] alarms;
+  return 0;
+}
@@ -0,0 +1,125 @@
+/************************************************************************
+ *
+ * SoVRMLCoordinateInterpolator morph benchmark
+ *
+ * Morphs a mesh with a large number of vertices between a few key
+ * shapes with an SoVRMLCoordinateInterpolator connected to an
+ * SoVRMLCoordinate node, like a morph animation does. For each
+ * frame, set_fraction is changed and the point field of the
+ * SoVRMLCoordinate node is read, which evaluates the interpolator.
+ *
+ * The same is then done for the normals of the mesh with an
+ * SoInterpolateVec3f engine, and for one rotation per vertex with an
+ * SoInterpolateRotation engine.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build morphbench morphbench.cpp
+ *   ./morphbench [vertices] [frames]
+ *
+ * The default is 1000000 vertices, and 60 frames.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/VRMLnodes/SoVRMLCoordinate.h>
+#include <Inventor/VRMLnodes/SoVRMLCoordinateInterpolator.h>
+#include <Inventor/engines/SoInterpolateRotation.h>
+#include <Inventor/engines/SoInterpolateVec3f.h>
+#include <Inventor/fields/SoMFRotation.h>
+#include <Inventor/fields/SoMFVec3f.h>
+
+static const int NUMKEYS = 3;
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int num = argc > 1 ? atoi(argv[1]) : 1000000;
+  const int frames = argc > 2 ? atoi(argv[2]) : 60;
+  fprintf(stdout, "%d vertices, %d key shapes\n", num, NUMKEYS);
+
+  SoVRMLCoordinateInterpolator * interpolator = new SoVRMLCoordinateInterpolator;
+  interpolator->ref();
+  interpolator->key.setNum(NUMKEYS);
+  for (int k = 0; k < NUMKEYS; k++) {
+    interpolator->key.set1Value(k, float(k) / (NUMKEYS - 1));
+  }
+  interpolator->keyValue.setNum(NUMKEYS * num);
+  SbVec3f * keyvalues = interpolator->keyValue.startEditing();
+  for (int k = 0; k < NUMKEYS; k++) {
+    const float scale = 1.0f + 0.5f * k;
+    for (int i = 0; i < num; i++) {
+      const float angle = 6.28f * i / num;
+      keyvalues[k * num + i].setValue(scale * cos(angle), float(i % 100) * 0.01f,
+                                      scale * sin(angle));
+    }
+  }
+  interpolator->keyValue.finishEditing();
+
+  SoVRMLCoordinate * coord = new SoVRMLCoordinate;
+  coord->ref();
+  coord->point.connectFrom(&interpolator->value_changed);
+
+  double time = 0.0;
+  for (int f = 0; f < frames; f++) {
+    interpolator->set_fraction = float(f) / frames;
+    SbTime start = SbTime::getTimeOfDay();
+    (void)coord->point.getNum();
+    time += (SbTime::getTimeOfDay() - start).getValue();
+  }
+  fprintf(stdout, "CoordinateInterpolator %8.3f ms per frame\n", 1000.0 * time / frames);
+
+  SoInterpolateVec3f * normals = new SoInterpolateVec3f;
+  normals->ref();
+  normals->input0.setValues(0, num, keyvalues);
+  normals->input1.setValues(0, num, keyvalues + num);
+  SoMFVec3f normalfield;
+  normalfield.connectFrom(&normals->output);
+
+  time = 0.0;
+  for (int f = 0; f < frames; f++) {
+    normals->alpha = float(f) / frames;
+    SbTime start = SbTime::getTimeOfDay();
+    (void)normalfield.getNum();
+    time += (SbTime::getTimeOfDay() - start).getValue();
+  }
+  fprintf(stdout, "InterpolateVec3f       %8.3f ms per frame\n", 1000.0 * time / frames);
+
+  SoInterpolateRotation * rotations = new SoInterpolateRotation;
+  rotations->ref();
+  rotations->input0.setNum(num);
+  rotations->input1.setNum(num);
+  SbRotation * r0 = rotations->input0.startEditing();
+  SbRotation * r1 = rotations->input1.startEditing();
+  for (int i = 0; i < num; i++) {
+    r0[i].setValue(keyvalues[i], 0.5f);
+    r1[i].setValue(keyvalues[num + i], -1.0f);
+  }
+  rotations->input0.finishEditing();
+  rotations->input1.finishEditing();
+  SoMFRotation rotationfield;
+  rotationfield.connectFrom(&rotations->output);
+
+  time = 0.0;
+  for (int f = 0; f < frames; f++) {
+    rotations->alpha = float(f) / frames;
+    SbTime start = SbTime::getTimeOfDay();
+    (void)rotationfield.getNum();
+    time += (SbTime::getTimeOfDay() - start).getValue();
+  }
+  fprintf(stdout, "InterpolateRotation    %8.3f ms per frame\n", 1000.0 * time / frames);
+
+  rotationfield.disconnect();
+  normalfield.disconnect();
+  rotations->unref();
+  normals->unref();
+  coord->unref();
+  interpolator->unref();
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+
+#include <Inventor/SoDB.h>
+#include <Inventor/C/threads/sched.h>
+#include <Inventor/C/threads/thread.h>
+
+// This application hammers a cc_sched from several threads at once,
+// to check that the scheduler (running on the work-stealing task
+// scheduler) neither loses nor duplicates jobs. Producer threads
+// schedule jobs with random priorities, and randomly change their
+// priority or unschedule them while the scheduler's threads are
+// running them. Some jobs schedule a follow-up job from the worker
+// thread. Meanwhile, the main thread runs the jobs in batches of
+// random size, waits for all of them now and then, and changes the
+// number of scheduler threads.
+//
+// Afterwards, every job must have run exactly once, except the ones
+// that were successfully unscheduled, which must not have run at all.
+//
+// Build and run with:
+//
+//   coin-config --build sched-attack sched-attack.cpp
+//   ./sched-attack [producers] [jobs per producer]
+
+class job_data {
+public:
+  std::atomic<int> runs;
+  uint32_t schedid;
+  SbBool unscheduled;
+  SbBool followup;
+  job_data * next; // follow-up job, if any
+};
+
+static cc_sched * sched = NULL;
+static std::atomic<int> producers_running(0);
+
+static uint32_t
+random_next(uint32_t & seed)
+{
+  seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+  return seed;
+}
+
+static void
+job_callback(void * closure)
+{
+  job_data * job = (job_data *) closure;
+  job->runs.fetch_add(1);
+  if (job->next) {
+    job->next->schedid = cc_sched_schedule(sched, job_callback, job->next, 1000.0f);
+  }
+}
+
+class producer_data {
+public:
+  job_data * jobs;
+  int numjobs;
+  uint32_t seed;
+};
+
+static void *
+producer_callback(void * closure)
+{
+  producer_data * data = (producer_data *) closure;
+  for (int i = 0; i < data->numjobs; i++) {
+    job_data * job = &data->jobs[i];
+    if (job->followup) continue; // scheduled by the job before it
+    const float priority = (float)(random_next(data->seed) % 100);
+    job->schedid = cc_sched_schedule(sched, job_callback, job, priority);
+
+    // mess with one of the recently scheduled jobs
+    const int other = i - (int)(random_next(data->seed) % 16);
+    if (other < 0 || data->jobs[other].followup) continue;
+    switch (random_next(data->seed) % 4) {
+    case 0:
+      if (cc_sched_unschedule(sched, data->jobs[other].schedid)) {
+        data->jobs[other].unscheduled = TRUE;
+      }
+      break;
+    case 1:
+      cc_sched_change_priority(sched, data->jobs[other].schedid,
+                               (float)(random_next(data->seed) % 100));
+      break;
+    default:
+      break;
+    }
+  }
+  producers_running.fetch_sub(1);
+  return NULL;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int numproducers = argc > 1 ? atoi(argv[1]) : 4;
+  const int numjobs = argc > 2 ? atoi(argv[2]) : 100000;
+
+  sched = cc_sched_construct(4);
+
+  producer_data * producers = new producer_data[numproducers];
+  cc_thread ** threads = new cc_thread*[numproducers];
+  producers_running.store(numproducers);
+  for (int p = 0; p < numproducers; p++) {
+    producers[p].jobs = new job_data[numjobs];
+    producers[p].numjobs = numjobs;
+    producers[p].seed = 0x9e3779b9u * (p + 1);
+    for (int i = 0; i < numjobs; i++) {
+      job_data * job = &producers[p].jobs[i];
+      job->runs.store(0);
+      job->schedid = 0;
+      job->unscheduled = FALSE;
+      job->next = NULL;
+      // every 8th job is a follow-up of the one before it
+      job->followup = (i % 8) == 7;
+      if (job->followup) producers[p].jobs[i - 1].next = job;
+    }
+  }
+  for (int p = 0; p < numproducers; p++) {
+    threads[p] = cc_thread_construct(producer_callback, &producers[p]);
+  }
+
+  uint32_t seed = 12345;
+  int round = 0;
+  while (producers_running.load() > 0) {
+    switch (random_next(seed) % 8) {
+    case 0:
+      cc_sched_wait_all(sched);
+      break;
+    case 1:
+      cc_sched_set_num_threads(sched, 1 + (int)(random_next(seed) % 6));
+      break;
+    case 2:
+      cc_sched_set_num_allowed(sched, -1);
+      break;
+    default:
+      cc_sched_set_num_allowed(sched, (int)(random_next(seed) % 200));
+      break;
+    }
+    cc_sleep(0.001f);
+    round++;
+  }
+  for (int p = 0; p < numproducers; p++) {
+    cc_thread_join(threads[p], NULL);
+    cc_thread_destruct(threads[p]);
+  }
+  cc_sched_set_num_allowed(sched, -1);
+  cc_sched_wait_all(sched);
+
+  int errors = 0, numrun = 0, numunscheduled = 0;
+  for (int p = 0; p < numproducers; p++) {
+    for (int i = 0; i < numjobs; i++) {
+      job_data * job = &producers[p].jobs[i];
+      const int expected = job->unscheduled ? 0 : 1;
+      // a follow-up job only runs if the job before it did
+      const SbBool skipped = job->followup && (producers[p].jobs[i - 1].runs.load() == 0);
+      if (!skipped && (job->runs.load() != expected)) {
+        if (errors < 10) {
+          fprintf(stderr, "producer %d, job %d: ran %d times, expected %d\n",
+                  p, i, job->runs.load(), expected);
+        }
+        errors++;
+      }
+      numrun += job->runs.load();
+      if (job->unscheduled) numunscheduled++;
+    }
+    delete[] producers[p].jobs;
+  }
+  delete[] producers;
+  delete[] threads;
+  cc_sched_destruct(sched);
+
+  fprintf(stdout, "%d jobs run, %d unscheduled, %d scheduler changes: %s\n",
+          numrun, numunscheduled, round, errors ? "FAILED" : "ok");
+  return errors ? 1 : 0;
+}
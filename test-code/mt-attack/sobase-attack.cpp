@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/C/threads/thread.h>
+#include <Inventor/lists/SoAuditorList.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+// This application hammers the reference counting and the auditor
+// bookkeeping of SoBase from several threads at once, and measures
+// the throughput for an increasing number of threads.
+//
+// A pool of nodes is shared by all threads. In the first phase, each
+// thread refs and unrefs random nodes from the pool. In the second
+// phase, each thread repeatedly attaches random shared nodes to a
+// private SoSeparator and detaches them again, which adds and removes
+// the separator as an auditor of the shared node, and touches a node
+// in its private graph, which sends a notification to the separator.
+//
+// Afterwards, the reference count and the number of auditors of every
+// shared node must be the same as before.
+//
+// Build and run with:
+//
+//   coin-config --build sobase-attack sobase-attack.cpp
+//   ./sobase-attack [maxthreads] [operations per thread]
+//
+// The default is 1, 2, 4, ... up to 8 threads, and 1000000
+// operations per thread.
+
+enum { NUM_SHARED = 64 };
+
+static SoCube * shared[NUM_SHARED];
+static std::atomic<int> threads_ready(0);
+static std::atomic<int> go(0);
+
+class thread_data {
+public:
+  int phase;
+  int numops;
+  uint32_t seed;
+  SoSeparator * root;
+  SoTranslation * leaf;
+};
+
+static uint32_t
+random_next(uint32_t & seed)
+{
+  seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+  return seed;
+}
+
+static void *
+thread_callback(void * closure)
+{
+  thread_data * data = (thread_data *) closure;
+  threads_ready.fetch_add(1);
+  while (go.load() == 0) { }
+
+  if (data->phase == 0) {
+    for (int i = 0; i < data->numops; i++) {
+      SoCube * node = shared[random_next(data->seed) % NUM_SHARED];
+      node->ref();
+      node->unref();
+    }
+  }
+  else {
+    for (int i = 0; i < data->numops; i++) {
+      SoCube * node = shared[random_next(data->seed) % NUM_SHARED];
+      data->root->addChild(node);
+      data->leaf->touch();
+      data->root->removeChild(node);
+    }
+  }
+  return NULL;
+}
+
+static double
+run_phase(int phase, int numthreads, int numops)
+{
+  thread_data * data = new thread_data[numthreads];
+  cc_thread ** threads = new cc_thread*[numthreads];
+  threads_ready.store(0);
+  go.store(0);
+  for (int t = 0; t < numthreads; t++) {
+    data[t].phase = phase;
+    data[t].numops = numops;
+    data[t].seed = 0x9e3779b9u * (t + 1);
+    data[t].root = new SoSeparator;
+    data[t].root->ref();
+    data[t].leaf = new SoTranslation;
+    data[t].root->addChild(data[t].leaf);
+    threads[t] = cc_thread_construct(thread_callback, &data[t]);
+  }
+  while (threads_ready.load() < numthreads) { cc_sleep(0.001f); }
+
+  SbTime start = SbTime::getTimeOfDay();
+  go.store(1);
+  for (int t = 0; t < numthreads; t++) {
+    cc_thread_join(threads[t], NULL);
+    cc_thread_destruct(threads[t]);
+  }
+  double elapsed = (SbTime::getTimeOfDay() - start).getValue();
+
+  for (int t = 0; t < numthreads; t++) { data[t].root->unref(); }
+  delete[] data;
+  delete[] threads;
+  return elapsed;
+}
+
+static int
+check_shared(void)
+{
+  int errors = 0;
+  for (int i = 0; i < NUM_SHARED; i++) {
+    const int refcount = shared[i]->getRefCount();
+    const int auditors = shared[i]->getAuditors().getLength();
+    if (refcount != 1 || auditors != 0) {
+      if (errors < 10) {
+        fprintf(stderr, "shared node %d: refcount %d, %d auditors, "
+                "expected 1 and 0\n", i, refcount, auditors);
+      }
+      errors++;
+    }
+  }
+  return errors;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int maxthreads = argc > 1 ? atoi(argv[1]) : 8;
+  const int numops = argc > 2 ? atoi(argv[2]) : 1000000;
+
+  for (int i = 0; i < NUM_SHARED; i++) {
+    shared[i] = new SoCube;
+    shared[i]->ref();
+  }
+
+  static const char * names[] = { "ref/unref", "attach/touch/detach" };
+  // attaching, touching and detaching is a lot slower than ref/unref
+  const int phaseops[] = { numops, numops / 10 };
+
+  int errors = 0;
+  for (int phase = 0; phase < 2; phase++) {
+    fprintf(stdout, "%s: %d operations per thread\n", names[phase], phaseops[phase]);
+    for (int threads = 1; threads <= maxthreads; threads *= 2) {
+      const double elapsed = run_phase(phase, threads, phaseops[phase]);
+      const int phaseerrors = check_shared();
+      fprintf(stdout, "%2d thread(s): %7.3f s, %12.0f operations/s%s\n",
+              threads, elapsed, (double)threads * phaseops[phase] / elapsed,
+              phaseerrors ? " FAILED" : "");
+      errors += phaseerrors;
+    }
+  }
+
+  for (int i = 0; i < NUM_SHARED; i++) { shared[i]->unref(); }
+  fprintf(stdout, "%s\n", errors ? "FAILED" : "ok");
+  return errors ? 1 : 0;
+}
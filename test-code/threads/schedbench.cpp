@@ -0,0 +1,100 @@
+/************************************************************************
+ *
+ * cc_sched scaling benchmark
+ *
+ * Schedules a large number of independent, CPU bound jobs on a
+ * cc_sched and waits for them, for an increasing number of scheduler
+ * threads. This is done for coarse jobs (about a millisecond of work
+ * each) and for fine-grained jobs (about a microsecond each), where
+ * the cost of the scheduling itself dominates.
+ *
+ * Build and run with:
+ *
+ *   coin-config --build schedbench schedbench.cpp
+ *   ./schedbench [maxthreads] [jobs]
+ *
+ * The default is 1, 2, 4, ... up to 8 threads, and 200000 jobs.
+ *
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/C/threads/sched.h>
+
+class job_data {
+public:
+  int iterations;
+  double result;
+};
+
+static std::atomic<int> jobs_done(0);
+
+static void
+job_callback(void * closure)
+{
+  job_data * job = (job_data *) closure;
+  // some floating point work the compiler can't optimize away
+  double x = job->result;
+  for (int i = 0; i < job->iterations; i++) {
+    x = x * 1.0000001 + 0.5 / (x + 1.0);
+  }
+  job->result = x;
+  jobs_done.fetch_add(1);
+}
+
+static double
+run_jobs(int numthreads, job_data * jobs, int numjobs)
+{
+  cc_sched * sched = cc_sched_construct(numthreads);
+  jobs_done.store(0);
+
+  SbTime start = SbTime::getTimeOfDay();
+  for (int i = 0; i < numjobs; i++) {
+    cc_sched_schedule(sched, job_callback, &jobs[i], 0.0f);
+  }
+  cc_sched_wait_all(sched);
+  double elapsed = (SbTime::getTimeOfDay() - start).getValue();
+
+  if (jobs_done.load() != numjobs) {
+    fprintf(stderr, "only %d of %d jobs were run\n", jobs_done.load(), numjobs);
+    exit(1);
+  }
+  cc_sched_destruct(sched);
+  return elapsed;
+}
+
+static void
+run_series(const char * name, int maxthreads, int numjobs, int iterations)
+{
+  job_data * jobs = new job_data[numjobs];
+  for (int i = 0; i < numjobs; i++) {
+    jobs[i].iterations = iterations;
+    jobs[i].result = (double)i;
+  }
+
+  fprintf(stdout, "%s: %d jobs of %d iterations\n", name, numjobs, iterations);
+  double serial = 0.0;
+  for (int threads = 1; threads <= maxthreads; threads *= 2) {
+    const double elapsed = run_jobs(threads, jobs, numjobs);
+    if (threads == 1) serial = elapsed;
+    fprintf(stdout, "%2d thread(s): %7.3f s, %10.0f jobs/s, speedup %5.2f\n",
+            threads, elapsed, numjobs / elapsed, serial / elapsed);
+  }
+  delete[] jobs;
+}
+
+int
+main(int argc, char ** argv)
+{
+  SoDB::init();
+
+  const int maxthreads = argc > 1 ? atoi(argv[1]) : 8;
+  const int numjobs = argc > 2 ? atoi(argv[2]) : 200000;
+
+  run_series("coarse", maxthreads, numjobs / 100, 200000);
+  run_series("fine-grained", maxthreads, numjobs, 200);
+  return 0;
+}